@@ -49,18 +49,121 @@
 
 #ifdef BUILD_GENTOOLS
 #define gpgrt_log_debug(...)  /**/
+#define STATS_ADD(field,n)    do { } while (0)
+#define STATS_INC(field)      do { } while (0)
 #endif
 
 
 static AsnNode resolve_identifier (AsnNode root, AsnNode node, int nestlevel);
 
+#ifndef BUILD_GENTOOLS
+/* Protects the cache of shared module trees kept in asn1-func2.c.  */
+gpgrt_lock_t _ksba_asn_module_cache_lock = GPGRT_LOCK_INITIALIZER;
+#endif
+
+
+/* A bump allocator for the nodes of a value tree.  All memory used by
+   the nodes (including names and values) is taken from the arena and
+   released in one go with the tree.  */
+#define ARENA_ALIGN        8
+#define ARENA_MIN_BLOCK    8192
+#define ARENA_MAX_BLOCK    65536
+
+struct asn_arena_block_s
+{
+  struct asn_arena_block_s *next;
+  size_t size;   /* Allocated size of DATA.  */
+  size_t used;   /* Used bytes of DATA.  */
+  union { long l; void *p; } data[1];
+};
+
+struct asn_arena_s
+{
+  struct asn_arena_block_s *blocks;  /* Current block first.  */
+  unsigned int nnodes;               /* Number of nodes in the arena.  */
+};
+
+
+static struct asn_arena_s *
+new_arena (void)
+{
+  struct asn_arena_s *arena;
+
+  arena = xmalloc (sizeof *arena);
+  arena->blocks = NULL;
+  arena->nnodes = 0;
+  return arena;
+}
+
+
+void
+_ksba_asn_release_arena (struct asn_arena_s *arena)
+{
+  struct asn_arena_block_s *b, *b2;
+
+  if (!arena)
+    return;
+  STATS_ADD (nodes_freed, arena->nnodes);
+  for (b = arena->blocks; b; b = b2)
+    {
+      b2 = b->next;
+      xfree (b);
+    }
+  xfree (arena);
+}
+
+
+static void *
+arena_alloc (struct asn_arena_s *arena, size_t n)
+{
+  struct asn_arena_block_s *b = arena->blocks;
+  size_t size;
+  void *p;
+
+  n = (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  if (!b || b->size - b->used < n)
+    {
+      size = b? b->size * 2 : ARENA_MIN_BLOCK;
+      if (size > ARENA_MAX_BLOCK)
+        size = ARENA_MAX_BLOCK;
+      if (size < n)
+        size = n;
+      b = xmalloc (sizeof *b + size);
+      b->size = size;
+      b->used = 0;
+      b->next = arena->blocks;
+      arena->blocks = b;
+    }
+  p = (char*)b->data + b->used;
+  b->used += n;
+  return p;
+}
+
+
+static char *
+arena_strdup (struct asn_arena_s *arena, const char *string)
+{
+  size_t n = strlen (string) + 1;
+
+  return memcpy (arena_alloc (arena, n), string, n);
+}
 
+
+/* Allocate a new node.  If ARENA is not NULL the node is taken from
+   that arena.  */
 static AsnNode
-add_node (node_type_t type)
+add_node (node_type_t type, struct asn_arena_s *arena)
 {
   AsnNode punt;
 
-  punt = xmalloc (sizeof *punt);
+  if (arena)
+    {
+      punt = arena_alloc (arena, sizeof *punt);
+      arena->nnodes++;
+    }
+  else
+    punt = xmalloc (sizeof *punt);
+  STATS_INC (nodes_allocated);
 
   punt->left = NULL;
   punt->name = NULL;
@@ -73,13 +176,17 @@ add_node (node_type_t type)
   punt->down = NULL;
   punt->right = NULL;
   punt->link_next = NULL;
+  punt->arena = arena;
+  punt->static_name = 0;
+  punt->static_value = 0;
+  punt->actual_type = 0;
   return punt;
 }
 
 AsnNode
 _ksba_asn_new_node (node_type_t type)
 {
-  return add_node (type);
+  return add_node (type, NULL);
 }
 
 
@@ -129,14 +236,15 @@ _ksba_asn_set_value (AsnNode node,
 {
   return_if_fail (node);
 
-  if (node->valuetype)
+  if (node->valuetype && !node->arena && !node->static_value)
     {
       if (node->valuetype == VALTYPE_CSTR)
         xfree (node->value.v_cstr);
       else if (node->valuetype == VALTYPE_MEM)
         xfree (node->value.v_mem.buf);
-      node->valuetype = 0;
     }
+  node->valuetype = 0;
+  node->static_value = 0;
 
   switch (vtype)
     {
@@ -148,13 +256,19 @@ _ksba_asn_set_value (AsnNode node,
       break;
     case VALTYPE_CSTR:
       return_if_fail (value);
-      node->value.v_cstr = xstrdup (value);
+      if (node->arena)
+        node->value.v_cstr = arena_strdup (node->arena, value);
+      else
+        node->value.v_cstr = xstrdup (value);
       break;
     case VALTYPE_MEM:
       node->value.v_mem.len = len;
       if (len && value)
         {
-          node->value.v_mem.buf = xmalloc (len);
+          if (node->arena)
+            node->value.v_mem.buf = arena_alloc (node->arena, len);
+          else
+            node->value.v_mem.buf = xmalloc (len);
           memcpy (node->value.v_mem.buf, value, len);
         }
       else
@@ -185,6 +299,15 @@ copy_value (AsnNode d, const AsnNode s)
 
   return_if_fail (d != s);
 
+  if (s->valuetype == VALTYPE_CSTR && s->static_value)
+    {
+      _ksba_asn_set_value (d, VALTYPE_NULL, NULL, 0);
+      d->value.v_cstr = s->value.v_cstr;
+      d->valuetype = VALTYPE_CSTR;
+      d->static_value = 1;
+      goto leave;
+    }
+
   switch (s->valuetype)
     {
     case VALTYPE_NULL:
@@ -214,18 +337,32 @@ copy_value (AsnNode d, const AsnNode s)
       return_if_fail (0);
     }
   _ksba_asn_set_value (d, s->valuetype, buf, len);
+ leave:
   d->off = s->off;
   d->nhdr = s->nhdr;
   d->len = s->len;
 }
 
+/* Set the name of D to the name of S.  Static names are shared.  */
+static void
+copy_name (AsnNode d, const AsnNode s)
+{
+  if (s->name && s->static_name)
+    {
+      _ksba_asn_set_name (d, NULL);
+      d->name = s->name;
+      d->static_name = 1;
+    }
+  else
+    _ksba_asn_set_name (d, s->name);
+}
+
 static AsnNode
-copy_node (const AsnNode s)
+copy_node (const AsnNode s, struct asn_arena_s *arena)
 {
-  AsnNode d = add_node (s->type);
+  AsnNode d = add_node (s->type, arena);
 
-  if (s->name)
-    d->name = xstrdup (s->name);
+  copy_name (d, s);
   d->flags = s->flags;
   copy_value (d, s);
   return d;
@@ -243,12 +380,15 @@ _ksba_asn_set_name (AsnNode node, const char *name)
 
   if (node->name)
     {
-      xfree (node->name);
+      if (!node->arena && !node->static_name)
+        xfree (node->name);
       node->name = NULL;
+      node->static_name = 0;
     }
 
   if (name && *name)
-      node->name = xstrdup (name);
+    node->name = (node->arena? arena_strdup (node->arena, name)
+                  /*        */ : xstrdup (name));
 }
 
 
@@ -281,15 +421,17 @@ set_down (AsnNode node, AsnNode down)
 void
 _ksba_asn_remove_node (AsnNode  node)
 {
-  if (node == NULL)
+  if (node == NULL || node->arena)
     return;
 
-  xfree (node->name);
-  if (node->valuetype == VALTYPE_CSTR)
+  if (!node->static_name)
+    xfree (node->name);
+  if (node->valuetype == VALTYPE_CSTR && !node->static_value)
     xfree (node->value.v_cstr);
   else if (node->valuetype == VALTYPE_MEM)
     xfree (node->value.v_mem.buf);
   xfree (node);
+  STATS_INC (nodes_freed);
 }
 
 
@@ -922,7 +1064,7 @@ _ksba_asn_expand_object_id (AsnNode node)
                     {
                       if (p4->type == TYPE_CONSTANT)
                         {
-                          p5 = add_node (TYPE_CONSTANT);
+                          p5 = add_node (TYPE_CONSTANT, p->arena);
                           _ksba_asn_set_name (p5, p4->name);
                           _ksba_asn_set_value (p5, VALTYPE_CSTR,
                                                p4->value.v_cstr, 0);
@@ -1025,7 +1167,7 @@ _ksba_asn_type_set_config (AsnNode node)
 /* Create a copy the tree at SRC_ROOT. s is a helper which should be
    set to SRC_ROOT by the caller */
 static AsnNode
-copy_tree (AsnNode src_root, AsnNode s)
+copy_tree (AsnNode src_root, AsnNode s, struct asn_arena_s *arena)
 {
   AsnNode first=NULL, dprev=NULL, d, down, tmp;
   AsnNode *link_nextp = NULL;
@@ -1033,7 +1175,7 @@ copy_tree (AsnNode src_root, AsnNode s)
   for (; s; s=s->right )
     {
       down = s->down;
-      d = copy_node (s);
+      d = copy_node (s, arena);
       if (link_nextp)
 	*link_nextp = d;
       link_nextp = &d->link_next;
@@ -1048,7 +1190,7 @@ copy_tree (AsnNode src_root, AsnNode s)
       dprev = d;
       if (down)
         {
-          tmp = copy_tree (src_root, down);
+          tmp = copy_tree (src_root, down, arena);
 	  if (tmp)
 	    {
 	      if (link_nextp)
@@ -1117,7 +1259,8 @@ resolve_identifier (AsnNode root, AsnNode node, int nestlevel)
 
 
 static AsnNode
-do_expand_tree (AsnNode src_root, AsnNode s, int depth)
+do_expand_tree (AsnNode src_root, AsnNode s, int depth,
+                struct asn_arena_s *arena)
 {
   AsnNode first=NULL, dprev=NULL, d, down, tmp;
   AsnNode *link_nextp = NULL;
@@ -1142,7 +1285,7 @@ do_expand_tree (AsnNode src_root, AsnNode s, int depth)
               continue;
             }
           down = d->down;
-          d = copy_node (d);
+          d = copy_node (d, arena);
 	  if (link_nextp)
 	    *link_nextp = d;
 	  link_nextp = &d->link_next;
@@ -1157,7 +1300,7 @@ do_expand_tree (AsnNode src_root, AsnNode s, int depth)
           if (s->flags.is_any)
             d->flags.is_any = 1;
           /* we don't want the resolved name - change it back */
-          _ksba_asn_set_name (d, s->name);
+          copy_name (d, s);
           /* copy the default and tag attributes */
           tmp = NULL;
           dp = &tmp;
@@ -1165,7 +1308,7 @@ do_expand_tree (AsnNode src_root, AsnNode s, int depth)
             {
               AsnNode x;
 
-              x = copy_node (s2);
+              x = copy_node (s2, arena);
 	      if (link_nextp)
 		*link_nextp = x;
 	      link_nextp = &x->link_next;
@@ -1182,7 +1325,7 @@ do_expand_tree (AsnNode src_root, AsnNode s, int depth)
         }
       else
         {
-	  d = copy_node (s);
+	  d = copy_node (s, arena);
 	  if (link_nextp)
 	    *link_nextp = d;
 	  link_nextp = &d->link_next;
@@ -1205,7 +1348,7 @@ do_expand_tree (AsnNode src_root, AsnNode s, int depth)
             }
           else
             {
-	      tmp = do_expand_tree (src_root, down, depth+1);
+	      tmp = do_expand_tree (src_root, down, depth+1, arena);
 	      if (tmp)
 		{
 		  if (link_nextp)
@@ -1249,7 +1392,29 @@ _ksba_asn_expand_tree (AsnNode parse_tree, const char *name)
   AsnNode root;
 
   root = name? find_node (parse_tree, name, 1) : parse_tree;
-  return do_expand_tree (parse_tree, root, 0);
+  return do_expand_tree (parse_tree, root, 0, NULL);
+}
+
+
+/* Same as _ksba_asn_expand_tree but allocate all nodes from a new
+   arena.  Such a tree is released at once and thus much faster to
+   create and destroy.  It is meant for trees which are only filled
+   with offsets by the BER decoder; values stored in such a tree are
+   not released before the entire tree.  */
+AsnNode
+_ksba_asn_expand_tree_arena (AsnNode parse_tree, const char *name)
+{
+  struct asn_arena_s *arena;
+  AsnNode root;
+
+  root = name? find_node (parse_tree, name, 1) : parse_tree;
+  if (!root)
+    return NULL;
+  arena = new_arena ();
+  root = do_expand_tree (parse_tree, root, 0, arena);
+  if (!root)
+    _ksba_asn_release_arena (arena);
+  return root;
 }
 
 
@@ -1261,7 +1426,7 @@ _ksba_asn_insert_copy (AsnNode node)
   AsnNode n;
   AsnNode *link_nextp;
 
-  n = copy_tree (node, node);
+  n = copy_tree (node, node, node->arena);
   if (!n)
     return NULL; /* out of core */
   return_null_if_fail (n->right == node->right);
@@ -1315,3 +1480,17 @@ _ksba_asn_find_type_value (const unsigned char *image, AsnNode root, int idx,
     }
   return NULL;
 }
+
+
+#ifndef BUILD_GENTOOLS
+/* Drop a reference to the shared module tree TREE.  The last
+   reference is owned by the module cache and never dropped.  */
+void
+_ksba_asn_unref_tree (ksba_asn_tree_t tree)
+{
+  gpgrt_lock_lock (&_ksba_asn_module_cache_lock);
+  assert (tree->refcount > 1);
+  tree->refcount--;
+  gpgrt_lock_unlock (&_ksba_asn_module_cache_lock);
+}
+#endif /*!BUILD_GENTOOLS*/
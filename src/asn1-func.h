@@ -37,7 +37,7 @@
 
 /* Important: this must match the code in asn1-gentables.c */
 struct node_flag_s {
-  enum tag_class class;
+  unsigned int class:2;       /* enum tag_class */
   unsigned int explicit:1;
   unsigned int implicit:1;
   unsigned int has_imports:1;
@@ -59,8 +59,6 @@ struct node_flag_s {
   unsigned int is_any:1;      /* The der-encoder must change any to a real type
                                  but still be aware that it actually is any */
   unsigned int not_used:1;
-  unsigned int help_down:1;    /* helper for create_tree */
-  unsigned int help_right:1;   /* helper for create_tree */
   unsigned int tag_seen:1;
   unsigned int skip_this:1;   /* helper */
 };
@@ -95,37 +93,51 @@ typedef struct asn_node_struct *AsnNode;
 typedef struct asn_node_struct *asn_node_t;
 #define HAVE_TYPEDEFD_ASNNODE
 #endif
+/* The fields used while walking and searching the tree come first.
+   Names and string values of nodes with the static_ flags point into
+   the string table of asn1-tables.c and are shared by all copies.  */
 struct asn_node_struct {
+  AsnNode down;                  /* Pointer to the son node */
+  AsnNode right;                 /* Pointer to the brother node */
   char *name;                    /* Node name */
-  node_type_t type;
   struct node_flag_s flags;
-
-  enum asn_value_type valuetype;
-  union asn_value_u value;
+  unsigned char type;            /* node_type_t */
+  unsigned char actual_type;     /* ugly helper to overcome TYPE_ANY probs*/
+  unsigned char valuetype;       /* enum asn_value_type */
+  unsigned char static_name:1;   /* NAME is not owned by the node.  */
+  unsigned char static_value:1;  /* V_CSTR is not owned by the node.  */
   int off;                       /* offset of this TLV */
   int nhdr;                      /* length of the header */
   int len;                       /* length part of the TLV */
-  node_type_t actual_type;       /* ugly helper to overcome TYPE_ANY probs*/
+  union asn_value_u value;
 
-  AsnNode down;                  /* Pointer to the son node */
-  AsnNode right;                 /* Pointer to the brother node */
   AsnNode left;                  /* Pointer to the next list element */
   AsnNode link_next;             /* to keep track of all nodes in a tree */
+  struct asn_arena_s *arena;     /* Arena holding the node or NULL.  */
 };
 
 /* Structure to keep an entire ASN.1 parse tree and associated information */
 struct ksba_asn_tree_s {
   AsnNode parse_tree;
   AsnNode node_list;  /* for easier release of all nodes */
+  unsigned int refcount;  /* Users of a shared module tree or 0.  */
+  struct ksba_asn_tree_s *next_shared;  /* Link for the module cache.  */
   char filename[1];
 };
 
 
+/* The tables created by asn1-gentables.  They describe the already
+   resolved tree in pre-order; the links are given as indices into the
+   table with 0 meaning no link.  */
 typedef struct static_struct_asn {
   unsigned int name_off;        /* Node name */
   node_type_t type;             /* Node type */
   struct node_flag_s flags;
-  unsigned int stringvalue_off;
+  unsigned int stringvalue_off; /* Value for VALTYPE_CSTR.  */
+  enum asn_value_type valuetype;
+  long numvalue;                /* Value for VALTYPE_LONG and _ULONG.  */
+  unsigned int down;            /* Index of the first son.  */
+  unsigned int right;           /* Index of the next brother.  */
 } static_asn;
 
 
@@ -147,6 +159,8 @@ int _ksba_asn_expand_object_id(AsnNode node);
 void _ksba_asn_set_default_tag (AsnNode node);
 void _ksba_asn_type_set_config (AsnNode node);
 AsnNode _ksba_asn_expand_tree (AsnNode parse_tree, const char *name);
+AsnNode _ksba_asn_expand_tree_arena (AsnNode parse_tree, const char *name);
+void _ksba_asn_release_arena (struct asn_arena_s *arena);
 AsnNode _ksba_asn_insert_copy (AsnNode node);
 
 int _ksba_asn_is_primitive (node_type_t type);
@@ -160,6 +174,10 @@ AsnNode _ksba_asn_find_type_value (const unsigned char *image,
 
 
 int _ksba_asn_delete_structure (AsnNode root);
+#ifndef BUILD_GENTOOLS
+extern gpgrt_lock_t _ksba_asn_module_cache_lock;
+void _ksba_asn_unref_tree (ksba_asn_tree_t tree);
+#endif
 
 /*-- asn2-func.c --*/
 /*(functions are all declared in ksba.h)*/
@@ -48,50 +48,120 @@
 #include "asn1-func.h"
 
 
-static AsnNode
-set_right (AsnNode  node, AsnNode  right)
+/* The module trees built from the static tables.  They are created
+   on first use and then shared by all users; the cache holds one
+   reference so that they are never released.  The lock is defined in
+   asn1-func.c.  */
+static ksba_asn_tree_t module_cache;
+
+
+/* Build the tree for the module MOD_NAME from the static tables.
+   The tables already describe the resolved tree and give the links
+   as indices; thus we only need to allocate the nodes and connect
+   them.  */
+static gpg_error_t
+build_tree (const char *mod_name, ksba_asn_tree_t *result)
 {
-  if (node == NULL)
-    return node;
-
-  node->right = right;
-  if (right)
-    right->left = node;
-  return node;
-}
-
+  const static_asn *root;
+  const char *strgtbl;
+  AsnNode *nodes;
+  AsnNode p;
+  AsnNode link_next = NULL;
+  unsigned int k, n;
+  ksba_asn_tree_t tree;
 
-static AsnNode
-set_down (AsnNode node, AsnNode down)
-{
-  if (node == NULL)
-    return node;
+  root = _ksba_asn_lookup_table (mod_name, &strgtbl);
+  if (!root)
+    return gpg_error (GPG_ERR_MODULE_NOT_FOUND);
 
-  node->down = down;
-  if (down)
-    down->left = node;
-  return node;
-}
+  for (n=0; root[n].stringvalue_off || root[n].type || root[n].name_off; n++)
+    ;
+  if (!n)
+    return gpg_error (GPG_ERR_GENERAL);
 
+  nodes = xtrycalloc (n, sizeof *nodes);
+  if (!nodes)
+    return gpg_error_from_syserror ();
+  tree = xtrymalloc (sizeof *tree + strlen (mod_name));
+  if (!tree)
+    {
+      gpg_error_t err = gpg_error_from_syserror ();
+      xfree (nodes);
+      return err;
+    }
 
-static AsnNode
-find_up (AsnNode  node)
-{
-  AsnNode p;
+  for (k=0; k < n; k++)
+    {
+      p = _ksba_asn_new_node (root[k].type);
+      p->flags = root[k].flags;
+      p->link_next = link_next;
+      link_next = p;
 
-  if (node == NULL)
-    return NULL;
+      /* The names and strings are used right from the table.  */
+      if (root[k].name_off)
+        {
+          p->name = (char*)strgtbl + root[k].name_off;
+          p->static_name = 1;
+        }
+      switch (root[k].valuetype)
+        {
+        case VALTYPE_CSTR:
+          p->value.v_cstr = (char*)strgtbl + root[k].stringvalue_off;
+          p->valuetype = VALTYPE_CSTR;
+          p->static_value = 1;
+          break;
+        case VALTYPE_LONG:
+          _ksba_asn_set_value (p, VALTYPE_LONG,
+                               &root[k].numvalue, sizeof (long));
+          break;
+        case VALTYPE_ULONG:
+          {
+            unsigned long val = root[k].numvalue;
+            _ksba_asn_set_value (p, VALTYPE_ULONG, &val, sizeof val);
+          }
+          break;
+        default:
+          break;
+        }
+      nodes[k] = p;
+    }
 
-  p = node;
-  while ((p->left != NULL) && (p->left->right == p))
-    p = p->left;
+  for (k=0; k < n; k++)
+    {
+      p = nodes[k];
+      if (root[k].down)
+        {
+          if (root[k].down >= n)
+            goto corrupt;
+          p->down = nodes[root[k].down];
+          p->down->left = p;
+        }
+      if (root[k].right)
+        {
+          if (root[k].right >= n)
+            goto corrupt;
+          p->right = nodes[root[k].right];
+          p->right->left = p;
+        }
+    }
 
-  return p->left;
+  tree->parse_tree = nodes[0];
+  tree->node_list = link_next;
+  tree->refcount = 0;
+  tree->next_shared = NULL;
+  strcpy (tree->filename, mod_name);
+  xfree (nodes);
+  *result = tree;
+  return 0;
+
+ corrupt:
+  _ksba_asn_release_nodes (link_next);
+  xfree (nodes);
+  xfree (tree);
+  return gpg_error (GPG_ERR_GENERAL);
 }
 
 
-
-
 /**
  * Creates the structures needed to manage the ASN1 definitions. ROOT is
  * a vector created by the asn1-gentable tool.
@@ -105,6 +175,10 @@ find_up (AsnNode  node)
  *   KsbaAsntree *result : return the pointer to an object to be used
  *   with other functions.
  *
+ * The returned tree is shared with all other users of the module and
+ * must not be modified.  It is built only once per process; release
+ * it with ksba_asn_tree_release.
+ *
  * Return Value:
  *   0: structure created correctly.
  *   GPG_ERR_GENERAL: an error occured while structure creation.
@@ -113,113 +187,46 @@ find_up (AsnNode  node)
 gpg_error_t
 ksba_asn_create_tree (const char *mod_name, ksba_asn_tree_t *result)
 {
-  enum { DOWN, UP, RIGHT } move;
-  const static_asn *root;
-  const char *strgtbl;
-  AsnNode pointer;
-  AsnNode p = NULL;
-  AsnNode p_last = NULL;
-  unsigned long k;
-  int rc;
-  AsnNode link_next = NULL;
+  ksba_asn_tree_t tree;
+  gpg_error_t err = 0;
+  unsigned long long start;
 
   if (!result)
     return gpg_error (GPG_ERR_INV_VALUE);
   *result = NULL;
-
   if (!mod_name)
     return gpg_error (GPG_ERR_INV_VALUE);
-  root = _ksba_asn_lookup_table (mod_name, &strgtbl);
-  if (!root)
-    return gpg_error (GPG_ERR_MODULE_NOT_FOUND);
-
-  pointer = NULL;
-  move = UP;
 
-  k = 0;
-  while (root[k].stringvalue_off || root[k].type || root[k].name_off)
+  STATS_INC (create_tree_calls);
+  start = STATS_NOW ();
+  gpgrt_lock_lock (&_ksba_asn_module_cache_lock);
+  for (tree = module_cache; tree; tree = tree->next_shared)
+    if (!strcmp (tree->filename, mod_name))
+      break;
+  if (!tree)
     {
-      p = _ksba_asn_new_node (root[k].type);
-      p->flags = root[k].flags;
-      p->flags.help_down = 0;
-      p->link_next = link_next;
-      link_next = p;
-
-      if (root[k].name_off)
-	_ksba_asn_set_name (p, strgtbl + root[k].name_off);
-      if (root[k].stringvalue_off)
+      ksba_alloc_ctx_t prevctx;
+
+      /* The tree is shared by all threads and kept until the process
+         terminates; thus it must not be taken from the allocator
+         context of the caller.  */
+      prevctx = _ksba_alloc_ctx_switch (NULL);
+      err = build_tree (mod_name, &tree);
+      _ksba_alloc_ctx_restore (prevctx);
+      if (!err)
         {
-          if (root[k].type == TYPE_TAG)
-            {
-              unsigned long val;
-              val = strtoul (strgtbl+root[k].stringvalue_off, NULL, 10);
-              _ksba_asn_set_value (p, VALTYPE_ULONG, &val, sizeof(val));
-            }
-          else
-            _ksba_asn_set_value (p, VALTYPE_CSTR,
-                                 strgtbl+root[k].stringvalue_off, 0);
+          tree->refcount = 1; /* The reference of the cache.  */
+          tree->next_shared = module_cache;
+          module_cache = tree;
         }
-
-      if (!pointer)
-	pointer = p;
-
-      if (move == DOWN)
-	set_down (p_last, p);
-      else if (move == RIGHT)
-	set_right (p_last, p);
-
-      p_last = p;
-
-      if (root[k].flags.help_down)
-	move = DOWN;
-      else if (root[k].flags.help_right)
-	move = RIGHT;
-      else
-	{
-	  while (1)
-	    {
-	      if (p_last == pointer)
-		break;
-
-	      p_last = find_up (p_last);
-
-	      if (p_last == NULL)
-		break;
-
-	      if (p_last->flags.help_right)
-		{
-		  p_last->flags.help_right = 0;
-		  move = RIGHT;
-		  break;
-		}
-	    }
-	}
-      k++;
     }
-
-  if (p_last == pointer)
+  if (!err)
     {
-      ksba_asn_tree_t tree;
-
-      _ksba_asn_change_integer_value (pointer);
-      _ksba_asn_expand_object_id (pointer);
-      tree = xtrymalloc (sizeof *tree + strlen (mod_name));
-      if (!tree)
-        rc = gpg_error (GPG_ERR_ENOMEM);
-      else
-        {
-          tree->parse_tree = pointer;
-          tree->node_list = p;
-          strcpy (tree->filename, mod_name);
-          *result = tree;
-          rc = 0;
-        }
+      tree->refcount++;
+      *result = tree;
     }
-  else
-      rc = gpg_error (GPG_ERR_GENERAL);
-
-  if (rc)
-    _ksba_asn_delete_structure (pointer);
-
-  return rc;
+  gpgrt_lock_unlock (&_ksba_asn_module_cache_lock);
+  STATS_ADD (create_tree_usec, STATS_NOW () - start);
+  (void)start;
+  return err;
 }
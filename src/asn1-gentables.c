@@ -178,13 +178,26 @@ write_string_table (FILE *fp)
 }
 
 
+/* Return the number of nodes in the subtree starting at NODE.  */
+static unsigned int
+count_nodes (AsnNode node)
+{
+  AsnNode p;
+  unsigned int n = 1;
+
+  for (p = node->down; p; p = p->right)
+    n += count_nodes (p);
+  return n;
+}
+
+
 static struct name_list_s *
 create_static_structure (AsnNode pointer, const char *file_name, FILE *fp)
 {
   AsnNode p;
   struct name_list_s *structure_name;
   const char *char_p, *slash_p, *dot_p;
-  char numbuf[50];
+  unsigned int idx;
 
   char_p = file_name;
   slash_p = file_name;
@@ -211,12 +224,8 @@ create_static_structure (AsnNode pointer, const char *file_name, FILE *fp)
   fprintf (fp, "static const static_asn %s_asn1_tab[] = {\n",
            structure_name->name);
 
-  for (p = pointer; p; p = _ksba_asn_walk_tree (pointer, p))
+  for (p = pointer, idx = 0; p; p = _ksba_asn_walk_tree (pointer, p), idx++)
     {
-      /* set the help flags */
-      p->flags.help_down  = !!p->down;
-      p->flags.help_right = !!p->right;
-
       /* write a structure line */
       fputs ("  {", fp);
       if (p->name)
@@ -247,31 +256,31 @@ create_static_structure (AsnNode pointer, const char *file_name, FILE *fp)
       fputs (p->flags.in_array       ? ",1":",0", fp);
       fputs (p->flags.is_any         ? ",1":",0", fp);
       fputs (p->flags.not_used       ? ",1":",0", fp);
-      fputs (p->flags.help_down      ? ",1":",0", fp);
-      fputs (p->flags.help_right     ? ",1":",0", fp);
       fputs ("}", fp);
 
+      /* The value is stored already converted.  */
       if (p->valuetype == VALTYPE_CSTR)
-	fprintf (fp, ",%u",
-                 (unsigned int)insert_string (p->value.v_cstr));
+	fprintf (fp, ",%u,%d,0",
+                 (unsigned int)insert_string (p->value.v_cstr),
+                 VALTYPE_CSTR);
       else if (p->valuetype == VALTYPE_LONG
                && p->type == TYPE_INTEGER && p->flags.assignment)
-        {
-          snprintf (numbuf, sizeof numbuf, "%ld", p->value.v_long);
-          fprintf (fp, ",%u", (unsigned int)insert_string (numbuf));
-        }
+        fprintf (fp, ",0,%d,%ldL", VALTYPE_LONG, p->value.v_long);
       else if (p->valuetype == VALTYPE_ULONG)
-        {
-          snprintf (numbuf, sizeof numbuf, "%lu", p->value.v_ulong);
-          fprintf (fp, ",%u", (unsigned int)insert_string (numbuf));
-        }
+        fprintf (fp, ",0,%d,%luL", VALTYPE_ULONG, p->value.v_ulong);
       else
         {
           if (p->valuetype)
             print_error ("can't store a value of type %d\n", p->valuetype);
-          fprintf (fp, ",0");
+          fprintf (fp, ",0,0,0");
         }
-      fputs ("},\n", fp);
+
+      /* Pre-order: the son directly follows its parent and the
+         brother follows the entire subtree.  The root has no
+         brother in the table.  */
+      fprintf (fp, ",%u,%u},\n",
+               p->down? idx + 1 : 0,
+               p->right && p != pointer? idx + count_nodes (p) : 0);
     }
 
   fprintf (fp, "  {0,0}\n};\n");
@@ -943,12 +943,20 @@ release_all_nodes (AsnNode node)
 {
   AsnNode node2;
 
+  if (node && node->arena)
+    {
+      /* All nodes of the tree are in the arena.  */
+      _ksba_asn_release_arena (node->arena);
+      return;
+    }
+
   for (; node; node = node2)
     {
       node2 = node->link_next;
-      xfree (node->name);
+      if (!node->static_name)
+        xfree (node->name);
 
-      if (node->valuetype == VALTYPE_CSTR)
+      if (node->valuetype == VALTYPE_CSTR && !node->static_value)
         xfree (node->value.v_cstr);
       else if (node->valuetype == VALTYPE_MEM)
         xfree (node->value.v_mem.buf);
@@ -1062,6 +1070,8 @@ ksba_asn_parse_file (const char *file_name, ksba_asn_tree_t *result, int debug)
       tree = xmalloc ( sizeof *tree + (file_name? strlen (file_name):1) );
       tree->parse_tree = parsectl.parse_tree;
       tree->node_list = parsectl.all_nodes;
+      tree->refcount = 0;
+      tree->next_shared = NULL;
       strcpy (tree->filename, file_name? file_name:"-");
       *result = tree;
     }
@@ -1076,6 +1086,14 @@ ksba_asn_tree_release (ksba_asn_tree_t tree)
 {
   if (!tree)
     return;
+#ifndef BUILD_GENTOOLS
+  if (tree->refcount)
+    {
+      /* A shared module tree; it is owned by the module cache.  */
+      _ksba_asn_unref_tree (tree);
+      return;
+    }
+#endif
   release_all_nodes (tree->node_list);
   tree->node_list = NULL;
   xfree (tree);
@@ -47,16 +47,22 @@
 #define MAX_IMAGE_LENGTH (16 * 1024 * 1024)
 
 
+/* The number of nesting levels the decoder state can track without
+ * allocating memory and the maximum number of levels we allow.  */
+#define DECODER_STATE_INLINE   32
+#define DECODER_STATE_MAXDEPTH 100
+
+
 struct decoder_state_item_s {
   AsnNode node;
-  int went_up;
-  int in_seq_of;
-  int in_any;    /* actually in a constructed any */
-  int again;
-  int next_tag;
   int length;  /* length of the value */
-  int ndef_length; /* the length is of indefinite length */
   int nread;   /* number of value bytes processed */
+  unsigned int went_up:1;
+  unsigned int in_seq_of:1;
+  unsigned int in_any:1;    /* actually in a constructed any */
+  unsigned int again:1;
+  unsigned int next_tag:1;
+  unsigned int ndef_length:1; /* the length is of indefinite length */
 };
 typedef struct decoder_state_item_s DECODER_STATE_ITEM;
 
@@ -64,7 +70,8 @@ struct decoder_state_s {
   DECODER_STATE_ITEM cur;     /* current state */
   int stacksize;
   int idx;
-  DECODER_STATE_ITEM stack[1];
+  DECODER_STATE_ITEM *stack;  /* INLINE_STACK or allocated for deep data */
+  DECODER_STATE_ITEM inline_stack[DECODER_STATE_INLINE];
 };
 typedef struct decoder_state_s *DECODER_STATE;
 
@@ -77,7 +84,7 @@ struct ber_decoder_s
   const char *last_errdesc; /* string with the error description */
   int non_der;    /* set if the encoding is not DER conform */
   AsnNode root;   /* of the expanded parse tree */
-  DECODER_STATE ds;
+  struct decoder_state_s ds;
   int bypass;
 
   /* Because some certificates actually come with trailing garbage, we
@@ -98,9 +105,10 @@ struct ber_decoder_s
   int use_image;
   struct
   {
-    unsigned char *buf;
+    unsigned char *buf; /* NULL if only the length is tracked.  */
     size_t used;
     size_t length;
+    int no_copy;
   } image;
   struct
   {
@@ -133,13 +141,16 @@ sum_a1_a2_ge_b (size_t a1, size_t a2, size_t b)
 
 
 
-static DECODER_STATE
-new_decoder_state (void)
+/* Initialize the state DS for a new run.  A stack allocated by a
+   previous run is kept.  */
+static void
+init_decoder_state (DECODER_STATE ds)
 {
-  DECODER_STATE ds;
-
-  ds = xmalloc (sizeof (*ds) + 99*sizeof(DECODER_STATE_ITEM));
-  ds->stacksize = 100;
+  if (!ds->stack)
+    {
+      ds->stack = ds->inline_stack;
+      ds->stacksize = DECODER_STATE_INLINE;
+    }
   ds->idx = 0;
   ds->cur.node = NULL;
   ds->cur.went_up = 0;
@@ -150,13 +161,14 @@ new_decoder_state (void)
   ds->cur.length = 0;
   ds->cur.ndef_length = 1;
   ds->cur.nread = 0;
-  return ds;
 }
 
 static void
 release_decoder_state (DECODER_STATE ds)
 {
-  xfree (ds);
+  if (ds->stack != ds->inline_stack)
+    xfree (ds->stack);
+  ds->stack = NULL;
 }
 
 static void
@@ -185,8 +197,29 @@ push_decoder_state (DECODER_STATE ds)
 {
   if (ds->idx >= ds->stacksize)
     {
-      fprintf (stderr, "ksba: ber-decoder: stack overflow!\n");
-      return gpg_error (GPG_ERR_LIMIT_REACHED);
+      DECODER_STATE_ITEM *stack;
+      int n;
+
+      if (ds->stacksize >= DECODER_STATE_MAXDEPTH)
+        {
+          fprintf (stderr, "ksba: ber-decoder: stack overflow!\n");
+          return gpg_error (GPG_ERR_LIMIT_REACHED);
+        }
+      n = ds->stacksize * 2;
+      if (n > DECODER_STATE_MAXDEPTH)
+        n = DECODER_STATE_MAXDEPTH;
+      if (ds->stack == ds->inline_stack)
+        {
+          stack = xtrymalloc (n * sizeof *stack);
+          if (stack)
+            memcpy (stack, ds->stack, ds->idx * sizeof *stack);
+        }
+      else
+        stack = xtryrealloc (ds->stack, n * sizeof *stack);
+      if (!stack)
+        return gpg_error_from_syserror ();
+      ds->stack = stack;
+      ds->stacksize = n;
     }
   ds->stack[ds->idx++] = ds->cur;
   return 0;
@@ -232,8 +265,10 @@ eof_or_error (BerDecoder d, int premature)
   return gpg_error (GPG_ERR_EOF);
 }
 
-static const char *
-universal_tag_name (unsigned long no)
+/* Return the name of the universal tag NO or NULL if it is not
+   known.  */
+const char *
+_ksba_ber_universal_tag_name (unsigned long no)
 {
   static const char * const names[31] = {
     "[End Tag]",
@@ -279,7 +314,7 @@ dump_tlv (const struct tag_info *ti, FILE *fp)
   const char *tagname = NULL;
 
   if (ti->class == CLASS_UNIVERSAL)
-    tagname = universal_tag_name (ti->tag);
+    tagname = _ksba_ber_universal_tag_name (ti->tag);
 
   if (tagname)
     fputs (tagname, fp);
@@ -355,9 +390,27 @@ _ksba_ber_decoder_new (void)
 void
 _ksba_ber_decoder_release (BerDecoder d)
 {
+  if (!d)
+    return;
+  _ksba_asn_release_nodes (d->root);
+  release_decoder_state (&d->ds);
   xfree (d);
 }
 
+
+/* Put the decoder D back into the state right after its creation so
+   that it can be used with another module and reader.  */
+void
+_ksba_ber_decoder_reset (BerDecoder d)
+{
+  if (!d)
+    return;
+  _ksba_asn_release_nodes (d->root);
+  xfree (d->image.buf);
+  release_decoder_state (&d->ds);
+  memset (d, 0, sizeof *d);
+}
+
 /**
  * _ksba_ber_decoder_set_module:
  * @d: Decoder object
@@ -433,10 +486,20 @@ read_buffer (ksba_reader_t reader, char *buffer, size_t count)
   else
     {
       char dummy[256];
+      const unsigned char *p;
       size_t n;
 
       while (count)
         {
+          if (!ksba_reader_peek (reader, &p, &n))
+            { /* Memory backed reader - no need to copy.  */
+              if (n > count)
+                n = count;
+              if (ksba_reader_consume (reader, n))
+                return -1;
+              count -= n;
+              continue;
+            }
           n = count > DIM(dummy) ? DIM(dummy): count;
           if (ksba_reader_read (reader, dummy, n, &nread))
             return -1;
@@ -804,9 +867,10 @@ match_der (AsnNode root, const struct tag_info *ti,
 static gpg_error_t
 decoder_init (BerDecoder d, const char *start_name)
 {
-  d->ds = new_decoder_state ();
+  init_decoder_state (&d->ds);
 
-  d->root = _ksba_asn_expand_tree (d->module, start_name);
+  _ksba_asn_release_nodes (d->root);
+  d->root = _ksba_asn_expand_tree_arena (d->module, start_name);
   clear_help_flags (d->root);
   d->bypass = 0;
   if (d->debug)
@@ -817,8 +881,7 @@ decoder_init (BerDecoder d, const char *start_name)
 static void
 decoder_deinit (BerDecoder d)
 {
-  release_decoder_state (d->ds);
-  d->ds = NULL;
+  /* The state stack is kept for the next run.  */
   d->val.node = NULL;
   if (d->debug)
     fprintf (stderr, "DECODER_DEINIT\n");
@@ -831,7 +894,7 @@ decoder_next (BerDecoder d)
   struct tag_info ti;
   AsnNode node = NULL;
   gpg_error_t err;
-  DECODER_STATE ds = d->ds;
+  DECODER_STATE ds = &d->ds;
   int debug = d->debug;
 
   if (d->ignore_garbage && d->fast_stop)
@@ -888,7 +951,7 @@ decoder_next (BerDecoder d)
   /* Store stuff in the image buffer. */
   if (d->use_image)
     {
-      if (!d->image.buf)
+      if (!d->image.length)
         {
           /* We need some extra bytes to store the stuff we read ahead
            * at the end of the module which is later pushed back.  We
@@ -903,15 +966,19 @@ decoder_next (BerDecoder d)
             return gpg_error (GPG_ERR_BAD_BER);
           if (d->image.length > MAX_IMAGE_LENGTH)
             return gpg_error (GPG_ERR_TOO_LARGE);
-          d->image.buf = xtrycalloc (1, d->image.length);
-          if (!d->image.buf)
-            return gpg_error (GPG_ERR_ENOMEM);
+          if (!d->image.no_copy)
+            {
+              d->image.buf = xtrycalloc (1, d->image.length);
+              if (!d->image.buf)
+                return gpg_error (GPG_ERR_ENOMEM);
+            }
         }
 
       if (sum_a1_a2_ge_b (ti.nhdr, d->image.used, d->image.length))
         return set_error (d, NULL, "image buffer too short to store the tag");
 
-      memcpy (d->image.buf + d->image.used, ti.buf, ti.nhdr);
+      if (d->image.buf)
+        memcpy (d->image.buf + d->image.used, ti.buf, ti.nhdr);
       d->image.used += ti.nhdr;
     }
 
@@ -938,6 +1005,8 @@ decoder_next (BerDecoder d)
                 {
                   /* We must push back the stuff we already read */
                   ksba_reader_unread (d->reader, ti.buf, ti.nhdr);
+                  if (d->use_image)
+                    d->image.used -= ti.nhdr;
                   return gpg_error (GPG_ERR_EOF);
                 }
               else
@@ -1015,7 +1084,7 @@ decoder_next (BerDecoder d)
                       if (err)
                         return err;
                       ds->cur.nread += n;
-                      ds->cur.went_up++;
+                      ds->cur.went_up = 1;
                     }
                   endtag = 0;
                 }
@@ -1112,6 +1181,7 @@ _ksba_ber_decoder_dump (BerDecoder d, FILE *fp)
 
   if (!d)
     return gpg_error (GPG_ERR_INV_VALUE);
+  STATS_INC (decoder_calls);
 
 #ifdef HAVE_GETENV
   d->debug = !!getenv("KSBA_DEBUG_BER_DECODER");
@@ -1225,6 +1295,7 @@ _ksba_ber_decoder_decode (BerDecoder d, const char *start_name,
 
   if (!d)
     return gpg_error (GPG_ERR_INV_VALUE);
+  STATS_INC (decoder_calls);
 
   if (r_root)
     *r_root = NULL;
@@ -1237,6 +1308,9 @@ _ksba_ber_decoder_decode (BerDecoder d, const char *start_name,
   d->honor_module_end = 1;
   d->use_image = 1;
   d->image.buf = NULL;
+  d->image.used = 0;
+  d->image.length = 0;
+  d->image.no_copy = !!(flags & BER_DECODER_FLAG_NO_IMAGE);
   d->fast_stop = !!(flags & BER_DECODER_FLAG_FAST_STOP);
 
   startoff = ksba_reader_tell (d->reader);
@@ -1259,15 +1333,17 @@ _ksba_ber_decoder_decode (BerDecoder d, const char *start_name,
                            - d->val.nhdr - startoff);
               node->nhdr = d->val.nhdr;
               node->len = d->val.length;
-              if (node->type == TYPE_ANY)
-                node->actual_type = d->val.tag;
+              if (node->type == TYPE_ANY) /* (type is only 8 bits) */
+                node->actual_type = d->val.tag < 256? d->val.tag : TYPE_NONE;
             }
           if (sum_a1_a2_gt_b (d->image.used, d->val.length, d->image.length))
             err = set_error(d, NULL, "TLV length too large");
           else if (d->val.primitive)
             {
-              if( read_buffer (d->reader,
-                               d->image.buf + d->image.used, d->val.length))
+              unsigned char *dst;
+
+              dst = d->image.buf? d->image.buf + d->image.used : NULL;
+              if (read_buffer (d->reader, dst, d->val.length))
                 err = eof_or_error (d, 1);
               else
                 {
@@ -1328,11 +1404,14 @@ _ksba_ber_decoder_decode (BerDecoder d, const char *start_name,
     err = 0;
 
   if (err)
-    xfree (d->image.buf);
+    {
+      xfree (d->image.buf);
+      d->image.buf = NULL;
+    }
 
   if (r_root && !err)
     {
-      if (!d->image.buf)
+      if (!d->image.length)
         { /* Not even the first node available - return eof */
 	  _ksba_asn_release_nodes (d->root);
           d->root = NULL;
@@ -38,10 +38,13 @@ typedef struct ber_decoder_s *BerDecoder;
 
 BerDecoder _ksba_ber_decoder_new (void);
 void       _ksba_ber_decoder_release (BerDecoder d);
+void       _ksba_ber_decoder_reset (BerDecoder d);
 
 gpg_error_t _ksba_ber_decoder_set_module (BerDecoder d, ksba_asn_tree_t module);
 gpg_error_t _ksba_ber_decoder_set_reader (BerDecoder d, ksba_reader_t r);
 
+const char *_ksba_ber_universal_tag_name (unsigned long no);
+
 gpg_error_t _ksba_ber_decoder_dump (BerDecoder d, FILE *fp);
 gpg_error_t _ksba_ber_decoder_decode (BerDecoder d, const char *start_name,
                                       unsigned int flags,
@@ -50,6 +53,7 @@ gpg_error_t _ksba_ber_decoder_decode (BerDecoder d, const char *start_name,
                                       size_t *r_imagelen);
 
 #define BER_DECODER_FLAG_FAST_STOP 1
+#define BER_DECODER_FLAG_NO_IMAGE  2  /* Track but do not copy the image. */
 
 
 #endif /*BER_DECODER_H*/
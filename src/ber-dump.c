@@ -23,10 +23,12 @@
 #include <string.h>
 #include <errno.h>
 #include <stdarg.h>
+#include <assert.h>
 
 #include "visibility.h"
 #include "ksba.h"
 #include "ber-decoder.h"
+#include "ber-help.h"
 
 #define PGMNAME "ber-dump"
 
@@ -36,9 +38,62 @@
 # define  ATTR_PRINTF(a,b)
 #endif
 
+/* The maximum nesting depth tracked by the scan mode.  */
+#define SCAN_MAX_DEPTH      64
+/* The number of largest elements shown by the scan mode.  */
+#define SCAN_MAX_LARGEST    10
+/* The number of malformed regions shown by the scan mode.  */
+#define SCAN_MAX_MALFORMED  20
+
 /* keep track of parsing error */
 static int error_counter;
 
+/* Print a structural summary instead of the full dump.  */
+static int opt_stats;
+
+/* The offset window given with --range.  */
+static int opt_range;
+static unsigned long long range_start;
+static size_t range_length;
+
+
+/* Information about one element for the scan mode.  */
+struct scan_elem_s
+{
+  unsigned long long off;
+  unsigned long long len;   /* Including the header.  */
+  int class;
+  int constructed;
+  unsigned long tag;
+  int depth;
+};
+
+/* A malformed region found by the scan mode.  */
+struct scan_malformed_s
+{
+  unsigned long long off;
+  unsigned long long end;   /* Equal to OFF if no resync happened.  */
+  const char *what;
+};
+
+/* The statistics gathered by the scan mode.  Tags larger than 30 are
+   counted in the last slot of TAGCOUNT.  */
+struct scan_stats_s
+{
+  unsigned long long size;  /* Size of the input or 0 if not known.  */
+  unsigned long long nbytes;
+  unsigned long long nelems;
+  unsigned long long tagcount[4][2][32];
+  unsigned long long depthcount[SCAN_MAX_DEPTH];
+  int maxdepth;
+  struct scan_elem_s largest[SCAN_MAX_LARGEST];
+  int nlargest;
+  unsigned long long nmalformed;
+  struct scan_malformed_s malformed[SCAN_MAX_MALFORMED];
+  unsigned long long stop_off;  /* Where the scan stopped early ...  */
+  const char *stop_what;        /* ... and why or NULL.  */
+};
+
 
 static void print_error (const char *fmt, ... )  ATTR_PRINTF(1,2);
 
@@ -69,21 +124,49 @@ fatal (const char *fmt, ... )
 }
 
 
-static void
-one_file (FILE *fp, const char *fname, ksba_asn_tree_t asn_tree)
+/* Open a reader for FP.  If --range has been given or the scan mode
+   is used the file is mapped into memory.  Returns NULL on error.  */
+static ksba_reader_t
+open_reader (FILE *fp, const char *fname)
 {
   gpg_error_t err;
   ksba_reader_t r;
-  BerDecoder d;
-
-  (void)fname;  /* Not yet used in error messages.  */
 
   err = ksba_reader_new (&r);
   if (err)
     fatal ("out of core\n");
+
+  if (opt_range || opt_stats)
+    {
+      err = ksba_reader_set_mmap (r, fileno (fp), range_start, range_length);
+      if (!err)
+        return r;
+      if (opt_range)
+        {
+          print_error ("can't map `%s': %s\n", fname, gpg_strerror (err));
+          ksba_reader_release (r);
+          return NULL;
+        }
+      /* Not a regular file; scan it using the buffered reader.  */
+    }
+
   err = ksba_reader_set_file (r, fp);
   if (err)
     fatal ("ksba_reader_set_file failed: rc=%d\n", err);
+  return r;
+}
+
+
+static void
+one_file (FILE *fp, const char *fname, ksba_asn_tree_t asn_tree)
+{
+  gpg_error_t err;
+  ksba_reader_t r;
+  BerDecoder d;
+
+  r = open_reader (fp, fname);
+  if (!r)
+    return;
 
   d = _ksba_ber_decoder_new ();
   if (!d)
@@ -108,13 +191,387 @@ one_file (FILE *fp, const char *fname, ksba_asn_tree_t asn_tree)
 }
 
 
+/* Skip N bytes of R.  */
+static gpg_error_t
+skip_bytes (ksba_reader_t r, unsigned long long n)
+{
+  gpg_error_t err;
+  const unsigned char *p;
+  size_t avail, nread;
+  char buffer[4096];
+
+  if (!n)
+    return 0;
+  if (!ksba_reader_peek (r, &p, &avail))
+    {
+      if (n > avail)
+        return gpg_error (GPG_ERR_EOF);
+      return ksba_reader_consume (r, n);
+    }
+
+  while (n)
+    {
+      err = ksba_reader_read (r, buffer,
+                              n < sizeof buffer? n : sizeof buffer, &nread);
+      if (err)
+        return err;
+      n -= nread;
+    }
+  return 0;
+}
+
+
+static void
+scan_add_malformed (struct scan_stats_s *stats,
+                    unsigned long long off, const char *what)
+{
+  if (stats->nmalformed < SCAN_MAX_MALFORMED)
+    {
+      stats->malformed[stats->nmalformed].off = off;
+      stats->malformed[stats->nmalformed].end = off;
+      stats->malformed[stats->nmalformed].what = what;
+    }
+  stats->nmalformed++;
+}
+
+
+/* Record the end of the last malformed region after a resync.  */
+static void
+scan_set_resync (struct scan_stats_s *stats, unsigned long long end)
+{
+  if (stats->nmalformed && stats->nmalformed <= SCAN_MAX_MALFORMED)
+    stats->malformed[stats->nmalformed - 1].end = end;
+}
+
+
+/* Continue reading R right after the first byte of the element at
+   OFF whose header TI has been read, so that a scan can look for the
+   next element there.  */
+static void
+scan_skip_byte (ksba_reader_t r, unsigned long long off, struct tag_info *ti)
+{
+  unsigned long long pos = ksba_reader_tell (r);
+
+  if (pos == off + ti->nhdr && ti->nhdr > 1)
+    ksba_reader_unread (r, ti->buf + 1, ti->nhdr - 1);
+  else if (pos == off)
+    skip_bytes (r, 1);
+  /* else: Data has been consumed which can't be given back.  */
+}
+
+
+/* Insert ELEM into the sorted list of the largest elements.  */
+static void
+scan_add_largest (struct scan_stats_s *stats, const struct scan_elem_s *elem)
+{
+  int i;
+
+  if (stats->nlargest == SCAN_MAX_LARGEST
+      && elem->len <= stats->largest[SCAN_MAX_LARGEST - 1].len)
+    return;
+  if (stats->nlargest < SCAN_MAX_LARGEST)
+    stats->nlargest++;
+  for (i = stats->nlargest - 1;
+       i > 0 && stats->largest[i-1].len < elem->len; i--)
+    stats->largest[i] = stats->largest[i-1];
+  stats->largest[i] = *elem;
+}
+
+
+/* Walk over all TL headers of R and fill STATS.  Primitive values
+   are skipped without looking at them and thus even very large
+   objects can be scanned quickly.  After a malformed element the
+   rest of its container is skipped.  At the top level, where the
+   input may start in the middle of an element, the scan goes on at
+   the next byte instead.  */
+static void
+scan_reader (ksba_reader_t r, struct scan_stats_s *stats)
+{
+  gpg_error_t err;
+  struct tag_info ti;
+  unsigned long long ends[SCAN_MAX_DEPTH]; /* End offsets; 0 for ndef.  */
+  unsigned long long off, end;
+  struct scan_elem_s elem;
+  const unsigned char *p;
+  size_t avail;
+  const char *what;
+  int depth = 0;
+  int resyncing = 0;  /* The last malformed region is still open.  */
+
+  if (!ksba_reader_peek (r, &p, &avail))
+    stats->size = avail;
+
+  for (;;)
+    {
+      off = ksba_reader_tell (r);
+      while (depth && ends[depth-1] && off >= ends[depth-1])
+        depth--;
+
+      err = _ksba_ber_read_tl (r, &ti);
+      if (gpg_err_code (err) == GPG_ERR_EOF && !ti.nhdr)
+        {
+          if (depth)
+            scan_add_malformed (stats, off, "premature EOF");
+          break;
+        }
+      if (err && !ti.nhdr)
+        {
+          stats->stop_off = off;
+          stats->stop_what = gpg_strerror (err);
+          break;
+        }
+      if (err)
+        {
+          what = ti.err_string? ti.err_string : gpg_strerror (err);
+          goto malformed;
+        }
+
+      if (ti.class == CLASS_UNIVERSAL && !ti.tag && !ti.is_constructed
+          && !ti.length && !ti.ndef)
+        {
+          if (depth && !ends[depth-1])
+            depth--;
+          else
+            scan_add_malformed (stats, off, "unexpected end-of-contents");
+          continue;
+        }
+
+      stats->nelems++;
+      stats->tagcount[ti.class][!!ti.is_constructed][ti.tag < 31? ti.tag:31]++;
+      stats->depthcount[depth]++;
+      if (depth > stats->maxdepth)
+        stats->maxdepth = depth;
+
+      if (ti.ndef)
+        {
+          if (!ti.is_constructed)
+            {
+              what = "indefinite length for primitive";
+              goto malformed;
+            }
+          if (depth == SCAN_MAX_DEPTH)
+            {
+              what = "nesting too deep";
+              goto malformed;
+            }
+          ends[depth++] = 0;
+          resyncing = 0;
+          continue;
+        }
+
+      end = off + ti.nhdr + ti.length;
+      if (depth && ends[depth-1] && end > ends[depth-1])
+        {
+          what = "element exceeds its container";
+          goto malformed;
+        }
+
+      elem.off = off;
+      elem.len = ti.nhdr + ti.length;
+      elem.class = ti.class;
+      elem.constructed = ti.is_constructed;
+      elem.tag = ti.tag;
+      elem.depth = depth;
+
+      if (ti.is_constructed && ti.length && depth < SCAN_MAX_DEPTH)
+        ends[depth++] = end;
+      else
+        {
+          if (skip_bytes (r, ti.length))
+            {
+              what = "value truncated";
+              goto malformed;
+            }
+          if (ti.is_constructed && ti.length)
+            scan_add_malformed (stats, off, "nesting too deep");
+        }
+      scan_add_largest (stats, &elem);
+      resyncing = 0;
+      continue;
+
+    malformed:
+      if (!resyncing)
+        scan_add_malformed (stats, off, what);
+      /* Skip the remainder of the enclosing element if its length is
+         known.  */
+      if (depth && ends[depth-1])
+        {
+          off = ksba_reader_tell (r);
+          end = ends[--depth];
+          err = end > off? skip_bytes (r, end - off) : 0;
+          if (gpg_err_code (err) == GPG_ERR_EOF)
+            break;  /* The container is cut off by the end of input.  */
+          if (err)
+            {
+              stats->stop_off = off;
+              stats->stop_what = gpg_strerror (err);
+              break;
+            }
+          scan_set_resync (stats, end);
+          resyncing = 0;
+          continue;
+        }
+      /* Otherwise try again at the next byte on the top level.  */
+      depth = 0;
+      scan_skip_byte (r, off, &ti);
+      scan_set_resync (stats, ksba_reader_tell (r));
+      resyncing = 1;
+    }
+
+  stats->nbytes = ksba_reader_tell (r);
+}
+
+
+static void
+print_tag (int class, int constructed, unsigned long tag)
+{
+  const char *tagname = NULL;
+  char buffer[40];
+
+  if (class == CLASS_UNIVERSAL && tag < 31)
+    tagname = _ksba_ber_universal_tag_name (tag);
+  if (!tagname)
+    {
+      snprintf (buffer, sizeof buffer, "[%s %lu%s]",
+                class == CLASS_UNIVERSAL? "UNIVERSAL" :
+                class == CLASS_APPLICATION? "APPLICATION" :
+                class == CLASS_CONTEXT? "CONTEXT-SPECIFIC" : "PRIVATE",
+                tag, tag < 31? "" : "+");
+      tagname = buffer;
+    }
+  printf ("%-26s %c", tagname, constructed? 'c':'p');
+}
+
+
+static void
+print_scan_stats (const char *fname, const struct scan_stats_s *stats)
+{
+  unsigned long long base = range_start;
+  int class, cons, tag, i;
+
+  printf ("file: %s\n", fname);
+  if (opt_range)
+    printf ("range: %llu-%llu\n", base,
+            base + (range_length? range_length : stats->size));
+  if (stats->stop_what)
+    printf ("stopped: off=%llu: %s\n",
+            base + stats->stop_off, stats->stop_what);
+  printf ("bytes: %llu\n"
+          "elements: %llu\n"
+          "max-depth: %d\n"
+          "malformed: %llu\n",
+          stats->nbytes, stats->nelems, stats->maxdepth, stats->nmalformed);
+
+  puts ("tags:");
+  for (class = 0; class < 4; class++)
+    for (tag = 0; tag < 32; tag++)
+      for (cons = 0; cons < 2; cons++)
+        if (stats->tagcount[class][cons][tag])
+          {
+            fputs ("  ", stdout);
+            print_tag (class, cons, tag);
+            printf (" %12llu\n", stats->tagcount[class][cons][tag]);
+          }
+
+  puts ("depths:");
+  for (i = 0; i <= stats->maxdepth; i++)
+    printf ("  %3d %12llu\n", i, stats->depthcount[i]);
+
+  puts ("largest:");
+  for (i = 0; i < stats->nlargest; i++)
+    {
+      printf ("  off=%-12llu len=%-12llu depth=%-3d ",
+              base + stats->largest[i].off, stats->largest[i].len,
+              stats->largest[i].depth);
+      print_tag (stats->largest[i].class, stats->largest[i].constructed,
+                 stats->largest[i].tag);
+      putchar ('\n');
+    }
+
+  if (stats->nmalformed)
+    {
+      puts ("malformed regions:");
+      for (i = 0; i < SCAN_MAX_MALFORMED && i < stats->nmalformed; i++)
+        {
+          if (stats->malformed[i].end > stats->malformed[i].off)
+            printf ("  off=%llu-%llu: %s\n",
+                    base + stats->malformed[i].off,
+                    base + stats->malformed[i].end,
+                    stats->malformed[i].what);
+          else
+            printf ("  off=%llu: %s\n",
+                    base + stats->malformed[i].off,
+                    stats->malformed[i].what);
+        }
+      if (stats->nmalformed > SCAN_MAX_MALFORMED)
+        printf ("  [%llu more]\n", stats->nmalformed - SCAN_MAX_MALFORMED);
+    }
+}
+
+
+static void
+scan_file (FILE *fp, const char *fname)
+{
+  ksba_reader_t r;
+  struct scan_stats_s *stats;
+
+  r = open_reader (fp, fname);
+  if (!r)
+    return;
+
+  stats = calloc (1, sizeof *stats);
+  if (!stats)
+    fatal ("out of core\n");
+  scan_reader (r, stats);
+  print_scan_stats (fname, stats);
+  if (stats->nmalformed)
+    error_counter++;
+
+  free (stats);
+  ksba_reader_release (r);
+}
+
+
 static void
 usage (int exitcode)
 {
-  fputs ("usage: ber-dump [--module asnfile] [files]\n", stderr);
+  fputs ("usage: ber-dump [options] [files]\n"
+         "\n"
+         "  --module ASNFILE  use the ASN.1 module ASNFILE\n"
+         "  --stats           print only a structural summary\n"
+         "  --range START-END only look at the bytes START to END - 1\n",
+         stderr);
   exit (exitcode);
 }
 
+
+/* Parse the argument of --range.  END may be omitted to denote the
+   end of the file.  */
+static void
+parse_range (const char *string)
+{
+  char *endp;
+  unsigned long long end;
+
+  errno = 0;
+  range_start = strtoull (string, &endp, 0);
+  if (errno || endp == string || *endp != '-')
+    usage (1);
+  string = endp + 1;
+  if (!*string)
+    range_length = 0;
+  else
+    {
+      end = strtoull (string, &endp, 0);
+      if (errno || *endp || end <= range_start
+          || end - range_start > (size_t)(-1))
+        usage (1);
+      range_length = end - range_start;
+    }
+  opt_range = 1;
+}
+
+
 int
 main (int argc, char **argv)
 {
@@ -127,16 +584,39 @@ main (int argc, char **argv)
     usage (0);
 
   argc--; argv++;
-  if (argc && !strcmp (*argv,"--module"))
+  while (argc && !strncmp (*argv, "--", 2))
     {
-      argc--; argv++;
-      if (!argc)
+      if (!strcmp (*argv, "--"))
+        {
+          argc--; argv++;
+          break;
+        }
+      else if (!strcmp (*argv, "--module"))
+        {
+          argc--; argv++;
+          if (!argc)
+            usage (1);
+          asnfile = *argv;
+          argc--; argv++;
+        }
+      else if (!strcmp (*argv, "--stats"))
+        {
+          opt_stats = 1;
+          argc--; argv++;
+        }
+      else if (!strcmp (*argv, "--range"))
+        {
+          argc--; argv++;
+          if (!argc)
+            usage (1);
+          parse_range (*argv);
+          argc--; argv++;
+        }
+      else
         usage (1);
-      asnfile = *argv;
-      argc--; argv++;
     }
 
-  if (asnfile)
+  if (asnfile && !opt_stats)
     {
       rc = ksba_asn_parse_file (asnfile, &asn_tree, 0);
       if (rc)
@@ -148,7 +628,12 @@ main (int argc, char **argv)
 
 
   if (!argc)
-    one_file (stdin, "-", asn_tree);
+    {
+      if (opt_stats)
+        scan_file (stdin, "-");
+      else
+        one_file (stdin, "-", asn_tree);
+    }
   else
     {
       for (; argc; argc--, argv++)
@@ -160,7 +645,10 @@ main (int argc, char **argv)
               print_error ("can't open `%s': %s\n", *argv, strerror (errno));
           else
             {
-              one_file (fp, *argv, asn_tree);
+              if (opt_stats)
+                scan_file (fp, *argv);
+              else
+                one_file (fp, *argv, asn_tree);
               fclose (fp);
             }
         }
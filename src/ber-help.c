@@ -95,6 +95,20 @@ _ksba_ber_read_tl (ksba_reader_t reader, struct tag_info *ti)
   int c;
   unsigned long tag;
 
+  /* If the reader is memory backed we can parse the header directly
+   * from its buffer.  Only if that does not work out we fall back to
+   * the byte wise reading so that all error cases and headers
+   * spanning a buffer boundary are handled there.  */
+  {
+    const unsigned char *p;
+    size_t n;
+
+    if (!ksba_reader_peek (reader, &p, &n)
+        && !_ksba_ber_parse_tl (&p, &n, ti))
+      return ksba_reader_consume (reader, ti->nhdr);
+  }
+  STATS_INC (tl_decoded);
+
   ti->length = 0;
   ti->ndef = 0;
   ti->nhdr = 0;
@@ -211,6 +225,14 @@ _ksba_ber_parse_tl (unsigned char const **buffer, size_t *size,
   const unsigned char *buf = *buffer;
   size_t length = *size;
 
+  STATS_INC (tl_decoded);
+  if (_ksba_ber_parse_tl_fast (buf, length, ti))
+    {
+      *buffer = buf + ti->nhdr;
+      *size = length - ti->nhdr;
+      return 0;
+    }
+
   ti->length = 0;
   ti->ndef = 0;
   ti->nhdr = 0;
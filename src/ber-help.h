@@ -64,6 +64,60 @@ size_t _ksba_ber_count_tl (unsigned long tag,
                            unsigned long length);
 
 
+/* Fast path for _ksba_ber_parse_tl handling the common case of a
+   single byte tag and a definite length encoded in at most 4 bytes.
+   The entire header at BUF is checked against SIZE only once.  On
+   success TI is filled and true is returned; if the header is not of
+   this simple form or not complete false is returned and the caller
+   needs to use the generic parser.  */
+static inline int
+_ksba_ber_parse_tl_fast (const unsigned char *buf, size_t size,
+                         struct tag_info *ti)
+{
+  unsigned int c, n;
+  unsigned long len;
+
+  if (size < 2 || (buf[0] & 0x1f) == 0x1f)
+    return 0;
+  c = buf[1];
+  if (!(c & 0x80))
+    {
+      n = 0;
+      len = c;
+    }
+  else
+    {
+      n = c & 0x7f;  /* Also rejects 0x80 (ndef) and 0xff.  */
+      if (!n || n > 4 || size < 2 + n)
+        return 0;
+      switch (n)
+        {
+        case 1: len = buf[2]; break;
+        case 2: len = (buf[2] << 8) | buf[3]; break;
+        case 3: len = (buf[2] << 16) | (buf[3] << 8) | buf[4]; break;
+        default:
+          len = ((unsigned long)buf[2] << 24) | (buf[3] << 16)
+                | (buf[4] << 8) | buf[5];
+          if (len > (1 << 30))
+            return 0;
+          break;
+        }
+    }
+
+  ti->class = (buf[0] & 0xc0) >> 6;
+  ti->is_constructed = !!(buf[0] & 0x20);
+  ti->tag = buf[0] & 0x1f;
+  ti->ndef = 0;
+  ti->nhdr = 2 + n;
+  ti->err_string = NULL;
+  ti->non_der = 0;
+  memcpy (ti->buf, buf, 2 + n);
+  /* Same kludge as in the generic parser.  */
+  ti->length = (ti->class == CLASS_UNIVERSAL && !ti->tag)? 0 : len;
+  return 1;
+}
+
+
 static inline void
 parse_skip (unsigned char const **buf, size_t *len, struct tag_info *ti)
 {
@@ -38,23 +38,41 @@
 #include "util.h"
 #include "ber-decoder.h"
 #include "ber-help.h"
+#include "der-builder.h"
 #include "convert.h"
 #include "keyinfo.h"
 #include "sexp-parse.h"
 #include "cert.h"
+#include "reader.h"
 
 
-static const char oidstr_subjectKeyIdentifier[] = "2.5.29.14";
-static const char oidstr_keyUsage[]         = "2.5.29.15";
-static const char oidstr_subjectAltName[]   = "2.5.29.17";
-static const char oidstr_issuerAltName[]    = "2.5.29.18";
-static const char oidstr_basicConstraints[] = "2.5.29.19";
-static const char oidstr_crlDistributionPoints[] = "2.5.29.31";
-static const char oidstr_certificatePolicies[] = "2.5.29.32";
-static const char oidstr_authorityKeyIdentifier[] = "2.5.29.35";
-static const char oidstr_extKeyUsage[] = "2.5.29.37";
-static const char oidstr_authorityInfoAccess[] = "1.3.6.1.5.5.7.1.1";
-static const char oidstr_subjectInfoAccess[]   = "1.3.6.1.5.5.7.1.11";
+/* This lock protects the lazy filling of the caches of all
+   certificates.  Once filled, the caches are read without it.  It
+   is only held for short steps; the lazy decoding of a certificate
+   uses the lock of that certificate.  */
+static gpgrt_lock_t cache_lock = GPGRT_LOCK_INITIALIZER;
+
+/* Return the kind of the extension with the OID identifier ID or
+   CERT_EXTN_LAST for other extensions.  */
+static int
+extn_kind_from_oid (oid_id_t id)
+{
+  switch (id)
+    {
+    case OID_CE_SUBJECT_KEY_ID:        return CERT_EXTN_SUBJECT_KEY_ID;
+    case OID_CE_KEY_USAGE:             return CERT_EXTN_KEY_USAGE;
+    case OID_CE_SUBJECT_ALT_NAME:      return CERT_EXTN_SUBJECT_ALT_NAME;
+    case OID_CE_ISSUER_ALT_NAME:       return CERT_EXTN_ISSUER_ALT_NAME;
+    case OID_CE_BASIC_CONSTRAINTS:     return CERT_EXTN_BASIC_CONSTRAINTS;
+    case OID_CE_CRL_DIST_POINTS:       return CERT_EXTN_CRL_DIST_POINTS;
+    case OID_CE_CERT_POLICIES:         return CERT_EXTN_CERT_POLICIES;
+    case OID_CE_AUTHORITY_KEY_ID:      return CERT_EXTN_AUTHORITY_KEY_ID;
+    case OID_CE_EXT_KEY_USAGE:         return CERT_EXTN_EXT_KEY_USAGE;
+    case OID_PE_AUTHORITY_INFO_ACCESS: return CERT_EXTN_AUTHORITY_INFO_ACCESS;
+    case OID_PE_SUBJECT_INFO_ACCESS:   return CERT_EXTN_SUBJECT_INFO_ACCESS;
+    default:                           return CERT_EXTN_LAST;
+    }
+}
 
 
 /**
@@ -69,10 +87,20 @@ static const char oidstr_subjectInfoAccess[]   = "1.3.6.1.5.5.7.1.11";
 gpg_error_t
 ksba_cert_new (ksba_cert_t *acert)
 {
+  gpg_error_t err;
+
   *acert = xtrycalloc (1, sizeof **acert);
   if (!*acert)
     return gpg_error_from_errno (errno);
+  err = gpgrt_lock_init (&(*acert)->lazy.lock);
+  if (err)
+    {
+      xfree (*acert);
+      *acert = NULL;
+      return err;
+    }
   (*acert)->ref_count++;
+  (*acert)->alloc_ctx = _ksba_alloc_ctx_current ();
 
   return 0;
 }
@@ -83,7 +111,7 @@ ksba_cert_ref (ksba_cert_t cert)
   if (!cert)
     fprintf (stderr, "BUG: ksba_cert_ref for NULL\n");
   else
-    ++cert->ref_count;
+    atomic_add_fetch (&cert->ref_count, 1);
 }
 
 /**
@@ -95,18 +123,22 @@ ksba_cert_ref (ksba_cert_t cert)
 void
 ksba_cert_release (ksba_cert_t cert)
 {
+  ksba_alloc_ctx_t actx, prevctx;
   int i;
 
   if (!cert)
     return;
-  if (cert->ref_count < 1)
+  if (atomic_load_acq (&cert->ref_count) < 1)
     {
       fprintf (stderr, "BUG: trying to release an already released cert\n");
       return;
     }
-  if (--cert->ref_count)
+  if (atomic_add_fetch (&cert->ref_count, -1))
     return;
 
+  actx = cert->alloc_ctx;
+  prevctx = _ksba_alloc_ctx_switch (actx);
+
   if (cert->udata)
     {
       struct cert_user_data *ud = cert->udata;
@@ -123,19 +155,31 @@ ksba_cert_release (ksba_cert_t cert)
     }
 
   xfree (cert->cache.digest_algo);
+  while (cert->cache.fprs)
+    {
+      struct cert_fpr *fpr = cert->cache.fprs->next;
+      xfree (cert->cache.fprs);
+      cert->cache.fprs = fpr;
+    }
   if (cert->cache.extns_valid)
     {
       for (i=0; i < cert->cache.n_extns; i++)
-        xfree (cert->cache.extns[i].oid);
+        xfree (cert->cache.extns[i].oidbuf);
       xfree (cert->cache.extns);
     }
 
   _ksba_asn_release_nodes (cert->root);
   ksba_asn_tree_release (cert->asn_tree);
 
-  xfree (cert->image);
+  if (!cert->image_borrowed)
+    xfree (cert->image);
+  else if (cert->image_release_cb)
+    cert->image_release_cb (cert->image_release_opaque);
 
+  gpgrt_lock_destroy (&cert->lazy.lock);
   xfree (cert);
+  _ksba_alloc_ctx_restore (prevctx);
+  ksba_alloc_ctx_release (actx);
 }
 
 
@@ -252,6 +296,268 @@ ksba_cert_get_user_data (ksba_cert_t cert, const char *key,
 }
 
 
+/**
+ * ksba_cert_set_lazy:
+ * @cert: An unitialized certificate object
+ * @enable: True to enable lazy decoding
+ *
+ * With @enable set, ksba_cert_read_der does not decode the entire
+ * certificate but only locates the image of the certificate, the
+ * tbsCertificate, the serial number and the issuer and subject
+ * names.  ksba_cert_get_image, ksba_cert_hash and
+ * ksba_cert_get_serial then work without decoding the certificate.
+ * All other accessors decode the certificate when first called; if
+ * that fails they return an error as if a value were missing.  Note
+ * that in this mode ksba_cert_read_der may accept certificates which
+ * are rejected later.
+ *
+ * Return value: 0 on success or an error value
+ **/
+gpg_error_t
+ksba_cert_set_lazy (ksba_cert_t cert, int enable)
+{
+  if (!cert)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (cert->initialized)
+    return gpg_error (GPG_ERR_CONFLICT);
+  cert->lazy.enabled = !!enable;
+  return 0;
+}
+
+
+/* Decode the certificate from READER into the tree of CERT.  The
+   image of the certificate is stored at R_IMAGE and R_IMAGELEN.  If
+   R_IMAGE is NULL the image is not copied and only its length is
+   returned; this is for callers which already have the image.  */
+static gpg_error_t
+decode_cert (ksba_cert_t cert, ksba_reader_t reader,
+             unsigned char **r_image, size_t *r_imagelen)
+{
+  gpg_error_t err;
+  BerDecoder decoder;
+  unsigned char *dummy;
+
+  if (!cert->asn_tree)
+    {
+      err = ksba_asn_create_tree ("tmttv2", &cert->asn_tree);
+      if (err)
+        return err;
+    }
+
+  decoder = _ksba_reader_get_decoder (reader);
+  if (!decoder)
+    return gpg_error (GPG_ERR_ENOMEM);
+
+  err = _ksba_ber_decoder_set_module (decoder, cert->asn_tree);
+  if (!err)
+    err = _ksba_ber_decoder_decode (decoder, "TMTTv2.Certificate",
+                                    r_image? 0 : BER_DECODER_FLAG_NO_IMAGE,
+                                    &cert->root, r_image? r_image : &dummy,
+                                    r_imagelen);
+
+  _ksba_reader_put_decoder (reader, decoder);
+  return err;
+}
+
+
+/* Decode the image of a lazily read certificate.  */
+static gpg_error_t
+decode_image (ksba_cert_t cert)
+{
+  gpg_error_t err;
+  ksba_reader_t reader;
+  size_t imagelen = 0;
+
+  err = ksba_reader_new (&reader);
+  if (err)
+    goto leave;
+  err = ksba_reader_set_mem (reader, cert->image, cert->imagelen);
+  if (!err)
+    err = decode_cert (cert, reader, NULL, &imagelen);
+  if (!err && imagelen != cert->imagelen)
+    err = gpg_error (GPG_ERR_INV_CERT_OBJ);
+  ksba_reader_release (reader);
+  if (err)
+    {
+      _ksba_asn_release_nodes (cert->root);
+      cert->root = NULL;
+    }
+ leave:
+  /* Publish the tree to other threads.  */
+  atomic_store_rel (&cert->lazy.pending, 0);
+  return err;
+}
+
+
+/* Move the cursor C to the next element of the image of CERT, check
+   that it has the class CLS and the tag TAG and store its position
+   as IDX unless IDX is negative.  */
+static gpg_error_t
+lazy_tlv (ksba_cert_t cert, ksba_der_cursor_t c,
+          int cls, int tag, int idx)
+{
+  gpg_error_t err;
+  int class, tg;
+
+  err = _ksba_der_cursor_next (c, &class, &tg, NULL, NULL);
+  if (gpg_err_code (err) == GPG_ERR_EOF)
+    err = gpg_error (GPG_ERR_INV_CERT_OBJ);
+  if (err)
+    return err;
+  if (class != cls || tg != tag)
+    return gpg_error (GPG_ERR_INV_CERT_OBJ);
+  if (idx >= 0)
+    {
+      cert->lazy.tlv[idx].off = c->_off;
+      cert->lazy.tlv[idx].nhdr = c->_nhdr;
+      cert->lazy.tlv[idx].len = c->_len;
+    }
+  return 0;
+}
+
+
+/* Locate the TLVs we need for the lazy mode in the image of CERT.
+   The image must be valid DER.  */
+static gpg_error_t
+lazy_scan (ksba_cert_t cert)
+{
+  gpg_error_t err;
+  struct ksba_der_cursor_s c;
+  int class, tag;
+
+  _ksba_der_cursor_init (&c, cert->image, cert->imagelen);
+  err = lazy_tlv (cert, &c, CLASS_UNIVERSAL, TYPE_SEQUENCE,
+                  CERT_NODE_CERTIFICATE);
+  if (!err)
+    err = _ksba_der_cursor_enter (&c);
+  if (!err)
+    err = lazy_tlv (cert, &c, CLASS_UNIVERSAL, TYPE_SEQUENCE, CERT_NODE_TBS);
+  if (!err)
+    err = _ksba_der_cursor_enter (&c);
+  if (err)
+    return err;
+
+  /* Skip the optional version.  */
+  err = _ksba_der_cursor_next (&c, &class, &tag, NULL, NULL);
+  if (gpg_err_code (err) == GPG_ERR_EOF)
+    err = gpg_error (GPG_ERR_INV_CERT_OBJ);
+  if (err)
+    return err;
+  if (class == CLASS_CONTEXT && !tag)
+    err = lazy_tlv (cert, &c, CLASS_UNIVERSAL, TYPE_INTEGER, CERT_NODE_SERIAL);
+  else if (class == CLASS_UNIVERSAL && tag == TYPE_INTEGER)
+    {
+      cert->lazy.tlv[CERT_NODE_SERIAL].off = c._off;
+      cert->lazy.tlv[CERT_NODE_SERIAL].nhdr = c._nhdr;
+      cert->lazy.tlv[CERT_NODE_SERIAL].len = c._len;
+    }
+  else
+    err = gpg_error (GPG_ERR_INV_CERT_OBJ);
+  if (!err)  /* signature */
+    err = lazy_tlv (cert, &c, CLASS_UNIVERSAL, TYPE_SEQUENCE, -1);
+  if (!err)
+    err = lazy_tlv (cert, &c, CLASS_UNIVERSAL, TYPE_SEQUENCE, CERT_NODE_ISSUER);
+  if (!err)  /* validity */
+    err = lazy_tlv (cert, &c, CLASS_UNIVERSAL, TYPE_SEQUENCE, -1);
+  if (!err)
+    err = lazy_tlv (cert, &c, CLASS_UNIVERSAL, TYPE_SEQUENCE,
+                    CERT_NODE_SUBJECT);
+  if (!err)  /* subjectPublicKeyInfo */
+    err = lazy_tlv (cert, &c, CLASS_UNIVERSAL, TYPE_SEQUENCE, -1);
+  /* Skip the optional parts including the extensions.  */
+  if (!err)
+    err = _ksba_der_cursor_leave (&c);
+  /* signatureAlgorithm and signatureValue */
+  if (!err)
+    err = lazy_tlv (cert, &c, CLASS_UNIVERSAL, TYPE_SEQUENCE, -1);
+  if (!err)
+    err = lazy_tlv (cert, &c, CLASS_UNIVERSAL, TYPE_BIT_STRING, -1);
+  if (err)
+    return err;
+
+  /* Nothing may follow, neither in the certificate nor after it.  */
+  err = _ksba_der_cursor_next (&c, NULL, NULL, NULL, NULL);
+  if (gpg_err_code (err) != GPG_ERR_EOF)
+    return gpg_error (GPG_ERR_INV_CERT_OBJ);
+  err = _ksba_der_cursor_leave (&c);
+  if (!err)
+    err = _ksba_der_cursor_next (&c, NULL, NULL, NULL, NULL);
+  if (gpg_err_code (err) != GPG_ERR_EOF)
+    return gpg_error (GPG_ERR_INV_CERT_OBJ);
+  return 0;
+}
+
+
+/* The lazy version of ksba_cert_read_der.  If the image of CERT is
+   borrowed, READER reads from that image.  */
+static gpg_error_t
+read_lazy (ksba_cert_t cert, ksba_reader_t reader)
+{
+  gpg_error_t err;
+  struct tag_info ti;
+  const unsigned char *p;
+  size_t n, nread;
+
+  err = _ksba_ber_read_tl (reader, &ti);
+  if (err)
+    return err;
+  if (ti.class != CLASS_UNIVERSAL || ti.tag != TYPE_SEQUENCE
+      || !ti.is_constructed || ti.ndef)
+    {
+      /* Leave it to the decoder to handle or reject this.  */
+      err = ksba_reader_unread (reader, ti.buf, ti.nhdr);
+      if (!err)
+        err = decode_cert (cert, reader,
+                           cert->image_borrowed? NULL : &cert->image,
+                           &cert->imagelen);
+      return err;
+    }
+
+  cert->imagelen = ti.nhdr + ti.length;
+  if (cert->image_borrowed)
+    {
+      /* Nothing to copy; just skip the value.  */
+      err = ksba_reader_peek (reader, &p, &n);
+      if (!err && n < ti.length)
+        err = gpg_error (GPG_ERR_BAD_BER);
+      if (!err)
+        err = ksba_reader_consume (reader, ti.length);
+      if (err)
+        goto leave;
+      goto scan;
+    }
+  cert->image = xtrymalloc (cert->imagelen);
+  if (!cert->image)
+    return gpg_error_from_syserror ();
+  memcpy (cert->image, ti.buf, ti.nhdr);
+  for (n = ti.nhdr; n < cert->imagelen; n += nread)
+    {
+      err = ksba_reader_read (reader, cert->image + n,
+                              cert->imagelen - n, &nread);
+      if (gpg_err_code (err) == GPG_ERR_EOF)
+        err = gpg_error (GPG_ERR_BAD_BER);
+      if (err)
+        goto leave;
+    }
+
+
+ scan:
+  if (lazy_scan (cert))
+    err = decode_image (cert); /* Get a proper result.  */
+  else
+    cert->lazy.pending = 1;
+
+ leave:
+  if (err && !cert->image_borrowed)
+    {
+      xfree (cert->image);
+      cert->image = NULL;
+      cert->imagelen = 0;
+    }
+  return err;
+}
+
+
 /**
  * ksba_cert_read_der:
  * @cert: An unitialized certificate object
@@ -260,7 +566,8 @@ ksba_cert_get_user_data (ksba_cert_t cert, const char *key,
  * Read the next certificate from the reader and store it in the
  * certificate object for future access.  The certificate is parsed
  * and rejected if it has any syntactical or semantical error
- * (i.e. does not match the ASN.1 description).
+ * (i.e. does not match the ASN.1 description).  See also
+ * ksba_cert_set_lazy.
  *
  * Return value: 0 on success or an error value
  **/
@@ -268,7 +575,6 @@ gpg_error_t
 ksba_cert_read_der (ksba_cert_t cert, ksba_reader_t reader)
 {
   gpg_error_t err = 0;
-  BerDecoder decoder = NULL;
 
   if (!cert || !reader)
     return gpg_error (GPG_ERR_INV_VALUE);
@@ -280,43 +586,98 @@ ksba_cert_read_der (ksba_cert_t cert, ksba_reader_t reader)
   cert->root = NULL;
   cert->asn_tree = NULL;
 
-  err = ksba_asn_create_tree ("tmttv2", &cert->asn_tree);
-  if (err)
-    goto leave;
+  if (cert->lazy.enabled)
+    err = read_lazy (cert, reader);
+  else
+    err = decode_cert (cert, reader, &cert->image, &cert->imagelen);
+  if (!err)
+    cert->initialized = 1;
 
-  decoder = _ksba_ber_decoder_new ();
-  if (!decoder)
-    {
-      err = gpg_error (GPG_ERR_ENOMEM);
-      goto leave;
-    }
+  return err;
+}
 
-  err = _ksba_ber_decoder_set_reader (decoder, reader);
-  if (err)
-    goto leave;
 
-  err = _ksba_ber_decoder_set_module (decoder, cert->asn_tree);
+gpg_error_t
+ksba_cert_init_from_mem (ksba_cert_t cert, const void *buffer, size_t length)
+{
+  gpg_error_t err;
+  ksba_reader_t reader;
+
+  err = ksba_reader_new (&reader);
+  if (err)
+    return err;
+  err = ksba_reader_set_mem (reader, buffer, length);
   if (err)
-     goto leave;
+    {
+      ksba_reader_release (reader);
+      return err;
+    }
+  err = ksba_cert_read_der (cert, reader);
+  ksba_reader_release (reader);
+  return err;
+}
 
-  err = _ksba_ber_decoder_decode (decoder, "TMTTv2.Certificate", 0,
-                                  &cert->root, &cert->image, &cert->imagelen);
-  if (!err)
-      cert->initialized = 1;
 
- leave:
-  _ksba_ber_decoder_release (decoder);
+/* Read the certificate at the current position of READER into CERT
+   without copying the image.  BUFFER is the address of the data at
+   that position and must stay valid as long as CERT.  */
+static gpg_error_t
+read_borrowed (ksba_cert_t cert, ksba_reader_t reader, const void *buffer)
+{
+  gpg_error_t err;
 
+  _ksba_asn_release_nodes (cert->root);
+  ksba_asn_tree_release (cert->asn_tree);
+  cert->root = NULL;
+  cert->asn_tree = NULL;
+
+  cert->image = (unsigned char *)buffer;
+  cert->image_borrowed = 1;
+  if (cert->lazy.enabled)
+    err = read_lazy (cert, reader);
+  else
+    err = decode_cert (cert, reader, NULL, &cert->imagelen);
+  if (err)
+    {
+      cert->image = NULL;
+      cert->imagelen = 0;
+      cert->image_borrowed = 0;
+    }
   return err;
 }
 
 
+/**
+ * ksba_cert_init_from_mem_ref:
+ * @cert: An unitialized certificate object
+ * @buffer: A buffer with the DER encoded certificate
+ * @length: The length of @buffer
+ * @release_cb: NULL or a function to release @buffer
+ * @opaque: The argument for @release_cb
+ *
+ * This is the same as ksba_cert_init_from_mem but the certificate
+ * object does not copy the image of the certificate; it keeps a
+ * reference to @buffer instead.  The caller must not change or free
+ * @buffer until the certificate object is released.  If @release_cb
+ * is given and the function succeeds, it is called with @opaque
+ * when the certificate object is released; this may be used to drop
+ * a reference on shared memory.
+ *
+ * Return value: 0 on success or an error value
+ **/
 gpg_error_t
-ksba_cert_init_from_mem (ksba_cert_t cert, const void *buffer, size_t length)
+ksba_cert_init_from_mem_ref (ksba_cert_t cert,
+                             const void *buffer, size_t length,
+                             void (*release_cb) (void *opaque), void *opaque)
 {
   gpg_error_t err;
   ksba_reader_t reader;
 
+  if (!cert || !buffer || !length)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (cert->initialized)
+    return gpg_error (GPG_ERR_CONFLICT);
+
   err = ksba_reader_new (&reader);
   if (err)
     return err;
@@ -326,28 +687,230 @@ ksba_cert_init_from_mem (ksba_cert_t cert, const void *buffer, size_t length)
       ksba_reader_release (reader);
       return err;
     }
-  err = ksba_cert_read_der (cert, reader);
+
+  err = read_borrowed (cert, reader, buffer);
   ksba_reader_release (reader);
+  if (err)
+    return err;
+
+  cert->image_release_cb = release_cb;
+  cert->image_release_opaque = opaque;
+  cert->initialized = 1;
+  return 0;
+}
+
+
+/**
+ * ksba_cert_read_bundle:
+ * @reader: A KSBA Reader object
+ * @flags: A bit vector of KSBA_CERT_BUNDLE_ flags
+ * @cb: A function called for each certificate
+ * @opaque: The first argument for @cb
+ * @r_count: NULL or a variable receiving the number of certificates
+ *
+ * Read all DER encoded certificates up to the end of @reader.  For
+ * each certificate @cb is called with a new certificate object; @cb
+ * needs to take a reference with ksba_cert_ref to keep it.  If @cb
+ * returns an error, reading stops and that error is returned.  The
+ * certificates share the decoder of @reader and the ASN.1 tree.
+ *
+ * With the flag KSBA_CERT_BUNDLE_LAZY the certificates are read as
+ * by ksba_cert_set_lazy.  With the flag KSBA_CERT_BUNDLE_REF the
+ * certificates reference the data of @reader instead of copying it,
+ * as ksba_cert_init_from_mem_ref would do; this requires a reader
+ * initialized by ksba_reader_set_mem or ksba_reader_set_mmap which
+ * the caller must not release or reuse as long as the certificates
+ * are in use.  GPG_ERR_NOT_SUPPORTED is returned for other readers.
+ *
+ * On error @r_count gives the number of certificates passed to @cb.
+ *
+ * Return value: 0 on success or an error value
+ **/
+gpg_error_t
+ksba_cert_read_bundle (ksba_reader_t reader, unsigned int flags,
+                       gpg_error_t (*cb) (void *opaque, ksba_cert_t cert),
+                       void *opaque, unsigned int *r_count)
+{
+  gpg_error_t err;
+  ksba_cert_t cert;
+  unsigned int count = 0;
+  const unsigned char *p = NULL;
+  const unsigned char *s;
+  struct tag_info ti;
+  unsigned char c;
+  size_t n;
+
+  if (r_count)
+    *r_count = 0;
+  if (!reader || !cb
+      || (flags & ~(KSBA_CERT_BUNDLE_LAZY | KSBA_CERT_BUNDLE_REF)))
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if ((flags & KSBA_CERT_BUNDLE_REF)
+      && reader->type != READER_TYPE_MEM && reader->type != READER_TYPE_MMAP)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  for (;;)
+    {
+      /* Check for the end of the bundle.  */
+      if ((flags & KSBA_CERT_BUNDLE_REF))
+        {
+          err = ksba_reader_peek (reader, &p, &n);
+          /* Data pushed back by ksba_reader_unread can't be
+             referenced.  */
+          if (!err && (p < reader->u.mem.buffer
+                       || p >= reader->u.mem.buffer + reader->u.mem.size))
+            err = gpg_error (GPG_ERR_NOT_SUPPORTED);
+        }
+      else
+        {
+          err = ksba_reader_read (reader, &c, 1, &n);
+          if (!err)
+            err = ksba_reader_unread (reader, &c, 1);
+        }
+      if (gpg_err_code (err) == GPG_ERR_EOF)
+        {
+          err = 0;
+          break;
+        }
+      if (err)
+        break;
+
+      err = ksba_cert_new (&cert);
+      if (err)
+        break;
+      cert->lazy.enabled = !!(flags & KSBA_CERT_BUNDLE_LAZY);
+      if ((flags & KSBA_CERT_BUNDLE_REF))
+        err = read_borrowed (cert, reader, p);
+      else
+        err = ksba_cert_read_der (cert, reader);
+      /* The decoder accepts a certificate truncated at the end of an
+         element; that would go unnoticed at the end of a bundle.  */
+      if (!err)
+        {
+          s = cert->image;
+          n = cert->imagelen;
+          err = _ksba_ber_parse_tl (&s, &n, &ti);
+          if (!err && ti.nhdr + ti.length != cert->imagelen)
+            err = gpg_error (GPG_ERR_BAD_BER);
+        }
+      if (!err)
+        {
+          cert->initialized = 1;
+          count++;
+          err = cb (opaque, cert);
+        }
+      ksba_cert_release (cert);
+      if (err)
+        break;
+    }
+
+  if (r_count)
+    *r_count = count;
   return err;
 }
 
 
 
+/* The paths of the nodes cached by _ksba_cert_find_node indexed by
+   enum cert_nodes.  */
+static const char * const cert_node_paths[CERT_NODE_LAST] =
+  {
+    "Certificate",
+    "Certificate.tbsCertificate",
+    "Certificate.signatureAlgorithm",
+    "Certificate.tbsCertificate.serialNumber",
+    "Certificate.tbsCertificate.issuer",
+    "Certificate.tbsCertificate.subject",
+    "Certificate.tbsCertificate.validity.notBefore",
+    "Certificate.tbsCertificate.validity.notAfter",
+    "Certificate.tbsCertificate.subjectPublicKeyInfo",
+    "Certificate.tbsCertificate.extensions.."
+  };
+
+
+/* Return the node WHICH of CERT.  The tree of a certificate does not
+   change after it has been read; thus the result of the lookup is
+   cached.  The accessors are often called in a loop and the lookup
+   by name would be the main part of their work.  */
+AsnNode
+_ksba_cert_find_node (ksba_cert_t cert, enum cert_nodes which)
+{
+  unsigned int bit = 1u << which;
+
+  if (!cert->initialized)
+    return NULL;
+  if (atomic_load_acq (&cert->lazy.pending))
+    {
+      gpgrt_lock_lock (&cert->lazy.lock);
+      if (cert->lazy.pending)
+        {
+          /* The tree belongs to CERT.  */
+          ksba_alloc_ctx_t prevctx = _ksba_alloc_ctx_switch (cert->alloc_ctx);
+          gpg_error_t err = decode_image (cert);
+
+          _ksba_alloc_ctx_restore (prevctx);
+          if (err)
+            cert->last_error = err;
+        }
+      gpgrt_lock_unlock (&cert->lazy.lock);
+    }
+  if (!(atomic_load_acq (&cert->cache.nodes_valid) & bit))
+    {
+      gpgrt_lock_lock (&cache_lock);
+      if (!(cert->cache.nodes_valid & bit))
+        {
+          cert->cache.nodes[which] = _ksba_asn_find_node
+            (cert->root, cert_node_paths[which]);
+          atomic_store_rel (&cert->cache.nodes_valid,
+                            cert->cache.nodes_valid | bit);
+        }
+      gpgrt_lock_unlock (&cache_lock);
+    }
+  return cert->cache.nodes[which];
+}
+
+
+/* Get the position of the TLV WHICH in the image of CERT.  This
+   works without decoding a lazily read certificate but WHICH must be
+   one of the TLVs located by lazy_scan.  For the issuer and subject
+   the DN and not the choice node is returned.  */
+static gpg_error_t
+get_tlv (ksba_cert_t cert, enum cert_nodes which,
+         size_t *r_off, size_t *r_nhdr, size_t *r_len)
+{
+  AsnNode n;
+
+  if (atomic_load_acq (&cert->lazy.pending))
+    {
+      *r_off = cert->lazy.tlv[which].off;
+      *r_nhdr = cert->lazy.tlv[which].nhdr;
+      *r_len = cert->lazy.tlv[which].len;
+      return 0;
+    }
+
+  n = _ksba_cert_find_node (cert, which);
+  if (n && (which == CERT_NODE_ISSUER || which == CERT_NODE_SUBJECT))
+    n = n->down; /* dereference the choice node */
+  if (!n || n->off == -1)
+    return gpg_error (GPG_ERR_NO_VALUE);
+  *r_off = n->off;
+  *r_nhdr = n->nhdr;
+  *r_len = n->len;
+  return 0;
+}
+
+
 const unsigned char *
 ksba_cert_get_image (ksba_cert_t cert, size_t *r_length )
 {
-  AsnNode n;
+  size_t off, nhdr, len;
 
   if (!cert)
     return NULL;
   if (!cert->initialized)
     return NULL;
 
-  n = _ksba_asn_find_node (cert->root, "Certificate");
-  if (!n)
-    return NULL;
-
-  if (n->off == -1)
+  if (get_tlv (cert, CERT_NODE_CERTIFICATE, &off, &nhdr, &len))
     {
 /*        fputs ("ksba_cert_get_image problem at node:\n", stderr); */
 /*        _ksba_asn_node_dump_all (n, stderr); */
@@ -356,18 +919,18 @@ ksba_cert_get_image (ksba_cert_t cert, size_t *r_length )
 
   /* Due to minor problems in our parser we might hit the assertion
      below.  Thus we better return a error, proper. */
-  if ( !(n->nhdr + n->len + n->off <= cert->imagelen) )
+  if ( !(nhdr + len + off <= cert->imagelen) )
     {
       fprintf (stderr,"\nOops, ksba_cert_get_image failed: "
                "imagelen=%lu  hdr=%d len=%d off=%d\n",
-               (unsigned long)cert->imagelen, n->nhdr, (int)n->len, n->off);
+               (unsigned long)cert->imagelen, (int)nhdr, (int)len, (int)off);
       return NULL;
     }
   /*assert (n->nhdr + n->len + n->off <= cert->imagelen);*/
 
   if (r_length)
-    *r_length = n->nhdr + n->len;
-  return cert->image + n->off;
+    *r_length = nhdr + len;
+  return cert->image + off;
 }
 
 /* Check whether certificates A and B are identical and return o in
@@ -395,28 +958,140 @@ ksba_cert_hash (ksba_cert_t cert, int what,
                 void (*hasher)(void *, const void *, size_t length),
                 void *hasher_arg)
 {
-  AsnNode n;
+  size_t off, nhdr, len;
 
   if (!cert /*|| !hasher*/)
     return gpg_error (GPG_ERR_INV_VALUE);
   if (!cert->initialized)
     return gpg_error (GPG_ERR_NO_DATA);
 
-  n = _ksba_asn_find_node (cert->root,
-                           what == 1? "Certificate.tbsCertificate"
-                                    : "Certificate");
-  if (!n)
-    return gpg_error (GPG_ERR_NO_VALUE); /* oops - should be there */
-  if (n->off == -1)
+  if (get_tlv (cert, (what == 1? CERT_NODE_TBS : CERT_NODE_CERTIFICATE),
+               &off, &nhdr, &len))
     {
 /*        fputs ("ksba_cert_hash problem at node:\n", stderr); */
 /*        _ksba_asn_node_dump_all (n, stderr); */
       return gpg_error (GPG_ERR_NO_VALUE);
     }
 
-  hasher (hasher_arg, cert->image + n->off,  n->nhdr + n->len);
+  hasher (hasher_arg, cert->image + off,  nhdr + len);
+
+
+  return 0;
+}
+
+
+/**
+ * ksba_cert_get_fingerprint:
+ * @cert: An initialized certificate object
+ * @what: The part of the certificate to hash
+ * @algo: The name of the hash algorithm
+ * @digest_fnc: NULL or a function to compute the digest
+ * @digest_fnc_arg: The first argument for @digest_fnc
+ * @r_digest: Receives the digest
+ * @r_digestlen: Receives the length of the digest
+ *
+ * Return the digest of the part @what of the certificate computed
+ * with the hash algorithm @algo.  @what is %KSBA_FPR_CERT for the
+ * entire certificate (the fingerprint), or %KSBA_FPR_ISSUER or
+ * %KSBA_FPR_SUBJECT for the DER encoding of the issuer or subject
+ * name.  KSBA does not implement hash algorithms; the digest is
+ * computed by calling @digest_fnc with @algo, the data to hash, a
+ * buffer for the digest and the address of its length, which is
+ * %KSBA_MAX_DIGEST_LEN on input and must be set to the length of the
+ * digest.  The result is cached in the certificate object and later
+ * calls with the same @what and @algo return it without calling
+ * @digest_fnc.  If @digest_fnc is NULL only the cache is consulted
+ * and GPG_ERR_NOT_FOUND is returned if the digest has not yet been
+ * computed.
+ *
+ * The returned digest is valid as long as the certificate object.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_cert_get_fingerprint (ksba_cert_t cert, ksba_fpr_part_t what,
+                           const char *algo,
+                           gpg_error_t (*digest_fnc)
+                             (void *arg, const char *algo,
+                              const void *buffer, size_t length,
+                              unsigned char *digest, size_t *r_digestlen),
+                           void *digest_fnc_arg,
+                           const unsigned char **r_digest,
+                           size_t *r_digestlen)
+{
+  gpg_error_t err;
+  struct cert_fpr *fpr, *f;
+  enum cert_nodes which;
+  size_t off, nhdr, len;
+  ksba_alloc_ctx_t prevctx;
+
+  if (!cert || !algo || !r_digest || !r_digestlen)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  switch (what)
+    {
+    case KSBA_FPR_CERT:    which = CERT_NODE_CERTIFICATE; break;
+    case KSBA_FPR_ISSUER:  which = CERT_NODE_ISSUER; break;
+    case KSBA_FPR_SUBJECT: which = CERT_NODE_SUBJECT; break;
+    default: return gpg_error (GPG_ERR_INV_VALUE);
+    }
+  if (!cert->initialized)
+    return gpg_error (GPG_ERR_NO_DATA);
+
+  for (f = atomic_load_acq (&cert->cache.fprs); f; f = f->next)
+    if (f->what == what && !strcmp (f->algo, algo))
+      {
+        *r_digest = f->digest;
+        *r_digestlen = f->digestlen;
+        return 0;
+      }
+  if (!digest_fnc)
+    return gpg_error (GPG_ERR_NOT_FOUND);
+
+  if (get_tlv (cert, which, &off, &nhdr, &len))
+    return gpg_error (GPG_ERR_NO_VALUE);
+
+  /* The cache is released using the context of CERT.  */
+  prevctx = _ksba_alloc_ctx_switch (cert->alloc_ctx);
+  fpr = xtrycalloc (1, sizeof *fpr + strlen (algo));
+  if (!fpr)
+    {
+      err = gpg_error_from_syserror ();
+      _ksba_alloc_ctx_restore (prevctx);
+      return err;
+    }
+  fpr->what = what;
+  strcpy (fpr->algo, algo);
+  fpr->digestlen = sizeof fpr->digest;
+  err = digest_fnc (digest_fnc_arg, algo, cert->image + off, nhdr + len,
+                    fpr->digest, &fpr->digestlen);
+  if (!err && fpr->digestlen > sizeof fpr->digest)
+    err = gpg_error (GPG_ERR_INV_LENGTH);
+  if (err)
+    {
+      xfree (fpr);
+      _ksba_alloc_ctx_restore (prevctx);
+      return err;
+    }
 
+  gpgrt_lock_lock (&cache_lock);
+  for (f = cert->cache.fprs; f; f = f->next)
+    if (f->what == what && !strcmp (f->algo, algo))
+      break;
+  if (f)  /* Another thread was faster.  */
+    {
+      xfree (fpr);
+      fpr = f;
+    }
+  else
+    {
+      fpr->next = cert->cache.fprs;
+      atomic_store_rel (&cert->cache.fprs, fpr);
+    }
+  gpgrt_lock_unlock (&cache_lock);
+  _ksba_alloc_ctx_restore (prevctx);
 
+  *r_digest = fpr->digest;
+  *r_digestlen = fpr->digestlen;
   return 0;
 }
 
@@ -444,6 +1119,7 @@ ksba_cert_get_digest_algo (ksba_cert_t cert)
   AsnNode n;
   char *algo;
   size_t nread;
+  ksba_alloc_ctx_t prevctx;
 
   if (!cert)
     return NULL;  /* Ooops (can't set cert->last_error :-().  */
@@ -454,8 +1130,9 @@ ksba_cert_get_digest_algo (ksba_cert_t cert)
        return NULL;
     }
 
-  if (cert->cache.digest_algo)
-    return cert->cache.digest_algo;
+  algo = atomic_load_acq (&cert->cache.digest_algo);
+  if (algo)
+    return algo;
 
 /*   n = _ksba_asn_find_node (cert->root, */
 /*                            "Certificate.signatureAlgorithm.algorithm"); */
@@ -465,142 +1142,467 @@ ksba_cert_get_digest_algo (ksba_cert_t cert)
 /*   else  */
 /*     cert->cache.digest_algo = algo; */
 
-  n = _ksba_asn_find_node (cert->root, "Certificate.signatureAlgorithm");
+  n = _ksba_cert_find_node (cert, CERT_NODE_SIGALGO);
+  prevctx = _ksba_alloc_ctx_switch (cert->alloc_ctx);
   if (!n || n->off == -1)
     {
       algo = NULL;
       err = gpg_error (GPG_ERR_UNKNOWN_ALGORITHM);
     }
-  else
-    err = _ksba_parse_algorithm_identifier (cert->image + n->off,
-                                            n->nhdr + n->len, &nread, &algo);
-  if (err)
-    cert->last_error = err;
-  else
-    cert->cache.digest_algo = algo;
+  else
+    err = _ksba_parse_algorithm_identifier (cert->image + n->off,
+                                            n->nhdr + n->len, &nread, &algo);
+  if (err)
+    cert->last_error = err;
+  else
+    {
+      /* Another thread may have been faster.  */
+      gpgrt_lock_lock (&cache_lock);
+      if (cert->cache.digest_algo)
+        {
+          xfree (algo);
+          algo = cert->cache.digest_algo;
+        }
+      else
+        atomic_store_rel (&cert->cache.digest_algo, algo);
+      gpgrt_lock_unlock (&cache_lock);
+    }
+  _ksba_alloc_ctx_restore (prevctx);
+
+  return algo;
+}
+
+
+
+
+/**
+ * ksba_cert_get_serial:
+ * @cert: certificate object
+ *
+ * This function returnes the serial number of the certificate.  The
+ * serial number is an integer returned as an canonical encoded
+ * S-expression with just one element.
+ *
+ * Return value: An allocated S-Exp or NULL for no value.
+ **/
+ksba_sexp_t
+ksba_cert_get_serial (ksba_cert_t cert)
+{
+  size_t off, nhdr, len;
+  char *p;
+  char numbuf[22];
+  int numbuflen;
+
+  if (!cert || !cert->initialized)
+    return NULL;
+
+  if (get_tlv (cert, CERT_NODE_SERIAL, &off, &nhdr, &len))
+    {
+/*        fputs ("get_serial problem at node:\n", stderr); */
+/*        _ksba_asn_node_dump_all (n, stderr); */
+      return NULL;
+    }
+
+  sprintf (numbuf,"(%u:", (unsigned int)len);
+  numbuflen = strlen (numbuf);
+  p = xtrymalloc (numbuflen + len + 2);
+  if (!p)
+    return NULL;
+  strcpy (p, numbuf);
+  memcpy (p+numbuflen, cert->image + off + nhdr, len);
+  p[numbuflen + len] = ')';
+  p[numbuflen + len + 1] = 0;
+  return p;
+}
+
+
+/* Return a pointer to the DER encoding of the serial number in CERT in
+   PTR and the length of that field in LENGTH.  */
+gpg_error_t
+_ksba_cert_get_serial_ptr (ksba_cert_t cert,
+                           unsigned char const **ptr, size_t *length)
+{
+  size_t off, nhdr, len;
+
+  if (!cert || !cert->initialized || !ptr || !length)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (get_tlv (cert, CERT_NODE_SERIAL, &off, &nhdr, &len))
+    return gpg_error (GPG_ERR_NO_VALUE);
+
+  *ptr = cert->image + off;
+  *length = nhdr + len;
+  return 0;
+}
+
+
+
+/**
+ * ksba_cert_get_issuer_dn_ptr:
+ * @cert: An initialized certificate object
+ * @ptr: Receives a pointer to the DER encoded issuer
+ * @length: Receives the length of the issuer
+ *
+ * Return a pointer to the DER encoding of the issuer's DN in the image
+ * of @cert.  The pointer is valid as long as @cert.  Use
+ * ksba_dn_cmp_der to compare such names.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_cert_get_issuer_dn_ptr (ksba_cert_t cert,
+                             unsigned char const **ptr, size_t *length)
+{
+  size_t off, nhdr, len;
+
+  if (!cert || !cert->initialized || !ptr || !length)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  if (get_tlv (cert, CERT_NODE_ISSUER, &off, &nhdr, &len))
+    return gpg_error (GPG_ERR_NO_VALUE);
+  *ptr = cert->image + off;
+  *length = nhdr + len;
+  return 0;
+}
+
+
+
+/**
+ * ksba_cert_get_subject_dn_ptr:
+ * @cert: An initialized certificate object
+ * @ptr: Receives a pointer to the DER encoded subject
+ * @length: Receives the length of the subject
+ *
+ * Return a pointer to the DER encoding of the subject's DN in the image
+ * of @cert.  The pointer is valid as long as @cert.  Use
+ * ksba_dn_cmp_der to compare such names.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_cert_get_subject_dn_ptr (ksba_cert_t cert,
+                             unsigned char const **ptr, size_t *length)
+{
+  size_t off, nhdr, len;
+
+  if (!cert || !cert->initialized || !ptr || !length)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  if (get_tlv (cert, CERT_NODE_SUBJECT, &off, &nhdr, &len))
+    return gpg_error (GPG_ERR_NO_VALUE);
+  *ptr = cert->image + off;
+  *length = nhdr + len;
+  return 0;
+}
+
+
+
+/* Helper for ksba_cert_get_view to move to the element IDX of the
+   content at BUF of length SIZE.  On success BUF and SIZE describe
+   the value of that element and TI its header.  */
+static gpg_error_t
+view_nth (unsigned char const **buf, size_t *size, int idx,
+          struct tag_info *ti)
+{
+  gpg_error_t err;
+
+  for (;;)
+    {
+      if (!*size)
+        return gpg_error (GPG_ERR_EOF);
+      err = _ksba_ber_parse_tl (buf, size, ti);
+      if (err)
+        return err;
+      if (ti->ndef || ti->length > *size)
+        return gpg_error (GPG_ERR_INV_CERT_OBJ);
+      if (!idx--)
+        {
+          *size = ti->length;
+          return 0;
+        }
+      parse_skip (buf, size, ti);
+    }
+}
+
+
+/**
+ * ksba_cert_get_view:
+ * @cert: An initialized certificate object
+ * @what: The part of the certificate to return
+ * @r_der: Receives a pointer to the DER encoded part
+ * @r_derlen: Receives the length of the part
+ * @r_tag: If not NULL, receives the universal tag of the part
+ *
+ * Return a pointer to the complete TLV of the part @what in the image
+ * of @cert.  The pointer is valid as long as @cert; nothing is
+ * allocated and a lazily read certificate is not decoded.  The tag
+ * allows to distinguish the variants of a part; for example the
+ * validity times may either be an UTCTime or a GeneralizedTime.  For
+ * %KSBA_CERT_VIEW_EXTENSIONS the SEQUENCE inside of the explicit tag
+ * is returned; ksba_cert_get_extension gives access to the single
+ * extensions.
+ *
+ * Return value: 0 on success, GPG_ERR_NO_VALUE if the certificate
+ * has no such part or another error code.
+ **/
+gpg_error_t
+ksba_cert_get_view (ksba_cert_t cert, ksba_cert_view_t what,
+                    const unsigned char **r_der, size_t *r_derlen,
+                    int *r_tag)
+{
+  gpg_error_t err;
+  const unsigned char *buf, *tbs;
+  size_t size, tbslen;
+  struct tag_info ti;
+  int idx;
+
+  if (!cert || !cert->initialized || !r_der || !r_derlen)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  /* The image has already been checked when reading the certificate;
+     thus we only need to step to the requested element.  */
+  buf = cert->image;
+  size = cert->imagelen;
+  err = view_nth (&buf, &size, 0, &ti);
+  if (err || what == KSBA_CERT_VIEW_CERT)
+    goto leave;
+
+  switch (what)
+    {
+    case KSBA_CERT_VIEW_TBS:     idx = 0; break;
+    case KSBA_CERT_VIEW_SIGALGO: idx = 1; break;
+    case KSBA_CERT_VIEW_SIGVAL:  idx = 2; break;
+    default:                     idx = -1; break;
+    }
+  err = view_nth (&buf, &size, idx == -1? 0 : idx, &ti);
+  if (err || idx != -1)
+    goto leave;
+
+  /* Now walk the tbsCertificate.  */
+  tbs = buf;
+  tbslen = size;
+  err = view_nth (&buf, &size, 0, &ti);
+  if (err)
+    goto leave;
+  idx = (ti.class == CLASS_CONTEXT && !ti.tag); /* Skip the version.  */
+  switch (what)
+    {
+    case KSBA_CERT_VIEW_SERIAL:    idx += 0; break;
+    case KSBA_CERT_VIEW_ISSUER:    idx += 2; break;
+    case KSBA_CERT_VIEW_VALIDITY:
+    case KSBA_CERT_VIEW_NOTBEFORE:
+    case KSBA_CERT_VIEW_NOTAFTER:  idx += 3; break;
+    case KSBA_CERT_VIEW_SUBJECT:   idx += 4; break;
+    case KSBA_CERT_VIEW_PUBKEY:    idx += 5; break;
+    case KSBA_CERT_VIEW_EXTENSIONS: idx += 6; break;
+    default:
+      return gpg_error (GPG_ERR_INV_VALUE);
+    }
+
+  if (what == KSBA_CERT_VIEW_EXTENSIONS)
+    {
+      /* Skip the optional unique identifiers.  */
+      do
+        {
+          buf = tbs;
+          size = tbslen;
+          err = view_nth (&buf, &size, idx++, &ti);
+        }
+      while (!err && !(ti.class == CLASS_CONTEXT && ti.tag == 3));
+      if (gpg_err_code (err) == GPG_ERR_EOF)
+        return gpg_error (GPG_ERR_NO_VALUE);
+      if (!err)
+        err = view_nth (&buf, &size, 0, &ti);
+      goto leave;
+    }
+
+  buf = tbs;
+  size = tbslen;
+  err = view_nth (&buf, &size, idx, &ti);
+  if (!err && what == KSBA_CERT_VIEW_NOTBEFORE)
+    err = view_nth (&buf, &size, 0, &ti);
+  else if (!err && what == KSBA_CERT_VIEW_NOTAFTER)
+    err = view_nth (&buf, &size, 1, &ti);
+
+ leave:
+  if (gpg_err_code (err) == GPG_ERR_EOF)
+    err = gpg_error (GPG_ERR_INV_CERT_OBJ);
+  if (!err && ti.class != CLASS_UNIVERSAL)
+    err = gpg_error (GPG_ERR_INV_CERT_OBJ);
+  if (err)
+    return err;
+  *r_der = buf - ti.nhdr;
+  *r_derlen = ti.nhdr + ti.length;
+  if (r_tag)
+    *r_tag = ti.tag;
+  return 0;
+}
+
+
+
+/* Read all extensions starting at the node START into the cache.
+   The caller must hold CACHE_LOCK.  */
+static gpg_error_t
+read_extensions (ksba_cert_t cert, AsnNode start)
+{
+  AsnNode n;
+  int count, kind;
+  int last[CERT_EXTN_LAST];
+  oid_id_t id;
+
+  assert (!cert->cache.extns_valid);
+  assert (!cert->cache.extns);
+
+  for (kind=0; kind < CERT_EXTN_LAST; kind++)
+    cert->cache.first_extn[kind] = last[kind] = -1;
+  for (count=0, n=start; n; n = n->right)
+    count++;
+  if (!count)
+    {
+      cert->cache.n_extns = 0;
+      atomic_store_rel (&cert->cache.extns_valid, 1);
+      return 0; /* no extensions at all */
+    }
+  cert->cache.extns = xtrycalloc (count, sizeof *cert->cache.extns);
+  if (!cert->cache.extns)
+    return gpg_error (GPG_ERR_ENOMEM);
+  cert->cache.n_extns = count;
 
-  return algo;
-}
+  {
+    for (count=0; start; start = start->right, count++)
+      {
+        n = start->down;
+        if (!n || n->type != TYPE_OBJECT_ID)
+          goto no_value;
 
+        if (n->off == -1)
+          goto no_value;
 
+        /* Classify the extension by its DER encoded OID.  Known OIDs
+           use the string from the registry.  */
+        id = _ksba_oid_lookup (cert->image + n->off + n->nhdr, n->len);
+        cert->cache.extns[count].oid = _ksba_oid_id_to_str (id);
+        if (!cert->cache.extns[count].oid)
+          {
+            cert->cache.extns[count].oidbuf
+              = _ksba_oid_node_to_str (cert->image, n);
+            if (!cert->cache.extns[count].oidbuf)
+              goto no_value;
+            cert->cache.extns[count].oid = cert->cache.extns[count].oidbuf;
+          }
 
+        cert->cache.extns[count].next = -1;
+        kind = extn_kind_from_oid (id);
+        if (kind < CERT_EXTN_LAST)
+          {
+            if (last[kind] == -1)
+              cert->cache.first_extn[kind] = count;
+            else
+              cert->cache.extns[last[kind]].next = count;
+            last[kind] = count;
+          }
 
-/**
- * ksba_cert_get_serial:
- * @cert: certificate object
- *
- * This function returnes the serial number of the certificate.  The
- * serial number is an integer returned as an canonical encoded
- * S-expression with just one element.
- *
- * Return value: An allocated S-Exp or NULL for no value.
- **/
-ksba_sexp_t
-ksba_cert_get_serial (ksba_cert_t cert)
-{
-  AsnNode n;
-  char *p;
-  char numbuf[22];
-  int numbuflen;
+        n = n->right;
+        if (n && n->type == TYPE_BOOLEAN)
+          {
+            if (n->off != -1 && n->len && cert->image[n->off + n->nhdr])
+              cert->cache.extns[count].crit = 1;
+            n = n->right;
+          }
 
-  if (!cert || !cert->initialized)
-    return NULL;
+        if (!n || n->type != TYPE_OCTET_STRING || n->off == -1)
+          goto no_value;
 
-  n = _ksba_asn_find_node (cert->root,
-                           "Certificate.tbsCertificate.serialNumber");
-  if (!n)
-    return NULL; /* oops - should be there */
+        cert->cache.extns[count].off = n->off + n->nhdr;
+        cert->cache.extns[count].len = n->len;
+      }
 
-  if (n->off == -1)
-    {
-/*        fputs ("get_serial problem at node:\n", stderr); */
-/*        _ksba_asn_node_dump_all (n, stderr); */
-      return NULL;
-    }
+    assert (count == cert->cache.n_extns);
+    atomic_store_rel (&cert->cache.extns_valid, 1);
+    return 0;
 
-  sprintf (numbuf,"(%u:", (unsigned int)n->len);
-  numbuflen = strlen (numbuf);
-  p = xtrymalloc (numbuflen + n->len + 2);
-  if (!p)
-    return NULL;
-  strcpy (p, numbuf);
-  memcpy (p+numbuflen, cert->image + n->off + n->nhdr, n->len);
-  p[numbuflen + n->len] = ')';
-  p[numbuflen + n->len + 1] = 0;
-  return p;
+  no_value:
+    for (count=0; count < cert->cache.n_extns; count++)
+      xfree (cert->cache.extns[count].oidbuf);
+    xfree (cert->cache.extns);
+    cert->cache.extns = NULL;
+    for (kind=0; kind < CERT_EXTN_LAST; kind++)
+      cert->cache.first_extn[kind] = -1;
+    return gpg_error (GPG_ERR_NO_VALUE);
+  }
 }
 
 
-/* Return a pointer to the DER encoding of the serial number in CERT in
-   PTR and the length of that field in LENGTH.  */
-gpg_error_t
-_ksba_cert_get_serial_ptr (ksba_cert_t cert,
-                           unsigned char const **ptr, size_t *length)
+/* Make sure that the extension cache of CERT is filled.  */
+static gpg_error_t
+get_extensions (ksba_cert_t cert)
 {
-  asn_node_t n;
+  gpg_error_t err;
 
-  if (!cert || !cert->initialized || !ptr || !length)
+  if (!cert)
     return gpg_error (GPG_ERR_INV_VALUE);
-  n = _ksba_asn_find_node (cert->root,
-                           "Certificate.tbsCertificate.serialNumber");
-  if (!n || n->off == -1)
-    return gpg_error (GPG_ERR_NO_VALUE);
+  if (!cert->initialized)
+    return gpg_error (GPG_ERR_NO_DATA);
 
-  *ptr = cert->image + n->off;
-  *length = n->nhdr + n->len;
+  if (!atomic_load_acq (&cert->cache.extns_valid))
+    {
+      AsnNode start = _ksba_cert_find_node (cert, CERT_NODE_EXTNS);
+      ksba_alloc_ctx_t prevctx;
+
+      prevctx = _ksba_alloc_ctx_switch (cert->alloc_ctx);
+      gpgrt_lock_lock (&cache_lock);
+      err = cert->cache.extns_valid? 0 : read_extensions (cert, start);
+      gpgrt_lock_unlock (&cache_lock);
+      _ksba_alloc_ctx_restore (prevctx);
+      if (err)
+        return err;
+      assert (cert->cache.extns_valid);
+    }
   return 0;
 }
 
 
-
-/* Return a pointer to the DER encoding of the issuer's DN in CERT in
-   PTR and the length of that object in LENGTH.  */
-gpg_error_t
-_ksba_cert_get_issuer_dn_ptr (ksba_cert_t cert,
-                               unsigned char const **ptr, size_t *length)
+/* Store the index of the first extension of KIND in CERT at R_IDX or
+   -1 if there is none.  The other extensions of that kind are linked
+   by their NEXT field.  */
+static gpg_error_t
+find_extension (ksba_cert_t cert, enum cert_extn_kinds kind, int *r_idx)
 {
-  asn_node_t n;
-
-  if (!cert || !cert->initialized || !ptr || !length)
-    return gpg_error (GPG_ERR_INV_VALUE);
+  gpg_error_t err;
 
-  n = _ksba_asn_find_node (cert->root, "Certificate.tbsCertificate.issuer");
-  if (!n || !n->down)
-    return gpg_error (GPG_ERR_NO_VALUE); /* oops - should be there */
-  n = n->down; /* dereference the choice node */
-  if (n->off == -1)
-    return gpg_error (GPG_ERR_NO_VALUE);
-  *ptr = cert->image + n->off;
-  *length = n->nhdr + n->len;
+  *r_idx = -1;
+  err = get_extensions (cert);
+  if (err)
+    return err;
+  *r_idx = cert->cache.first_extn[kind];
   return 0;
 }
 
 
-
-/* Return a pointer to the DER encoding of the subject's DN in CERT in
-   PTR and the length of that object in LENGTH.  */
-gpg_error_t
-_ksba_cert_get_subject_dn_ptr (ksba_cert_t cert,
-                               unsigned char const **ptr, size_t *length)
+/* Return information about the only extension of KIND in CERT.
+   Returns GPG_ERR_EOF if there is no such extension and
+   GPG_ERR_DUP_VALUE if there are several.  */
+static gpg_error_t
+get_unique_extension (ksba_cert_t cert, enum cert_extn_kinds kind,
+                      int *r_crit, size_t *r_deroff, size_t *r_derlen)
 {
-  asn_node_t n;
-
-  if (!cert || !cert->initialized || !ptr || !length)
-    return gpg_error (GPG_ERR_INV_VALUE);
+  gpg_error_t err;
+  int idx;
 
-  n = _ksba_asn_find_node (cert->root, "Certificate.tbsCertificate.subject");
-  if (!n || !n->down)
-    return gpg_error (GPG_ERR_NO_VALUE); /* oops - should be there */
-  n = n->down; /* dereference the choice node */
-  if (n->off == -1)
-    return gpg_error (GPG_ERR_NO_VALUE);
-  *ptr = cert->image + n->off;
-  *length = n->nhdr + n->len;
+  err = find_extension (cert, kind, &idx);
+  if (err)
+    return err;
+  if (idx == -1)
+    return gpg_error (GPG_ERR_EOF);
+  if (cert->cache.extns[idx].next != -1)
+    return gpg_error (GPG_ERR_DUP_VALUE);
+  if (r_crit)
+    *r_crit = cert->cache.extns[idx].crit;
+  *r_deroff = cert->cache.extns[idx].off;
+  *r_derlen = cert->cache.extns[idx].len;
   return 0;
 }
 
 
-
 /* Worker function for get_isssuer and get_subject. */
 static gpg_error_t
 get_name (ksba_cert_t cert, int idx, int use_subject, char **result)
@@ -608,7 +1610,6 @@ get_name (ksba_cert_t cert, int idx, int use_subject, char **result)
   gpg_error_t err;
   char *p;
   int i;
-  const char *oid;
   struct tag_info ti;
   const unsigned char *der;
   size_t off, derlen, seqlen;
@@ -623,10 +1624,8 @@ get_name (ksba_cert_t cert, int idx, int use_subject, char **result)
     { /* Get the required DN */
       AsnNode n;
 
-      n = _ksba_asn_find_node (cert->root,
-                               (use_subject?
-                                "Certificate.tbsCertificate.subject":
-                                "Certificate.tbsCertificate.issuer") );
+      n = _ksba_cert_find_node (cert, (use_subject? CERT_NODE_SUBJECT
+                                       : CERT_NODE_ISSUER));
       if (!n || !n->down)
         return gpg_error (GPG_ERR_NO_VALUE); /* oops - should be there */
       n = n->down; /* dereference the choice node */
@@ -641,15 +1640,14 @@ get_name (ksba_cert_t cert, int idx, int use_subject, char **result)
     }
 
   /* get {issuer,subject}AltName */
-  for (i=0; !(err=ksba_cert_get_extension (cert, i, &oid, NULL,
-                                           &off, &derlen)); i++)
-    {
-      if (!strcmp (oid, (use_subject?
-                         oidstr_subjectAltName:oidstr_issuerAltName)))
-        break;
-    }
+  err = find_extension (cert, (use_subject? CERT_EXTN_SUBJECT_ALT_NAME
+                                : CERT_EXTN_ISSUER_ALT_NAME), &i);
+  if (!err && i == -1)
+    err = gpg_error (GPG_ERR_EOF);
   if (err)
       return err; /* no alt name or error*/
+  off = cert->cache.extns[i].off;
+  derlen = cert->cache.extns[i].len;
 
   der = cert->image + off;
 
@@ -818,9 +1816,8 @@ ksba_cert_get_validity (ksba_cert_t cert, int what, ksba_isotime_t timebuf)
   if (!cert->initialized)
     return gpg_error (GPG_ERR_NO_DATA);
 
-  n = _ksba_asn_find_node (cert->root,
-        what == 0? "Certificate.tbsCertificate.validity.notBefore"
-                 : "Certificate.tbsCertificate.validity.notAfter");
+  n = _ksba_cert_find_node (cert, (what == 0? CERT_NODE_NOTBEFORE
+                                   : CERT_NODE_NOTAFTER));
   if (!n)
     return 0; /* no value available */
 
@@ -842,6 +1839,70 @@ ksba_cert_get_validity (ksba_cert_t cert, int what, ksba_isotime_t timebuf)
 }
 
 
+/**
+ * ksba_cert_get_validity_epoch:
+ * @cert: An initialized certificate object
+ * @what: 0 for notBefore, 1 for notAfter
+ * @r_epoch: Receives the time
+ *
+ * Return the validity time @what of @cert as seconds since the Epoch.
+ * The times are converted only once and then cached; a lazily read
+ * certificate is not decoded.  Thus checking the validity of many
+ * certificates amounts to comparing integers.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_cert_get_validity_epoch (ksba_cert_t cert, int what,
+                              ksba_epoch_t *r_epoch)
+{
+  gpg_error_t err;
+  const unsigned char *der;
+  size_t derlen, nhdr;
+  ksba_epoch_t validity[2];
+  int i, tag;
+
+  if (!cert || what < 0 || what > 1 || !r_epoch)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_epoch = 0;
+  if (!cert->initialized)
+    return gpg_error (GPG_ERR_NO_DATA);
+
+  if (!atomic_load_acq (&cert->cache.validity_valid))
+    {
+      for (i=0; i < 2; i++)
+        {
+          err = _ksba_cert_get_view (cert, (i? KSBA_CERT_VIEW_NOTAFTER
+                                            : KSBA_CERT_VIEW_NOTBEFORE),
+                                     &der, &derlen, &tag);
+          if (err)
+            return err;
+          if (tag != TYPE_UTC_TIME && tag != TYPE_GENERALIZED_TIME)
+            return gpg_error (GPG_ERR_INV_TIME);
+          /* The tag is a single octet; skip the length.  */
+          nhdr = (der[1] & 0x80)? 2 + (der[1] & 0x7f) : 2;
+          if (nhdr > derlen)
+            return gpg_error (GPG_ERR_INV_CERT_OBJ);
+          err = _ksba_asntime_to_epoch (der + nhdr, derlen - nhdr,
+                                        tag == TYPE_UTC_TIME, validity + i);
+          if (err)
+            return err;
+        }
+      gpgrt_lock_lock (&cache_lock);
+      if (!cert->cache.validity_valid)
+        {
+          cert->cache.validity[0] = validity[0];
+          cert->cache.validity[1] = validity[1];
+          atomic_store_rel (&cert->cache.validity_valid, 1);
+        }
+      gpgrt_lock_unlock (&cache_lock);
+    }
+
+  *r_epoch = cert->cache.validity[what];
+  return 0;
+}
+
+
 
 ksba_sexp_t
 ksba_cert_get_public_key (ksba_cert_t cert)
@@ -855,9 +1916,7 @@ ksba_cert_get_public_key (ksba_cert_t cert)
   if (!cert->initialized)
     return NULL;
 
-  n = _ksba_asn_find_node (cert->root,
-                           "Certificate"
-                           ".tbsCertificate.subjectPublicKeyInfo");
+  n = _ksba_cert_find_node (cert, CERT_NODE_PUBKEY);
   if (!n)
     {
       cert->last_error = gpg_error (GPG_ERR_NO_VALUE);
@@ -887,8 +1946,7 @@ _ksba_cert_get_public_key_ptr (ksba_cert_t cert,
   if (!cert || !cert->initialized || !ptr || !length)
     return gpg_error (GPG_ERR_INV_VALUE);
 
-  n = _ksba_asn_find_node (cert->root,
-                           "Certificate.tbsCertificate.subjectPublicKeyInfo");
+  n = _ksba_cert_find_node (cert, CERT_NODE_PUBKEY);
   if (!n || !n->down || !n->down->right)
     return gpg_error (GPG_ERR_NO_VALUE); /* oops - should be there */
   n = n->down->right;
@@ -921,8 +1979,7 @@ ksba_cert_get_sig_val (ksba_cert_t cert)
   if (!cert->initialized)
     return NULL;
 
-  n = _ksba_asn_find_node (cert->root,
-                           "Certificate.signatureAlgorithm");
+  n = _ksba_cert_find_node (cert, CERT_NODE_SIGALGO);
   if (!n)
     {
       cert->last_error = gpg_error (GPG_ERR_NO_VALUE);
@@ -951,68 +2008,49 @@ ksba_cert_get_sig_val (ksba_cert_t cert)
 }
 
 
-/* Read all extensions into the cache */
-static gpg_error_t
-read_extensions (ksba_cert_t cert)
+/* Store a description of the public key of CERT at DESC.  The
+   pointers in DESC are valid as long as CERT.  */
+gpg_error_t
+ksba_cert_get_public_key_desc (ksba_cert_t cert, ksba_keydesc_t desc)
 {
-  AsnNode start, n;
-  int count;
-
-  assert (!cert->cache.extns_valid);
-  assert (!cert->cache.extns);
-
-  start = _ksba_asn_find_node (cert->root,
-                               "Certificate.tbsCertificate.extensions..");
-  for (count=0, n=start; n; n = n->right)
-    count++;
-  if (!count)
-    {
-      cert->cache.n_extns = 0;
-      cert->cache.extns_valid = 1;
-      return 0; /* no extensions at all */
-    }
-  cert->cache.extns = xtrycalloc (count, sizeof *cert->cache.extns);
-  if (!cert->cache.extns)
-    return gpg_error (GPG_ERR_ENOMEM);
-  cert->cache.n_extns = count;
+  AsnNode n;
 
-  {
-    for (count=0; start; start = start->right, count++)
-      {
-        n = start->down;
-        if (!n || n->type != TYPE_OBJECT_ID)
-          goto no_value;
+  if (!cert || !desc)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!cert->initialized)
+    return gpg_error (GPG_ERR_NO_DATA);
 
-        cert->cache.extns[count].oid = _ksba_oid_node_to_str (cert->image, n);
-        if (!cert->cache.extns[count].oid)
-          goto no_value;
+  n = _ksba_cert_find_node (cert, CERT_NODE_PUBKEY);
+  if (!n || n->off == -1)
+    return gpg_error (GPG_ERR_NO_VALUE);
 
-        n = n->right;
-        if (n && n->type == TYPE_BOOLEAN)
-          {
-            if (n->off != -1 && n->len && cert->image[n->off + n->nhdr])
-              cert->cache.extns[count].crit = 1;
-            n = n->right;
-          }
+  return _ksba_keyinfo_to_keydesc (cert->image + n->off, n->nhdr + n->len,
+                                   desc);
+}
 
-        if (!n || n->type != TYPE_OCTET_STRING || n->off == -1)
-          goto no_value;
 
-        cert->cache.extns[count].off = n->off + n->nhdr;
-        cert->cache.extns[count].len = n->len;
-      }
+/* Store a description of the signature of CERT at DESC.  The pointers
+   in DESC are valid as long as CERT.  */
+gpg_error_t
+ksba_cert_get_sig_val_desc (ksba_cert_t cert, ksba_keydesc_t desc)
+{
+  AsnNode n, n2;
 
-    assert (count == cert->cache.n_extns);
-    cert->cache.extns_valid = 1;
-    return 0;
+  if (!cert || !desc)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!cert->initialized)
+    return gpg_error (GPG_ERR_NO_DATA);
 
-  no_value:
-    for (count=0; count < cert->cache.n_extns; count++)
-      xfree (cert->cache.extns[count].oid);
-    xfree (cert->cache.extns);
-    cert->cache.extns = NULL;
+  n = _ksba_cert_find_node (cert, CERT_NODE_SIGALGO);
+  if (!n || n->off == -1)
     return gpg_error (GPG_ERR_NO_VALUE);
-  }
+
+  n2 = n->right;
+  return _ksba_sigval_to_keydesc (cert->image + n->off,
+                                  n->nhdr + n->len
+                                  + ((!n2||n2->off == -1)? 0
+                                     : (n2->nhdr+n2->len)),
+                                  desc);
 }
 
 
@@ -1024,18 +2062,9 @@ ksba_cert_get_extension (ksba_cert_t cert, int idx,
 {
   gpg_error_t err;
 
-  if (!cert)
-    return gpg_error (GPG_ERR_INV_VALUE);
-  if (!cert->initialized)
-    return gpg_error (GPG_ERR_NO_DATA);
-
-  if (!cert->cache.extns_valid)
-    {
-      err = read_extensions (cert);
-      if (err)
-        return err;
-      assert (cert->cache.extns_valid);
-    }
+  err = get_extensions (cert);
+  if (err)
+    return err;
 
   if (idx == cert->cache.n_extns)
     return gpg_error (GPG_ERR_EOF); /* No more extensions. */
@@ -1064,8 +2093,7 @@ gpg_error_t
 ksba_cert_is_ca (ksba_cert_t cert, int *r_ca, int *r_pathlen)
 {
   gpg_error_t err;
-  const char *oid;
-  int idx, crit;
+  int crit;
   size_t off, derlen, seqlen;
   const unsigned char *der;
   struct tag_info ti;
@@ -1076,25 +2104,13 @@ ksba_cert_is_ca (ksba_cert_t cert, int *r_ca, int *r_pathlen)
     *r_ca = 0;
   if (r_pathlen)
     *r_pathlen = -1;
-  for (idx=0; !(err=ksba_cert_get_extension (cert, idx, &oid, &crit,
-                                             &off, &derlen)); idx++)
-    {
-      if (!strcmp (oid, oidstr_basicConstraints))
-        break;
-    }
+  err = get_unique_extension (cert, CERT_EXTN_BASIC_CONSTRAINTS,
+                              &crit, &off, &derlen);
   if (gpg_err_code (err) == GPG_ERR_EOF)
       return 0; /* no such constraint */
   if (err)
     return err;
 
-  /* check that there is only one */
-  for (idx++; !(err=ksba_cert_get_extension (cert, idx, &oid, NULL,
-                                             NULL, NULL)); idx++)
-    {
-      if (!strcmp (oid, oidstr_basicConstraints))
-        return gpg_error (GPG_ERR_DUP_VALUE);
-    }
-
   der = cert->image + off;
 
   err = _ksba_ber_parse_tl (&der, &derlen, &ti);
@@ -1171,8 +2187,6 @@ gpg_error_t
 ksba_cert_get_key_usage (ksba_cert_t cert, unsigned int *r_flags)
 {
   gpg_error_t err;
-  const char *oid;
-  int idx, crit;
   size_t off, derlen;
   const unsigned char *der;
   struct tag_info ti;
@@ -1182,26 +2196,13 @@ ksba_cert_get_key_usage (ksba_cert_t cert, unsigned int *r_flags)
   if (!r_flags)
     return gpg_error (GPG_ERR_INV_VALUE);
   *r_flags = 0;
-  for (idx=0; !(err=ksba_cert_get_extension (cert, idx, &oid, &crit,
-                                             &off, &derlen)); idx++)
-    {
-      if (!strcmp (oid, oidstr_keyUsage))
-        break;
-    }
+  err = get_unique_extension (cert, CERT_EXTN_KEY_USAGE, NULL, &off, &derlen);
   if (gpg_err_code (err) == GPG_ERR_EOF
       || gpg_err_code (err) == GPG_ERR_NO_VALUE)
       return gpg_error (GPG_ERR_NO_DATA); /* no key usage */
   if (err)
     return err;
 
-  /* check that there is only one */
-  for (idx++; !(err=ksba_cert_get_extension (cert, idx, &oid, NULL,
-                                             NULL, NULL)); idx++)
-    {
-      if (!strcmp (oid, oidstr_keyUsage))
-        return gpg_error (GPG_ERR_DUP_VALUE);
-    }
-
   der = cert->image + off;
 
   err = _ksba_ber_parse_tl (&der, &derlen, &ti);
@@ -1308,7 +2309,6 @@ gpg_error_t
 ksba_cert_get_cert_policies (ksba_cert_t cert, char **r_policies)
 {
   gpg_error_t err;
-  const char *oid;
   int idx, crit;
   size_t off, derlen, seqlen;
   const unsigned char *der;
@@ -1318,14 +2318,40 @@ ksba_cert_get_cert_policies (ksba_cert_t cert, char **r_policies)
     return gpg_error (GPG_ERR_INV_VALUE);
   *r_policies = NULL;
 
-  for (idx=0; !(err=ksba_cert_get_extension (cert, idx, &oid, &crit,
-                                             &off, &derlen)); idx++)
+  err = find_extension (cert, CERT_EXTN_CERT_POLICIES, &idx);
+  for (; !err && idx != -1; idx = cert->cache.extns[idx].next)
     {
-      if (!strcmp (oid, oidstr_certificatePolicies))
+      char *suboid;
+
+      crit = cert->cache.extns[idx].crit;
+      off = cert->cache.extns[idx].off;
+      derlen = cert->cache.extns[idx].len;
+
+      der = cert->image + off;
+
+      err = _ksba_ber_parse_tl (&der, &derlen, &ti);
+      if (err)
+        goto leave;
+      if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_SEQUENCE
+             && ti.is_constructed) )
+        {
+          err = gpg_error (GPG_ERR_INV_CERT_OBJ);
+          goto leave;
+        }
+      if (ti.ndef)
+        {
+          err = gpg_error (GPG_ERR_NOT_DER_ENCODED);
+          goto leave;
+        }
+      seqlen = ti.length;
+      if (seqlen > derlen)
+        {
+          err = gpg_error (GPG_ERR_BAD_BER);
+          goto leave;
+        }
+      while (seqlen)
         {
-          char *suboid;
-
-          der = cert->image + off;
+          size_t seqseqlen;
 
           err = _ksba_ber_parse_tl (&der, &derlen, &ti);
           if (err)
@@ -1341,90 +2367,67 @@ ksba_cert_get_cert_policies (ksba_cert_t cert, char **r_policies)
               err = gpg_error (GPG_ERR_NOT_DER_ENCODED);
               goto leave;
             }
-          seqlen = ti.length;
-          if (seqlen > derlen)
+          if (ti.length > derlen)
             {
               err = gpg_error (GPG_ERR_BAD_BER);
               goto leave;
             }
-          while (seqlen)
+          if (!ti.length)
+            {
+              /* We do not accept an empty inner SEQ */
+              err = gpg_error (GPG_ERR_INV_CERT_OBJ);
+              goto leave;
+            }
+          if (ti.nhdr+ti.length > seqlen)
             {
-              size_t seqseqlen;
+              err = gpg_error (GPG_ERR_BAD_BER);
+              goto leave;
+            }
+          seqlen -= ti.nhdr + ti.length;
+          seqseqlen = ti.length;
 
-              err = _ksba_ber_parse_tl (&der, &derlen, &ti);
-              if (err)
-                goto leave;
-              if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_SEQUENCE
-                     && ti.is_constructed) )
-                {
-                  err = gpg_error (GPG_ERR_INV_CERT_OBJ);
-                  goto leave;
-                }
-              if (ti.ndef)
-                {
-                  err = gpg_error (GPG_ERR_NOT_DER_ENCODED);
-                  goto leave;
-                }
-              if (ti.length > derlen)
-                {
-                  err = gpg_error (GPG_ERR_BAD_BER);
-                  goto leave;
-                }
-              if (!ti.length)
-                {
-                  /* We do not accept an empty inner SEQ */
-                  err = gpg_error (GPG_ERR_INV_CERT_OBJ);
-                  goto leave;
-                }
-              if (ti.nhdr+ti.length > seqlen)
-                {
-                  err = gpg_error (GPG_ERR_BAD_BER);
-                  goto leave;
-                }
-              seqlen -= ti.nhdr + ti.length;
-              seqseqlen = ti.length;
-
-              err = _ksba_ber_parse_tl (&der, &derlen, &ti);
-              if (err)
-                goto leave;
-              if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OBJECT_ID))
-                {
-                  err = gpg_error (GPG_ERR_INV_CERT_OBJ);
-                  goto leave;
-                }
-              if (ti.length > derlen)
-                {
-                  err = gpg_error (GPG_ERR_BAD_BER);
-                  goto leave;
-                }
-              if (ti.nhdr+ti.length > seqseqlen)
-                {
-                  err = gpg_error (GPG_ERR_BAD_BER);
-                  goto leave;
-                }
-              seqseqlen -= ti.nhdr;
-
-              suboid = ksba_oid_to_str (der, ti.length);
-              if (!suboid)
-                {
-                  err = gpg_error (GPG_ERR_ENOMEM);
-                  goto leave;
-                }
-              der       += ti.length;
-              derlen    -= ti.length;
-              seqseqlen -= ti.length;
-
-              err = append_cert_policy (r_policies, suboid, crit);
-              xfree (suboid);
-              if (err)
-                goto leave;
+          err = _ksba_ber_parse_tl (&der, &derlen, &ti);
+          if (err)
+            goto leave;
+          if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OBJECT_ID))
+            {
+              err = gpg_error (GPG_ERR_INV_CERT_OBJ);
+              goto leave;
+            }
+          if (ti.length > derlen)
+            {
+              err = gpg_error (GPG_ERR_BAD_BER);
+              goto leave;
+            }
+          if (ti.nhdr+ti.length > seqseqlen)
+            {
+              err = gpg_error (GPG_ERR_BAD_BER);
+              goto leave;
+            }
+          seqseqlen -= ti.nhdr;
 
-              /* skip the rest of the seq which is more or less optional */
-              der    += seqseqlen;
-              derlen -= seqseqlen;
+          suboid = ksba_oid_to_str (der, ti.length);
+          if (!suboid)
+            {
+              err = gpg_error (GPG_ERR_ENOMEM);
+              goto leave;
             }
+          der       += ti.length;
+          derlen    -= ti.length;
+          seqseqlen -= ti.length;
+
+          err = append_cert_policy (r_policies, suboid, crit);
+          xfree (suboid);
+          if (err)
+            goto leave;
+
+          /* skip the rest of the seq which is more or less optional */
+          der    += seqseqlen;
+          derlen -= seqseqlen;
         }
     }
+  if (!err)
+    err = gpg_error (GPG_ERR_EOF);
 
   if (gpg_err_code (err) == GPG_ERR_EOF)
     err = 0;
@@ -1451,7 +2454,6 @@ gpg_error_t
 ksba_cert_get_ext_key_usages (ksba_cert_t cert, char **result)
 {
   gpg_error_t err;
-  const char *oid;
   int idx, crit;
   size_t off, derlen;
   const unsigned char *der;
@@ -1461,20 +2463,42 @@ ksba_cert_get_ext_key_usages (ksba_cert_t cert, char **result)
     return gpg_error (GPG_ERR_INV_VALUE);
   *result = NULL;
 
-  for (idx=0; !(err=ksba_cert_get_extension (cert, idx, &oid, &crit,
-                                             &off, &derlen)); idx++)
+  err = find_extension (cert, CERT_EXTN_EXT_KEY_USAGE, &idx);
+  for (; !err && idx != -1; idx = cert->cache.extns[idx].next)
     {
-      if (!strcmp (oid, oidstr_extKeyUsage))
-        {
-          char *suboid;
+      char *suboid;
+
+      crit = cert->cache.extns[idx].crit;
+      off = cert->cache.extns[idx].off;
+      derlen = cert->cache.extns[idx].len;
 
-          der = cert->image + off;
+      der = cert->image + off;
 
+      err = _ksba_ber_parse_tl (&der, &derlen, &ti);
+      if (err)
+        goto leave;
+      if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_SEQUENCE
+             && ti.is_constructed) )
+        {
+          err = gpg_error (GPG_ERR_INV_CERT_OBJ);
+          goto leave;
+        }
+      if (ti.ndef)
+        {
+          err = gpg_error (GPG_ERR_NOT_DER_ENCODED);
+          goto leave;
+        }
+      if (ti.length > derlen)
+        {
+          err = gpg_error (GPG_ERR_BAD_BER);
+          goto leave;
+        }
+      while (derlen)
+        {
           err = _ksba_ber_parse_tl (&der, &derlen, &ti);
           if (err)
             goto leave;
-          if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_SEQUENCE
-                 && ti.is_constructed) )
+          if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OBJECT_ID))
             {
               err = gpg_error (GPG_ERR_INV_CERT_OBJ);
               goto leave;
@@ -1489,43 +2513,24 @@ ksba_cert_get_ext_key_usages (ksba_cert_t cert, char **result)
               err = gpg_error (GPG_ERR_BAD_BER);
               goto leave;
             }
-          while (derlen)
+
+          suboid = ksba_oid_to_str (der, ti.length);
+          if (!suboid)
             {
-              err = _ksba_ber_parse_tl (&der, &derlen, &ti);
-              if (err)
-                goto leave;
-              if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OBJECT_ID))
-                {
-                  err = gpg_error (GPG_ERR_INV_CERT_OBJ);
-                  goto leave;
-                }
-              if (ti.ndef)
-                {
-                  err = gpg_error (GPG_ERR_NOT_DER_ENCODED);
-                  goto leave;
-                }
-              if (ti.length > derlen)
-                {
-                  err = gpg_error (GPG_ERR_BAD_BER);
-                  goto leave;
-                }
-
-              suboid = ksba_oid_to_str (der, ti.length);
-              if (!suboid)
-                {
-                  err = gpg_error (GPG_ERR_ENOMEM);
-                  goto leave;
-                }
-              der       += ti.length;
-              derlen    -= ti.length;
-
-              err = append_cert_policy (result, suboid, crit);
-              xfree (suboid);
-              if (err)
-                goto leave;
+              err = gpg_error (GPG_ERR_ENOMEM);
+              goto leave;
             }
+          der       += ti.length;
+          derlen    -= ti.length;
+
+          err = append_cert_policy (result, suboid, crit);
+          xfree (suboid);
+          if (err)
+            goto leave;
         }
     }
+  if (!err)
+    err = gpg_error (GPG_ERR_EOF);
 
   if (gpg_err_code (err) == GPG_ERR_EOF)
     err = 0;
@@ -1712,9 +2717,8 @@ ksba_cert_get_crl_dist_point (ksba_cert_t cert, int idx,
                               ksba_crl_reason_t *r_reason)
 {
   gpg_error_t err;
-  const char *oid;
   size_t off, derlen;
-  int myidx, crit;
+  int myidx;
 
   if (r_distpoint)
     *r_distpoint = NULL;
@@ -1723,79 +2727,81 @@ ksba_cert_get_crl_dist_point (ksba_cert_t cert, int idx,
   if (r_reason)
     *r_reason = 0;
 
-  for (myidx=0; !(err=ksba_cert_get_extension (cert, myidx, &oid, &crit,
-                                               &off, &derlen)); myidx++)
+  err = find_extension (cert, CERT_EXTN_CRL_DIST_POINTS, &myidx);
+  for (; !err && myidx != -1; myidx = cert->cache.extns[myidx].next)
     {
-      if (!strcmp (oid, oidstr_crlDistributionPoints))
-        {
-          const unsigned char *der;
-          struct tag_info ti;
-           size_t seqlen;
+      const unsigned char *der;
+      struct tag_info ti;
+      size_t seqlen;
+
+      off = cert->cache.extns[myidx].off;
+      derlen = cert->cache.extns[myidx].len;
+
+      der = cert->image + off;
+
+      err = _ksba_ber_parse_tl (&der, &derlen, &ti);
+      if (err)
+        return err;
+      if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_SEQUENCE
+             && ti.is_constructed) )
+        return gpg_error (GPG_ERR_INV_CERT_OBJ);
+      if (ti.ndef)
+        return gpg_error (GPG_ERR_NOT_DER_ENCODED);
+      seqlen = ti.length;
+      if (seqlen > derlen)
+        return gpg_error (GPG_ERR_BAD_BER);
 
-          der = cert->image + off;
+      /* Note: an empty sequence is actually not allowed but we
+         better don't care */
 
+      while (seqlen)
+        {
           err = _ksba_ber_parse_tl (&der, &derlen, &ti);
           if (err)
             return err;
           if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_SEQUENCE
                  && ti.is_constructed) )
             return gpg_error (GPG_ERR_INV_CERT_OBJ);
-          if (ti.ndef)
-            return gpg_error (GPG_ERR_NOT_DER_ENCODED);
-          seqlen = ti.length;
-          if (seqlen > derlen)
+          if (derlen < ti.length)
+            return gpg_error (GPG_ERR_BAD_BER);
+          if (seqlen < ti.nhdr)
+            return gpg_error (GPG_ERR_BAD_BER);
+          seqlen -= ti.nhdr;
+          if (seqlen < ti.length)
             return gpg_error (GPG_ERR_BAD_BER);
 
-          /* Note: an empty sequence is actually not allowed but we
-             better don't care */
+          if (idx)
+            { /* skip because we are not yet at the desired index */
+              der    += ti.length;
+              derlen -= ti.length;
+              seqlen -= ti.length;
+              idx--;
+              continue;
+            }
 
-          while (seqlen)
-            {
-              err = _ksba_ber_parse_tl (&der, &derlen, &ti);
-              if (err)
-                return err;
-              if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_SEQUENCE
-                     && ti.is_constructed) )
-                return gpg_error (GPG_ERR_INV_CERT_OBJ);
-              if (derlen < ti.length)
-                return gpg_error (GPG_ERR_BAD_BER);
-              if (seqlen < ti.nhdr)
-                return gpg_error (GPG_ERR_BAD_BER);
-              seqlen -= ti.nhdr;
-              if (seqlen < ti.length)
-                return gpg_error (GPG_ERR_BAD_BER);
-
-              if (idx)
-                { /* skip because we are not yet at the desired index */
-                  der    += ti.length;
-                  derlen -= ti.length;
-                  seqlen -= ti.length;
-                  idx--;
-                  continue;
-                }
-
-              if (!ti.length)
-                return 0;
-
-              err = parse_distribution_point (der, ti.length,
-                                              r_distpoint, r_issuer, r_reason);
-              if (err && r_distpoint)
-                {
-                  ksba_name_release (*r_distpoint);
-                  *r_distpoint = NULL;
-                }
-              if (err && r_issuer)
-                {
-                  ksba_name_release (*r_issuer);
-                  *r_issuer = NULL;
-                }
-              if (err && r_reason)
-                *r_reason = 0;
+          if (!ti.length)
+            return 0;
 
-              return err;
+          err = parse_distribution_point (der, ti.length,
+                                          r_distpoint, r_issuer, r_reason);
+          if (err && r_distpoint)
+            {
+              ksba_name_release (*r_distpoint);
+              *r_distpoint = NULL;
+            }
+          if (err && r_issuer)
+            {
+              ksba_name_release (*r_issuer);
+              *r_issuer = NULL;
             }
+          if (err && r_reason)
+            *r_reason = 0;
+
+          return err;
         }
     }
+  if (!err)
+    err = gpg_error (GPG_ERR_EOF);
 
   return err;
 }
@@ -1812,12 +2818,10 @@ ksba_cert_get_auth_key_id (ksba_cert_t cert,
                            ksba_sexp_t *r_serial)
 {
   gpg_error_t err;
-  const char *oid;
   size_t off, derlen;
   const unsigned char *der;
   const unsigned char *keyid_der = NULL;
   size_t keyid_derlen = 0;
-  int idx, crit;
   struct tag_info ti;
   char numbuf[30];
   size_t numbuflen;
@@ -1829,26 +2833,14 @@ ksba_cert_get_auth_key_id (ksba_cert_t cert,
   *r_name = NULL;
   *r_serial = NULL;
 
-  for (idx=0; !(err=ksba_cert_get_extension (cert, idx, &oid, &crit,
-                                             &off, &derlen)); idx++)
-    {
-      if (!strcmp (oid, oidstr_authorityKeyIdentifier))
-        break;
-    }
+  err = get_unique_extension (cert, CERT_EXTN_AUTHORITY_KEY_ID,
+                              NULL, &off, &derlen);
   if (gpg_err_code (err) == GPG_ERR_EOF
       || gpg_err_code (err) == GPG_ERR_NO_VALUE)
     return gpg_error (GPG_ERR_NO_DATA); /* not available */
   if (err)
     return err;
 
-  /* check that there is only one */
-  for (idx++; !(err=ksba_cert_get_extension (cert, idx, &oid, NULL,
-                                             NULL, NULL)); idx++)
-    {
-      if (!strcmp (oid, oidstr_authorityKeyIdentifier))
-        return gpg_error (GPG_ERR_DUP_VALUE);
-    }
-
   der = cert->image + off;
 
   err = _ksba_ber_parse_tl (&der, &derlen, &ti);
@@ -1955,14 +2947,13 @@ ksba_cert_get_auth_key_id (ksba_cert_t cert,
    R_CRIT is not NULL, the critical extension flag will be stored at
    that address. */
 static gpg_error_t
-get_simple_octet_string_ext (ksba_cert_t cert, const char *oid,
+get_simple_octet_string_ext (ksba_cert_t cert, enum cert_extn_kinds kind,
                              int *r_crit, ksba_sexp_t *r_data)
 {
   gpg_error_t err;
-  const char *tmpoid;
   size_t off, derlen;
   const unsigned char *der;
-  int idx, crit;
+  int crit;
   struct tag_info ti;
   char numbuf[30];
   size_t numbuflen;
@@ -1971,12 +2962,7 @@ get_simple_octet_string_ext (ksba_cert_t cert, const char *oid,
     return gpg_error (GPG_ERR_INV_VALUE);
   *r_data = NULL;
 
-  for (idx=0; !(err=ksba_cert_get_extension (cert, idx, &tmpoid, &crit,
-                                             &off, &derlen)); idx++)
-    {
-      if (!strcmp (tmpoid, oid))
-        break;
-    }
+  err = get_unique_extension (cert, kind, &crit, &off, &derlen);
   if (err)
     {
       if (gpg_err_code (err) == GPG_ERR_EOF
@@ -1985,14 +2971,6 @@ get_simple_octet_string_ext (ksba_cert_t cert, const char *oid,
       return err;
     }
 
-  /* Check that there is only one */
-  for (idx++; !(err=ksba_cert_get_extension (cert, idx, &tmpoid, NULL,
-                                             NULL, NULL)); idx++)
-    {
-      if (!strcmp (tmpoid, oid))
-        return gpg_error (GPG_ERR_DUP_VALUE);
-    }
-
   der = cert->image + off;
 
   err = _ksba_ber_parse_tl (&der, &derlen, &ti);
@@ -2031,11 +3009,141 @@ get_simple_octet_string_ext (ksba_cert_t cert, const char *oid,
 gpg_error_t
 ksba_cert_get_subj_key_id (ksba_cert_t cert, int *r_crit, ksba_sexp_t *r_keyid)
 {
-  return get_simple_octet_string_ext (cert, oidstr_subjectKeyIdentifier,
+  return get_simple_octet_string_ext (cert, CERT_EXTN_SUBJECT_KEY_ID,
                                       r_crit, r_keyid);
 }
 
 
+/* Locate the key identifier in the subjectKeyIdentifier of CERT or,
+   if AUTHORITY is set, in the authorityKeyIdentifier.  The offset of
+   the identifier in the image is stored at R_OFF and its length at
+   R_LEN; R_LEN is set to 0 if the certificate has no such
+   identifier.  */
+static gpg_error_t
+locate_key_id (ksba_cert_t cert, int authority,
+               size_t *r_off, size_t *r_len)
+{
+  gpg_error_t err;
+  size_t derlen, extoff = 0, extlen = 0;
+  const unsigned char *der;
+  struct tag_info ti;
+
+  *r_off = *r_len = 0;
+  err = get_unique_extension (cert, (authority? CERT_EXTN_AUTHORITY_KEY_ID
+                                     : CERT_EXTN_SUBJECT_KEY_ID),
+                              NULL, &extoff, &extlen);
+  if (gpg_err_code (err) == GPG_ERR_NO_VALUE
+      || gpg_err_code (err) == GPG_ERR_EOF)
+    return 0;  /* Broken extensions or not available.  */
+  if (err)
+    return err;
+
+  der = cert->image + extoff;
+  derlen = extlen;
+  err = _ksba_ber_parse_tl (&der, &derlen, &ti);
+  if (err)
+    return err;
+  if (ti.ndef)
+    return gpg_error (GPG_ERR_NOT_DER_ENCODED);
+  if (ti.length > derlen)
+    return gpg_error (GPG_ERR_BAD_BER);
+
+  if (!authority)
+    {
+      if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING
+             && !ti.is_constructed) )
+        return gpg_error (GPG_ERR_INV_CERT_OBJ);
+      if (ti.length != derlen)
+        return gpg_error (GPG_ERR_INV_CERT_OBJ); /* Garbage follows. */
+    }
+  else
+    {
+      if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_SEQUENCE
+             && ti.is_constructed) )
+        return gpg_error (GPG_ERR_INV_CERT_OBJ);
+      if (!ti.length)
+        return 0;
+      err = _ksba_ber_parse_tl (&der, &derlen, &ti);
+      if (err)
+        return err;
+      if (ti.class != CLASS_CONTEXT || ti.tag)
+        return 0;  /* No keyIdentifier.  */
+      if (ti.ndef)
+        return gpg_error (GPG_ERR_NOT_DER_ENCODED);
+      if (ti.length > derlen)
+        return gpg_error (GPG_ERR_BAD_BER);
+    }
+
+  *r_off = der - cert->image;
+  *r_len = ti.length;
+  return 0;
+}
+
+
+/**
+ * ksba_cert_get_key_ids:
+ * @cert: An initialized certificate object
+ * @r_ski: NULL or receives the subjectKeyIdentifier
+ * @r_skilen: Receives the length of the subjectKeyIdentifier
+ * @r_aki: NULL or receives the keyIdentifier of the
+ *         authorityKeyIdentifier
+ * @r_akilen: Receives the length of that keyIdentifier
+ *
+ * Return pointers to the raw key identifiers of @cert.  If an
+ * identifier is not available, NULL and a length of 0 are returned
+ * for it.  Unlike ksba_cert_get_subj_key_id and
+ * ksba_cert_get_auth_key_id, nothing is allocated; the extensions
+ * are parsed only once and the returned pointers are valid as long
+ * as the certificate object.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_cert_get_key_ids (ksba_cert_t cert,
+                       const unsigned char **r_ski, size_t *r_skilen,
+                       const unsigned char **r_aki, size_t *r_akilen)
+{
+  gpg_error_t err;
+  size_t ski_off, ski_len, aki_off, aki_len;
+
+  if (!cert || (r_ski && !r_skilen) || (r_aki && !r_akilen))
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!cert->initialized)
+    return gpg_error (GPG_ERR_NO_DATA);
+
+  if (!atomic_load_acq (&cert->cache.keyids_valid))
+    {
+      err = locate_key_id (cert, 0, &ski_off, &ski_len);
+      if (!err)
+        err = locate_key_id (cert, 1, &aki_off, &aki_len);
+      if (err)
+        return err;
+      gpgrt_lock_lock (&cache_lock);
+      if (!cert->cache.keyids_valid)
+        {
+          cert->cache.ski_off = ski_off;
+          cert->cache.ski_len = ski_len;
+          cert->cache.aki_off = aki_off;
+          cert->cache.aki_len = aki_len;
+          atomic_store_rel (&cert->cache.keyids_valid, 1);
+        }
+      gpgrt_lock_unlock (&cache_lock);
+    }
+
+  if (r_ski)
+    {
+      *r_skilen = cert->cache.ski_len;
+      *r_ski = *r_skilen? cert->image + cert->cache.ski_off : NULL;
+    }
+  if (r_aki)
+    {
+      *r_akilen = cert->cache.aki_len;
+      *r_aki = *r_akilen? cert->image + cert->cache.aki_off : NULL;
+    }
+  return 0;
+}
+
+
 
 /* MODE 0 := authorityInfoAccess
         1 := subjectInfoAccess
@@ -2048,9 +3156,8 @@ get_info_access (ksba_cert_t cert, int idx, int mode,
                  char **method, ksba_name_t *location)
 {
   gpg_error_t err;
-  const char *oid;
   size_t off, derlen;
-  int myidx, crit;
+  int myidx;
 
   *method = NULL;
   *location = NULL;
@@ -2060,102 +3167,104 @@ get_info_access (ksba_cert_t cert, int idx, int mode,
   if (idx < 0)
     return gpg_error (GPG_ERR_INV_INDEX);
 
-  for (myidx=0; !(err=ksba_cert_get_extension (cert, myidx, &oid, &crit,
-                                               &off, &derlen)); myidx++)
+  err = find_extension (cert, (mode == 0? CERT_EXTN_AUTHORITY_INFO_ACCESS
+                               : CERT_EXTN_SUBJECT_INFO_ACCESS), &myidx);
+  for (; !err && myidx != -1; myidx = cert->cache.extns[myidx].next)
     {
-      if (!strcmp (oid,(mode == 0)? oidstr_authorityInfoAccess
-                                  : oidstr_subjectInfoAccess) )
+      const unsigned char *der;
+      struct tag_info ti;
+      size_t seqlen;
+
+      off = cert->cache.extns[myidx].off;
+      derlen = cert->cache.extns[myidx].len;
+
+      der = cert->image + off;
+
+      /* What we are going to parse is:
+       *
+       *    AuthorityInfoAccessSyntax  ::=
+       *            SEQUENCE SIZE (1..MAX) OF AccessDescription
+       *
+       *    AccessDescription  ::=  SEQUENCE {
+       *            accessMethod          OBJECT IDENTIFIER,
+       *            accessLocation        GeneralName  }
+       */
+      err = _ksba_ber_parse_tl (&der, &derlen, &ti);
+      if (err)
+        return err;
+      if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_SEQUENCE
+             && ti.is_constructed) )
+        return gpg_error (GPG_ERR_INV_CERT_OBJ);
+      if (ti.ndef)
+        return gpg_error (GPG_ERR_NOT_DER_ENCODED);
+      seqlen = ti.length;
+      if (seqlen > derlen)
+        return gpg_error (GPG_ERR_BAD_BER);
+
+      /* Note: an empty sequence is actually not allowed but we
+         better don't care. */
+
+      while (seqlen)
         {
-          const unsigned char *der;
-          struct tag_info ti;
-          size_t seqlen;
-
-          der = cert->image + off;
-
-          /* What we are going to parse is:
-           *
-           *    AuthorityInfoAccessSyntax  ::=
-           *            SEQUENCE SIZE (1..MAX) OF AccessDescription
-           *
-           *    AccessDescription  ::=  SEQUENCE {
-           *            accessMethod          OBJECT IDENTIFIER,
-           *            accessLocation        GeneralName  }
-           */
           err = _ksba_ber_parse_tl (&der, &derlen, &ti);
           if (err)
             return err;
           if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_SEQUENCE
                  && ti.is_constructed) )
             return gpg_error (GPG_ERR_INV_CERT_OBJ);
+          if (derlen < ti.length)
+            return gpg_error (GPG_ERR_BAD_BER);
+          if (seqlen < ti.nhdr)
+            return gpg_error (GPG_ERR_BAD_BER);
+          seqlen -= ti.nhdr;
+          if (seqlen < ti.length)
+            return gpg_error (GPG_ERR_BAD_BER);
+
+          if (idx)
+            { /* Skip because we are not yet at the desired index. */
+              der    += ti.length;
+              derlen -= ti.length;
+              seqlen -= ti.length;
+              idx--;
+              continue;
+            }
+          /* We only need the next object, thus we can (and
+             actually need to) limit the DERLEN to the length of
+             the current sequence. */
+          derlen = ti.length;
+          if (!derlen)
+            return gpg_error (GPG_ERR_INV_CERT_OBJ);
+
+          err = _ksba_ber_parse_tl (&der, &derlen, &ti);
+          if (err)
+            return err;
+
+          if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OBJECT_ID
+                 && !ti.is_constructed))
+            return gpg_error (GPG_ERR_INV_CERT_OBJ);
           if (ti.ndef)
             return gpg_error (GPG_ERR_NOT_DER_ENCODED);
-          seqlen = ti.length;
-          if (seqlen > derlen)
+          if (derlen < ti.length)
             return gpg_error (GPG_ERR_BAD_BER);
 
-          /* Note: an empty sequence is actually not allowed but we
-             better don't care. */
+          *method = ksba_oid_to_str (der, ti.length);
+          if (!*method)
+            return gpg_error (GPG_ERR_ENOMEM);
+          der       += ti.length;
+          derlen    -= ti.length;
 
-          while (seqlen)
+          err = _ksba_name_new_from_der (location, der, derlen);
+          if (err)
             {
-              err = _ksba_ber_parse_tl (&der, &derlen, &ti);
-              if (err)
-                return err;
-              if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_SEQUENCE
-                     && ti.is_constructed) )
-                return gpg_error (GPG_ERR_INV_CERT_OBJ);
-              if (derlen < ti.length)
-                return gpg_error (GPG_ERR_BAD_BER);
-              if (seqlen < ti.nhdr)
-                return gpg_error (GPG_ERR_BAD_BER);
-              seqlen -= ti.nhdr;
-              if (seqlen < ti.length)
-                return gpg_error (GPG_ERR_BAD_BER);
-
-              if (idx)
-                { /* Skip because we are not yet at the desired index. */
-                  der    += ti.length;
-                  derlen -= ti.length;
-                  seqlen -= ti.length;
-                  idx--;
-                  continue;
-                }
-              /* We only need the next object, thus we can (and
-                 actually need to) limit the DERLEN to the length of
-                 the current sequence. */
-              derlen = ti.length;
-              if (!derlen)
-                return gpg_error (GPG_ERR_INV_CERT_OBJ);
-
-              err = _ksba_ber_parse_tl (&der, &derlen, &ti);
-              if (err)
-                return err;
-
-              if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OBJECT_ID
-                     && !ti.is_constructed))
-                return gpg_error (GPG_ERR_INV_CERT_OBJ);
-              if (ti.ndef)
-                return gpg_error (GPG_ERR_NOT_DER_ENCODED);
-              if (derlen < ti.length)
-                return gpg_error (GPG_ERR_BAD_BER);
-
-              *method = ksba_oid_to_str (der, ti.length);
-              if (!*method)
-                return gpg_error (GPG_ERR_ENOMEM);
-              der       += ti.length;
-              derlen    -= ti.length;
-
-              err = _ksba_name_new_from_der (location, der, derlen);
-              if (err)
-                {
-                  ksba_free (*method);
-                  *method = NULL;
-                  return err;
-                }
-              return 0;
+              ksba_free (*method);
+              *method = NULL;
+              return err;
             }
+          return 0;
         }
     }
+  if (!err)
+    err = gpg_error (GPG_ERR_EOF);
 
   return err;
 }
@@ -2195,3 +3304,178 @@ ksba_cert_get_subject_info_access (ksba_cert_t cert, int idx,
     return gpg_error (GPG_ERR_INV_VALUE);
   return get_info_access (cert, idx, 1, r_method, r_location);
 }
+
+
+/* Find the issuer of CERT in STORE.  If CERT has an
+   authorityKeyIdentifier, a certificate with a matching
+   subjectKeyIdentifier is preferred.  A self-issued certificate is
+   its own issuer if it is not in STORE.  Returns a new reference.  */
+static gpg_error_t
+find_verify_issuer (ksba_cert_t cert, ksba_certstore_t store,
+                    ksba_cert_t *r_issuer)
+{
+  gpg_error_t err;
+  const unsigned char *aki, *ski, *dn, *dn2;
+  size_t akilen, skilen, dnlen, dn2len;
+  ksba_cert_t issuer, first = NULL;
+  int idx;
+
+  *r_issuer = NULL;
+  err = _ksba_cert_get_key_ids (cert, NULL, NULL, &aki, &akilen);
+  if (err)
+    return err;
+  for (idx=0; store; idx++)
+    {
+      err = _ksba_certstore_find_issuer (store, cert, idx, &issuer);
+      if (gpg_err_code (err) == GPG_ERR_NOT_FOUND)
+        break;
+      if (err)
+        {
+          ksba_cert_release (first);
+          return err;
+        }
+      if (!aki
+          || (!_ksba_cert_get_key_ids (issuer, &ski, &skilen, NULL, NULL)
+              && ski && skilen == akilen && !memcmp (ski, aki, akilen)))
+        {
+          ksba_cert_release (first);
+          *r_issuer = issuer;
+          return 0;
+        }
+      if (!first)
+        first = issuer;
+      else
+        ksba_cert_release (issuer);
+    }
+  if (first)
+    {
+      *r_issuer = first;
+      return 0;
+    }
+
+  err = _ksba_cert_get_issuer_dn_ptr (cert, &dn, &dnlen);
+  if (!err)
+    err = _ksba_cert_get_subject_dn_ptr (cert, &dn2, &dn2len);
+  if (err)
+    return err;
+  if (_ksba_dn_cmp_der (dn, dnlen, dn2, dn2len))
+    return gpg_error (GPG_ERR_MISSING_ISSUER_CERT);
+  ksba_cert_ref (cert);
+  *r_issuer = cert;
+  return 0;
+}
+
+
+/**
+ * ksba_cert_prepare_verify:
+ * @items: An array of items
+ * @nitems: The number of items
+ * @store: NULL or a store to look up the issuers
+ *
+ * Prepare the verification of the signatures of many certificates.
+ * For each item the caller sets the field @cert and optionally the
+ * field @issuer.  This function then fills in the signed data, the
+ * signature algorithm, the signature value and the public key of the
+ * issuer so that a crypto backend can verify all signatures in one
+ * go, for example spread over several threads.  If no issuer is
+ * given, it is looked up in @store; without a match a self-issued
+ * certificate is taken as its own issuer.  The signed data and the
+ * algorithm are valid as long as the certificate object.  The other
+ * fields are released by ksba_cert_release_verify which must be
+ * called even if this function fails.
+ *
+ * All items are processed even after an error.  The error of each
+ * item is stored in its field @err.
+ *
+ * Return value: 0 if all items have been prepared or the error of the
+ * first failed item.
+ **/
+gpg_error_t
+ksba_cert_prepare_verify (ksba_cert_verify_item_t items, size_t nitems,
+                          ksba_certstore_t store)
+{
+  gpg_error_t err, firsterr = 0;
+  ksba_cert_verify_item_t item;
+  size_t i;
+
+  if (!items && nitems)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  for (i=0; i < nitems; i++)
+    {
+      item = items + i;
+      item->tbs = NULL;
+      item->tbslen = 0;
+      item->digest_algo = NULL;
+      item->sigval = NULL;
+      item->pubkey = NULL;
+      item->_issuer_ref = 0;
+
+      if (!item->cert)
+        err = gpg_error (GPG_ERR_INV_VALUE);
+      else
+        err = _ksba_cert_get_view (item->cert, KSBA_CERT_VIEW_TBS,
+                                   &item->tbs, &item->tbslen, NULL);
+      if (!err)
+        {
+          item->digest_algo = _ksba_cert_get_digest_algo (item->cert);
+          if (!item->digest_algo)
+            err = gpg_error (GPG_ERR_UNKNOWN_ALGORITHM);
+        }
+      if (!err)
+        {
+          item->sigval = _ksba_cert_get_sig_val (item->cert);
+          if (!item->sigval)
+            err = gpg_error (GPG_ERR_INV_CERT_OBJ);
+        }
+      if (!err && !item->issuer)
+        {
+          err = find_verify_issuer (item->cert, store, &item->issuer);
+          if (!err)
+            item->_issuer_ref = 1;
+        }
+      if (!err)
+        {
+          item->pubkey = _ksba_cert_get_public_key (item->issuer);
+          if (!item->pubkey)
+            err = gpg_error (GPG_ERR_INV_CERT_OBJ);
+        }
+
+      item->err = err;
+      if (err && !firsterr)
+        firsterr = err;
+    }
+
+  return firsterr;
+}
+
+
+/**
+ * ksba_cert_release_verify:
+ * @items: An array of items prepared by ksba_cert_prepare_verify
+ * @nitems: The number of items
+ *
+ * Release the data allocated by ksba_cert_prepare_verify.  An issuer
+ * which has been looked up is released and its field reset to NULL.
+ **/
+void
+ksba_cert_release_verify (ksba_cert_verify_item_t items, size_t nitems)
+{
+  size_t i;
+
+  if (!items)
+    return;
+  for (i=0; i < nitems; i++)
+    {
+      ksba_free (items[i].sigval);
+      items[i].sigval = NULL;
+      ksba_free (items[i].pubkey);
+      items[i].pubkey = NULL;
+      if (items[i]._issuer_ref)
+        {
+          ksba_cert_release (items[i].issuer);
+          items[i].issuer = NULL;
+          items[i]._issuer_ref = 0;
+        }
+    }
+}
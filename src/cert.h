@@ -33,12 +33,44 @@
 
 #include "asn1-func.h"
 
+/* The extensions known to the accessors of a certificate.  */
+enum cert_extn_kinds
+  {
+    CERT_EXTN_SUBJECT_KEY_ID = 0,
+    CERT_EXTN_KEY_USAGE,
+    CERT_EXTN_SUBJECT_ALT_NAME,
+    CERT_EXTN_ISSUER_ALT_NAME,
+    CERT_EXTN_BASIC_CONSTRAINTS,
+    CERT_EXTN_CRL_DIST_POINTS,
+    CERT_EXTN_CERT_POLICIES,
+    CERT_EXTN_AUTHORITY_KEY_ID,
+    CERT_EXTN_EXT_KEY_USAGE,
+    CERT_EXTN_AUTHORITY_INFO_ACCESS,
+    CERT_EXTN_SUBJECT_INFO_ACCESS,
+    CERT_EXTN_LAST    /* Also used for unknown extensions.  */
+  };
+
+
 /* An object to keep parsed information about an extension. */
 struct cert_extn_info
 {
-  char *oid;
+  const char *oid;  /* Static or OIDBUF.  */
+  char *oidbuf;
   int crit;
   int off, len;
+  int next;   /* Index of the next extension of the same known kind
+                 or -1.  */
+};
+
+
+/* A cached fingerprint; see ksba_cert_get_fingerprint.  */
+struct cert_fpr
+{
+  struct cert_fpr *next;
+  ksba_fpr_part_t what;
+  size_t digestlen;
+  unsigned char digest[KSBA_MAX_DIGEST_LEN];
+  char algo[1];
 };
 
 
@@ -67,6 +99,24 @@ struct cert_user_data
 };
 
 
+/* Indices of the nodes cached by _ksba_cert_find_node; see the
+   table in cert.c.  */
+enum cert_nodes
+  {
+    CERT_NODE_CERTIFICATE = 0,
+    CERT_NODE_TBS,
+    CERT_NODE_SIGALGO,
+    CERT_NODE_SERIAL,
+    CERT_NODE_ISSUER,
+    CERT_NODE_SUBJECT,
+    CERT_NODE_NOTBEFORE,
+    CERT_NODE_NOTAFTER,
+    CERT_NODE_PUBKEY,
+    CERT_NODE_EXTNS,
+    CERT_NODE_LAST   /* End marker.  */
+  };
+
+
 /* The internal certificate object. */
 struct ksba_cert_s
 {
@@ -88,11 +138,16 @@ struct ksba_cert_s
      modified. */
   int ref_count;
 
+  ksba_alloc_ctx_t alloc_ctx;  /* The allocator context or NULL.  */
+
   ksba_asn_tree_t asn_tree;
   AsnNode root;              /* Root of the tree with the values */
 
   unsigned char *image;
   size_t imagelen;
+  int image_borrowed;        /* IMAGE is owned by the caller.  */
+  void (*image_release_cb) (void *opaque);
+  void *image_release_opaque;
 
   gpg_error_t last_error;
   struct {
@@ -100,13 +155,35 @@ struct ksba_cert_s
     int  extns_valid;
     int  n_extns;
     struct cert_extn_info *extns;
+    int  first_extn[CERT_EXTN_LAST]; /* Index into EXTNS or -1.  */
+    unsigned int nodes_valid;  /* Bit vector of valid NODES.  */
+    AsnNode nodes[CERT_NODE_LAST];
+    struct cert_fpr *fprs;
+    int keyids_valid;
+    size_t ski_off, ski_len; /* The key identifiers in IMAGE.  */
+    size_t aki_off, aki_len;
+    int validity_valid;
+    ksba_epoch_t validity[2];  /* notBefore and notAfter.  */
   } cache;
+
+  /* Information for the lazy decoding; see ksba_cert_set_lazy.  */
+  struct {
+    int enabled;
+    int pending;  /* The tree has not yet been decoded.  */
+    gpgrt_lock_t lock;  /* Serializes the decoding of this object.  */
+    struct {      /* Position of some TLVs in IMAGE.  */
+      size_t off;
+      size_t nhdr;
+      size_t len;
+    } tlv[CERT_NODE_LAST];
+  } lazy;
 };
 
 
 /*** Internal functions ***/
 
 int _ksba_cert_cmp (ksba_cert_t a, ksba_cert_t b);
+AsnNode _ksba_cert_find_node (ksba_cert_t cert, enum cert_nodes which);
 
 gpg_error_t _ksba_cert_get_serial_ptr (ksba_cert_t cert,
                                        unsigned char const **ptr,
@@ -41,6 +41,7 @@
 #include "convert.h"
 #include "keyinfo.h"
 #include "der-encoder.h"
+#include "der-builder.h"
 #include "ber-help.h"
 #include "sexp-parse.h"
 #include "certreq.h"
@@ -167,11 +168,58 @@ ksba_certreq_release (ksba_certreq_t cr)
       xfree (cr->extn_list);
       cr->extn_list = e;
     }
+  xfree (cr->extn_cache.der);
+  _ksba_der_release (cr->dbld);
 
   xfree (cr);
 }
 
 
+/**
+ * ksba_certreq_reset:
+ * @cr: A Certreq object
+ *
+ * Prepare @cr for building another request.  The serial number, the
+ * subject and its alternative names, the public key and the signature
+ * are cleared.  The issuer, the validity, the signing key info, the
+ * extensions, the writer and the hash function are kept.  Thus only
+ * the values specific to a request need to be set for the next
+ * request; the kept extensions are encoded only once.
+ **/
+void
+ksba_certreq_reset (ksba_certreq_t cr)
+{
+  if (!cr)
+    return;
+  xfree (cr->x509.serial.der);
+  cr->x509.serial.der = NULL;
+  cr->x509.serial.derlen = 0;
+  xfree (cr->subject.der);
+  cr->subject.der = NULL;
+  cr->subject.derlen = 0;
+  xfree (cr->key.der);
+  cr->key.der = NULL;
+  cr->key.derlen = 0;
+  xfree (cr->cri.der);
+  cr->cri.der = NULL;
+  cr->cri.derlen = 0;
+  xfree (cr->sig_val.algo);
+  cr->sig_val.algo = NULL;
+  cr->sig_val.is_ecc = 0;
+  xfree (cr->sig_val.value);
+  cr->sig_val.value = NULL;
+  cr->sig_val.valuelen = 0;
+  while (cr->subject_alt_names)
+    {
+      struct general_names_s *tmp = cr->subject_alt_names->next;
+      xfree (cr->subject_alt_names);
+      cr->subject_alt_names = tmp;
+    }
+  cr->last_error = 0;
+  cr->any_build_done = 0;
+}
+
+
 gpg_error_t
 ksba_certreq_set_writer (ksba_certreq_t cr, ksba_writer_t w)
 {
@@ -370,11 +418,11 @@ ksba_certreq_add_subject (ksba_certreq_t cr, const char *name)
 }
 
 
-/* Add the GeneralNames object GNAMES to the list of extensions in CR.
-   Use OID as object identifier for the extensions. */
+/* Create an extension from the GeneralNames object GNAMES and store
+   it at R_EXTN.  Use OID as object identifier for the extension. */
 static gpg_error_t
-add_general_names_to_extn (ksba_certreq_t cr, struct general_names_s *gnames,
-                           const char *oid)
+make_general_names_extn (struct general_names_s *gnames, const char *oid,
+                         struct extn_list_s **r_extn)
 {
   struct general_names_s *g;
   size_t n, n1, n2;
@@ -393,13 +441,17 @@ add_general_names_to_extn (ksba_certreq_t cr, struct general_names_s *gnames,
   e = xtrymalloc (sizeof *e + n2 - 1);
   if (!e)
     return gpg_error_from_errno (errno);
+  e->next = NULL;
   e->oid = oid;
   e->critical = 0;
   e->derlen = n2;
   der = e->der;
   n = _ksba_ber_encode_tl (der, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, n1);
   if (!n)
-    return gpg_error (GPG_ERR_BUG); /* (no need to cleanup after a bug) */
+    {
+      xfree (e);
+      return gpg_error (GPG_ERR_BUG);
+    }
   der += n;
 
   for (g=gnames; g; g = g->next)
@@ -409,8 +461,7 @@ add_general_names_to_extn (ksba_certreq_t cr, struct general_names_s *gnames,
     }
   assert (der - e->der == n2);
 
-  e->next = cr->extn_list;
-  cr->extn_list = e;
+  *r_extn = e;
   return 0;
 }
 
@@ -455,6 +506,8 @@ ksba_certreq_add_extension (ksba_certreq_t cr,
 
   e->next = cr->extn_list;
   cr->extn_list = e;
+  xfree (cr->extn_cache.der);
+  cr->extn_cache.der = NULL;
 
   return 0;
 }
@@ -630,241 +683,115 @@ ksba_certreq_set_sig_val (ksba_certreq_t cr, ksba_const_sexp_t sigval)
 
 
 
-/* Build the extension block and return it in R_DER and R_DERLEN.  IF
-   CERTMODE is true build X.509 certificate extension instead.  */
+/* Make sure that the extensions in the extension list of CR are
+   encoded and stored in CR->EXTN_CACHE.  The cache is only cleared
+   when an extension is added so that the constant part of a series
+   of requests is encoded only once.  */
 static gpg_error_t
-build_extensions (ksba_certreq_t cr, int certmode,
-                  void **r_der, size_t *r_derlen)
+encode_extensions (ksba_certreq_t cr, ksba_der_t dbld)
 {
-  gpg_error_t err;
-  ksba_writer_t writer, w=NULL;
   struct extn_list_s *e;
-  unsigned char *value = NULL;
-  size_t valuelen;
-  unsigned char *p;
-  size_t n;
-
-  *r_der = NULL;
-  *r_derlen = 0;
-  err = ksba_writer_new (&writer);
-  if (err)
-    goto leave;
-  err = ksba_writer_set_mem (writer, 2048);
-  if (err)
-    goto leave;
-  err = ksba_writer_new (&w);
-  if (err)
-    goto leave;
 
+  if (cr->extn_cache.der || !cr->extn_list)
+    return 0;
+
+  _ksba_der_builder_reset (dbld);
   for (e=cr->extn_list; e; e = e->next)
     {
-      err = ksba_writer_set_mem (w, e->derlen + 100);
-      if (err)
-        goto leave;
-
-      err = ksba_oid_from_str (e->oid, &p, &n);
-      if(err)
-        goto leave;
-      err = _ksba_ber_write_tl (w, TYPE_OBJECT_ID, CLASS_UNIVERSAL, 0, n);
-      if (!err)
-        err = ksba_writer_write (w, p, n);
-      xfree (p);
-
+      _ksba_der_add_tag (dbld, 0, TYPE_SEQUENCE);
+      _ksba_der_add_oid (dbld, e->oid);
       if (e->critical)
-        {
-          err = _ksba_ber_write_tl (w, TYPE_BOOLEAN, CLASS_UNIVERSAL, 0, 1);
-          if (!err)
-            err = ksba_writer_write (w, "\xff", 1);
-          if(err)
-            goto leave;
-        }
-
-      err = _ksba_ber_write_tl (w, TYPE_OCTET_STRING, CLASS_UNIVERSAL,
-                                0, e->derlen);
-      if (!err)
-        err = ksba_writer_write (w, e->der, e->derlen);
-      if(err)
-        goto leave;
-
-      p = ksba_writer_snatch_mem (w, &n);
-      if (!p)
-        {
-          err = gpg_error (GPG_ERR_ENOMEM);
-          goto leave;
-        }
-      err = _ksba_ber_write_tl (writer, TYPE_SEQUENCE, CLASS_UNIVERSAL,
-                                1, n);
-      if (!err)
-        err = ksba_writer_write (writer, p, n);
-      xfree (p); p = NULL;
-      if (err)
-        goto leave;
+        _ksba_der_add_ptr (dbld, 0, TYPE_BOOLEAN, "\xff", 1);
+      _ksba_der_add_ptr (dbld, 0, TYPE_OCTET_STRING, e->der, e->derlen);
+      _ksba_der_add_end (dbld);
     }
 
-  /* Embed all the sequences into another sequence */
-  value = ksba_writer_snatch_mem (writer, &valuelen);
-  if (!value)
-    {
-      err = gpg_error (GPG_ERR_ENOMEM);
-      goto leave;
-    }
-  err = ksba_writer_set_mem (writer, valuelen+10);
-  if (err)
-    goto leave;
-  err = _ksba_ber_write_tl (writer, TYPE_SEQUENCE, CLASS_UNIVERSAL,
-                            1, valuelen);
-  if (!err)
-    err = ksba_writer_write (writer, value, valuelen);
-  if (err)
-    goto leave;
-
-  xfree (value);
-  value = ksba_writer_snatch_mem (writer, &valuelen);
-  if (!value)
-    {
-      err = gpg_error (GPG_ERR_ENOMEM);
-      goto leave;
-    }
-
-  if (!certmode)
-    {
-      /* Now create the extension request sequence content */
-      err = ksba_writer_set_mem (writer, valuelen+100);
-      if (err)
-        goto leave;
-      err = ksba_oid_from_str (oidstr_extensionReq, &p, &n);
-      if(err)
-        goto leave;
-      err = _ksba_ber_write_tl (writer, TYPE_OBJECT_ID, CLASS_UNIVERSAL, 0, n);
-      if (!err)
-        err = ksba_writer_write (writer, p, n);
-      xfree (p); p = NULL;
-      if (err)
-        return err;
-      err = _ksba_ber_write_tl (writer, TYPE_SET, CLASS_UNIVERSAL, 1, valuelen);
-      if (!err)
-        err = ksba_writer_write (writer, value, valuelen);
-
-      /* Put this all into a SEQUENCE */
-      xfree (value);
-      value = ksba_writer_snatch_mem (writer, &valuelen);
-      if (!value)
-        {
-          err = gpg_error (GPG_ERR_ENOMEM);
-          goto leave;
-        }
-      err = ksba_writer_set_mem (writer, valuelen+10);
-      if (err)
-        goto leave;
-      err = _ksba_ber_write_tl (writer, TYPE_SEQUENCE, CLASS_UNIVERSAL,
-                                1, valuelen);
-      if (!err)
-        err = ksba_writer_write (writer, value, valuelen);
-      if (err)
-        goto leave;
-
-      xfree (value);
-      value = ksba_writer_snatch_mem (writer, &valuelen);
-      if (!value)
-        {
-          err = gpg_error (GPG_ERR_ENOMEM);
-          goto leave;
-        }
-    }
-
-  *r_der = value;
-  *r_derlen = valuelen;
-  value = NULL;
+  return _ksba_der_builder_get (dbld, &cr->extn_cache.der,
+                                &cr->extn_cache.derlen);
+}
 
 
- leave:
-  ksba_writer_release (writer);
-  ksba_writer_release (w);
-  xfree (value);
-  return err;
+/* Return the DER builder of CR after resetting it.  Returns NULL on
+   error.  */
+static ksba_der_t
+get_builder (ksba_certreq_t cr)
+{
+  if (cr->dbld)
+    _ksba_der_builder_reset (cr->dbld);
+  else
+    cr->dbld = _ksba_der_builder_new (0);
+  return cr->dbld;
 }
 
 
-/* Build a value tree from the already stored values. */
+/* Build the CertificationRequestInfo or the TBSCertificate from the
+   already stored values and store it at CR->CRI.  */
 static gpg_error_t
 build_cri (ksba_certreq_t cr)
 {
   gpg_error_t err;
-  ksba_writer_t writer;
-  void *value = NULL;
-  size_t valuelen;
+  ksba_der_t dbld;
+  struct extn_list_s *san = NULL;
   int certmode;
 
   /* If a serial number has been set, we don't create a CSR but a
      proper certificate.  */
   certmode = !!cr->x509.serial.der;
 
-  err = ksba_writer_new (&writer);
-  if (err)
-    goto leave;
-  err = ksba_writer_set_mem (writer, 2048);
-  if (err)
-    goto leave;
+  if (!cr->key.der || !cr->subject.der)
+    return gpg_error (GPG_ERR_MISSING_VALUE);
+  if (certmode && !cr->x509.siginfo.der)
+    return gpg_error (GPG_ERR_MISSING_VALUE);
 
-  if (!cr->key.der)
+  dbld = get_builder (cr);
+  if (!dbld)
+    return gpg_error_from_syserror ();
+
+  /* The subjectAltNames are specific to a request; the other
+     extensions are only encoded once.  */
+  if (cr->subject_alt_names)
     {
-      err = gpg_error (GPG_ERR_MISSING_VALUE);
-      goto leave;
+      err = make_general_names_extn (cr->subject_alt_names,
+                                     oidstr_subjectAltName, &san);
+      if (err)
+        goto leave;
     }
+  err = encode_extensions (cr, dbld);
+  if (err)
+    goto leave;
 
-  /* We write all stuff out to a temporary writer object, then use
-     this object to create the cri and store the cri image */
+  _ksba_der_builder_reset (dbld);
+  _ksba_der_add_tag (dbld, 0, TYPE_SEQUENCE);
 
   if (certmode)
     {
       /* Store the version structure; version is 3 (encoded as 2):
          [0] { INTEGER 2 }  */
-      err = ksba_writer_write (writer, "\xa0\x03\x02\x01\x02", 5);
+      _ksba_der_add_der (dbld, "\xa0\x03\x02\x01\x02", 5);
     }
   else
     {
       /* Store version v1 (which is a 0).  */
-      err = _ksba_ber_write_tl (writer, TYPE_INTEGER, CLASS_UNIVERSAL, 0, 1);
-      if (!err)
-        err = ksba_writer_write (writer, "", 1);
+      _ksba_der_add_ptr (dbld, 0, TYPE_INTEGER, "", 1);
     }
-  if (err)
-    goto leave;
 
   /* For a certificate we need to store the s/n, the signature
      algorithm identifier, the issuer DN and the validity.  */
   if (certmode)
     {
       /* Store the serial number. */
-      err = _ksba_ber_write_tl (writer, TYPE_INTEGER, CLASS_UNIVERSAL, 0,
-                                cr->x509.serial.derlen);
-      if (!err)
-        err = ksba_writer_write (writer,
-                                 cr->x509.serial.der, cr->x509.serial.derlen);
-      if (err)
-        goto leave;
+      _ksba_der_add_ptr (dbld, 0, TYPE_INTEGER,
+                         cr->x509.serial.der, cr->x509.serial.derlen);
 
       /* Store the signature algorithm identifier.  */
-      if (!cr->x509.siginfo.der)
-        err = gpg_error (GPG_ERR_MISSING_VALUE);
-      else
-        err = ksba_writer_write (writer,
-                                 cr->x509.siginfo.der, cr->x509.siginfo.derlen);
-      if (err)
-        goto leave;
-
+      _ksba_der_add_der (dbld, cr->x509.siginfo.der, cr->x509.siginfo.derlen);
 
       /* Store the issuer DN.  If no issuer DN has been set we use the
          subject DN.  */
       if (cr->x509.issuer.der)
-        err = ksba_writer_write (writer,
-                                 cr->x509.issuer.der, cr->x509.issuer.derlen);
-      else if (cr->subject.der)
-        err = ksba_writer_write (writer, cr->subject.der, cr->subject.derlen);
+        _ksba_der_add_der (dbld, cr->x509.issuer.der, cr->x509.issuer.derlen);
       else
-        err = gpg_error (GPG_ERR_MISSING_VALUE);
-      if (err)
-        goto leave;
+        _ksba_der_add_der (dbld, cr->subject.der, cr->subject.derlen);
 
       /* Store the Validity.  */
       {
@@ -935,100 +862,64 @@ build_cri (ksba_certreq_t cr)
         assert (tp - templ <= 36);
         templ[1] = tp - templ - 2;  /* Fixup the sequence length.  */
 
-        err = ksba_writer_write (writer, templ, tp - templ);
-        if (err)
-          goto leave;
+        _ksba_der_add_der (dbld, templ, tp - templ);
       }
     }
 
   /* store the subject */
-  if (!cr->subject.der)
-    {
-      err = gpg_error (GPG_ERR_MISSING_VALUE);
-      goto leave;
-    }
-  err = ksba_writer_write (writer, cr->subject.der, cr->subject.derlen);
-  if (err)
-    goto leave;
+  _ksba_der_add_der (dbld, cr->subject.der, cr->subject.derlen);
 
   /* store the public key info */
-  err = ksba_writer_write (writer, cr->key.der, cr->key.derlen);
-  if (err)
-    goto leave;
+  _ksba_der_add_der (dbld, cr->key.der, cr->key.derlen);
 
-  /* Copy generalNames objects to the extension list. */
-  if (cr->subject_alt_names)
+  /* Write the extensions.  Note that the implicit SET OF is REQUIRED */
+  if (san || cr->extn_cache.der)
     {
-      err = add_general_names_to_extn (cr, cr->subject_alt_names,
-                                       oidstr_subjectAltName);
-      if (err)
-        goto leave;
-      while (cr->subject_alt_names)
+      _ksba_der_add_tag (dbld, CLASS_CONTEXT, certmode? 3:0);
+      if (!certmode)
         {
-          struct general_names_s *tmp = cr->subject_alt_names->next;
-          xfree (cr->subject_alt_names);
-          cr->subject_alt_names = tmp;
+          /* The extension request attribute.  */
+          _ksba_der_add_tag (dbld, 0, TYPE_SEQUENCE);
+          _ksba_der_add_oid (dbld, oidstr_extensionReq);
+          _ksba_der_add_tag (dbld, 0, TYPE_SET);
         }
-      cr->subject_alt_names = NULL;
-    }
-
-
-  /* Write the extensions.  Note that the implicit SET OF is REQUIRED */
-  xfree (value); value = NULL;
-  valuelen = 0;
-  if (cr->extn_list)
-    {
-      err = build_extensions (cr, certmode, &value, &valuelen);
-      if (err)
-        goto leave;
-      err = _ksba_ber_write_tl (writer, certmode? 3:0,
-                                CLASS_CONTEXT, 1, valuelen);
-      if (!err)
-        err = ksba_writer_write (writer, value, valuelen);
-      if (err)
-        goto leave;
+      _ksba_der_add_tag (dbld, 0, TYPE_SEQUENCE);
+      if (san)
+        {
+          _ksba_der_add_tag (dbld, 0, TYPE_SEQUENCE);
+          _ksba_der_add_oid (dbld, san->oid);
+          _ksba_der_add_ptr (dbld, 0, TYPE_OCTET_STRING, san->der, san->derlen);
+          _ksba_der_add_end (dbld);
+        }
+      if (cr->extn_cache.der)
+        _ksba_der_add_der (dbld, cr->extn_cache.der, cr->extn_cache.derlen);
+      _ksba_der_add_end (dbld);
+      if (!certmode)
+        {
+          _ksba_der_add_end (dbld);
+          _ksba_der_add_end (dbld);
+        }
+      _ksba_der_add_end (dbld);
     }
   else
-    { /* We can't write an object of length zero using our ber_write
-         function.  So we must open encode it. */
-      err = ksba_writer_write (writer,
-                               certmode? "\xa3\x02\x30":"\xa0\x02\x30", 4);
-      if (err)
-        goto leave;
+    { /* Encode an empty extension block the same way as earlier
+         versions did.  */
+      _ksba_der_add_der (dbld, certmode? "\xa3\x02\x30":"\xa0\x02\x30", 4);
     }
 
-
-  /* pack it into the sequence */
-  xfree (value);
-  value = ksba_writer_snatch_mem (writer, &valuelen);
-  if (!value)
-    {
-      err = gpg_error (GPG_ERR_ENOMEM);
-      goto leave;
-    }
-  /* reinitialize the buffer to create the outer sequence */
-  err = ksba_writer_set_mem (writer, valuelen+10);
-  if (err)
-    goto leave;
-  /* write outer sequence */
-  err = _ksba_ber_write_tl (writer, TYPE_SEQUENCE, CLASS_UNIVERSAL,
-                            1, valuelen);
-  if (!err)
-    err = ksba_writer_write (writer, value, valuelen);
-  if (err)
-    goto leave;
+  _ksba_der_add_end (dbld);
 
   /* and store the final result */
-  cr->cri.der = ksba_writer_snatch_mem (writer, &cr->cri.derlen);
-  if (!cr->cri.der)
-    err = gpg_error (GPG_ERR_ENOMEM);
+  xfree (cr->cri.der);
+  cr->cri.der = NULL;
+  err = _ksba_der_builder_get (dbld, &cr->cri.der, &cr->cri.derlen);
 
  leave:
-  ksba_writer_release (writer);
-  xfree (value);
+  xfree (san);
   return err;
 }
 
+
 static gpg_error_t
 hash_cri (ksba_certreq_t cr)
 {
@@ -1037,6 +928,7 @@ hash_cri (ksba_certreq_t cr)
   if (!cr->cri.der)
     return gpg_error (GPG_ERR_INV_STATE);
   cr->hash_fnc (cr->hash_fnc_arg, cr->cri.der, cr->cri.derlen);
+  STATS_ADD (hash_bytes, cr->cri.derlen);
   return 0;
 }
 
@@ -1046,32 +938,24 @@ hash_cri (ksba_certreq_t cr)
 static gpg_error_t
 sign_and_write (ksba_certreq_t cr)
 {
-  gpg_error_t err;
   ksba_der_t dbld;
-  unsigned char *value = NULL;
-  size_t valuelen;
 
-  dbld = _ksba_der_builder_new (0);
+  if (!cr->cri.der || !cr->sig_val.algo)
+    return gpg_error (GPG_ERR_MISSING_VALUE);
+  if (!cr->writer)
+    return gpg_error (GPG_ERR_MISSING_ACTION);
+
+  dbld = get_builder (cr);
   if (!dbld)
-    {
-      err = gpg_error_from_syserror ();
-      goto leave;
-    }
+    return gpg_error_from_syserror ();
 
   /* Start outer sequence.  */
   _ksba_der_add_tag (dbld, 0, TYPE_SEQUENCE);
 
   /* Store the cri */
-  if (!cr->cri.der)
-    {
-      err = gpg_error (GPG_ERR_MISSING_VALUE);
-      goto leave;
-    }
   _ksba_der_add_der (dbld, cr->cri.der, cr->cri.derlen);
 
   /* Store the signatureAlgorithm */
-  if (!cr->sig_val.algo)
-    return gpg_error (GPG_ERR_MISSING_VALUE);
   _ksba_der_add_tag (dbld, 0, TYPE_SEQUENCE);
   _ksba_der_add_oid (dbld, cr->sig_val.algo);
   if (!cr->sig_val.is_ecc)
@@ -1085,23 +969,11 @@ sign_and_write (ksba_certreq_t cr)
   _ksba_der_add_end (dbld);
 
   /* and finally write the result */
-  err = _ksba_der_builder_get (dbld, &value, &valuelen);
-  if (err)
-    goto leave;
-
-  if (!cr->writer)
-    err = gpg_error (GPG_ERR_MISSING_ACTION);
-  else
-    err = ksba_writer_write (cr->writer, value, valuelen);
-
- leave:
-  ksba_der_release (dbld);
-  xfree (value);
-  return err;
+  return _ksba_der_builder_write (dbld, cr->writer);
 }
 
 
-
+
 /* The main function to build a certificate request.  It is used in a
  * loop to allow for interaction between the function and the caller */
 gpg_error_t
@@ -104,6 +104,14 @@ struct ksba_certreq_s
 
   struct extn_list_s *extn_list;
 
+  struct {
+    unsigned char *der;  /* The encoded EXTN_LIST or NULL if not yet
+                            encoded.  */
+    size_t derlen;
+  } extn_cache;
+
+  ksba_der_t dbld;  /* DER builder kept for re-use or NULL.  */
+
   struct {
     unsigned char *der;
     size_t derlen;
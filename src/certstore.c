@@ -0,0 +1,807 @@
+/* certstore.c - An indexed store of certificates
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * KSBA is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copies of the GNU General Public License
+ * and the GNU Lesser General Public License along with this program;
+ * if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The store keeps a reference to each of its certificates and puts
+ * them into several hash tables, each keyed by a different part of
+ * the certificate.  The keys point into the images of the
+ * certificates; thus nothing needs to be converted for an insert or
+ * a lookup.  All certificates are also kept in a list ordered by
+ * their last use so that a store with a limit can drop the least
+ * recently used one.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "util.h"
+#include "ber-decoder.h"
+#include "ber-help.h"
+#include "cert.h"
+#include "certstore.h"
+
+
+/* The initial number of buckets of each table.  */
+#define INITIAL_TABLE_SIZE 64
+
+
+/* Return the FNV-1a hash of the buffer P of length N.  */
+static unsigned int
+hash_buffer (const unsigned char *p, size_t n)
+{
+  unsigned int h = 2166136261u;
+
+  for (; n; n--, p++)
+    h = (h ^ *p) * 16777619u;
+  return h;
+}
+
+
+/* Return true if the key of ITEM in the index IDX matches KEY of
+   length KEYLEN with the hash value HASH.  */
+static int
+key_matches (struct certstore_item_s *item, enum certstore_index idx,
+             unsigned int hash, const unsigned char *key, size_t keylen)
+{
+  return (item->hash[idx] == hash
+          && item->keylen[idx] == keylen
+          && !memcmp (item->key[idx], key, keylen));
+}
+
+
+/* Link ITEM into all tables of STORE.  */
+static void
+link_item (ksba_certstore_t store, struct certstore_item_s *item)
+{
+  enum certstore_index idx;
+  unsigned int bucket;
+
+  for (idx=0; idx < CERTSTORE_NINDEXES; idx++)
+    {
+      if (!item->key[idx])
+        continue;
+      bucket = item->hash[idx] & (store->size - 1);
+      item->next[idx] = store->table[idx][bucket];
+      store->table[idx][bucket] = item;
+    }
+}
+
+
+/* Double the size of the tables of STORE.  */
+static gpg_error_t
+grow_tables (ksba_certstore_t store)
+{
+  struct certstore_item_s **old[CERTSTORE_NINDEXES];
+  struct certstore_item_s *item, *next;
+  unsigned int oldsize = store->size;
+  unsigned int n;
+  enum certstore_index idx;
+
+  for (idx=0; idx < CERTSTORE_NINDEXES; idx++)
+    {
+      old[idx] = store->table[idx];
+      store->table[idx] = xtrycalloc (2 * oldsize, sizeof *old[idx]);
+      if (!store->table[idx])
+        {
+          gpg_error_t err = gpg_error_from_syserror ();
+          while (idx--)
+            xfree (store->table[idx]);
+          for (idx=0; idx < CERTSTORE_NINDEXES; idx++)
+            store->table[idx] = old[idx];
+          return err;
+        }
+    }
+  store->size = 2 * oldsize;
+
+  /* Each item is in the image table.  */
+  for (n=0; n < oldsize; n++)
+    for (item = old[CERTSTORE_IMAGE][n]; item; item = next)
+      {
+        next = item->next[CERTSTORE_IMAGE];
+        link_item (store, item);
+      }
+  for (idx=0; idx < CERTSTORE_NINDEXES; idx++)
+    xfree (old[idx]);
+  return 0;
+}
+
+
+/* Return the item with the image IMAGE of length IMAGELEN or NULL.
+   If R_PREV is not NULL the address of the pointer to the item in the
+   image table is stored there.  */
+static struct certstore_item_s *
+find_image (ksba_certstore_t store,
+            const unsigned char *image, size_t imagelen,
+            struct certstore_item_s ***r_prev)
+{
+  struct certstore_item_s **prev, *item;
+  unsigned int hash = hash_buffer (image, imagelen);
+
+  prev = &store->table[CERTSTORE_IMAGE][hash & (store->size - 1)];
+  for (; (item = *prev); prev = &item->next[CERTSTORE_IMAGE])
+    if (key_matches (item, CERTSTORE_IMAGE, hash, image, imagelen))
+      {
+        if (r_prev)
+          *r_prev = prev;
+        return item;
+      }
+  return NULL;
+}
+
+
+/* Remove ITEM from the LRU list of STORE.  */
+static void
+lru_unlink (ksba_certstore_t store, struct certstore_item_s *item)
+{
+  if (item->lru_prev)
+    item->lru_prev->lru_next = item->lru_next;
+  else
+    store->lru_first = item->lru_next;
+  if (item->lru_next)
+    item->lru_next->lru_prev = item->lru_prev;
+  else
+    store->lru_last = item->lru_prev;
+  item->lru_prev = item->lru_next = NULL;
+}
+
+
+/* Put ITEM at the head of the LRU list of STORE.  */
+static void
+lru_push (ksba_certstore_t store, struct certstore_item_s *item)
+{
+  item->lru_prev = NULL;
+  item->lru_next = store->lru_first;
+  if (store->lru_first)
+    store->lru_first->lru_prev = item;
+  else
+    store->lru_last = item;
+  store->lru_first = item;
+}
+
+
+/* Unlink ITEM from the table IDX of STORE.  */
+static void
+unlink_item (ksba_certstore_t store, struct certstore_item_s *item,
+             enum certstore_index idx)
+{
+  struct certstore_item_s **prev;
+
+  if (!item->key[idx])
+    return;
+  prev = &store->table[idx][item->hash[idx] & (store->size - 1)];
+  for (; *prev; prev = &(*prev)->next[idx])
+    if (*prev == item)
+      {
+        *prev = item->next[idx];
+        return;
+      }
+}
+
+
+/* Remove ITEM from STORE and release it.  PREV is the address of the
+   pointer to ITEM in the image table.  */
+static void
+remove_item (ksba_certstore_t store, struct certstore_item_s *item,
+             struct certstore_item_s **prev)
+{
+  enum certstore_index idx;
+
+  *prev = item->next[CERTSTORE_IMAGE];
+  for (idx=0; idx < CERTSTORE_NINDEXES; idx++)
+    if (idx != CERTSTORE_IMAGE)
+      unlink_item (store, item, idx);
+  lru_unlink (store, item);
+  store->count--;
+  ksba_cert_release (item->cert);
+  xfree (item);
+}
+
+
+/* Remove the least recently used certificates from STORE until there
+   are fewer than N.  */
+static void
+shrink_store (ksba_certstore_t store, unsigned int n)
+{
+  struct certstore_item_s *item, **prev;
+  const unsigned char *image;
+  size_t imagelen;
+
+  while (store->count >= n && (item = store->lru_last))
+    {
+      image = item->key[CERTSTORE_IMAGE];
+      imagelen = item->keylen[CERTSTORE_IMAGE];
+      if (find_image (store, image, imagelen, &prev) != item)
+        break;  /* Can't happen.  */
+      remove_item (store, item, prev);
+    }
+}
+
+
+/**
+ * ksba_certstore_new:
+ * @r_store: Receives the new certificate store
+ *
+ * Create a new and empty certificate store.  A store is an object
+ * like all other objects of KSBA and may only be used by one thread
+ * at a time; the certificates returned by it may be shared, though.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_certstore_new (ksba_certstore_t *r_store)
+{
+  ksba_certstore_t store;
+  enum certstore_index idx;
+
+  *r_store = NULL;
+  store = xtrycalloc (1, sizeof *store);
+  if (!store)
+    return gpg_error_from_syserror ();
+  store->size = INITIAL_TABLE_SIZE;
+  for (idx=0; idx < CERTSTORE_NINDEXES; idx++)
+    {
+      store->table[idx] = xtrycalloc (store->size, sizeof *store->table[idx]);
+      if (!store->table[idx])
+        {
+          gpg_error_t err = gpg_error_from_syserror ();
+          ksba_certstore_release (store);
+          return err;
+        }
+    }
+  *r_store = store;
+  return 0;
+}
+
+
+/**
+ * ksba_certstore_release:
+ * @store: A certificate store
+ *
+ * Release the store and the references to its certificates.
+ **/
+void
+ksba_certstore_release (ksba_certstore_t store)
+{
+  struct certstore_item_s *item, *next;
+  enum certstore_index idx;
+  unsigned int n;
+
+  if (!store)
+    return;
+  if (store->table[CERTSTORE_IMAGE])
+    for (n=0; n < store->size; n++)
+      for (item = store->table[CERTSTORE_IMAGE][n]; item; item = next)
+        {
+          next = item->next[CERTSTORE_IMAGE];
+          ksba_cert_release (item->cert);
+          xfree (item);
+        }
+  for (idx=0; idx < CERTSTORE_NINDEXES; idx++)
+    xfree (store->table[idx]);
+  xfree (store);
+}
+
+
+/**
+ * ksba_certstore_add:
+ * @store: A certificate store
+ * @cert: An initialized certificate
+ *
+ * Add @cert to @store.  The store takes its own reference to @cert.
+ * GPG_ERR_DUP_VALUE is returned if the store already has a
+ * certificate with the same image.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_certstore_add (ksba_certstore_t store, ksba_cert_t cert)
+{
+  gpg_error_t err;
+  struct certstore_item_s *item;
+  struct tag_info ti;
+  const unsigned char *p;
+  size_t n;
+
+  if (!store || !cert)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  item = xtrycalloc (1, sizeof *item);
+  if (!item)
+    return gpg_error_from_syserror ();
+
+  item->key[CERTSTORE_IMAGE] = ksba_cert_get_image (cert,
+                                      &item->keylen[CERTSTORE_IMAGE]);
+  if (!item->key[CERTSTORE_IMAGE])
+    {
+      err = gpg_error (GPG_ERR_NO_DATA);
+      goto leave;
+    }
+  if (find_image (store, item->key[CERTSTORE_IMAGE],
+                  item->keylen[CERTSTORE_IMAGE], NULL))
+    {
+      err = gpg_error (GPG_ERR_DUP_VALUE);
+      goto leave;
+    }
+
+  err = _ksba_cert_get_subject_dn_ptr (cert, &item->key[CERTSTORE_SUBJECT],
+                                       &item->keylen[CERTSTORE_SUBJECT]);
+  if (!err)
+    err = _ksba_cert_get_issuer_dn_ptr (cert, &item->issuer,
+                                        &item->issuerlen);
+  if (!err)
+    err = _ksba_cert_get_serial_ptr (cert, &p, &n);
+  if (err)
+    goto leave;
+  /* Index only the value of the serial number.  */
+  err = _ksba_ber_parse_tl (&p, &n, &ti);
+  if (err)
+    goto leave;
+  if (ti.length > n)
+    {
+      err = gpg_error (GPG_ERR_BAD_BER);
+      goto leave;
+    }
+  item->key[CERTSTORE_SERIAL] = p;
+  item->keylen[CERTSTORE_SERIAL] = ti.length;
+
+  /* A certificate without a usable SKI is just not indexed by it.  */
+  if (ksba_cert_get_key_ids (cert, &item->key[CERTSTORE_SKI],
+                             &item->keylen[CERTSTORE_SKI], NULL, NULL))
+    item->key[CERTSTORE_SKI] = NULL;
+
+  item->hash[CERTSTORE_IMAGE] = hash_buffer (item->key[CERTSTORE_IMAGE],
+                                             item->keylen[CERTSTORE_IMAGE]);
+  item->hash[CERTSTORE_SUBJECT] = hash_buffer (item->key[CERTSTORE_SUBJECT],
+                                          item->keylen[CERTSTORE_SUBJECT]);
+  item->hash[CERTSTORE_SERIAL] = (hash_buffer (item->issuer, item->issuerlen)
+                                  ^ hash_buffer (item->key[CERTSTORE_SERIAL],
+                                           item->keylen[CERTSTORE_SERIAL]));
+  if (item->key[CERTSTORE_SKI])
+    item->hash[CERTSTORE_SKI] = hash_buffer (item->key[CERTSTORE_SKI],
+                                             item->keylen[CERTSTORE_SKI]);
+
+  if (store->limit)
+    shrink_store (store, store->limit);
+  if (store->count >= store->size)
+    {
+      err = grow_tables (store);
+      if (err)
+        goto leave;
+    }
+
+  ksba_cert_ref (cert);
+  item->cert = cert;
+  link_item (store, item);
+  lru_push (store, item);
+  store->count++;
+  item = NULL;
+
+ leave:
+  xfree (item);
+  return err;
+}
+
+
+/**
+ * ksba_certstore_remove:
+ * @store: A certificate store
+ * @cert: A certificate
+ *
+ * Remove the certificate with the same image as @cert from @store and
+ * release the reference of the store.  GPG_ERR_NOT_FOUND is returned
+ * if there is no such certificate.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_certstore_remove (ksba_certstore_t store, ksba_cert_t cert)
+{
+  struct certstore_item_s *item, **prev = NULL;
+  const unsigned char *image;
+  size_t imagelen;
+
+  if (!store || !cert)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  image = ksba_cert_get_image (cert, &imagelen);
+  if (!image)
+    return gpg_error (GPG_ERR_NO_DATA);
+  item = find_image (store, image, imagelen, &prev);
+  if (!item)
+    return gpg_error (GPG_ERR_NOT_FOUND);
+
+  remove_item (store, item, prev);
+  return 0;
+}
+
+
+/* Return the number of certificates in STORE.  */
+unsigned int
+ksba_certstore_count (ksba_certstore_t store)
+{
+  return store? store->count : 0;
+}
+
+
+/**
+ * ksba_certstore_set_limit:
+ * @store: A certificate store
+ * @limit: The maximum number of certificates or 0 for no limit
+ *
+ * Limit the number of certificates in @store to @limit.  If a
+ * certificate is added to a full store, the least recently used
+ * certificate is removed; a certificate counts as used when it is
+ * added or found by one of the ksba_certstore_find functions.  This
+ * allows to use a store as a cache, for example for the certificates
+ * of CMS objects (see ksba_cms_set_certstore).  If the store has
+ * already more certificates than @limit, the least recently used
+ * ones are removed right away.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_certstore_set_limit (ksba_certstore_t store, unsigned int limit)
+{
+  if (!store)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  store->limit = limit;
+  if (limit)
+    shrink_store (store, limit + 1);
+  return 0;
+}
+
+
+/* Store a new reference to the certificate of ITEM at R_CERT and mark
+   ITEM as the most recently used one of STORE.  */
+static gpg_error_t
+return_cert (ksba_certstore_t store, struct certstore_item_s *item,
+             ksba_cert_t *r_cert)
+{
+  if (!item)
+    return gpg_error (GPG_ERR_NOT_FOUND);
+  if (store->lru_first != item)
+    {
+      lru_unlink (store, item);
+      lru_push (store, item);
+    }
+  ksba_cert_ref (item->cert);
+  *r_cert = item->cert;
+  return 0;
+}
+
+
+/* Return the IDXth certificate whose key in the index WHICH matches
+   KEY of length KEYLEN.  */
+static gpg_error_t
+find_key (ksba_certstore_t store, enum certstore_index which,
+          const unsigned char *key, size_t keylen, int idx,
+          ksba_cert_t *r_cert)
+{
+  struct certstore_item_s *item;
+  unsigned int hash;
+
+  if (!r_cert)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_cert = NULL;
+  if (!store || !key || idx < 0)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  hash = hash_buffer (key, keylen);
+  for (item = store->table[which][hash & (store->size - 1)];
+       item; item = item->next[which])
+    if (key_matches (item, which, hash, key, keylen) && !idx--)
+      break;
+  return return_cert (store, item, r_cert);
+}
+
+
+/**
+ * ksba_certstore_find_subject:
+ * @store: A certificate store
+ * @dn: The DER encoded subject name
+ * @dnlen: The length of @dn
+ * @idx: The index of the match to return
+ * @r_cert: Receives the certificate
+ *
+ * Return the @idx-th certificate of @store with the subject @dn.
+ * The caller must release the returned certificate.
+ * GPG_ERR_NOT_FOUND is returned if there is no such certificate.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_certstore_find_subject (ksba_certstore_t store,
+                             const unsigned char *dn, size_t dnlen,
+                             int idx, ksba_cert_t *r_cert)
+{
+  return find_key (store, CERTSTORE_SUBJECT, dn, dnlen, idx, r_cert);
+}
+
+
+/**
+ * ksba_certstore_find_issuer:
+ * @store: A certificate store
+ * @cert: A certificate
+ * @idx: The index of the match to return
+ * @r_cert: Receives the certificate
+ *
+ * Return the @idx-th certificate of @store whose subject is the
+ * issuer of @cert.  The caller must release the returned
+ * certificate.  GPG_ERR_NOT_FOUND is returned if there is no such
+ * certificate.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_certstore_find_issuer (ksba_certstore_t store, ksba_cert_t cert,
+                            int idx, ksba_cert_t *r_cert)
+{
+  gpg_error_t err;
+  const unsigned char *dn;
+  size_t dnlen;
+
+  if (!r_cert || !cert)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_cert = NULL;
+  err = _ksba_cert_get_issuer_dn_ptr (cert, &dn, &dnlen);
+  if (err)
+    return err;
+  return find_key (store, CERTSTORE_SUBJECT, dn, dnlen, idx, r_cert);
+}
+
+
+/**
+ * ksba_certstore_find_serial:
+ * @store: A certificate store
+ * @issuer: The DER encoded issuer name
+ * @issuerlen: The length of @issuer
+ * @serial: The value of the serial number
+ * @seriallen: The length of @serial
+ * @r_cert: Receives the certificate
+ *
+ * Return the certificate of @store with the issuer @issuer and the
+ * serial number @serial.  @serial are the octets of the DER encoded
+ * INTEGER as found in the S-expression returned by
+ * ksba_cert_get_serial.  The caller must release the returned
+ * certificate.  GPG_ERR_NOT_FOUND is returned if there is no such
+ * certificate.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_certstore_find_serial (ksba_certstore_t store,
+                            const unsigned char *issuer, size_t issuerlen,
+                            const unsigned char *serial, size_t seriallen,
+                            ksba_cert_t *r_cert)
+{
+  struct certstore_item_s *item;
+  unsigned int hash;
+
+  if (!r_cert)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_cert = NULL;
+  if (!store || !issuer || !serial)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  hash = hash_buffer (issuer, issuerlen) ^ hash_buffer (serial, seriallen);
+  for (item = store->table[CERTSTORE_SERIAL][hash & (store->size - 1)];
+       item; item = item->next[CERTSTORE_SERIAL])
+    if (key_matches (item, CERTSTORE_SERIAL, hash, serial, seriallen)
+        && item->issuerlen == issuerlen
+        && !memcmp (item->issuer, issuer, issuerlen))
+      break;
+  return return_cert (store, item, r_cert);
+}
+
+
+/**
+ * ksba_certstore_find_ski:
+ * @store: A certificate store
+ * @keyid: The subject key identifier
+ * @keyidlen: The length of @keyid
+ * @idx: The index of the match to return
+ * @r_cert: Receives the certificate
+ *
+ * Return the @idx-th certificate of @store with the subject key
+ * identifier @keyid, as returned by ksba_cert_get_key_ids.  The
+ * caller must release the returned certificate.  GPG_ERR_NOT_FOUND
+ * is returned if there is no such certificate.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_certstore_find_ski (ksba_certstore_t store,
+                         const unsigned char *keyid, size_t keyidlen,
+                         int idx, ksba_cert_t *r_cert)
+{
+  return find_key (store, CERTSTORE_SKI, keyid, keyidlen, idx, r_cert);
+}
+
+
+/**
+ * ksba_certstore_find_image:
+ * @store: A certificate store
+ * @image: The DER encoded certificate
+ * @imagelen: The length of @image
+ * @r_cert: Receives the certificate
+ *
+ * Return the certificate of @store with the image @image.  The caller
+ * must release the returned certificate.  GPG_ERR_NOT_FOUND is
+ * returned if there is no such certificate.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_certstore_find_image (ksba_certstore_t store,
+                           const void *image, size_t imagelen,
+                           ksba_cert_t *r_cert)
+{
+  if (!r_cert)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_cert = NULL;
+  if (!store || !image)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  return return_cert (store, find_image (store, image, imagelen, NULL),
+                      r_cert);
+}
+
+
+
+/* The process-wide certificate cache used by the CMS parser for
+   objects without their own store (see ksba_cms_set_cert_cache_limit)
+   and the lock protecting it.  The cache and its certificates outlive
+   the objects which put them there, thus they are allocated with the
+   global allocator.  */
+static ksba_certstore_t cert_cache;
+static gpgrt_lock_t cert_cache_lock = GPGRT_LOCK_INITIALIZER;
+
+
+/* Release function for the image of a certificate in the cache.  */
+static void
+release_cache_image (void *opaque)
+{
+  xfree (opaque);
+}
+
+
+/* Set the limit of the process-wide cache to LIMIT.  The cache is
+   created as needed; a LIMIT of 0 releases it.  */
+gpg_error_t
+_ksba_certstore_set_cache_limit (unsigned int limit)
+{
+  gpg_error_t err = 0;
+  ksba_certstore_t store = NULL;
+  ksba_alloc_ctx_t prevctx;
+
+  prevctx = _ksba_alloc_ctx_switch (NULL);
+  gpgrt_lock_lock (&cert_cache_lock);
+  if (!limit)
+    {
+      store = cert_cache;
+      atomic_store_rel (&cert_cache, NULL);
+    }
+  else if (!cert_cache)
+    {
+      err = ksba_certstore_new (&store);
+      if (!err)
+        err = ksba_certstore_set_limit (store, limit);
+      if (!err)
+        {
+          atomic_store_rel (&cert_cache, store);
+          store = NULL;
+        }
+    }
+  else
+    err = ksba_certstore_set_limit (cert_cache, limit);
+  gpgrt_lock_unlock (&cert_cache_lock);
+  /* Certificates still used by CMS objects keep their references.  */
+  ksba_certstore_release (store);
+  _ksba_alloc_ctx_restore (prevctx);
+  return err;
+}
+
+
+/* Return true if the process-wide cache is enabled.  */
+int
+_ksba_certstore_cache_enabled (void)
+{
+  return !!atomic_load_acq (&cert_cache);
+}
+
+
+/* Store at R_CERT a new reference to the certificate of the
+   process-wide cache with the image IMAGE of length IMAGELEN.  If the
+   cache has no such certificate, it is decoded from a copy of IMAGE
+   and added.  GPG_ERR_NOT_ENABLED is returned if there is no cache.  */
+gpg_error_t
+_ksba_certstore_cache_get (const unsigned char *image, size_t imagelen,
+                           ksba_cert_t *r_cert)
+{
+  gpg_error_t err;
+  ksba_cert_t cert = NULL;
+  unsigned char *copy = NULL;
+  ksba_alloc_ctx_t prevctx;
+
+  *r_cert = NULL;
+  prevctx = _ksba_alloc_ctx_switch (NULL);
+
+  gpgrt_lock_lock (&cert_cache_lock);
+  if (!cert_cache)
+    err = gpg_error (GPG_ERR_NOT_ENABLED);
+  else
+    err = ksba_certstore_find_image (cert_cache, image, imagelen, r_cert);
+  gpgrt_lock_unlock (&cert_cache_lock);
+  if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    goto leave;
+
+  /* Decode the new certificate without holding the lock.  */
+  copy = xtrymalloc (imagelen);
+  if (!copy)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  memcpy (copy, image, imagelen);
+  err = ksba_cert_new (&cert);
+  if (err)
+    goto leave;
+  err = ksba_cert_init_from_mem_ref (cert, copy, imagelen,
+                                     release_cache_image, copy);
+  if (err)
+    goto leave;
+  copy = NULL;
+
+  gpgrt_lock_lock (&cert_cache_lock);
+  if (cert_cache)
+    {
+      err = ksba_certstore_add (cert_cache, cert);
+      if (gpg_err_code (err) == GPG_ERR_DUP_VALUE)
+        {
+          /* Another thread added it meanwhile; use that one.  */
+          ksba_cert_release (cert);
+          cert = NULL;
+          err = ksba_certstore_find_image (cert_cache, image, imagelen,
+                                           &cert);
+        }
+    }
+  /* else: The cache has been disabled meanwhile; return CERT anyway.  */
+  gpgrt_lock_unlock (&cert_cache_lock);
+  if (!err)
+    {
+      *r_cert = cert;
+      cert = NULL;
+    }
+
+ leave:
+  ksba_cert_release (cert);
+  xfree (copy);
+  _ksba_alloc_ctx_restore (prevctx);
+  return err;
+}
@@ -0,0 +1,81 @@
+/* certstore.h - Internal definitions for the certificate store
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * KSBA is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copies of the GNU General Public License
+ * and the GNU Lesser General Public License along with this program;
+ * if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTSTORE_H
+#define CERTSTORE_H 1
+
+#include "ksba.h"
+
+/* The indexes of a store.  */
+enum certstore_index
+  {
+    CERTSTORE_IMAGE = 0,    /* The entire certificate.  */
+    CERTSTORE_SUBJECT,      /* The DER encoded subject.  */
+    CERTSTORE_SERIAL,       /* The serial number along with the issuer.  */
+    CERTSTORE_SKI,          /* The subject key identifier.  */
+    CERTSTORE_NINDEXES
+  };
+
+
+/* A certificate in a store.  The keys point into the image of the
+   certificate.  */
+struct certstore_item_s
+{
+  ksba_cert_t cert;
+  struct certstore_item_s *next[CERTSTORE_NINDEXES];
+  unsigned int hash[CERTSTORE_NINDEXES];
+  const unsigned char *key[CERTSTORE_NINDEXES];  /* NULL if not indexed.  */
+  size_t keylen[CERTSTORE_NINDEXES];
+  const unsigned char *issuer;  /* The DER encoded issuer.  */
+  size_t issuerlen;
+  struct certstore_item_s *lru_prev;  /* The next more recently used.  */
+  struct certstore_item_s *lru_next;  /* The next less recently used.  */
+};
+
+
+struct ksba_certstore_s
+{
+  unsigned int count;  /* Number of certificates.  */
+  unsigned int size;   /* Number of buckets of each table; a power of 2.  */
+  unsigned int limit;  /* Maximum number of certificates or 0.  */
+  struct certstore_item_s **table[CERTSTORE_NINDEXES];
+  struct certstore_item_s *lru_first;  /* The most recently used.  */
+  struct certstore_item_s *lru_last;   /* The least recently used.  */
+};
+
+
+/*-- certstore.c --*/
+gpg_error_t _ksba_certstore_set_cache_limit (unsigned int limit);
+int _ksba_certstore_cache_enabled (void);
+gpg_error_t _ksba_certstore_cache_get (const unsigned char *image,
+                                       size_t imagelen, ksba_cert_t *r_cert);
+
+
+#endif /*CERTSTORE_H*/
@@ -47,8 +47,10 @@
 #include "cms.h"
 #include "asn1-func.h" /* need some constants */
 #include "ber-decoder.h"
+#include "reader.h"
 #include "ber-help.h"
 #include "keyinfo.h"
+#include "certstore.h"
 
 static int
 read_byte (ksba_reader_t reader)
@@ -94,33 +96,25 @@ create_and_run_decoder (ksba_reader_t reader, const char *elem_name,
   if (err)
     return err;
 
-  decoder = _ksba_ber_decoder_new ();
+  decoder = _ksba_reader_get_decoder (reader);
   if (!decoder)
     {
       ksba_asn_tree_release (cms_tree);
       return gpg_error (GPG_ERR_ENOMEM);
     }
 
-  err = _ksba_ber_decoder_set_reader (decoder, reader);
-  if (err)
-    {
-      ksba_asn_tree_release (cms_tree);
-      _ksba_ber_decoder_release (decoder);
-      return err;
-    }
-
   err = _ksba_ber_decoder_set_module (decoder, cms_tree);
   if (err)
     {
       ksba_asn_tree_release (cms_tree);
-      _ksba_ber_decoder_release (decoder);
+      _ksba_reader_put_decoder (reader, decoder);
       return err;
     }
 
   err = _ksba_ber_decoder_decode (decoder, elem_name, flags,
                                   r_root, r_image, r_imagelen);
 
-  _ksba_ber_decoder_release (decoder);
+  _ksba_reader_put_decoder (reader, decoder);
   ksba_asn_tree_release (cms_tree);
   return err;
 }
@@ -265,8 +259,6 @@ parse_encrypted_content_info (ksba_reader_t reader,
   size_t nread;
   int algo_parmtype;
 
-  /* Fixme: release oids in case of errors */
-
   /* read the sequence triplet */
   err = _ksba_ber_read_tl (reader, &ti);
   if (err)
@@ -307,35 +299,50 @@ parse_encrypted_content_info (ksba_reader_t reader,
   /* read the algorithmIdentifier */
   err = _ksba_ber_read_tl (reader, &ti);
   if (err)
-    return err;
+    goto leave;
   if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_SEQUENCE
          && ti.is_constructed) )
-    return gpg_error (GPG_ERR_INV_CMS_OBJ);
+    {
+      err = gpg_error (GPG_ERR_INV_CMS_OBJ);
+      goto leave;
+    }
   if (!content_ndef)
     {
       if (content_len < ti.nhdr)
-        return gpg_error (GPG_ERR_BAD_BER); /* triplet header larger that sequence */
+        {
+          err = gpg_error (GPG_ERR_BAD_BER); /* triplet header larger that sequence */
+          goto leave;
+        }
       content_len -= ti.nhdr;
       if (content_len < ti.length)
-        return gpg_error (GPG_ERR_BAD_BER); /* triplet larger that sequence */
+        {
+          err = gpg_error (GPG_ERR_BAD_BER); /* triplet larger that sequence */
+          goto leave;
+        }
       content_len -= ti.length;
     }
   if (ti.nhdr + ti.length >= DIM(tmpbuf))
-    return gpg_error (GPG_ERR_TOO_LARGE);
+    {
+      err = gpg_error (GPG_ERR_TOO_LARGE);
+      goto leave;
+    }
   memcpy (tmpbuf, ti.buf, ti.nhdr);
   err = read_buffer (reader, tmpbuf+ti.nhdr, ti.length);
   if (err)
-    return err;
+    goto leave;
   err = _ksba_parse_algorithm_identifier3 (tmpbuf, ti.nhdr+ti.length,
                                            0x30,
                                            &nread, &algo_oid,
                                            &algo_parm, &algo_parmlen,
                                            &algo_parmtype);
   if (err)
-    return err;
+    goto leave;
   assert (nread <= ti.nhdr + ti.length);
   if (nread < ti.nhdr + ti.length)
-    return gpg_error (GPG_ERR_TOO_SHORT);
+    {
+      err = gpg_error (GPG_ERR_TOO_SHORT);
+      goto leave;
+    }
 
   /* the optional encryptedDataInfo */
   *has_content = 0;
@@ -345,11 +352,7 @@ parse_encrypted_content_info (ksba_reader_t reader,
          may be the end tag */
       err = _ksba_ber_read_tl (reader, &ti);
       if (err)
-        {
-          xfree (cont_oid);
-          xfree (algo_oid);
-          return err;
-        }
+        goto leave;
 
       /* Note: the tag may either denote a constructed or a primitve
          object.  Actually this should match the use of NDEF header
@@ -360,10 +363,16 @@ parse_encrypted_content_info (ksba_reader_t reader,
           if (!content_ndef)
             {
               if (content_len < ti.nhdr)
-                return gpg_error (GPG_ERR_BAD_BER);
+                {
+                  err = gpg_error (GPG_ERR_BAD_BER);
+                  goto leave;
+                }
               content_len -= ti.nhdr;
               if (!ti.ndef && content_len < ti.length)
-                return gpg_error (GPG_ERR_BAD_BER);
+                {
+                  err = gpg_error (GPG_ERR_BAD_BER);
+                  goto leave;
+                }
             }
         }
       else /* not what we want - push it back */
@@ -371,7 +380,7 @@ parse_encrypted_content_info (ksba_reader_t reader,
           *has_content = 0;
           err = ksba_reader_unread (reader, ti.buf, ti.nhdr);
           if (err)
-            return err;
+            goto leave;
         }
     }
   *r_len = content_len;
@@ -382,6 +391,12 @@ parse_encrypted_content_info (ksba_reader_t reader,
   *r_algo_parmlen = algo_parmlen;
   *r_algo_parmtype = algo_parmtype;
   return 0;
+
+ leave:
+  xfree (cont_oid);
+  xfree (algo_oid);
+  xfree (algo_parm);
+  return err;
 }
 
 
@@ -611,6 +626,110 @@ _ksba_cms_parse_signed_data_part_1 (ksba_cms_t cms)
   return 0;
 }
 
+/* Release function for an image of a certificate read by
+   read_cert.  */
+static void
+release_cert_image (void *opaque)
+{
+  xfree (opaque);
+}
+
+
+/* Read a certificate from READER.  TI is the already read header of
+   the certificate.  If STORE is not NULL a certificate of STORE with
+   the same image is returned and a new certificate is added to
+   STORE.  Without a STORE the process-wide cache is used the same
+   way if it has been enabled.  */
+static gpg_error_t
+read_cert (ksba_reader_t reader, struct tag_info *ti,
+           ksba_certstore_t store, ksba_cert_t *r_cert)
+{
+  gpg_error_t err;
+  ksba_cert_t cert;
+  unsigned char *image;
+  size_t imagelen, n, nread;
+
+  *r_cert = NULL;
+  if (ti->ndef || (!store && !_ksba_certstore_cache_enabled ()))
+    {
+      /* We must unread so that the standard parser sees the sequence */
+      err = ksba_reader_unread (reader, ti->buf, ti->nhdr);
+      if (err)
+        return err;
+      /* Use the standard certificate parser */
+      err = ksba_cert_new (&cert);
+      if (err)
+        return err;
+      err = ksba_cert_read_der (cert, reader);
+      if (err)
+        {
+          ksba_cert_release (cert);
+          return err;
+        }
+      *r_cert = cert;
+      return 0;
+    }
+
+  imagelen = ti->nhdr + ti->length;
+  image = xtrymalloc (imagelen);
+  if (!image)
+    return gpg_error_from_syserror ();
+  memcpy (image, ti->buf, ti->nhdr);
+  for (n = ti->nhdr; n < imagelen; n += nread)
+    {
+      err = ksba_reader_read (reader, image + n, imagelen - n, &nread);
+      if (err)
+        {
+          xfree (image);
+          return err;
+        }
+    }
+
+  if (!store)
+    {
+      /* If the cache has been disabled meanwhile, the certificate is
+         decoded below.  */
+      err = _ksba_certstore_cache_get (image, imagelen, r_cert);
+      if (gpg_err_code (err) != GPG_ERR_NOT_ENABLED)
+        {
+          xfree (image);
+          return err;
+        }
+    }
+  else if (!ksba_certstore_find_image (store, image, imagelen, r_cert))
+    {
+      xfree (image);
+      return 0;
+    }
+
+  err = ksba_cert_new (&cert);
+  if (err)
+    {
+      xfree (image);
+      return err;
+    }
+  err = ksba_cert_init_from_mem_ref (cert, image, imagelen,
+                                     release_cert_image, image);
+  if (err)
+    {
+      xfree (image);
+      ksba_cert_release (cert);
+      return err;
+    }
+  if (store)
+    {
+      err = ksba_certstore_add (store, cert);
+      if (err)
+        {
+          ksba_cert_release (cert);
+          return err;
+        }
+    }
+  *r_cert = cert;
+  return 0;
+}
+
+
 /* Continue parsing of the structure we started to parse with the
    part_1 function.  We expect to be right at the certificates tag.  */
 gpg_error_t
@@ -670,20 +789,9 @@ _ksba_cms_parse_signed_data_part_2 (ksba_cms_t cms)
                 && ti.is_constructed))
             break; /* not a sequence, so we are ready with the set */
 
-          /* We must unread so that the standard parser sees the sequence */
-          err = ksba_reader_unread (cms->reader, ti.buf, ti.nhdr);
-          if (err)
-            return err;
-          /* Use the standard certificate parser */
-          err = ksba_cert_new (&cert);
+          err = read_cert (cms->reader, &ti, cms->certstore, &cert);
           if (err)
             return err;
-          err = ksba_cert_read_der (cert, cms->reader);
-          if (err)
-            {
-              ksba_cert_release (cert);
-              return err;
-            }
           cl = xtrycalloc (1, sizeof *cl);
           if (!cl)
             {
@@ -47,6 +47,7 @@
 #include "util.h"
 
 #include "cms.h"
+#include "reader.h"
 #include "convert.h"
 #include "keyinfo.h"
 #include "der-encoder.h"
@@ -55,6 +56,11 @@
 #include "cert.h"
 #include "der-builder.h"
 #include "stringbuf.h"
+#include "certstore.h"
+
+/* Size of the buffer used to copy the content if the reader can't
+   hand out its own buffer.  */
+#define COPY_BUFFER_SIZE 65536
 
 static gpg_error_t ct_parse_data (ksba_cms_t cms);
 static gpg_error_t ct_parse_signed_data (ksba_cms_t cms);
@@ -177,25 +183,103 @@ log_sexp (const char *text, ksba_const_sexp_t p)
 #endif /* debug helper */
 
 
-/* Helper for read_and_hash_cont().  */
+/* States of the content copy loop.  */
+enum {
+  CONT_START = 0,
+  CONT_CHUNK,         /* Expecting the next chunk of a ndef content.  */
+  CONT_CHUNK_DATA,    /* Copying a primitive chunk.  */
+  CONT_PART,          /* Expecting the next part of a constructed chunk. */
+  CONT_PART_DATA,     /* Copying a primitive part of a chunk.  */
+  CONT_RAW            /* Copying the remaining bytes.  */
+};
+
+
+/* Read a tag and length from the CMS reader.  With a non-blocking
+   reader which ran out of data the reader is set back and
+   GPG_ERR_EAGAIN is returned so that this function may simply be
+   called again.  */
 static gpg_error_t
-read_hash_block (ksba_cms_t cms, unsigned long nleft)
+read_cont_tl (ksba_cms_t cms, struct tag_info *ti)
 {
   gpg_error_t err;
-  char buffer[4096];
+  int marked;
+
+  marked = _ksba_reader_mark (cms->reader);
+  err = _ksba_ber_read_tl (cms->reader, ti);
+  if (marked)
+    {
+      if (err && _ksba_reader_would_block (cms->reader)
+          && !_ksba_reader_rewind (cms->reader))
+        return gpg_error (GPG_ERR_EAGAIN);
+      _ksba_reader_unmark (cms->reader);
+    }
+  return err;
+}
+
+
+/* Pass the LENGTH bytes at BUFFER to all hash functions of CMS.  */
+static void
+hash_cont (ksba_cms_t cms, const void *buffer, size_t length)
+{
+  struct hash_fnc_list_s *h;
+
+  STATS_ADD (hash_bytes, length);
+  if (cms->hash_fnc)
+    cms->hash_fnc (cms->hash_fnc_arg, buffer, length);
+  for (h = cms->more_hash_fncs; h; h = h->next)
+    h->fnc (h->arg, buffer, length);
+}
+
+
+/* Pass the LENGTH bytes at BUFFER to the writer of CMS and, if HASH
+   is set, to its hash functions.  */
+static gpg_error_t
+put_cont (ksba_cms_t cms, int hash, const void *buffer, size_t length)
+{
+  if (hash)
+    hash_cont (cms, buffer, length);
+  return cms->writer? ksba_writer_write (cms->writer, buffer, length) : 0;
+}
+
+
+/* Helper for copy_cont().  Copy CMS->CONT.NLEFT bytes from the reader
+   to the writer and hash them if HASH is set.  */
+static gpg_error_t
+copy_block (ksba_cms_t cms, int hash)
+{
+  gpg_error_t err;
+  const unsigned char *p;
   size_t n, nread;
 
-  while (nleft)
+  while (cms->cont.nleft)
     {
-      n = nleft < sizeof (buffer)? nleft : sizeof (buffer);
-      err = ksba_reader_read (cms->reader, buffer, n, &nread);
+      /* If the reader can hand out its buffer directly we hash and
+         write straight from it and avoid the bounce through BUFFER.  */
+      if (!ksba_reader_peek (cms->reader, &p, &n))
+        {
+          if (n > cms->cont.nleft)
+            n = cms->cont.nleft;
+          err = put_cont (cms, hash, p, n);
+          if (!err)
+            err = ksba_reader_consume (cms->reader, n);
+          if (err)
+            return err;
+          cms->cont.nleft -= n;
+          continue;
+        }
+      if (!cms->cont.buffer)
+        {
+          cms->cont.buffer = xtrymalloc (COPY_BUFFER_SIZE);
+          if (!cms->cont.buffer)
+            return gpg_error_from_syserror ();
+        }
+      n = cms->cont.nleft < COPY_BUFFER_SIZE? cms->cont.nleft
+                                             : COPY_BUFFER_SIZE;
+      err = ksba_reader_read (cms->reader, cms->cont.buffer, n, &nread);
       if (err)
         return err;
-      nleft -= nread;
-      if (cms->hash_fnc)
-        cms->hash_fnc (cms->hash_fnc_arg, buffer, nread);
-      if (cms->writer)
-        err = ksba_writer_write (cms->writer, buffer, nread);
+      cms->cont.nleft -= nread;
+      err = put_cont (cms, hash, cms->cont.buffer, nread);
       if (err)
         return err;
     }
@@ -203,217 +287,240 @@ read_hash_block (ksba_cms_t cms, unsigned long nleft)
 }
 
 
-/* Copy all the bytes from the reader to the writer and hash them if a
-   a hash function has been set.  The writer may be NULL to just do
-   the hashing */
+/* Helper for copy_cont().  Fast path for the chunks of an indefinite
+   length content: If the reader can hand out its buffer, the chunks
+   found completely in that buffer are parsed right there.  Their
+   payloads are collected and passed to the writer and the hash
+   functions in large blocks.  Streaming signers often use chunks of
+   only 1000 bytes and reading each header with _ksba_ber_read_tl
+   would dominate the run time.  Anything not handled here, like a
+   chunk crossing the end of the buffer, is left to copy_cont.  */
 static gpg_error_t
-read_and_hash_cont (ksba_cms_t cms)
+scan_chunks (ksba_cms_t cms, int hash)
 {
-  gpg_error_t err = 0;
-  unsigned long nleft;
-  struct tag_info ti;
+  gpg_error_t err;
+  const unsigned char *p, *chunk;
+  size_t n, off, hdr, len, used;
+  int i, k;
 
-  if (cms->inner_cont_ndef)
-    {
-      for (;;)
-        {
-          err = _ksba_ber_read_tl (cms->reader, &ti);
-          if (err)
-            return err;
+  if (ksba_reader_peek (cms->reader, &p, &n))
+    return 0;
 
-          if (ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING
-              && !ti.is_constructed)
-            { /* next chunk */
-              nleft = ti.length;
-              err = read_hash_block (cms, nleft);
-              if (err)
-                return err;
-            }
-          else if (ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING
-                   && ti.is_constructed)
-            { /* next chunk is constructed */
-              for (;;)
-                {
-                  err = _ksba_ber_read_tl (cms->reader, &ti);
-                  if (err)
-                    return err;
-                  if (ti.class == CLASS_UNIVERSAL
-                      && ti.tag == TYPE_OCTET_STRING
-                      && !ti.is_constructed)
-                    {
-                      nleft = ti.length;
-                      err = read_hash_block (cms, nleft);
-                      if (err)
-                        return err;
-                    }
-                  else if (ti.class == CLASS_UNIVERSAL && !ti.tag
-                           && !ti.is_constructed)
-                    break; /* ready with this chunk */
-                  else
-                    return gpg_error (GPG_ERR_ENCODING_PROBLEM);
-                }
-            }
-          else if (ti.class == CLASS_UNIVERSAL && !ti.tag
-                   && !ti.is_constructed)
-            return 0; /* ready */
-          else
-            return gpg_error (GPG_ERR_ENCODING_PROBLEM);
-        }
+  if (!cms->cont.buffer)
+    {
+      cms->cont.buffer = xtrymalloc (COPY_BUFFER_SIZE);
+      if (!cms->cont.buffer)
+        return gpg_error_from_syserror ();
     }
-  else
+
+  used = 0;
+  for (off = 0; n - off >= 2; off += hdr + len)
     {
-      /* This is basically the same as above but we allow for
-         arbitrary types.  Not sure whether it is really needed but
-         right in the beginning of gnupg 1.9 we had at least one
-         message with didn't used octet strings.  Not ethat we don't
-         do proper NLEFT checking but well why should we validate
-         these things?  Well, it might be nice to have such a feature
-         but then we should write a more general mechanism to do
-         that.  */
-      nleft = cms->inner_cont_len;
-      /* First read the octet string but allow all types here */
-      err = _ksba_ber_read_tl (cms->reader, &ti);
-      if (err)
-        return err;
-      if (nleft < ti.nhdr)
-        return gpg_error (GPG_ERR_ENCODING_PROBLEM);
-      nleft -= ti.nhdr;
-
-      if (ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING
-          && ti.is_constructed)
-        { /* Next chunk is constructed */
-          for (;;)
-            {
-              err = _ksba_ber_read_tl (cms->reader, &ti);
-              if (err)
-                return err;
-              if (ti.class == CLASS_UNIVERSAL
-                  && ti.tag == TYPE_OCTET_STRING
-                  && !ti.is_constructed)
-                {
-                  nleft = ti.length;
-                  err = read_hash_block (cms, nleft);
-                  if (err)
-                    return err;
-                }
-              else if (ti.class == CLASS_UNIVERSAL && !ti.tag
-                       && !ti.is_constructed)
-                break; /* Ready with this chunk */
-              else
-                return gpg_error (GPG_ERR_ENCODING_PROBLEM);
-            }
+      chunk = p + off;
+      hdr = 2;
+      len = 0;
+      if (chunk[0] == 0x24 && chunk[1] == 0x80
+          && cms->cont.state == CONT_CHUNK)
+        { /* A constructed chunk.  */
+          cms->cont.state = CONT_PART;
+          continue;
+        }
+      if (!chunk[0] && !chunk[1]
+          && cms->cont.state == CONT_PART && cms->inner_cont_ndef)
+        { /* End of a constructed chunk.  */
+          cms->cont.state = CONT_CHUNK;
+          continue;
+        }
+      if (chunk[0] != 0x04)
+        break;  /* Not a primitive octet string.  */
+      if ((chunk[1] & 0x80))
+        {
+          k = chunk[1] & 0x7f;
+          if (!k || k > 4 || n - off < 2 + k)
+            break;
+          for (i=0; i < k; i++)
+            len = (len << 8) | chunk[2+i];
+          hdr += k;
         }
-      else if (ti.class == CLASS_UNIVERSAL && !ti.tag
-               && !ti.is_constructed)
-        return 0; /* ready */
       else
+        len = chunk[1];
+      if (len > n - off - hdr)
+        break;  /* Not completely in the buffer.  */
+
+      if (used && (len >= COPY_BUFFER_SIZE / 4
+                   || len > COPY_BUFFER_SIZE - used))
+        {
+          err = put_cont (cms, hash, cms->cont.buffer, used);
+          if (err)
+            return err;
+          used = 0;
+        }
+      if (len >= COPY_BUFFER_SIZE / 4)
         {
-          err = read_hash_block (cms, nleft);
+          err = put_cont (cms, hash, chunk + hdr, len);
           if (err)
             return err;
         }
+      else
+        {
+          memcpy (cms->cont.buffer + used, chunk + hdr, len);
+          used += len;
+        }
     }
-  return 0;
-}
 
+  if (used)
+    {
+      err = put_cont (cms, hash, cms->cont.buffer, used);
+      if (err)
+        return err;
+    }
+  return off? ksba_reader_consume (cms->reader, off) : 0;
+}
 
 
-/* Copy all the encrypted bytes from the reader to the writer.
-   Handles indefinite length encoding */
+/* Copy all the bytes of the inner content from the reader to the
+   writer and hash them if HASH is set and a hash function has been
+   set.  The writer may be NULL to just do the hashing.  Indefinite
+   length encoding is handled.  With a definite length the content is
+   expected to be wrapped into a tag unless DEFINITE_RAW is set in which
+   case the content bytes are copied verbatim.  If the reader would
+   block GPG_ERR_EAGAIN is returned and the function may be called
+   again later to continue where it stopped.  */
 static gpg_error_t
-read_encrypted_cont (ksba_cms_t cms)
+copy_cont (ksba_cms_t cms, int hash, int definite_raw)
 {
-  gpg_error_t err = 0;
-  unsigned long nleft;
-  char buffer[4096];
-  size_t n, nread;
+  gpg_error_t err;
+  struct tag_info ti;
 
-  if (cms->inner_cont_ndef)
+  for (;;)
     {
-      struct tag_info ti;
+      if (cms->cont.state == CONT_CHUNK || cms->cont.state == CONT_PART)
+        {
+          err = scan_chunks (cms, hash);
+          if (err)
+            return err;
+        }
 
-      /* fixme: this ist mostly a duplicate of the code in
-         read_and_hash_cont(). */
-      for (;;)
+      switch (cms->cont.state)
         {
-          err = _ksba_ber_read_tl (cms->reader, &ti);
+        case CONT_START:
+          if (cms->inner_cont_ndef)
+            {
+              cms->cont.state = CONT_CHUNK;
+              break;
+            }
+          cms->cont.nleft = cms->inner_cont_len;
+          if (definite_raw)
+            {
+              cms->cont.state = CONT_RAW;
+              break;
+            }
+          /* For definite length encoded data we allow for arbitrary
+             types.  Not sure whether it is really needed but right in
+             the beginning of gnupg 1.9 we had at least one message
+             which didn't used octet strings.  */
+          err = read_cont_tl (cms, &ti);
           if (err)
             return err;
+          if (cms->cont.nleft < ti.nhdr)
+            return gpg_error (GPG_ERR_ENCODING_PROBLEM);
+          cms->cont.nleft -= ti.nhdr;
 
+          if (ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING
+              && ti.is_constructed)
+            cms->cont.state = CONT_PART; /* Next chunk is constructed.  */
+          else if (ti.class == CLASS_UNIVERSAL && !ti.tag
+                   && !ti.is_constructed)
+            goto ready;
+          else
+            cms->cont.state = CONT_RAW;
+          break;
+
+        case CONT_CHUNK:
+          err = read_cont_tl (cms, &ti);
+          if (err)
+            return err;
           if (ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING
               && !ti.is_constructed)
-            { /* next chunk */
-              nleft = ti.length;
-              while (nleft)
-                {
-                  n = nleft < sizeof (buffer)? nleft : sizeof (buffer);
-                  err = ksba_reader_read (cms->reader, buffer, n, &nread);
-                  if (err)
-                    return err;
-                  nleft -= nread;
-                  err = ksba_writer_write (cms->writer, buffer, nread);
-                  if (err)
-                    return err;
-                }
+            { /* Next chunk.  */
+              cms->cont.nleft = ti.length;
+              cms->cont.state = CONT_CHUNK_DATA;
             }
           else if (ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING
                    && ti.is_constructed)
-            { /* next chunk is constructed */
-              for (;;)
-                {
-                  err = _ksba_ber_read_tl (cms->reader, &ti);
-                  if (err)
-                    return err;
-                  if (ti.class == CLASS_UNIVERSAL
-                      && ti.tag == TYPE_OCTET_STRING
-                      && !ti.is_constructed)
-                    {
-                      nleft = ti.length;
-                      while (nleft)
-                        {
-                          n = nleft < sizeof (buffer)? nleft : sizeof (buffer);
-                          err = ksba_reader_read (cms->reader, buffer, n, &nread);
-                          if (err)
-                            return err;
-                          nleft -= nread;
-                          if (cms->writer)
-                            err = ksba_writer_write (cms->writer, buffer, nread);
-                          if (err)
-                            return err;
-                        }
-                    }
-                  else if (ti.class == CLASS_UNIVERSAL && !ti.tag
-                           && !ti.is_constructed)
-                    break; /* ready with this chunk */
-                  else
-                    return gpg_error (GPG_ERR_ENCODING_PROBLEM);
-                }
-            }
+            cms->cont.state = CONT_PART; /* Next chunk is constructed.  */
           else if (ti.class == CLASS_UNIVERSAL && !ti.tag
                    && !ti.is_constructed)
-            return 0; /* ready */
+            goto ready;
           else
             return gpg_error (GPG_ERR_ENCODING_PROBLEM);
-        }
-    }
-  else
-    {
-      nleft = cms->inner_cont_len;
-      while (nleft)
-        {
-          n = nleft < sizeof (buffer)? nleft : sizeof (buffer);
-          err = ksba_reader_read (cms->reader, buffer, n, &nread);
+          break;
+
+        case CONT_CHUNK_DATA:
+        case CONT_PART_DATA:
+          err = copy_block (cms, hash);
+          if (err)
+            return err;
+          cms->cont.state = cms->cont.state == CONT_CHUNK_DATA? CONT_CHUNK
+                                                              : CONT_PART;
+          break;
+
+        case CONT_PART:
+          err = read_cont_tl (cms, &ti);
           if (err)
             return err;
-          nleft -= nread;
-          err = ksba_writer_write (cms->writer, buffer, nread);
+          if (ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING
+              && !ti.is_constructed)
+            {
+              cms->cont.nleft = ti.length;
+              cms->cont.state = CONT_PART_DATA;
+            }
+          else if (ti.class == CLASS_UNIVERSAL && !ti.tag
+                   && !ti.is_constructed)
+            { /* Ready with this chunk.  */
+              if (!cms->inner_cont_ndef)
+                goto ready;
+              cms->cont.state = CONT_CHUNK;
+            }
+          else
+            return gpg_error (GPG_ERR_ENCODING_PROBLEM);
+          break;
+
+        case CONT_RAW:
+          err = copy_block (cms, hash);
           if (err)
             return err;
+          goto ready;
+
+        default:
+          return gpg_error (GPG_ERR_BUG);
         }
     }
+
+ ready:
+  cms->cont.state = CONT_START;
   return 0;
 }
 
+
+/* Copy all the bytes from the reader to the writer and hash them if a
+   a hash function has been set.  The writer may be NULL to just do
+   the hashing */
+static gpg_error_t
+read_and_hash_cont (ksba_cms_t cms)
+{
+  return copy_cont (cms, 1, 0);
+}
+
+
+/* Copy all the encrypted bytes from the reader to the writer.
+   Handles indefinite length encoding */
+static gpg_error_t
+read_encrypted_cont (ksba_cms_t cms)
+{
+  return copy_cont (cms, 0, 1);
+}
+
 /* copy data from reader to writer.  Assume that it is an octet string
    and insert undefinite length headers where needed */
 static gpg_error_t
@@ -457,7 +564,7 @@ ksba_cms_identify (ksba_reader_t reader)
   unsigned char buffer[24];
   const unsigned char*p;
   size_t n, count;
-  char *oid;
+  const char *oid;
   int i;
   int maybe_p12 = 0;
 
@@ -515,15 +622,15 @@ ksba_cms_identify (ksba_reader_t reader)
   if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OBJECT_ID
          && !ti.is_constructed && ti.length) || ti.length > n)
     return KSBA_CT_NONE;
-  oid = ksba_oid_to_str (p, ti.length);
+  /* All content types we handle are in the OID registry.  */
+  oid = _ksba_oid_id_to_str (_ksba_oid_lookup (p, ti.length));
   if (!oid)
-    return KSBA_CT_NONE; /* out of core */
+    return KSBA_CT_NONE; /* unknown */
   for (i=0; content_handlers[i].oid; i++)
     {
       if (!strcmp (content_handlers[i].oid, oid))
         break;
     }
-  ksba_free(oid);
   if (!content_handlers[i].oid)
     return KSBA_CT_NONE; /* unknown */
   if (maybe_p12 && (content_handlers[i].ct == KSBA_CT_DATA
@@ -547,6 +654,7 @@ ksba_cms_new (ksba_cms_t *r_cms)
   *r_cms = xtrycalloc (1, sizeof **r_cms);
   if (!*r_cms)
     return gpg_error_from_errno (errno);
+  (*r_cms)->alloc_ctx = _ksba_alloc_ctx_current ();
   return 0;
 }
 
@@ -573,9 +681,20 @@ release_value_tree (struct value_tree_s *tree)
 void
 ksba_cms_release (ksba_cms_t cms)
 {
+  ksba_alloc_ctx_t actx, prevctx;
+
   if (!cms)
     return;
+  actx = cms->alloc_ctx;
+  prevctx = _ksba_alloc_ctx_switch (actx);
   xfree (cms->content.oid);
+  xfree (cms->cont.buffer);
+  while (cms->more_hash_fncs)
+    {
+      struct hash_fnc_list_s *h = cms->more_hash_fncs->next;
+      xfree (cms->more_hash_fncs);
+      cms->more_hash_fncs = h;
+    }
   while (cms->digest_algos)
     {
       struct oidlist_s *ol = cms->digest_algos->next;
@@ -615,6 +734,8 @@ ksba_cms_release (ksba_cms_t cms)
       _ksba_asn_release_nodes (cms->signer_info->root);
       xfree (cms->signer_info->image);
       xfree (cms->signer_info->cache.digest_algo);
+      xfree (cms->signer_info->cache.attrs);
+      xfree (cms->signer_info->cache.sigval);
       xfree (cms->signer_info);
       cms->signer_info = tmp;
     }
@@ -637,6 +758,8 @@ ksba_cms_release (ksba_cms_t cms)
     }
 
   xfree (cms);
+  _ksba_alloc_ctx_restore (prevctx);
+  ksba_alloc_ctx_release (actx);
 }
 
 
@@ -654,7 +777,138 @@ ksba_cms_set_reader_writer (ksba_cms_t cms, ksba_reader_t r, ksba_writer_t w)
 }
 
 
+/**
+ * ksba_cms_set_certstore:
+ * @cms: A CMS object
+ * @store: A certificate store or NULL
+ *
+ * Use @store as a cache for the certificates of a signed data object.
+ * For each certificate found by ksba_cms_parse, a certificate of
+ * @store with the same image is used instead of decoding it again;
+ * new certificates are added to @store.  Thus the certificates
+ * returned by ksba_cms_get_cert may be shared with other CMS objects
+ * and with the caller of the store.  Use ksba_certstore_set_limit to
+ * bound the size of the cache.  @store must not be released before
+ * @cms and, like all objects, may only be used by one thread at a
+ * time.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_cms_set_certstore (ksba_cms_t cms, ksba_certstore_t store)
+{
+  if (!cms)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  cms->certstore = store;
+  return 0;
+}
+
+
+/**
+ * ksba_cms_set_cert_cache_limit:
+ * @limit: The maximum number of certificates or 0
+ *
+ * Enable a process-wide cache of up to @limit certificates for all
+ * CMS objects without a store set by ksba_cms_set_certstore.  It
+ * works like such a store but may be used by all threads at the same
+ * time.  Thus the certificates returned by ksba_cms_get_cert may be
+ * shared between threads and should not be modified, for example by
+ * ksba_cert_set_user_data.  A @limit of 0 disables the cache and
+ * drops its references to the certificates.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_cms_set_cert_cache_limit (unsigned int limit)
+{
+  return _ksba_certstore_set_cache_limit (limit);
+}
+
+
 
+/* Run the parse step FNC.  If the reader is in non-blocking mode and
+   runs out of data, all changes done by FNC are undone, the reader is
+   set back to where it was before and GPG_ERR_EAGAIN is returned.  The
+   step may then be repeated once more data is available.  */
+static gpg_error_t
+run_resumable (ksba_cms_t cms, gpg_error_t (*fnc)(ksba_cms_t))
+{
+  gpg_error_t err;
+  struct oidlist_s *digest_algos = cms->digest_algos;
+  struct certlist_s *cert_list = cms->cert_list;
+  struct signer_info_s **si_tail;
+  struct value_tree_s **vt_tail;
+  char *inner_cont_oid = cms->inner_cont_oid;
+  char *encr_algo_oid = cms->encr_algo_oid;
+  char *encr_iv = cms->encr_iv;
+
+  if (!_ksba_reader_mark (cms->reader))
+    return fnc (cms);
+
+  /* The signer and recipient infos are appended to their lists.  */
+  for (si_tail = &cms->signer_info; *si_tail; si_tail = &(*si_tail)->next)
+    ;
+  for (vt_tail = &cms->recp_info; *vt_tail; vt_tail = &(*vt_tail)->next)
+    ;
+
+  err = fnc (cms);
+  if (!err || !_ksba_reader_would_block (cms->reader)
+      || _ksba_reader_rewind (cms->reader))
+    {
+      _ksba_reader_unmark (cms->reader);
+      return err;
+    }
+
+  while (cms->digest_algos != digest_algos)
+    {
+      struct oidlist_s *ol = cms->digest_algos->next;
+      xfree (cms->digest_algos->oid);
+      xfree (cms->digest_algos);
+      cms->digest_algos = ol;
+    }
+  while (cms->cert_list != cert_list)
+    {
+      struct certlist_s *cl = cms->cert_list->next;
+      ksba_cert_release (cms->cert_list->cert);
+      xfree (cms->cert_list);
+      cms->cert_list = cl;
+    }
+  while (*si_tail)
+    {
+      struct signer_info_s *tmp = (*si_tail)->next;
+      _ksba_asn_release_nodes ((*si_tail)->root);
+      xfree ((*si_tail)->image);
+      xfree ((*si_tail)->cache.digest_algo);
+      xfree ((*si_tail)->cache.attrs);
+      xfree ((*si_tail)->cache.sigval);
+      xfree (*si_tail);
+      *si_tail = tmp;
+    }
+  release_value_tree (*vt_tail);
+  *vt_tail = NULL;
+  if (cms->inner_cont_oid != inner_cont_oid)
+    {
+      xfree (cms->inner_cont_oid);
+      cms->inner_cont_oid = inner_cont_oid;
+    }
+  if (cms->encr_algo_oid != encr_algo_oid)
+    {
+      xfree (cms->encr_algo_oid);
+      cms->encr_algo_oid = encr_algo_oid;
+    }
+  if (cms->encr_iv != encr_iv)
+    {
+      xfree (cms->encr_iv);
+      cms->encr_iv = encr_iv;
+    }
+  return gpg_error (GPG_ERR_EAGAIN);
+}
+
+
+/* Parse the next part of the CMS object.  If the reader has been put
+   into non-blocking mode and runs out of data, KSBA_SR_WOULD_BLOCK is
+   returned as stop reason; the function shall then be called again
+   once more data is available.  */
 gpg_error_t
 ksba_cms_parse (ksba_cms_t cms, ksba_stop_reason_t *r_stopreason)
 {
@@ -667,7 +921,12 @@ ksba_cms_parse (ksba_cms_t cms, ksba_stop_reason_t *r_stopreason)
   *r_stopreason = KSBA_SR_RUNNING;
   if (!cms->stop_reason)
     { /* Initial state: start parsing */
-      err = _ksba_cms_parse_content_info (cms);
+      err = run_resumable (cms, _ksba_cms_parse_content_info);
+      if (gpg_err_code (err) == GPG_ERR_EAGAIN)
+        {
+          *r_stopreason = KSBA_SR_WOULD_BLOCK;
+          return 0;
+        }
       if (err)
         return err;
       for (i=0; content_handlers[i].oid; i++)
@@ -686,12 +945,18 @@ ksba_cms_parse (ksba_cms_t cms, ksba_stop_reason_t *r_stopreason)
   else if (cms->content.handler)
     {
       err = cms->content.handler (cms);
+      if (gpg_err_code (err) == GPG_ERR_EAGAIN)
+        {
+          *r_stopreason = KSBA_SR_WOULD_BLOCK;
+          return 0;
+        }
       if (err)
         return err;
     }
   else
     return gpg_error (GPG_ERR_UNSUPPORTED_CMS_OBJ);
 
+  STATS_TRACE ("cms", cms->stop_reason);
   *r_stopreason = cms->stop_reason;
   return 0;
 }
@@ -720,10 +985,20 @@ ksba_cms_build (ksba_cms_t cms, ksba_stop_reason_t *r_stopreason)
       err = cms->content.handler (cms);
       if (err)
         return err;
+      /* Make sure that a batching or queueing writer passes on all
+         data before the caller takes over.  */
+      if (cms->stop_reason == KSBA_SR_BEGIN_DATA
+          || cms->stop_reason == KSBA_SR_READY)
+        {
+          err = ksba_writer_flush (cms->writer);
+          if (err)
+            return err;
+        }
     }
   else
     return gpg_error (GPG_ERR_UNSUPPORTED_CMS_OBJ);
 
+  STATS_TRACE ("cms-build", cms->stop_reason);
   *r_stopreason = cms->stop_reason;
   return 0;
 }
@@ -963,6 +1238,22 @@ ksba_cms_get_issuer_serial (ksba_cms_t cms, int idx,
 
 
 
+/* Return the OID of the digest algorithm of signer SI or NULL.  */
+static const char *
+get_digest_algo (struct signer_info_s *si)
+{
+  AsnNode n;
+
+  if (!si->cache.digest_algo)
+    {
+      n = _ksba_asn_find_node (si->root,
+                               "SignerInfo.digestAlgorithm.algorithm");
+      si->cache.digest_algo = _ksba_oid_node_to_str (si->image, n);
+    }
+  return si->cache.digest_algo;
+}
+
+
 /**
  * ksba_cms_get_digest_algo:
  * @cms: CMS object
@@ -978,8 +1269,6 @@ ksba_cms_get_issuer_serial (ksba_cms_t cms, int idx,
 const char *
 ksba_cms_get_digest_algo (ksba_cms_t cms, int idx)
 {
-  AsnNode n;
-  char *algo;
   struct signer_info_s *si;
 
   if (!cms)
@@ -994,16 +1283,7 @@ ksba_cms_get_digest_algo (ksba_cms_t cms, int idx)
   if (!si)
     return NULL;
 
-  if (si->cache.digest_algo)
-    return si->cache.digest_algo;
-
-  n = _ksba_asn_find_node (si->root, "SignerInfo.digestAlgorithm.algorithm");
-  algo = _ksba_oid_node_to_str (si->image, n);
-  if (algo)
-    {
-      si->cache.digest_algo = algo;
-    }
-  return algo;
+  return get_digest_algo (si);
 }
 
 
@@ -1036,6 +1316,42 @@ ksba_cms_get_cert (ksba_cms_t cms, int idx)
 }
 
 
+/* Find the messageDigest attribute of signer SI and store its node
+   at R_NODE; NULL is stored if there is no such attribute.  */
+static gpg_error_t
+find_message_digest (struct signer_info_s *si, AsnNode *r_node)
+{
+  AsnNode nsiginfo, n;
+
+  *r_node = NULL;
+  nsiginfo = _ksba_asn_find_node (si->root, "SignerInfo.signedAttrs");
+  if (!nsiginfo)
+    return gpg_error (GPG_ERR_BUG);
+
+  n = _ksba_asn_find_type_value (si->image, nsiginfo, 0,
+                                 oid_messageDigest, DIM(oid_messageDigest));
+  if (!n)
+    return 0; /* this is okay, because the element is optional */
+
+  /* check that there is only one */
+  if (_ksba_asn_find_type_value (si->image, nsiginfo, 1,
+                                 oid_messageDigest, DIM(oid_messageDigest)))
+    return gpg_error (GPG_ERR_DUP_VALUE);
+
+  /* the value is is a SET OF OCTECT STRING but the set must have
+     excactly one OCTECT STRING.  (rfc2630 11.2) */
+  if ( !(n->type == TYPE_SET_OF && n->down
+         && n->down->type == TYPE_OCTET_STRING && !n->down->right))
+    return gpg_error (GPG_ERR_INV_CMS_OBJ);
+  n = n->down;
+  if (n->off == -1)
+    return gpg_error (GPG_ERR_BUG);
+
+  *r_node = n;
+  return 0;
+}
+
+
 /*
  * Return the extension attribute messageDigest
  * or for authenvelopeddata the MAC.
@@ -1044,7 +1360,8 @@ gpg_error_t
 ksba_cms_get_message_digest (ksba_cms_t cms, int idx,
                              char **r_digest, size_t *r_digest_len)
 {
-  AsnNode nsiginfo, n;
+  gpg_error_t err;
+  AsnNode n;
   struct signer_info_s *si;
 
   if (!cms || !r_digest || !r_digest_len)
@@ -1095,28 +1412,9 @@ ksba_cms_get_message_digest (ksba_cms_t cms, int idx,
 
   *r_digest = NULL;
   *r_digest_len = 0;
-  nsiginfo = _ksba_asn_find_node (si->root, "SignerInfo.signedAttrs");
-  if (!nsiginfo)
-    return gpg_error (GPG_ERR_BUG);
-
-  n = _ksba_asn_find_type_value (si->image, nsiginfo, 0,
-                                 oid_messageDigest, DIM(oid_messageDigest));
-  if (!n)
-    return 0; /* this is okay, because the element is optional */
-
-  /* check that there is only one */
-  if (_ksba_asn_find_type_value (si->image, nsiginfo, 1,
-                                 oid_messageDigest, DIM(oid_messageDigest)))
-    return gpg_error (GPG_ERR_DUP_VALUE);
-
-  /* the value is is a SET OF OCTECT STRING but the set must have
-     excactly one OCTECT STRING.  (rfc2630 11.2) */
-  if ( !(n->type == TYPE_SET_OF && n->down
-         && n->down->type == TYPE_OCTET_STRING && !n->down->right))
-    return gpg_error (GPG_ERR_INV_CMS_OBJ);
-  n = n->down;
-  if (n->off == -1)
-    return gpg_error (GPG_ERR_BUG);
+  err = find_message_digest (si, &n);
+  if (err || !n)
+    return err;
 
   *r_digest_len = n->len;
   *r_digest = xtrymalloc (n->len);
@@ -1280,6 +1578,31 @@ ksba_cms_get_sigattr_oids (ksba_cms_t cms, int idx,
 }
 
 
+/* Convert the signature of signer SI to an S-expression and store it
+   at R_STRING.  */
+static gpg_error_t
+get_sig_val (struct signer_info_s *si, ksba_sexp_t *r_string)
+{
+  AsnNode n, n2;
+
+  n = _ksba_asn_find_node (si->root, "SignerInfo.signatureAlgorithm");
+  if (!n)
+    return gpg_error (GPG_ERR_NO_VALUE);
+  if (n->off == -1)
+    {
+/*        fputs ("ksba_cms_get_sig_val problem at node:\n", stderr); */
+/*        _ksba_asn_node_dump_all (n, stderr); */
+      return gpg_error (GPG_ERR_GENERAL);
+    }
+
+  n2 = n->right; /* point to the actual value */
+  return _ksba_sigval_to_sexp (si->image + n->off,
+                               n->nhdr + n->len
+                               + ((!n2||n2->off == -1)? 0:(n2->nhdr+n2->len)),
+                               r_string);
+}
+
+
 /**
  * ksba_cms_get_sig_val:
  * @cms: CMS object
@@ -1294,8 +1617,6 @@ ksba_cms_get_sigattr_oids (ksba_cms_t cms, int idx,
 ksba_sexp_t
 ksba_cms_get_sig_val (ksba_cms_t cms, int idx)
 {
-  AsnNode n, n2;
-  gpg_error_t err;
   ksba_sexp_t string;
   struct signer_info_s *si;
 
@@ -1311,25 +1632,170 @@ ksba_cms_get_sig_val (ksba_cms_t cms, int idx)
   if (!si)
     return NULL;
 
+  if (get_sig_val (si, &string))
+    return NULL;
+
+  return string;
+}
+
+
+/**
+ * ksba_cms_get_sig_val_desc:
+ * @cms: CMS object
+ * @idx: index of signer
+ * @desc: Returns the description of the signature
+ *
+ * This is a version of ksba_cms_get_sig_val which stores a
+ * description of the signature of signer @idx at @desc instead of
+ * creating an S-expression.  The pointers in @desc are valid as long
+ * as @cms.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_cms_get_sig_val_desc (ksba_cms_t cms, int idx, ksba_keydesc_t desc)
+{
+  struct signer_info_s *si;
+  AsnNode n, n2;
+
+  if (!cms || !desc)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!cms->signer_info)
+    return gpg_error (GPG_ERR_NO_DATA);
+  if (idx < 0)
+    return gpg_error (GPG_ERR_INV_INDEX);
+
+  for (si=cms->signer_info; si && idx; si = si->next, idx-- )
+    ;
+  if (!si)
+    return -1; /* no more signers */
+
   n = _ksba_asn_find_node (si->root, "SignerInfo.signatureAlgorithm");
-  if (!n)
-      return NULL;
-  if (n->off == -1)
+  if (!n || n->off == -1)
+    return gpg_error (GPG_ERR_NO_VALUE);
+
+  n2 = n->right; /* point to the actual value */
+  return _ksba_sigval_to_keydesc (si->image + n->off,
+                                  n->nhdr + n->len
+                                  + ((!n2||n2->off == -1)? 0
+                                     : (n2->nhdr+n2->len)),
+                                  desc);
+}
+
+
+/* Fill SIGNER with the information about signer SI.  */
+static gpg_error_t
+get_signer (struct signer_info_s *si, ksba_cms_signer_t signer)
+{
+  gpg_error_t err;
+  AsnNode n;
+
+  memset (signer, 0, sizeof *signer);
+
+  n = _ksba_asn_find_node (si->root,
+                           "SignerInfo.sid.issuerAndSerialNumber.issuer");
+  if (n && n->down && n->down->off != -1)
     {
-/*        fputs ("ksba_cms_get_sig_val problem at node:\n", stderr); */
-/*        _ksba_asn_node_dump_all (n, stderr); */
-      return NULL;
+      n = n->down; /* dereference the choice node */
+      signer->issuer = si->image + n->off;
+      signer->issuerlen = n->nhdr + n->len;
+      n = _ksba_asn_find_node
+        (si->root, "SignerInfo.sid.issuerAndSerialNumber.serialNumber");
+      if (!n || n->off == -1)
+        return gpg_error (GPG_ERR_NO_VALUE);
+      signer->serial = si->image + n->off + n->nhdr;
+      signer->seriallen = n->len;
     }
 
-  n2 = n->right; /* point to the actual value */
-  err = _ksba_sigval_to_sexp (si->image + n->off,
-                              n->nhdr + n->len
-                              + ((!n2||n2->off == -1)? 0:(n2->nhdr+n2->len)),
-                              &string);
-  if (err)
-      return NULL;
+  signer->digest_algo = get_digest_algo (si);
+  if (!signer->digest_algo)
+    return gpg_error (GPG_ERR_INV_CMS_OBJ);
 
-  return string;
+  n = _ksba_asn_find_node (si->root, "SignerInfo.signedAttrs");
+  if (n && n->off != -1)
+    {
+      if (!si->cache.attrs)
+        {
+          /* We don't hash the implicit tag [0] but a SET tag */
+          si->cache.attrs = xtrymalloc (n->nhdr + n->len);
+          if (!si->cache.attrs)
+            return gpg_error_from_syserror ();
+          memcpy (si->cache.attrs, si->image + n->off, n->nhdr + n->len);
+          si->cache.attrs[0] = 0x31;
+        }
+      signer->attrs = si->cache.attrs;
+      signer->attrslen = n->nhdr + n->len;
+
+      err = find_message_digest (si, &n);
+      if (err)
+        return err;
+      if (n)
+        {
+          signer->digest = si->image + n->off + n->nhdr;
+          signer->digestlen = n->len;
+        }
+    }
+
+  if (!si->cache.sigval)
+    {
+      err = get_sig_val (si, &si->cache.sigval);
+      if (err)
+        return err;
+    }
+  signer->sigval = si->cache.sigval;
+
+  return 0;
+}
+
+
+/**
+ * ksba_cms_get_signers:
+ * @cms: CMS object
+ * @signers: Array to receive the signers or NULL
+ * @nsigners: Number of elements in @signers
+ * @r_count: Returns the number of signers
+ *
+ * Return the information required to verify the signatures of all
+ * signers at once.  The first @nsigners signers are stored in
+ * @signers so that they can be processed independently of each
+ * other and of the CMS object, for example by a pool of threads.
+ * The number of signers in @cms is stored at @r_count; to learn
+ * about the required size of the array, this function may be called
+ * with @nsigners set to 0.  The data referenced by @signers is owned
+ * by @cms and valid as long as @cms lives.
+ *
+ * To verify a signer with signed attributes, the digest of the
+ * content needs to be compared to the digest field; the signature
+ * is then computed over the attrs field.  Without signed attributes
+ * the signature is computed over the content.
+ *
+ * Return value: 0 on success or an error code.  GPG_ERR_NO_DATA is
+ * returned if there are no signers.
+ **/
+gpg_error_t
+ksba_cms_get_signers (ksba_cms_t cms, ksba_cms_signer_t signers,
+                      unsigned int nsigners, unsigned int *r_count)
+{
+  gpg_error_t err;
+  struct signer_info_s *si;
+  unsigned int count;
+
+  if (!cms || !r_count || (nsigners && !signers))
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_count = 0;
+  if (!cms->signer_info)
+    return gpg_error (GPG_ERR_NO_DATA);
+
+  for (si=cms->signer_info, count=0; si; si = si->next, count++)
+    if (count < nsigners)
+      {
+        err = get_signer (si, signers + count);
+        if (err)
+          return err;
+      }
+
+  *r_count = count;
+  return 0;
 }
 
 
@@ -1646,7 +2112,215 @@ ksba_cms_get_enc_val (ksba_cms_t cms, int idx)
       return NULL;
     }
 
-  return string;
+  return string;
+}
+
+
+
+/* Store the location of the issuer at ISSUER_PATH and the serial
+   number at SERIAL_PATH in ROOT into RECP.  */
+static gpg_error_t
+get_recipient_isn (struct value_tree_s *vt, AsnNode root,
+                   const char *issuer_path, const char *serial_path,
+                   ksba_cms_recipient_t recp)
+{
+  AsnNode n;
+
+  n = _ksba_asn_find_node (root, issuer_path);
+  if (!n || !n->down || n->down->off == -1)
+    return 0;
+  n = n->down; /* dereference the choice node */
+  recp->issuer = vt->image + n->off;
+  recp->issuerlen = n->nhdr + n->len;
+
+  n = _ksba_asn_find_node (root, serial_path);
+  if (!n || n->off == -1)
+    return gpg_error (GPG_ERR_NO_VALUE);
+  recp->serial = vt->image + n->off + n->nhdr;
+  recp->seriallen = n->len;
+  return 0;
+}
+
+
+/* Store the value of the OCTET STRING at PATH in ROOT as key
+   identifier into RECP.  */
+static void
+get_recipient_keyid (struct value_tree_s *vt, AsnNode root, const char *path,
+                     ksba_cms_recipient_t recp)
+{
+  AsnNode n;
+
+  n = _ksba_asn_find_node (root, path);
+  if (n && n->off != -1)
+    {
+      recp->keyid = vt->image + n->off + n->nhdr;
+      recp->keyidlen = n->len;
+    }
+}
+
+
+/* Fill RECP with the identifiers of recipient VT.  */
+static gpg_error_t
+get_recipient (struct value_tree_s *vt, ksba_cms_recipient_t recp)
+{
+  gpg_error_t err = 0;
+  AsnNode n;
+
+  memset (recp, 0, sizeof *recp);
+
+  n = _ksba_asn_find_node (vt->root, "RecipientInfo.+");
+  if (!n || !n->name)
+    return gpg_error (GPG_ERR_NO_VALUE);
+  recp->type = n->name;
+
+  if (!strcmp (n->name, "ktri"))
+    {
+      err = get_recipient_isn (vt, n,
+                               "ktri.rid.issuerAndSerialNumber.issuer",
+                               "ktri.rid.issuerAndSerialNumber.serialNumber",
+                               recp);
+      get_recipient_keyid (vt, n, "ktri.rid.subjectKeyIdentifier", recp);
+    }
+  else if (!strcmp (n->name, "kari"))
+    {
+      err = get_recipient_isn (vt, n,
+                               ("kari..recipientEncryptedKeys"
+                                "..rid.issuerAndSerialNumber.issuer"),
+                               ("kari..recipientEncryptedKeys"
+                                "..rid.issuerAndSerialNumber.serialNumber"),
+                               recp);
+      get_recipient_keyid (vt, n, ("kari..recipientEncryptedKeys"
+                                   "..rid.rKeyId.subjectKeyIdentifier"),
+                           recp);
+    }
+  else if (!strcmp (n->name, "kekri"))
+    get_recipient_keyid (vt, n, "kekri.kekid.keyIdentifier", recp);
+  else if (strcmp (n->name, "pwri"))
+    err = gpg_error (GPG_ERR_INV_CMS_OBJ);
+
+  return err;
+}
+
+
+/**
+ * ksba_cms_get_recipients:
+ * @cms: CMS object
+ * @recps: Array to receive the recipients or NULL
+ * @nrecps: Number of elements in @recps
+ * @r_count: Returns the number of recipients
+ *
+ * Return the identifiers of all recipients of an enveloped data
+ * object at once.  The first @nrecps recipients are stored in @recps
+ * in the order of their index as used by ksba_cms_get_enc_val.  The
+ * type field is one of "ktri", "kari", "kekri" or "pwri".  Recipients
+ * identified by issuer and serial number have these fields set;
+ * recipients identified by a subject key identifier, by a rKeyId or
+ * by a KEK identifier have the keyid field set.  For "kari" only the
+ * first of the recipient encrypted keys is considered, as done by
+ * ksba_cms_get_issuer_serial.  The number of recipients in @cms is
+ * stored at @r_count; to learn about the required size of the array,
+ * this function may be called with @nrecps set to 0.  The data
+ * referenced by @recps is owned by @cms and valid as long as @cms
+ * lives.
+ *
+ * Return value: 0 on success or an error code.  GPG_ERR_NO_DATA is
+ * returned if there are no recipients.
+ **/
+gpg_error_t
+ksba_cms_get_recipients (ksba_cms_t cms, ksba_cms_recipient_t recps,
+                         unsigned int nrecps, unsigned int *r_count)
+{
+  gpg_error_t err;
+  struct value_tree_s *vt;
+  unsigned int count;
+
+  if (!cms || !r_count || (nrecps && !recps))
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_count = 0;
+  if (!cms->recp_info)
+    return gpg_error (GPG_ERR_NO_DATA);
+
+  for (vt=cms->recp_info, count=0; vt; vt = vt->next, count++)
+    if (count < nrecps)
+      {
+        err = get_recipient (vt, recps + count);
+        if (err)
+          return err;
+      }
+
+  *r_count = count;
+  return 0;
+}
+
+
+/**
+ * ksba_cms_find_recipient:
+ * @cms: CMS object
+ * @store: The certificates of our keys
+ * @start: The index of the first recipient to consider
+ * @r_idx: Returns the index of the recipient
+ * @r_cert: Returns the matching certificate or NULL
+ *
+ * Find the first recipient with an index of at least @start whose
+ * certificate is in @store.  Recipients are matched by issuer and
+ * serial number or by subject key identifier using the indices of the
+ * store, so that a message with many recipients can be matched
+ * against many keys in a single pass.  The index of the recipient,
+ * suitable for ksba_cms_get_enc_val, is stored at @r_idx and, if
+ * @r_cert is not NULL, the certificate at @r_cert; the caller must
+ * release it.  To find further matches, this function may be called
+ * again with @start set to the returned index plus one.  KEK and
+ * password recipients are never matched.
+ *
+ * Return value: 0 on success or an error code.  GPG_ERR_NOT_FOUND is
+ * returned if there is no matching recipient.
+ **/
+gpg_error_t
+ksba_cms_find_recipient (ksba_cms_t cms, ksba_certstore_t store, int start,
+                         int *r_idx, ksba_cert_t *r_cert)
+{
+  gpg_error_t err;
+  struct value_tree_s *vt;
+  struct ksba_cms_recipient_s recp;
+  ksba_cert_t cert;
+  int idx;
+
+  if (r_cert)
+    *r_cert = NULL;
+  if (!cms || !store || !r_idx)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (start < 0)
+    return gpg_error (GPG_ERR_INV_INDEX);
+
+  for (vt=cms->recp_info, idx=0; vt && idx < start; vt = vt->next, idx++)
+    ;
+  for (; vt; vt = vt->next, idx++)
+    {
+      err = get_recipient (vt, &recp);
+      if (err)
+        return err;
+      if (recp.issuer)
+        err = ksba_certstore_find_serial (store, recp.issuer, recp.issuerlen,
+                                          recp.serial, recp.seriallen, &cert);
+      else if (recp.keyid && strcmp (recp.type, "kekri"))
+        err = ksba_certstore_find_ski (store, recp.keyid, recp.keyidlen,
+                                       0, &cert);
+      else
+        continue;
+      if (gpg_err_code (err) == GPG_ERR_NOT_FOUND)
+        continue;
+      if (err)
+        return err;
+
+      *r_idx = idx;
+      if (r_cert)
+        *r_cert = cert;
+      else
+        ksba_cert_release (cert);
+      return 0;
+    }
+
+  return gpg_error (GPG_ERR_NOT_FOUND);
 }
 
 
@@ -1667,6 +2341,44 @@ ksba_cms_set_hash_function (ksba_cms_t cms,
 }
 
 
+/**
+ * ksba_cms_add_hash_function:
+ * @cms: A CMS object
+ * @hash_fnc: The hash function
+ * @hash_fnc_arg: The first argument for @hash_fnc
+ *
+ * Add another function to hash the content of signed data.  The
+ * content is passed to the function set with
+ * ksba_cms_set_hash_function and to all added functions in the order
+ * they have been added.  This allows computing the digests for all
+ * algorithms listed by ksba_cms_get_digest_algo_list in one pass,
+ * for example one per algorithm.  Only the function set with
+ * ksba_cms_set_hash_function is used by ksba_cms_hash_signed_attrs.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_cms_add_hash_function (ksba_cms_t cms,
+                            void (*hash_fnc)(void *, const void *, size_t),
+                            void *hash_fnc_arg)
+{
+  struct hash_fnc_list_s *h, **tail;
+
+  if (!cms || !hash_fnc)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  h = xtrycalloc (1, sizeof *h);
+  if (!h)
+    return gpg_error_from_syserror ();
+  h->fnc = hash_fnc;
+  h->arg = hash_fnc_arg;
+  for (tail = &cms->more_hash_fncs; *tail; tail = &(*tail)->next)
+    ;
+  *tail = h;
+  return 0;
+}
+
+
 /* hash the signed attributes of the given signer */
 gpg_error_t
 ksba_cms_hash_signed_attrs (ksba_cms_t cms, int idx)
@@ -1694,6 +2406,7 @@ ksba_cms_hash_signed_attrs (ksba_cms_t cms, int idx)
   cms->hash_fnc (cms->hash_fnc_arg, "\x31", 1);
   cms->hash_fnc (cms->hash_fnc_arg,
                  si->image + n->off + 1, n->nhdr + n->len - 1);
+  STATS_ADD (hash_bytes, n->nhdr + n->len);
 
   return 0;
 }
@@ -1839,6 +2552,8 @@ ksba_cms_add_cert (ksba_cms_t cms, ksba_cert_t cert)
 
   if (!cms || !cert)
     return gpg_error (GPG_ERR_INV_VALUE);
+  if (cms->certs_written)
+    return gpg_error (GPG_ERR_CONFLICT);
 
   /* first check whether this is a duplicate. */
   for (cl = cms->cert_info_list; cl; cl = cl->next)
@@ -2456,7 +3171,7 @@ ct_parse_signed_data (ksba_cms_t cms)
     }
   else if (stop_reason == KSBA_SR_BEGIN_DATA)
     {
-      if (!cms->hash_fnc)
+      if (!cms->hash_fnc && !cms->more_hash_fncs)
         err = gpg_error (GPG_ERR_MISSING_ACTION);
       else
         state = sIN_DATA;
@@ -2475,14 +3190,16 @@ ct_parse_signed_data (ksba_cms_t cms)
 
   /* Do the action */
   if (state == sSTART)
-    err = _ksba_cms_parse_signed_data_part_1 (cms);
+    err = run_resumable (cms, _ksba_cms_parse_signed_data_part_1);
   else if (state == sGOT_HASH)
-    err = _ksba_cms_parse_signed_data_part_2 (cms);
+    err = run_resumable (cms, _ksba_cms_parse_signed_data_part_2);
   else if (state == sIN_DATA)
     err = read_and_hash_cont (cms);
   else
     err = gpg_error (GPG_ERR_INV_STATE);
 
+  if (gpg_err_code (err) == GPG_ERR_EAGAIN)
+    cms->stop_reason = stop_reason;  /* Repeat this state.  */
   if (err)
     return err;
 
@@ -2552,14 +3269,16 @@ ct_parse_enveloped_data (ksba_cms_t cms)
 
   /* Do the action */
   if (state == sSTART)
-    err = _ksba_cms_parse_enveloped_data_part_1 (cms);
+    err = run_resumable (cms, _ksba_cms_parse_enveloped_data_part_1);
   else if (state == sREST)
-    err = _ksba_cms_parse_enveloped_data_part_2 (cms);
+    err = run_resumable (cms, _ksba_cms_parse_enveloped_data_part_2);
   else if (state == sINDATA)
     err = read_encrypted_cont (cms);
   else
     err = gpg_error (GPG_ERR_INV_STATE);
 
+  if (gpg_err_code (err) == GPG_ERR_EAGAIN)
+    cms->stop_reason = stop_reason;  /* Repeat this state.  */
   if (err)
     return err;
 
@@ -2753,8 +3472,7 @@ set_issuer_serial (AsnNode info, ksba_cert_t cert, int mode)
   if (!info || !cert)
     return gpg_error (GPG_ERR_INV_VALUE);
 
-  src = _ksba_asn_find_node (cert->root,
-                             "Certificate.tbsCertificate.serialNumber");
+  src = _ksba_cert_find_node (cert, CERT_NODE_SERIAL);
   dst = _ksba_asn_find_node (info,
                              mode?
                              "rid.issuerAndSerialNumber.serialNumber":
@@ -2763,8 +3481,7 @@ set_issuer_serial (AsnNode info, ksba_cert_t cert, int mode)
   if (err)
     return err;
 
-  src = _ksba_asn_find_node (cert->root,
-                             "Certificate.tbsCertificate.issuer");
+  src = _ksba_cert_find_node (cert, CERT_NODE_ISSUER);
   dst = _ksba_asn_find_node (info,
                              mode?
                              "rid.issuerAndSerialNumber.issuer":
@@ -2923,7 +3640,19 @@ build_signed_data_attributes (ksba_cms_t cms)
           if (err )
             return err;
         }
+
+      /* The certificates are not needed anymore; release them so that
+         they don't stay in memory while the user computes the
+         signatures.  */
+      while (cms->cert_info_list)
+        {
+          certlist = cms->cert_info_list->next;
+          ksba_cert_release (cms->cert_info_list->cert);
+          xfree (cms->cert_info_list);
+          cms->cert_info_list = certlist;
+        }
     }
+  cms->certs_written = 1;
 
   /* If we ever support it, here is the right place to do it:
      Write the optional CRLs */
@@ -3161,7 +3890,7 @@ build_signed_data_attributes (ksba_cms_t cms)
           if (err)
             goto leave;
 	  _ksba_asn_release_nodes (attrarray[i].root);
-	  free (attrarray[i].image);
+	  xfree (attrarray[i].image);
 	  attrarray[i].root = NULL;
 	  attrarray[i].image = NULL;
         }
@@ -3196,257 +3925,256 @@ build_signed_data_attributes (ksba_cms_t cms)
 
 
 
-/* The user has calculated the signatures and we can therefore write
-   everything left over to do. */
+/* Encode the signer info for the signer described by CERTLIST,
+   DIGESTLIST, SI and SV using the ASN.1 module CMS_TREE.  The DER
+   encoding is stored as a new buffer at R_IMAGE and R_IMAGELEN.  */
 static gpg_error_t
-build_signed_data_rest (ksba_cms_t cms)
+encode_signer_info (ksba_asn_tree_t cms_tree, struct certlist_s *certlist,
+                    struct oidlist_s *digestlist, struct signer_info_s *si,
+                    struct sig_val_s *sv,
+                    unsigned char **r_image, size_t *r_imagelen)
 {
   gpg_error_t err;
-  int signer;
-  ksba_asn_tree_t cms_tree = NULL;
-  struct certlist_s *certlist;
-  struct oidlist_s *digestlist;
-  struct signer_info_s *si;
-  struct sig_val_s *sv;
-  ksba_writer_t tmpwrt = NULL;
-  AsnNode root = NULL;
+  AsnNode root, n, n2;
   ksba_der_t dbld = NULL;
+  const char *oid;
 
-  /* Now we can really write the signer info */
-  err = ksba_asn_create_tree ("cms", &cms_tree);
+  if (!certlist->cert || !digestlist->oid)
+    return gpg_error (GPG_ERR_BUG);
+
+  root = _ksba_asn_expand_tree (cms_tree->parse_tree,
+                                "CryptographicMessageSyntax.SignerInfo");
+
+  /* We store a version of 1 because we use the issuerAndSerialNumber */
+  n = _ksba_asn_find_node (root, "SignerInfo.version");
+  if (!n)
+    {
+      err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
+      goto leave;
+    }
+  err = _ksba_der_store_integer (n, "\x00\x00\x00\x01\x01");
   if (err)
-    return err;
+    goto leave;
 
-  certlist = cms->cert_list;
-  if (!certlist)
+  /* Store the sid */
+  n = _ksba_asn_find_node (root, "SignerInfo.sid");
+  if (!n)
     {
-      err = gpg_error (GPG_ERR_MISSING_VALUE); /* oops */
-      return err;
+      err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
+      goto leave;
     }
 
-  /* To construct the set we use a temporary writer object. */
-  err = ksba_writer_new (&tmpwrt);
+  err = set_issuer_serial (n, certlist->cert, 0);
+  if (err)
+    goto leave;
+
+  /* store the digestAlgorithm */
+  n = _ksba_asn_find_node (root, "SignerInfo.digestAlgorithm.algorithm");
+  if (!n)
+    {
+      err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
+      goto leave;
+    }
+  err = _ksba_der_store_oid (n, digestlist->oid);
   if (err)
     goto leave;
-  err = ksba_writer_set_mem (tmpwrt, 2048);
+  n = _ksba_asn_find_node (root, "SignerInfo.digestAlgorithm.parameters");
+  if (!n)
+    {
+      err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
+      goto leave;
+    }
+  err = _ksba_der_store_null (n);
   if (err)
     goto leave;
 
-  digestlist = cms->digest_algos;
-  si = cms->signer_info;
-  sv = cms->sig_val;
+  /* and the signed attributes */
+  n = _ksba_asn_find_node (root, "SignerInfo.signedAttrs");
+  if (!n || !n->down)
+    {
+      err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
+      goto leave;
+    }
+  assert (si->root);
+  assert (si->image);
+  n2 = _ksba_asn_find_node (si->root, "SignerInfo.signedAttrs");
+  if (!n2 || !n2->down)
+    {
+      err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
+      goto leave;
+    }
+  err = _ksba_der_copy_tree (n, n2, si->image);
+  if (err)
+    goto leave;
 
-  for (signer=0; certlist;
-       signer++,
-         certlist = certlist->next,
-         digestlist = digestlist->next,
-         si = si->next,
-         sv = sv->next)
+  /* store the signatureAlgorithm */
+  n = _ksba_asn_find_node (root,
+                           "SignerInfo.signatureAlgorithm.algorithm");
+  if (!n)
     {
-      AsnNode n, n2;
-      unsigned char *image;
-      size_t imagelen;
-      const char *oid;
+      err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
+      goto leave;
+    }
+  if (!sv->algo)
+    {
+      err = gpg_error (GPG_ERR_MISSING_VALUE);
+      goto leave;
+    }
 
-      if (!digestlist || !si || !sv)
-        {
-	  err = gpg_error (GPG_ERR_MISSING_VALUE); /* oops */
-	  goto leave;
-	}
-      if (!certlist->cert || !digestlist->oid)
+  if (!strcmp (sv->algo, "ecdsa"))
+    {
+      /* Look at the digest algorithm and replace accordingly.  */
+      if (!strcmp (digestlist->oid, "2.16.840.1.101.3.4.2.1"))
+        oid = "1.2.840.10045.4.3.2";  /* ecdsa-with-SHA256 */
+      else if (!strcmp (digestlist->oid, "2.16.840.1.101.3.4.2.2"))
+        oid = "1.2.840.10045.4.3.3";  /* ecdsa-with-SHA384 */
+      else if (!strcmp (digestlist->oid, "2.16.840.1.101.3.4.2.3"))
+        oid = "1.2.840.10045.4.3.4";  /* ecdsa-with-SHA512 */
+      else
         {
-	  err = gpg_error (GPG_ERR_BUG);
-	  goto leave;
-	}
+          err = gpg_error (GPG_ERR_DIGEST_ALGO);
+          goto leave;
+        }
+    }
+  else
+    oid = sv->algo;
 
-      root = _ksba_asn_expand_tree (cms_tree->parse_tree,
-                                    "CryptographicMessageSyntax.SignerInfo");
+  err = _ksba_der_store_oid (n, oid);
+  if (err)
+    goto leave;
+  n = _ksba_asn_find_node (root,
+                           "SignerInfo.signatureAlgorithm.parameters");
+  if (!n)
+    {
+      err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
+      goto leave;
+    }
+  err = _ksba_der_store_null (n);
+  if (err)
+    goto leave;
 
-      /* We store a version of 1 because we use the issuerAndSerialNumber */
-      n = _ksba_asn_find_node (root, "SignerInfo.version");
-      if (!n)
-	{
-	  err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
-	  goto leave;
-	}
-      err = _ksba_der_store_integer (n, "\x00\x00\x00\x01\x01");
-      if (err)
-        goto leave;
+  /* store the signature  */
+  if (!sv->value)
+    {
+      err = gpg_error (GPG_ERR_MISSING_VALUE);
+      goto leave;
+    }
+  n = _ksba_asn_find_node (root, "SignerInfo.signature");
+  if (!n)
+    {
+      err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
+      goto leave;
+    }
 
-      /* Store the sid */
-      n = _ksba_asn_find_node (root, "SignerInfo.sid");
-      if (!n)
+  if (sv->ecc.r)  /* ECDSA */
+    {
+      unsigned char *tmpder;
+      size_t tmpderlen;
+
+      _ksba_der_release (dbld);
+      dbld = _ksba_der_builder_new (0);
+      if (!dbld)
         {
-	  err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
-	  goto leave;
-	}
+          err = gpg_error_from_syserror ();
+          goto leave;
+        }
+      _ksba_der_add_tag (dbld, 0, TYPE_SEQUENCE);
+      _ksba_der_add_int (dbld, sv->ecc.r, sv->ecc.rlen, 1);
+      _ksba_der_add_int (dbld, sv->value, sv->valuelen, 1);
+      _ksba_der_add_end (dbld);
 
-      err = set_issuer_serial (n, certlist->cert, 0);
+      err = _ksba_der_builder_get (dbld, &tmpder, &tmpderlen);
       if (err)
         goto leave;
-
-      /* store the digestAlgorithm */
-      n = _ksba_asn_find_node (root, "SignerInfo.digestAlgorithm.algorithm");
-      if (!n)
-	{
-	  err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
-	  goto leave;
-	}
-      err = _ksba_der_store_oid (n, digestlist->oid);
+      err = _ksba_der_store_octet_string (n, tmpder, tmpderlen);
+      xfree (tmpder);
       if (err)
         goto leave;
-      n = _ksba_asn_find_node (root, "SignerInfo.digestAlgorithm.parameters");
-      if (!n)
-        {
-	  err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
-	  goto leave;
-	}
-      err = _ksba_der_store_null (n);
+    }
+  else  /* RSA */
+    {
+      err = _ksba_der_store_octet_string (n, sv->value, sv->valuelen);
       if (err)
         goto leave;
+    }
 
-      /* and the signed attributes */
-      n = _ksba_asn_find_node (root, "SignerInfo.signedAttrs");
-      if (!n || !n->down)
-        {
-	  err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
-	  goto leave;
-	}
-      assert (si->root);
-      assert (si->image);
-      n2 = _ksba_asn_find_node (si->root, "SignerInfo.signedAttrs");
-      if (!n2 || !n2->down)
-        {
-	  err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
-	  goto leave;
-	}
-      err = _ksba_der_copy_tree (n, n2, si->image);
-      if (err)
-        goto leave;
-      image = NULL;
+  /* Make the DER encoding. */
+  err = _ksba_der_encode_tree (root, r_image, r_imagelen);
 
-      /* store the signatureAlgorithm */
-      n = _ksba_asn_find_node (root,
-			       "SignerInfo.signatureAlgorithm.algorithm");
-      if (!n)
-        {
-	  err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
-	  goto leave;
-	}
-      if (!sv->algo)
-        {
-	  err = gpg_error (GPG_ERR_MISSING_VALUE);
-	  goto leave;
-	}
+ leave:
+  _ksba_asn_release_nodes (root);
+  _ksba_der_release (dbld);
+  return err;
+}
 
-      if (!strcmp (sv->algo, "ecdsa"))
-        {
-          /* Look at the digest algorithm and replace accordingly.  */
-          if (!strcmp (digestlist->oid, "2.16.840.1.101.3.4.2.1"))
-            oid = "1.2.840.10045.4.3.2";  /* ecdsa-with-SHA256 */
-          else if (!strcmp (digestlist->oid, "2.16.840.1.101.3.4.2.2"))
-            oid = "1.2.840.10045.4.3.3";  /* ecdsa-with-SHA384 */
-          else if (!strcmp (digestlist->oid, "2.16.840.1.101.3.4.2.3"))
-            oid = "1.2.840.10045.4.3.4";  /* ecdsa-with-SHA512 */
-          else
-            {
-              err = gpg_error (GPG_ERR_DIGEST_ALGO);
-              goto leave;
-            }
-        }
-      else
-        oid = sv->algo;
 
-      err = _ksba_der_store_oid (n, oid);
-      if (err)
-	goto leave;
-      n = _ksba_asn_find_node (root,
-			       "SignerInfo.signatureAlgorithm.parameters");
-      if (!n)
-        {
-	  err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
-	  goto leave;
-	}
-      err = _ksba_der_store_null (n);
-      if (err)
-	goto leave;
+/* The user has calculated the signatures and we can therefore write
+   everything left over to do. */
+static gpg_error_t
+build_signed_data_rest (ksba_cms_t cms)
+{
+  gpg_error_t err;
+  int pass;
+  ksba_asn_tree_t cms_tree = NULL;
+  struct certlist_s *certlist;
+  struct oidlist_s *digestlist;
+  struct signer_info_s *si;
+  struct sig_val_s *sv;
+  unsigned char *image;
+  size_t imagelen;
+  unsigned long totallen = 0;
 
-      /* store the signature  */
-      if (!sv->value)
-        {
-	  err = gpg_error (GPG_ERR_MISSING_VALUE);
-	  goto leave;
-	}
-      n = _ksba_asn_find_node (root, "SignerInfo.signature");
-      if (!n)
-	{
-	  err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
-	  goto leave;
-	}
+  if (!cms->cert_list)
+    return gpg_error (GPG_ERR_MISSING_VALUE); /* oops */
+
+  /* Now we can really write the signer info */
+  err = ksba_asn_create_tree ("cms", &cms_tree);
+  if (err)
+    return err;
 
-      if (sv->ecc.r)  /* ECDSA */
+  /* The SET of signer infos is written with a definite length so
+     that older versions of the parser can read it.  Instead of
+     collecting all signer infos to get that length, we encode them
+     twice: first to sum up their lengths and then to write them out
+     one by one.  This keeps the memory use flat with many signers.  */
+  for (pass=0; pass < 2; pass++)
+    {
+      if (pass)
         {
-          unsigned char *tmpder;
-          size_t tmpderlen;
+          err = _ksba_ber_write_tl (cms->writer, TYPE_SET, CLASS_UNIVERSAL,
+                                    1, totallen);
+          if (err)
+            goto leave;
+        }
 
-          _ksba_der_release (dbld);
-          dbld = _ksba_der_builder_new (0);
-          if (!dbld)
+      digestlist = cms->digest_algos;
+      si = cms->signer_info;
+      sv = cms->sig_val;
+      for (certlist = cms->cert_list; certlist;
+           certlist = certlist->next,
+             digestlist = digestlist->next,
+             si = si->next,
+             sv = sv->next)
+        {
+          if (!digestlist || !si || !sv)
             {
-              err = gpg_error_from_syserror ();
+              err = gpg_error (GPG_ERR_MISSING_VALUE); /* oops */
               goto leave;
             }
-          _ksba_der_add_tag (dbld, 0, TYPE_SEQUENCE);
-          _ksba_der_add_int (dbld, sv->ecc.r, sv->ecc.rlen, 1);
-          _ksba_der_add_int (dbld, sv->value, sv->valuelen, 1);
-          _ksba_der_add_end (dbld);
-
-          err = _ksba_der_builder_get (dbld, &tmpder, &tmpderlen);
-          if (err)
-            goto leave;
-          err = _ksba_der_store_octet_string (n, tmpder, tmpderlen);
-          xfree (tmpder);
+          err = encode_signer_info (cms_tree, certlist, digestlist, si, sv,
+                                    &image, &imagelen);
           if (err)
             goto leave;
-        }
-      else  /* RSA */
-        {
-          err = _ksba_der_store_octet_string (n, sv->value, sv->valuelen);
+          if (pass)
+            err = ksba_writer_write (cms->writer, image, imagelen);
+          else
+            totallen += imagelen;
+          xfree (image);
           if (err)
             goto leave;
         }
-
-      /* Make the DER encoding and write it out. */
-      err = _ksba_der_encode_tree (root, &image, &imagelen);
-      if (err)
-	goto leave;
-
-      err = ksba_writer_write (tmpwrt, image, imagelen);
-      xfree (image);
-      if (err)
-	goto leave;
     }
 
-  /* Write out the SET filled with all signer infos */
-  {
-    unsigned char *value;
-    size_t valuelen;
-
-    value = ksba_writer_snatch_mem (tmpwrt, &valuelen);
-    if (!value)
-      {
-        err = gpg_error (GPG_ERR_ENOMEM);
-	goto leave;
-      }
-    err = _ksba_ber_write_tl (cms->writer, TYPE_SET, CLASS_UNIVERSAL,
-                              1, valuelen);
-    if (!err)
-      err = ksba_writer_write (cms->writer, value, valuelen);
-    xfree (value);
-    if (err)
-      goto leave;
-  }
-
   /* Write 3 end tags */
   err = _ksba_ber_write_tl (cms->writer, 0, 0, 0, 0);
   if (!err)
@@ -3456,9 +4184,6 @@ build_signed_data_rest (ksba_cms_t cms)
 
  leave:
   ksba_asn_tree_release (cms_tree);
-  _ksba_asn_release_nodes (root);
-  ksba_writer_release (tmpwrt);
-  _ksba_der_release (dbld);
   return err;
 }
 
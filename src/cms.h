@@ -66,6 +66,13 @@ struct oidlist_s {
   char *oid;
 };
 
+/* An additional hash function for the content.  */
+struct hash_fnc_list_s {
+  struct hash_fnc_list_s *next;
+  void (*fnc)(void *, const void *, size_t);
+  void *arg;
+};
+
 /* A structure to store an OID and a parameter. */
 struct oidparmlist_s {
   struct oidparmlist_s *next;
@@ -96,6 +103,8 @@ struct signer_info_s {
   size_t imagelen;
   struct {
     char *digest_algo;
+    unsigned char *attrs;  /* The signed attributes with a SET tag.  */
+    ksba_sexp_t sigval;
   } cache;
 };
 
@@ -113,12 +122,14 @@ struct sig_val_s {
 
 struct ksba_cms_s {
   gpg_error_t last_error;
+  ksba_alloc_ctx_t alloc_ctx;  /* The allocator context or NULL.  */
 
   ksba_reader_t reader;
   ksba_writer_t writer;
 
   void (*hash_fnc)(void *, const void *, size_t);
   void *hash_fnc_arg;
+  struct hash_fnc_list_s *more_hash_fncs;
 
   ksba_stop_reason_t stop_reason;
 
@@ -153,6 +164,8 @@ struct ksba_cms_s {
 
   struct certlist_s *cert_info_list; /* A list with certificates intended
                                         to be send with a signed message */
+  int certs_written;  /* The certificates have been written out.  */
+  ksba_certstore_t certstore;  /* Store to look up parsed certificates.  */
 
   struct oidparmlist_s *capability_list; /* A list of S/MIME capabilities. */
 
@@ -163,6 +176,14 @@ struct ksba_cms_s {
   struct sig_val_s *sig_val;
 
   struct enc_val_s *enc_val;
+
+  /* State of the content copy loop.  This allows to resume the loop
+     after a non-blocking reader ran out of data.  */
+  struct {
+    int state;
+    unsigned long nleft;
+    unsigned char *buffer;  /* Used if the reader can't be peeked.  */
+  } cont;
 };
 
 
@@ -40,6 +40,10 @@ gpg_error_t _ksba_assert_time_format (const ksba_isotime_t atime);
 void _ksba_copy_time (ksba_isotime_t d, const ksba_isotime_t s);
 int _ksba_cmp_time (const ksba_isotime_t a, const ksba_isotime_t b);
 int _ksba_current_time (ksba_isotime_t timebuf);
+gpg_error_t _ksba_isotime_to_epoch (const ksba_isotime_t atime,
+                                    ksba_epoch_t *r_epoch);
+gpg_error_t _ksba_asntime_to_epoch (const char *buffer, size_t length,
+                                    int is_utctime, ksba_epoch_t *r_epoch);
 
 
 /*-- dn.c --*/
@@ -50,6 +54,94 @@ gpg_error_t _ksba_derdn_to_str (const unsigned char *der, size_t derlen,
 gpg_error_t _ksba_dn_from_str (const char *string, char **rbuf, size_t *rlength);
 
 /*-- oid.c --*/
+
+/* Identifiers of the OIDs in the registry of oid.c.  */
+typedef enum
+  {
+    OID_NONE = 0,   /* Not in the registry.  */
+    OID_AT_COMMON_NAME,
+    OID_AT_SURNAME,
+    OID_AT_SERIAL_NUMBER,
+    OID_AT_COUNTRY_NAME,
+    OID_AT_LOCALITY_NAME,
+    OID_AT_STATE_OR_PROVINCE,
+    OID_AT_STREET_ADDRESS,
+    OID_AT_ORGANIZATION_NAME,
+    OID_AT_ORGANIZATIONAL_UNIT,
+    OID_AT_TITLE,
+    OID_AT_DESCRIPTION,
+    OID_AT_BUSINESS_CATEGORY,
+    OID_AT_POSTAL_ADDRESS,
+    OID_AT_POSTAL_CODE,
+    OID_AT_GIVEN_NAME,
+    OID_AT_PSEUDONYM,
+    OID_AT_DOMAIN_COMPONENT,
+    OID_AT_USERID,
+    OID_AT_EMAIL_ADDRESS,
+    OID_CE_SUBJECT_DIR_ATTRS,
+    OID_CE_SUBJECT_KEY_ID,
+    OID_CE_KEY_USAGE,
+    OID_CE_PRIVATE_KEY_USAGE,
+    OID_CE_SUBJECT_ALT_NAME,
+    OID_CE_ISSUER_ALT_NAME,
+    OID_CE_BASIC_CONSTRAINTS,
+    OID_CE_CRL_NUMBER,
+    OID_CE_CRL_REASON,
+    OID_CE_INVALIDITY_DATE,
+    OID_CE_DELTA_CRL_INDICATOR,
+    OID_CE_ISSUING_DIST_POINT,
+    OID_CE_CERT_ISSUER,
+    OID_CE_NAME_CONSTRAINTS,
+    OID_CE_CRL_DIST_POINTS,
+    OID_CE_CERT_POLICIES,
+    OID_CE_POLICY_MAPPINGS,
+    OID_CE_AUTHORITY_KEY_ID,
+    OID_CE_POLICY_CONSTRAINTS,
+    OID_CE_EXT_KEY_USAGE,
+    OID_CE_FRESHEST_CRL,
+    OID_CE_INHIBIT_ANY_POLICY,
+    OID_PE_AUTHORITY_INFO_ACCESS,
+    OID_PE_QC_STATEMENTS,
+    OID_PE_SUBJECT_INFO_ACCESS,
+    OID_PE_OCSP_NOCHECK,
+    OID_PE_SCT_LIST,
+    OID_CT_DATA,
+    OID_CT_SIGNED_DATA,
+    OID_CT_ENVELOPED_DATA,
+    OID_CT_DIGESTED_DATA,
+    OID_CT_ENCRYPTED_DATA,
+    OID_CT_AUTH_DATA,
+    OID_CT_AUTHENVELOPED_DATA,
+    OID_CT_SPC_IND_DATA_CTX,
+    OID_CT_OPENPGP_KEYBLOCK,
+    OID_CURVE_ED25519,
+    OID_CURVE_X25519,
+    OID_CURVE_ED448,
+    OID_CURVE_X448,
+    OID_CURVE_NIST_P192,
+    OID_CURVE_NIST_P224,
+    OID_CURVE_NIST_P256,
+    OID_CURVE_NIST_P384,
+    OID_CURVE_NIST_P521,
+    OID_CURVE_BRAINPOOL_P160R1,
+    OID_CURVE_BRAINPOOL_P192R1,
+    OID_CURVE_BRAINPOOL_P224R1,
+    OID_CURVE_BRAINPOOL_P256R1,
+    OID_CURVE_BRAINPOOL_P320R1,
+    OID_CURVE_BRAINPOOL_P384R1,
+    OID_CURVE_BRAINPOOL_P512R1,
+    OID_CURVE_GOST2001_A,
+    OID_CURVE_GOST2001_B,
+    OID_CURVE_GOST2001_C,
+    OID_CURVE_GOST2012_A,
+    OID_CURVE_GOST2012_B,
+    OID_CURVE_SECP256K1,
+    OID_LAST
+  }
+oid_id_t;
+
+oid_id_t _ksba_oid_lookup (const void *der, size_t derlen);
+const char *_ksba_oid_id_to_str (oid_id_t id);
 char *_ksba_oid_node_to_str (const unsigned char *image, AsnNode node);
 gpg_error_t _ksba_oid_from_buf (const void *buffer, size_t buflen,
                                 unsigned char **rbuf, size_t *rlength);
@@ -43,21 +43,83 @@
 #include "ber-help.h"
 #include "ber-decoder.h"
 #include "crl.h"
+#include "reader.h"
 #include "stringbuf.h"
 
 
 static const char oidstr_crlNumber[] = "2.5.29.20";
 static const char oidstr_crlReason[] = "2.5.29.21";
+static const char oidstr_deltaCRLIndicator[] = "2.5.29.27";
 #if 0
 static const char oidstr_issuingDistributionPoint[] = "2.5.29.28";
 #endif
 static const char oidstr_certificateIssuer[] = "2.5.29.29";
 static const char oidstr_authorityKeyIdentifier[] = "2.5.29.35";
 
-/* We better buffer the hashing. */
+/* Pass all pending data to the hash function.  */
+static void
+flush_hash (ksba_crl_t crl)
+{
+  if (crl->hash_fnc)
+    {
+      if (crl->hashbuf.used)
+        crl->hash_fnc (crl->hash_fnc_arg,
+                       crl->hashbuf.buffer, crl->hashbuf.used);
+      if (crl->hashbuf.spanlen)
+        crl->hash_fnc (crl->hash_fnc_arg,
+                       crl->hashbuf.span, crl->hashbuf.spanlen);
+      STATS_ADD (hash_bytes, crl->hashbuf.used + crl->hashbuf.spanlen);
+    }
+  crl->hashbuf.used = 0;
+  crl->hashbuf.span = NULL;
+  crl->hashbuf.spanlen = 0;
+}
+
+
+/* If the reader is memory backed try to find the LENGTH bytes at
+   BUFFER in the reader's memory right after the pending span or, if
+   there is none, right before the read position and add them to the
+   span.  Usually BUFFER already points into that memory; only short
+   copies like a TL header need to be compared.  Returns true if the
+   data has been added.  */
+static int
+hash_from_mem (ksba_crl_t crl, const void *buffer, size_t length)
+{
+  const unsigned char *mem;
+  size_t used, off;
+
+  if (crl->resume.active
+      || !_ksba_reader_get_mem (crl->reader, &mem, &used))
+    return 0;
+
+  if (crl->hashbuf.span)
+    off = crl->hashbuf.span + crl->hashbuf.spanlen - mem;
+  else if (used >= length)
+    off = used - length;
+  else
+    return 0;
+  if (off > used || length > used - off)
+    return 0;
+  if (mem + off != buffer && memcmp (mem + off, buffer, length))
+    return 0;
+
+  if (!crl->hashbuf.span)
+    crl->hashbuf.span = mem + off;
+  crl->hashbuf.spanlen += length;
+  return 1;
+}
+
+
+/* We better buffer the hashing.  Data available in the memory of the
+   reader is hashed directly from there.  */
 static inline void
 do_hash (ksba_crl_t crl, const void *buffer, size_t length)
 {
+  if (hash_from_mem (crl, buffer, length))
+    return;
+  if (crl->hashbuf.span)
+    flush_hash (crl);
+
   while (length)
     {
       size_t n = length;
@@ -68,10 +130,30 @@ do_hash (ksba_crl_t crl, const void *buffer, size_t length)
       crl->hashbuf.used += n;
       if (crl->hashbuf.used == sizeof crl->hashbuf.buffer)
         {
+          int keep = 0;
+
+          /* Data hashed in a parse step which may need to be repeated
+             must not yet be passed to the hash function.  */
+          if (crl->resume.active)
+            {
+              keep = crl->hashbuf.used - crl->resume.hashused;
+              if (keep == crl->hashbuf.used)
+                {
+                  keep = 0;
+                  crl->resume.broken = 1;
+                }
+              crl->resume.hashused = 0;
+            }
           if (crl->hash_fnc)
-            crl->hash_fnc (crl->hash_fnc_arg,
-                           crl->hashbuf.buffer, crl->hashbuf.used);
-          crl->hashbuf.used = 0;
+            {
+              crl->hash_fnc (crl->hash_fnc_arg,
+                             crl->hashbuf.buffer, crl->hashbuf.used - keep);
+              STATS_ADD (hash_bytes, crl->hashbuf.used - keep);
+            }
+          if (keep)
+            memmove (crl->hashbuf.buffer,
+                     crl->hashbuf.buffer + crl->hashbuf.used - keep, keep);
+          crl->hashbuf.used = keep;
         }
       buffer = (const char *)buffer + n;
       length -= n;
@@ -95,6 +177,7 @@ ksba_crl_new (ksba_crl_t *r_crl)
   *r_crl = xtrycalloc (1, sizeof **r_crl);
   if (!*r_crl)
     return gpg_error_from_errno (errno);
+  (*r_crl)->alloc_ctx = _ksba_alloc_ctx_current ();
   return 0;
 }
 
@@ -108,8 +191,12 @@ ksba_crl_new (ksba_crl_t *r_crl)
 void
 ksba_crl_release (ksba_crl_t crl)
 {
+  ksba_alloc_ctx_t actx, prevctx;
+
   if (!crl)
     return;
+  actx = crl->alloc_ctx;
+  prevctx = _ksba_alloc_ctx_switch (actx);
   xfree (crl->algo.oid);
   xfree (crl->algo.parm);
 
@@ -117,6 +204,7 @@ ksba_crl_release (ksba_crl_t crl)
   xfree (crl->issuer.image);
 
   xfree (crl->item.serial);
+  xfree (crl->batch.buffer);
 
   xfree (crl->sigval);
   while (crl->extension_list)
@@ -128,6 +216,8 @@ ksba_crl_release (ksba_crl_t crl)
     }
 
   xfree (crl);
+  _ksba_alloc_ctx_restore (prevctx);
+  ksba_alloc_ctx_release (actx);
 }
 
 
@@ -405,11 +495,10 @@ ksba_crl_get_auth_key_id (ksba_crl_t crl,
 }
 
 
-/* Return the optional crlNumber in NUMBER or GPG_ERR_NO_DATA if it is
-   not available.  Caller must release NUMBER if the fuction retruned
-   with success. */
-gpg_error_t
-ksba_crl_get_crl_number (ksba_crl_t crl, ksba_sexp_t *number)
+/* Return the value of the INTEGER extension OIDSTR in NUMBER or
+   GPG_ERR_NO_DATA if it is not available.  */
+static gpg_error_t
+get_number_extension (ksba_crl_t crl, const char *oidstr, ksba_sexp_t *number)
 {
   gpg_error_t err;
   size_t derlen;
@@ -424,7 +513,7 @@ ksba_crl_get_crl_number (ksba_crl_t crl, ksba_sexp_t *number)
   *number = NULL;
 
   for (e=crl->extension_list; e; e = e->next)
-    if (!strcmp (e->oid, oidstr_crlNumber))
+    if (!strcmp (e->oid, oidstr))
       break;
   if (!e)
     return gpg_error (GPG_ERR_NO_DATA); /* not available */
@@ -434,7 +523,7 @@ ksba_crl_get_crl_number (ksba_crl_t crl, ksba_sexp_t *number)
     crl_extn_t e2;
 
     for (e2 = e->next; e2; e2 = e2->next)
-      if (!strcmp (e2->oid, oidstr_crlNumber))
+      if (!strcmp (e2->oid, oidstr))
         return gpg_error (GPG_ERR_DUP_VALUE);
   }
 
@@ -459,6 +548,37 @@ ksba_crl_get_crl_number (ksba_crl_t crl, ksba_sexp_t *number)
 }
 
 
+/* Return the optional crlNumber in NUMBER or GPG_ERR_NO_DATA if it is
+   not available.  Caller must release NUMBER if the fuction retruned
+   with success. */
+gpg_error_t
+ksba_crl_get_crl_number (ksba_crl_t crl, ksba_sexp_t *number)
+{
+  return get_number_extension (crl, oidstr_crlNumber, number);
+}
+
+
+/**
+ * ksba_crl_get_delta_base:
+ * @crl: CRL object
+ * @r_number: Receives the number of the base CRL
+ *
+ * Check whether @crl is a delta CRL and return the number of the base
+ * CRL from its deltaCRLIndicator extension at @r_number.  The entries
+ * of a delta CRL may be applied to an index of a base CRL whose
+ * crlNumber is at least @r_number using ksba_crl_index_apply_delta.
+ * The caller must release @r_number.
+ *
+ * Return value: 0 on success, GPG_ERR_NO_DATA if @crl is not a delta
+ * CRL or another error code.
+ **/
+gpg_error_t
+ksba_crl_get_delta_base (ksba_crl_t crl, ksba_sexp_t *r_number)
+{
+  return get_number_extension (crl, oidstr_deltaCRLIndicator, r_number);
+}
+
+
 
 
 /**
@@ -519,10 +639,21 @@ ksba_crl_get_item (ksba_crl_t crl, ksba_sexp_t *r_serial,
 
   if (r_serial)
     {
-      if (!crl->item.serial)
+      char numbuf[22];
+      size_t numbuflen;
+
+      *r_serial = NULL;
+      if (!crl->item.seriallen)
         return gpg_error (GPG_ERR_NO_DATA);
-      *r_serial = crl->item.serial;
-      crl->item.serial = NULL;
+      sprintf (numbuf,"(%u:", (unsigned int)crl->item.seriallen);
+      numbuflen = strlen (numbuf);
+      *r_serial = xtrymalloc (numbuflen + crl->item.seriallen + 2);
+      if (!*r_serial)
+        return gpg_error (GPG_ERR_ENOMEM);
+      strcpy (*r_serial, numbuf);
+      memcpy (*r_serial+numbuflen, crl->item.serial, crl->item.seriallen);
+      (*r_serial)[numbuflen + crl->item.seriallen] = ')';
+      (*r_serial)[numbuflen + crl->item.seriallen + 1] = 0;
     }
    if (r_revocation_date)
     _ksba_copy_time (r_revocation_date, crl->item.revocation_date);
@@ -532,6 +663,58 @@ ksba_crl_get_item (ksba_crl_t crl, ksba_sexp_t *r_serial,
 }
 
 
+/**
+ * ksba_crl_get_update_epoch:
+ * @crl: CRL object
+ * @what: 0 for thisUpdate, 1 for nextUpdate
+ * @r_epoch: Returns the time
+ *
+ * Return the thisUpdate or nextUpdate time as seconds since the
+ * Epoch.  The times are converted while parsing.
+ *
+ * Return value: 0 on success, GPG_ERR_NO_VALUE if the CRL has no
+ * nextUpdate time or another error code.
+ **/
+gpg_error_t
+ksba_crl_get_update_epoch (ksba_crl_t crl, int what, ksba_epoch_t *r_epoch)
+{
+  if (!crl || what < 0 || what > 1 || !r_epoch)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_epoch = 0;
+  if (!*crl->this_update)
+    return gpg_error (GPG_ERR_INV_TIME);
+  if (what == 1 && !*crl->next_update)
+    return gpg_error (GPG_ERR_NO_VALUE);
+  *r_epoch = what? crl->next_update_epoch : crl->this_update_epoch;
+  return 0;
+}
+
+
+/**
+ * ksba_crl_get_item_epoch:
+ * @crl: CRL object
+ * @r_epoch: Returns the revocation date
+ *
+ * Return the revocation date of the current item as seconds since the
+ * Epoch.  Unlike ksba_crl_get_item this function may be called any
+ * number of times after the parse function came back with
+ * %KSBA_SR_GOT_ITEM.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_get_item_epoch (ksba_crl_t crl, ksba_epoch_t *r_epoch)
+{
+  if (!crl || !r_epoch)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_epoch = 0;
+  if (!*crl->item.revocation_date)
+    return gpg_error (GPG_ERR_INV_TIME);
+  *r_epoch = crl->item.revocation_epoch;
+  return 0;
+}
+
+
 
 /**
  * ksba_crl_get_sig_val:
@@ -627,6 +810,51 @@ read_buffer (ksba_reader_t reader, char *buffer, size_t count)
   return 0;
 }
 
+/* Make the next COUNT bytes of READER available at R_BUF.  If the
+   reader is memory backed R_BUF is set to point into the reader's
+   buffer and no copy is done; in all other cases the data is read
+   into BUFFER which must be large enough.  The returned pointer is
+   only valid until the next read from READER.  Return 0 on
+   success.  */
+static int
+read_value (ksba_reader_t reader, unsigned char *buffer, size_t count,
+            const unsigned char **r_buf)
+{
+  const unsigned char *p;
+  size_t n;
+
+  if (!ksba_reader_peek (reader, &p, &n) && n >= count)
+    {
+      *r_buf = p;
+      return ksba_reader_consume (reader, count)? -1 : 0;
+    }
+  *r_buf = buffer;
+  return read_buffer (reader, buffer, count);
+}
+
+
+/* Make the complete TLV whose header TI has just been read from
+   READER available at R_TLV.  START and STARTLEN are the values
+   returned by ksba_reader_peek right before the header was read or
+   NULL if that function failed.  If they cover the entire TLV no copy
+   is done; otherwise the TLV is assembled in BUFFER which must be at
+   least TI->NHDR + TI->LENGTH bytes long.  Return 0 on success.  */
+static int
+read_tlv (ksba_reader_t reader, const struct tag_info *ti,
+          const unsigned char *start, size_t startlen,
+          unsigned char *buffer, const unsigned char **r_tlv)
+{
+  if (start && startlen >= ti->nhdr + ti->length)
+    {
+      *r_tlv = start;
+      return ksba_reader_consume (reader, ti->length)? -1 : 0;
+    }
+  memcpy (buffer, ti->buf, ti->nhdr);
+  *r_tlv = buffer;
+  return read_buffer (reader, buffer + ti->nhdr, ti->length);
+}
+
+
 /* Create a new decoder and run it for the given element */
 /* Fixme: this code is duplicated from cms-parser.c */
 static gpg_error_t
@@ -642,33 +870,25 @@ create_and_run_decoder (ksba_reader_t reader, const char *elem_name,
   if (err)
     return err;
 
-  decoder = _ksba_ber_decoder_new ();
+  decoder = _ksba_reader_get_decoder (reader);
   if (!decoder)
     {
       ksba_asn_tree_release (crl_tree);
       return gpg_error (GPG_ERR_ENOMEM);
     }
 
-  err = _ksba_ber_decoder_set_reader (decoder, reader);
-  if (err)
-    {
-      ksba_asn_tree_release (crl_tree);
-      _ksba_ber_decoder_release (decoder);
-      return err;
-    }
-
   err = _ksba_ber_decoder_set_module (decoder, crl_tree);
   if (err)
     {
       ksba_asn_tree_release (crl_tree);
-      _ksba_ber_decoder_release (decoder);
+      _ksba_reader_put_decoder (reader, decoder);
       return err;
     }
 
   err = _ksba_ber_decoder_decode (decoder, elem_name, 0,
                                   r_root, r_image, r_imagelen);
 
-  _ksba_ber_decoder_release (decoder);
+  _ksba_reader_put_decoder (reader, decoder);
   ksba_asn_tree_release (crl_tree);
   return err;
 }
@@ -782,6 +1002,7 @@ parse_to_next_update (ksba_crl_t crl)
   int outer_ndef, tbs_ndef;
   int c;
   unsigned char tmpbuf[500]; /* for OID or algorithmIdentifier */
+  const unsigned char *value;
   size_t nread;
 
   /* read the outer sequence */
@@ -941,13 +1162,14 @@ parse_to_next_update (ksba_crl_t crl)
     }
   if (ti.nhdr + ti.length >= DIM(tmpbuf))
     return gpg_error (GPG_ERR_TOO_LARGE);
-  memcpy (tmpbuf, ti.buf, ti.nhdr);
-  err = read_buffer (crl->reader, tmpbuf+ti.nhdr, ti.length);
+  HASH (ti.buf, ti.nhdr);
+  err = read_value (crl->reader, tmpbuf, ti.length, &value);
   if (err)
     return err;
-  HASH (tmpbuf, ti.nhdr+ti.length);
-  _ksba_asntime_to_iso (tmpbuf+ti.nhdr, ti.length,
+  HASH (value, ti.length);
+  _ksba_asntime_to_iso (value, ti.length,
                         ti.tag == TYPE_UTC_TIME, crl->this_update);
+  _ksba_isotime_to_epoch (crl->this_update, &crl->this_update_epoch);
 
   /* Read the optional nextUpdate time. */
   err = _ksba_ber_read_tl (crl->reader, &ti);
@@ -968,13 +1190,14 @@ parse_to_next_update (ksba_crl_t crl)
         }
       if (ti.nhdr + ti.length >= DIM(tmpbuf))
         return gpg_error (GPG_ERR_TOO_LARGE);
-      memcpy (tmpbuf, ti.buf, ti.nhdr);
-      err = read_buffer (crl->reader, tmpbuf+ti.nhdr, ti.length);
+      HASH (ti.buf, ti.nhdr);
+      err = read_value (crl->reader, tmpbuf, ti.length, &value);
       if (err)
         return err;
-      HASH (tmpbuf, ti.nhdr+ti.length);
-      _ksba_asntime_to_iso (tmpbuf+ti.nhdr, ti.length,
+      HASH (value, ti.length);
+      _ksba_asntime_to_iso (value, ti.length,
                             ti.tag == TYPE_UTC_TIME, crl->next_update);
+      _ksba_isotime_to_epoch (crl->next_update, &crl->next_update_epoch);
       err = _ksba_ber_read_tl (crl->reader, &ti);
       if (err)
         return err;
@@ -1018,9 +1241,9 @@ parse_to_next_update (ksba_crl_t crl)
 
 
 
-/* Store an entry extension into the current item. */
+/* Store an entry extension into the reason code REASON of an item.  */
 static gpg_error_t
-store_one_entry_extension (ksba_crl_t crl,
+store_one_entry_extension (ksba_crl_reason_t *reason,
                            const unsigned char *der, size_t derlen)
 {
   gpg_error_t err;
@@ -1044,18 +1267,17 @@ store_one_entry_extension (ksba_crl_t crl,
          repeated we can track all reason codes. */
       switch (*buf)
         {
-        case  0: crl->item.reason |= KSBA_CRLREASON_UNSPECIFIED; break;
-        case  1: crl->item.reason |= KSBA_CRLREASON_KEY_COMPROMISE; break;
-        case  2: crl->item.reason |= KSBA_CRLREASON_CA_COMPROMISE; break;
-        case  3: crl->item.reason |= KSBA_CRLREASON_AFFILIATION_CHANGED; break;
-        case  4: crl->item.reason |= KSBA_CRLREASON_SUPERSEDED; break;
-        case  5: crl->item.reason |= KSBA_CRLREASON_CESSATION_OF_OPERATION;
-          break;
-        case  6: crl->item.reason |= KSBA_CRLREASON_CERTIFICATE_HOLD; break;
-        case  8: crl->item.reason |= KSBA_CRLREASON_REMOVE_FROM_CRL; break;
-        case  9: crl->item.reason |= KSBA_CRLREASON_PRIVILEGE_WITHDRAWN; break;
-        case 10: crl->item.reason |= KSBA_CRLREASON_AA_COMPROMISE; break;
-        default: crl->item.reason |= KSBA_CRLREASON_OTHER; break;
+        case  0: *reason |= KSBA_CRLREASON_UNSPECIFIED; break;
+        case  1: *reason |= KSBA_CRLREASON_KEY_COMPROMISE; break;
+        case  2: *reason |= KSBA_CRLREASON_CA_COMPROMISE; break;
+        case  3: *reason |= KSBA_CRLREASON_AFFILIATION_CHANGED; break;
+        case  4: *reason |= KSBA_CRLREASON_SUPERSEDED; break;
+        case  5: *reason |= KSBA_CRLREASON_CESSATION_OF_OPERATION; break;
+        case  6: *reason |= KSBA_CRLREASON_CERTIFICATE_HOLD; break;
+        case  8: *reason |= KSBA_CRLREASON_REMOVE_FROM_CRL; break;
+        case  9: *reason |= KSBA_CRLREASON_PRIVILEGE_WITHDRAWN; break;
+        case 10: *reason |= KSBA_CRLREASON_AA_COMPROMISE; break;
+        default: *reason |= KSBA_CRLREASON_OTHER; break;
         }
     }
   if (!strcmp (oid, oidstr_certificateIssuer))
@@ -1082,8 +1304,7 @@ parse_crl_entry (ksba_crl_t crl, int *got_entry)
   unsigned long len;
   int ndef;
   unsigned char tmpbuf[4096]; /* for time, serial number and extensions */
-  char numbuf[22];
-  int numbuflen;
+  const unsigned char *value;
 
   /* Check the length to see whether we are at the end of the seq but do
      this only when we know that we have this optional seq of seq. */
@@ -1128,22 +1349,25 @@ parse_crl_entry (ksba_crl_t crl, int *got_entry)
     }
   if (ti.nhdr + ti.length >= DIM(tmpbuf))
     return gpg_error (GPG_ERR_TOO_LARGE);
-  memcpy (tmpbuf, ti.buf, ti.nhdr);
-  err = read_buffer (crl->reader, tmpbuf+ti.nhdr, ti.length);
+  HASH (ti.buf, ti.nhdr);
+  err = read_value (crl->reader, tmpbuf, ti.length, &value);
   if (err)
     return err;
-  HASH (tmpbuf, ti.nhdr+ti.length);
+  HASH (value, ti.length);
 
-  xfree (crl->item.serial);
-  sprintf (numbuf,"(%u:", (unsigned int)ti.length);
-  numbuflen = strlen (numbuf);
-  crl->item.serial = xtrymalloc (numbuflen + ti.length + 2);
-  if (!crl->item.serial)
-    return gpg_error (GPG_ERR_ENOMEM);
-  strcpy (crl->item.serial, numbuf);
-  memcpy (crl->item.serial+numbuflen, tmpbuf+ti.nhdr, ti.length);
-  crl->item.serial[numbuflen + ti.length] = ')';
-  crl->item.serial[numbuflen + ti.length + 1] = 0;
+  /* The buffer for the serial number is reused for all entries.  */
+  crl->item.seriallen = 0;
+  if (ti.length > crl->item.serialsize)
+    {
+      xfree (crl->item.serial);
+      crl->item.serialsize = 0;
+      crl->item.serial = xtrymalloc (ti.length < 64? 64 : ti.length);
+      if (!crl->item.serial)
+        return gpg_error (GPG_ERR_ENOMEM);
+      crl->item.serialsize = ti.length < 64? 64 : ti.length;
+    }
+  memcpy (crl->item.serial, value, ti.length);
+  crl->item.seriallen = ti.length;
   crl->item.reason = 0;
 
   /* get the revocation time */
@@ -1165,14 +1389,16 @@ parse_crl_entry (ksba_crl_t crl, int *got_entry)
     }
   if (ti.nhdr + ti.length >= DIM(tmpbuf))
     return gpg_error (GPG_ERR_TOO_LARGE);
-  memcpy (tmpbuf, ti.buf, ti.nhdr);
-  err = read_buffer (crl->reader, tmpbuf+ti.nhdr, ti.length);
+  HASH (ti.buf, ti.nhdr);
+  err = read_value (crl->reader, tmpbuf, ti.length, &value);
   if (err)
     return err;
-  HASH (tmpbuf, ti.nhdr+ti.length);
+  HASH (value, ti.length);
 
-  _ksba_asntime_to_iso (tmpbuf+ti.nhdr, ti.length,
+  _ksba_asntime_to_iso (value, ti.length,
                         ti.tag == TYPE_UTC_TIME, crl->item.revocation_date);
+  _ksba_isotime_to_epoch (crl->item.revocation_date,
+                          &crl->item.revocation_epoch);
 
   /* if there is still space we must parse the optional entryExtensions */
   if (ndef)
@@ -1198,6 +1424,11 @@ parse_crl_entry (ksba_crl_t crl, int *got_entry)
       /* now loop over the extensions */
       while (len)
         {
+          const unsigned char *start;
+          size_t startlen;
+
+          if (ksba_reader_peek (crl->reader, &start, &startlen))
+            start = NULL;
           err = _ksba_ber_read_tl (crl->reader, &ti);
           if (err)
             return err;
@@ -1214,12 +1445,12 @@ parse_crl_entry (ksba_crl_t crl, int *got_entry)
           len -= ti.length;
           if (ti.nhdr + ti.length >= DIM(tmpbuf))
             return gpg_error (GPG_ERR_TOO_LARGE);
-          memcpy (tmpbuf, ti.buf, ti.nhdr);
-          err = read_buffer (crl->reader, tmpbuf+ti.nhdr, ti.length);
+          err = read_tlv (crl->reader, &ti, start, startlen, tmpbuf, &value);
           if (err)
             return err;
-          HASH (tmpbuf, ti.nhdr+ti.length);
-          err = store_one_entry_extension (crl, tmpbuf, ti.nhdr+ti.length);
+          HASH (value, ti.nhdr+ti.length);
+          err = store_one_entry_extension (&crl->item.reason,
+                                           value, ti.nhdr+ti.length);
           if (err)
             return err;
         }
@@ -1362,8 +1593,37 @@ parse_signature (ksba_crl_t crl)
 }
 
 
+/* Undo the changes done by a parse step which needs to be repeated
+   because the reader would block.  START_STATE is set for the first
+   step.  EXTN is the extension list as it was before the step.  */
+static void
+rollback_step (ksba_crl_t crl, int start_state, crl_extn_t extn)
+{
+  if (start_state)
+    {
+      _ksba_asn_release_nodes (crl->issuer.root);
+      crl->issuer.root = NULL;
+      xfree (crl->issuer.image);
+      crl->issuer.image = NULL;
+      crl->issuer.imagelen = 0;
+    }
+  crl->state = crl->resume.state;
+  while (crl->extension_list && crl->extension_list != extn)
+    {
+      crl_extn_t tmp = crl->extension_list->next;
+      xfree (crl->extension_list->oid);
+      xfree (crl->extension_list);
+      crl->extension_list = tmp;
+    }
+  crl->hashbuf.used = crl->resume.hashused;
+}
+
+
 /* The actual parser which should be used with a new CRL object and
-   run in a loop until the the KSBA_SR_READY is encountered */
+   run in a loop until the the KSBA_SR_READY is encountered.  If the
+   reader is in non-blocking mode KSBA_SR_WOULD_BLOCK may be returned
+   as stop reason; the function shall then be called again with this
+   stop reason once more data is available. */
 gpg_error_t
 ksba_crl_parse (ksba_crl_t crl, ksba_stop_reason_t *r_stopreason)
 {
@@ -1376,6 +1636,7 @@ ksba_crl_parse (ksba_crl_t crl, ksba_stop_reason_t *r_stopreason)
   ksba_stop_reason_t stop_reason;
   gpg_error_t err = 0;
   int got_entry = 0;
+  crl_extn_t extn;
 
   if (!crl || !r_stopreason)
     return gpg_error (GPG_ERR_INV_VALUE);
@@ -1388,6 +1649,8 @@ ksba_crl_parse (ksba_crl_t crl, ksba_stop_reason_t *r_stopreason)
 
   /* Calculate state from last reason */
   stop_reason = *r_stopreason;
+  if (stop_reason == KSBA_SR_WOULD_BLOCK)
+    stop_reason = crl->resume.stop_reason;
   *r_stopreason = KSBA_SR_RUNNING;
   switch (stop_reason)
     {
@@ -1411,6 +1674,13 @@ ksba_crl_parse (ksba_crl_t crl, ksba_stop_reason_t *r_stopreason)
   if (err)
     return err;
 
+  /* Prepare for repeating this step.  */
+  crl->resume.active = _ksba_reader_mark (crl->reader);
+  crl->resume.broken = 0;
+  crl->resume.hashused = crl->hashbuf.used;
+  crl->resume.state = crl->state;
+  extn = crl->extension_list;
+
   /* Do the action */
   switch (state)
     {
@@ -1422,19 +1692,31 @@ ksba_crl_parse (ksba_crl_t crl, ksba_stop_reason_t *r_stopreason)
       break;
     case sCRLEXT:
       err = parse_crl_extensions (crl);
+      if (!err)
+        err = parse_signature (crl);
       if (!err)
         {
-          if (crl->hash_fnc && crl->hashbuf.used)
-            crl->hash_fnc (crl->hash_fnc_arg,
-                           crl->hashbuf.buffer, crl->hashbuf.used);
-          crl->hashbuf.used = 0;
-          err = parse_signature (crl);
+          flush_hash (crl);
         }
       break;
     default:
       err = gpg_error (GPG_ERR_INV_STATE);
       break;
     }
+
+  if (crl->resume.active)
+    {
+      crl->resume.active = 0;
+      if (err && _ksba_reader_would_block (crl->reader)
+          && !crl->resume.broken && !_ksba_reader_rewind (crl->reader))
+        {
+          rollback_step (crl, state == sSTART, extn);
+          crl->resume.stop_reason = stop_reason;
+          *r_stopreason = KSBA_SR_WOULD_BLOCK;
+          return 0;
+        }
+      _ksba_reader_unmark (crl->reader);
+    }
   if (err)
     return err;
 
@@ -1454,6 +1736,381 @@ ksba_crl_parse (ksba_crl_t crl, ksba_stop_reason_t *r_stopreason)
       break;
     }
 
+  /* Individual entries are not traced.  */
+  if (stop_reason != KSBA_SR_GOT_ITEM)
+    STATS_TRACE ("crl", stop_reason);
   *r_stopreason = stop_reason;
   return 0;
 }
+
+
+/**
+ * ksba_crl_build_index:
+ * @crl: CRL object
+ * @idx: The index to fill
+ * @r_stopreason: The stop reason as used with ksba_crl_parse
+ *
+ * Parse the CRL like ksba_crl_parse but put all entries into @idx
+ * instead of returning with %KSBA_SR_GOT_ITEM for each of them.  The
+ * function may be used in place of ksba_crl_parse, usually after it
+ * came back with %KSBA_SR_BEGIN_ITEMS, and returns with
+ * %KSBA_SR_END_ITEMS after the last entry; the parsing is then
+ * completed with ksba_crl_parse.  %KSBA_SR_WOULD_BLOCK may be
+ * returned as with ksba_crl_parse.  If a serial number is listed more
+ * than once the first entry is kept.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_build_index (ksba_crl_t crl, ksba_crl_index_t idx,
+                      ksba_stop_reason_t *r_stopreason)
+{
+  gpg_error_t err;
+
+  if (!crl || !idx || !r_stopreason)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  do
+    {
+      err = ksba_crl_parse (crl, r_stopreason);
+      if (err)
+        return err;
+      if (*r_stopreason != KSBA_SR_GOT_ITEM)
+        continue;
+
+      err = ksba_crl_index_add (idx, crl->item.serial, crl->item.seriallen,
+                                crl->item.reason,
+                                crl->item.revocation_epoch);
+      if (gpg_err_code (err) == GPG_ERR_DUP_VALUE)
+        err = 0;
+      if (err)
+        return err;
+    }
+  while (*r_stopreason == KSBA_SR_BEGIN_ITEMS
+         || *r_stopreason == KSBA_SR_GOT_ITEM);
+
+  return 0;
+}
+
+
+/**
+ * ksba_crl_get_items:
+ * @crl: CRL object
+ * @entries: An array to receive the entries
+ * @nentries: The number of elements of @entries
+ * @r_count: Receives the number of returned entries
+ * @r_stopreason: The stop reason as used with ksba_crl_parse
+ *
+ * Parse the CRL like ksba_crl_parse but return up to @nentries
+ * entries in one call instead of returning with %KSBA_SR_GOT_ITEM
+ * for each of them.  The serial numbers are stored in a buffer of
+ * @crl which is reused by the next call; they are thus only valid
+ * until then.  The stop reason is %KSBA_SR_GOT_ITEM if the array has
+ * been filled and more entries may follow, and %KSBA_SR_END_ITEMS
+ * after the last entry; the parsing is then completed with
+ * ksba_crl_parse.  With %KSBA_SR_WOULD_BLOCK the entries parsed so
+ * far are returned and the function shall be called again with this
+ * stop reason once more data is available.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_get_items (ksba_crl_t crl, ksba_crl_entry_t entries,
+                    unsigned int nentries, unsigned int *r_count,
+                    ksba_stop_reason_t *r_stopreason)
+{
+  gpg_error_t err = 0;
+  ksba_crl_entry_t e;
+  unsigned char *p;
+  size_t used = 0, n;
+  unsigned int count = 0, i;
+
+  if (!crl || !entries || !nentries || !r_count || !r_stopreason)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_count = 0;
+
+  while (count < nentries)
+    {
+      err = ksba_crl_parse (crl, r_stopreason);
+      if (err)
+        return err;
+      if (*r_stopreason == KSBA_SR_BEGIN_ITEMS)
+        continue;
+      if (*r_stopreason != KSBA_SR_GOT_ITEM)
+        break;
+
+      if (crl->item.seriallen > crl->batch.size - used)
+        {
+          for (n = crl->batch.size? crl->batch.size : 4096;
+               crl->item.seriallen > n - used; n *= 2)
+            ;
+          p = xtryrealloc (crl->batch.buffer, n);
+          if (!p)
+            return gpg_error_from_syserror ();
+          crl->batch.buffer = p;
+          crl->batch.size = n;
+        }
+      memcpy (crl->batch.buffer + used, crl->item.serial, crl->item.seriallen);
+      used += crl->item.seriallen;
+
+      e = entries + count++;
+      e->seriallen = crl->item.seriallen;
+      e->reason = crl->item.reason;
+      e->date = crl->item.revocation_epoch;
+    }
+
+  /* The buffer may have been moved; thus set the pointers now.  */
+  for (i=0, p=crl->batch.buffer; i < count; p += entries[i++].seriallen)
+    entries[i].serial = p;
+  *r_count = count;
+  return 0;
+}
+
+
+/**
+ * ksba_crl_split_items:
+ * @crl: CRL object
+ * @chunks: An array to receive the chunks
+ * @nchunks: The number of elements of @chunks
+ * @r_count: Receives the number of returned chunks
+ * @r_stopreason: The stop reason as used with ksba_crl_parse
+ *
+ * Split the entries of a CRL read from a memory or mmap reader into
+ * up to @nchunks parts of about the same size.  This function may
+ * only be called right after ksba_crl_parse came back with
+ * %KSBA_SR_BEGIN_ITEMS.  It only checks the outer structure of the
+ * entries, hashes them and returns with %KSBA_SR_END_ITEMS; the
+ * parsing is then completed with ksba_crl_parse.  The chunks point
+ * into the memory of the reader and may be decoded in parallel with
+ * ksba_crl_build_index_chunk; they are valid as long as the reader
+ * is not changed.  If the reader does not read from memory or the
+ * entries are not encoded with a definite length GPG_ERR_NOT_SUPPORTED
+ * is returned and the CRL may instead be processed with
+ * ksba_crl_build_index.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_split_items (ksba_crl_t crl, ksba_crl_chunk_t chunks,
+                      unsigned int nchunks, unsigned int *r_count,
+                      ksba_stop_reason_t *r_stopreason)
+{
+  gpg_error_t err;
+  struct tag_info ti;
+  const unsigned char *mem, *p, *start;
+  size_t used, n, total, left, chunksize;
+  unsigned int count = 0;
+
+  if (!crl || !chunks || !nchunks || !r_count || !r_stopreason)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_count = 0;
+  if (*r_stopreason != KSBA_SR_BEGIN_ITEMS)
+    return gpg_error (GPG_ERR_INV_STATE);
+
+  if (!crl->state.have_seqseq
+      || (!crl->state.seqseq_ndef && !crl->state.seqseq_len))
+    {
+      /* No entries at all; the next TL has already been read.  */
+      *r_stopreason = KSBA_SR_END_ITEMS;
+      return 0;
+    }
+  if (crl->state.seqseq_ndef)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  /* The header of the first entry has already been read.  Locate it
+     and all following entries in the memory of the reader.  */
+  ti = crl->state.ti;
+  if (!_ksba_reader_get_mem (crl->reader, &mem, &used)
+      || ksba_reader_peek (crl->reader, &p, &n)
+      || p != mem + used || used < ti.nhdr
+      || memcmp (p - ti.nhdr, ti.buf, ti.nhdr))
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+  total = crl->state.seqseq_len;
+  if (total < ti.nhdr || total - ti.nhdr > n)
+    return gpg_error (GPG_ERR_BAD_BER);
+  start = p - ti.nhdr;
+
+  /* Walk over the entries and start a new chunk each time the
+     current one has reached its share.  */
+  chunksize = (total + nchunks - 1) / nchunks;
+  chunks[0].der = start;
+  p = start;
+  left = total;
+  while (left)
+    {
+      if (count + 1 < nchunks
+          && (size_t)(p - chunks[count].der) >= chunksize)
+        {
+          chunks[count].derlen = p - chunks[count].der;
+          chunks[++count].der = p;
+        }
+      n = left;
+      err = _ksba_ber_parse_tl (&p, &n, &ti);
+      if (err)
+        return err;
+      if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_SEQUENCE
+             && ti.is_constructed) )
+        return gpg_error (GPG_ERR_INV_CRL_OBJ);
+      if (ti.ndef)
+        return gpg_error (GPG_ERR_UNSUPPORTED_ENCODING);
+      if (ti.length > n)
+        return gpg_error (GPG_ERR_BAD_BER);
+      p += ti.length;
+      left = n - ti.length;
+    }
+  chunks[count].derlen = p - chunks[count].der;
+  count++;
+
+  HASH (start, total);
+  if (ksba_reader_consume (crl->reader, total - crl->state.ti.nhdr))
+    return gpg_error (GPG_ERR_BUG);
+  /* Read ahead as done by parse_crl_entry.  */
+  err = _ksba_ber_read_tl (crl->reader, &ti);
+  if (err)
+    return err;
+  crl->state.ti = ti;
+  crl->state.seqseq_len = 0;
+
+  *r_count = count;
+  *r_stopreason = KSBA_SR_END_ITEMS;
+  return 0;
+}
+
+
+/* Parse the entry at *BUF of length *LEN, store it in E and advance
+   BUF and LEN to the next entry.  The serial number of E points into
+   the entry.  This is the memory based version of parse_crl_entry.  */
+static gpg_error_t
+parse_chunk_entry (const unsigned char **buf, size_t *len,
+                   struct ksba_crl_entry_s *e)
+{
+  gpg_error_t err;
+  struct tag_info ti;
+  const unsigned char *p = *buf;
+  size_t n = *len;
+  ksba_isotime_t rdate;
+
+  err = _ksba_ber_parse_tl (&p, &n, &ti);
+  if (err)
+    return err;
+  if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_SEQUENCE
+         && ti.is_constructed) )
+    return gpg_error (GPG_ERR_INV_CRL_OBJ);
+  if (ti.ndef)
+    return gpg_error (GPG_ERR_UNSUPPORTED_ENCODING);
+  if (ti.length > n)
+    return gpg_error (GPG_ERR_BAD_BER);
+  *buf = p + ti.length;
+  *len = n - ti.length;
+  n = ti.length;
+
+  /* get the serial number */
+  err = _ksba_ber_parse_tl (&p, &n, &ti);
+  if (err)
+    return err;
+  if ( !(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_INTEGER
+         && !ti.is_constructed) )
+    return gpg_error (GPG_ERR_INV_CRL_OBJ);
+  if (ti.ndef || ti.length > n)
+    return gpg_error (GPG_ERR_BAD_BER);
+  e->serial = p;
+  e->seriallen = ti.length;
+  e->reason = 0;
+  p += ti.length;
+  n -= ti.length;
+
+  /* get the revocation time */
+  err = _ksba_ber_parse_tl (&p, &n, &ti);
+  if (err)
+    return err;
+  if ( !(ti.class == CLASS_UNIVERSAL
+         && (ti.tag == TYPE_UTC_TIME || ti.tag == TYPE_GENERALIZED_TIME)
+         && !ti.is_constructed) )
+    return gpg_error (GPG_ERR_INV_CRL_OBJ);
+  if (ti.ndef || ti.length > n)
+    return gpg_error (GPG_ERR_BAD_BER);
+  _ksba_asntime_to_iso (p, ti.length, ti.tag == TYPE_UTC_TIME, rdate);
+  _ksba_isotime_to_epoch (rdate, &e->date);
+  p += ti.length;
+  n -= ti.length;
+
+  /* if there is still space we must parse the optional entryExtensions */
+  if (n)
+    {
+      err = _ksba_ber_parse_tl (&p, &n, &ti);
+      if (err)
+        return err;
+      if ( !(ti.class == CLASS_UNIVERSAL
+             && ti.tag == TYPE_SEQUENCE && ti.is_constructed) )
+        return gpg_error (GPG_ERR_INV_CRL_OBJ);
+      if (ti.ndef)
+        return gpg_error (GPG_ERR_UNSUPPORTED_ENCODING);
+      if (ti.length > n)
+        return gpg_error (GPG_ERR_BAD_BER);
+      n = ti.length;
+
+      /* now loop over the extensions */
+      while (n)
+        {
+          const unsigned char *start = p;
+
+          err = _ksba_ber_parse_tl (&p, &n, &ti);
+          if (err)
+            return err;
+          if ( !(ti.class == CLASS_UNIVERSAL
+                 && ti.tag == TYPE_SEQUENCE && ti.is_constructed) )
+            return gpg_error (GPG_ERR_INV_CRL_OBJ);
+          if (ti.ndef)
+            return gpg_error (GPG_ERR_UNSUPPORTED_ENCODING);
+          if (ti.length > n)
+            return gpg_error (GPG_ERR_BAD_BER);
+          err = store_one_entry_extension (&e->reason,
+                                           start, ti.nhdr + ti.length);
+          if (err)
+            return err;
+          p += ti.length;
+          n -= ti.length;
+        }
+    }
+
+  return 0;
+}
+
+
+/**
+ * ksba_crl_build_index_chunk:
+ * @chunk: A chunk as returned by ksba_crl_split_items
+ * @idx: The index to fill
+ *
+ * Decode all entries of @chunk and put them into @idx as done by
+ * ksba_crl_build_index.  This function does not use the CRL object
+ * and may thus be called from several threads at once as long as
+ * each thread uses its own index.  The indices are then combined
+ * using ksba_crl_index_merge in the order of the chunks.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_build_index_chunk (ksba_crl_chunk_t chunk, ksba_crl_index_t idx)
+{
+  gpg_error_t err;
+  struct ksba_crl_entry_s e;
+  const unsigned char *p;
+  size_t n;
+
+  if (!chunk || !idx)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  for (p = chunk->der, n = chunk->derlen; n; )
+    {
+      err = parse_chunk_entry (&p, &n, &e);
+      if (err)
+        return err;
+      err = ksba_crl_index_add (idx, e.serial, e.seriallen, e.reason, e.date);
+      if (gpg_err_code (err) == GPG_ERR_DUP_VALUE)
+        err = 0;
+      if (err)
+        return err;
+    }
+  return 0;
+}
@@ -50,6 +50,7 @@ typedef struct crl_extn_s *crl_extn_t;
 
 struct ksba_crl_s {
   gpg_error_t last_error;
+  ksba_alloc_ctx_t alloc_ctx;  /* The allocator context or NULL.  */
 
   ksba_reader_t reader;
   int any_parse_done;
@@ -57,7 +58,7 @@ struct ksba_crl_s {
   void (*hash_fnc)(void *, const void *, size_t);
   void *hash_fnc_arg;
 
-  struct {
+  struct crl_state_s {
     struct tag_info ti;
     unsigned long outer_len, tbs_len, seqseq_len;
     int outer_ndef, tbs_ndef, seqseq_ndef;
@@ -77,21 +78,45 @@ struct ksba_crl_s {
   } issuer;
   ksba_isotime_t this_update;
   ksba_isotime_t next_update;
+  ksba_epoch_t this_update_epoch;  /* The update times in seconds  */
+  ksba_epoch_t next_update_epoch;  /* since the Epoch.  */
 
   struct {
-    ksba_sexp_t serial;
+    unsigned char *serial;   /* The octets of the serial number.  */
+    size_t seriallen;        /* 0 if there is no serial number.  */
+    size_t serialsize;       /* Allocated size of SERIAL.  */
     ksba_crl_reason_t reason;
     ksba_isotime_t revocation_date;
+    ksba_epoch_t revocation_epoch;
   } item;
 
+  /* The buffer for the serial numbers returned by ksba_crl_get_items.  */
+  struct {
+    unsigned char *buffer;
+    size_t size;
+  } batch;
+
   crl_extn_t extension_list;
   ksba_sexp_t sigval;
 
   struct {
     int used;
     char buffer[8192];
+    /* Data to be hashed directly from the memory of the reader.  It
+       follows the data in BUFFER.  */
+    const unsigned char *span;
+    size_t spanlen;
   } hashbuf;
 
+  /* Used with a non-blocking reader to repeat a parse step.  */
+  struct {
+    int active;      /* The current step may be repeated.  */
+    int broken;      /* Hashed data of this step has been flushed.  */
+    int hashused;    /* Value of HASHBUF.USED at the start of the step. */
+    ksba_stop_reason_t stop_reason; /* The stop reason to resume from. */
+    struct crl_state_s state;       /* STATE at the start of the step.  */
+  } resume;
+
 };
 
 
@@ -0,0 +1,1225 @@
+/* crlindex.c - A hash index of the entries of a CRL
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * KSBA is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copies of the GNU General Public License
+ * and the GNU Lesser General Public License along with this program;
+ * if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The index keeps the serial numbers of the revoked certificates as
+ * the raw octets of their DER encoded INTEGERs in one buffer and
+ * finds them by open addressing with linear probing.  The table is
+ * kept at most half full, so a lookup usually needs one or two
+ * probes.  A written index may also be used in place; a lookup is
+ * then a binary search over its sorted records.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "util.h"
+#include "sexp-parse.h"
+#include "reader.h"
+#include "crlindex.h"
+
+
+/* The initial number of slots.  */
+#define INITIAL_SLOTS 256
+
+/* The magic and version of a written index.  */
+#define INDEX_MAGIC   "KSBACRLI"
+#define INDEX_VERSION 2
+
+/* The size of the fixed header and of one record of a written index
+   and the maximum length of the strings in the header.  */
+#define HEADER_SIZE   56
+#define RECORD_SIZE   16
+#define MAX_INFO_LEN  65536
+
+
+/* Return the FNV-1a hash of the buffer P of length N.  */
+static unsigned int
+hash_buffer (const unsigned char *p, size_t n)
+{
+  unsigned int h = 2166136261u;
+
+  for (; n; n--, p++)
+    h = (h ^ *p) * 16777619u;
+  return h;
+}
+
+
+/* Store the value VAL as an unsigned big endian number of N octets at
+   BUF.  */
+static void
+put_uint (unsigned char *buf, unsigned long long val, int n)
+{
+  while (n--)
+    {
+      buf[n] = val;
+      val >>= 8;
+    }
+}
+
+
+/* Return the unsigned big endian number of N octets at BUF.  */
+static unsigned long long
+get_uint (const unsigned char *buf, int n)
+{
+  unsigned long long val = 0;
+
+  while (n--)
+    val = (val << 8) | *buf++;
+  return val;
+}
+
+
+/* Return the slot of IDX holding SERIAL of length SERIALLEN with the
+   hash HASH or the free slot where it would be inserted.  */
+static unsigned int
+find_slot (ksba_crl_index_t idx, unsigned int hash,
+           const unsigned char *serial, size_t seriallen)
+{
+  unsigned int mask = idx->size - 1;
+  unsigned int slot = hash & mask;
+  struct crl_index_entry_s *e;
+
+  for (; idx->slots[slot]; slot = (slot + 1) & mask)
+    {
+      e = idx->entries + idx->slots[slot] - 1;
+      if (e->hash == hash && e->len == seriallen
+          && !memcmp (idx->serials + e->off, serial, seriallen))
+        break;
+    }
+  return slot;
+}
+
+
+/* Allocate a table of SIZE slots for IDX and put all entries into
+   it.  */
+static gpg_error_t
+rebuild_slots (ksba_crl_index_t idx, unsigned int size)
+{
+  unsigned int *slots, n, mask, slot;
+
+  slots = xtrycalloc (size, sizeof *slots);
+  if (!slots)
+    return gpg_error_from_syserror ();
+  mask = size - 1;
+  for (n=0; n < idx->count; n++)
+    {
+      for (slot = idx->entries[n].hash & mask; slots[slot];
+           slot = (slot + 1) & mask)
+        ;
+      slots[slot] = n + 1;
+    }
+  xfree (idx->slots);
+  idx->slots = slots;
+  idx->size = size;
+  return 0;
+}
+
+
+/* Free SLOT of IDX.  The following entries of the probe sequence are
+   moved up so that find_slot still finds them.  */
+static void
+clear_slot (ksba_crl_index_t idx, unsigned int slot)
+{
+  unsigned int mask = idx->size - 1;
+  unsigned int next, home;
+  int keep;
+
+  for (next = (slot + 1) & mask; idx->slots[next]; next = (next + 1) & mask)
+    {
+      /* Keep the entry if its home slot lies in (SLOT,NEXT].  */
+      home = idx->entries[idx->slots[next] - 1].hash & mask;
+      if (slot <= next)
+        keep = slot < home && home <= next;
+      else
+        keep = slot < home || home <= next;
+      if (keep)
+        continue;
+      idx->slots[slot] = idx->slots[next];
+      slot = next;
+    }
+  idx->slots[slot] = 0;
+}
+
+
+/* Store the serials of IDX in the order of its entries and without
+   unused space.  */
+static gpg_error_t
+compact_serials (ksba_crl_index_t idx)
+{
+  unsigned char *serials;
+  size_t off;
+  unsigned int n;
+
+  serials = xtrymalloc (idx->serialslen? idx->serialslen : 1);
+  if (!serials)
+    return gpg_error_from_syserror ();
+  for (n=0, off=0; n < idx->count; n++)
+    {
+      memcpy (serials + off, idx->serials + idx->entries[n].off,
+              idx->entries[n].len);
+      idx->entries[n].off = off;
+      off += idx->entries[n].len;
+    }
+  xfree (idx->serials);
+  idx->serials = serials;
+  idx->serialslen = off;
+  idx->serialssize = idx->serialslen? idx->serialslen : 1;
+  idx->unused = 0;
+  return 0;
+}
+
+
+/* Remove the entry of IDX in SLOT.  The last entry is moved into its
+   place; its serial is kept where it is.  The serials are compacted
+   once more than half of their space is unused.  */
+static void
+remove_entry (ksba_crl_index_t idx, unsigned int slot)
+{
+  unsigned int n = idx->slots[slot] - 1;
+  struct crl_index_entry_s *e;
+
+  idx->unused += idx->entries[n].len;
+  clear_slot (idx, slot);
+  idx->count--;
+  if (n != idx->count)
+    {
+      e = idx->entries + idx->count;
+      slot = find_slot (idx, e->hash, idx->serials + e->off, e->len);
+      idx->entries[n] = *e;
+      idx->slots[slot] = n + 1;
+    }
+  if (idx->unused > idx->serialslen / 2)
+    compact_serials (idx);  /* On error the space is kept.  */
+}
+
+
+/* Compare two serial numbers.  Shorter ones sort first; this is the
+   order of the records of a written index.  */
+static int
+compare_serials (const unsigned char *a, size_t alen,
+                 const unsigned char *b, size_t blen)
+{
+  if (alen != blen)
+    return alen < blen? -1 : 1;
+  return memcmp (a, b, alen);
+}
+
+
+/* Get the serial number, the reason and the date of entry N of IDX.
+   For a mapped index the record is checked first.  */
+static gpg_error_t
+get_entry (ksba_crl_index_t idx, unsigned int n,
+           const unsigned char **r_serial, size_t *r_seriallen,
+           ksba_crl_reason_t *r_reason, ksba_epoch_t *r_date)
+{
+  const unsigned char *rec;
+  size_t off;
+
+  if (idx->map.records)
+    {
+      rec = idx->map.records + (size_t)n * RECORD_SIZE;
+      off = get_uint (rec, 4);
+      *r_seriallen = get_uint (rec+4, 2);
+      if (off > idx->map.serialslen
+          || *r_seriallen > idx->map.serialslen - off)
+        return gpg_error (GPG_ERR_INV_OBJ);
+      *r_serial = idx->map.serials + off;
+      *r_reason = get_uint (rec+6, 2);
+      *r_date = (ksba_epoch_t)get_uint (rec+8, 8);
+    }
+  else
+    {
+      *r_serial = idx->serials + idx->entries[n].off;
+      *r_seriallen = idx->entries[n].len;
+      *r_reason = idx->entries[n].reason;
+      *r_date = idx->entries[n].date;
+    }
+  return 0;
+}
+
+
+/* Find SERIAL of length SERIALLEN in the mapped index IDX by a binary
+   search over the sorted records and store its entry number at R_N.  */
+static gpg_error_t
+find_mapped (ksba_crl_index_t idx, const unsigned char *serial,
+             size_t seriallen, unsigned int *r_n)
+{
+  gpg_error_t err;
+  unsigned int lo = 0, hi = idx->count, mid;
+  const unsigned char *p;
+  size_t n;
+  ksba_crl_reason_t reason;
+  ksba_epoch_t date;
+  int cmp;
+
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      err = get_entry (idx, mid, &p, &n, &reason, &date);
+      if (err)
+        return err;
+      cmp = compare_serials (serial, seriallen, p, n);
+      if (!cmp)
+        {
+          *r_n = mid;
+          return 0;
+        }
+      if (cmp < 0)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+  return gpg_error (GPG_ERR_NOT_FOUND);
+}
+
+
+/* Make sure that IDX has room for one more entry with a serial of
+   length SERIALLEN.  */
+static gpg_error_t
+reserve (ksba_crl_index_t idx, size_t seriallen)
+{
+  gpg_error_t err;
+  void *p;
+  size_t n;
+
+  if (idx->count == idx->nentries)
+    {
+      n = idx->nentries? 2 * idx->nentries : INITIAL_SLOTS / 2;
+      if (n <= idx->nentries || n > (unsigned int)-1 / 2)
+        return gpg_error (GPG_ERR_TOO_LARGE);
+      p = xtryrealloc (idx->entries, n * sizeof *idx->entries);
+      if (!p)
+        return gpg_error_from_syserror ();
+      idx->entries = p;
+      idx->nentries = n;
+    }
+
+  if (seriallen > idx->serialssize - idx->serialslen)
+    {
+      n = idx->serialssize? idx->serialssize : 4096;
+      while (seriallen > n - idx->serialslen)
+        {
+          if (n * 2 < n)
+            return gpg_error (GPG_ERR_TOO_LARGE);
+          n *= 2;
+        }
+      p = xtryrealloc (idx->serials, n);
+      if (!p)
+        return gpg_error_from_syserror ();
+      idx->serials = p;
+      idx->serialssize = n;
+    }
+
+  if (2 * (idx->count + 1) > idx->size)
+    {
+      err = rebuild_slots (idx, idx->size? 2 * idx->size : INITIAL_SLOTS);
+      if (err)
+        return err;
+    }
+  return 0;
+}
+
+
+/* Clear all data of IDX.  */
+static void
+clear_index (ksba_crl_index_t idx)
+{
+  xfree (idx->entries);
+  xfree (idx->serials);
+  xfree (idx->slots);
+  xfree (idx->info.issuer);
+  xfree (idx->info.number);
+  xfree (idx->info.digest_algo);
+  xfree (idx->info.digest);
+  memset (idx, 0, sizeof *idx);
+}
+
+
+/**
+ * ksba_crl_index_new:
+ * @r_idx: Receives the new index
+ *
+ * Create a new and empty index of revoked certificates.  Use
+ * ksba_crl_build_index to fill it from a CRL.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_index_new (ksba_crl_index_t *r_idx)
+{
+  if (!r_idx)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_idx = xtrycalloc (1, sizeof **r_idx);
+  if (!*r_idx)
+    return gpg_error_from_syserror ();
+  return 0;
+}
+
+
+/**
+ * ksba_crl_index_release:
+ * @idx: An index or NULL
+ *
+ * Release the index @idx.
+ **/
+void
+ksba_crl_index_release (ksba_crl_index_t idx)
+{
+  if (!idx)
+    return;
+  clear_index (idx);
+  xfree (idx);
+}
+
+
+/**
+ * ksba_crl_index_add:
+ * @idx: An index
+ * @serial: The value of the serial number
+ * @seriallen: The length of @serial
+ * @reason: The reason for the revocation
+ * @date: The revocation date
+ *
+ * Add the serial number @serial to @idx.  @serial are the octets of
+ * the DER encoded INTEGER as found in the S-expressions returned by
+ * ksba_crl_get_item and ksba_cert_get_serial.  If the serial number
+ * is already in @idx, the entry is not changed and GPG_ERR_DUP_VALUE
+ * is returned.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_index_add (ksba_crl_index_t idx,
+                    const unsigned char *serial, size_t seriallen,
+                    ksba_crl_reason_t reason, ksba_epoch_t date)
+{
+  gpg_error_t err;
+  struct crl_index_entry_s *e;
+  unsigned int hash, slot;
+
+  if (!idx || !serial || !seriallen)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (idx->map.records)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+  if (seriallen > 0xffff)
+    return gpg_error (GPG_ERR_TOO_LARGE);
+
+  err = reserve (idx, seriallen);
+  if (err)
+    return err;
+  hash = hash_buffer (serial, seriallen);
+  slot = find_slot (idx, hash, serial, seriallen);
+  if (idx->slots[slot])
+    return gpg_error (GPG_ERR_DUP_VALUE);
+
+  e = idx->entries + idx->count;
+  e->off = idx->serialslen;
+  e->len = seriallen;
+  e->hash = hash;
+  e->reason = reason;
+  e->date = date;
+  memcpy (idx->serials + idx->serialslen, serial, seriallen);
+  idx->serialslen += seriallen;
+  idx->slots[slot] = ++idx->count;
+  return 0;
+}
+
+
+/**
+ * ksba_crl_index_remove:
+ * @idx: An index
+ * @serial: The value of the serial number
+ * @seriallen: The length of @serial
+ *
+ * Remove the serial number @serial from @idx.  See ksba_crl_index_add
+ * for the format of @serial.
+ *
+ * Return value: 0 on success, GPG_ERR_NOT_FOUND if the serial number
+ * is not in @idx or another error code.
+ **/
+gpg_error_t
+ksba_crl_index_remove (ksba_crl_index_t idx,
+                       const unsigned char *serial, size_t seriallen)
+{
+  unsigned int slot;
+
+  if (!idx || !serial)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (idx->map.records)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+  if (!idx->count)
+    return gpg_error (GPG_ERR_NOT_FOUND);
+
+  slot = find_slot (idx, hash_buffer (serial, seriallen), serial, seriallen);
+  if (!idx->slots[slot])
+    return gpg_error (GPG_ERR_NOT_FOUND);
+  remove_entry (idx, slot);
+  return 0;
+}
+
+
+/**
+ * ksba_crl_index_merge:
+ * @idx: An index
+ * @other: Another index
+ *
+ * Add all entries of @other to @idx.  Serial numbers already in @idx
+ * are not changed.  This is used to combine the indices built from
+ * the chunks of a CRL by ksba_crl_build_index_chunk.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_index_merge (ksba_crl_index_t idx, ksba_crl_index_t other)
+{
+  gpg_error_t err;
+  const unsigned char *serial;
+  size_t seriallen;
+  ksba_crl_reason_t reason;
+  ksba_epoch_t date;
+  unsigned int i;
+
+  if (!idx || !other || idx == other)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  for (i=0; i < other->count; i++)
+    {
+      err = get_entry (other, i, &serial, &seriallen, &reason, &date);
+      if (!err)
+        err = ksba_crl_index_add (idx, serial, seriallen, reason, date);
+      if (gpg_err_code (err) == GPG_ERR_DUP_VALUE)
+        err = 0;
+      if (err)
+        return err;
+    }
+  return 0;
+}
+
+
+/**
+ * ksba_crl_index_apply_delta:
+ * @idx: The index of a base CRL
+ * @delta: The index of a delta CRL
+ *
+ * Update @idx with the entries of @delta.  Entries with the reason
+ * %KSBA_CRLREASON_REMOVE_FROM_CRL are removed from @idx; all other
+ * entries are added to @idx or replace the entry with the same serial
+ * number.  The caller needs to check that @delta has been built from
+ * a valid delta CRL for the base CRL of @idx; see
+ * ksba_crl_get_delta_base.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_index_apply_delta (ksba_crl_index_t idx, ksba_crl_index_t delta)
+{
+  gpg_error_t err;
+  struct crl_index_entry_s *e;
+  const unsigned char *serial;
+  size_t seriallen;
+  ksba_crl_reason_t reason;
+  ksba_epoch_t date;
+  unsigned int i, slot;
+
+  if (!idx || !delta || idx == delta)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (idx->map.records)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  for (i=0; i < delta->count; i++)
+    {
+      err = get_entry (delta, i, &serial, &seriallen, &reason, &date);
+      if (err)
+        return err;
+      if ((reason & KSBA_CRLREASON_REMOVE_FROM_CRL))
+        {
+          if (idx->count)
+            {
+              slot = find_slot (idx, hash_buffer (serial, seriallen),
+                                serial, seriallen);
+              if (idx->slots[slot])
+                remove_entry (idx, slot);
+            }
+          continue;
+        }
+
+      err = ksba_crl_index_add (idx, serial, seriallen, reason, date);
+      if (gpg_err_code (err) == GPG_ERR_DUP_VALUE)
+        {
+          /* For example a certificate on hold which is now revoked.  */
+          slot = find_slot (idx, hash_buffer (serial, seriallen),
+                            serial, seriallen);
+          e = idx->entries + idx->slots[slot] - 1;
+          e->reason = reason;
+          e->date = date;
+          err = 0;
+        }
+      if (err)
+        return err;
+    }
+  return 0;
+}
+
+
+/**
+ * ksba_crl_index_count:
+ * @idx: An index
+ *
+ * Return value: The number of serial numbers in @idx.
+ **/
+unsigned int
+ksba_crl_index_count (ksba_crl_index_t idx)
+{
+  return idx? idx->count : 0;
+}
+
+
+/**
+ * ksba_crl_index_lookup:
+ * @idx: An index
+ * @serial: The value of the serial number
+ * @seriallen: The length of @serial
+ * @r_reason: NULL or receives the reason for the revocation
+ * @r_date: NULL or receives the revocation date
+ *
+ * Check whether the certificate with the serial number @serial has
+ * been revoked.  See ksba_crl_index_add for the format of @serial.
+ *
+ * Return value: 0 if the serial number is in @idx, GPG_ERR_NOT_FOUND
+ * if not or another error code.
+ **/
+gpg_error_t
+ksba_crl_index_lookup (ksba_crl_index_t idx,
+                       const unsigned char *serial, size_t seriallen,
+                       ksba_crl_reason_t *r_reason, ksba_epoch_t *r_date)
+{
+  gpg_error_t err;
+  struct crl_index_entry_s *e;
+  unsigned int slot, n;
+  const unsigned char *p;
+  size_t len;
+  ksba_crl_reason_t reason;
+  ksba_epoch_t date;
+
+  if (!idx || !serial)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!idx->count)
+    return gpg_error (GPG_ERR_NOT_FOUND);
+
+  if (idx->map.records)
+    {
+      err = find_mapped (idx, serial, seriallen, &n);
+      if (!err)
+        err = get_entry (idx, n, &p, &len, &reason, &date);
+      if (err)
+        return err;
+      if (r_reason)
+        *r_reason = reason;
+      if (r_date)
+        *r_date = date;
+      return 0;
+    }
+
+  slot = find_slot (idx, hash_buffer (serial, seriallen), serial, seriallen);
+  if (!idx->slots[slot])
+    return gpg_error (GPG_ERR_NOT_FOUND);
+  e = idx->entries + idx->slots[slot] - 1;
+  if (r_reason)
+    *r_reason = e->reason;
+  if (r_date)
+    *r_date = e->date;
+  return 0;
+}
+
+
+
+/* Read exactly COUNT octets from READER into BUFFER.  */
+static gpg_error_t
+read_exact (ksba_reader_t reader, unsigned char *buffer, size_t count)
+{
+  gpg_error_t err;
+  size_t nread;
+
+  while (count)
+    {
+      err = ksba_reader_read (reader, buffer, count, &nread);
+      if (gpg_err_code (err) == GPG_ERR_EOF)
+        return gpg_error (GPG_ERR_INV_OBJ);
+      if (err)
+        return err;
+      buffer += nread;
+      count -= nread;
+    }
+  return 0;
+}
+
+
+/**
+ * ksba_crl_index_set_info:
+ * @idx: An index
+ * @crl: The CRL object the index has been built from
+ *
+ * Store the issuer, the crlNumber and the update times of @crl in
+ * @idx so that they are written along with the entries.  @crl must
+ * have been parsed completely.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_index_set_info (ksba_crl_index_t idx, ksba_crl_t crl)
+{
+  gpg_error_t err;
+  char *issuer = NULL;
+  ksba_sexp_t number = NULL;
+  const unsigned char *p;
+  size_t n = 0;
+  ksba_epoch_t this_update, next_update;
+
+  if (!idx || !crl)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (idx->map.records)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  err = ksba_crl_get_update_epoch (crl, 0, &this_update);
+  if (err)
+    return err;
+  err = ksba_crl_get_update_epoch (crl, 1, &next_update);
+  if (gpg_err_code (err) == GPG_ERR_NO_VALUE)
+    err = 0;
+  if (err)
+    return err;
+
+  err = ksba_crl_get_issuer (crl, &issuer);
+  if (err)
+    return err;
+  err = ksba_crl_get_crl_number (crl, &number);
+  if (gpg_err_code (err) == GPG_ERR_NO_DATA)
+    err = 0;
+  else if (!err)
+    {
+      p = number + 1;
+      n = snext (&p);
+      if (!n)
+        err = gpg_error (GPG_ERR_INV_SEXP);
+      else
+        memmove (number, p, n);
+    }
+  if (!err && (strlen (issuer) + 1 > MAX_INFO_LEN || n > MAX_INFO_LEN))
+    err = gpg_error (GPG_ERR_TOO_LARGE);
+  if (err)
+    {
+      xfree (issuer);
+      xfree (number);
+      return err;
+    }
+
+  xfree (idx->info.issuer);
+  xfree (idx->info.number);
+  idx->info.issuer = issuer;
+  idx->info.number = number;
+  idx->info.numberlen = n;
+  idx->info.this_update = this_update;
+  idx->info.next_update = next_update;
+  idx->info.valid = 1;
+  return 0;
+}
+
+
+/**
+ * ksba_crl_index_set_digest:
+ * @idx: An index
+ * @algo: The OID of the digest algorithm
+ * @digest: The digest
+ * @digestlen: The length of @digest
+ *
+ * Store the digest of the tbsCertList of the CRL in @idx, usually
+ * after its signature has been verified, so that it is written along
+ * with the entries for auditing.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_index_set_digest (ksba_crl_index_t idx, const char *algo,
+                           const unsigned char *digest, size_t digestlen)
+{
+  char *a;
+  unsigned char *d;
+
+  if (!idx || !algo || !digest || !digestlen)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (idx->map.records)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+  if (strlen (algo) + 1 > MAX_INFO_LEN || digestlen > MAX_INFO_LEN)
+    return gpg_error (GPG_ERR_TOO_LARGE);
+
+  a = xtrystrdup (algo);
+  d = xtrymalloc (digestlen);
+  if (!a || !d)
+    {
+      xfree (a);
+      xfree (d);
+      return gpg_error_from_syserror ();
+    }
+  memcpy (d, digest, digestlen);
+  xfree (idx->info.digest_algo);
+  xfree (idx->info.digest);
+  idx->info.digest_algo = a;
+  idx->info.digest = d;
+  idx->info.digestlen = digestlen;
+  return 0;
+}
+
+
+/**
+ * ksba_crl_index_get_info:
+ * @idx: An index
+ * @r_issuer: NULL or receives the issuer
+ * @r_number: NULL or receives the crlNumber or NULL
+ * @r_numberlen: NULL or receives the length of the crlNumber
+ * @r_this_update: NULL or receives the thisUpdate time
+ * @r_next_update: NULL or receives the nextUpdate time or 0
+ *
+ * Return the information stored with ksba_crl_index_set_info.  The
+ * crlNumber is returned as the octets of the INTEGER like the serial
+ * numbers.  The returned pointers are valid as long as @idx.
+ *
+ * Return value: 0 on success, GPG_ERR_NO_DATA if no information is
+ * available or another error code.
+ **/
+gpg_error_t
+ksba_crl_index_get_info (ksba_crl_index_t idx, const char **r_issuer,
+                         const unsigned char **r_number, size_t *r_numberlen,
+                         ksba_epoch_t *r_this_update,
+                         ksba_epoch_t *r_next_update)
+{
+  if (!idx)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!idx->info.valid)
+    return gpg_error (GPG_ERR_NO_DATA);
+  if (r_issuer)
+    *r_issuer = idx->info.issuer;
+  if (r_number)
+    *r_number = idx->info.number;
+  if (r_numberlen)
+    *r_numberlen = idx->info.numberlen;
+  if (r_this_update)
+    *r_this_update = idx->info.this_update;
+  if (r_next_update)
+    *r_next_update = idx->info.next_update;
+  return 0;
+}
+
+
+/**
+ * ksba_crl_index_get_digest:
+ * @idx: An index
+ * @r_algo: Receives the OID of the digest algorithm
+ * @r_digest: Receives the digest
+ * @r_digestlen: Receives the length of the digest
+ *
+ * Return the digest stored with ksba_crl_index_set_digest.  The
+ * returned pointers are valid as long as @idx.
+ *
+ * Return value: 0 on success, GPG_ERR_NO_DATA if no digest is
+ * available or another error code.
+ **/
+gpg_error_t
+ksba_crl_index_get_digest (ksba_crl_index_t idx, const char **r_algo,
+                           const unsigned char **r_digest,
+                           size_t *r_digestlen)
+{
+  if (!idx || !r_algo || !r_digest || !r_digestlen)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!idx->info.digest)
+    return gpg_error (GPG_ERR_NO_DATA);
+  *r_algo = idx->info.digest_algo;
+  *r_digest = idx->info.digest;
+  *r_digestlen = idx->info.digestlen;
+  return 0;
+}
+
+
+
+struct sort_item_s
+{
+  const unsigned char *serial;
+  size_t seriallen;
+  ksba_crl_reason_t reason;
+  ksba_epoch_t date;
+};
+
+static int
+compare_sort_items (const void *a_arg, const void *b_arg)
+{
+  const struct sort_item_s *a = a_arg;
+  const struct sort_item_s *b = b_arg;
+
+  return compare_serials (a->serial, a->seriallen, b->serial, b->seriallen);
+}
+
+
+/**
+ * ksba_crl_index_write:
+ * @idx: An index
+ * @writer: The writer to write to
+ *
+ * Write @idx to @writer in a portable format which can be read back
+ * with ksba_crl_index_read or used in place with ksba_crl_index_map.
+ * The format consists of a header with a magic string, a version, the
+ * counts and the information about the CRL, followed by a record with
+ * the offset and length of the serial number, the reason and the
+ * revocation date for each entry and finally the serial numbers.  The
+ * records are sorted by the serial numbers.  All numbers are big
+ * endian.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_index_write (ksba_crl_index_t idx, ksba_writer_t writer)
+{
+  gpg_error_t err;
+  struct sort_item_s *items;
+  unsigned char *records = NULL;
+  unsigned char buf[HEADER_SIZE];
+  size_t issuerlen, algolen, serialslen;
+  unsigned int n;
+
+  if (!idx || !writer)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  items = xtrycalloc (idx->count? idx->count : 1, sizeof *items);
+  if (!items)
+    return gpg_error_from_syserror ();
+  for (n=0, serialslen=0; n < idx->count; n++)
+    {
+      err = get_entry (idx, n, &items[n].serial, &items[n].seriallen,
+                       &items[n].reason, &items[n].date);
+      if (err)
+        goto leave;
+      serialslen += items[n].seriallen;
+    }
+  if (serialslen > 0xffffffff)
+    {
+      err = gpg_error (GPG_ERR_TOO_LARGE);
+      goto leave;
+    }
+  qsort (items, idx->count, sizeof *items, compare_sort_items);
+
+  records = xtrymalloc ((size_t)(idx->count? idx->count : 1) * RECORD_SIZE);
+  if (!records)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  for (n=0, serialslen=0; n < idx->count; n++)
+    {
+      put_uint (records + (size_t)n * RECORD_SIZE, serialslen, 4);
+      put_uint (records + (size_t)n * RECORD_SIZE + 4, items[n].seriallen, 2);
+      put_uint (records + (size_t)n * RECORD_SIZE + 6, items[n].reason, 2);
+      put_uint (records + (size_t)n * RECORD_SIZE + 8,
+                (unsigned long long)items[n].date, 8);
+      serialslen += items[n].seriallen;
+    }
+
+  issuerlen = idx->info.issuer? strlen (idx->info.issuer) + 1 : 0;
+  algolen = idx->info.digest_algo? strlen (idx->info.digest_algo) + 1 : 0;
+  memcpy (buf, INDEX_MAGIC, 8);
+  put_uint (buf+8, INDEX_VERSION, 4);
+  put_uint (buf+12, idx->count, 4);
+  put_uint (buf+16, serialslen, 4);
+  put_uint (buf+20, idx->info.valid, 4);
+  put_uint (buf+24, (unsigned long long)idx->info.this_update, 8);
+  put_uint (buf+32, (unsigned long long)idx->info.next_update, 8);
+  put_uint (buf+40, issuerlen, 4);
+  put_uint (buf+44, idx->info.numberlen, 4);
+  put_uint (buf+48, algolen, 4);
+  put_uint (buf+52, idx->info.digestlen, 4);
+  err = ksba_writer_write (writer, buf, HEADER_SIZE);
+  if (!err && issuerlen)
+    err = ksba_writer_write (writer, idx->info.issuer, issuerlen);
+  if (!err && idx->info.numberlen)
+    err = ksba_writer_write (writer, idx->info.number, idx->info.numberlen);
+  if (!err && algolen)
+    err = ksba_writer_write (writer, idx->info.digest_algo, algolen);
+  if (!err && idx->info.digestlen)
+    err = ksba_writer_write (writer, idx->info.digest, idx->info.digestlen);
+  if (!err && idx->count)
+    err = ksba_writer_write (writer, records,
+                             (size_t)idx->count * RECORD_SIZE);
+  for (n=0; !err && n < idx->count; n++)
+    err = ksba_writer_write (writer, items[n].serial, items[n].seriallen);
+
+ leave:
+  xfree (records);
+  xfree (items);
+  return err;
+}
+
+
+/* Parse the header of a written index at BUF.  Store the number of
+   entries at R_COUNT, the length of the serials at R_SERIALSLEN and
+   the lengths of the strings following the header at R_LENS.  */
+static gpg_error_t
+parse_header (ksba_crl_index_t idx, const unsigned char *buf,
+              unsigned int *r_count, size_t *r_serialslen, size_t *r_lens)
+{
+  int i;
+
+  if (memcmp (buf, INDEX_MAGIC, 8))
+    return gpg_error (GPG_ERR_INV_OBJ);
+  if (get_uint (buf+8, 4) != INDEX_VERSION)
+    return gpg_error (GPG_ERR_UNSUPPORTED_PROTOCOL);
+  *r_count = get_uint (buf+12, 4);
+  *r_serialslen = get_uint (buf+16, 4);
+  if (*r_count > *r_serialslen || *r_count > (unsigned int)-1 / 4)
+    return gpg_error (GPG_ERR_INV_OBJ);
+  idx->info.valid = !!get_uint (buf+20, 4);
+  idx->info.this_update = (ksba_epoch_t)get_uint (buf+24, 8);
+  idx->info.next_update = (ksba_epoch_t)get_uint (buf+32, 8);
+  for (i=0; i < 4; i++)
+    {
+      r_lens[i] = get_uint (buf + 40 + 4*i, 4);
+      if (r_lens[i] > MAX_INFO_LEN)
+        return gpg_error (GPG_ERR_INV_OBJ);
+    }
+  return 0;
+}
+
+
+/* Take the strings of the header from BUF using the lengths LENS.  */
+static gpg_error_t
+parse_info (ksba_crl_index_t idx, const unsigned char *buf,
+            const size_t *lens)
+{
+  unsigned char *p[4];
+  int i;
+
+  if ((lens[0] && buf[lens[0]-1])
+      || (lens[2] && buf[lens[0]+lens[1]+lens[2]-1]))
+    return gpg_error (GPG_ERR_INV_OBJ); /* Strings not terminated.  */
+  for (i=0; i < 4; i++)
+    {
+      p[i] = NULL;
+      if (lens[i] && !(p[i] = xtrymalloc (lens[i])))
+        {
+          while (i--)
+            xfree (p[i]);
+          return gpg_error_from_syserror ();
+        }
+      if (lens[i])
+        memcpy (p[i], buf, lens[i]);
+      buf += lens[i];
+    }
+  idx->info.issuer = (char *)p[0];
+  idx->info.number = p[1];
+  idx->info.numberlen = lens[1];
+  idx->info.digest_algo = (char *)p[2];
+  idx->info.digest = p[3];
+  idx->info.digestlen = lens[3];
+  return 0;
+}
+
+
+/**
+ * ksba_crl_index_read:
+ * @idx: An empty index
+ * @reader: The reader to read from
+ *
+ * Read an index written by ksba_crl_index_write from @reader into
+ * @idx.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_index_read (ksba_crl_index_t idx, ksba_reader_t reader)
+{
+  gpg_error_t err;
+  unsigned char buf[HEADER_SIZE];
+  unsigned char *info = NULL;
+  unsigned int count, n, size;
+  size_t serialslen, infolen, lens[4];
+  struct crl_index_entry_s *e;
+
+  if (!idx || !reader)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (idx->count || idx->map.records || idx->info.valid || idx->info.digest)
+    return gpg_error (GPG_ERR_CONFLICT);
+
+  err = read_exact (reader, buf, HEADER_SIZE);
+  if (!err)
+    err = parse_header (idx, buf, &count, &serialslen, lens);
+  if (err)
+    goto leave;
+  infolen = lens[0] + lens[1] + lens[2] + lens[3];
+  info = xtrymalloc (infolen? infolen : 1);
+  if (!info)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  err = read_exact (reader, info, infolen);
+  if (!err)
+    err = parse_info (idx, info, lens);
+  if (err)
+    goto leave;
+
+  for (size = INITIAL_SLOTS; size < 2 * count; size *= 2)
+    ;
+  xfree (idx->entries);
+  xfree (idx->serials);
+  idx->entries = xtrycalloc (count? count : 1, sizeof *idx->entries);
+  idx->serials = xtrymalloc (serialslen? serialslen : 1);
+  if (!idx->entries || !idx->serials)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  idx->nentries = count? count : 1;
+  idx->serialssize = serialslen? serialslen : 1;
+
+  for (n=0; n < count; n++)
+    {
+      err = read_exact (reader, buf, RECORD_SIZE);
+      if (err)
+        goto leave;
+      e = idx->entries + n;
+      e->off = get_uint (buf, 4);
+      e->len = get_uint (buf+4, 2);
+      e->reason = get_uint (buf+6, 2);
+      e->date = (ksba_epoch_t)get_uint (buf+8, 8);
+      if (!e->len || e->off > serialslen || e->len > serialslen - e->off)
+        {
+          err = gpg_error (GPG_ERR_INV_OBJ);
+          goto leave;
+        }
+    }
+  err = read_exact (reader, idx->serials, serialslen);
+  if (err)
+    goto leave;
+  idx->serialslen = serialslen;
+
+  for (n=0; n < count; n++)
+    {
+      e = idx->entries + n;
+      e->hash = hash_buffer (idx->serials + e->off, e->len);
+    }
+  idx->count = count;
+  err = rebuild_slots (idx, size);
+  if (!err)
+    {
+      /* Reject duplicates so that the index is the same as one built
+         with ksba_crl_index_add.  */
+      for (n=0; !err && n < count; n++)
+        {
+          e = idx->entries + n;
+          if (idx->slots[find_slot (idx, e->hash, idx->serials + e->off,
+                                    e->len)] != n + 1)
+            err = gpg_error (GPG_ERR_DUP_VALUE);
+        }
+    }
+
+ leave:
+  if (err)
+    clear_index (idx);
+  xfree (info);
+  return err;
+}
+
+
+/**
+ * ksba_crl_index_map:
+ * @idx: An empty index
+ * @reader: A memory or mmap reader
+ *
+ * Use an index written by ksba_crl_index_write in place.  Only the
+ * header is parsed; lookups are done by a binary search over the
+ * records in the memory of @reader which must thus not be changed or
+ * released before @idx.  This allows opening a large index with
+ * ksba_reader_set_mmap at no cost.  A mapped index can't be
+ * modified.  The records are not checked in advance; a file written
+ * by another program may thus lead to wrong results.
+ *
+ * Return value: 0 on success, GPG_ERR_NOT_SUPPORTED if @reader does
+ * not read from memory or another error code.
+ **/
+gpg_error_t
+ksba_crl_index_map (ksba_crl_index_t idx, ksba_reader_t reader)
+{
+  gpg_error_t err;
+  const unsigned char *mem, *p;
+  size_t used, n, serialslen, infolen, lens[4];
+  unsigned int count;
+
+  if (!idx || !reader)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (idx->count || idx->map.records || idx->info.valid || idx->info.digest)
+    return gpg_error (GPG_ERR_CONFLICT);
+  if (!_ksba_reader_get_mem (reader, &mem, &used))
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+  err = ksba_reader_peek (reader, &p, &n);
+  if (gpg_err_code (err) == GPG_ERR_EOF)
+    return gpg_error (GPG_ERR_INV_OBJ);
+  if (err)
+    return err;
+
+  if (n < HEADER_SIZE)
+    return gpg_error (GPG_ERR_INV_OBJ);
+  err = parse_header (idx, p, &count, &serialslen, lens);
+  if (err)
+    goto leave;
+  infolen = lens[0] + lens[1] + lens[2] + lens[3];
+  if (infolen > n - HEADER_SIZE
+      || (n - HEADER_SIZE - infolen) / RECORD_SIZE < count
+      || (serialslen
+          > n - HEADER_SIZE - infolen - (size_t)count * RECORD_SIZE))
+    {
+      err = gpg_error (GPG_ERR_INV_OBJ);
+      goto leave;
+    }
+  err = parse_info (idx, p + HEADER_SIZE, lens);
+  if (err)
+    goto leave;
+  err = ksba_reader_consume (reader, HEADER_SIZE + infolen
+                             + (size_t)count * RECORD_SIZE + serialslen);
+  if (err)
+    goto leave;
+
+  idx->map.records = p + HEADER_SIZE + infolen;
+  idx->map.serials = idx->map.records + (size_t)count * RECORD_SIZE;
+  idx->map.serialslen = serialslen;
+  idx->count = count;
+
+ leave:
+  if (err)
+    clear_index (idx);
+  return err;
+}
@@ -0,0 +1,84 @@
+/* crlindex.h - Internal definitions for the CRL index
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * KSBA is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copies of the GNU General Public License
+ * and the GNU Lesser General Public License along with this program;
+ * if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CRLINDEX_H
+#define CRLINDEX_H 1
+
+#include "ksba.h"
+
+/* An entry of a CRL index.  */
+struct crl_index_entry_s
+{
+  size_t off;                /* Offset of the serial in SERIALS.  */
+  size_t len;                /* Length of the serial.  */
+  unsigned int hash;
+  ksba_crl_reason_t reason;
+  ksba_epoch_t date;         /* The revocation date.  */
+};
+
+
+struct ksba_crl_index_s
+{
+  unsigned int count;        /* Number of used ENTRIES.  */
+  unsigned int nentries;     /* Number of allocated ENTRIES.  */
+  struct crl_index_entry_s *entries;
+  unsigned char *serials;    /* The concatenated serial numbers.  */
+  size_t serialslen;
+  size_t serialssize;        /* Allocated size of SERIALS.  */
+  unsigned int size;         /* Number of slots; a power of 2.  */
+  unsigned int *slots;       /* 0 for a free slot or index+1 into
+                                ENTRIES.  */
+  size_t unused;             /* Octets of SERIALS no longer used.  */
+
+  /* Information about the CRL.  */
+  struct {
+    int valid;               /* The information has been set.  */
+    char *issuer;
+    unsigned char *number;   /* The crlNumber or NULL.  */
+    size_t numberlen;
+    ksba_epoch_t this_update;
+    ksba_epoch_t next_update; /* 0 if not available.  */
+    char *digest_algo;       /* The OID of the digest algorithm or NULL.  */
+    unsigned char *digest;
+    size_t digestlen;
+  } info;
+
+  /* If the index has been mapped from memory, the records and the
+     serials of the written index; ENTRIES, SERIALS and SLOTS are
+     then not used.  */
+  struct {
+    const unsigned char *records;
+    const unsigned char *serials;
+    size_t serialslen;
+  } map;
+};
+
+
+#endif /*CRLINDEX_H*/
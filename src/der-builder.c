@@ -49,9 +49,14 @@ struct item_s
   unsigned int encapsulate:1;    /* This encapsulates other objects.    */
   unsigned int verbatim:1;       /* Copy the value verbatim.            */
   unsigned int is_stop:1;        /* This is a STOP item.                */
-  const void *value;
+  unsigned int in_arena:1;       /* The value is stored in the arena.   */
+  unsigned int dirty:1;          /* Field changed since the last write. */
+  const void *value;             /* Caller provided value or NULL.      */
+  size_t valueoff;               /* Offset of the value in the arena.   */
+  size_t valuesize;              /* Space for the value in the arena.   */
   size_t valuelen;
-  char *buffer;                  /* Malloced space or NULL.  */
+  size_t outoff;                 /* Offset of the value in the output.  */
+  int parent;                    /* Enclosing STOP item or -1.          */
 };
 
 
@@ -63,8 +68,12 @@ struct ksba_der_s
   size_t nallocateditems; /* Number of allocated items.  */
   size_t nitems;          /* Number of used items.  */
   struct item_s *items;   /* Array of items.  */
-  int laststop;           /* Used as return value of compute_length.  */
+  unsigned char *arena;   /* Malloced space for all copied values.  */
+  size_t arenasize;       /* Allocated size of ARENA.  */
+  size_t arenalen;        /* Used size of ARENA.  */
+  size_t objlen;          /* Length of the constructed object.  */
   unsigned int finished:1;/* The object has been constructed.  */
+  unsigned int written:1; /* The OUTOFF values are valid.  */
 };
 
 
@@ -72,13 +81,10 @@ struct ksba_der_s
 void
 _ksba_der_release (ksba_der_t d)
 {
-  int idx;
-
   if (!d)
     return;
 
-  for (idx=0; idx < d->nitems; idx++)
-    xfree (d->items[idx].buffer);
+  xfree (d->arena);
   xfree (d->items);
   xfree (d);
 }
@@ -110,37 +116,25 @@ _ksba_der_builder_new (unsigned int nitems)
 }
 
 
-/* Reset a DER build context so that a new sequence can be build.  */
+/* Reset a DER build context so that a new sequence can be build.  The
+ * allocated items and the arena are kept for re-use.  */
 void
 _ksba_der_builder_reset (ksba_der_t d)
 {
-  int idx;
-
   if (!d)
     return;  /* Oops.  */
-  for (idx=0; idx < d->nitems; idx++)
-    {
-      if (d->items[idx].buffer)
-        {
-          xfree (d->items[idx].buffer);
-          d->items[idx].buffer = NULL;
-        }
-      d->items[idx].hdrlen = 0;
-      d->items[idx].is_constructed = 0;
-      d->items[idx].encapsulate = 0;
-      d->items[idx].verbatim = 0;
-      d->items[idx].is_stop = 0;
-      d->items[idx].value = NULL;
-    }
   d->nitems = 0;
+  d->arenalen = 0;
+  d->objlen = 0;
   d->finished = 0;
+  d->written = 0;
   d->error = 0;
 }
 
 
-/* Make sure the array of items is large enough for one new item.
- * Records any error in D and returns true in that case.  True is also
- * returned if D is in finished state.  */
+/* Make sure the array of items is large enough for one new item and
+ * clear that item.  Records any error in D and returns true in that
+ * case.  True is also returned if D is in finished state.  */
 static int
 ensure_space (ksba_der_t d)
 {
@@ -159,10 +153,47 @@ ensure_space (ksba_der_t d)
       else
         d->items = newitems;
     }
+  if (!d->error)
+    memset (d->items + d->nitems, 0, sizeof *d->items);
   return !!d->error;
 }
 
 
+/* Make sure that the arena of D has room for LENGTH more bytes and
+ * return a pointer to that space.  The space is claimed by a
+ * following call to add_val_core; any other call may move the arena.
+ * On error NULL is returned and the error is recorded in D.  */
+static unsigned char *
+reserve_value (ksba_der_t d, size_t length)
+{
+  unsigned char *newarena;
+  size_t newsize;
+
+  if (length > d->arenasize - d->arenalen)
+    {
+      newsize = d->arenasize? d->arenasize : 256;
+      while (newsize - d->arenalen < length)
+        {
+          if (newsize * 2 < newsize)
+            {
+              d->error = gpg_error (GPG_ERR_TOO_LARGE);
+              return NULL;
+            }
+          newsize *= 2;
+        }
+      newarena = xtryrealloc (d->arena, newsize);
+      if (!newarena)
+        {
+          d->error = gpg_error_from_syserror ();
+          return NULL;
+        }
+      d->arena = newarena;
+      d->arenasize = newsize;
+    }
+  return d->arena + d->arenalen;
+}
+
+
 /* Add a new primitive element to the builder instance D.  The element
  * is described by CLASS, TAG, VALUE, and VALUELEN.  CLASS and TAG
  * must describe a primitive element and (VALUE,VALUELEN) specify its
@@ -185,19 +216,21 @@ _ksba_der_add_ptr (ksba_der_t d, int class, int tag,
 
 
 /* This is a low level function which assumes that D has been
- * validated, VALUE is not NULL and enough space for a new item is
- * available.  It takes ownership of VALUE.  VERBATIM is usually
- * passed as false */
+ * validated and enough space for a new item is available.  It claims
+ * VALUELEN bytes of the arena which the caller has filled after a
+ * call to reserve_value.  VERBATIM is usually passed as false */
 static void
-add_val_core (ksba_der_t d, int class, int tag, void *value, size_t valuelen,
+add_val_core (ksba_der_t d, int class, int tag, size_t valuelen,
               int verbatim)
 {
-  d->items[d->nitems].buffer   = value;
   d->items[d->nitems].class    = class & 0x03;
   d->items[d->nitems].tag      = tag;
-  d->items[d->nitems].value    = value;
+  d->items[d->nitems].in_arena = 1;
+  d->items[d->nitems].valueoff = d->arenalen;
+  d->items[d->nitems].valuesize = valuelen;
   d->items[d->nitems].valuelen = valuelen;
   d->items[d->nitems].verbatim = !!verbatim;
+  d->arenalen += valuelen;
   d->nitems++;
 }
 
@@ -209,7 +242,7 @@ void
 _ksba_der_add_val (ksba_der_t d, int class, int tag,
                    const void *value, size_t valuelen)
 {
-  void *p;
+  unsigned char *p;
 
   if (ensure_space (d))
     return;
@@ -218,14 +251,11 @@ _ksba_der_add_val (ksba_der_t d, int class, int tag,
       d->error = gpg_error (GPG_ERR_INV_VALUE);
       return;
     }
-  p = xtrymalloc (valuelen);
+  p = reserve_value (d, valuelen);
   if (!p)
-    {
-      d->error = gpg_error_from_syserror ();
-      return;
-    }
+    return;
   memcpy (p, value, valuelen);
-  add_val_core (d, class, tag, p, valuelen, 0);
+  add_val_core (d, class, tag, valuelen, 0);
 }
 
 
@@ -235,17 +265,27 @@ void
 _ksba_der_add_oid (ksba_der_t d, const char *oidstr)
 {
   gpg_error_t err;
-  unsigned char *buf;
-  size_t len;
+  unsigned char *p;
+  size_t n, len;
 
   if (ensure_space (d))
     return;
+  if (!oidstr)
+    {
+      d->error = gpg_error (GPG_ERR_INV_VALUE);
+      return;
+    }
 
-  err = ksba_oid_from_str (oidstr, &buf, &len);
+  /* The DER encoding is never longer than the dotted string.  */
+  n = strlen (oidstr) + 1;
+  p = reserve_value (d, n);
+  if (!p)
+    return;
+  err = ksba_oid_from_str_buf (oidstr, p, n, &len);
   if (err)
     d->error = err;
   else
-    add_val_core (d, 0, TYPE_OBJECT_ID, buf, len, 0);
+    add_val_core (d, 0, TYPE_OBJECT_ID, len, 0);
 }
 
 
@@ -264,15 +304,12 @@ _ksba_der_add_bts (ksba_der_t d, const void *value, size_t valuelen,
       d->error = gpg_error (GPG_ERR_INV_VALUE);
       return;
     }
-  p = xtrymalloc (1+valuelen);
+  p = reserve_value (d, 1+valuelen);
   if (!p)
-    {
-      d->error = gpg_error_from_syserror ();
-      return;
-    }
+    return;
   p[0] = unusedbits;
   memcpy (p+1, value, valuelen);
-  add_val_core (d, 0, TYPE_BIT_STRING, p, 1+valuelen, 0);
+  add_val_core (d, 0, TYPE_BIT_STRING, 1+valuelen, 0);
 }
 
 
@@ -293,17 +330,14 @@ _ksba_der_add_int (ksba_der_t d, const void *value, size_t valuelen,
   else
     need_extra = (force_positive && (*(const unsigned char*)value & 0x80));
 
-  p = xtrymalloc (need_extra+valuelen);
+  p = reserve_value (d, need_extra+valuelen);
   if (!p)
-    {
-      d->error = gpg_error_from_syserror ();
-      return;
-    }
+    return;
   if (need_extra)
     p[0] = 0;
   if (valuelen)
     memcpy (p+need_extra, value, valuelen);
-  add_val_core (d, 0, TYPE_INTEGER, p, need_extra+valuelen, 0);
+  add_val_core (d, 0, TYPE_INTEGER, need_extra+valuelen, 0);
 }
 
 
@@ -314,7 +348,7 @@ _ksba_der_add_int (ksba_der_t d, const void *value, size_t valuelen,
 void
 _ksba_der_add_der (ksba_der_t d, const void *der, size_t derlen)
 {
-  void *p;
+  unsigned char *p;
 
   if (ensure_space (d))
     return;
@@ -323,14 +357,11 @@ _ksba_der_add_der (ksba_der_t d, const void *der, size_t derlen)
       d->error = gpg_error (GPG_ERR_INV_VALUE);
       return;
     }
-  p = xtrymalloc (derlen);
+  p = reserve_value (d, derlen);
   if (!p)
-    {
-      d->error = gpg_error_from_syserror ();
-      return;
-    }
+    return;
   memcpy (p, der, derlen);
-  add_val_core (d, 0, 0, p, derlen, 1);
+  add_val_core (d, 0, 0, derlen, 1);
 }
 
 
@@ -483,55 +514,174 @@ write_tl (unsigned char *buffer, int class, int tag,
 }
 
 
-/* Compute and set the length of all constructed elements in the item
- * array of D starting at IDX up to the corresponding stop item.  On
- * error d->error is set.  */
-static size_t
-compute_lengths (ksba_der_t d, int idx)
+/* Compute and set the length of all elements in the item array of D
+ * and store the length of the entire object at d->objlen.  This is
+ * done in a single backward pass: A STOP item is used to accumulate
+ * the length of the elements of its constructed element and links to
+ * the STOP item of the enclosing element.  On error d->error is
+ * set.  */
+static void
+compute_lengths (ksba_der_t d)
 {
+  struct item_s *item;
   size_t total = 0;
+  size_t len;
+  int idx, top, encap_bts;
 
   if (d->error)
-    return 0;
+    return;
 
-  for (; idx < d->nitems; idx++)
+  top = -1;
+  for (idx = d->nitems - 1; idx >= 0; idx--)
     {
-      if (d->items[idx].is_stop)
-        {
-          d->laststop = idx;
-          break;
-        }
-      if (d->items[idx].verbatim)
+      item = d->items + idx;
+      if (item->is_stop)
         {
-          total += d->items[idx].valuelen;
+          item->valuelen = 0;
+          item->parent = top;
+          top = idx;
           continue;
         }
-      if (d->items[idx].is_constructed)
+      if (item->is_constructed)
         {
-          d->items[idx].valuelen = compute_lengths (d, idx+1);
-          if (d->error)
-            return 0;
-          /* Note: The last processed IDX is stored at d->LASTSTOP.  */
+          if (top != -1)
+            {
+              item->valuelen = d->items[top].valuelen;
+              top = d->items[top].parent;
+            }
+          else
+            {
+              /* An element which has not been closed extends to the
+               * end of the object.  */
+              item->valuelen = total;
+              total = 0;
+            }
         }
-      d->items[idx].hdrlen = count_tl (d->items[idx].class,
-                                       d->items[idx].tag,
-                                       d->items[idx].valuelen);
-      if (!d->items[idx].hdrlen)
+
+      if (item->verbatim)
+        len = item->valuelen;
+      else
         {
-          if (d->error)
-            d->error = gpg_error (GPG_ERR_ENCODING_PROBLEM);
-          return 0; /* Error.  */
+          /* For data encapsulated in a bit string we need to account
+           * for the unused bits octet.  */
+          encap_bts = (item->encapsulate && !item->class
+                       && item->tag == TYPE_BIT_STRING);
+          item->hdrlen = count_tl (item->class, item->tag,
+                                   item->valuelen + encap_bts);
+          if (!item->hdrlen)
+            {
+              d->error = gpg_error (GPG_ERR_ENCODING_PROBLEM);
+              return;
+            }
+          len = item->hdrlen + encap_bts + item->valuelen;
         }
 
-      total += d->items[idx].hdrlen + d->items[idx].valuelen;
-      if (d->items[idx].is_constructed)
+      if (top != -1)
+        d->items[top].valuelen += len;
+      else
+        total += len;
+    }
+
+  if (top != -1)
+    {
+      d->error = gpg_error (GPG_ERR_ENCODING_PROBLEM); /* Extra end. */
+      return;
+    }
+  d->objlen = total;
+}
+
+
+/* Finish the construction of the object at D and return the recorded
+ * error or an error from computing the lengths.  */
+static gpg_error_t
+finish_builder (ksba_der_t d)
+{
+  if (d->error)
+    return d->error;
+
+  if (!d->finished)
+    {
+      if (d->nitems == 1)
+        ;  /* Single item does not need an end tag.  */
+      else if (!d->nitems || !d->items[d->nitems-1].is_stop)
+        return gpg_error (GPG_ERR_NO_OBJ);
+
+      compute_lengths (d);
+      if (d->error)
+        return d->error;
+
+      d->finished = 1;
+      d->written = 0;
+    }
+  return 0;
+}
+
+
+/* Write the finished object D to BUFFER which must have a size of at
+ * least d->objlen bytes, or if BUFFER is NULL to the WRITER.  */
+static gpg_error_t
+write_items (ksba_der_t d, unsigned char *buffer, ksba_writer_t writer)
+{
+  gpg_error_t err;
+  struct item_s *item;
+  unsigned char tmp[16];
+  unsigned char *p;
+  const void *value;
+  size_t n, buflen;
+  int idx, encap_bts;
+
+  buflen = 0;
+  for (idx=0; idx < d->nitems; idx++)
+    {
+      item = d->items + idx;
+      if (item->is_stop)
+        continue;
+      if (!item->verbatim)
         {
-          if (d->items[idx].encapsulate && d->items[idx].tag == TYPE_BIT_STRING)
-            total++;  /* Account for the unused bits octet.  */
-          idx = d->laststop;
+          encap_bts = (item->encapsulate && !item->class
+                       && item->tag == TYPE_BIT_STRING);
+          n = item->hdrlen + encap_bts;
+          if (buflen + n > d->objlen || item->hdrlen + 1 > sizeof tmp)
+            return gpg_error (GPG_ERR_BUG);
+          p = buffer? buffer + buflen : tmp;
+          write_tl (p, item->class, item->tag,
+                    (item->is_constructed && !item->encapsulate),
+                    item->valuelen + encap_bts);
+          if (encap_bts)
+            p[item->hdrlen] = 0;
+          if (!buffer)
+            {
+              err = ksba_writer_write (writer, tmp, n);
+              if (err)
+                return err;
+            }
+          buflen += n;
+        }
+      item->outoff = buflen;
+      item->dirty = 0;
+      if (item->in_arena)
+        value = d->arena + item->valueoff;
+      else
+        value = item->value;
+      if (value && item->valuelen)
+        {
+          if (buflen + item->valuelen > d->objlen)
+            return gpg_error (GPG_ERR_BUG);
+          if (buffer)
+            memcpy (buffer + buflen, value, item->valuelen);
+          else
+            {
+              err = ksba_writer_write (writer, value, item->valuelen);
+              if (err)
+                return err;
+            }
+          buflen += item->valuelen;
         }
     }
-  return total;
+  if (buflen != d->objlen)
+    return gpg_error (GPG_ERR_BUG);
+  d->written = 1;
+  return 0;
 }
 
 
@@ -549,122 +699,448 @@ compute_lengths (ksba_der_t d, int idx)
 gpg_error_t
 _ksba_der_builder_get (ksba_der_t d, unsigned char **r_obj, size_t *r_objlen)
 {
-  gpg_error_t err = 0;
-  int idx;
-  unsigned char *buffer = NULL;
-  unsigned char *p;
-  size_t bufsize, buflen;
-  int encap_bts;
+  gpg_error_t err;
+  unsigned char *buffer;
 
-  *r_obj = NULL;
-  *r_objlen = 0;
+  if (r_obj)
+    *r_obj = NULL;
+  if (r_objlen)
+    *r_objlen = 0;
 
   if (!d)
     return gpg_error (GPG_ERR_INV_ARG);
   if (d->error)
     {
-      err = d->error;
       if (r_objlen)
         *r_objlen = d->nitems;
-      goto leave;
+      return d->error;
     }
   if (!r_obj)
     return 0;
 
-  if (!d->finished)
+  err = finish_builder (d);
+  if (err)
+    return err;
+
+  buffer = xtrymalloc (d->objlen);
+  if (!buffer)
+    return gpg_error_from_syserror ();
+  err = write_items (d, buffer, NULL);
+  if (err)
     {
-      if (d->nitems == 1)
-        ;  /* Single item does not need an end tag.  */
-      else if (!d->nitems || !d->items[d->nitems-1].is_stop)
-        {
-          err = gpg_error (GPG_ERR_NO_OBJ);
-          goto leave;
-        }
+      xfree (buffer);
+      return err;
+    }
 
-      compute_lengths (d, 0);
-      err = d->error;
-      if (err)
-        goto leave;
+  *r_obj = buffer;
+  if (r_objlen)
+    *r_objlen = d->objlen;
+  return 0;
+}
 
-      d->finished = 1;
+
+/* This is a version of _ksba_der_builder_get which stores the object
+ * in the caller provided BUFFER of BUFSIZE bytes.  The length of the
+ * object is stored at R_OBJLEN.  If BUFFER is NULL or too short
+ * GPG_ERR_BUFFER_TOO_SHORT is returned and the required length is
+ * stored at R_OBJLEN.  Other errors are reported as with
+ * _ksba_der_builder_get.  */
+gpg_error_t
+_ksba_der_builder_get_buf (ksba_der_t d, unsigned char *buffer,
+                           size_t bufsize, size_t *r_objlen)
+{
+  gpg_error_t err;
+
+  if (!r_objlen)
+    return gpg_error (GPG_ERR_INV_ARG);
+  *r_objlen = 0;
+
+  if (!d)
+    return gpg_error (GPG_ERR_INV_ARG);
+  if (d->error)
+    {
+      *r_objlen = d->nitems;
+      return d->error;
     }
 
-  /* If the first element is a primitive element we rightly assume no
-   * other elements follow.  It is the user's duty to build a valid
-   * ASN.1 object.  */
-  bufsize = d->items[0].hdrlen + d->items[0].valuelen;
-
-  /* if (getenv ("KSBA_DEBUG_DER_BUILDER")) */
-  /*   { */
-  /*     for (idx=0; idx < d->nitems; idx++) */
-  /*       gpgrt_log_debug ("DERB[%2d]: c=%d t=%2d %s p=%p h=%u l=%zu\n", */
-  /*                        idx, */
-  /*                        d->items[idx].class, */
-  /*                        d->items[idx].tag, */
-  /*                        d->items[idx].verbatim? "verbatim": */
-  /*                        d->items[idx].is_stop? "stop": */
-  /*                        d->items[idx].is_constructed? "cons":"prim", */
-  /*                        d->items[idx].value, */
-  /*                        d->items[idx].hdrlen, */
-  /*                        d->items[idx].valuelen); */
-  /*   } */
-
-  buffer = xtrymalloc (bufsize);
-  if (!buffer)
+  err = finish_builder (d);
+  if (err)
+    return err;
+
+  *r_objlen = d->objlen;
+  if (!buffer || bufsize < d->objlen)
+    return gpg_error (GPG_ERR_BUFFER_TOO_SHORT);
+  err = write_items (d, buffer, NULL);
+  if (err)
+    *r_objlen = 0;
+  return err;
+}
+
+
+/* Write the constructed DER object at D to the writer W.  No copy of
+ * the entire object is created.  Errors are reported as with
+ * _ksba_der_builder_get.  */
+gpg_error_t
+_ksba_der_builder_write (ksba_der_t d, ksba_writer_t w)
+{
+  gpg_error_t err;
+
+  if (!d || !w)
+    return gpg_error (GPG_ERR_INV_ARG);
+
+  err = finish_builder (d);
+  if (err)
+    return err;
+
+  return write_items (d, NULL, w);
+}
+
+
+
+/*
+ * Template mode.
+ */
+
+/* Return an identifier for the primitive item most recently added to
+ * D so that its value can later be replaced using _ksba_der_set_field.
+ * This allows to construct an object once and then to only change
+ * some of its values, for example a serial number or a time.  On
+ * error -1 is returned and the error is recorded in D.  */
+int
+_ksba_der_mark_field (ksba_der_t d)
+{
+  struct item_s *item;
+
+  if (!d || d->error)
+    return -1;
+  if (!d->nitems)
     {
-      err = gpg_error_from_syserror ();
-      goto leave;
+      d->error = gpg_error (GPG_ERR_INV_STATE);
+      return -1;
     }
-  buflen = 0;
-  p = buffer;
+  item = d->items + d->nitems - 1;
+  if (item->is_stop || item->is_constructed)
+    {
+      d->error = gpg_error (GPG_ERR_INV_STATE);
+      return -1;
+    }
+  return d->nitems - 1;
+}
 
-  for (idx=0; idx < d->nitems; idx++)
+
+/* Replace the value of the item FIELD of D, as returned by
+ * _ksba_der_mark_field, by a copy of (VALUE,VALUELEN).  The value is
+ * stored as given; for example no leading zero is added to an
+ * INTEGER.  This may be called after the object has been retrieved;
+ * the next retrieval then yields the object with the new value.  */
+gpg_error_t
+_ksba_der_set_field (ksba_der_t d, int field,
+                     const void *value, size_t valuelen)
+{
+  struct item_s *item;
+  unsigned char *p;
+
+  if (!d || field < 0 || field >= d->nitems || (!value && valuelen))
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (d->error)
+    return d->error;
+  item = d->items + field;
+  if (item->is_stop || item->is_constructed)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  if (item->in_arena && valuelen <= item->valuesize)
+    p = d->arena + item->valueoff;
+  else
     {
-      if (d->items[idx].is_stop)
-        continue;
-      if (!d->items[idx].verbatim)
-        {
-          /* For data encapsulated in a bit string we need to adjust
-           * for the unused bits octet.  */
-          encap_bts = (d->items[idx].encapsulate && !d->items[idx].class
-                       && d->items[idx].tag == TYPE_BIT_STRING);
+      p = reserve_value (d, valuelen);
+      if (!p)
+        return d->error;
+      item->in_arena = 1;
+      item->valueoff = d->arenalen;
+      item->valuesize = valuelen;
+      d->arenalen += valuelen;
+    }
+  if (valuelen)
+    memcpy (p, value, valuelen);
 
-          if (buflen + d->items[idx].hdrlen + encap_bts > bufsize)
-            {
-              err = gpg_error (GPG_ERR_BUG);
-              goto leave;
-            }
-          write_tl (p, d->items[idx].class, d->items[idx].tag,
-                    (d->items[idx].is_constructed
-                     && !d->items[idx].encapsulate),
-                    d->items[idx].valuelen + encap_bts);
-          p += d->items[idx].hdrlen;
-          buflen += d->items[idx].hdrlen;
-          if (encap_bts)
-            {
-              *p++ = 0;
-              buflen++;
-            }
-        }
-      if (d->items[idx].value)
+  if (item->valuelen != valuelen)
+    {
+      /* The lengths need to be computed again.  */
+      item->valuelen = valuelen;
+      d->finished = 0;
+      d->written = 0;
+    }
+  item->dirty = 1;
+  return 0;
+}
+
+
+/* Update the object in BUFFER of BUFSIZE bytes which has been written
+ * by the last call to _ksba_der_builder_get_buf or this function for
+ * D.  If the lengths of all changed fields are unchanged, only these
+ * fields are written to BUFFER.  Otherwise the entire object is
+ * written as with _ksba_der_builder_get_buf which also explains the
+ * meaning of R_OBJLEN and the return value.  */
+gpg_error_t
+_ksba_der_builder_update_buf (ksba_der_t d, unsigned char *buffer,
+                              size_t bufsize, size_t *r_objlen)
+{
+  struct item_s *item;
+  int idx;
+
+  if (!d || !r_objlen)
+    return gpg_error (GPG_ERR_INV_ARG);
+
+  if (!d->error && d->finished && d->written
+      && buffer && bufsize >= d->objlen)
+    {
+      for (idx=0; idx < d->nitems; idx++)
         {
-          if (buflen + d->items[idx].valuelen > bufsize)
-            {
-              err = gpg_error (GPG_ERR_BUG);
-              goto leave;
-            }
-          memcpy (p, d->items[idx].value, d->items[idx].valuelen);
-          p += d->items[idx].valuelen;
-          buflen += d->items[idx].valuelen;
+          item = d->items + idx;
+          if (!item->dirty)
+            continue;
+          memcpy (buffer + item->outoff, d->arena + item->valueoff,
+                  item->valuelen);
+          item->dirty = 0;
         }
+      *r_objlen = d->objlen;
+      return 0;
     }
-  assert (buflen == bufsize);
 
-  *r_obj = buffer;
-  *r_objlen = buflen;
-  buffer = NULL;
+  return _ksba_der_builder_get_buf (d, buffer, bufsize, r_objlen);
+}
 
- leave:
-  xfree (buffer);
-  return err;
+
+/*
+ * The DER cursor.
+ */
+
+/* Check that the header described by TI is valid DER.  */
+static gpg_error_t
+check_der_header (const struct tag_info *ti)
+{
+  size_t ntag;
+
+  if (ti->ndef)
+    return gpg_error (GPG_ERR_BAD_BER);
+  if (ti->class == CLASS_UNIVERSAL && !ti->tag)
+    return gpg_error (GPG_ERR_BAD_BER);  /* End tag.  */
+
+  /* The tag must be encoded in the shortest form.  */
+  ntag = 1;
+  if ((ti->buf[0] & 0x1f) == 0x1f)
+    {
+      if (ti->tag < 0x1f || ti->buf[1] == 0x80)
+        return gpg_error (GPG_ERR_BAD_BER);
+      while (ti->buf[ntag] & 0x80)
+        ntag++;
+      ntag++;
+    }
+
+  /* And so must be the length.  */
+  if ((ti->buf[ntag] & 0x80)
+      && (ti->length < 128 || !ti->buf[ntag+1]))
+    return gpg_error (GPG_ERR_BAD_BER);
+
+  return 0;
+}
+
+
+/* Check the value V of length N of the universal primitive type TAG
+   or whether TAG is allowed to be CONSTRUCTED.  */
+static gpg_error_t
+check_der_value (unsigned long tag, int constructed,
+                 const unsigned char *v, size_t n)
+{
+  size_t i;
+
+  switch (tag)
+    {
+    case TYPE_SEQUENCE:
+    case TYPE_SET:
+      return constructed? 0 : gpg_error (GPG_ERR_BAD_BER);
+    default:
+      break;
+    }
+
+  /* In DER all other universal types we know about are primitive.  */
+  if (constructed)
+    return (tag <= TYPE_BMP_STRING)? gpg_error (GPG_ERR_BAD_BER) : 0;
+
+  switch (tag)
+    {
+    case TYPE_BOOLEAN:
+      if (n != 1 || (*v && *v != 0xff))
+        return gpg_error (GPG_ERR_BAD_BER);
+      break;
+    case TYPE_INTEGER:
+    case TYPE_ENUMERATED:
+      if (!n || (n > 1 && ((!v[0] && !(v[1] & 0x80))
+                           || (v[0] == 0xff && (v[1] & 0x80)))))
+        return gpg_error (GPG_ERR_BAD_BER);
+      break;
+    case TYPE_NULL:
+      if (n)
+        return gpg_error (GPG_ERR_BAD_BER);
+      break;
+    case TYPE_BIT_STRING:
+      if (!n || v[0] > 7 || (n == 1 && v[0]))
+        return gpg_error (GPG_ERR_BAD_BER);
+      break;
+    case TYPE_OBJECT_ID:
+      if (!n || (v[n-1] & 0x80))
+        return gpg_error (GPG_ERR_BAD_BER);
+      for (i=0; i < n; i++)  /* No leading zero groups.  */
+        if (v[i] == 0x80 && (!i || !(v[i-1] & 0x80)))
+          return gpg_error (GPG_ERR_BAD_BER);
+      break;
+    default:
+      break;
+    }
+  return 0;
+}
+
+
+/* Initialize the cursor C to walk the DER encoded data in DER of
+   length DERLEN.  The data must be valid while the cursor is used.
+   The first call to _ksba_der_cursor_next yields the first element
+   at the top level.  */
+void
+_ksba_der_cursor_init (ksba_der_cursor_t c, const void *der, size_t derlen)
+{
+  if (!c)
+    return;
+  memset (c, 0, sizeof *c);
+  c->_der = der;
+  c->_end[0] = der? derlen : 0;
+}
+
+
+/* Move the cursor C to the next element of the current level.  The
+   class, the tag, the constructed flag and the length of the value
+   are stored at the given addresses (each may be NULL).  The value of
+   the previous element is skipped.  Returns GPG_ERR_EOF at the end of
+   the current level and GPG_ERR_BAD_BER if the element is not valid
+   DER.  */
+gpg_error_t
+_ksba_der_cursor_next (ksba_der_cursor_t c, int *r_class, int *r_tag,
+                       int *r_constructed, size_t *r_length)
+{
+  gpg_error_t err;
+  struct tag_info ti;
+  const unsigned char *buf;
+  size_t pos, size;
+
+  if (!c)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  pos = c->_valid? c->_off + c->_nhdr + c->_len : c->_next;
+  c->_valid = 0;
+  c->_next = pos;
+  if (pos >= c->_end[c->_depth])
+    return gpg_error (GPG_ERR_EOF);
+
+  buf = c->_der + pos;
+  size = c->_end[c->_depth] - pos;
+  err = _ksba_ber_parse_tl (&buf, &size, &ti);
+  if (err)
+    return err;
+  err = check_der_header (&ti);
+  if (err)
+    return err;
+  if (ti.length > size)
+    return gpg_error (GPG_ERR_BAD_BER);
+  if (ti.class == CLASS_UNIVERSAL)
+    {
+      err = check_der_value (ti.tag, ti.is_constructed, buf, ti.length);
+      if (err)
+        return err;
+    }
+
+  c->_off = pos;
+  c->_nhdr = ti.nhdr;
+  c->_len = ti.length;
+  c->_constructed = !!ti.is_constructed;
+  c->_valid = 1;
+  if (r_class)
+    *r_class = ti.class;
+  if (r_tag)
+    *r_tag = ti.tag;
+  if (r_constructed)
+    *r_constructed = ti.is_constructed;
+  if (r_length)
+    *r_length = ti.length;
+  return 0;
+}
+
+
+/* Descend into the current element of C, which must be constructed.
+   The next call to _ksba_der_cursor_next yields its first child.  */
+gpg_error_t
+_ksba_der_cursor_enter (ksba_der_cursor_t c)
+{
+  if (!c)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!c->_valid || !c->_constructed)
+    return gpg_error (GPG_ERR_INV_STATE);
+  if (c->_depth >= KSBA_DER_CURSOR_MAXDEPTH)
+    return gpg_error (GPG_ERR_TOO_LARGE);
+
+  c->_depth++;
+  c->_end[c->_depth] = c->_off + c->_nhdr + c->_len;
+  c->_next = c->_off + c->_nhdr;
+  c->_valid = 0;
+  return 0;
+}
+
+
+/* Skip the remaining elements of the current level of C and return
+   to the parent level.  The next call to _ksba_der_cursor_next
+   yields the element following the parent.  */
+gpg_error_t
+_ksba_der_cursor_leave (ksba_der_cursor_t c)
+{
+  if (!c)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!c->_depth)
+    return gpg_error (GPG_ERR_INV_STATE);
+
+  c->_next = c->_end[c->_depth];
+  c->_depth--;
+  c->_valid = 0;
+  return 0;
+}
+
+
+/* Store a pointer to the value of the current element of C at R_PTR
+   and its length at R_LENGTH.  */
+gpg_error_t
+_ksba_der_cursor_value (ksba_der_cursor_t c,
+                        const unsigned char **r_ptr, size_t *r_length)
+{
+  if (!c || !r_ptr || !r_length)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!c->_valid)
+    return gpg_error (GPG_ERR_INV_STATE);
+
+  *r_ptr = c->_der + c->_off + c->_nhdr;
+  *r_length = c->_len;
+  return 0;
+}
+
+
+/* Store a pointer to the entire current element of C including its
+   header at R_PTR and its length at R_LENGTH.  */
+gpg_error_t
+_ksba_der_cursor_tlv (ksba_der_cursor_t c,
+                      const unsigned char **r_ptr, size_t *r_length)
+{
+  if (!c || !r_ptr || !r_length)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!c->_valid)
+    return gpg_error (GPG_ERR_INV_STATE);
+
+  *r_ptr = c->_der + c->_off;
+  *r_length = c->_nhdr + c->_len;
+  return 0;
 }
@@ -46,6 +46,29 @@ void _ksba_der_add_end (ksba_der_t d);
 
 gpg_error_t _ksba_der_builder_get (ksba_der_t d,
                                    unsigned char **r_obj, size_t *r_objlen);
+gpg_error_t _ksba_der_builder_get_buf (ksba_der_t d, unsigned char *buffer,
+                                       size_t bufsize, size_t *r_objlen);
+gpg_error_t _ksba_der_builder_write (ksba_der_t d, ksba_writer_t w);
+
+int _ksba_der_mark_field (ksba_der_t d);
+gpg_error_t _ksba_der_set_field (ksba_der_t d, int field,
+                                 const void *value, size_t valuelen);
+gpg_error_t _ksba_der_builder_update_buf (ksba_der_t d, unsigned char *buffer,
+                                          size_t bufsize, size_t *r_objlen);
+
+void _ksba_der_cursor_init (ksba_der_cursor_t c,
+                            const void *der, size_t derlen);
+gpg_error_t _ksba_der_cursor_next (ksba_der_cursor_t c,
+                                   int *r_class, int *r_tag,
+                                   int *r_constructed, size_t *r_length);
+gpg_error_t _ksba_der_cursor_enter (ksba_der_cursor_t c);
+gpg_error_t _ksba_der_cursor_leave (ksba_der_cursor_t c);
+gpg_error_t _ksba_der_cursor_value (ksba_der_cursor_t c,
+                                    const unsigned char **r_ptr,
+                                    size_t *r_length);
+gpg_error_t _ksba_der_cursor_tlv (ksba_der_cursor_t c,
+                                  const unsigned char **r_ptr,
+                                  size_t *r_length);
 
 
 #endif /*DER_BUILDER_H*/
@@ -39,8 +39,6 @@
 #include "util.h"
 #include "asn1-func.h"
 #include "ber-help.h"
-#include "ber-decoder.h"
-#include "stringbuf.h"
 
 
 static const struct {
@@ -98,13 +96,141 @@ static unsigned char charclasses[128] = {
 #undef P
 
 
+/* Helpers to scan strings a machine word at a time.  WORD_ONES has
+   all bytes set to 0x01 and WORD_HIGHS all bytes set to 0x80.  The
+   tests are only valid for words without any high bit set.  */
+#define WORD_ONES   (~0UL / 255)
+#define WORD_HIGHS  (WORD_ONES * 0x80)
+/* True if any byte of W is less than C.  */
+#define WORD_HAS_LESS(w,c) (((w) - WORD_ONES * (c)) & ~(w) & WORD_HIGHS)
+/* True if any byte of W equals C.  */
+#define WORD_HAS_BYTE(w,c) WORD_HAS_LESS ((w) ^ (WORD_ONES * (c)), 1)
+
+static inline unsigned long
+load_word (const unsigned char *s)
+{
+  unsigned long w;
+
+  memcpy (&w, s, sizeof w);
+  return w;
+}
+
+
+/* Return the number of leading bytes of S of length N which do not
+   have the high bit set.  */
+static size_t
+ascii_span (const unsigned char *s, size_t n)
+{
+  size_t i = 0;
+
+  for (; i + sizeof (unsigned long) <= n; i += sizeof (unsigned long))
+    if ((load_word (s + i) & WORD_HIGHS))
+      break;
+  for (; i < n && !(s[i] & 0x80); i++)
+    ;
+  return i;
+}
+
+
+/* Return true if the character C needs to be quoted.  This does not
+   care about spaces and hash marks at the begin or end of a
+   string.  */
+static inline int
+need_quote_p (int c)
+{
+  return (c < ' ' || c > 126
+          || c == ',' || c == '+' || c == '\"' || c == '\\'
+          || c == '<' || c == '>' || c == ';');
+}
+
+
+/* Return the number of leading bytes of S of length N which do not
+   need to be quoted.  */
+static size_t
+plain_span (const unsigned char *s, size_t n)
+{
+  size_t i = 0;
+  unsigned long w;
+
+  for (; i + sizeof w <= n; i += sizeof w)
+    {
+      w = load_word (s + i);
+      if ((w & WORD_HIGHS)
+          || WORD_HAS_LESS (w, ' ') || WORD_HAS_BYTE (w, 127)
+          || WORD_HAS_BYTE (w, ',') || WORD_HAS_BYTE (w, '+')
+          || WORD_HAS_BYTE (w, '\"') || WORD_HAS_BYTE (w, '\\')
+          || WORD_HAS_BYTE (w, '<') || WORD_HAS_BYTE (w, '>')
+          || WORD_HAS_BYTE (w, ';'))
+        break;
+    }
+  for (; i < n && !need_quote_p (s[i]); i++)
+    ;
+  return i;
+}
+
+
+/* The output of the DN rendering.  With BUF set to NULL only the
+   length of the string is computed.  */
+struct dnbuf
+{
+  char *buf;
+  size_t len;
+};
+
+
+static inline void
+put_dnbuf_mem (struct dnbuf *db, const void *text, size_t n)
+{
+  if (db->buf)
+    memcpy (db->buf + db->len, text, n);
+  db->len += n;
+}
+
+
+/* Put N bytes of TEXT to DB but only every SKIP+1st byte, assuming
+   that the other bytes are null octets.  */
+static inline void
+put_dnbuf_mem_skip (struct dnbuf *db, const unsigned char *text, size_t n,
+                    int skip)
+{
+  char *p;
+
+  if (!skip)
+    {
+      put_dnbuf_mem (db, text, n);
+      return;
+    }
+  if (!db->buf)
+    {
+      db->len += n / (skip + 1);
+      return;
+    }
+  p = db->buf + db->len;
+  while (n > skip)
+    {
+      text += skip;
+      n -= skip;
+      *p++ = *text++;
+      n--;
+      db->len++;
+    }
+}
+
+
+static inline void
+put_dnbuf (struct dnbuf *db, const char *text)
+{
+  put_dnbuf_mem (db, text, strlen (text));
+}
+
+
 /* This function is used for 1 byte encodings to insert any required
    quoting.  It does not do the quoting for a space or hash mark at
    the beginning of a string or a space as the last character of a
    string.  It will do steps of SKIP+1 characters, assuming that these
    SKIP characters are null octets. */
 static void
-append_quoted (struct stringbuf *sb, const unsigned char *value, size_t length,
+append_quoted (struct dnbuf *db, const unsigned char *value, size_t length,
                int skip)
 {
   unsigned char tmp[4];
@@ -113,16 +239,25 @@ append_quoted (struct stringbuf *sb, const unsigned char *value, size_t length,
 
   for (;;)
     {
-      for (value = s; n+skip < length; n++, s++)
+      value = s;
+      if (!skip)
         {
-          s += skip;
-          n += skip;
-          if (*s < ' ' || *s > 126 || strchr (",+\"\\<>;", *s) )
-            break;
+          size_t nplain = plain_span (s, length - n);
+
+          s += nplain;
+          n += nplain;
         }
+      else
+        for (; n+skip < length; n++, s++)
+          {
+            s += skip;
+            n += skip;
+            if (need_quote_p (*s))
+              break;
+          }
 
       if (s != value)
-        put_stringbuf_mem_skip (sb, value, s-value, skip);
+        put_dnbuf_mem_skip (db, value, s-value, skip);
       if (n+skip >= length)
         return; /* ready */
       s += skip;
@@ -130,34 +265,34 @@ append_quoted (struct stringbuf *sb, const unsigned char *value, size_t length,
       if ( *s < ' ' || *s > 126 )
         {
           snprintf (tmp, sizeof tmp, "\\%02X", *s);
-          put_stringbuf_mem (sb, tmp, 3);
+          put_dnbuf_mem (db, tmp, 3);
         }
       else
         {
           tmp[0] = '\\';
           tmp[1] = *s;
-          put_stringbuf_mem (sb, tmp, 2);
+          put_dnbuf_mem (db, tmp, 2);
         }
       n++; s++;
     }
 }
 
 
-/* Append VALUE of LENGTH and TYPE to SB.  Do the required quoting. */
+/* Append VALUE of LENGTH and TYPE to DB.  Do the required quoting. */
 static void
 append_utf8_value (const unsigned char *value, size_t length,
-                   struct stringbuf *sb)
+                   struct dnbuf *db)
 {
   unsigned char tmp[6];
   const unsigned char *s;
-  size_t n;
+  size_t n, nascii;
   int i, nmore;
 
   if (length && (*value == ' ' || *value == '#'))
     {
       tmp[0] = '\\';
       tmp[1] = *value;
-      put_stringbuf_mem (sb, tmp, 2);
+      put_dnbuf_mem (db, tmp, 2);
       value++;
       length--;
     }
@@ -165,16 +300,18 @@ append_utf8_value (const unsigned char *value, size_t length,
     {
       tmp[0] = '\\';
       tmp[1] = ' ';
-      put_stringbuf_mem (sb, tmp, 2);
+      put_dnbuf_mem (db, tmp, 2);
       length--;
     }
 
   for (s=value, n=0;;)
     {
-      for (value = s; n < length && !(*s & 0x80); n++, s++)
-        ;
+      value = s;
+      nascii = ascii_span (s, length - n);
+      s += nascii;
+      n += nascii;
       if (s != value)
-        append_quoted (sb, value, s-value, 0);
+        append_quoted (db, value, s-value, 0);
       if (n==length)
         return; /* ready */
       if (!(*s & 0x80))
@@ -196,7 +333,7 @@ append_utf8_value (const unsigned char *value, size_t length,
         {
           /* Encoding error:  We quote the bad byte.  */
           snprintf (tmp, sizeof tmp, "\\%02X", *s);
-          put_stringbuf_mem (sb, tmp, 3);
+          put_dnbuf_mem (db, tmp, 3);
           s++; n++;
         }
       else
@@ -209,26 +346,26 @@ append_utf8_value (const unsigned char *value, size_t length,
               tmp[i] = *s++;
               n++;
             }
-          put_stringbuf_mem (sb, tmp, i);
+          put_dnbuf_mem (db, tmp, i);
         }
     }
 }
 
-/* Append VALUE of LENGTH and TYPE to SB.  Do character set conversion
+/* Append VALUE of LENGTH and TYPE to DB.  Do character set conversion
    and quoting */
 static void
 append_latin1_value (const unsigned char *value, size_t length,
-                     struct stringbuf *sb)
+                     struct dnbuf *db)
 {
   unsigned char tmp[2];
   const unsigned char *s;
-  size_t n;
+  size_t n, nascii;
 
   if (length && (*value == ' ' || *value == '#'))
     {
       tmp[0] = '\\';
       tmp[1] = *value;
-      put_stringbuf_mem (sb, tmp, 2);
+      put_dnbuf_mem (db, tmp, 2);
       value++;
       length--;
     }
@@ -236,31 +373,33 @@ append_latin1_value (const unsigned char *value, size_t length,
     {
       tmp[0] = '\\';
       tmp[1] = ' ';
-      put_stringbuf_mem (sb, tmp, 2);
+      put_dnbuf_mem (db, tmp, 2);
       length--;
     }
 
   for (s=value, n=0;;)
     {
-      for (value = s; n < length && !(*s & 0x80); n++, s++)
-        ;
+      value = s;
+      nascii = ascii_span (s, length - n);
+      s += nascii;
+      n += nascii;
       if (s != value)
-        append_quoted (sb, value, s-value, 0);
+        append_quoted (db, value, s-value, 0);
       if (n==length)
         return; /* ready */
       assert ((*s & 0x80));
       tmp[0] = 0xc0 | ((*s >> 6) & 3);
       tmp[1] = 0x80 | ( *s & 0x3f );
-      put_stringbuf_mem (sb, tmp, 2);
+      put_dnbuf_mem (db, tmp, 2);
       n++; s++;
     }
 }
 
-/* Append VALUE of LENGTH and TYPE to SB.  Do UCS-4 to utf conversion
+/* Append VALUE of LENGTH and TYPE to DB.  Do UCS-4 to utf conversion
    and and quoting */
 static void
 append_ucs4_value (const unsigned char *value, size_t length,
-                   struct stringbuf *sb)
+                   struct dnbuf *db)
 {
   unsigned char tmp[7];
   const unsigned char *s;
@@ -273,7 +412,7 @@ append_ucs4_value (const unsigned char *value, size_t length,
     {
       tmp[0] = '\\';
       tmp[1] = *value;
-      put_stringbuf_mem (sb, tmp, 2);
+      put_dnbuf_mem (db, tmp, 2);
       value += 4;
       length -= 4;
     }
@@ -281,7 +420,7 @@ append_ucs4_value (const unsigned char *value, size_t length,
     {
       tmp[0] = '\\';
       tmp[1] = ' ';
-      put_stringbuf_mem (sb, tmp, 2);
+      put_dnbuf_mem (db, tmp, 2);
       length -= 4;
     }
 
@@ -291,13 +430,13 @@ append_ucs4_value (const unsigned char *value, size_t length,
              && !s[0] && !s[1] && !s[2] && !(s[3] & 0x80); n += 4, s += 4)
         ;
       if (s != value)
-        append_quoted (sb, value, s-value, 3);
+        append_quoted (db, value, s-value, 3);
       if (n>=length)
         return; /* ready */
       if (n < 4)
         { /* This is an invalid encoding - better stop after adding
              one impossible characater */
-          put_stringbuf_mem (sb, "\xff", 1);
+          put_dnbuf_mem (db, "\xff", 1);
           return;
         }
       c = *s++ << 24;
@@ -341,15 +480,15 @@ append_ucs4_value (const unsigned char *value, size_t length,
           tmp[i++] = 0x80 | ((c >>  6) & 0x3f);
           tmp[i++] = 0x80 | ( c        & 0x3f);
         }
-      put_stringbuf_mem (sb, tmp, i);
+      put_dnbuf_mem (db, tmp, i);
     }
 }
 
-/* Append VALUE of LENGTH and TYPE to SB.  Do UCS-2 to utf conversion
+/* Append VALUE of LENGTH and TYPE to DB.  Do UCS-2 to utf conversion
    and and quoting */
 static void
 append_ucs2_value (const unsigned char *value, size_t length,
-                   struct stringbuf *sb)
+                   struct dnbuf *db)
 {
   unsigned char tmp[3];
   const unsigned char *s;
@@ -361,7 +500,7 @@ append_ucs2_value (const unsigned char *value, size_t length,
     {
       tmp[0] = '\\';
       tmp[1] = *value;
-      put_stringbuf_mem (sb, tmp, 2);
+      put_dnbuf_mem (db, tmp, 2);
       value += 2;
       length -= 2;
     }
@@ -369,7 +508,7 @@ append_ucs2_value (const unsigned char *value, size_t length,
     {
       tmp[0] = '\\';
       tmp[1] = ' ';
-      put_stringbuf_mem (sb, tmp, 2);
+      put_dnbuf_mem (db, tmp, 2);
       length -=2;
     }
 
@@ -378,13 +517,13 @@ append_ucs2_value (const unsigned char *value, size_t length,
       for (value = s; n+1 < length && !s[0] && !(s[1] & 0x80); n += 2, s += 2)
         ;
       if (s != value)
-        append_quoted (sb, value, s-value, 1);
+        append_quoted (db, value, s-value, 1);
       if (n>=length)
         return; /* ready */
       if (n < 2)
         { /* This is an invalid encoding - better stop after adding
              one impossible characater */
-          put_stringbuf_mem (sb, "\xff", 1);
+          put_dnbuf_mem (db, "\xff", 1);
           return;
         }
       c  = *s++ << 8;
@@ -402,254 +541,293 @@ append_ucs2_value (const unsigned char *value, size_t length,
           tmp[i++] = 0x80 | ((c >>  6) & 0x3f);
           tmp[i++] = 0x80 | ( c        & 0x3f);
         }
-      put_stringbuf_mem (sb, tmp, i);
+      put_dnbuf_mem (db, tmp, i);
     }
 }
 
 
-/* Append attribute and value.  ROOT is the sequence */
+/* Parse the next TLV from the buffer *BUF of length *LEN into TI and
+   VAL and advance the buffer.  Returns -1 for a bad encoding.  */
+static int
+next_dn_tlv (const unsigned char **buf, size_t *len, struct tag_info *ti,
+             const unsigned char **val)
+{
+  if (_ksba_ber_parse_tl (buf, len, ti) || ti->ndef || ti->length > *len)
+    return -1;
+  *val = *buf;
+  *buf += ti->length;
+  *len -= ti->length;
+  return 0;
+}
+
+
+/* Append the name of the attribute type given by the DER encoded OID
+   of OIDLEN bytes to DB.  Sets USE_HEX if there is no name for it.  */
 static gpg_error_t
-append_atv (const unsigned char *image, AsnNode root, struct stringbuf *sb)
+render_attr_type (const unsigned char *oid, size_t oidlen, struct dnbuf *db,
+                  int *use_hex)
 {
-  AsnNode node = root->down;
+  char buffer[100];
+  char *p;
   const char *name;
-  int use_hex = 0;
   int i;
 
-  if (!node || node->type != TYPE_OBJECT_ID)
-    return gpg_error (GPG_ERR_UNEXPECTED_TAG);
-  if (node->off == -1)
-    return gpg_error (GPG_ERR_NO_VALUE); /* Hmmm, this might lead to misunderstandings */
-
-  name = NULL;
+  *use_hex = 0;
   for (i=0; oid_name_tbl[i].name; i++)
     {
       if (oid_name_tbl[i].source == 1
-          && node->len == oid_name_tbl[i].oidlen
-          && !memcmp (image+node->off+node->nhdr,
-                      oid_name_tbl[i].oid, node->len))
+          && oidlen == oid_name_tbl[i].oidlen
+          && !memcmp (oid, oid_name_tbl[i].oid, oidlen))
         {
-          name = oid_name_tbl[i].name;
-          break;
+          put_dnbuf (db, oid_name_tbl[i].name);
+          return 0;
         }
     }
-  if (name)
-    put_stringbuf (sb, name);
-  else
-    { /* No name for the OID in the table; at least not DER encoded.
-         Now convert the OID to a string, try to find it in the table
-         again and use the string as last resort.  */
-      char *p;
 
-      p = ksba_oid_to_str (image+node->off+node->nhdr, node->len);
+  /* No name for the OID in the table; at least not DER encoded.  Now
+     convert the OID to a string, try to find it in the table again
+     and use the string as last resort.  */
+  if (!ksba_oid_to_str_buf ((const char *)oid, oidlen, buffer, sizeof buffer))
+    p = buffer;
+  else
+    {
+      p = ksba_oid_to_str ((const char *)oid, oidlen);
       if (!p)
         return gpg_error (GPG_ERR_ENOMEM);
+    }
 
-      for (i=0; *p && oid_name_tbl[i].name; i++)
-        {
-          if (oid_name_tbl[i].source == 1
-              && !strcmp (p, oid_name_tbl[i].oidstr))
-            {
-              name = oid_name_tbl[i].name;
-              break;
-            }
-        }
-      if (name)
-        put_stringbuf (sb, name);
-      else
+  name = NULL;
+  for (i=0; *p && oid_name_tbl[i].name; i++)
+    {
+      if (oid_name_tbl[i].source == 1
+          && !strcmp (p, oid_name_tbl[i].oidstr))
         {
-          put_stringbuf (sb, p);
-          use_hex = 1;
+          name = oid_name_tbl[i].name;
+          break;
         }
-      xfree (p);
     }
-  put_stringbuf (sb, "=");
-  node = node->right;
-  if (!node || node->off == -1)
+  if (name)
+    put_dnbuf (db, name);
+  else
+    {
+      put_dnbuf (db, p);
+      *use_hex = 1;
+    }
+  if (p != buffer)
+    xfree (p);
+  return 0;
+}
+
+
+/* Append the AttributeTypeAndValue at DER of DERLEN bytes to DB.  */
+static gpg_error_t
+render_atv (const unsigned char *der, size_t derlen, struct dnbuf *db)
+{
+  static const char hexdigits[] = "0123456789ABCDEF";
+  gpg_error_t err;
+  struct tag_info ti;
+  const unsigned char *oid, *val;
+  char tmp[2];
+  int use_hex;
+  size_t n;
+
+  if (next_dn_tlv (&der, &derlen, &ti, &oid))
+    return gpg_error (GPG_ERR_BAD_BER);
+  if (ti.class != CLASS_UNIVERSAL || ti.tag != TYPE_OBJECT_ID)
+    return gpg_error (GPG_ERR_UNEXPECTED_TAG);
+  err = render_attr_type (oid, ti.length, db, &use_hex);
+  if (err)
+    return err;
+  put_dnbuf_mem (db, "=", 1);
+
+  if (!derlen)
     return gpg_error (GPG_ERR_NO_VALUE);
+  if (next_dn_tlv (&der, &derlen, &ti, &val))
+    return gpg_error (GPG_ERR_BAD_BER);
+  if (ti.class != CLASS_UNIVERSAL || ti.is_constructed)
+    use_hex = 1;
 
-  switch (use_hex? 0 : node->type)
+  switch (use_hex? 0 : ti.tag)
     {
     case TYPE_UTF8_STRING:
-      append_utf8_value (image+node->off+node->nhdr, node->len, sb);
+      append_utf8_value (val, ti.length, db);
       break;
     case TYPE_PRINTABLE_STRING:
     case TYPE_IA5_STRING:
       /* we assume that wrong encodings are latin-1 */
     case TYPE_TELETEX_STRING: /* Not correct, but mostly used as latin-1 */
-      append_latin1_value (image+node->off+node->nhdr, node->len, sb);
+      append_latin1_value (val, ti.length, db);
       break;
 
     case TYPE_UNIVERSAL_STRING:
-      append_ucs4_value (image+node->off+node->nhdr, node->len, sb);
+      append_ucs4_value (val, ti.length, db);
       break;
 
     case TYPE_BMP_STRING:
-      append_ucs2_value (image+node->off+node->nhdr, node->len, sb);
+      append_ucs2_value (val, ti.length, db);
       break;
 
     case 0: /* forced usage of hex */
     default:
-      put_stringbuf (sb, "#");
-      for (i=0; i < node->len; i++)
-        {
-          char tmp[3];
-          snprintf (tmp, sizeof tmp, "%02X", image[node->off+node->nhdr+i]);
-          put_stringbuf (sb, tmp);
-        }
+      put_dnbuf_mem (db, "#", 1);
+      if (!db->buf)
+        db->len += 2 * ti.length;
+      else
+        for (n=0; n < ti.length; n++)
+          {
+            tmp[0] = hexdigits[val[n] >> 4];
+            tmp[1] = hexdigits[val[n] & 15];
+            put_dnbuf_mem (db, tmp, 2);
+          }
       break;
     }
 
   return 0;
 }
 
+
+/* Append the RelativeDistinguishedName at DER of DERLEN bytes to
+   DB.  */
 static gpg_error_t
-dn_to_str (const unsigned char *image, AsnNode root, struct stringbuf *sb)
+render_rdn (const unsigned char *der, size_t derlen, struct dnbuf *db)
 {
   gpg_error_t err;
-  AsnNode nset;
-
-  if (!root )
-    return 0; /* empty DN */
-  nset = root->down;
-  if (!nset)
-    return 0; /* consider this as empty */
-  if (nset->type != TYPE_SET_OF)
-    return gpg_error (GPG_ERR_UNEXPECTED_TAG);
+  struct tag_info ti;
+  const unsigned char *atv;
+  int first = 1;
 
-  /* output in reverse order */
-  while (nset->right)
-    nset = nset->right;
-
-  for (;;)
+  while (derlen)
     {
-      AsnNode nseq;
-
-      if (nset->type != TYPE_SET_OF)
+      if (next_dn_tlv (&der, &derlen, &ti, &atv))
+        return gpg_error (GPG_ERR_BAD_BER);
+      if (ti.class != CLASS_UNIVERSAL || ti.tag != TYPE_SEQUENCE)
         return gpg_error (GPG_ERR_UNEXPECTED_TAG);
-      for (nseq = nset->down; nseq; nseq = nseq->right)
-        {
-          if (nseq->type != TYPE_SEQUENCE)
-            return gpg_error (GPG_ERR_UNEXPECTED_TAG);
-          if (nseq != nset->down)
-            put_stringbuf (sb, "+");
-          err = append_atv (image, nseq, sb);
-          if (err)
-            return err;
-        }
-      if (nset == root->down)
-        break;
-      put_stringbuf (sb, ",");
-      nset = nset->left;
+      if (!first)
+        put_dnbuf_mem (db, "+", 1);
+      first = 0;
+      err = render_atv (atv, ti.length, db);
+      if (err)
+        return err;
     }
-
   return 0;
 }
 
 
-gpg_error_t
-_ksba_dn_to_str (const unsigned char *image, AsnNode node, char **r_string)
+/* Render the DER encoded Name at DER of DERLEN bytes into DB.  The
+   RDNS are output in reverse order as required by RFC-2253.  */
+static gpg_error_t
+render_dn (const unsigned char *der, size_t derlen, struct dnbuf *db)
 {
   gpg_error_t err;
-  struct stringbuf sb;
+  struct tag_info ti;
+  const unsigned char *p, *rdn;
+  struct {
+    const unsigned char *der;
+    size_t len;
+  } fixed_rdns[16], *rdns;
+  size_t n;
+  int i, nrdns;
 
-  *r_string = NULL;
-  if (!node || node->type != TYPE_SEQUENCE_OF)
-    return gpg_error (GPG_ERR_INV_VALUE);
+  if (next_dn_tlv (&der, &derlen, &ti, &rdn))
+    return gpg_error (GPG_ERR_BAD_BER);
+  if (ti.class != CLASS_UNIVERSAL || ti.tag != TYPE_SEQUENCE)
+    return gpg_error (GPG_ERR_UNEXPECTED_TAG);
+  der = rdn;
+  derlen = ti.length;
 
-  init_stringbuf (&sb, 100);
-  err = dn_to_str (image, node, &sb);
-  if (!err)
+  for (nrdns=0, p=der, n=derlen; n; nrdns++)
     {
-      *r_string = get_stringbuf (&sb);
-      if (!*r_string)
-        err = gpg_error (GPG_ERR_ENOMEM);
+      if (next_dn_tlv (&p, &n, &ti, &rdn))
+        return gpg_error (GPG_ERR_BAD_BER);
+      if (ti.class != CLASS_UNIVERSAL || ti.tag != TYPE_SET)
+        return gpg_error (GPG_ERR_UNEXPECTED_TAG);
     }
-  deinit_stringbuf (&sb);
-
-  return err;
-}
-
-
-/* Create a new decoder and run it for the given element */
-/* Fixme: this code is duplicated from cms-parser.c */
-static gpg_error_t
-create_and_run_decoder (ksba_reader_t reader, const char *elem_name,
-                        AsnNode *r_root,
-                        unsigned char **r_image, size_t *r_imagelen)
-{
-  gpg_error_t err;
-  ksba_asn_tree_t crl_tree;
-  BerDecoder decoder;
-
-  err = ksba_asn_create_tree ("tmttv2", &crl_tree);
-  if (err)
-    return err;
+  if (!nrdns)
+    return 0; /* empty DN */
 
-  decoder = _ksba_ber_decoder_new ();
-  if (!decoder)
+  if (nrdns <= DIM (fixed_rdns))
+    rdns = fixed_rdns;
+  else
     {
-      ksba_asn_tree_release (crl_tree);
-      return gpg_error (GPG_ERR_ENOMEM);
+      rdns = xtrymalloc (nrdns * sizeof *rdns);
+      if (!rdns)
+        return gpg_error (GPG_ERR_ENOMEM);
     }
-
-  err = _ksba_ber_decoder_set_reader (decoder, reader);
-  if (err)
+  for (i=0, p=der, n=derlen; n; i++)
     {
-      ksba_asn_tree_release (crl_tree);
-      _ksba_ber_decoder_release (decoder);
-      return err;
+      next_dn_tlv (&p, &n, &ti, &rdns[i].der);
+      rdns[i].len = ti.length;
     }
 
-  err = _ksba_ber_decoder_set_module (decoder, crl_tree);
-  if (err)
+  /* output in reverse order */
+  err = 0;
+  for (i=nrdns-1; i >= 0 && !err; i--)
     {
-      ksba_asn_tree_release (crl_tree);
-      _ksba_ber_decoder_release (decoder);
-      return err;
+      err = render_rdn (rdns[i].der, rdns[i].len, db);
+      if (i)
+        put_dnbuf_mem (db, ",", 1);
     }
 
-  err = _ksba_ber_decoder_decode (decoder, elem_name, 0,
-                                  r_root, r_image, r_imagelen);
-
-  _ksba_ber_decoder_release (decoder);
-  ksba_asn_tree_release (crl_tree);
+  if (rdns != fixed_rdns)
+    xfree (rdns);
   return err;
 }
 
 
-gpg_error_t
-_ksba_derdn_to_str (const unsigned char *der, size_t derlen, char **r_string)
+/* Render the DER encoded Name at DER of DERLEN bytes as a newly
+   allocated string.  */
+static gpg_error_t
+derdn_to_str (const unsigned char *der, size_t derlen, char **r_string)
 {
   gpg_error_t err;
-  AsnNode root;
-  unsigned char *image;
-  size_t imagelen;
-  ksba_reader_t reader;
+  struct dnbuf db;
 
-  err = ksba_reader_new (&reader);
+  *r_string = NULL;
+
+  /* First compute the length and then render the string.  */
+  memset (&db, 0, sizeof db);
+  err = render_dn (der, derlen, &db);
   if (err)
     return err;
-  err = ksba_reader_set_mem (reader, der, derlen);
+  db.buf = xtrymalloc (db.len + 1);
+  if (!db.buf)
+    return gpg_error (GPG_ERR_ENOMEM);
+  db.len = 0;
+  err = render_dn (der, derlen, &db);
   if (err)
     {
-      ksba_reader_release (reader);
+      xfree (db.buf);
       return err;
     }
-  err = create_and_run_decoder (reader,
-                                "TMTTv2.CertificateList.tbsCertList.issuer",
-                                &root, &image, &imagelen);
-  ksba_reader_release (reader);
-  if (!err)
+  db.buf[db.len] = 0;
+  *r_string = db.buf;
+  return 0;
+}
+
+
+gpg_error_t
+_ksba_dn_to_str (const unsigned char *image, AsnNode node, char **r_string)
+{
+  *r_string = NULL;
+  if (!node || node->type != TYPE_SEQUENCE_OF)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (node->off == -1)
     {
-      err = _ksba_dn_to_str (image, root->down, r_string);
-      _ksba_asn_release_nodes (root);
-      xfree (image);
+      *r_string = xtrystrdup ("");
+      return *r_string? 0 : gpg_error (GPG_ERR_ENOMEM);
     }
-  return err;
+
+  return derdn_to_str (image + node->off, node->nhdr + node->len, r_string);
 }
 
-
+
+gpg_error_t
+_ksba_derdn_to_str (const unsigned char *der, size_t derlen, char **r_string)
+{
+  return derdn_to_str (der, derlen, r_string);
+}
+
+
 /*
    Convert a string back to DN
 */
@@ -1153,6 +1331,53 @@ ksba_dn_der2str (const void *der, size_t derlen, char **rstring)
 }
 
 
+/**
+ * ksba_dn_der2str_buf:
+ * @der: A DER encoded Name
+ * @derlen: The length of @der
+ * @buffer: Returns the name as string
+ * @bufsize: The size of @buffer
+ * @r_length: If not NULL, returns the length of the string
+ *
+ * This is a version of ksba_dn_der2str which stores the string in the
+ * caller provided @buffer instead of allocating it.  The length of the
+ * string without the terminating Nul is also stored at @r_length if
+ * GPG_ERR_BUFFER_TOO_SHORT is returned; thus a caller may retry with
+ * a buffer of the right size.
+ *
+ * Return value: 0 on success, GPG_ERR_BUFFER_TOO_SHORT if @buffer is
+ * too short, or another error code.
+ **/
+gpg_error_t
+ksba_dn_der2str_buf (const void *der, size_t derlen,
+                     char *buffer, size_t bufsize, size_t *r_length)
+{
+  gpg_error_t err;
+  struct dnbuf db;
+
+  if (r_length)
+    *r_length = 0;
+  if (!der || !buffer)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  memset (&db, 0, sizeof db);
+  err = render_dn (der, derlen, &db);
+  if (err)
+    return err;
+  if (r_length)
+    *r_length = db.len;
+  if (db.len >= bufsize)
+    return gpg_error (GPG_ERR_BUFFER_TOO_SHORT);
+  db.buf = buffer;
+  db.len = 0;
+  err = render_dn (der, derlen, &db);
+  if (err)
+    return err;
+  db.buf[db.len] = 0;
+  return 0;
+}
+
+
 gpg_error_t
 ksba_dn_str2der (const char *string, unsigned char **rder, size_t *rderlen)
 {
@@ -1161,6 +1386,816 @@ ksba_dn_str2der (const char *string, unsigned char **rder, size_t *rderlen)
 
 
 
+/* A cursor over the characters of a string value for ksba_dn_cmp_der.  */
+struct dnchar_cursor_s
+{
+  const unsigned char *s;
+  size_t n;
+  int width;    /* 0 for UTF-8, 1 for Latin-1, 2 for UCS-2, 4 for UCS-4.  */
+  int started;  /* Leading spaces have been skipped.  */
+};
+
+
+/* Return the width of the characters of a string value with TAG as
+   used by struct dnchar_cursor_s or -1 for non-string types.  */
+static int
+string_width (unsigned long tag)
+{
+  switch (tag)
+    {
+    case TYPE_UTF8_STRING:      return 0;
+    case TYPE_NUMERIC_STRING:
+    case TYPE_PRINTABLE_STRING:
+    case TYPE_TELETEX_STRING:   /* Mostly used as Latin-1.  */
+    case TYPE_IA5_STRING:
+    case TYPE_VISIBLE_STRING:   return 1;
+    case TYPE_BMP_STRING:       return 2;
+    case TYPE_UNIVERSAL_STRING: return 4;
+    default:                    return -1;
+    }
+}
+
+
+/* Return the next character from the cursor C or -1 at the end.  An
+   invalid encoding yields the raw bytes marked with bit 31 so that it
+   only matches itself.  */
+static long
+next_dnchar_raw (struct dnchar_cursor_s *c)
+{
+  unsigned long val;
+  int i, nbytes;
+
+  if (!c->n)
+    return -1;
+  switch (c->width)
+    {
+    case 1:
+      c->n--;
+      return *c->s++;
+    case 2:
+    case 4:
+      if (c->n < c->width)
+        break;
+      for (val=0, i=0; i < c->width; i++)
+        val = (val << 8) | *c->s++;
+      c->n -= c->width;
+      return val & 0x7fffffff;
+    default:
+      val = *c->s;
+      if (val < 0x80)
+        nbytes = 1;
+      else if ((val & 0xe0) == 0xc0)
+        nbytes = 2, val &= 0x1f;
+      else if ((val & 0xf0) == 0xe0)
+        nbytes = 3, val &= 0x0f;
+      else if ((val & 0xf8) == 0xf0)
+        nbytes = 4, val &= 0x07;
+      else
+        break;
+      if (c->n < nbytes)
+        break;
+      for (i=1; i < nbytes; i++)
+        {
+          if ((c->s[i] & 0xc0) != 0x80)
+            goto invalid;
+          val = (val << 6) | (c->s[i] & 0x3f);
+        }
+      c->s += nbytes;
+      c->n -= nbytes;
+      return val;
+    }
+
+ invalid:
+  c->n--;
+  return 0x80000000 | *c->s++;
+}
+
+
+/* Return the next character from the cursor C in the form used for
+   comparing: Leading and trailing spaces are removed, inner runs of
+   spaces are compressed to one and letters are mapped to lowercase.
+   Returns -1 at the end.  */
+static long
+next_dnchar (struct dnchar_cursor_s *c)
+{
+  struct dnchar_cursor_s save;
+  long ch;
+
+  ch = next_dnchar_raw (c);
+  if (!c->started)
+    {
+      while (ch == ' ')
+        ch = next_dnchar_raw (c);
+      c->started = 1;
+    }
+  else if (ch == ' ')
+    {
+      do
+        {
+          save = *c;
+          ch = next_dnchar_raw (c);
+        }
+      while (ch == ' ');
+      if (ch == -1)
+        return -1;
+      *c = save;  /* Return the character after the spaces next time.  */
+      return ' ';
+    }
+
+  /* Fold ASCII and Latin-1 letters.  */
+  if ((ch >= 'A' && ch <= 'Z')
+      || (ch >= 0xc0 && ch <= 0xde && ch != 0xd7))
+    ch += 0x20;
+  return ch;
+}
+
+
+/* Compare the AttributeTypeAndValue A of length ALEN with B of length
+   BLEN.  Returns 0 if they match, 1 if not, and -1 for a bad
+   encoding.  */
+static int
+cmp_atv (const unsigned char *a, size_t alen,
+         const unsigned char *b, size_t blen)
+{
+  struct tag_info tia, tib;
+  const unsigned char *oida, *oidb, *vala, *valb;
+  size_t oidalen;
+  struct dnchar_cursor_s ca, cb;
+  long cha, chb;
+
+  if (next_dn_tlv (&a, &alen, &tia, &oida)
+      || next_dn_tlv (&b, &blen, &tib, &oidb)
+      || tia.class != CLASS_UNIVERSAL || tia.tag != TYPE_OBJECT_ID
+      || tib.class != CLASS_UNIVERSAL || tib.tag != TYPE_OBJECT_ID)
+    return -1;
+  oidalen = tia.length;
+  if (oidalen != tib.length || memcmp (oida, oidb, oidalen))
+    return 1;
+
+  if (next_dn_tlv (&a, &alen, &tia, &vala) || alen
+      || next_dn_tlv (&b, &blen, &tib, &valb) || blen)
+    return -1;
+
+  if (tia.class != CLASS_UNIVERSAL || tib.class != CLASS_UNIVERSAL
+      || tia.is_constructed || tib.is_constructed
+      || string_width (tia.tag) < 0 || string_width (tib.tag) < 0)
+    {
+      /* Not a string; this needs to match exactly.  */
+      return !(tia.class == tib.class && tia.tag == tib.tag
+               && tia.is_constructed == tib.is_constructed
+               && tia.length == tib.length
+               && !memcmp (vala, valb, tia.length));
+    }
+
+  memset (&ca, 0, sizeof ca);
+  ca.s = vala;
+  ca.n = tia.length;
+  ca.width = string_width (tia.tag);
+  memset (&cb, 0, sizeof cb);
+  cb.s = valb;
+  cb.n = tib.length;
+  cb.width = string_width (tib.tag);
+  do
+    {
+      cha = next_dnchar (&ca);
+      chb = next_dnchar (&cb);
+      if (cha != chb)
+        return 1;
+    }
+  while (cha != -1);
+  return 0;
+}
+
+
+/* Compare the RelativeDistinguishedName A of length ALEN with B of
+   length BLEN.  The order of the attributes does not matter.
+   Returns 0 if they match, 1 if not, and -1 for a bad encoding.  */
+static int
+cmp_rdn (const unsigned char *a, size_t alen,
+         const unsigned char *b, size_t blen)
+{
+  struct tag_info ti;
+  const unsigned char *p, *q, *atva, *atvb;
+  size_t n, m, atvalen;
+  int na, nb, rc;
+
+  /* Check the encoding and count the attributes.  */
+  for (na=0, p=a, n=alen; n; na++)
+    if (next_dn_tlv (&p, &n, &ti, &atva)
+        || ti.class != CLASS_UNIVERSAL || ti.tag != TYPE_SEQUENCE)
+      return -1;
+  for (nb=0, p=b, n=blen; n; nb++)
+    if (next_dn_tlv (&p, &n, &ti, &atvb)
+        || ti.class != CLASS_UNIVERSAL || ti.tag != TYPE_SEQUENCE)
+      return -1;
+  if (!na || na != nb)
+    return na? 1 : -1;
+
+  for (p=a, n=alen; n; )
+    {
+      if (next_dn_tlv (&p, &n, &ti, &atva))
+        return -1;
+      atvalen = ti.length;
+      for (rc=1, q=b, m=blen; rc == 1 && m; )
+        {
+          if (next_dn_tlv (&q, &m, &ti, &atvb))
+            return -1;
+          rc = cmp_atv (atva, atvalen, atvb, ti.length);
+        }
+      if (rc)
+        return rc;
+    }
+  return 0;
+}
+
+
+/**
+ * ksba_dn_cmp_der:
+ * @a: A DER encoded Name
+ * @alen: The length of @a
+ * @b: Another DER encoded Name
+ * @blen: The length of @b
+ *
+ * Compare two distinguished names as described in RFC 5280, section
+ * 7.1: The names match if they have the same RDNs in the same order
+ * and each RDN has the same set of attributes.  String values are
+ * compared after converting them to Unicode, removing leading and
+ * trailing spaces, compressing inner spaces and folding the case of
+ * ASCII and Latin-1 letters; other values need to be identical.
+ * Nothing is allocated; thus the names may be taken directly from the
+ * images of certificates, for example by ksba_cert_get_issuer_dn_ptr.
+ *
+ * Return value: 0 if the names match, 1 if they do not match, and -1
+ * if one of the names is not properly encoded.
+ **/
+int
+ksba_dn_cmp_der (const void *a, size_t alen, const void *b, size_t blen)
+{
+  struct tag_info tia, tib;
+  const unsigned char *pa = a, *pb = b, *rdna, *rdnb;
+  size_t rdnalen;
+  int rc;
+
+  if (!pa || !pb
+      || next_dn_tlv (&pa, &alen, &tia, &rdna) || alen
+      || next_dn_tlv (&pb, &blen, &tib, &rdnb) || blen
+      || tia.class != CLASS_UNIVERSAL || tia.tag != TYPE_SEQUENCE
+      || tib.class != CLASS_UNIVERSAL || tib.tag != TYPE_SEQUENCE)
+    return -1;
+
+  /* Fast path for the common case of identical encodings.  */
+  if (tia.length == tib.length && !memcmp (rdna, rdnb, tia.length))
+    return 0;
+
+  pa = rdna;
+  alen = tia.length;
+  pb = rdnb;
+  blen = tib.length;
+  while (alen && blen)
+    {
+      if (next_dn_tlv (&pa, &alen, &tia, &rdna)
+          || next_dn_tlv (&pb, &blen, &tib, &rdnb)
+          || tia.class != CLASS_UNIVERSAL || tia.tag != TYPE_SET
+          || tib.class != CLASS_UNIVERSAL || tib.tag != TYPE_SET)
+        return -1;
+      rdnalen = tia.length;
+      rc = cmp_rdn (rdna, rdnalen, rdnb, tib.length);
+      if (rc)
+        return rc;
+    }
+  return (alen || blen)? 1 : 0;
+}
+
+
+
+/* An attribute of a compiled DN.  */
+struct dn_matcher_atv_s
+{
+  const unsigned char *oid;    /* The DER encoded OID.  */
+  size_t oidlen;
+  int is_string;               /* The value is a string.  */
+  enum tag_class class;        /* For non-strings the class, */
+  unsigned long tag;           /* the tag, */
+  int is_constructed;          /* the constructed flag */
+  const unsigned char *value;  /* and the value which need to match.  */
+  size_t valuelen;
+  const long *chars;           /* The normalized characters of strings.  */
+  size_t nchars;
+};
+
+
+/* A DN compiled for fast matching against DER encoded names.  */
+struct ksba_dn_matcher_s
+{
+  unsigned char *der;          /* The DER encoded Name.  */
+  size_t derlen;
+  int nrdns;                   /* The number of RDNs.  */
+  int *rdns;                   /* NRDNS+1 indices to the first attribute
+                                  of each RDN.  */
+  struct dn_matcher_atv_s *atvs;
+  long *chars;                 /* The buffer for all normalized chars.  */
+};
+
+
+/* Walk the DER encoded Name of MATCHER and fill its tables.  If
+   COUNT_ONLY is set only the number of RDNs and attributes and an
+   upper limit of the number of characters are stored at R_NRDNS,
+   R_NATVS and R_NCHARS.  */
+static gpg_error_t
+walk_dn_matcher (ksba_dn_matcher_t matcher, int count_only,
+                 int *r_nrdns, int *r_natvs, size_t *r_nchars)
+{
+  struct tag_info ti;
+  const unsigned char *p, *q, *r, *rdn, *atv, *oid, *val;
+  size_t n, m, k;
+  int nrdns, natvs;
+  size_t nchars;
+  struct dn_matcher_atv_s *a = NULL;
+  struct dnchar_cursor_s c;
+  long ch;
+
+  p = matcher->der;
+  n = matcher->derlen;
+  if (next_dn_tlv (&p, &n, &ti, &rdn) || n
+      || ti.class != CLASS_UNIVERSAL || ti.tag != TYPE_SEQUENCE)
+    return gpg_error (GPG_ERR_BAD_BER);
+
+  nrdns = natvs = 0;
+  nchars = 0;
+  for (p = rdn, n = ti.length; n; nrdns++)
+    {
+      if (next_dn_tlv (&p, &n, &ti, &rdn)
+          || ti.class != CLASS_UNIVERSAL || ti.tag != TYPE_SET)
+        return gpg_error (GPG_ERR_BAD_BER);
+      if (!count_only)
+        matcher->rdns[nrdns] = natvs;
+      for (q = rdn, m = ti.length; m; natvs++)
+        {
+          if (next_dn_tlv (&q, &m, &ti, &atv)
+              || ti.class != CLASS_UNIVERSAL || ti.tag != TYPE_SEQUENCE)
+            return gpg_error (GPG_ERR_BAD_BER);
+          r = atv;
+          k = ti.length;
+          if (next_dn_tlv (&r, &k, &ti, &oid)
+              || ti.class != CLASS_UNIVERSAL || ti.tag != TYPE_OBJECT_ID)
+            return gpg_error (GPG_ERR_BAD_BER);
+          if (!count_only)
+            {
+              a = matcher->atvs + natvs;
+              a->oid = oid;
+              a->oidlen = ti.length;
+            }
+          if (next_dn_tlv (&r, &k, &ti, &val) || k)
+            return gpg_error (GPG_ERR_BAD_BER);
+          if (count_only)
+            {
+              nchars += ti.length;
+              continue;
+            }
+          a->is_string = (ti.class == CLASS_UNIVERSAL && !ti.is_constructed
+                          && string_width (ti.tag) >= 0);
+          a->class = ti.class;
+          a->tag = ti.tag;
+          a->is_constructed = ti.is_constructed;
+          a->value = val;
+          a->valuelen = ti.length;
+          if (a->is_string)
+            {
+              memset (&c, 0, sizeof c);
+              c.s = val;
+              c.n = ti.length;
+              c.width = string_width (ti.tag);
+              a->chars = matcher->chars + nchars;
+              while ((ch = next_dnchar (&c)) != -1)
+                matcher->chars[nchars++] = ch;
+              a->nchars = matcher->chars + nchars - a->chars;
+            }
+        }
+    }
+  if (!nrdns || !natvs)
+    return gpg_error (GPG_ERR_BAD_BER);
+
+  if (count_only)
+    {
+      *r_nrdns = nrdns;
+      *r_natvs = natvs;
+      *r_nchars = nchars;
+    }
+  else
+    matcher->rdns[nrdns] = natvs;
+  return 0;
+}
+
+
+/**
+ * ksba_dn_matcher_new:
+ * @r_matcher: Returns the new object
+ * @string: A DN in the format of RFC-2253
+ *
+ * Compile the DN given as @string for use with ksba_dn_matcher_match.
+ * The string is parsed and its attribute values are normalized only
+ * once; thus this is faster than ksba_dn_cmp_der if the same DN is
+ * compared against many names.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_dn_matcher_new (ksba_dn_matcher_t *r_matcher, const char *string)
+{
+  gpg_error_t err;
+  ksba_dn_matcher_t matcher;
+  int nrdns, natvs;
+  size_t nchars;
+
+  if (!r_matcher || !string)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_matcher = NULL;
+
+  matcher = xtrycalloc (1, sizeof *matcher);
+  if (!matcher)
+    return gpg_error (GPG_ERR_ENOMEM);
+  err = _ksba_dn_from_str (string, (char**)&matcher->der, &matcher->derlen);
+  if (!err)
+    err = walk_dn_matcher (matcher, 1, &nrdns, &natvs, &nchars);
+  if (!err)
+    {
+      matcher->nrdns = nrdns;
+      matcher->rdns = xtrycalloc (nrdns + 1, sizeof *matcher->rdns);
+      matcher->atvs = xtrycalloc (natvs, sizeof *matcher->atvs);
+      matcher->chars = xtrymalloc ((nchars? nchars : 1)
+                                   * sizeof *matcher->chars);
+      if (!matcher->rdns || !matcher->atvs || !matcher->chars)
+        err = gpg_error (GPG_ERR_ENOMEM);
+    }
+  if (!err)
+    err = walk_dn_matcher (matcher, 0, NULL, NULL, NULL);
+  if (err)
+    {
+      ksba_dn_matcher_release (matcher);
+      return err;
+    }
+
+  *r_matcher = matcher;
+  return 0;
+}
+
+
+/**
+ * ksba_dn_matcher_release:
+ * @matcher: A matcher object
+ *
+ * Release the @matcher.  Passing NULL is allowed.
+ **/
+void
+ksba_dn_matcher_release (ksba_dn_matcher_t matcher)
+{
+  if (!matcher)
+    return;
+  xfree (matcher->der);
+  xfree (matcher->rdns);
+  xfree (matcher->atvs);
+  xfree (matcher->chars);
+  xfree (matcher);
+}
+
+
+/* Match the compiled attribute ATV against the AttributeTypeAndValue
+   B of length BLEN.  Returns 0 if they match, 1 if not, and -1 for a
+   bad encoding.  */
+static int
+match_atv (const struct dn_matcher_atv_s *atv,
+           const unsigned char *b, size_t blen)
+{
+  struct tag_info ti;
+  const unsigned char *oid, *val;
+  struct dnchar_cursor_s c;
+  size_t i;
+  long ch;
+
+  if (next_dn_tlv (&b, &blen, &ti, &oid)
+      || ti.class != CLASS_UNIVERSAL || ti.tag != TYPE_OBJECT_ID)
+    return -1;
+  if (ti.length != atv->oidlen || memcmp (oid, atv->oid, ti.length))
+    return 1;
+  if (next_dn_tlv (&b, &blen, &ti, &val) || blen)
+    return -1;
+
+  if (!atv->is_string || ti.class != CLASS_UNIVERSAL || ti.is_constructed
+      || string_width (ti.tag) < 0)
+    {
+      /* Not a string; this needs to match exactly.  */
+      return !(ti.class == atv->class && ti.tag == atv->tag
+               && ti.is_constructed == atv->is_constructed
+               && ti.length == atv->valuelen
+               && !memcmp (val, atv->value, ti.length));
+    }
+
+  memset (&c, 0, sizeof c);
+  c.s = val;
+  c.n = ti.length;
+  c.width = string_width (ti.tag);
+  for (i=0; i < atv->nchars; i++)
+    if (next_dnchar (&c) != atv->chars[i])
+      return 1;
+  ch = next_dnchar (&c);
+  return ch != -1;
+}
+
+
+/* Match the compiled attributes ATVS of an RDN with NATVS items
+   against the RelativeDistinguishedName B of length BLEN.  */
+static int
+match_rdn (const struct dn_matcher_atv_s *atvs, int natvs,
+           const unsigned char *b, size_t blen)
+{
+  struct tag_info ti;
+  const unsigned char *q, *atvb;
+  size_t m;
+  int i, nb, rc;
+
+  for (nb=0, q=b, m=blen; m; nb++)
+    if (next_dn_tlv (&q, &m, &ti, &atvb)
+        || ti.class != CLASS_UNIVERSAL || ti.tag != TYPE_SEQUENCE)
+      return -1;
+  if (!nb)
+    return -1;
+  if (nb != natvs)
+    return 1;
+
+  for (i=0; i < natvs; i++)
+    {
+      for (rc=1, q=b, m=blen; rc == 1 && m; )
+        {
+          if (next_dn_tlv (&q, &m, &ti, &atvb))
+            return -1;
+          rc = match_atv (atvs + i, atvb, ti.length);
+        }
+      if (rc)
+        return rc;
+    }
+  return 0;
+}
+
+
+/**
+ * ksba_dn_matcher_match:
+ * @matcher: A matcher object
+ * @der: A DER encoded Name
+ * @derlen: The length of @der
+ *
+ * Compare the DN compiled into @matcher with the name @der using the
+ * rules of ksba_dn_cmp_der.  Nothing is allocated.
+ *
+ * Return value: 0 if the names match, 1 if they do not match, and -1
+ * if @der is not properly encoded.
+ **/
+int
+ksba_dn_matcher_match (ksba_dn_matcher_t matcher,
+                       const void *der, size_t derlen)
+{
+  struct tag_info ti;
+  const unsigned char *p = der, *rdn;
+  size_t n;
+  int i, rc;
+
+  if (!matcher || !p)
+    return -1;
+
+  /* Fast path for the common case of identical encodings.  */
+  if (derlen == matcher->derlen && !memcmp (p, matcher->der, derlen))
+    return 0;
+
+  if (next_dn_tlv (&p, &derlen, &ti, &rdn) || derlen
+      || ti.class != CLASS_UNIVERSAL || ti.tag != TYPE_SEQUENCE)
+    return -1;
+
+  p = rdn;
+  n = ti.length;
+  for (i=0; n; i++)
+    {
+      if (next_dn_tlv (&p, &n, &ti, &rdn)
+          || ti.class != CLASS_UNIVERSAL || ti.tag != TYPE_SET)
+        return -1;
+      if (i == matcher->nrdns)
+        return 1;
+      rc = match_rdn (matcher->atvs + matcher->rdns[i],
+                      matcher->rdns[i+1] - matcher->rdns[i],
+                      rdn, ti.length);
+      if (rc)
+        return rc;
+    }
+  return i == matcher->nrdns? 0 : 1;
+}
+
+
+
+/* An item of the DN string cache.  The DER encoded name and the
+   string are stored in DATA.  */
+struct dn_cache_item_s
+{
+  struct dn_cache_item_s *next;     /* Next item in the bucket.  */
+  struct dn_cache_item_s *older;    /* The LRU list.  */
+  struct dn_cache_item_s *newer;
+  unsigned int hash;
+  size_t derlen;
+  char *string;                     /* Points into DATA.  */
+  unsigned char data[1];
+};
+
+
+/* A cache of DNs rendered as strings.  */
+struct ksba_dn_cache_s
+{
+  struct dn_cache_item_s **table;   /* SIZE buckets of items.  */
+  unsigned int size;                /* A power of two.  */
+  unsigned int maxitems;
+  unsigned int nitems;
+  struct dn_cache_item_s *newest;   /* The LRU list.  */
+  struct dn_cache_item_s *oldest;
+};
+
+
+static unsigned int
+hash_der (const unsigned char *der, size_t derlen)
+{
+  unsigned int hash = 0;
+  size_t n;
+
+  for (n=0; n < derlen; n++)
+    hash = hash * 31 + der[n];
+  return hash;
+}
+
+
+/* Unlink ITEM from the LRU list of CACHE.  */
+static void
+dn_cache_unlink (ksba_dn_cache_t cache, struct dn_cache_item_s *item)
+{
+  if (item->older)
+    item->older->newer = item->newer;
+  else
+    cache->oldest = item->newer;
+  if (item->newer)
+    item->newer->older = item->older;
+  else
+    cache->newest = item->older;
+}
+
+
+/* Link ITEM as the newest item into the LRU list of CACHE.  */
+static void
+dn_cache_link (ksba_dn_cache_t cache, struct dn_cache_item_s *item)
+{
+  item->newer = NULL;
+  item->older = cache->newest;
+  if (cache->newest)
+    cache->newest->newer = item;
+  else
+    cache->oldest = item;
+  cache->newest = item;
+}
+
+
+/**
+ * ksba_dn_cache_new:
+ * @r_cache: Returns the new object
+ * @maxitems: The maximum number of names kept in the cache
+ *
+ * Create a cache for ksba_dn_cache_der2str.  If more than @maxitems
+ * names are rendered, the least recently used ones are dropped.  A
+ * cache may not be used concurrently by several threads.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_dn_cache_new (ksba_dn_cache_t *r_cache, unsigned int maxitems)
+{
+  ksba_dn_cache_t cache;
+
+  if (!r_cache || !maxitems)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_cache = NULL;
+
+  cache = xtrycalloc (1, sizeof *cache);
+  if (!cache)
+    return gpg_error (GPG_ERR_ENOMEM);
+  for (cache->size = 16; cache->size < maxitems; cache->size <<= 1)
+    ;
+  cache->maxitems = maxitems;
+  cache->table = xtrycalloc (cache->size, sizeof *cache->table);
+  if (!cache->table)
+    {
+      xfree (cache);
+      return gpg_error (GPG_ERR_ENOMEM);
+    }
+  *r_cache = cache;
+  return 0;
+}
+
+
+/**
+ * ksba_dn_cache_release:
+ * @cache: A cache object
+ *
+ * Release the @cache.  Passing NULL is allowed.
+ **/
+void
+ksba_dn_cache_release (ksba_dn_cache_t cache)
+{
+  struct dn_cache_item_s *item, *tmp;
+
+  if (!cache)
+    return;
+  for (item = cache->oldest; item; item = tmp)
+    {
+      tmp = item->newer;
+      xfree (item);
+    }
+  xfree (cache->table);
+  xfree (cache);
+}
+
+
+/**
+ * ksba_dn_cache_der2str:
+ * @cache: A cache object
+ * @der: A DER encoded Name
+ * @derlen: The length of @der
+ * @r_string: Returns the name as string
+ *
+ * This is a version of ksba_dn_der2str which looks up the string in
+ * @cache first and stores newly rendered strings in it.  The caller
+ * must free the returned string using ksba_free().
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_dn_cache_der2str (ksba_dn_cache_t cache, const void *der, size_t derlen,
+                       char **r_string)
+{
+  gpg_error_t err;
+  struct dn_cache_item_s *item, **pp;
+  unsigned int hash;
+  char *string;
+  size_t n;
+
+  if (!cache || !der || !r_string)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_string = NULL;
+
+  hash = hash_der (der, derlen);
+  for (item = cache->table[hash & (cache->size - 1)]; item; item = item->next)
+    if (item->hash == hash && item->derlen == derlen
+        && !memcmp (item->data, der, derlen))
+      {
+        *r_string = xtrystrdup (item->string);
+        if (!*r_string)
+          return gpg_error (GPG_ERR_ENOMEM);
+        dn_cache_unlink (cache, item);
+        dn_cache_link (cache, item);
+        return 0;
+      }
+
+  err = _ksba_derdn_to_str (der, derlen, &string);
+  if (err)
+    return err;
+
+  if (cache->nitems == cache->maxitems)
+    {
+      /* Drop the least recently used item.  */
+      item = cache->oldest;
+      for (pp = &cache->table[item->hash & (cache->size - 1)]; *pp != item;
+           pp = &(*pp)->next)
+        ;
+      *pp = item->next;
+      dn_cache_unlink (cache, item);
+      xfree (item);
+      cache->nitems--;
+    }
+
+  n = strlen (string);
+  item = xtrymalloc (sizeof *item + derlen + n);
+  if (item)
+    {
+      item->hash = hash;
+      item->derlen = derlen;
+      memcpy (item->data, der, derlen);
+      item->string = (char*)item->data + derlen;
+      memcpy (item->string, string, n + 1);
+      pp = &cache->table[hash & (cache->size - 1)];
+      item->next = *pp;
+      *pp = item;
+      dn_cache_link (cache, item);
+      cache->nitems++;
+    }
+  /* A failure to store the string in the cache is not an error.  */
+
+  *r_string = string;
+  return 0;
+}
+
+
+
 /* Assuming that STRING contains an rfc2253 encoded string, test
    whether this string may be passed as a valid DN to libksba.  On
    success the functions returns 0.  On error the function returns an
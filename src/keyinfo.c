@@ -521,12 +521,13 @@ static const struct
     {                             \
       int count = c & 0x7f;       \
                                   \
+      if (count > prefix ## len)         \
+        return gpg_error (GPG_ERR_BAD_BER);\
+      prefix ## len -= count;            \
       for (len=0; count; count--) \
         {                         \
           len <<= 8;              \
-          if (!prefix ## len)            \
-            return gpg_error (GPG_ERR_BAD_BER);\
-          c = *(prefix)++; prefix ## len--;   \
+          c = *(prefix)++;        \
           len |= c & 0xff;        \
         }                         \
     }                             \
@@ -865,7 +866,8 @@ _ksba_keyinfo_to_sexp (const unsigned char *der, size_t derlen,
   int c, i;
   size_t nread, off, len, parm_off, parm_len;
   int parm_type;
-  char *parm_oid = NULL;
+  const char *parm_oid = NULL;
+  char *parm_oidbuf = NULL;
   int algoidx;
   int is_bitstr;
   int got_curve = 0;
@@ -904,7 +906,13 @@ _ksba_keyinfo_to_sexp (const unsigned char *der, size_t derlen,
     return gpg_error (GPG_ERR_UNSUPPORTED_ALGORITHM);
 
   if (parm_off && parm_len && parm_type == TYPE_OBJECT_ID)
-    parm_oid = ksba_oid_to_str (der+parm_off, parm_len);
+    {
+      /* Known curves are taken from the registry.  */
+      parm_oid = _ksba_oid_id_to_str (_ksba_oid_lookup (der+parm_off,
+                                                        parm_len));
+      if (!parm_oid)
+        parm_oid = parm_oidbuf = ksba_oid_to_str (der+parm_off, parm_len);
+    }
   else if (parm_off && parm_len)
     {
       parmder = der + parm_off;
@@ -920,7 +928,7 @@ _ksba_keyinfo_to_sexp (const unsigned char *der, size_t derlen,
          allow both */
       if (!derlen)
         {
-          xfree (parm_oid);
+          xfree (parm_oidbuf);
           return gpg_error (GPG_ERR_INV_KEYINFO);
         }
       c = *der++; derlen--;
@@ -980,13 +988,13 @@ _ksba_keyinfo_to_sexp (const unsigned char *der, size_t derlen,
             {
               if (!parmderlen)
                 {
-                  xfree (parm_oid);
+                  xfree (parm_oidbuf);
                   return gpg_error (GPG_ERR_INV_KEYINFO);
                 }
               c = *parmder++; parmderlen--;
               if ( c != *ctrl )
                 {
-                  xfree (parm_oid);
+                  xfree (parm_oidbuf);
                   return gpg_error (GPG_ERR_UNEXPECTED_TAG);
                 }
               is_int = c == 0x02;
@@ -1046,13 +1054,13 @@ _ksba_keyinfo_to_sexp (const unsigned char *der, size_t derlen,
         {
           if (!derlen)
             {
-              xfree (parm_oid);
+              xfree (parm_oidbuf);
               return gpg_error (GPG_ERR_INV_KEYINFO);
             }
           c = *der++; derlen--;
           if ( c != *ctrl )
             {
-              xfree (parm_oid);
+              xfree (parm_oidbuf);
               return gpg_error (GPG_ERR_UNEXPECTED_TAG);
             }
           is_int = c == 0x02;
@@ -1072,7 +1080,7 @@ _ksba_keyinfo_to_sexp (const unsigned char *der, size_t derlen,
         }
     }
   put_stringbuf (&sb, "))");
-  xfree (parm_oid);
+  xfree (parm_oidbuf);
 
   *r_string = get_stringbuf (&sb);
   if (!*r_string)
@@ -1082,6 +1090,161 @@ _ksba_keyinfo_to_sexp (const unsigned char *der, size_t derlen,
 }
 
 
+/* Store the elements described by ELEM and CTRL, which are taken from
+   an algo_table_s, from the buffer DER of length DERLEN in DESC.  This
+   works like the loops in _ksba_keyinfo_to_sexp but does not copy the
+   values.  */
+static gpg_error_t
+get_keydesc_elems (const char *elem, const unsigned char *ctrl,
+                   const unsigned char *der, size_t derlen,
+                   ksba_keydesc_t desc)
+{
+  int c, is_int;
+  size_t len;
+
+  for (; *elem; ctrl++, elem++)
+    {
+      if ( (*ctrl & 0x80) && !elem[1] )
+        {
+          /* Hack to allow reading a raw value.  */
+          is_int = 1;
+          len = derlen;
+        }
+      else
+        {
+          if (!derlen)
+            return gpg_error (GPG_ERR_INV_KEYINFO);
+          c = *der++; derlen--;
+          if ( c != *ctrl )
+            return gpg_error (GPG_ERR_UNEXPECTED_TAG);
+          is_int = c == 0x02;
+          TLV_LENGTH (der);
+        }
+      if (is_int && *elem != '-')  /* Take this integer.  */
+        {
+          if (desc->nelem == KSBA_KEYDESC_MAXELEM)
+            return gpg_error (GPG_ERR_BUG);
+          desc->elem[desc->nelem].name = *elem;
+          desc->elem[desc->nelem].value = der;
+          desc->elem[desc->nelem].length = len;
+          desc->nelem++;
+          der += len;
+          derlen -= len;
+        }
+    }
+  return 0;
+}
+
+
+/* This is a version of _ksba_keyinfo_to_sexp which stores the
+   description of the key in DESC instead of creating an S-expression.
+   Nothing is allocated and the pointers in DESC reference DER.  */
+gpg_error_t
+_ksba_keyinfo_to_keydesc (const unsigned char *der, size_t derlen,
+                          ksba_keydesc_t desc)
+{
+  gpg_error_t err;
+  int c, i;
+  size_t nread, off, len, parm_off, parm_len;
+  int parm_type;
+  int algoidx;
+  int is_bitstr;
+  const struct algo_table_s *algo;
+
+  memset (desc, 0, sizeof *desc);
+
+  /* check the outer sequence */
+  if (!derlen)
+    return gpg_error (GPG_ERR_INV_KEYINFO);
+  c = *der++; derlen--;
+  if ( c != 0x30 )
+    return gpg_error (GPG_ERR_UNEXPECTED_TAG); /* not a SEQUENCE */
+  TLV_LENGTH(der);
+  /* and now the inner part */
+  err = get_algorithm (1, der, derlen, 0x30,
+                       &nread, &off, &len, &is_bitstr,
+                       &parm_off, &parm_len, &parm_type);
+  if (err)
+    return err;
+
+  /* look into our table of supported algorithms */
+  for (algoidx=0; pk_algo_table[algoidx].oid; algoidx++)
+    {
+      if ( len == pk_algo_table[algoidx].oidlen
+           && !memcmp (der+off, pk_algo_table[algoidx].oid, len))
+        break;
+    }
+  if (!pk_algo_table[algoidx].oid)
+    return gpg_error (GPG_ERR_UNKNOWN_ALGORITHM);
+  if (!pk_algo_table[algoidx].supported)
+    return gpg_error (GPG_ERR_UNSUPPORTED_ALGORITHM);
+  algo = pk_algo_table + algoidx;
+
+  desc->pkalgo = (ksba_pkalgo_t)algo->pkalgo;
+  desc->algo = algo->algo_string;
+  if (parm_off && parm_len)
+    {
+      desc->parm = der + parm_off;
+      desc->parmlen = parm_len;
+    }
+
+  if (algo->pkalgo == PKALGO_ECC && desc->parm
+      && parm_type == TYPE_OBJECT_ID)
+    {
+      /* Only known curves have a string.  */
+      desc->curve_oid = desc->parm;
+      desc->curve_oidlen = desc->parmlen;
+      desc->curve = _ksba_oid_id_to_str
+        (_ksba_oid_lookup (desc->curve_oid, desc->curve_oidlen));
+    }
+  else if (algo->pkalgo == PKALGO_ED25519
+           || algo->pkalgo == PKALGO_ED448
+           || algo->pkalgo == PKALGO_X25519
+           || algo->pkalgo == PKALGO_X448)
+    {
+      desc->curve_oid = der + off;
+      desc->curve_oidlen = len;
+      desc->curve = algo->oidstring;
+    }
+  else if (algo->pkalgo == PKALGO_ECC && desc->parm)
+    {
+      /* See _ksba_keyinfo_to_sexp for this hack.  */
+      for (i=0; ecdomainparm_to_name[i].name; i++)
+        if (ecdomainparm_to_name[i].derlen == desc->parmlen
+            && !memcmp (ecdomainparm_to_name[i].der, desc->parm,
+                        desc->parmlen))
+          {
+            desc->curve = ecdomainparm_to_name[i].name;
+            break;
+          }
+    }
+  else if (desc->parm && parm_type != TYPE_OBJECT_ID
+           && algo->parmelem_string && algo->parmctrl_string)
+    {
+      err = get_keydesc_elems (algo->parmelem_string,
+                               (const unsigned char *)algo->parmctrl_string,
+                               desc->parm, desc->parmlen, desc);
+      if (err)
+        return err;
+    }
+
+  der += nread;
+  derlen -= nread;
+
+  if (is_bitstr)
+    {
+      /* Skip the number of unused bits.  */
+      if (!derlen)
+        return gpg_error (GPG_ERR_INV_KEYINFO);
+      der++; derlen--;
+    }
+
+  return get_keydesc_elems (algo->elem_string,
+                            (const unsigned char *)algo->ctrl_string,
+                            der, derlen, desc);
+}
+
+
 /* Match the algorithm string given in BUF which is of length BUFLEN
  * with the known algorithms from our table and return the table
  * entriy with the OID string.  If WITH_SIG is true, the table of
@@ -1769,6 +1932,85 @@ _ksba_sigval_to_sexp (const unsigned char *der, size_t derlen,
 }
 
 
+/* This is a version of _ksba_sigval_to_sexp which stores the
+   description of the signature in DESC instead of creating an
+   S-expression.  Nothing is allocated and the pointers in DESC
+   reference DER.  For RSA-PSS the parameters are not parsed but
+   returned in the PARM field.  */
+gpg_error_t
+_ksba_sigval_to_keydesc (const unsigned char *der, size_t derlen,
+                         ksba_keydesc_t desc)
+{
+  gpg_error_t err;
+  size_t nread, off, len, parm_off, parm_len;
+  int parm_type;
+  int algoidx;
+  int is_bitstr;
+  const struct algo_table_s *algo;
+
+  memset (desc, 0, sizeof *desc);
+
+  err = get_algorithm (1, der, derlen, 0x30,
+                       &nread, &off, &len, &is_bitstr,
+                       &parm_off, &parm_len, &parm_type);
+  if (err)
+    return err;
+
+  /* look into our table of supported algorithms */
+  for (algoidx=0; sig_algo_table[algoidx].oid; algoidx++)
+    {
+      if ( len == sig_algo_table[algoidx].oidlen
+           && !memcmp (der+off, sig_algo_table[algoidx].oid, len))
+        break;
+    }
+  if (!sig_algo_table[algoidx].oid)
+    return gpg_error (GPG_ERR_UNKNOWN_ALGORITHM);
+  if (!sig_algo_table[algoidx].supported)
+    return gpg_error (GPG_ERR_UNSUPPORTED_ALGORITHM);
+  algo = sig_algo_table + algoidx;
+
+  desc->pkalgo = (ksba_pkalgo_t)algo->pkalgo;
+  desc->algo = algo->algo_string;
+  desc->hash = algo->digest_string;
+  if (parm_off && parm_len)
+    {
+      desc->parm = der + parm_off;
+      desc->parmlen = parm_len;
+    }
+  if (parm_type == TYPE_SEQUENCE && algo->supported == SUPPORTED_RSAPSS)
+    desc->pss = 1;
+
+  der += nread;
+  derlen -= nread;
+
+  if (is_bitstr)
+    {
+      /* Skip the number of unused bits.  */
+      if (!derlen)
+        return gpg_error (GPG_ERR_INV_KEYINFO);
+      der++; derlen--;
+    }
+
+  if (algo->pkalgo == PKALGO_ED25519 || algo->pkalgo == PKALGO_ED448
+      || (algo->pkalgo == PKALGO_ECC && *algo->elem_string == 'P'))
+    {
+      /* R and S are simply concatenated; see cryptval_to_sexp.  */
+      desc->elem[0].name = 'r';
+      desc->elem[0].value = der;
+      desc->elem[0].length = derlen/2;
+      desc->elem[1].name = 's';
+      desc->elem[1].value = der + derlen/2;
+      desc->elem[1].length = derlen - derlen/2;
+      desc->nelem = 2;
+      return 0;
+    }
+
+  return get_keydesc_elems (algo->elem_string,
+                            (const unsigned char *)algo->ctrl_string,
+                            der, derlen, desc);
+}
+
+
 /* Assume that der is a buffer of length DERLEN with a DER encoded
  * ASN.1 structure like this:
  *
@@ -68,8 +68,13 @@ gpg_error_t _ksba_keyinfo_get_pss_info (const unsigned char *der,
                                         char **r_psshash,
                                         unsigned int *r_saltlen);
 
+gpg_error_t _ksba_keyinfo_to_keydesc (const unsigned char *der, size_t derlen,
+                                      ksba_keydesc_t desc);
+
 gpg_error_t _ksba_sigval_to_sexp (const unsigned char *der, size_t derlen,
                                 ksba_sexp_t *r_string);
+gpg_error_t _ksba_sigval_to_keydesc (const unsigned char *der, size_t derlen,
+                                     ksba_keydesc_t desc);
 gpg_error_t _ksba_encval_to_sexp (const unsigned char *der, size_t derlen,
                                 ksba_sexp_t *r_string);
 gpg_error_t _ksba_encval_kari_to_sexp (const unsigned char *der, size_t derlen,
@@ -73,6 +73,7 @@ ksba_ocsp_new (ksba_ocsp_t *r_ocsp)
   *r_ocsp = xtrycalloc (1, sizeof **r_ocsp);
   if (!*r_ocsp)
     return gpg_error_from_syserror ();
+  (*r_ocsp)->alloc_ctx = _ksba_alloc_ctx_current ();
   return 0;
 }
 
@@ -102,17 +103,34 @@ release_ocsp_extensions (struct ocsp_extension_s *ex)
 }
 
 
+/* Release the hash tables of the request items.  */
+static void
+release_index (ksba_ocsp_t ocsp)
+{
+  xfree (ocsp->id_table);
+  ocsp->id_table = NULL;
+  xfree (ocsp->cert_table);
+  ocsp->cert_table = NULL;
+  ocsp->table_size = 0;
+}
+
+
 /* Release the OCSP object and all its resources. Passing NULL for
    OCSP is a valid nop. */
 void
 ksba_ocsp_release (ksba_ocsp_t ocsp)
 {
+  ksba_alloc_ctx_t actx, prevctx;
   struct ocsp_reqitem_s *ri;
 
   if (!ocsp)
     return;
+  actx = ocsp->alloc_ctx;
+  prevctx = _ksba_alloc_ctx_switch (actx);
   xfree (ocsp->digest_oid);
   xfree (ocsp->request_buffer);
+  xfree (ocsp->request_template);
+  release_index (ocsp);
   for (; (ri=ocsp->requestlist); ri = ocsp->requestlist )
     {
       ocsp->requestlist = ri->next;
@@ -120,6 +138,8 @@ ksba_ocsp_release (ksba_ocsp_t ocsp)
       ksba_cert_release (ri->issuer_cert);
       release_ocsp_extensions (ri->single_extensions);
       xfree (ri->serialno);
+      xfree (ri->certid);
+      xfree (ri);
     }
   xfree (ocsp->sigval);
   xfree (ocsp->responder_id.name);
@@ -127,6 +147,8 @@ ksba_ocsp_release (ksba_ocsp_t ocsp)
   release_ocsp_certlist (ocsp->received_certs);
   release_ocsp_extensions (ocsp->response_extensions);
   xfree (ocsp);
+  _ksba_alloc_ctx_restore (prevctx);
+  ksba_alloc_ctx_release (actx);
 }
 
 
@@ -180,6 +202,10 @@ ksba_ocsp_add_target (ksba_ocsp_t ocsp,
 
   ri->next = ocsp->requestlist;
   ocsp->requestlist = ri;
+  ocsp->nrequests++;
+  release_index (ocsp);
+  xfree (ocsp->request_template);
+  ocsp->request_template = NULL;
 
   return 0;
 }
@@ -252,6 +278,124 @@ issuer_key_hash (ksba_cert_t cert, unsigned char *sha1_buffer)
 }
 
 
+/* Return the hash value of a CertID.  All targets of an issuer share
+   NAME_HASH and KEY_HASH; thus the serial number is mixed in.  */
+static unsigned int
+hash_cert_id (const unsigned char *name_hash, const unsigned char *key_hash,
+              const unsigned char *serialno, size_t serialnolen)
+{
+  unsigned int hash;
+  size_t n;
+
+  hash = (((unsigned int)name_hash[0] << 24
+           | name_hash[1] << 16 | name_hash[2] << 8)
+          ^ (key_hash[0] << 16 | key_hash[1] << 8 | key_hash[2]));
+  for (n=0; n < serialnolen; n++)
+    hash = hash * 31 + serialno[n];
+  return hash;
+}
+
+
+/* Return the hash value of the certificate object CERT.  Only the
+   pointer is used, as done for the lookup by certificate.  */
+static unsigned int
+hash_cert (ksba_cert_t cert)
+{
+  size_t value = (size_t)cert;
+
+  /* Objects are aligned, thus we drop the low bits.  */
+  return (unsigned int)((value >> 4) ^ (value >> 16));
+}
+
+
+/* Create the hash tables of the request items of OCSP.  The items are
+   appended to their buckets so that a lookup returns the same item as
+   a linear search of the request list.  */
+static gpg_error_t
+build_index (ksba_ocsp_t ocsp)
+{
+  struct ocsp_reqitem_s *ri, **pp;
+  unsigned int size, hash;
+
+  for (size = 16; size < ocsp->nrequests; size <<= 1)
+    ;
+  ocsp->id_table = xtrycalloc (size, sizeof *ocsp->id_table);
+  ocsp->cert_table = xtrycalloc (size, sizeof *ocsp->cert_table);
+  if (!ocsp->id_table || !ocsp->cert_table)
+    {
+      gpg_error_t err = gpg_error_from_syserror ();
+      release_index (ocsp);
+      return err;
+    }
+  ocsp->table_size = size;
+
+  for (ri=ocsp->requestlist; ri; ri = ri->next)
+    {
+      ri->next_id = ri->next_cert = NULL;
+      hash = hash_cert_id (ri->issuer_name_hash, ri->issuer_key_hash,
+                           ri->serialno, ri->serialnolen);
+      for (pp = &ocsp->id_table[hash & (size - 1)]; *pp;
+           pp = &(*pp)->next_id)
+        ;
+      *pp = ri;
+      hash = hash_cert (ri->cert);
+      for (pp = &ocsp->cert_table[hash & (size - 1)]; *pp;
+           pp = &(*pp)->next_cert)
+        ;
+      *pp = ri;
+    }
+  return 0;
+}
+
+
+/* Find the request item for the certificate CERT and store it at
+   R_ITEM.  NULL is stored if there is no such item.  */
+static gpg_error_t
+find_request_item (ksba_ocsp_t ocsp, ksba_cert_t cert,
+                   struct ocsp_reqitem_s **r_item)
+{
+  gpg_error_t err;
+  struct ocsp_reqitem_s *ri;
+
+  if (!ocsp->table_size && (err = build_index (ocsp)))
+    return err;
+  ri = ocsp->cert_table[hash_cert (cert) & (ocsp->table_size - 1)];
+  for (; ri; ri = ri->next_cert)
+    if (ri->cert == cert)
+      break;
+  *r_item = ri;
+  return 0;
+}
+
+
+/* Find the request item with the CertID given by NAME_HASH, KEY_HASH
+   and the serial number SERIALNO and store it at R_ITEM.  NULL is
+   stored if there is no such item.  */
+static gpg_error_t
+find_request_item_by_id (ksba_ocsp_t ocsp, const unsigned char *name_hash,
+                         const unsigned char *key_hash,
+                         const unsigned char *serialno, size_t serialnolen,
+                         struct ocsp_reqitem_s **r_item)
+{
+  gpg_error_t err;
+  struct ocsp_reqitem_s *ri;
+  unsigned int hash;
+
+  if (!ocsp->table_size && (err = build_index (ocsp)))
+    return err;
+  hash = hash_cert_id (name_hash, key_hash, serialno, serialnolen);
+  for (ri = ocsp->id_table[hash & (ocsp->table_size - 1)];
+       ri; ri = ri->next_id)
+    if (!memcmp (ri->issuer_name_hash, name_hash, 20)
+        && !memcmp (ri->issuer_key_hash, key_hash, 20)
+        && ri->serialnolen == serialnolen
+        && !memcmp (ri->serialno, serialno, serialnolen))
+      break;
+  *r_item = ri;
+  return 0;
+}
+
+
 /* Write the extensions for a request to WOUT. */
 static gpg_error_t
 write_request_extensions (ksba_ocsp_t ocsp, ksba_writer_t wout)
@@ -348,13 +492,16 @@ write_request_extensions (ksba_ocsp_t ocsp, ksba_writer_t wout)
    all necessary information have been set and stores the prepared
    request in the context.  A subsequent ksba_ocsp_build_request may
    then be used to retrieve this request.  Optional the requestmay be
-   signed beofre calling ksba_ocsp_build_request.
+   signed beofre calling ksba_ocsp_build_request.  If no targets have
+   been added since the last request was built and the nonce has the
+   same length, the request is copied from the last one and only the
+   nonce is replaced.
  */
 gpg_error_t
 ksba_ocsp_prepare_request (ksba_ocsp_t ocsp)
 {
   gpg_error_t err;
-  struct ocsp_reqitem_s *ri;
+  struct ocsp_reqitem_s *ri, *prev = NULL;
   unsigned char *p;
   const unsigned char *der;
   size_t derlen;
@@ -374,6 +521,24 @@ ksba_ocsp_prepare_request (ksba_ocsp_t ocsp)
   if (!ocsp->requestlist)
     return gpg_error (GPG_ERR_MISSING_ACTION);
 
+  if (ocsp->request_template && ocsp->template_noncelen == ocsp->noncelen)
+    {
+      /* Only the nonce may have changed since the request was built.
+         Because we do not support signed requests, the nonce
+         extension is the last object of the request.  */
+      p = xtrymalloc (ocsp->request_templatelen);
+      if (!p)
+        return gpg_error_from_syserror ();
+      memcpy (p, ocsp->request_template, ocsp->request_templatelen);
+      memcpy (p + ocsp->request_templatelen - ocsp->noncelen,
+              ocsp->nonce, ocsp->noncelen);
+      ocsp->request_buffer = p;
+      ocsp->request_buflen = ocsp->request_templatelen;
+      return 0;
+    }
+
+  release_index (ocsp); /* The CertIDs may be computed.  */
+
   /* Create three writer objects for construction of the request. */
   err = ksba_writer_new (&w3);
   if (!err)
@@ -389,6 +554,19 @@ ksba_ocsp_prepare_request (ksba_ocsp_t ocsp)
   /* Loop over all single requests. */
   for (ri=ocsp->requestlist; ri; ri = ri->next)
     {
+      if (ri->certid)
+        {
+          /* The Request has been encoded by a former call.  */
+          err = _ksba_ber_write_tl (w3, TYPE_SEQUENCE, CLASS_UNIVERSAL,
+                                    1, ri->certidlen);
+          if (!err)
+            err = ksba_writer_write (w3, ri->certid, ri->certidlen);
+          if (err)
+            goto leave;
+          prev = ri;
+          continue;
+        }
+
       err = ksba_writer_set_mem (w2, 256);
       if (!err)
         err = ksba_writer_set_mem (w1, 256);
@@ -400,19 +578,32 @@ ksba_ocsp_prepare_request (ksba_ocsp_t ocsp)
       if (err)
         goto leave;
 
-      /* Compute the issuerNameHash and write it into the CertID object. */
-      err = issuer_name_hash (ri->issuer_cert, ri->issuer_name_hash);
-      if (!err)
-        err = _ksba_ber_write_tl (w1, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0,20);
+      /* Compute the issuerNameHash and write it into the CertID
+         object.  The targets of a large request usually share a few
+         issuers, thus we take the hashes from the previous item if
+         it has the same issuer. */
+      if (prev && prev->issuer_cert == ri->issuer_cert)
+        {
+          memcpy (ri->issuer_name_hash, prev->issuer_name_hash, 20);
+          memcpy (ri->issuer_key_hash, prev->issuer_key_hash, 20);
+        }
+      else
+        {
+          err = issuer_name_hash (ri->issuer_cert, ri->issuer_name_hash);
+          if (!err)
+            err = issuer_key_hash (ri->issuer_cert, ri->issuer_key_hash);
+          if (err)
+            goto leave;
+        }
+      prev = ri;
+      err = _ksba_ber_write_tl (w1, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0,20);
       if (!err)
         err = ksba_writer_write (w1, ri->issuer_name_hash, 20);
       if(err)
         goto leave;
 
-      /* Compute the issuerKeyHash and write it. */
-      err = issuer_key_hash (ri->issuer_cert, ri->issuer_key_hash);
-      if (!err)
-        err = _ksba_ber_write_tl (w1, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0,20);
+      /* Write the issuerKeyHash. */
+      err = _ksba_ber_write_tl (w1, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0,20);
       if (!err)
         err = ksba_writer_write (w1, ri->issuer_key_hash, 20);
       if (err)
@@ -471,7 +662,9 @@ ksba_ocsp_prepare_request (ksba_ocsp_t ocsp)
                                 1, derlen);
       if (!err)
         err = ksba_writer_write (w3, p, derlen);
-      xfree (p); p = NULL;
+      /* Keep it for the next request.  */
+      ri->certid = p; p = NULL;
+      ri->certidlen = derlen;
       if (err)
         goto leave;
 
@@ -579,6 +772,18 @@ ksba_ocsp_prepare_request (ksba_ocsp_t ocsp)
     }
   ocsp->request_buffer = p;
   ocsp->request_buflen = derlen;
+
+  /* Keep a copy so that requests for the same targets only need to
+     patch the nonce.  This is only an optimization, thus a failed
+     allocation is not an error.  */
+  xfree (ocsp->request_template);
+  ocsp->request_template = xtrymalloc (derlen);
+  if (ocsp->request_template)
+    {
+      memcpy (ocsp->request_template, p, derlen);
+      ocsp->request_templatelen = derlen;
+      ocsp->template_noncelen = ocsp->noncelen;
+    }
   /* Ready. */
 
  leave:
@@ -727,7 +932,8 @@ parse_response_extensions (ksba_ocsp_t ocsp,
           err = gpg_error (GPG_ERR_BAD_BER);
           goto leave;
         }
-      ex = xtrymalloc (sizeof *ex + strlen (oid) + ti.length);
+      ex = xtrymalloc (sizeof *ex + strlen (oid)
+                       + (ocsp->ref_response? 0 : ti.length));
       if (!ex)
         {
           err = gpg_error_from_syserror ();
@@ -735,10 +941,14 @@ parse_response_extensions (ksba_ocsp_t ocsp,
         }
       ex->crit = is_crit;
       strcpy (ex->data, oid);
-      ex->data[strlen (oid)] = 0;
-      ex->off = strlen (oid) + 1;
       ex->len = ti.length;
-      memcpy (ex->data + ex->off, data, ti.length);
+      if (ocsp->ref_response)
+        ex->der = data;
+      else
+        {
+          memcpy (ex->data + strlen (oid) + 1, data, ti.length);
+          ex->der = (unsigned char *)ex->data + strlen (oid) + 1;
+        }
       ex->next = ocsp->response_extensions;
       ocsp->response_extensions = ex;
 
@@ -755,7 +965,7 @@ parse_response_extensions (ksba_ocsp_t ocsp,
    Parse single extensions and store them away.
 */
 static int
-parse_single_extensions (struct ocsp_reqitem_s *ri,
+parse_single_extensions (ksba_ocsp_t ocsp, struct ocsp_reqitem_s *ri,
                          const unsigned char *data, size_t datalen)
 {
   gpg_error_t err;
@@ -800,7 +1010,8 @@ parse_single_extensions (struct ocsp_reqitem_s *ri,
           err = gpg_error (GPG_ERR_BAD_BER);
           goto leave;
         }
-      ex = xtrymalloc (sizeof *ex + strlen (oid) + ti.length);
+      ex = xtrymalloc (sizeof *ex + strlen (oid)
+                       + (ocsp->ref_response? 0 : ti.length));
       if (!ex)
         {
           err = gpg_error_from_syserror ();
@@ -808,10 +1019,14 @@ parse_single_extensions (struct ocsp_reqitem_s *ri,
         }
       ex->crit = is_crit;
       strcpy (ex->data, oid);
-      ex->data[strlen (oid)] = 0;
-      ex->off = strlen (oid) + 1;
       ex->len = ti.length;
-      memcpy (ex->data + ex->off, data, ti.length);
+      if (ocsp->ref_response)
+        ex->der = data;
+      else
+        {
+          memcpy (ex->data + strlen (oid) + 1, data, ti.length);
+          ex->der = (unsigned char *)ex->data + strlen (oid) + 1;
+        }
       ex->next = ri->single_extensions;
       ri->single_extensions = ex;
 
@@ -844,14 +1059,14 @@ parse_single_extensions (struct ocsp_reqitem_s *ri,
          responseType   OBJECT IDENTIFIER,
          response       OCTET STRING }
 
-   On success the RESPONSE_STATUS field of OCSP will be set to the
-   response status and DATA will now point to the first byte in the
+   On success R_STATUS will be set to the response status and DATA
+   will now point to the first byte in the
    octet string of the response; RLEN will be set to the length of
    this octet string.  Note thate DATALEN is also updated but might
    point to a value larger than RLEN points to, if the provided data
    is a part of a larger image. */
 static gpg_error_t
-parse_response_status (ksba_ocsp_t ocsp,
+parse_response_status (ksba_ocsp_response_status_t *r_status,
                        unsigned char const **data, size_t *datalen,
                        size_t *rlength)
 {
@@ -870,17 +1085,17 @@ parse_response_status (ksba_ocsp_t ocsp,
     return err;
   switch (**data)
     {
-    case 0:  ocsp->response_status = KSBA_OCSP_RSPSTATUS_SUCCESS; break;
-    case 1:  ocsp->response_status = KSBA_OCSP_RSPSTATUS_MALFORMED; break;
-    case 2:  ocsp->response_status = KSBA_OCSP_RSPSTATUS_INTERNAL; break;
-    case 3:  ocsp->response_status = KSBA_OCSP_RSPSTATUS_TRYLATER; break;
-    case 5:  ocsp->response_status = KSBA_OCSP_RSPSTATUS_SIGREQUIRED; break;
-    case 6:  ocsp->response_status = KSBA_OCSP_RSPSTATUS_UNAUTHORIZED; break;
-    default: ocsp->response_status = KSBA_OCSP_RSPSTATUS_OTHER; break;
+    case 0:  *r_status = KSBA_OCSP_RSPSTATUS_SUCCESS; break;
+    case 1:  *r_status = KSBA_OCSP_RSPSTATUS_MALFORMED; break;
+    case 2:  *r_status = KSBA_OCSP_RSPSTATUS_INTERNAL; break;
+    case 3:  *r_status = KSBA_OCSP_RSPSTATUS_TRYLATER; break;
+    case 5:  *r_status = KSBA_OCSP_RSPSTATUS_SIGREQUIRED; break;
+    case 6:  *r_status = KSBA_OCSP_RSPSTATUS_UNAUTHORIZED; break;
+    default: *r_status = KSBA_OCSP_RSPSTATUS_OTHER; break;
     }
   parse_skip (data, datalen, &ti);
 
-  if (ocsp->response_status)
+  if (*r_status)
       return 0; /* This is an error reponse; we have to stop here. */
 
   /* We have a successful reponse status, thus we check that
@@ -911,58 +1126,28 @@ parse_response_status (ksba_ocsp_t ocsp,
 
 /* Parse the object:
 
-     SingleResponse ::= SEQUENCE {
-      certID                       CertID,
-      certStatus                   CertStatus,
-      thisUpdate                   GeneralizedTime,
-      nextUpdate         [0]       EXPLICIT GeneralizedTime OPTIONAL,
-      singleExtensions   [1]       EXPLICIT Extensions OPTIONAL }
-
-     CertStatus ::= CHOICE {
-       good        [0]     IMPLICIT NULL,
-       revoked     [1]     IMPLICIT RevokedInfo,
-       unknown     [2]     IMPLICIT UnknownInfo }
-
-     RevokedInfo ::= SEQUENCE {
-       revocationTime              GeneralizedTime,
-       revocationReason    [0]     EXPLICIT CRLReason OPTIONAL }
-
-     UnknownInfo ::= NULL -- this can be replaced with an enumeration
-
-*/
+     CertID ::= SEQUENCE {
+       hashAlgorithm       AlgorithmIdentifier,
+       issuerNameHash      OCTET STRING, -- Hash of Issuer's DN
+       issuerKeyHash       OCTET STRING, -- Hash of Issuers public key
+       serialNumber        CertificateSerialNumber }
 
+   and store pointers to the hashes and the value of the serial number
+   at R_NAME_HASH, R_KEY_HASH and R_SERIALNO.  R_IS_SHA1 is set to
+   true if the hashes are SHA-1 digests and may thus match those of a
+   request.  */
 static gpg_error_t
-parse_single_response (ksba_ocsp_t ocsp,
-                       unsigned char const **data, size_t *datalen)
+parse_cert_id (unsigned char const **data, size_t *datalen,
+               const unsigned char **r_name_hash,
+               const unsigned char **r_key_hash,
+               const unsigned char **r_serialno, size_t *r_serialnolen,
+               int *r_is_sha1)
 {
   gpg_error_t err;
   struct tag_info ti;
-  const unsigned char *savedata;
-  const unsigned char *endptr;
-  size_t savedatalen;
   size_t n;
   char *oid;
-  ksba_isotime_t this_update, next_update, revocation_time;
-  int look_for_request;
-  const unsigned char *name_hash;
-  const unsigned char *key_hash;
-  const unsigned char *serialno;
-  size_t serialnolen;
-  struct ocsp_reqitem_s *request_item = NULL;
 
-  /* The SingeResponse sequence. */
-  err = parse_sequence (data, datalen, &ti);
-  if (err)
-    return err;
-  endptr = *data + ti.length;
-
-  /* The CertID is
-       SEQUENCE {
-         hashAlgorithm       AlgorithmIdentifier,
-         issuerNameHash      OCTET STRING, -- Hash of Issuer's DN
-         issuerKeyHash       OCTET STRING, -- Hash of Issuers public key
-         serialNumber        CertificateSerialNumber }
-  */
   err = parse_sequence (data, datalen, &ti);
   if (err)
     return err;
@@ -973,50 +1158,100 @@ parse_single_response (ksba_ocsp_t ocsp,
   *data += n;
   *datalen -= n;
   /* gpgrt_log_debug ("algorithmIdentifier is `%s'\n", oid); */
-  look_for_request = !strcmp (oid, oidstr_sha1);
+  *r_is_sha1 = !strcmp (oid, oidstr_sha1);
   xfree (oid);
 
   err = parse_octet_string (data, datalen, &ti);
   if (err)
     return err;
-  name_hash = *data;
+  *r_name_hash = *data;
 /*   fprintf (stderr, "issuerNameHash=");  */
 /*   dump_hex (*data, ti.length); */
 /*   putc ('\n', stderr); */
   if (ti.length != 20)
-    look_for_request = 0; /* Can't be a SHA-1 digest. */
+    *r_is_sha1 = 0; /* Can't be a SHA-1 digest. */
   parse_skip (data, datalen, &ti);
 
   err = parse_octet_string (data, datalen, &ti);
   if (err)
     return err;
-  key_hash = *data;
+  *r_key_hash = *data;
 /*   fprintf (stderr, "issuerKeyHash=");  */
 /*   dump_hex (*data, ti.length); */
 /*   putc ('\n', stderr); */
   if (ti.length != 20)
-    look_for_request = 0; /* Can't be a SHA-1 digest. */
+    *r_is_sha1 = 0; /* Can't be a SHA-1 digest. */
   parse_skip (data, datalen, &ti);
 
   err= parse_integer (data, datalen, &ti);
   if (err)
     return err;
-  serialno = *data;
-  serialnolen = ti.length;
+  *r_serialno = *data;
+  *r_serialnolen = ti.length;
 /*   fprintf (stderr, "serialNumber=");  */
 /*   dump_hex (*data, ti.length); */
 /*   putc ('\n', stderr); */
   parse_skip (data, datalen, &ti);
+  return 0;
+}
+
+
+/* Parse the object:
+
+     SingleResponse ::= SEQUENCE {
+      certID                       CertID,
+      certStatus                   CertStatus,
+      thisUpdate                   GeneralizedTime,
+      nextUpdate         [0]       EXPLICIT GeneralizedTime OPTIONAL,
+      singleExtensions   [1]       EXPLICIT Extensions OPTIONAL }
+
+     CertStatus ::= CHOICE {
+       good        [0]     IMPLICIT NULL,
+       revoked     [1]     IMPLICIT RevokedInfo,
+       unknown     [2]     IMPLICIT UnknownInfo }
+
+     RevokedInfo ::= SEQUENCE {
+       revocationTime              GeneralizedTime,
+       revocationReason    [0]     EXPLICIT CRLReason OPTIONAL }
+
+     UnknownInfo ::= NULL -- this can be replaced with an enumeration
+
+*/
+
+static gpg_error_t
+parse_single_response (ksba_ocsp_t ocsp,
+                       unsigned char const **data, size_t *datalen)
+{
+  gpg_error_t err;
+  struct tag_info ti;
+  const unsigned char *savedata;
+  const unsigned char *endptr;
+  size_t savedatalen;
+  ksba_isotime_t this_update, next_update, revocation_time;
+  int look_for_request;
+  const unsigned char *name_hash;
+  const unsigned char *key_hash;
+  const unsigned char *serialno;
+  size_t serialnolen;
+  struct ocsp_reqitem_s *request_item = NULL;
+
+  /* The SingeResponse sequence. */
+  err = parse_sequence (data, datalen, &ti);
+  if (err)
+    return err;
+  endptr = *data + ti.length;
+
+  err = parse_cert_id (data, datalen, &name_hash, &key_hash,
+                       &serialno, &serialnolen, &look_for_request);
+  if (err)
+    return err;
 
   if (look_for_request)
     {
-      for (request_item = ocsp->requestlist;
-           request_item; request_item = request_item->next)
-        if (!memcmp (request_item->issuer_name_hash, name_hash, 20)
-            && !memcmp (request_item->issuer_key_hash, key_hash, 20)
-            && request_item->serialnolen == serialnolen
-            && !memcmp (request_item->serialno, serialno, serialnolen))
-            break; /* Got it. */
+      err = find_request_item_by_id (ocsp, name_hash, key_hash,
+                                     serialno, serialnolen, &request_item);
+      if (err)
+        return err;
     }
 
 
@@ -1162,7 +1397,8 @@ parse_single_response (ksba_ocsp_t ocsp,
     {
       if (request_item)
         {
-          err = parse_single_extensions (request_item, *data, ti.length);
+          err = parse_single_extensions (ocsp, request_item,
+                                         *data, ti.length);
           if (err)
             return err;
         }
@@ -1308,7 +1544,7 @@ parse_response (ksba_ocsp_t ocsp, const unsigned char *msg, size_t msglen)
 
 
   msgstart = msg;
-  err = parse_response_status (ocsp, &msg, &msglen, &len);
+  err = parse_response_status (&ocsp->response_status, &msg, &msglen, &len);
   if (err)
     return err;
   msglen = len; /* We don't care about any extra bytes provided to us. */
@@ -1396,8 +1632,13 @@ parse_response (ksba_ocsp_t ocsp, const unsigned char *msg, size_t msglen)
         err = ksba_cert_new (&cert);
         if (err)
           return err;
-        err = ksba_cert_init_from_mem (cert, msg - ti.nhdr,
-                                       ti.nhdr + ti.length);
+        if (ocsp->ref_response)
+          err = ksba_cert_init_from_mem_ref (cert, msg - ti.nhdr,
+                                             ti.nhdr + ti.length,
+                                             NULL, NULL);
+        else
+          err = ksba_cert_init_from_mem (cert, msg - ti.nhdr,
+                                         ti.nhdr + ti.length);
         if (err)
           {
             ksba_cert_release (cert);
@@ -1423,22 +1664,15 @@ parse_response (ksba_ocsp_t ocsp, const unsigned char *msg, size_t msglen)
 }
 
 
-/* Given the OCSP context and a binary reponse message of MSGLEN bytes
-   in MSG, this fucntion parses the response and prepares it for
-   signature verification.  The status from the server is returned in
-   RESPONSE_STATUS and must be checked even if the function returns
-   without an error. */
-gpg_error_t
-ksba_ocsp_parse_response (ksba_ocsp_t ocsp,
-                          const unsigned char *msg, size_t msglen,
-                          ksba_ocsp_response_status_t *response_status)
+/* Common code for ksba_ocsp_parse_response and
+   ksba_ocsp_parse_response_ref.  */
+static gpg_error_t
+do_parse_response (ksba_ocsp_t ocsp, const unsigned char *msg, size_t msglen,
+                   ksba_ocsp_response_status_t *response_status)
 {
   gpg_error_t err;
   struct ocsp_reqitem_s *ri;
 
-  if (!ocsp || !msg || !msglen || !response_status)
-    return gpg_error (GPG_ERR_INV_VALUE);
-
   if (!ocsp->requestlist)
     return gpg_error (GPG_ERR_MISSING_ACTION);
 
@@ -1449,6 +1683,7 @@ ksba_ocsp_parse_response (ksba_ocsp_t ocsp,
   release_ocsp_certlist (ocsp->received_certs);
   release_ocsp_extensions (ocsp->response_extensions);
   ocsp->received_certs = NULL;
+  ocsp->response_extensions = NULL;
   ocsp->hash_length = 0;
   ocsp->bad_nonce = 0;
   xfree (ocsp->responder_id.name);
@@ -1463,6 +1698,7 @@ ksba_ocsp_parse_response (ksba_ocsp_t ocsp,
       *ri->revocation_time = 0;
       ri->revocation_reason = 0;
       release_ocsp_extensions (ri->single_extensions);
+      ri->single_extensions = NULL;
     }
 
   /* Run the actual parser.  */
@@ -1483,6 +1719,42 @@ ksba_ocsp_parse_response (ksba_ocsp_t ocsp,
 }
 
 
+/* Given the OCSP context and a binary reponse message of MSGLEN bytes
+   in MSG, this fucntion parses the response and prepares it for
+   signature verification.  The status from the server is returned in
+   RESPONSE_STATUS and must be checked even if the function returns
+   without an error. */
+gpg_error_t
+ksba_ocsp_parse_response (ksba_ocsp_t ocsp,
+                          const unsigned char *msg, size_t msglen,
+                          ksba_ocsp_response_status_t *response_status)
+{
+  if (!ocsp || !msg || !msglen || !response_status)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  ocsp->ref_response = 0;
+  return do_parse_response (ocsp, msg, msglen, response_status);
+}
+
+
+/* This is the same as ksba_ocsp_parse_response but the extensions
+   and the certificates of the response are not copied; they
+   reference MSG instead.  The caller must not change or free MSG as
+   long as OCSP is used to access the response or a certificate
+   returned by ksba_ocsp_get_cert is in use.  */
+gpg_error_t
+ksba_ocsp_parse_response_ref (ksba_ocsp_t ocsp,
+                              const unsigned char *msg, size_t msglen,
+                              ksba_ocsp_response_status_t *response_status)
+{
+  if (!ocsp || !msg || !msglen || !response_status)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  ocsp->ref_response = 1;
+  return do_parse_response (ocsp, msg, msglen, response_status);
+}
+
+
 /* Return the digest algorithm to be used for the signature or NULL in
    case of an error.  The returned pointer is valid as long as the
    context is valid and no other ksba_ocsp_parse_response or
@@ -1637,6 +1909,7 @@ ksba_ocsp_get_status (ksba_ocsp_t ocsp, ksba_cert_t cert,
                       ksba_isotime_t r_revocation_time,
                       ksba_crl_reason_t *r_reason)
 {
+  gpg_error_t err;
   struct ocsp_reqitem_s *ri;
 
   if (!ocsp || !cert || !r_status)
@@ -1645,13 +1918,10 @@ ksba_ocsp_get_status (ksba_ocsp_t ocsp, ksba_cert_t cert,
     return gpg_error (GPG_ERR_MISSING_ACTION);
 
   /* Find the certificate.  We don't care about the issuer certificate
-     and stop at the first match.  The implementation may be optimized
-     by keeping track of the last certificate found to start with the
-     next one then.  Given that a usual request consists only of a few
-     certificates, this does not make much sense in reality. */
-  for (ri=ocsp->requestlist; ri; ri = ri->next)
-    if (ri->cert == cert)
-      break;
+     and stop at the first match.  */
+  err = find_request_item (ocsp, cert, &ri);
+  if (err)
+    return err;
   if (!ri)
     return gpg_error (GPG_ERR_NOT_FOUND);
   if (r_status)
@@ -1668,6 +1938,48 @@ ksba_ocsp_get_status (ksba_ocsp_t ocsp, ksba_cert_t cert,
 }
 
 
+/* Return the status of all targets for the last response done on
+   the context OCSP.  The first NSTATI targets are stored in the array
+   STATI in the order they were added with ksba_ocsp_add_target; the
+   fields have the same meaning as the values returned by
+   ksba_ocsp_get_status.  The certificates are not referenced and are
+   valid as long as OCSP lives.  The number of targets is stored at
+   R_COUNT; to learn about the required size of the array, this
+   function may be called with NSTATI set to 0.  As with
+   ksba_ocsp_get_status, the caller should have checked the signature
+   of the response before using the returned stati.  */
+gpg_error_t
+ksba_ocsp_get_status_list (ksba_ocsp_t ocsp, ksba_ocsp_status_t stati,
+                           unsigned int nstati, unsigned int *r_count)
+{
+  struct ocsp_reqitem_s *ri;
+  ksba_ocsp_status_t st;
+  unsigned int idx;
+
+  if (!ocsp || !r_count || (nstati && !stati))
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_count = 0;
+  if (!ocsp->requestlist)
+    return gpg_error (GPG_ERR_MISSING_ACTION);
+
+  /* The list is in reverse order of the targets.  */
+  for (ri=ocsp->requestlist, idx=ocsp->nrequests; ri; ri = ri->next)
+    if (--idx < nstati)
+      {
+        st = stati + idx;
+        st->cert = ri->cert;
+        st->status = ri->status;
+        _ksba_copy_time (st->this_update, ri->this_update);
+        _ksba_copy_time (st->next_update, ri->next_update);
+        _ksba_copy_time (st->revocation_time, ri->revocation_time);
+        st->reason = ri->revocation_reason;
+      }
+
+  *r_count = ocsp->nrequests;
+  return 0;
+}
+
+
 /* WARNING: The returned values ares only valid as long as no other
    ocsp function is called on the same context.  */
 gpg_error_t
@@ -1688,10 +2000,11 @@ ksba_ocsp_get_extension (ksba_ocsp_t ocsp, ksba_cert_t cert, int idx,
     {
       /* Return extensions for the certificate (singleExtensions).  */
       struct ocsp_reqitem_s *ri;
+      gpg_error_t err;
 
-      for (ri=ocsp->requestlist; ri; ri = ri->next)
-        if (ri->cert == cert)
-          break;
+      err = find_request_item (ocsp, cert, &ri);
+      if (err)
+        return err;
       if (!ri)
         return gpg_error (GPG_ERR_NOT_FOUND);
 
@@ -1714,9 +2027,1015 @@ ksba_ocsp_get_extension (ksba_ocsp_t ocsp, ksba_cert_t cert, int idx,
   if (r_crit)
     *r_crit = ex->crit;
   if (r_der)
-    *r_der = ex->data + ex->off;
+    *r_der = ex->der;
   if (r_derlen)
     *r_derlen = ex->len;
 
   return 0;
 }
+
+
+
+/* Create a new cache for pre-encoded responses and store it at
+   R_CACHE.  A responder may use it to answer requests for the same
+   targets without encoding and signing a response each time.  */
+gpg_error_t
+ksba_ocsp_cache_new (ksba_ocsp_cache_t *r_cache)
+{
+  ksba_ocsp_cache_t cache;
+
+  *r_cache = NULL;
+  cache = xtrycalloc (1, sizeof *cache);
+  if (!cache)
+    return gpg_error_from_syserror ();
+  cache->size = 64;
+  cache->table = xtrycalloc (cache->size, sizeof *cache->table);
+  if (!cache->table)
+    {
+      gpg_error_t err = gpg_error_from_syserror ();
+      xfree (cache);
+      return err;
+    }
+  *r_cache = cache;
+  return 0;
+}
+
+
+/* Release the cache item ITEM and its reference to the response.  */
+static void
+release_cache_item (struct ocsp_cache_item_s *item)
+{
+  if (!--item->blob->refcount)
+    xfree (item->blob);
+  xfree (item);
+}
+
+
+/* Release the cache CACHE and all its responses.  Passing NULL for
+   CACHE is a valid nop.  */
+void
+ksba_ocsp_cache_release (ksba_ocsp_cache_t cache)
+{
+  struct ocsp_cache_item_s *item;
+  unsigned int i;
+
+  if (!cache)
+    return;
+  for (i=0; i < cache->size; i++)
+    while ((item = cache->table[i]))
+      {
+        cache->table[i] = item->next;
+        release_cache_item (item);
+      }
+  xfree (cache->table);
+  xfree (cache);
+}
+
+
+/* Return the address of the link to the item of CACHE with the given
+   CertID.  The link is NULL if there is no such item.  */
+static struct ocsp_cache_item_s **
+find_cache_item (ksba_ocsp_cache_t cache, unsigned int hash,
+                 const unsigned char *name_hash,
+                 const unsigned char *key_hash,
+                 const unsigned char *serialno, size_t serialnolen)
+{
+  struct ocsp_cache_item_s **pp;
+
+  for (pp = &cache->table[hash & (cache->size - 1)]; *pp;
+       pp = &(*pp)->next)
+    if ((*pp)->hash == hash
+        && (*pp)->serialnolen == serialnolen
+        && !memcmp ((*pp)->serialno, serialno, serialnolen)
+        && !memcmp ((*pp)->name_hash, name_hash, 20)
+        && !memcmp ((*pp)->key_hash, key_hash, 20))
+      break;
+  return pp;
+}
+
+
+/* Double the number of buckets of CACHE.  */
+static gpg_error_t
+grow_cache (ksba_ocsp_cache_t cache)
+{
+  struct ocsp_cache_item_s **table, *item;
+  unsigned int i, size;
+
+  size = cache->size * 2;
+  table = xtrycalloc (size, sizeof *table);
+  if (!table)
+    return gpg_error_from_syserror ();
+  for (i=0; i < cache->size; i++)
+    while ((item = cache->table[i]))
+      {
+        cache->table[i] = item->next;
+        item->next = table[item->hash & (size - 1)];
+        table[item->hash & (size - 1)] = item;
+      }
+  xfree (cache->table);
+  cache->table = table;
+  cache->size = size;
+  return 0;
+}
+
+
+/* Parse the response in BLOB and prepend a cache item for each of
+   its SingleResponses with a SHA-1 CertID and a nextUpdate to the
+   list at R_ITEMS.  */
+static gpg_error_t
+parse_cache_response (struct ocsp_cache_blob_s *blob,
+                      struct ocsp_cache_item_s **r_items)
+{
+  gpg_error_t err;
+  struct tag_info ti;
+  ksba_ocsp_response_status_t status;
+  const unsigned char *data, *savedata, *endptr;
+  size_t datalen, savedatalen, len;
+  ksba_isotime_t tmptime;
+  struct ocsp_cache_item_s *item;
+  int is_sha1;
+
+  data = blob->data;
+  datalen = blob->length;
+  err = parse_response_status (&status, &data, &datalen, &len);
+  if (err)
+    return err;
+  if (status)
+    return gpg_error (GPG_ERR_INV_VALUE); /* Only good ones are cached. */
+  datalen = len;
+
+  /* The BasicOCSPResponse and its ResponseData.  */
+  err = parse_sequence (&data, &datalen, &ti);
+  if (!err)
+    err = parse_sequence (&data, &datalen, &ti);
+  if (err)
+    return err;
+  savedata = data;
+  savedatalen = datalen;
+  err = parse_context_tag (&data, &datalen, &ti, 0);
+  if (err)
+    {
+      data = savedata;
+      datalen = savedatalen;
+    }
+  else
+    parse_skip (&data, &datalen, &ti);  /* The version.  */
+  err = _ksba_ber_parse_tl (&data, &datalen, &ti);
+  if (err)
+    return err;
+  if (ti.length > datalen)
+    return gpg_error (GPG_ERR_BAD_BER);
+  parse_skip (&data, &datalen, &ti);  /* The responderID.  */
+  err = parse_asntime_into_isotime (&data, &datalen, tmptime);
+  if (err)
+    return err;
+
+  /* The responses.  */
+  err = parse_sequence (&data, &datalen, &ti);
+  if (err)
+    return err;
+  len = ti.length;
+  while (len)
+    {
+      err = parse_sequence (&data, &datalen, &ti);
+      if (err)
+        return err;
+      endptr = data + ti.length;
+      if (len < ti.nhdr + ti.length)
+        return gpg_error (GPG_ERR_BAD_BER);
+      len -= ti.nhdr + ti.length;
+
+      item = xtrycalloc (1, sizeof *item);
+      if (!item)
+        return gpg_error_from_syserror ();
+      item->blob = blob;
+      blob->refcount++;
+      item->next = *r_items;
+      *r_items = item;
+      err = parse_cert_id (&data, &datalen, &item->name_hash,
+                           &item->key_hash, &item->serialno,
+                           &item->serialnolen, &is_sha1);
+      if (err)
+        return err;
+
+      /* Skip the certStatus and the thisUpdate. */
+      err = _ksba_ber_parse_tl (&data, &datalen, &ti);
+      if (err)
+        return err;
+      if (ti.length > datalen)
+        return gpg_error (GPG_ERR_BAD_BER);
+      parse_skip (&data, &datalen, &ti);
+      err = parse_asntime_into_isotime (&data, &datalen, tmptime);
+      if (err)
+        return err;
+
+      /* Get the nextUpdate.  */
+      if (data < endptr)
+        {
+          savedata = data;
+          savedatalen = datalen;
+          err = parse_context_tag (&data, &datalen, &ti, 0);
+          if (!err)
+            err = parse_asntime_into_isotime (&data, &datalen,
+                                              item->next_update);
+          else if (gpg_err_code (err) == GPG_ERR_INV_OBJ)
+            err = 0;
+          if (err)
+            return err;
+        }
+      if (!is_sha1 || !*item->next_update)
+        {
+          /* We can't match it or must not cache it.  */
+          *r_items = item->next;
+          release_cache_item (item);
+        }
+      else
+        item->hash = hash_cert_id (item->name_hash, item->key_hash,
+                                   item->serialno, item->serialnolen);
+
+      /* Skip the singleExtensions.  */
+      if (data > endptr)
+        return gpg_error (GPG_ERR_BAD_BER);
+      datalen -= endptr - data;
+      data = endptr;
+    }
+  return 0;
+}
+
+
+/* Store the DER encoded and signed OCSP response RESPONSE of length
+   RESPONSELEN in CACHE.  The response is copied once and used for all
+   its targets; responses which were stored before for the same
+   targets are replaced.  Only targets identified by SHA-1 hashes,
+   which are used for requests, and with a nextUpdate are stored; the
+   response is used until that time.  GPG_ERR_NO_DATA is returned if
+   there is no such target in the response.  */
+gpg_error_t
+ksba_ocsp_cache_put (ksba_ocsp_cache_t cache,
+                     const unsigned char *response, size_t responselen)
+{
+  gpg_error_t err;
+  struct ocsp_cache_blob_s *blob;
+  struct ocsp_cache_item_s *items = NULL;
+  struct ocsp_cache_item_s *item, **pp;
+
+  if (!cache || !response || !responselen)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  blob = xtrymalloc (sizeof *blob + responselen - 1);
+  if (!blob)
+    return gpg_error_from_syserror ();
+  memcpy (blob->data, response, responselen);
+  blob->length = responselen;
+  blob->refcount = 1;
+
+  err = parse_cache_response (blob, &items);
+  if (!err && !items)
+    err = gpg_error (GPG_ERR_NO_DATA);
+  while ((item = items))
+    {
+      items = item->next;
+      if (!err && cache->count >= cache->size)
+        err = grow_cache (cache);
+      if (err)
+        {
+          release_cache_item (item);
+          continue;
+        }
+      pp = find_cache_item (cache, item->hash, item->name_hash,
+                            item->key_hash, item->serialno,
+                            item->serialnolen);
+      if (*pp)
+        {
+          item->next = (*pp)->next;
+          release_cache_item (*pp);
+        }
+      else
+        {
+          item->next = NULL;
+          cache->count++;
+        }
+      *pp = item;
+    }
+  if (!--blob->refcount)
+    xfree (blob);
+  return err;
+}
+
+
+/* Find a response in CACHE for the DER encoded OCSP request REQUEST
+   of length REQUESTLEN which is still valid at NOW.  If NOW is NULL
+   the current time is used; a later time may be given to refresh
+   responses before they expire.  A response is only returned if it
+   answers all targets of the request.  A nonce of the request is
+   ignored.  On success a pointer to the response is stored at
+   R_RESPONSE and its length at R_RESPONSELEN; the response is valid
+   until CACHE is changed.  GPG_ERR_NOT_FOUND is returned if there is
+   no such response.  */
+gpg_error_t
+ksba_ocsp_cache_get (ksba_ocsp_cache_t cache,
+                     const unsigned char *request, size_t requestlen,
+                     const ksba_isotime_t now,
+                     unsigned char const **r_response,
+                     size_t *r_responselen)
+{
+  gpg_error_t err;
+  struct tag_info ti;
+  const unsigned char *data = request;
+  size_t datalen = requestlen;
+  const unsigned char *savedata, *endptr;
+  size_t savedatalen, len;
+  const unsigned char *name_hash, *key_hash, *serialno;
+  size_t serialnolen;
+  ksba_isotime_t current;
+  struct ocsp_cache_item_s *item;
+  struct ocsp_cache_blob_s *blob = NULL;
+  int is_sha1, tag;
+
+  if (!cache || !request || !r_response || !r_responselen)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_response = NULL;
+  *r_responselen = 0;
+
+  if (!now)
+    {
+      _ksba_current_time (current);
+      now = current;
+    }
+
+  /* The OCSPRequest and its tbsRequest with the optional version and
+     requestorName.  */
+  err = parse_sequence (&data, &datalen, &ti);
+  if (!err)
+    err = parse_sequence (&data, &datalen, &ti);
+  if (err)
+    return err;
+  for (tag=0; tag < 2; tag++)
+    {
+      savedata = data;
+      savedatalen = datalen;
+      err = parse_context_tag (&data, &datalen, &ti, tag);
+      if (err)
+        {
+          data = savedata;
+          datalen = savedatalen;
+        }
+      else
+        parse_skip (&data, &datalen, &ti);
+    }
+
+  /* The requestList.  */
+  err = parse_sequence (&data, &datalen, &ti);
+  if (err)
+    return err;
+  len = ti.length;
+  if (!len)
+    return gpg_error (GPG_ERR_INV_OBJ);
+  while (len)
+    {
+      err = parse_sequence (&data, &datalen, &ti);
+      if (err)
+        return err;
+      endptr = data + ti.length;
+      if (len < ti.nhdr + ti.length)
+        return gpg_error (GPG_ERR_BAD_BER);
+      len -= ti.nhdr + ti.length;
+
+      err = parse_cert_id (&data, &datalen, &name_hash, &key_hash,
+                           &serialno, &serialnolen, &is_sha1);
+      if (err)
+        return err;
+      if (!is_sha1)
+        return gpg_error (GPG_ERR_NOT_FOUND);
+      item = *find_cache_item (cache,
+                               hash_cert_id (name_hash, key_hash,
+                                             serialno, serialnolen),
+                               name_hash, key_hash, serialno, serialnolen);
+      if (!item || _ksba_cmp_time (now, item->next_update) >= 0
+          || (blob && item->blob != blob))
+        return gpg_error (GPG_ERR_NOT_FOUND);
+      blob = item->blob;
+
+      /* Skip the singleRequestExtensions.  */
+      if (data > endptr)
+        return gpg_error (GPG_ERR_BAD_BER);
+      datalen -= endptr - data;
+      data = endptr;
+    }
+
+  *r_response = blob->data;
+  *r_responselen = blob->length;
+  return 0;
+}
+
+
+
+/* The AlgorithmIdentifier for SHA-1 used in the CertIDs and the DER
+   encoded OIDs of the nonce extension and the basic response type.  */
+static const unsigned char rb_sha1_algid[] =
+  { 0x30, 0x09, 0x06, 0x05, 0x2b, 0x0e, 0x03, 0x02, 0x1a, 0x05, 0x00 };
+static const unsigned char rb_nonce_oid[] =
+  { 0x2b, 0x06, 0x01, 0x05, 0x05, 0x07, 0x30, 0x01, 0x02 };
+static const unsigned char rb_basic_oid[] =
+  { 0x2b, 0x06, 0x01, 0x05, 0x05, 0x07, 0x30, 0x01, 0x01 };
+
+
+/* Return the length of the header of a TLV with a one byte tag and a
+   value of LENGTH bytes.  Unlike _ksba_ber_count_tl a LENGTH of 0 is
+   not taken as indefinite length.  */
+static size_t
+rb_tl_len (size_t length)
+{
+  if (length < 128)
+    return 2;
+  else if (length <= 0xff)
+    return 3;
+  else if (length <= 0xffff)
+    return 4;
+  else if (length <= 0xffffff)
+    return 5;
+  else
+    return 6;
+}
+
+
+/* Write the header of a TLV with the identifier octet TAG and a value
+   of LENGTH bytes to P and return the pointer to the value.  */
+static unsigned char *
+rb_put_tl (unsigned char *p, int tag, size_t length)
+{
+  size_t n = rb_tl_len (length) - 2;
+
+  *p++ = tag;
+  if (!n)
+    *p++ = length;
+  else
+    {
+      *p++ = 0x80 | n;
+      for (; n; n--)
+        *p++ = length >> (8 * (n - 1));
+    }
+  return p;
+}
+
+
+/* Write ATIME as GeneralizedTime of 17 bytes to P and return the
+   pointer after it.  */
+static unsigned char *
+rb_put_time (unsigned char *p, const ksba_isotime_t atime)
+{
+  *p++ = TYPE_GENERALIZED_TIME;
+  *p++ = 15;
+  memcpy (p, atime, 8);
+  memcpy (p+8, atime+9, 6);
+  p[14] = 'Z';
+  return p + 15;
+}
+
+
+/* Return the CRLReason code for REASON or -1 if no reason is to be
+   encoded.  */
+static int
+rb_reason_code (ksba_crl_reason_t reason)
+{
+  switch (reason)
+    {
+    case KSBA_CRLREASON_KEY_COMPROMISE:         return 1;
+    case KSBA_CRLREASON_CA_COMPROMISE:          return 2;
+    case KSBA_CRLREASON_AFFILIATION_CHANGED:    return 3;
+    case KSBA_CRLREASON_SUPERSEDED:             return 4;
+    case KSBA_CRLREASON_CESSATION_OF_OPERATION: return 5;
+    case KSBA_CRLREASON_CERTIFICATE_HOLD:       return 6;
+    case KSBA_CRLREASON_REMOVE_FROM_CRL:        return 8;
+    case KSBA_CRLREASON_PRIVILEGE_WITHDRAWN:    return 9;
+    case KSBA_CRLREASON_AA_COMPROMISE:          return 10;
+    default:                                    return -1;
+    }
+}
+
+
+/* Return the length of the CertID of the single response S.  */
+static size_t
+rb_certid_len (const struct ksba_ocsp_single_s *s)
+{
+  return (sizeof rb_sha1_algid + 22 + 22
+          + rb_tl_len (s->serialnolen) + s->serialnolen);
+}
+
+
+/* Return the length of the value of the SingleResponse S.  */
+static size_t
+rb_single_len (const struct ksba_ocsp_single_s *s)
+{
+  size_t n, len;
+
+  n = rb_certid_len (s);
+  len = rb_tl_len (n) + n;
+  if (s->status == KSBA_STATUS_REVOKED)
+    len += 2 + 17 + (rb_reason_code (s->reason) == -1? 0 : 5);
+  else
+    len += 2;
+  len += 17;
+  if (*s->next_update)
+    len += 2 + 17;
+  return len;
+}
+
+
+/* Write the SingleResponse S to P and return the pointer after it.  */
+static unsigned char *
+rb_put_single (unsigned char *p, const struct ksba_ocsp_single_s *s)
+{
+  int code;
+
+  p = rb_put_tl (p, 0x30, rb_single_len (s));
+  p = rb_put_tl (p, 0x30, rb_certid_len (s));
+  memcpy (p, rb_sha1_algid, sizeof rb_sha1_algid);
+  p += sizeof rb_sha1_algid;
+  p = rb_put_tl (p, TYPE_OCTET_STRING, 20);
+  memcpy (p, s->issuer_name_hash, 20);
+  p += 20;
+  p = rb_put_tl (p, TYPE_OCTET_STRING, 20);
+  memcpy (p, s->issuer_key_hash, 20);
+  p += 20;
+  p = rb_put_tl (p, TYPE_INTEGER, s->serialnolen);
+  memcpy (p, s->serialno, s->serialnolen);
+  p += s->serialnolen;
+
+  switch (s->status)
+    {
+    case KSBA_STATUS_GOOD:    /* good [0] IMPLICIT NULL */
+      *p++ = 0x80;
+      *p++ = 0;
+      break;
+    case KSBA_STATUS_REVOKED: /* revoked [1] IMPLICIT RevokedInfo */
+      code = rb_reason_code (s->reason);
+      *p++ = 0xa1;
+      *p++ = code == -1? 17 : 22;
+      p = rb_put_time (p, s->revocation_time);
+      if (code != -1)
+        {
+          *p++ = 0xa0;
+          *p++ = 3;
+          *p++ = TYPE_ENUMERATED;
+          *p++ = 1;
+          *p++ = code;
+        }
+      break;
+    default:                  /* unknown [2] IMPLICIT NULL */
+      *p++ = 0x82;
+      *p++ = 0;
+      break;
+    }
+
+  p = rb_put_time (p, s->this_update);
+  if (*s->next_update)
+    {
+      *p++ = 0xa0;
+      *p++ = 17;
+      p = rb_put_time (p, s->next_update);
+    }
+  return p;
+}
+
+
+/* Return the length of the signatureAlgorithm.  */
+static size_t
+rb_sigalgo_len (ksba_ocsp_response_builder_t rb)
+{
+  size_t n;
+
+  n = rb_tl_len (rb->sigalgolen) + rb->sigalgolen + (rb->sigalgo_null? 2:0);
+  return rb_tl_len (n) + n;
+}
+
+
+/* Return the length of the [0] certs of the BasicOCSPResponse.  */
+static size_t
+rb_certs_len (ksba_ocsp_response_builder_t rb)
+{
+  size_t n;
+
+  if (!rb->certs)
+    return 0;
+  n = rb_tl_len (rb->certslen) + rb->certslen;
+  return rb_tl_len (n) + n;
+}
+
+
+/* Compute the headers preceding the tbsResponseData for a signature
+   of SIGLEN bytes and return their length.  If P is not NULL write
+   them to P.  The length of the entire response is stored at
+   R_TOTAL.  */
+static size_t
+rb_headers (ksba_ocsp_response_builder_t rb, size_t siglen,
+            unsigned char *p, size_t *r_total)
+{
+  size_t basic, octets, rbytes, explicit, resp;
+
+  /* The values of OCSPResponse, [0] EXPLICIT, ResponseBytes, the
+     OCTET STRING and BasicOCSPResponse from the inside out.  */
+  basic = (rb->tbslen + rb_sigalgo_len (rb) + rb_tl_len (siglen + 1)
+           + siglen + 1 + rb_certs_len (rb));
+  octets = rb_tl_len (basic) + basic;
+  rbytes = 2 + sizeof rb_basic_oid + rb_tl_len (octets) + octets;
+  explicit = rb_tl_len (rbytes) + rbytes;
+  resp = 3 + rb_tl_len (explicit) + explicit;
+  *r_total = rb_tl_len (resp) + resp;
+
+  if (p)
+    {
+      p = rb_put_tl (p, 0x30, resp);
+      *p++ = TYPE_ENUMERATED;
+      *p++ = 1;
+      *p++ = KSBA_OCSP_RSPSTATUS_SUCCESS;
+      p = rb_put_tl (p, 0xa0, explicit);
+      p = rb_put_tl (p, 0x30, rbytes);
+      p = rb_put_tl (p, TYPE_OBJECT_ID, sizeof rb_basic_oid);
+      memcpy (p, rb_basic_oid, sizeof rb_basic_oid);
+      p += sizeof rb_basic_oid;
+      p = rb_put_tl (p, TYPE_OCTET_STRING, octets);
+      rb_put_tl (p, 0x30, basic);
+    }
+
+  return *r_total - basic;
+}
+
+
+/* Create a new builder for OCSP responses and store it at R_RB.  A
+   responder may use one builder for many responses; see
+   ksba_ocsp_response_builder_reset.  */
+gpg_error_t
+ksba_ocsp_response_builder_new (ksba_ocsp_response_builder_t *r_rb)
+{
+  *r_rb = xtrycalloc (1, sizeof **r_rb);
+  if (!*r_rb)
+    return gpg_error_from_syserror ();
+  (*r_rb)->certs_tail = &(*r_rb)->certs;
+  return 0;
+}
+
+
+/* Release the response builder RB.  */
+void
+ksba_ocsp_response_builder_release (ksba_ocsp_response_builder_t rb)
+{
+  struct ocsp_certlist_s *cl, *cl2;
+
+  if (!rb)
+    return;
+  for (cl = rb->certs; cl; cl = cl2)
+    {
+      cl2 = cl->next;
+      ksba_cert_release (cl->cert);
+      xfree (cl);
+    }
+  xfree (rb->responder);
+  xfree (rb->singles);
+  xfree (rb->buffer);
+  xfree (rb->sigalgo);
+  xfree (rb);
+}
+
+
+/* Prepare RB for the next response by removing all single responses
+   and the nonce.  The responder ID and the certificates are kept and
+   the buffer is reused.  */
+void
+ksba_ocsp_response_builder_reset (ksba_ocsp_response_builder_t rb)
+{
+  if (!rb)
+    return;
+  rb->nsingles = 0;
+  rb->noncelen = 0;
+  rb->tbslen = 0;
+}
+
+
+/* Set the responder ID of RB.  Either NAME with the DER encoded Name
+   of NAMELEN bytes or KEYHASH with the 20 byte SHA-1 hash of the
+   responder's public key must be given.  */
+gpg_error_t
+ksba_ocsp_response_builder_set_responder (ksba_ocsp_response_builder_t rb,
+                                          const unsigned char *name,
+                                          size_t namelen,
+                                          const unsigned char *keyhash)
+{
+  unsigned char *p;
+  size_t n;
+
+  if (!rb || (!name == !keyhash) || (name && !namelen))
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  n = name? rb_tl_len (namelen) + namelen : 2 + 22;
+  p = xtrymalloc (n);
+  if (!p)
+    return gpg_error_from_syserror ();
+  xfree (rb->responder);
+  rb->responder = p;
+  rb->responderlen = n;
+  if (name)
+    {
+      p = rb_put_tl (p, 0xa1, namelen); /* byName [1] EXPLICIT */
+      memcpy (p, name, namelen);
+    }
+  else
+    {
+      *p++ = 0xa2;                      /* byKey [2] EXPLICIT */
+      *p++ = 22;
+      p = rb_put_tl (p, TYPE_OCTET_STRING, 20);
+      memcpy (p, keyhash, 20);
+    }
+  rb->tbslen = 0;
+  return 0;
+}
+
+
+/* Add the certificate CERT to the certificates sent with the
+   responses of RB.  This is usually the responder's certificate.  */
+gpg_error_t
+ksba_ocsp_response_builder_add_cert (ksba_ocsp_response_builder_t rb,
+                                     ksba_cert_t cert)
+{
+  struct ocsp_certlist_s *cl;
+  size_t n;
+
+  if (!rb || !cert)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!ksba_cert_get_image (cert, &n))
+    return gpg_error (GPG_ERR_NO_DATA);
+
+  cl = xtrycalloc (1, sizeof *cl);
+  if (!cl)
+    return gpg_error_from_syserror ();
+  ksba_cert_ref (cert);
+  cl->cert = cert;
+  *rb->certs_tail = cl;
+  rb->certs_tail = &cl->next;
+  rb->certslen += n;
+  rb->tbslen = 0;
+  return 0;
+}
+
+
+/* Include the nonce extension with NONCE of NONCELEN bytes in the
+   response of RB.  This is the nonce taken from the request.  */
+gpg_error_t
+ksba_ocsp_response_builder_set_nonce (ksba_ocsp_response_builder_t rb,
+                                      const unsigned char *nonce,
+                                      size_t noncelen)
+{
+  if (!rb || (!nonce && noncelen))
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (noncelen > sizeof rb->nonce)
+    return gpg_error (GPG_ERR_TOO_LARGE);
+
+  if (noncelen)
+    memcpy (rb->nonce, nonce, noncelen);
+  rb->noncelen = noncelen;
+  rb->tbslen = 0;
+  return 0;
+}
+
+
+/* Add the NSINGLES responses from the array SINGLES to RB.  The
+   entries are checked and copied but the hashes and serial numbers
+   they point to must stay valid until the response has been built
+   with ksba_ocsp_response_builder_get_tbs.  Either all or no entries
+   are added.  */
+gpg_error_t
+ksba_ocsp_response_builder_add_singles (ksba_ocsp_response_builder_t rb,
+                                     const struct ksba_ocsp_single_s *singles,
+                                     unsigned int nsingles)
+{
+  const struct ksba_ocsp_single_s *s;
+  unsigned int i;
+
+  if (!rb || (!singles && nsingles))
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  for (i=0; i < nsingles; i++)
+    {
+      s = singles + i;
+      if (!s->issuer_name_hash || !s->issuer_key_hash
+          || !s->serialno || !s->serialnolen)
+        return gpg_error (GPG_ERR_INV_VALUE);
+      if (_ksba_assert_time_format (s->this_update)
+          || (*s->next_update && _ksba_assert_time_format (s->next_update)))
+        return gpg_error (GPG_ERR_INV_TIME);
+      switch (s->status)
+        {
+        case KSBA_STATUS_GOOD:
+        case KSBA_STATUS_UNKNOWN:
+          break;
+        case KSBA_STATUS_REVOKED:
+          if (_ksba_assert_time_format (s->revocation_time))
+            return gpg_error (GPG_ERR_INV_TIME);
+          if (rb_reason_code (s->reason) == -1
+              && s->reason && s->reason != KSBA_CRLREASON_UNSPECIFIED)
+            return gpg_error (GPG_ERR_INV_VALUE);
+          break;
+        default:
+          return gpg_error (GPG_ERR_INV_VALUE);
+        }
+    }
+
+  if (rb->nsingles + nsingles < rb->nsingles)
+    return gpg_error (GPG_ERR_TOO_LARGE);
+  if (rb->nsingles + nsingles > rb->singles_size)
+    {
+      struct ksba_ocsp_single_s *tmp;
+      unsigned int n = rb->singles_size? rb->singles_size : 16;
+
+      while (n < rb->nsingles + nsingles)
+        n *= 2;
+      tmp = xtryrealloc (rb->singles, n * sizeof *tmp);
+      if (!tmp)
+        return gpg_error_from_syserror ();
+      rb->singles = tmp;
+      rb->singles_size = n;
+    }
+  if (nsingles)
+    memcpy (rb->singles + rb->nsingles, singles, nsingles * sizeof *singles);
+  rb->nsingles += nsingles;
+  rb->tbslen = 0;
+  return 0;
+}
+
+
+/* Build the response of RB produced at PRODUCED_AT, or now if that is
+   NULL, to be signed with the algorithm SIGALGO given as OID string.
+   MAXSIGLEN is the largest length of the signature with that
+   algorithm.  The length of the entire response is computed first so
+   that it is written to a single buffer.  On success a pointer to
+   the tbsResponseData in that buffer is stored at R_TBS and its
+   length at R_TBSLEN.  This is to be hashed and signed; the
+   signature is then passed to ksba_ocsp_response_builder_set_sig.  */
+gpg_error_t
+ksba_ocsp_response_builder_get_tbs (ksba_ocsp_response_builder_t rb,
+                                    const ksba_isotime_t produced_at,
+                                    const char *sigalgo, size_t maxsiglen,
+                                    unsigned char const **r_tbs,
+                                    size_t *r_tbslen)
+{
+  gpg_error_t err;
+  ksba_isotime_t now;
+  unsigned char *p;
+  size_t responses, tbs, hdrlen, total, n;
+  unsigned int i;
+
+  if (!rb || !sigalgo || !maxsiglen || !r_tbs || !r_tbslen)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_tbs = NULL;
+  *r_tbslen = 0;
+  rb->tbslen = 0;
+  if (!rb->responder || !rb->nsingles)
+    return gpg_error (GPG_ERR_MISSING_VALUE);
+  if (produced_at)
+    {
+      if (_ksba_assert_time_format (produced_at))
+        return gpg_error (GPG_ERR_INV_TIME);
+      _ksba_copy_time (now, produced_at);
+    }
+  else
+    _ksba_current_time (now);
+
+  xfree (rb->sigalgo);
+  err = ksba_oid_from_str (sigalgo, &rb->sigalgo, &rb->sigalgolen);
+  if (err)
+    {
+      rb->sigalgo = NULL;
+      return err;
+    }
+  /* The PKCS#1 algorithms take NULL parameters, the others none.  */
+  rb->sigalgo_null = !strncmp (sigalgo, "1.2.840.113549.1.1.", 19);
+
+  responses = 0;
+  for (i=0; i < rb->nsingles; i++)
+    {
+      n = rb_single_len (rb->singles + i);
+      responses += rb_tl_len (n) + n;
+    }
+  tbs = rb->responderlen + 17 + rb_tl_len (responses) + responses;
+  if (rb->noncelen)
+    tbs += 21 + rb->noncelen;
+  rb->tbslen = rb_tl_len (tbs) + tbs;
+  rb->maxsiglen = maxsiglen;
+  hdrlen = rb_headers (rb, maxsiglen, NULL, &total);
+  if (maxsiglen > 0xffff || total > 0x7fffffff)
+    {
+      rb->tbslen = 0;
+      return gpg_error (GPG_ERR_TOO_LARGE);
+    }
+
+  if (total > rb->buffer_size)
+    {
+      xfree (rb->buffer);
+      rb->buffer = xtrymalloc (total);
+      if (!rb->buffer)
+        {
+          err = gpg_error_from_syserror ();
+          rb->buffer_size = 0;
+          rb->tbslen = 0;
+          return err;
+        }
+      rb->buffer_size = total;
+    }
+
+  /* Write the tbsResponseData after the space for the headers.  */
+  rb->tbsoff = hdrlen;
+  p = rb_put_tl (rb->buffer + rb->tbsoff, 0x30, tbs);
+  memcpy (p, rb->responder, rb->responderlen);
+  p += rb->responderlen;
+  p = rb_put_time (p, now);
+  p = rb_put_tl (p, 0x30, responses);
+  for (i=0; i < rb->nsingles; i++)
+    p = rb_put_single (p, rb->singles + i);
+  if (rb->noncelen)
+    {
+      *p++ = 0xa1;                      /* responseExtensions */
+      *p++ = 19 + rb->noncelen;
+      *p++ = 0x30;                      /* Extensions */
+      *p++ = 17 + rb->noncelen;
+      *p++ = 0x30;                      /* Extension */
+      *p++ = 15 + rb->noncelen;
+      p = rb_put_tl (p, TYPE_OBJECT_ID, sizeof rb_nonce_oid);
+      memcpy (p, rb_nonce_oid, sizeof rb_nonce_oid);
+      p += sizeof rb_nonce_oid;
+      p = rb_put_tl (p, TYPE_OCTET_STRING, 2 + rb->noncelen);
+      p = rb_put_tl (p, TYPE_OCTET_STRING, rb->noncelen);
+      memcpy (p, rb->nonce, rb->noncelen);
+      p += rb->noncelen;
+    }
+  assert (p == rb->buffer + rb->tbsoff + rb->tbslen);
+
+  *r_tbs = rb->buffer + rb->tbsoff;
+  *r_tbslen = rb->tbslen;
+  return 0;
+}
+
+
+/* Complete the response of RB with the signature SIG of SIGLEN bytes
+   over the tbsResponseData returned by
+   ksba_ocsp_response_builder_get_tbs.  SIGLEN may be shorter than the
+   length reserved.  On success a pointer to the DER encoded response
+   is stored at R_DER and its length at R_DERLEN.  The response is
+   owned by RB and valid until RB is changed or released.  */
+gpg_error_t
+ksba_ocsp_response_builder_set_sig (ksba_ocsp_response_builder_t rb,
+                                    const unsigned char *sig, size_t siglen,
+                                    unsigned char const **r_der,
+                                    size_t *r_derlen)
+{
+  struct ocsp_certlist_s *cl;
+  const unsigned char *image;
+  unsigned char *p, *start;
+  size_t hdrlen, total, n;
+
+  if (!rb || !sig || !siglen || !r_der || !r_derlen)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_der = NULL;
+  *r_derlen = 0;
+  if (!rb->tbslen)
+    return gpg_error (GPG_ERR_MISSING_ACTION);
+  if (siglen > rb->maxsiglen)
+    return gpg_error (GPG_ERR_TOO_LARGE);
+
+  /* A shorter signature may need shorter headers; these are aligned
+     to end right before the tbsResponseData.  */
+  hdrlen = rb_headers (rb, siglen, NULL, &total);
+  start = rb->buffer + rb->tbsoff - hdrlen;
+  rb_headers (rb, siglen, start, &total);
+
+  p = rb->buffer + rb->tbsoff + rb->tbslen;
+  n = rb_tl_len (rb->sigalgolen) + rb->sigalgolen + (rb->sigalgo_null? 2:0);
+  p = rb_put_tl (p, 0x30, n);
+  p = rb_put_tl (p, TYPE_OBJECT_ID, rb->sigalgolen);
+  memcpy (p, rb->sigalgo, rb->sigalgolen);
+  p += rb->sigalgolen;
+  if (rb->sigalgo_null)
+    {
+      *p++ = TYPE_NULL;
+      *p++ = 0;
+    }
+  p = rb_put_tl (p, TYPE_BIT_STRING, siglen + 1);
+  *p++ = 0;
+  memcpy (p, sig, siglen);
+  p += siglen;
+  if (rb->certs)
+    {
+      p = rb_put_tl (p, 0xa0, rb_tl_len (rb->certslen) + rb->certslen);
+      p = rb_put_tl (p, 0x30, rb->certslen);
+      for (cl = rb->certs; cl; cl = cl->next)
+        {
+          image = ksba_cert_get_image (cl->cert, &n);
+          memcpy (p, image, n);
+          p += n;
+        }
+    }
+  assert (p == start + total);
+
+  *r_der = start;
+  *r_derlen = total;
+  return 0;
+}
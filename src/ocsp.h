@@ -45,17 +45,20 @@ struct ocsp_certlist_s {
 struct ocsp_extension_s
 {
   struct ocsp_extension_s *next;
-  size_t off;    /* Offset into DATA to the content of the octet string.  */
+  const unsigned char *der; /* The content of the octet string.  */
   size_t len;    /* Length of the octet string. */
   int crit;      /* IsCritical flag. */
   char data[1];  /* This is made up of the OID string followed by the
-                    actual DER data of the extension. */
+                    actual DER data of the extension.  If the response
+                    is referenced, only the OID is stored.  */
 };
 
 
 /* A structure to keep a information about a single status request. */
 struct ocsp_reqitem_s {
   struct ocsp_reqitem_s *next;
+  struct ocsp_reqitem_s *next_id;   /* Next item in the CertID bucket.  */
+  struct ocsp_reqitem_s *next_cert; /* Next item in the CERT bucket.  */
 
   ksba_cert_t cert;        /* The target certificate for the request. */
   ksba_cert_t issuer_cert; /* And the certificate of the issuer. */
@@ -65,6 +68,8 @@ struct ocsp_reqitem_s {
   unsigned char issuer_key_hash[20];  /* The hash as used by the request. */
   unsigned char *serialno; /* A malloced copy of the serial number. */
   size_t serialnolen;      /* and its length. */
+  unsigned char *certid;   /* NULL or the cached DER of the Request */
+  size_t certidlen;        /* without its tag and length. */
 
   /* The actual status as parsed from the response. */
   ksba_isotime_t this_update;  /* The thisUpdate value from the response. */
@@ -77,10 +82,20 @@ struct ocsp_reqitem_s {
 
 /* A structure used as context for the ocsp subsystem. */
 struct ksba_ocsp_s {
+  ksba_alloc_ctx_t alloc_ctx;  /* The allocator context or NULL.  */
+
   char *digest_oid;        /* The OID of the digest algorithm to be
                               used for a request. */
 
   struct ocsp_reqitem_s *requestlist;  /* The list of request items. */
+  unsigned int nrequests;              /* Number of items in the list.  */
+
+  /* Hash tables to find the request items by their CertID and by
+     their certificate.  Both have TABLE_SIZE buckets and are created
+     on demand; they are released if the list of items changes. */
+  struct ocsp_reqitem_s **id_table;
+  struct ocsp_reqitem_s **cert_table;
+  unsigned int table_size;
 
   size_t noncelen;          /* 0 if no nonce was sent. */
   unsigned char nonce[16];  /* The random nonce we sent; actual length
@@ -91,10 +106,14 @@ struct ksba_ocsp_s {
 
   unsigned char *request_buffer; /* Internal buffer to build the request. */
   size_t request_buflen;
+  unsigned char *request_template; /* NULL or a copy of the last */
+  size_t request_templatelen;      /* fully built request and the */
+  size_t template_noncelen;        /* length of its nonce.  */
 
   size_t hash_offset;      /* What area of the response is to be */
   size_t hash_length;      /* hashed. */
 
+  int ref_response;         /* The response is referenced and not copied. */
   ksba_ocsp_response_status_t response_status; /* Status of the response. */
   ksba_sexp_t sigval;          /* The signature value. */
   ksba_isotime_t produced_at;  /* The time the response was signed. */
@@ -110,4 +129,56 @@ struct ksba_ocsp_s {
 };
 
 
+/* A pre-encoded response shared by the cache items of its targets. */
+struct ocsp_cache_blob_s {
+  unsigned int refcount;
+  size_t length;
+  unsigned char data[1];
+};
+
+/* An item of the response cache.  The pointers reference the CertID
+   in the response of BLOB.  */
+struct ocsp_cache_item_s {
+  struct ocsp_cache_item_s *next;
+  unsigned int hash;
+  struct ocsp_cache_blob_s *blob;
+  const unsigned char *name_hash;
+  const unsigned char *key_hash;
+  const unsigned char *serialno;
+  size_t serialnolen;
+  ksba_isotime_t next_update;  /* The response is valid until then.  */
+};
+
+/* A cache of responses for a responder.  */
+struct ksba_ocsp_cache_s {
+  struct ocsp_cache_item_s **table;  /* SIZE buckets of items.  */
+  unsigned int size;
+  unsigned int count;                /* Number of items.  */
+};
+
+
+/* The object to build OCSP responses.  */
+struct ksba_ocsp_response_builder_s {
+  unsigned char *responder;   /* The DER encoded ResponderID.  */
+  size_t responderlen;
+  struct ocsp_certlist_s *certs;   /* Certificates to include.  */
+  struct ocsp_certlist_s **certs_tail;
+  size_t certslen;            /* Length of their images.  */
+  size_t noncelen;            /* 0 if no nonce shall be included.  */
+  unsigned char nonce[32];
+  struct ksba_ocsp_single_s *singles;  /* NSINGLES responses of */
+  unsigned int nsingles;               /* SINGLES_SIZE allocated.  */
+  unsigned int singles_size;
+
+  unsigned char *buffer;      /* The response under construction.  */
+  size_t buffer_size;         /* Allocated size of BUFFER.  */
+  size_t tbsoff;              /* Offset of the tbsResponseData.  */
+  size_t tbslen;              /* Its length.  */
+  size_t maxsiglen;           /* Space reserved for the signature.  */
+  unsigned char *sigalgo;     /* The DER encoded OID of the signature */
+  size_t sigalgolen;          /* algorithm.  */
+  int sigalgo_null;           /* The algorithm has NULL parameters.  */
+};
+
+
 #endif /*OCSP_H*/
@@ -39,6 +39,336 @@
 #include "convert.h"
 
 
+/* The registry of OIDs known to the library, indexed by their
+   oid_id_t.  New entries are appended here and to the enum in
+   convert.h and their identifier is inserted into OID_DER_ORDER.  */
+static const struct
+{
+  unsigned char derlen;
+  const char *der;
+  const char *str;
+} oid_registry[OID_LAST] = {
+  { 0, NULL, NULL },
+  {  3, "\x55\x04\x03",                             "2.5.4.3" },
+  {  3, "\x55\x04\x04",                             "2.5.4.4" },
+  {  3, "\x55\x04\x05",                             "2.5.4.5" },
+  {  3, "\x55\x04\x06",                             "2.5.4.6" },
+  {  3, "\x55\x04\x07",                             "2.5.4.7" },
+  {  3, "\x55\x04\x08",                             "2.5.4.8" },
+  {  3, "\x55\x04\x09",                             "2.5.4.9" },
+  {  3, "\x55\x04\x0a",                             "2.5.4.10" },
+  {  3, "\x55\x04\x0b",                             "2.5.4.11" },
+  {  3, "\x55\x04\x0c",                             "2.5.4.12" },
+  {  3, "\x55\x04\x0d",                             "2.5.4.13" },
+  {  3, "\x55\x04\x0f",                             "2.5.4.15" },
+  {  3, "\x55\x04\x10",                             "2.5.4.16" },
+  {  3, "\x55\x04\x11",                             "2.5.4.17" },
+  {  3, "\x55\x04\x2a",                             "2.5.4.42" },
+  {  3, "\x55\x04\x41",                             "2.5.4.65" },
+  { 10, "\x09\x92\x26\x89\x93\xf2\x2c\x64\x01\x19",
+        "0.9.2342.19200300.100.1.25" },
+  { 10, "\x09\x92\x26\x89\x93\xf2\x2c\x64\x01\x01",
+        "0.9.2342.19200300.100.1.1" },
+  {  9, "\x2a\x86\x48\x86\xf7\x0d\x01\x09\x01",     "1.2.840.113549.1.9.1" },
+  {  3, "\x55\x1d\x09",                             "2.5.29.9" },
+  {  3, "\x55\x1d\x0e",                             "2.5.29.14" },
+  {  3, "\x55\x1d\x0f",                             "2.5.29.15" },
+  {  3, "\x55\x1d\x10",                             "2.5.29.16" },
+  {  3, "\x55\x1d\x11",                             "2.5.29.17" },
+  {  3, "\x55\x1d\x12",                             "2.5.29.18" },
+  {  3, "\x55\x1d\x13",                             "2.5.29.19" },
+  {  3, "\x55\x1d\x14",                             "2.5.29.20" },
+  {  3, "\x55\x1d\x15",                             "2.5.29.21" },
+  {  3, "\x55\x1d\x18",                             "2.5.29.24" },
+  {  3, "\x55\x1d\x1b",                             "2.5.29.27" },
+  {  3, "\x55\x1d\x1c",                             "2.5.29.28" },
+  {  3, "\x55\x1d\x1d",                             "2.5.29.29" },
+  {  3, "\x55\x1d\x1e",                             "2.5.29.30" },
+  {  3, "\x55\x1d\x1f",                             "2.5.29.31" },
+  {  3, "\x55\x1d\x20",                             "2.5.29.32" },
+  {  3, "\x55\x1d\x21",                             "2.5.29.33" },
+  {  3, "\x55\x1d\x23",                             "2.5.29.35" },
+  {  3, "\x55\x1d\x24",                             "2.5.29.36" },
+  {  3, "\x55\x1d\x25",                             "2.5.29.37" },
+  {  3, "\x55\x1d\x2e",                             "2.5.29.46" },
+  {  3, "\x55\x1d\x36",                             "2.5.29.54" },
+  {  8, "\x2b\x06\x01\x05\x05\x07\x01\x01",         "1.3.6.1.5.5.7.1.1" },
+  {  8, "\x2b\x06\x01\x05\x05\x07\x01\x03",         "1.3.6.1.5.5.7.1.3" },
+  {  8, "\x2b\x06\x01\x05\x05\x07\x01\x0b",         "1.3.6.1.5.5.7.1.11" },
+  {  9, "\x2b\x06\x01\x05\x05\x07\x30\x01\x05",     "1.3.6.1.5.5.7.48.1.5" },
+  { 10, "\x2b\x06\x01\x04\x01\xd6\x79\x02\x04\x02",
+        "1.3.6.1.4.1.11129.2.4.2" },
+  {  9, "\x2a\x86\x48\x86\xf7\x0d\x01\x07\x01",     "1.2.840.113549.1.7.1" },
+  {  9, "\x2a\x86\x48\x86\xf7\x0d\x01\x07\x02",     "1.2.840.113549.1.7.2" },
+  {  9, "\x2a\x86\x48\x86\xf7\x0d\x01\x07\x03",     "1.2.840.113549.1.7.3" },
+  {  9, "\x2a\x86\x48\x86\xf7\x0d\x01\x07\x05",     "1.2.840.113549.1.7.5" },
+  {  9, "\x2a\x86\x48\x86\xf7\x0d\x01\x07\x06",     "1.2.840.113549.1.7.6" },
+  { 11, "\x2a\x86\x48\x86\xf7\x0d\x01\x09\x10\x01\x02",
+        "1.2.840.113549.1.9.16.1.2" },
+  { 11, "\x2a\x86\x48\x86\xf7\x0d\x01\x09\x10\x01\x17",
+        "1.2.840.113549.1.9.16.1.23" },
+  { 10, "\x2b\x06\x01\x04\x01\x82\x37\x02\x01\x04", "1.3.6.1.4.1.311.2.1.4" },
+  { 10, "\x2b\x06\x01\x04\x01\xda\x47\x02\x03\x01",
+        "1.3.6.1.4.1.11591.2.3.1" },
+  {  3, "\x2b\x65\x70",                             "1.3.101.112" },
+  {  3, "\x2b\x65\x6e",                             "1.3.101.110" },
+  {  3, "\x2b\x65\x71",                             "1.3.101.113" },
+  {  3, "\x2b\x65\x6f",                             "1.3.101.111" },
+  {  8, "\x2a\x86\x48\xce\x3d\x03\x01\x01",         "1.2.840.10045.3.1.1" },
+  {  5, "\x2b\x81\x04\x00\x21",                     "1.3.132.0.33" },
+  {  8, "\x2a\x86\x48\xce\x3d\x03\x01\x07",         "1.2.840.10045.3.1.7" },
+  {  5, "\x2b\x81\x04\x00\x22",                     "1.3.132.0.34" },
+  {  5, "\x2b\x81\x04\x00\x23",                     "1.3.132.0.35" },
+  {  9, "\x2b\x24\x03\x03\x02\x08\x01\x01\x01",     "1.3.36.3.3.2.8.1.1.1" },
+  {  9, "\x2b\x24\x03\x03\x02\x08\x01\x01\x03",     "1.3.36.3.3.2.8.1.1.3" },
+  {  9, "\x2b\x24\x03\x03\x02\x08\x01\x01\x05",     "1.3.36.3.3.2.8.1.1.5" },
+  {  9, "\x2b\x24\x03\x03\x02\x08\x01\x01\x07",     "1.3.36.3.3.2.8.1.1.7" },
+  {  9, "\x2b\x24\x03\x03\x02\x08\x01\x01\x09",     "1.3.36.3.3.2.8.1.1.9" },
+  {  9, "\x2b\x24\x03\x03\x02\x08\x01\x01\x0b",     "1.3.36.3.3.2.8.1.1.11" },
+  {  9, "\x2b\x24\x03\x03\x02\x08\x01\x01\x0d",     "1.3.36.3.3.2.8.1.1.13" },
+  {  7, "\x2a\x85\x03\x02\x02\x23\x01",             "1.2.643.2.2.35.1" },
+  {  7, "\x2a\x85\x03\x02\x02\x23\x02",             "1.2.643.2.2.35.2" },
+  {  7, "\x2a\x85\x03\x02\x02\x23\x03",             "1.2.643.2.2.35.3" },
+  {  9, "\x2a\x85\x03\x07\x01\x02\x01\x02\x01",     "1.2.643.7.1.2.1.2.1" },
+  {  9, "\x2a\x85\x03\x07\x01\x02\x01\x02\x02",     "1.2.643.7.1.2.1.2.2" },
+  {  5, "\x2b\x81\x04\x00\x0a",                     "1.3.132.0.10" },
+};
+
+/* The identifiers of all registered OIDs sorted by their DER
+   encoding for a binary search.  */
+static const unsigned char oid_der_order[OID_LAST - 1] = {
+    OID_AT_USERID, OID_AT_DOMAIN_COMPONENT, OID_CURVE_GOST2001_A,
+    OID_CURVE_GOST2001_B, OID_CURVE_GOST2001_C, OID_CURVE_GOST2012_A,
+    OID_CURVE_GOST2012_B, OID_CT_DATA, OID_CT_SIGNED_DATA,
+    OID_CT_ENVELOPED_DATA, OID_CT_DIGESTED_DATA,
+    OID_CT_ENCRYPTED_DATA, OID_AT_EMAIL_ADDRESS, OID_CT_AUTH_DATA,
+    OID_CT_AUTHENVELOPED_DATA, OID_CURVE_NIST_P192,
+    OID_CURVE_NIST_P256, OID_CT_SPC_IND_DATA_CTX, OID_PE_SCT_LIST,
+    OID_CT_OPENPGP_KEYBLOCK, OID_PE_AUTHORITY_INFO_ACCESS,
+    OID_PE_QC_STATEMENTS, OID_PE_SUBJECT_INFO_ACCESS,
+    OID_PE_OCSP_NOCHECK, OID_CURVE_BRAINPOOL_P160R1,
+    OID_CURVE_BRAINPOOL_P192R1, OID_CURVE_BRAINPOOL_P224R1,
+    OID_CURVE_BRAINPOOL_P256R1, OID_CURVE_BRAINPOOL_P320R1,
+    OID_CURVE_BRAINPOOL_P384R1, OID_CURVE_BRAINPOOL_P512R1,
+    OID_CURVE_X25519, OID_CURVE_X448, OID_CURVE_ED25519,
+    OID_CURVE_ED448, OID_CURVE_SECP256K1, OID_CURVE_NIST_P224,
+    OID_CURVE_NIST_P384, OID_CURVE_NIST_P521, OID_AT_COMMON_NAME,
+    OID_AT_SURNAME, OID_AT_SERIAL_NUMBER, OID_AT_COUNTRY_NAME,
+    OID_AT_LOCALITY_NAME, OID_AT_STATE_OR_PROVINCE,
+    OID_AT_STREET_ADDRESS, OID_AT_ORGANIZATION_NAME,
+    OID_AT_ORGANIZATIONAL_UNIT, OID_AT_TITLE, OID_AT_DESCRIPTION,
+    OID_AT_BUSINESS_CATEGORY, OID_AT_POSTAL_ADDRESS,
+    OID_AT_POSTAL_CODE, OID_AT_GIVEN_NAME, OID_AT_PSEUDONYM,
+    OID_CE_SUBJECT_DIR_ATTRS, OID_CE_SUBJECT_KEY_ID, OID_CE_KEY_USAGE,
+    OID_CE_PRIVATE_KEY_USAGE, OID_CE_SUBJECT_ALT_NAME,
+    OID_CE_ISSUER_ALT_NAME, OID_CE_BASIC_CONSTRAINTS,
+    OID_CE_CRL_NUMBER, OID_CE_CRL_REASON, OID_CE_INVALIDITY_DATE,
+    OID_CE_DELTA_CRL_INDICATOR, OID_CE_ISSUING_DIST_POINT,
+    OID_CE_CERT_ISSUER, OID_CE_NAME_CONSTRAINTS,
+    OID_CE_CRL_DIST_POINTS, OID_CE_CERT_POLICIES,
+    OID_CE_POLICY_MAPPINGS, OID_CE_AUTHORITY_KEY_ID,
+    OID_CE_POLICY_CONSTRAINTS, OID_CE_EXT_KEY_USAGE,
+    OID_CE_FRESHEST_CRL, OID_CE_INHIBIT_ANY_POLICY
+};
+
+
+/* The same sorted by their dotted strings.  */
+static const unsigned char oid_str_order[OID_LAST - 1] = {
+    OID_AT_USERID, OID_AT_DOMAIN_COMPONENT, OID_CURVE_GOST2001_A,
+    OID_CURVE_GOST2001_B, OID_CURVE_GOST2001_C, OID_CURVE_GOST2012_A,
+    OID_CURVE_GOST2012_B, OID_CURVE_NIST_P192, OID_CURVE_NIST_P256,
+    OID_CT_DATA, OID_CT_SIGNED_DATA, OID_CT_ENVELOPED_DATA,
+    OID_CT_DIGESTED_DATA, OID_CT_ENCRYPTED_DATA, OID_AT_EMAIL_ADDRESS,
+    OID_CT_AUTH_DATA, OID_CT_AUTHENVELOPED_DATA, OID_CURVE_X25519,
+    OID_CURVE_X448, OID_CURVE_ED25519, OID_CURVE_ED448,
+    OID_CURVE_SECP256K1, OID_CURVE_NIST_P224, OID_CURVE_NIST_P384,
+    OID_CURVE_NIST_P521, OID_CURVE_BRAINPOOL_P160R1,
+    OID_CURVE_BRAINPOOL_P384R1, OID_CURVE_BRAINPOOL_P512R1,
+    OID_CURVE_BRAINPOOL_P192R1, OID_CURVE_BRAINPOOL_P224R1,
+    OID_CURVE_BRAINPOOL_P256R1, OID_CURVE_BRAINPOOL_P320R1,
+    OID_PE_SCT_LIST, OID_CT_OPENPGP_KEYBLOCK, OID_CT_SPC_IND_DATA_CTX,
+    OID_PE_AUTHORITY_INFO_ACCESS, OID_PE_SUBJECT_INFO_ACCESS,
+    OID_PE_QC_STATEMENTS, OID_PE_OCSP_NOCHECK, OID_CE_SUBJECT_KEY_ID,
+    OID_CE_KEY_USAGE, OID_CE_PRIVATE_KEY_USAGE,
+    OID_CE_SUBJECT_ALT_NAME, OID_CE_ISSUER_ALT_NAME,
+    OID_CE_BASIC_CONSTRAINTS, OID_CE_CRL_NUMBER, OID_CE_CRL_REASON,
+    OID_CE_INVALIDITY_DATE, OID_CE_DELTA_CRL_INDICATOR,
+    OID_CE_ISSUING_DIST_POINT, OID_CE_CERT_ISSUER,
+    OID_CE_NAME_CONSTRAINTS, OID_CE_CRL_DIST_POINTS,
+    OID_CE_CERT_POLICIES, OID_CE_POLICY_MAPPINGS,
+    OID_CE_AUTHORITY_KEY_ID, OID_CE_POLICY_CONSTRAINTS,
+    OID_CE_EXT_KEY_USAGE, OID_CE_FRESHEST_CRL,
+    OID_CE_INHIBIT_ANY_POLICY, OID_CE_SUBJECT_DIR_ATTRS,
+    OID_AT_ORGANIZATION_NAME, OID_AT_ORGANIZATIONAL_UNIT,
+    OID_AT_TITLE, OID_AT_DESCRIPTION, OID_AT_BUSINESS_CATEGORY,
+    OID_AT_POSTAL_ADDRESS, OID_AT_POSTAL_CODE, OID_AT_COMMON_NAME,
+    OID_AT_SURNAME, OID_AT_GIVEN_NAME, OID_AT_SERIAL_NUMBER,
+    OID_AT_COUNTRY_NAME, OID_AT_PSEUDONYM, OID_AT_LOCALITY_NAME,
+    OID_AT_STATE_OR_PROVINCE, OID_AT_STREET_ADDRESS
+};
+
+
+/* Return the identifier of the DER encoded OID at DER of DERLEN bytes
+   or OID_NONE if it is not in the registry.  */
+oid_id_t
+_ksba_oid_lookup (const void *der, size_t derlen)
+{
+  int lo, hi, mid, cmp;
+  unsigned int id;
+  size_t n;
+
+  lo = 0;
+  hi = DIM (oid_der_order) - 1;
+  while (lo <= hi)
+    {
+      mid = (lo + hi) / 2;
+      id = oid_der_order[mid];
+      n = oid_registry[id].derlen;
+      cmp = memcmp (oid_registry[id].der, der, n < derlen? n : derlen);
+      if (!cmp)
+        cmp = n < derlen? -1 : n > derlen;
+      if (!cmp)
+        return id;
+      if (cmp < 0)
+        lo = mid + 1;
+      else
+        hi = mid - 1;
+    }
+  return OID_NONE;
+}
+
+
+/* Return the identifier of the OID given as dotted STRING or
+   OID_NONE if it is not in the registry.  */
+static oid_id_t
+lookup_str (const char *string)
+{
+  int lo, hi, mid, cmp;
+  unsigned int id;
+
+  lo = 0;
+  hi = DIM (oid_str_order) - 1;
+  while (lo <= hi)
+    {
+      mid = (lo + hi) / 2;
+      id = oid_str_order[mid];
+      cmp = strcmp (oid_registry[id].str, string);
+      if (!cmp)
+        return id;
+      if (cmp < 0)
+        lo = mid + 1;
+      else
+        hi = mid - 1;
+    }
+  return OID_NONE;
+}
+
+
+/* Return the OID with identifier ID as a dotted string or NULL for
+   OID_NONE.  The string is static.  */
+const char *
+_ksba_oid_id_to_str (oid_id_t id)
+{
+  if (id <= OID_NONE || id >= OID_LAST)
+    return NULL;
+  return oid_registry[id].str;
+}
+
+
+
+/* Append the arc VAL, preceded by a dot if DOT is set, to the string
+   at P which must end before END.  Return the new end of the string
+   or NULL if it does not fit.  */
+static char *
+append_arc (char *p, char *end, int dot, unsigned long val)
+{
+  char tmp[24];
+  int n = sizeof tmp;
+
+  do
+    tmp[--n] = '0' + val % 10;
+  while ((val /= 10));
+  if (dot)
+    tmp[--n] = '.';
+  if (end - p < (int)sizeof tmp - n)
+    return NULL;
+  memcpy (p, tmp + n, sizeof tmp - n);
+  return p + sizeof tmp - n;
+}
+
+
+/* Format the DER encoded OID at BUF of LENGTH bytes as dotted string
+   into STRING of SIZE bytes.  Returns GPG_ERR_BUFFER_TOO_SHORT if
+   STRING is too short and GPG_ERR_INV_OID_STRING for an arc which does
+   not fit into an unsigned long.  */
+static gpg_error_t
+format_oid (const unsigned char *buf, size_t length, char *string,
+            size_t size)
+{
+  char *p = string;
+  char *end = string + size - 1;
+  size_t n = 0;
+  unsigned long val, valmask;
+
+  if (!size)
+    return gpg_error (GPG_ERR_BUFFER_TOO_SHORT);
+  if (!length)
+    {
+      *p = 0;
+      return 0;
+    }
+
+  valmask = (unsigned long)0xfe << (8 * (sizeof (valmask) - 1));
+
+  if (buf[0] < 80)
+    {
+      p = append_arc (p, end, 0, buf[0] / 40);
+      if (p)
+        p = append_arc (p, end, 1, buf[0] % 40);
+    }
+  else
+    {
+      val = buf[n] & 0x7f;
+      while ( (buf[n]&0x80) && ++n < length )
+        {
+          if ( (val & valmask) )
+            return gpg_error (GPG_ERR_INV_OID_STRING);  /* Overflow.  */
+          val <<= 7;
+          val |= buf[n] & 0x7f;
+        }
+      if (val < 80)
+        return gpg_error (GPG_ERR_INV_OID_STRING);
+      p = append_arc (p, end, 0, 2);
+      if (p)
+        p = append_arc (p, end, 1, val - 80);
+    }
+  for (n++; p && n < length; n++)
+    {
+      val = buf[n] & 0x7f;
+      while ( (buf[n]&0x80) && ++n < length )
+        {
+          if ( (val & valmask) )
+            return gpg_error (GPG_ERR_INV_OID_STRING);  /* Overflow.  */
+          val <<= 7;
+          val |= buf[n] & 0x7f;
+        }
+      p = append_arc (p, end, 1, val);
+    }
+  if (!p)
+    return gpg_error (GPG_ERR_BUFFER_TOO_SHORT);
+
+  *p = 0;
+  return 0;
+}
+
+
+/* Return a special OID (gnu.gnupg.badoid) to indicate the error case.
+   The OID is broken and thus we return one which can't do any harm.
+   Formally this does not need to be a bad OID but an OID with an arc
+   that can't be represented in a 32 bit word is more than likely
+   corrupt.  */
+#define BAD_OID_STRING "1.3.6.1.4.1.11591.2.12242973"
+
 
 /**
  * ksba_oid_to_str:
@@ -62,69 +392,69 @@
 char *
 ksba_oid_to_str (const char *buffer, size_t length)
 {
-  const unsigned char *buf = buffer;
-  char *string, *p;
-  int n = 0;
-  unsigned long val, valmask;
+  const char *s;
+  char *string;
+  size_t size;
 
-  valmask = (unsigned long)0xfe << (8 * (sizeof (valmask) - 1));
+  /* Copy known OIDs from the registry.  */
+  s = _ksba_oid_id_to_str (_ksba_oid_lookup (buffer, length));
+  if (s)
+    return xtrystrdup (s);
 
   /* To calculate the length of the string we can safely assume an
      upper limit of 3 decimal characters per byte.  Two extra bytes
      account for the special first octect */
-  string = p = xtrymalloc (length*(1+3)+2+1);
+  size = length*(1+3)+2+1;
+  string = xtrymalloc (size);
   if (!string)
     return NULL;
-  if (!length)
+  if (format_oid (buffer, length, string, size))
     {
-      *p = 0;
-      return string;
+      xfree (string);
+      return xtrystrdup (BAD_OID_STRING);
     }
+  return string;
+}
 
-  if (buf[0] < 40)
-    p += sprintf (p, "0.%d", buf[n]);
-  else if (buf[0] < 80)
-    p += sprintf (p, "1.%d", buf[n]-40);
-  else {
-    val = buf[n] & 0x7f;
-    while ( (buf[n]&0x80) && ++n < length )
-      {
-        if ( (val & valmask) )
-          goto badoid;  /* Overflow.  */
-        val <<= 7;
-        val |= buf[n] & 0x7f;
-      }
-    if (val < 80)
-      goto badoid;
-    val -= 80;
-    sprintf (p, "2.%lu", val);
-    p += strlen (p);
-  }
-  for (n++; n < length; n++)
-    {
-      val = buf[n] & 0x7f;
-      while ( (buf[n]&0x80) && ++n < length )
-        {
-          if ( (val & valmask) )
-            goto badoid;  /* Overflow.  */
-          val <<= 7;
-          val |= buf[n] & 0x7f;
-        }
-      sprintf (p, ".%lu", val);
-      p += strlen (p);
-    }
 
-  *p = 0;
-  return string;
+/**
+ * ksba_oid_to_str_buf:
+ * @der: A BER encoded OID
+ * @derlen: The length of this OID
+ * @buffer: Returns the OID as string
+ * @bufsize: The size of @buffer
+ *
+ * This is a version of ksba_oid_to_str which stores the string in the
+ * caller provided @buffer instead of allocating it.
+ *
+ * Return value: 0 on success, GPG_ERR_BUFFER_TOO_SHORT if the string
+ * and its terminating Nul do not fit into @buffer, or another error
+ * code.
+ **/
+gpg_error_t
+ksba_oid_to_str_buf (const char *der, size_t derlen,
+                     char *buffer, size_t bufsize)
+{
+  gpg_error_t err;
+  const char *s;
 
- badoid:
-  /* Return a special OID (gnu.gnupg.badoid) to indicate the error
-     case.  The OID is broken and thus we return one which can't do
-     any harm.  Formally this does not need to be a bad OID but an OID
-     with an arc that can't be represented in a 32 bit word is more
-     than likely corrupt.  */
-  xfree (string);
-  return xtrystrdup ("1.3.6.1.4.1.11591.2.12242973");
+  if (!der && derlen)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!buffer)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  s = _ksba_oid_id_to_str (_ksba_oid_lookup (der, derlen));
+  if (!s)
+    {
+      err = format_oid (der, derlen, buffer, bufsize);
+      if (gpg_err_code (err) != GPG_ERR_INV_OID_STRING)
+        return err;
+      s = BAD_OID_STRING;
+    }
+  if (strlen (s) >= bufsize)
+    return gpg_error (GPG_ERR_BUFFER_TOO_SHORT);
+  strcpy (buffer, s);
+  return 0;
 }
 
 
@@ -163,62 +493,42 @@ make_flagged_int (unsigned long value, char *buf, size_t buflen)
 }
 
 
-/**
- * ksba_oid_from_str:
- * @string: A string with the OID in dotted decimal form
- * @rbuf:   Returns the DER encoded OID
- * @rlength: and its length
- *
- * Convertes the OID given in dotted decimal form to an DER encoding
- * and returns it in allocated buffer rbuf and its length in rlength.
- * rbuf is set to NULL in case an error is returned.
- * Scanning stops at the first white space.
- *
- * The caller must free the returned buffer using ksba_free() or the
- * function he has registered as a replacement.
- *
- * Return value: 0 on success or an error value
- **/
-gpg_error_t
-ksba_oid_from_str (const char *string, unsigned char **rbuf, size_t *rlength)
+/* Parse the OID in dotted decimal form at STRING and store its DER
+   encoding in BUF of BUFSIZE bytes and its length at R_BUFLEN.  */
+static gpg_error_t
+parse_oid (const char *string, unsigned char *buf, size_t bufsize,
+           size_t *r_buflen)
 {
-  unsigned char *buf;
-  size_t buflen;
+  unsigned char tmp[16];
+  size_t buflen, n;
   unsigned long val1, val;
   const char *endp;
+  oid_id_t id;
   int arcno;
 
-  if (!string || !rbuf || !rlength)
-    return gpg_error (GPG_ERR_INV_VALUE);
-  *rbuf = NULL;
-  *rlength = 0;
-
-  /* we allow the OID to be prefixed with either "oid." or "OID." */
-  if ( !strncmp (string, "oid.", 4) || !strncmp (string, "OID.", 4))
-    string += 4;
-
-  if (!*string)
-    return gpg_error (GPG_ERR_INV_VALUE);
+  /* Copy known OIDs from the registry.  */
+  id = lookup_str (string);
+  if (id)
+    {
+      if (oid_registry[id].derlen > bufsize)
+        return gpg_error (GPG_ERR_BUFFER_TOO_SHORT);
+      memcpy (buf, oid_registry[id].der, oid_registry[id].derlen);
+      *r_buflen = oid_registry[id].derlen;
+      return 0;
+    }
 
-  /* we can safely assume that the encoded OID is shorter than the string */
-  buf = xtrymalloc ( strlen(string) + 2);
-  if (!buf)
-    return gpg_error (GPG_ERR_ENOMEM);
   buflen = 0;
-
   val1 = 0; /* avoid compiler warnings */
   arcno = 0;
   do {
     arcno++;
     val = strtoul (string, (char**)&endp, 10);
     if (!digitp (string) || !(*endp == '.' || !*endp))
-      {
-        xfree (buf);
-        return gpg_error (GPG_ERR_INV_OID_STRING);
-      }
+      return gpg_error (GPG_ERR_INV_OID_STRING);
     if (*endp == '.')
       string = endp+1;
 
+    n = 0;
     if (arcno == 1)
       {
         if (val > 2)
@@ -230,36 +540,120 @@ ksba_oid_from_str (const char *string, unsigned char **rbuf, size_t *rlength)
         if (val1 < 2)
           {
             if (val > 39)
-              {
-                xfree (buf);
-                return gpg_error (GPG_ERR_INV_OID_STRING);
-              }
-            buf[buflen++] = val1*40 + val;
+              return gpg_error (GPG_ERR_INV_OID_STRING);
+            tmp[n++] = val1*40 + val;
           }
         else
           {
             val += 80;
-            buflen = make_flagged_int (val, buf, buflen);
+            n = make_flagged_int (val, tmp, n);
           }
       }
     else
       {
-        buflen = make_flagged_int (val, buf, buflen);
+        n = make_flagged_int (val, tmp, n);
       }
+    if (buflen + n > bufsize)
+      return gpg_error (GPG_ERR_BUFFER_TOO_SHORT);
+    memcpy (buf + buflen, tmp, n);
+    buflen += n;
   } while (*endp == '.');
 
   if (arcno == 1)
     { /* it is not possible to encode only the first arc */
-      xfree (buf);
       return gpg_error (GPG_ERR_INV_OID_STRING);
     }
 
+  *r_buflen = buflen;
+  return 0;
+}
+
+
+/**
+ * ksba_oid_from_str:
+ * @string: A string with the OID in dotted decimal form
+ * @rbuf:   Returns the DER encoded OID
+ * @rlength: and its length
+ *
+ * Convertes the OID given in dotted decimal form to an DER encoding
+ * and returns it in allocated buffer rbuf and its length in rlength.
+ * rbuf is set to NULL in case an error is returned.
+ * Scanning stops at the first white space.
+ *
+ * The caller must free the returned buffer using ksba_free() or the
+ * function he has registered as a replacement.
+ *
+ * Return value: 0 on success or an error value
+ **/
+gpg_error_t
+ksba_oid_from_str (const char *string, unsigned char **rbuf, size_t *rlength)
+{
+  gpg_error_t err;
+  unsigned char *buf;
+  size_t buflen;
+
+  if (!string || !rbuf || !rlength)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *rbuf = NULL;
+  *rlength = 0;
+
+  /* we allow the OID to be prefixed with either "oid." or "OID." */
+  if ( !strncmp (string, "oid.", 4) || !strncmp (string, "OID.", 4))
+    string += 4;
+
+  if (!*string)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  /* we can safely assume that the encoded OID is shorter than the string */
+  buflen = strlen (string) + 2;
+  buf = xtrymalloc (buflen);
+  if (!buf)
+    return gpg_error (GPG_ERR_ENOMEM);
+
+  err = parse_oid (string, buf, buflen, &buflen);
+  if (err)
+    {
+      xfree (buf);
+      return err;
+    }
+
   *rbuf = buf;
   *rlength = buflen;
   return 0;
 }
 
 
+/**
+ * ksba_oid_from_str_buf:
+ * @string: A string with the OID in dotted decimal form
+ * @buffer: Returns the DER encoded OID
+ * @bufsize: The size of @buffer
+ * @r_length: Returns the length of the DER encoded OID
+ *
+ * This is a version of ksba_oid_from_str which stores the DER
+ * encoding in the caller provided @buffer instead of allocating it.
+ *
+ * Return value: 0 on success, GPG_ERR_BUFFER_TOO_SHORT if the DER
+ * encoding does not fit into @buffer, or another error code.
+ **/
+gpg_error_t
+ksba_oid_from_str_buf (const char *string, unsigned char *buffer,
+                       size_t bufsize, size_t *r_length)
+{
+  if (!string || !buffer || !r_length)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_length = 0;
+
+  if ( !strncmp (string, "oid.", 4) || !strncmp (string, "OID.", 4))
+    string += 4;
+
+  if (!*string)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  return parse_oid (string, buffer, bufsize, r_length);
+}
+
+
 /* Convert the string in BUFFER which is of length BUFLEN to its DER
    encoding and returns it in a new allocated buffer RBUF and its
    length in RLENGTH.  RBUF is set to NULL if an error is returned.
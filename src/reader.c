@@ -35,10 +35,35 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+# define USE_MMAP 1
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/mman.h>
+#endif
 #include "util.h"
 
 #include "ksba.h"
 #include "reader.h"
+#include "ber-decoder.h"
+
+/* True if the data of reader R is directly accessible in memory.  */
+#define IS_MEM_READER(r) ((r)->type == READER_TYPE_MEM \
+                          || (r)->type == READER_TYPE_MMAP)
+
+
+/* Release the mapping of an mmap reader.  */
+static void
+unmap_reader (ksba_reader_t r)
+{
+#ifdef USE_MMAP
+  if (r->u.mem.mapaddr)
+    munmap (r->u.mem.mapaddr, r->u.mem.maplen);
+#endif
+  r->u.mem.mapaddr = NULL;
+  r->u.mem.maplen = 0;
+  r->u.mem.buffer = NULL;
+}
 
 /**
  * ksba_reader_new:
@@ -54,6 +79,7 @@ ksba_reader_new (ksba_reader_t *r_r)
   *r_r = xtrycalloc (1, sizeof **r_r);
   if (!*r_r)
     return gpg_error_from_errno (errno);
+  (*r_r)->alloc_ctx = _ksba_alloc_ctx_current ();
   return 0;
 }
 
@@ -67,8 +93,12 @@ ksba_reader_new (ksba_reader_t *r_r)
 void
 ksba_reader_release (ksba_reader_t r)
 {
+  ksba_alloc_ctx_t actx, prevctx;
+
   if (!r)
     return;
+  actx = r->alloc_ctx;
+  prevctx = _ksba_alloc_ctx_switch (actx);
   if (r->notify_cb)
     {
       void (*notify_fnc)(void*,ksba_reader_t) = r->notify_cb;
@@ -78,8 +108,15 @@ ksba_reader_release (ksba_reader_t r)
     }
   if (r->type == READER_TYPE_MEM)
     xfree (r->u.mem.buffer);
+  else if (r->type == READER_TYPE_MMAP)
+    unmap_reader (r);
   xfree (r->unread.buf);
+  xfree (r->readahead.buf);
+  xfree (r->record.buf);
+  _ksba_ber_decoder_release (r->decoder);
   xfree (r);
+  _ksba_alloc_ctx_restore (prevctx);
+  ksba_alloc_ctx_release (actx);
 }
 
 
@@ -192,6 +229,105 @@ ksba_reader_set_mem (ksba_reader_t r, const void *buffer, size_t length)
 }
 
 
+/**
+ * ksba_reader_set_mmap:
+ * @r: Reader object
+ * @fd: file descriptor of a regular file
+ * @offset: Offset of the first byte to make available
+ * @length: Number of bytes to make available or 0 for all
+ *
+ * Initialize the reader object by mapping @length bytes of the file
+ * described by @fd, starting at @offset, into memory.  If @length is
+ * 0 everything from @offset up to the end of the file is used.  The
+ * reader then behaves like one initialized with ksba_reader_set_mem
+ * but without copying the data; in particular ksba_reader_peek may be
+ * used on it.  The file descriptor is not used after this function
+ * returns and may be closed by the caller.  It is possible to reuse
+ * this reader object with another file if the reader object has
+ * already been initialized using this function.
+ *
+ * If the system does not support memory mapped files
+ * GPG_ERR_NOT_IMPLEMENTED is returned; the caller may then fall back
+ * to ksba_reader_set_fd.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_reader_set_mmap (ksba_reader_t r, int fd,
+                      unsigned long long offset, size_t length)
+{
+#ifdef USE_MMAP
+  struct stat st;
+  long pagesize;
+  size_t delta;
+  void *addr;
+
+  if (!r || fd == -1)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (r->type == READER_TYPE_MMAP)
+    { /* Reuse this reader */
+      unmap_reader (r);
+      r->type = 0;
+    }
+  if (r->type)
+    return gpg_error (GPG_ERR_CONFLICT);
+
+  if (fstat (fd, &st))
+    return gpg_error_from_errno (errno);
+  if (!S_ISREG (st.st_mode))
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (offset > st.st_size)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!length)
+    {
+      if (st.st_size - offset > (size_t)(-1))
+        return gpg_error (GPG_ERR_TOO_LARGE);
+      length = st.st_size - offset;
+    }
+  else if (length > st.st_size - offset)
+    return gpg_error (GPG_ERR_INV_LENGTH);
+
+  /* The offset for mmap needs to be a multiple of the page size.  */
+  pagesize = sysconf (_SC_PAGESIZE);
+  if (pagesize <= 0)
+    pagesize = 4096;
+  delta = offset % pagesize;
+
+  if (length)
+    {
+      addr = mmap (NULL, length + delta, PROT_READ, MAP_PRIVATE,
+                   fd, (off_t)(offset - delta));
+      if (addr == MAP_FAILED)
+        return gpg_error_from_errno (errno);
+#ifdef MADV_SEQUENTIAL
+      madvise (addr, length + delta, MADV_SEQUENTIAL);
+#endif
+      r->u.mem.mapaddr = addr;
+      r->u.mem.maplen = length + delta;
+      r->u.mem.buffer = (unsigned char *)addr + delta;
+    }
+  else /* mmap does not allow a length of zero.  */
+    {
+      r->u.mem.mapaddr = NULL;
+      r->u.mem.maplen = 0;
+      r->u.mem.buffer = NULL;
+    }
+  r->u.mem.size = length;
+  r->u.mem.readpos = 0;
+  r->type = READER_TYPE_MMAP;
+  r->eof = 0;
+
+  return 0;
+#else /*!USE_MMAP*/
+  (void)offset;
+  (void)length;
+  if (!r || fd == -1)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  return gpg_error (GPG_ERR_NOT_IMPLEMENTED);
+#endif /*!USE_MMAP*/
+}
+
+
 /**
  * ksba_reader_set_fd:
  * @r: Reader object
@@ -243,6 +379,61 @@ ksba_reader_set_file (ksba_reader_t r, FILE *fp)
 
 
 
+/**
+ * ksba_reader_set_buffer_size:
+ * @r: Reader object
+ * @size: Size of the read-ahead buffer or 0 to disable it
+ *
+ * Enable a read-ahead buffer of @size bytes for a reader initialized
+ * with ksba_reader_set_fd or ksba_reader_set_cb.  Small reads as
+ * done by the parsers are then served from this buffer which is
+ * refilled in large blocks; this greatly reduces the number of
+ * system calls or callback invocations.  Note that the reader will
+ * then consume data from the file descriptor or callback beyond the
+ * last object read.  By default no read-ahead buffer is used.  The
+ * function may be called at any time as long as @size is large
+ * enough to hold the currently buffered data.  The values returned
+ * by ksba_reader_tell and the behaviour of ksba_reader_unread are not
+ * affected by the buffer.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_reader_set_buffer_size (ksba_reader_t r, size_t size)
+{
+  unsigned char *buf;
+  size_t n;
+
+  if (!r)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (r->type != READER_TYPE_FD && r->type != READER_TYPE_CB)
+    return gpg_error (GPG_ERR_NOT_IMPLEMENTED);
+
+  n = r->readahead.length - r->readahead.readpos;
+  if (size < n)
+    return gpg_error (GPG_ERR_CONFLICT);
+
+  if (!size)
+    buf = NULL;
+  else
+    {
+      buf = xtrymalloc (size);
+      if (!buf)
+        return gpg_error_from_errno (errno);
+      if (n)
+        memcpy (buf, r->readahead.buf + r->readahead.readpos, n);
+    }
+  xfree (r->readahead.buf);
+  r->readahead.buf = buf;
+  r->readahead.size = size;
+  r->readahead.length = n;
+  r->readahead.readpos = 0;
+
+  return 0;
+}
+
+
+
 /**
  * ksba_reader_set_cb:
  * @r: Reader object
@@ -285,28 +476,169 @@ ksba_reader_set_cb (ksba_reader_t r,
 }
 
 
-/**
- * ksba_reader_read:
- * @r: Readder object
- * @buffer: A buffer for returning the data
- * @length: The length of this buffer
- * @nread:  Number of bytes actually read.
- *
- * Read data from the current read position to the supplied @buffer,
- * max. @length bytes are read and the actual number of bytes read are
- * returned in @nread.  If there are no more bytes available %GPG_ERR_EOF is
- * returned and @nread is set to 0.
- *
- * If a @buffer of NULL is specified, the function does only return
- * the number of bytes available and does not move the read pointer.
- * This does only work for objects initialized from memory; if the
- * object is not capable of this it will return the error
- * GPG_ERR_NOT_IMPLEMENTED
- *
- * Return value: 0 on success, GPG_ERR_EOF or another error code
- **/
-gpg_error_t
-ksba_reader_read (ksba_reader_t r, char *buffer, size_t length, size_t *nread)
+/* Read up to LENGTH bytes directly from the FD or callback of
+   reader R.  The caller needs to update R->NREAD.  */
+static gpg_error_t
+read_raw (ksba_reader_t r, char *buffer, size_t length, size_t *nread)
+{
+  gpg_error_t err;
+
+  *nread = 0;
+
+  if (r->type == READER_TYPE_CB)
+    {
+      if (r->eof)
+        return gpg_error (GPG_ERR_EOF);
+
+      err = r->u.cb.fnc (r->u.cb.value, buffer, length, nread);
+      if (r->nonblocking
+          && ((err && gpg_err_code (err) == GPG_ERR_EAGAIN)
+              || (!err && length && !*nread)))
+        {
+          *nread = 0;
+          r->would_block = 1;
+          return gpg_error (GPG_ERR_EAGAIN);
+        }
+      if (err)
+        {
+          *nread = 0;
+          r->eof = 1;
+          return gpg_error (GPG_ERR_EOF);
+        }
+    }
+  else if (r->type == READER_TYPE_FD)
+    {
+      ssize_t n;
+
+      if (r->eof)
+        return gpg_error (GPG_ERR_EOF);
+
+      if (!length)
+        return 0;
+
+      n = read (r->u.fd, buffer, length);
+      if (n > 0)
+        *nread = n;
+      else if (n < 0)
+        {
+          if (r->nonblocking && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+              r->would_block = 1;
+              return gpg_error (GPG_ERR_EAGAIN);
+            }
+          r->error = errno;
+          return gpg_error_from_errno (errno);
+        }
+      else
+        {
+          r->eof = 1;
+          return gpg_error (GPG_ERR_EOF);
+        }
+    }
+  else
+    return gpg_error (GPG_ERR_BUG);
+
+  return 0;
+}
+
+
+/* Refill the read-ahead buffer of R if it is empty.  */
+static gpg_error_t
+fill_readahead (ksba_reader_t r)
+{
+  gpg_error_t err;
+  size_t n;
+
+  if (r->readahead.readpos < r->readahead.length)
+    return 0;
+  r->readahead.readpos = r->readahead.length = 0;
+  err = read_raw (r, (char*)r->readahead.buf, r->readahead.size, &n);
+  if (err)
+    return err;
+  r->readahead.length = n;
+  return 0;
+}
+
+
+/* Read up to LENGTH bytes from the FD or callback of reader R using
+   the read-ahead buffer.  Requests which are at least as large as
+   the buffer are passed through once the buffer has been drained.
+   The caller needs to update R->NREAD.  */
+static gpg_error_t
+read_buffered (ksba_reader_t r, char *buffer, size_t length, size_t *nread)
+{
+  gpg_error_t err;
+  size_t nbytes;
+
+  *nread = 0;
+  if (!length)
+    return 0;
+
+  if (r->readahead.readpos == r->readahead.length)
+    {
+      if (length >= r->readahead.size)
+        return read_raw (r, buffer, length, nread);
+      err = fill_readahead (r);
+      if (err)
+        return err;
+    }
+
+  nbytes = r->readahead.length - r->readahead.readpos;
+  if (nbytes > length)
+    nbytes = length;
+  memcpy (buffer, r->readahead.buf + r->readahead.readpos, nbytes);
+  r->readahead.readpos += nbytes;
+  *nread = nbytes;
+  return 0;
+}
+
+
+/* Append LENGTH bytes from BUFFER to the recording of R.  */
+static gpg_error_t
+record_bytes (ksba_reader_t r, const void *buffer, size_t length)
+{
+  if (r->record.length + length > r->record.size)
+    {
+      unsigned char *tmp;
+      size_t newsize = 2 * r->record.size;
+
+      if (newsize < r->record.length + length + 256)
+        newsize = r->record.length + length + 256;
+      tmp = xtryrealloc (r->record.buf, newsize);
+      if (!tmp)
+        return gpg_error_from_errno (errno);
+      r->record.buf = tmp;
+      r->record.size = newsize;
+    }
+  memcpy (r->record.buf + r->record.length, buffer, length);
+  r->record.length += length;
+  return 0;
+}
+
+
+#ifdef ENABLE_STATS
+/* Account for COUNT bytes read from R.  */
+static void
+count_read (ksba_reader_t r, size_t count)
+{
+  switch (r->type)
+    {
+    case READER_TYPE_MEM:
+    case READER_TYPE_MMAP: STATS_ADD (read_mem, count); break;
+    case READER_TYPE_FD:   STATS_ADD (read_fd, count); break;
+    case READER_TYPE_FILE: STATS_ADD (read_file, count); break;
+    case READER_TYPE_CB:   STATS_ADD (read_cb, count); break;
+    default: break;
+    }
+}
+#else
+# define count_read(r,n) do { } while (0)
+#endif
+
+
+/* The actual read function; see ksba_reader_read.  */
+static gpg_error_t
+do_read (ksba_reader_t r, char *buffer, size_t length, size_t *nread)
 {
   size_t nbytes;
 
@@ -316,7 +648,7 @@ ksba_reader_read (ksba_reader_t r, char *buffer, size_t length, size_t *nread)
 
   if (!buffer)
     {
-      if (r->type != READER_TYPE_MEM)
+      if (!IS_MEM_READER (r))
         return gpg_error (GPG_ERR_NOT_IMPLEMENTED);
       *nread = r->u.mem.size - r->u.mem.readpos;
       if (r->unread.buf)
@@ -349,7 +681,7 @@ ksba_reader_read (ksba_reader_t r, char *buffer, size_t length, size_t *nread)
       r->eof = 1;
       return gpg_error (GPG_ERR_EOF);
     }
-  else if (r->type == READER_TYPE_MEM)
+  else if (IS_MEM_READER (r))
     {
       nbytes = r->u.mem.size - r->u.mem.readpos;
       if (!nbytes)
@@ -395,63 +727,217 @@ ksba_reader_read (ksba_reader_t r, char *buffer, size_t length, size_t *nread)
             return gpg_error (GPG_ERR_EOF);
         }
     }
-  else if (r->type == READER_TYPE_CB)
+  else if (r->type == READER_TYPE_CB || r->type == READER_TYPE_FD)
     {
-      if (r->eof)
-        return gpg_error (GPG_ERR_EOF);
+      gpg_error_t err;
 
-      if (r->u.cb.fnc (r->u.cb.value, buffer, length, nread))
-        {
-          *nread = 0;
-          r->eof = 1;
-          return gpg_error (GPG_ERR_EOF);
-        }
+      if (r->readahead.size)
+        err = read_buffered (r, buffer, length, nread);
+      else
+        err = read_raw (r, buffer, length, nread);
+      if (err)
+        return err;
       r->nread += *nread;
     }
-  else if (r->type == READER_TYPE_FD)
+  else
+    return gpg_error (GPG_ERR_BUG);
+
+  return 0;
+}
+
+/**
+ * ksba_reader_read:
+ * @r: Readder object
+ * @buffer: A buffer for returning the data
+ * @length: The length of this buffer
+ * @nread:  Number of bytes actually read.
+ *
+ * Read data from the current read position to the supplied @buffer,
+ * max. @length bytes are read and the actual number of bytes read are
+ * returned in @nread.  If there are no more bytes available %GPG_ERR_EOF is
+ * returned and @nread is set to 0.
+ *
+ * If a @buffer of NULL is specified, the function does only return
+ * the number of bytes available and does not move the read pointer.
+ * This does only work for objects initialized from memory; if the
+ * object is not capable of this it will return the error
+ * GPG_ERR_NOT_IMPLEMENTED
+ *
+ * Return value: 0 on success, GPG_ERR_EOF or another error code
+ **/
+gpg_error_t
+ksba_reader_read (ksba_reader_t r, char *buffer, size_t length, size_t *nread)
+{
+  gpg_error_t err;
+
+  err = do_read (r, buffer, length, nread);
+  if (!err && buffer)
+    count_read (r, *nread);
+  if (!err && buffer && *nread && r->record.active)
+    err = record_bytes (r, buffer, *nread);
+  return err;
+}
+
+/**
+ * ksba_reader_peek:
+ * @r: Reader object
+ * @r_buffer: Returns a pointer to the data
+ * @r_length: Returns the number of bytes available at @r_buffer
+ *
+ * Return a pointer to the data at the current read position without
+ * copying it and without moving the read pointer.  At least one byte
+ * is returned on success; the caller may then use
+ * ksba_reader_consume to advance the read pointer by up to @r_length
+ * bytes.  The returned data is only valid until the next call of
+ * another reader function.  Note that the returned length may be
+ * less than the total number of bytes available; to get more data
+ * the caller needs to consume the returned bytes and call this
+ * function again.
+ *
+ * This does only work for objects initialized from memory or by
+ * ksba_reader_set_mmap and for file descriptor and callback based
+ * objects with a read-ahead buffer (see ksba_reader_set_buffer_size);
+ * if the object is not capable of this it will return the error
+ * GPG_ERR_NOT_IMPLEMENTED and the caller should fall back to
+ * ksba_reader_read.  GPG_ERR_EAGAIN is returned if a callback does
+ * currently not deliver any data.
+ *
+ * Return value: 0 on success, GPG_ERR_EOF or another error code
+ **/
+gpg_error_t
+ksba_reader_peek (ksba_reader_t r,
+                  const unsigned char **r_buffer, size_t *r_length)
+{
+  if (!r || !r_buffer || !r_length)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  *r_buffer = NULL;
+  *r_length = 0;
+
+  if (r->unread.buf && r->unread.length)
     {
-      ssize_t n;
+      *r_length = r->unread.length - r->unread.readpos;
+      if (!*r_length)
+        return gpg_error (GPG_ERR_BUG);
+      *r_buffer = r->unread.buf + r->unread.readpos;
+      return 0;
+    }
 
-      if (r->eof)
-        return gpg_error (GPG_ERR_EOF);
+  if ((r->type == READER_TYPE_FD || r->type == READER_TYPE_CB)
+      && r->readahead.size)
+    {
+      gpg_error_t err = fill_readahead (r);
+      if (err)
+        return err;
+      *r_length = r->readahead.length - r->readahead.readpos;
+      if (!*r_length)
+        return gpg_error (GPG_ERR_EAGAIN);
+      *r_buffer = r->readahead.buf + r->readahead.readpos;
+      return 0;
+    }
 
-      if (!length)
-        {
-          *nread = 0;
-          return 0;
-        }
+  if (!IS_MEM_READER (r))
+    return gpg_error (GPG_ERR_NOT_IMPLEMENTED);
 
-      n = read (r->u.fd, buffer, length);
-      if (n > 0)
-        {
-          r->nread += n;
-          *nread = n;
-        }
-      else
-        {
-          *nread = 0;
+  *r_length = r->u.mem.size - r->u.mem.readpos;
+  if (!*r_length)
+    {
+      r->eof = 1;
+      return gpg_error (GPG_ERR_EOF);
+    }
+  *r_buffer = r->u.mem.buffer + r->u.mem.readpos;
+  return 0;
+}
 
-          if (n < 0)
-            {
-              r->error = errno;
-              return gpg_error_from_errno (errno);
-            }
-          else
-            {
-              r->eof = 1;
-              return gpg_error (GPG_ERR_EOF);
-            }
-        }
+
+/**
+ * ksba_reader_consume:
+ * @r: Reader object
+ * @count: Number of bytes to skip
+ *
+ * Advance the read pointer by @count bytes.  This is to be used after
+ * ksba_reader_peek; @count may not be larger than the length returned
+ * by the last call to that function.
+ *
+ * Return value: 0 on success or an error code
+ **/
+gpg_error_t
+ksba_reader_consume (ksba_reader_t r, size_t count)
+{
+  gpg_error_t err;
+  size_t nbytes;
+  const unsigned char *p;
+
+  if (!r)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!count)
+    return 0;
+
+  if (r->unread.buf && r->unread.length)
+    {
+      nbytes = r->unread.length - r->unread.readpos;
+      p = r->unread.buf + r->unread.readpos;
+    }
+  else if (IS_MEM_READER (r))
+    {
+      nbytes = r->u.mem.size - r->u.mem.readpos;
+      p = r->u.mem.buffer + r->u.mem.readpos;
+    }
+  else if ((r->type == READER_TYPE_FD || r->type == READER_TYPE_CB)
+           && r->readahead.size)
+    {
+      nbytes = r->readahead.length - r->readahead.readpos;
+      p = r->readahead.buf + r->readahead.readpos;
     }
   else
-    return gpg_error (GPG_ERR_BUG);
+    return gpg_error (GPG_ERR_NOT_IMPLEMENTED);
+
+  if (count > nbytes)
+    return gpg_error (GPG_ERR_INV_LENGTH);
+  if (r->record.active)
+    {
+      err = record_bytes (r, p, count);
+      if (err)
+        return err;
+    }
+
+  if (r->unread.buf && r->unread.length)
+    {
+      r->unread.readpos += count;
+      if (r->unread.readpos == r->unread.length)
+        r->unread.readpos = r->unread.length = 0;
+    }
+  else if (IS_MEM_READER (r))
+    r->u.mem.readpos += count;
+  else
+    r->readahead.readpos += count;
 
+  r->nread += count;
+  count_read (r, count);
   return 0;
 }
 
+
+/**
+ * ksba_reader_unread:
+ * @r: Reader object
+ * @buffer: The data to push back
+ * @count: The length of this data
+ *
+ * Push back @count bytes from @buffer so that they will be returned
+ * by the next read operations.  Bytes pushed back by a later call
+ * are returned first.  Not more bytes than have been read may be
+ * pushed back.  If the data is the same as the data most
+ * recently read from a memory, mmap or buffered reader, only the read
+ * pointer is moved back.
+ *
+ * Return value: 0 on success or an error code
+ **/
 gpg_error_t
 ksba_reader_unread (ksba_reader_t r, const void *buffer, size_t count)
 {
+  size_t n;
+
   if (!r || !buffer)
     return gpg_error (GPG_ERR_INV_VALUE);
   if (!count)
@@ -462,25 +948,234 @@ ksba_reader_unread (ksba_reader_t r, const void *buffer, size_t count)
   if (r->nread < count)
     return gpg_error (GPG_ERR_CONFLICT);
 
-  if (!r->unread.buf)
+  if (r->record.active)
     {
-      r->unread.size = count + 100;
-      r->unread.buf = xtrymalloc (r->unread.size);
-      if (!r->unread.buf)
-        return gpg_error (GPG_ERR_ENOMEM);
-      r->unread.length = count;
+      /* The pushed back bytes will be read and thus recorded again.  */
+      if (r->record.length >= count)
+        r->record.length -= count;
+      else
+        r->record.broken = 1;
+    }
+
+  if (!r->unread.length)
+    {
+      /* If the bytes are still in our buffer we only need to move
+         the read pointer back.  */
+      if (IS_MEM_READER (r)
+          && r->u.mem.readpos >= count
+          && !memcmp (r->u.mem.buffer + r->u.mem.readpos - count,
+                      buffer, count))
+        {
+          r->u.mem.readpos -= count;
+          r->nread -= count;
+          r->eof = 0;
+          return 0;
+        }
+      if ((r->type == READER_TYPE_FD || r->type == READER_TYPE_CB)
+          && r->readahead.readpos >= count
+          && !memcmp (r->readahead.buf + r->readahead.readpos - count,
+                      buffer, count))
+        {
+          r->readahead.readpos -= count;
+          r->nread -= count;
+          return 0;
+        }
       r->unread.readpos = 0;
-      memcpy (r->unread.buf, buffer, count);
-      r->nread -= count;
     }
-  else if (r->unread.length + count < r->unread.size)
+
+  n = r->unread.length - r->unread.readpos;
+  if (n && r->unread.readpos >= count)
     {
-      memcpy (r->unread.buf+r->unread.length, buffer, count);
-      r->unread.length += count;
-      r->nread -= count;
+      /* The bytes fit in front of the pending bytes.  */
+      r->unread.readpos -= count;
+      memcpy (r->unread.buf + r->unread.readpos, buffer, count);
     }
   else
-    return gpg_error (GPG_ERR_NOT_IMPLEMENTED); /* fixme: easy to do */
+    {
+      if (n + count > r->unread.size)
+        {
+          unsigned char *tmp;
+          size_t newsize = 2 * r->unread.size;
+
+          if (newsize < n + count + 100)
+            newsize = n + count + 100;
+          tmp = xtryrealloc (r->unread.buf, newsize);
+          if (!tmp)
+            return gpg_error (GPG_ERR_ENOMEM);
+          r->unread.buf = tmp;
+          r->unread.size = newsize;
+        }
+      /* Pushed back bytes go in front of the pending bytes.  */
+      if (n)
+        memmove (r->unread.buf + count, r->unread.buf + r->unread.readpos, n);
+      memcpy (r->unread.buf, buffer, count);
+      r->unread.readpos = 0;
+      r->unread.length = n + count;
+    }
+  r->nread -= count;
+
+  return 0;
+}
+
+
+/**
+ * ksba_reader_set_nonblocking:
+ * @r: Reader object
+ * @yes: Enable or disable non-blocking mode
+ *
+ * Put a reader initialized with ksba_reader_set_fd or
+ * ksba_reader_set_cb into non-blocking mode.  In this mode a file
+ * descriptor returning EAGAIN or EWOULDBLOCK and a callback returning
+ * %GPG_ERR_EAGAIN or no data does not lead to an error or EOF.
+ * Instead the read functions return %GPG_ERR_EAGAIN and
+ * ksba_crl_parse and ksba_cms_parse return with the stop reason
+ * %KSBA_SR_WOULD_BLOCK.  Those functions may then be called again
+ * once more data is available; they continue where they stopped.
+ *
+ * Return value: 0 on success or an error code
+ **/
+gpg_error_t
+ksba_reader_set_nonblocking (ksba_reader_t r, int yes)
+{
+  if (!r)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (r->type != READER_TYPE_FD && r->type != READER_TYPE_CB)
+    return gpg_error (GPG_ERR_NOT_IMPLEMENTED);
+  r->nonblocking = !!yes;
+  return 0;
+}
+
+
+/* Set a mark at the current read position of a non-blocking reader
+   R.  All bytes read after the mark are recorded so that the reader
+   can be set back to the mark with _ksba_reader_rewind.  Returns
+   true if a mark has been set; false if the reader is blocking and
+   thus no mark is required.  */
+int
+_ksba_reader_mark (ksba_reader_t r)
+{
+  r->record.active = 0;
+  r->would_block = 0;
+  if (!r->nonblocking)
+    return 0;
+
+  r->record.active = 1;
+  r->record.broken = 0;
+  r->record.length = 0;
+  r->record.nread = r->nread;
+  return 1;
+}
 
+
+/* Set the reader R back to the last mark and remove the mark.  */
+gpg_error_t
+_ksba_reader_rewind (ksba_reader_t r)
+{
+  unsigned char *buf;
+  size_t n, size;
+
+  if (!r->record.active || r->record.broken)
+    {
+      _ksba_reader_unmark (r);
+      return gpg_error (GPG_ERR_INV_STATE);
+    }
+  r->record.active = 0;
+
+  if (r->record.length)
+    {
+      /* Put the recorded bytes in front of pending unread bytes.  */
+      n = r->unread.length - r->unread.readpos;
+      size = r->record.length + n + 100;
+      buf = xtrymalloc (size);
+      if (!buf)
+        return gpg_error_from_errno (errno);
+      memcpy (buf, r->record.buf, r->record.length);
+      if (n)
+        memcpy (buf + r->record.length, r->unread.buf + r->unread.readpos, n);
+      xfree (r->unread.buf);
+      r->unread.buf = buf;
+      r->unread.size = size;
+      r->unread.length = r->record.length + n;
+      r->unread.readpos = 0;
+    }
+  r->record.length = 0;
+  r->nread = r->record.nread;
+  r->eof = 0;
   return 0;
 }
+
+
+/* Remove the mark from R.  */
+void
+_ksba_reader_unmark (ksba_reader_t r)
+{
+  r->record.active = 0;
+  r->record.length = 0;
+}
+
+
+/* Return true if a read on R would have blocked since the last
+   mark.  */
+int
+_ksba_reader_would_block (ksba_reader_t r)
+{
+  return r->would_block;
+}
+
+
+/* If R reads from memory store the start of that memory at R_BUFFER
+   and the number of bytes already taken from it at R_USED and return
+   true.  The memory stays valid and unchanged as long as R is not
+   set to a different source.  Returns false for all other readers.  */
+int
+_ksba_reader_get_mem (ksba_reader_t r,
+                      const unsigned char **r_buffer, size_t *r_used)
+{
+  if (!IS_MEM_READER (r))
+    return 0;
+  *r_buffer = r->u.mem.buffer;
+  *r_used = r->u.mem.readpos;
+  return 1;
+}
+
+
+/* Return a BER decoder set up to read from R.  A decoder used before
+   with R is reused so that its allocations are amortized over a
+   stream of objects.  The caller needs to return the decoder using
+   _ksba_reader_put_decoder.  Returns NULL on error.  */
+BerDecoder
+_ksba_reader_get_decoder (ksba_reader_t r)
+{
+  BerDecoder d;
+
+  if (r->decoder)
+    {
+      d = r->decoder;
+      r->decoder = NULL;
+    }
+  else if (!(d = _ksba_ber_decoder_new ()))
+    return NULL;
+
+  if (_ksba_ber_decoder_set_reader (d, r))
+    {
+      _ksba_ber_decoder_release (d);
+      return NULL;
+    }
+  return d;
+}
+
+
+/* Give the decoder D obtained by _ksba_reader_get_decoder back to R.  */
+void
+_ksba_reader_put_decoder (ksba_reader_t r, BerDecoder d)
+{
+  if (!d)
+    return;
+  if (r->decoder)
+    _ksba_ber_decoder_release (d);
+  else
+    {
+      _ksba_ber_decoder_reset (d);
+      r->decoder = d;
+    }
+}
@@ -38,11 +38,13 @@ enum reader_type {
   READER_TYPE_MEM,
   READER_TYPE_FD,
   READER_TYPE_FILE,
-  READER_TYPE_CB
+  READER_TYPE_CB,
+  READER_TYPE_MMAP
 };
 
 
 struct ksba_reader_s {
+  ksba_alloc_ctx_t alloc_ctx;  /* The allocator context or NULL.  */
   int eof;
   int error;   /* If an error occured, takes the value of errno. */
   unsigned long nread;
@@ -52,13 +54,21 @@ struct ksba_reader_s {
     size_t length;  /* used size */
     size_t readpos; /* offset where to start the next read */
   } unread;
+  struct {
+    unsigned char *buf;
+    size_t size;    /* allocated size; 0 if read-ahead is disabled */
+    size_t length;  /* used size */
+    size_t readpos; /* offset where to start the next read */
+  } readahead;      /* for READER_TYPE_FD and READER_TYPE_CB */
   enum reader_type type;
   union {
     struct {
       unsigned char *buffer;
       size_t size;
       size_t readpos;
-    } mem;   /* for READER_TYPE_MEM */
+      void *mapaddr;  /* Start of the mapping (READER_TYPE_MMAP).  */
+      size_t maplen;  /* Length of the mapping (READER_TYPE_MMAP).  */
+    } mem;   /* for READER_TYPE_MEM and READER_TYPE_MMAP */
     int fd;  /* for READER_TYPE_FD */
     FILE *file; /* for READER_TYPE_FILE */
     struct {
@@ -68,9 +78,33 @@ struct ksba_reader_s {
   } u;
   void (*notify_cb)(void*,ksba_reader_t);
   void *notify_cb_value;
+
+  int nonblocking;  /* Report GPG_ERR_EAGAIN instead of blocking.  */
+  int would_block;  /* A read returned GPG_ERR_EAGAIN since the mark.  */
+  struct {
+    int active;     /* A mark has been set.  */
+    int broken;     /* More bytes have been unread than recorded.  */
+    unsigned long nread; /* Value of NREAD at the mark.  */
+    unsigned char *buf;  /* The bytes read since the mark.  */
+    size_t size;
+    size_t length;
+  } record;
+
+  struct ber_decoder_s *decoder;  /* A cached decoder or NULL.  */
 };
 
 
+/*-- reader.c --*/
+int  _ksba_reader_mark (ksba_reader_t r);
+gpg_error_t _ksba_reader_rewind (ksba_reader_t r);
+void _ksba_reader_unmark (ksba_reader_t r);
+int  _ksba_reader_would_block (ksba_reader_t r);
+int  _ksba_reader_get_mem (ksba_reader_t r,
+                           const unsigned char **r_buffer, size_t *r_used);
+struct ber_decoder_s *_ksba_reader_get_decoder (ksba_reader_t r);
+void _ksba_reader_put_decoder (ksba_reader_t r, struct ber_decoder_s *d);
+
+
 
 
 #endif /*READER_H*/
@@ -147,6 +147,57 @@ _ksba_cmp_time (const ksba_isotime_t a, const ksba_isotime_t b)
   return strcmp (a, b);
 }
 
+/* Convert the ISO time ATIME to the number of seconds since the
+   Epoch and store it at R_EPOCH.  The fields are not range checked;
+   ATIME is expected to come from _ksba_asntime_to_iso.  */
+gpg_error_t
+_ksba_isotime_to_epoch (const ksba_isotime_t atime, ksba_epoch_t *r_epoch)
+{
+  gpg_error_t err;
+  long long year, month, day, era, yoe, doy, doe;
+
+  *r_epoch = 0;
+  err = _ksba_assert_time_format (atime);
+  if (err)
+    return gpg_err_code (err) == GPG_ERR_BUG? gpg_error (GPG_ERR_INV_TIME)
+                                            : err;
+
+  /* Count the days with the year starting in March so that the leap
+     day is the last one of a year; an era has 400 years.  */
+  year = atoi_4 (atime);
+  month = atoi_2 (atime+4);
+  day = atoi_2 (atime+6);
+  if (month <= 2)
+    year--;
+  era = (year >= 0? year : year - 399) / 400;
+  yoe = year - era * 400;
+  doy = (153 * (month > 2? month - 3 : month + 9) + 2) / 5 + day - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  day = era * 146097 + doe - 719468;
+
+  *r_epoch = (day * 86400 + atoi_2 (atime+9) * 3600
+              + atoi_2 (atime+11) * 60 + atoi_2 (atime+13));
+  return 0;
+}
+
+
+/* Convert an UTCTime or GeneralizedTime to the number of seconds
+   since the Epoch.  See _ksba_asntime_to_iso for the arguments.  */
+gpg_error_t
+_ksba_asntime_to_epoch (const char *buffer, size_t length, int is_utctime,
+                        ksba_epoch_t *r_epoch)
+{
+  gpg_error_t err;
+  ksba_isotime_t timebuf;
+
+  *r_epoch = 0;
+  err = _ksba_asntime_to_iso (buffer, length, is_utctime, timebuf);
+  if (!err)
+    err = _ksba_isotime_to_epoch (timebuf, r_epoch);
+  return err;
+}
+
+
 /* Fill the TIMEBUF with the current time (UTC of course). */
 int
 _ksba_current_time (ksba_isotime_t timebuf)
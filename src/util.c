@@ -34,6 +34,7 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <time.h>
 
 #include "util.h"
 
@@ -47,6 +48,27 @@ static gpg_error_t (*hash_buffer_fnc)(void *arg, const char *oid,
 static void *hash_buffer_fnc_arg;
 
 
+/* An allocator context.  */
+struct ksba_alloc_ctx_s
+{
+  int refcount;
+  void *(*alloc_func)(void *opaque, size_t n);
+  void *(*realloc_func)(void *opaque, void *p, size_t n);
+  void (*free_func)(void *opaque, void *p);
+  void *opaque;
+};
+
+/* The allocator context of the current thread or NULL to use the
+   global functions.  The thread holds a reference to it.  Without
+   support for thread local storage allocator contexts can't be
+   created and this is always NULL.  */
+#ifdef HAVE_THREAD_LOCAL
+static __thread ksba_alloc_ctx_t current_alloc_ctx;
+#else
+static ksba_alloc_ctx_t current_alloc_ctx;
+#endif
+
+
 
 /* Note, that we expect that the free fucntion does not change
    ERRNO. */
@@ -61,6 +83,222 @@ ksba_set_malloc_hooks ( void *(*new_alloc_func)(size_t n),
 }
 
 
+/* Create a new allocator context and store it at R_CTX.  While the
+   context is entered using ksba_alloc_ctx_enter, all allocations of
+   the calling thread are done by calling ALLOC_FUNC, REALLOC_FUNC,
+   and FREE_FUNC with OPAQUE as first argument.  Thus for example all
+   ASN.1 nodes, S-expressions, and strings created while parsing one
+   request can be taken from an arena and released at once.
+
+   Reader, certificate, CRL, CMS, and OCSP objects take the context
+   entered at their creation.  Their release functions use that
+   context regardless of the context entered at that time.  All other
+   functions of such an object should only be called while its
+   context is entered and memory returned by them needs to be
+   released with the context entered.  The context is kept until
+   ksba_alloc_ctx_release has been called, all objects using it have
+   been released, and no thread has it entered anymore.
+
+   Allocator contexts require thread local storage; if the library
+   has been built without it GPG_ERR_NOT_SUPPORTED is returned.  */
+gpg_error_t
+ksba_alloc_ctx_new (ksba_alloc_ctx_t *r_ctx,
+                    void *(*new_alloc_func)(void *opaque, size_t n),
+                    void *(*new_realloc_func)(void *opaque, void *p, size_t n),
+                    void (*new_free_func)(void *opaque, void *p),
+                    void *opaque)
+{
+  ksba_alloc_ctx_t ctx;
+
+  if (!r_ctx)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_ctx = NULL;
+  if (!new_alloc_func || !new_realloc_func || !new_free_func)
+    return gpg_error (GPG_ERR_INV_VALUE);
+#ifndef HAVE_THREAD_LOCAL
+  /* A single context for all threads would redirect the allocations
+     of all other threads as well.  */
+  (void)ctx;
+  (void)opaque;
+  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+#else /*HAVE_THREAD_LOCAL*/
+
+  /* The context itself is always taken from the global allocator.  */
+  ctx = alloc_func (sizeof *ctx);
+  if (!ctx)
+    return gpg_error_from_syserror ();
+  ctx->refcount = 1;
+  ctx->alloc_func = new_alloc_func;
+  ctx->realloc_func = new_realloc_func;
+  ctx->free_func = new_free_func;
+  ctx->opaque = opaque;
+  *r_ctx = ctx;
+  return 0;
+#endif /*HAVE_THREAD_LOCAL*/
+}
+
+
+/* Release a reference to the allocator context CTX.  */
+void
+ksba_alloc_ctx_release (ksba_alloc_ctx_t ctx)
+{
+  if (!ctx)
+    return;
+  if (atomic_add_fetch (&ctx->refcount, -1))
+    return;
+  free_func (ctx);
+}
+
+
+/* Make CTX the allocator context of the calling thread and return the
+   previous one.  Passing NULL switches back to the global allocation
+   functions; thus the scope of a context is usually ended by passing
+   the returned value to this function again.  While a context is
+   entered the thread holds a reference to it, so that it may be
+   released by another thread in the meantime.  The returned context
+   is only valid as long as the caller holds its own reference.  */
+ksba_alloc_ctx_t
+ksba_alloc_ctx_enter (ksba_alloc_ctx_t ctx)
+{
+  ksba_alloc_ctx_t prev = current_alloc_ctx;
+
+  if (ctx)
+    atomic_add_fetch (&ctx->refcount, 1);
+  current_alloc_ctx = ctx;
+  ksba_alloc_ctx_release (prev);
+  return prev;
+}
+
+
+/* Return a new reference to the allocator context of the calling
+   thread or NULL if none has been entered.  The reference is to be
+   released using ksba_alloc_ctx_release.  */
+ksba_alloc_ctx_t
+_ksba_alloc_ctx_current (void)
+{
+  ksba_alloc_ctx_t ctx = current_alloc_ctx;
+
+  if (ctx)
+    atomic_add_fetch (&ctx->refcount, 1);
+  return ctx;
+}
+
+
+/* Enter the allocator context CTX and return a new reference to the
+   previous one.  Unlike ksba_alloc_ctx_enter this keeps the previous
+   context alive until it is restored using _ksba_alloc_ctx_restore.
+   Internal code uses this to switch to the context of an object or,
+   with CTX passed as NULL, to the global functions for data which
+   outlives the current context.  */
+ksba_alloc_ctx_t
+_ksba_alloc_ctx_switch (ksba_alloc_ctx_t ctx)
+{
+  ksba_alloc_ctx_t prev = _ksba_alloc_ctx_current ();
+
+  ksba_alloc_ctx_enter (ctx);
+  return prev;
+}
+
+
+/* Enter the context PREV returned by _ksba_alloc_ctx_switch again
+   and release the reference.  */
+void
+_ksba_alloc_ctx_restore (ksba_alloc_ctx_t prev)
+{
+  ksba_alloc_ctx_enter (prev);
+  ksba_alloc_ctx_release (prev);
+}
+
+
+
+/* The statistics counters of the calling thread.  Without support
+   for thread local storage there is only one set of counters which
+   is not protected against concurrent updates.  */
+#ifdef ENABLE_STATS
+# ifdef HAVE_THREAD_LOCAL
+__thread struct ksba_stats_s _ksba_stats;
+# else
+struct ksba_stats_s _ksba_stats;
+# endif
+
+static void (*trace_cb)(void *opaque, const char *phase,
+                        int reason, unsigned long long usec);
+static void *trace_cb_value;
+
+/* Return a timestamp in microseconds.  */
+unsigned long long
+_ksba_stats_now (void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  if (!clock_gettime (CLOCK_MONOTONIC, &ts))
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+#endif
+  return time (NULL) * 1000000ULL;
+}
+
+/* Pass a parse phase to the trace callback.  */
+void
+_ksba_stats_trace (const char *phase, int reason)
+{
+  if (trace_cb)
+    trace_cb (trace_cb_value, phase, reason, _ksba_stats_now ());
+}
+#endif /*ENABLE_STATS*/
+
+
+/* Copy the statistics counters of the calling thread to STATS.  The
+   counters are only available if libksba has been configured with
+   --enable-stats; else the counters are cleared and
+   GPG_ERR_NOT_SUPPORTED is returned.  */
+gpg_error_t
+ksba_get_stats (ksba_stats_t stats)
+{
+  if (!stats)
+    return gpg_error (GPG_ERR_INV_VALUE);
+#ifdef ENABLE_STATS
+  *stats = _ksba_stats;
+  return 0;
+#else
+  memset (stats, 0, sizeof *stats);
+  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+#endif
+}
+
+
+/* Clear the statistics counters of the calling thread.  */
+void
+ksba_reset_stats (void)
+{
+#ifdef ENABLE_STATS
+  memset (&_ksba_stats, 0, sizeof _ksba_stats);
+#endif
+}
+
+
+/* Register CB to be called with CB_VALUE for each parse phase.  PHASE
+   is the name of the object type, for example "crl" or "cms", and
+   REASON is the stop reason returned by the parse function.  USEC is
+   a monotonic timestamp in microseconds.  The callback is global and
+   may be called from any thread; it is only called if libksba has
+   been configured with --enable-stats.  Passing NULL for CB removes
+   the callback.  */
+void
+ksba_set_trace_cb (void (*cb)(void *opaque, const char *phase,
+                              int reason, unsigned long long usec),
+                   void *cb_value)
+{
+#ifdef ENABLE_STATS
+  trace_cb = cb;
+  trace_cb_value = cb_value;
+#else
+  (void)cb;
+  (void)cb_value;
+#endif
+}
+
+
 /* Register a has function for general use by libksba.  This is
    required to avoid dependencies to specific low-level
    crypolibraries.  The function should be used right at the startup
@@ -127,6 +365,10 @@ _ksba_hash_buffer (const char *oid, const void *buffer, size_t length,
 void *
 ksba_malloc (size_t n )
 {
+  ksba_alloc_ctx_t ctx = current_alloc_ctx;
+
+  if (ctx)
+    return ctx->alloc_func (ctx->opaque, n);
   return alloc_func (n);
 }
 
@@ -152,6 +394,10 @@ ksba_calloc (size_t n, size_t m )
 void *
 ksba_realloc (void *mem, size_t n)
 {
+  ksba_alloc_ctx_t ctx = current_alloc_ctx;
+
+  if (ctx)
+    return ctx->realloc_func (ctx->opaque, mem, n);
   return realloc_func (mem, n );
 }
 
@@ -218,7 +464,13 @@ _ksba_reallocarray (void *a, size_t oldnmemb, size_t nmemb, size_t size)
 void
 ksba_free ( void *a )
 {
-  if (a)
+  ksba_alloc_ctx_t ctx = current_alloc_ctx;
+
+  if (!a)
+    ;
+  else if (ctx)
+    ctx->free_func (ctx->opaque, a);
+  else
     free_func (a);
 }
 
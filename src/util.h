@@ -96,6 +96,48 @@ char *_ksba_xstrdup (const char *p);
     } while (0)
 
 
+/* Atomic operations for objects shared between threads.  LOAD_ACQ
+   and STORE_REL are used to publish lazily computed values.  Without
+   compiler support these are plain accesses and objects may not be
+   shared.  */
+#ifdef HAVE_ATOMIC_BUILTINS
+# define atomic_add_fetch(p,n) __atomic_add_fetch ((p), (n), __ATOMIC_ACQ_REL)
+# define atomic_load_acq(p)    __atomic_load_n ((p), __ATOMIC_ACQUIRE)
+# define atomic_store_rel(p,v) __atomic_store_n ((p), (v), __ATOMIC_RELEASE)
+#else
+# define atomic_add_fetch(p,n) (*(p) += (n))
+# define atomic_load_acq(p)    (*(p))
+# define atomic_store_rel(p,v) (*(p) = (v))
+#endif
+
+
+/* Objects which take the allocator context at their creation.  */
+ksba_alloc_ctx_t _ksba_alloc_ctx_current (void);
+ksba_alloc_ctx_t _ksba_alloc_ctx_switch (ksba_alloc_ctx_t ctx);
+void _ksba_alloc_ctx_restore (ksba_alloc_ctx_t prev);
+
+
+/* The statistics counters; see ksba_get_stats.  Without ENABLE_STATS
+   the macros expand to nothing.  */
+#ifdef ENABLE_STATS
+# ifdef HAVE_THREAD_LOCAL
+extern __thread struct ksba_stats_s _ksba_stats;
+# else
+extern struct ksba_stats_s _ksba_stats;
+# endif
+unsigned long long _ksba_stats_now (void);
+void _ksba_stats_trace (const char *phase, int reason);
+# define STATS_ADD(field,n)  (_ksba_stats.field += (n))
+# define STATS_NOW()         _ksba_stats_now ()
+# define STATS_TRACE(p,r)    _ksba_stats_trace ((p), (r))
+#else
+# define STATS_ADD(field,n)  do { } while (0)
+# define STATS_NOW()         0
+# define STATS_TRACE(p,r)    do { } while (0)
+#endif
+#define STATS_INC(field)     STATS_ADD (field, 1)
+
+
 #ifndef HAVE_STPCPY
 char *_ksba_stpcpy (char *a, const char *b);
 #define stpcpy(a,b) _ksba_stpcpy ((a), (b))
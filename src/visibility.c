@@ -96,6 +96,49 @@ ksba_free ( void *a )
     _ksba_free (a);
 }
 
+gpg_error_t
+ksba_alloc_ctx_new (ksba_alloc_ctx_t *r_ctx,
+                    void *(*alloc_func)(void *opaque, size_t n),
+                    void *(*realloc_func)(void *opaque, void *p, size_t n),
+                    void (*free_func)(void *opaque, void *p),
+                    void *opaque)
+{
+  return _ksba_alloc_ctx_new (r_ctx, alloc_func, realloc_func, free_func,
+                              opaque);
+}
+
+void
+ksba_alloc_ctx_release (ksba_alloc_ctx_t ctx)
+{
+  _ksba_alloc_ctx_release (ctx);
+}
+
+ksba_alloc_ctx_t
+ksba_alloc_ctx_enter (ksba_alloc_ctx_t ctx)
+{
+  return _ksba_alloc_ctx_enter (ctx);
+}
+
+gpg_error_t
+ksba_get_stats (ksba_stats_t stats)
+{
+  return _ksba_get_stats (stats);
+}
+
+void
+ksba_reset_stats (void)
+{
+  _ksba_reset_stats ();
+}
+
+void
+ksba_set_trace_cb (void (*cb)(void *opaque, const char *phase,
+                              int reason, unsigned long long usec),
+                   void *opaque)
+{
+  _ksba_set_trace_cb (cb, opaque);
+}
+
 
 /*-- cert.c --*/
 gpg_error_t
@@ -137,6 +180,13 @@ ksba_cert_get_user_data (ksba_cert_t cert, const char *key,
 
 
 
+gpg_error_t
+ksba_cert_set_lazy (ksba_cert_t cert, int enable)
+{
+  return _ksba_cert_set_lazy (cert, enable);
+}
+
+
 gpg_error_t
 ksba_cert_read_der (ksba_cert_t cert, ksba_reader_t reader)
 {
@@ -152,6 +202,25 @@ ksba_cert_init_from_mem (ksba_cert_t cert,
 }
 
 
+gpg_error_t
+ksba_cert_init_from_mem_ref (ksba_cert_t cert,
+                             const void *buffer, size_t length,
+                             void (*release_cb) (void *opaque), void *opaque)
+{
+  return _ksba_cert_init_from_mem_ref (cert, buffer, length,
+                                       release_cb, opaque);
+}
+
+
+gpg_error_t
+ksba_cert_read_bundle (ksba_reader_t reader, unsigned int flags,
+                       gpg_error_t (*cb) (void *opaque, ksba_cert_t cert),
+                       void *opaque, unsigned int *r_count)
+{
+  return _ksba_cert_read_bundle (reader, flags, cb, opaque, r_count);
+}
+
+
 const unsigned char *
 ksba_cert_get_image (ksba_cert_t cert, size_t *r_length)
 {
@@ -159,6 +228,31 @@ ksba_cert_get_image (ksba_cert_t cert, size_t *r_length)
 }
 
 
+gpg_error_t
+ksba_cert_get_issuer_dn_ptr (ksba_cert_t cert,
+                             const unsigned char **r_ptr, size_t *r_length)
+{
+  return _ksba_cert_get_issuer_dn_ptr (cert, r_ptr, r_length);
+}
+
+
+gpg_error_t
+ksba_cert_get_subject_dn_ptr (ksba_cert_t cert,
+                              const unsigned char **r_ptr, size_t *r_length)
+{
+  return _ksba_cert_get_subject_dn_ptr (cert, r_ptr, r_length);
+}
+
+
+gpg_error_t
+ksba_cert_get_view (ksba_cert_t cert, ksba_cert_view_t what,
+                    const unsigned char **r_der, size_t *r_derlen,
+                    int *r_tag)
+{
+  return _ksba_cert_get_view (cert, what, r_der, r_derlen, r_tag);
+}
+
+
 gpg_error_t
 ksba_cert_hash (ksba_cert_t cert,
                 int what,
@@ -171,6 +265,23 @@ ksba_cert_hash (ksba_cert_t cert,
 }
 
 
+gpg_error_t
+ksba_cert_get_fingerprint (ksba_cert_t cert, ksba_fpr_part_t what,
+                           const char *algo,
+                           gpg_error_t (*digest_fnc)
+                             (void *arg, const char *algo,
+                              const void *buffer, size_t length,
+                              unsigned char *digest, size_t *r_digestlen),
+                           void *digest_fnc_arg,
+                           const unsigned char **r_digest,
+                           size_t *r_digestlen)
+{
+  return _ksba_cert_get_fingerprint (cert, what, algo,
+                                     digest_fnc, digest_fnc_arg,
+                                     r_digest, r_digestlen);
+}
+
+
 const char *
 ksba_cert_get_digest_algo (ksba_cert_t cert)
 {
@@ -200,6 +311,14 @@ ksba_cert_get_validity (ksba_cert_t cert, int what,
 }
 
 
+gpg_error_t
+ksba_cert_get_validity_epoch (ksba_cert_t cert, int what,
+                              ksba_epoch_t *r_epoch)
+{
+  return _ksba_cert_get_validity_epoch (cert, what, r_epoch);
+}
+
+
 char *
 ksba_cert_get_subject (ksba_cert_t cert, int idx)
 {
@@ -221,6 +340,20 @@ ksba_cert_get_sig_val (ksba_cert_t cert)
 }
 
 
+gpg_error_t
+ksba_cert_get_public_key_desc (ksba_cert_t cert, ksba_keydesc_t desc)
+{
+  return _ksba_cert_get_public_key_desc (cert, desc);
+}
+
+
+gpg_error_t
+ksba_cert_get_sig_val_desc (ksba_cert_t cert, ksba_keydesc_t desc)
+{
+  return _ksba_cert_get_sig_val_desc (cert, desc);
+}
+
+
 
 gpg_error_t
 ksba_cert_get_extension (ksba_cert_t cert, int idx,
@@ -291,6 +424,15 @@ ksba_cert_get_subj_key_id (ksba_cert_t cert,
 }
 
 
+gpg_error_t
+ksba_cert_get_key_ids (ksba_cert_t cert,
+                       const unsigned char **r_ski, size_t *r_skilen,
+                       const unsigned char **r_aki, size_t *r_akilen)
+{
+  return _ksba_cert_get_key_ids (cert, r_ski, r_skilen, r_aki, r_akilen);
+}
+
+
 gpg_error_t
 ksba_cert_get_authority_info_access (ksba_cert_t cert, int idx,
                                      char **r_method,
@@ -310,6 +452,108 @@ ksba_cert_get_subject_info_access (ksba_cert_t cert, int idx,
 }
 
 
+gpg_error_t
+ksba_cert_prepare_verify (ksba_cert_verify_item_t items, size_t nitems,
+                          ksba_certstore_t store)
+{
+  return _ksba_cert_prepare_verify (items, nitems, store);
+}
+
+
+void
+ksba_cert_release_verify (ksba_cert_verify_item_t items, size_t nitems)
+{
+  _ksba_cert_release_verify (items, nitems);
+}
+
+
+/*-- certstore.c --*/
+gpg_error_t
+ksba_certstore_new (ksba_certstore_t *r_store)
+{
+  return _ksba_certstore_new (r_store);
+}
+
+
+void
+ksba_certstore_release (ksba_certstore_t store)
+{
+  _ksba_certstore_release (store);
+}
+
+
+gpg_error_t
+ksba_certstore_add (ksba_certstore_t store, ksba_cert_t cert)
+{
+  return _ksba_certstore_add (store, cert);
+}
+
+
+gpg_error_t
+ksba_certstore_remove (ksba_certstore_t store, ksba_cert_t cert)
+{
+  return _ksba_certstore_remove (store, cert);
+}
+
+
+unsigned int
+ksba_certstore_count (ksba_certstore_t store)
+{
+  return _ksba_certstore_count (store);
+}
+
+
+gpg_error_t
+ksba_certstore_set_limit (ksba_certstore_t store, unsigned int limit)
+{
+  return _ksba_certstore_set_limit (store, limit);
+}
+
+
+gpg_error_t
+ksba_certstore_find_subject (ksba_certstore_t store,
+                             const unsigned char *dn, size_t dnlen,
+                             int idx, ksba_cert_t *r_cert)
+{
+  return _ksba_certstore_find_subject (store, dn, dnlen, idx, r_cert);
+}
+
+
+gpg_error_t
+ksba_certstore_find_issuer (ksba_certstore_t store, ksba_cert_t cert,
+                            int idx, ksba_cert_t *r_cert)
+{
+  return _ksba_certstore_find_issuer (store, cert, idx, r_cert);
+}
+
+
+gpg_error_t
+ksba_certstore_find_serial (ksba_certstore_t store,
+                            const unsigned char *issuer, size_t issuerlen,
+                            const unsigned char *serial, size_t seriallen,
+                            ksba_cert_t *r_cert)
+{
+  return _ksba_certstore_find_serial (store, issuer, issuerlen,
+                                      serial, seriallen, r_cert);
+}
+
+
+gpg_error_t
+ksba_certstore_find_ski (ksba_certstore_t store,
+                         const unsigned char *keyid, size_t keyidlen,
+                         int idx, ksba_cert_t *r_cert)
+{
+  return _ksba_certstore_find_ski (store, keyid, keyidlen, idx, r_cert);
+}
+
+
+gpg_error_t
+ksba_certstore_find_image (ksba_certstore_t store,
+                           const void *image, size_t imagelen,
+                           ksba_cert_t *r_cert)
+{
+  return _ksba_certstore_find_image (store, image, imagelen, r_cert);
+}
 
 
 /*-- cms.c --*/
@@ -343,6 +587,20 @@ ksba_cms_set_reader_writer (ksba_cms_t cms,
 }
 
 
+gpg_error_t
+ksba_cms_set_certstore (ksba_cms_t cms, ksba_certstore_t store)
+{
+  return _ksba_cms_set_certstore (cms, store);
+}
+
+
+gpg_error_t
+ksba_cms_set_cert_cache_limit (unsigned int limit)
+{
+  return _ksba_cms_set_cert_cache_limit (limit);
+}
+
+
 
 gpg_error_t
 ksba_cms_parse (ksba_cms_t cms, ksba_stop_reason_t *r_stopreason)
@@ -441,6 +699,21 @@ ksba_cms_get_sig_val (ksba_cms_t cms, int idx)
 }
 
 
+gpg_error_t
+ksba_cms_get_sig_val_desc (ksba_cms_t cms, int idx, ksba_keydesc_t desc)
+{
+  return _ksba_cms_get_sig_val_desc (cms, idx, desc);
+}
+
+
+gpg_error_t
+ksba_cms_get_signers (ksba_cms_t cms, ksba_cms_signer_t signers,
+                      unsigned int nsigners, unsigned int *r_count)
+{
+  return _ksba_cms_get_signers (cms, signers, nsigners, r_count);
+}
+
+
 ksba_sexp_t
 ksba_cms_get_enc_val (ksba_cms_t cms, int idx)
 {
@@ -448,6 +721,22 @@ ksba_cms_get_enc_val (ksba_cms_t cms, int idx)
 }
 
 
+gpg_error_t
+ksba_cms_get_recipients (ksba_cms_t cms, ksba_cms_recipient_t recps,
+                         unsigned int nrecps, unsigned int *r_count)
+{
+  return _ksba_cms_get_recipients (cms, recps, nrecps, r_count);
+}
+
+
+gpg_error_t
+ksba_cms_find_recipient (ksba_cms_t cms, ksba_certstore_t store, int start,
+                         int *r_idx, ksba_cert_t *r_cert)
+{
+  return _ksba_cms_find_recipient (cms, store, start, r_idx, r_cert);
+}
+
+
 void
 ksba_cms_set_hash_function (ksba_cms_t cms,
                             void (*hash_fnc)(void *, const void *, size_t),
@@ -457,6 +746,15 @@ ksba_cms_set_hash_function (ksba_cms_t cms,
 }
 
 
+gpg_error_t
+ksba_cms_add_hash_function (ksba_cms_t cms,
+                            void (*hash_fnc)(void *, const void *, size_t),
+                            void *hash_fnc_arg)
+{
+  return _ksba_cms_add_hash_function (cms, hash_fnc, hash_fnc_arg);
+}
+
+
 gpg_error_t
 ksba_cms_hash_signed_attrs (ksba_cms_t cms, int idx)
 {
@@ -628,6 +926,13 @@ ksba_crl_get_crl_number (ksba_crl_t crl, ksba_sexp_t *number)
 }
 
 
+gpg_error_t
+ksba_crl_get_delta_base (ksba_crl_t crl, ksba_sexp_t *r_number)
+{
+  return _ksba_crl_get_delta_base (crl, r_number);
+}
+
+
 gpg_error_t
 ksba_crl_get_update_times (ksba_crl_t crl,
                            ksba_isotime_t this_update,
@@ -647,6 +952,20 @@ ksba_crl_get_item (ksba_crl_t crl,
 }
 
 
+gpg_error_t
+ksba_crl_get_update_epoch (ksba_crl_t crl, int what, ksba_epoch_t *r_epoch)
+{
+  return _ksba_crl_get_update_epoch (crl, what, r_epoch);
+}
+
+
+gpg_error_t
+ksba_crl_get_item_epoch (ksba_crl_t crl, ksba_epoch_t *r_epoch)
+{
+  return _ksba_crl_get_item_epoch (crl, r_epoch);
+}
+
+
 ksba_sexp_t
 ksba_crl_get_sig_val (ksba_crl_t crl)
 {
@@ -661,6 +980,157 @@ ksba_crl_parse (ksba_crl_t crl, ksba_stop_reason_t *r_stopreason)
 }
 
 
+gpg_error_t
+ksba_crl_build_index (ksba_crl_t crl, ksba_crl_index_t idx,
+                      ksba_stop_reason_t *r_stopreason)
+{
+  return _ksba_crl_build_index (crl, idx, r_stopreason);
+}
+
+
+gpg_error_t
+ksba_crl_get_items (ksba_crl_t crl, ksba_crl_entry_t entries,
+                    unsigned int nentries, unsigned int *r_count,
+                    ksba_stop_reason_t *r_stopreason)
+{
+  return _ksba_crl_get_items (crl, entries, nentries, r_count, r_stopreason);
+}
+
+
+gpg_error_t
+ksba_crl_split_items (ksba_crl_t crl, ksba_crl_chunk_t chunks,
+                      unsigned int nchunks, unsigned int *r_count,
+                      ksba_stop_reason_t *r_stopreason)
+{
+  return _ksba_crl_split_items (crl, chunks, nchunks, r_count, r_stopreason);
+}
+
+
+gpg_error_t
+ksba_crl_build_index_chunk (ksba_crl_chunk_t chunk, ksba_crl_index_t idx)
+{
+  return _ksba_crl_build_index_chunk (chunk, idx);
+}
+
+
+
+/*-- crlindex.c --*/
+gpg_error_t
+ksba_crl_index_new (ksba_crl_index_t *r_idx)
+{
+  return _ksba_crl_index_new (r_idx);
+}
+
+
+void
+ksba_crl_index_release (ksba_crl_index_t idx)
+{
+  _ksba_crl_index_release (idx);
+}
+
+
+gpg_error_t
+ksba_crl_index_add (ksba_crl_index_t idx,
+                    const unsigned char *serial, size_t seriallen,
+                    ksba_crl_reason_t reason, ksba_epoch_t date)
+{
+  return _ksba_crl_index_add (idx, serial, seriallen, reason, date);
+}
+
+
+gpg_error_t
+ksba_crl_index_remove (ksba_crl_index_t idx,
+                       const unsigned char *serial, size_t seriallen)
+{
+  return _ksba_crl_index_remove (idx, serial, seriallen);
+}
+
+
+gpg_error_t
+ksba_crl_index_merge (ksba_crl_index_t idx, ksba_crl_index_t other)
+{
+  return _ksba_crl_index_merge (idx, other);
+}
+
+
+gpg_error_t
+ksba_crl_index_apply_delta (ksba_crl_index_t idx, ksba_crl_index_t delta)
+{
+  return _ksba_crl_index_apply_delta (idx, delta);
+}
+
+
+unsigned int
+ksba_crl_index_count (ksba_crl_index_t idx)
+{
+  return _ksba_crl_index_count (idx);
+}
+
+
+gpg_error_t
+ksba_crl_index_lookup (ksba_crl_index_t idx,
+                       const unsigned char *serial, size_t seriallen,
+                       ksba_crl_reason_t *r_reason, ksba_epoch_t *r_date)
+{
+  return _ksba_crl_index_lookup (idx, serial, seriallen, r_reason, r_date);
+}
+
+
+gpg_error_t
+ksba_crl_index_set_info (ksba_crl_index_t idx, ksba_crl_t crl)
+{
+  return _ksba_crl_index_set_info (idx, crl);
+}
+
+
+gpg_error_t
+ksba_crl_index_set_digest (ksba_crl_index_t idx, const char *algo,
+                           const unsigned char *digest, size_t digestlen)
+{
+  return _ksba_crl_index_set_digest (idx, algo, digest, digestlen);
+}
+
+
+gpg_error_t
+ksba_crl_index_get_info (ksba_crl_index_t idx, const char **r_issuer,
+                         const unsigned char **r_number, size_t *r_numberlen,
+                         ksba_epoch_t *r_this_update,
+                         ksba_epoch_t *r_next_update)
+{
+  return _ksba_crl_index_get_info (idx, r_issuer, r_number, r_numberlen,
+                                   r_this_update, r_next_update);
+}
+
+
+gpg_error_t
+ksba_crl_index_get_digest (ksba_crl_index_t idx, const char **r_algo,
+                           const unsigned char **r_digest,
+                           size_t *r_digestlen)
+{
+  return _ksba_crl_index_get_digest (idx, r_algo, r_digest, r_digestlen);
+}
+
+
+gpg_error_t
+ksba_crl_index_write (ksba_crl_index_t idx, ksba_writer_t writer)
+{
+  return _ksba_crl_index_write (idx, writer);
+}
+
+
+gpg_error_t
+ksba_crl_index_read (ksba_crl_index_t idx, ksba_reader_t reader)
+{
+  return _ksba_crl_index_read (idx, reader);
+}
+
+
+gpg_error_t
+ksba_crl_index_map (ksba_crl_index_t idx, ksba_reader_t reader)
+{
+  return _ksba_crl_index_map (idx, reader);
+}
+
 
 
 /*-- ocsp.c --*/
@@ -816,6 +1286,14 @@ ksba_ocsp_get_status (ksba_ocsp_t ocsp, ksba_cert_t cert,
 }
 
 
+gpg_error_t
+ksba_ocsp_get_status_list (ksba_ocsp_t ocsp, ksba_ocsp_status_t stati,
+                           unsigned int nstati, unsigned int *r_count)
+{
+  return _ksba_ocsp_get_status_list (ocsp, stati, nstati, r_count);
+}
+
+
 gpg_error_t
 ksba_ocsp_get_extension (ksba_ocsp_t ocsp, ksba_cert_t cert,
                          int idx,
@@ -828,6 +1306,131 @@ ksba_ocsp_get_extension (ksba_ocsp_t ocsp, ksba_cert_t cert,
 }
 
 
+gpg_error_t
+ksba_ocsp_parse_response_ref (ksba_ocsp_t ocsp,
+                              const unsigned char *msg, size_t msglen,
+                              ksba_ocsp_response_status_t *resp_status)
+{
+  return _ksba_ocsp_parse_response_ref (ocsp, msg, msglen, resp_status);
+}
+
+
+gpg_error_t
+ksba_ocsp_cache_new (ksba_ocsp_cache_t *r_cache)
+{
+  return _ksba_ocsp_cache_new (r_cache);
+}
+
+
+void
+ksba_ocsp_cache_release (ksba_ocsp_cache_t cache)
+{
+  _ksba_ocsp_cache_release (cache);
+}
+
+
+gpg_error_t
+ksba_ocsp_cache_put (ksba_ocsp_cache_t cache,
+                     const unsigned char *response, size_t responselen)
+{
+  return _ksba_ocsp_cache_put (cache, response, responselen);
+}
+
+
+gpg_error_t
+ksba_ocsp_cache_get (ksba_ocsp_cache_t cache,
+                     const unsigned char *request, size_t requestlen,
+                     const ksba_isotime_t now,
+                     unsigned char const **r_response,
+                     size_t *r_responselen)
+{
+  return _ksba_ocsp_cache_get (cache, request, requestlen, now,
+                               r_response, r_responselen);
+}
+
+
+gpg_error_t
+ksba_ocsp_response_builder_new (ksba_ocsp_response_builder_t *r_rb)
+{
+  return _ksba_ocsp_response_builder_new (r_rb);
+}
+
+
+void
+ksba_ocsp_response_builder_release (ksba_ocsp_response_builder_t rb)
+{
+  _ksba_ocsp_response_builder_release (rb);
+}
+
+
+void
+ksba_ocsp_response_builder_reset (ksba_ocsp_response_builder_t rb)
+{
+  _ksba_ocsp_response_builder_reset (rb);
+}
+
+
+gpg_error_t
+ksba_ocsp_response_builder_set_responder (ksba_ocsp_response_builder_t rb,
+                                          const unsigned char *name,
+                                          size_t namelen,
+                                          const unsigned char *keyhash)
+{
+  return _ksba_ocsp_response_builder_set_responder (rb, name, namelen,
+                                                    keyhash);
+}
+
+
+gpg_error_t
+ksba_ocsp_response_builder_add_cert (ksba_ocsp_response_builder_t rb,
+                                     ksba_cert_t cert)
+{
+  return _ksba_ocsp_response_builder_add_cert (rb, cert);
+}
+
+
+gpg_error_t
+ksba_ocsp_response_builder_set_nonce (ksba_ocsp_response_builder_t rb,
+                                      const unsigned char *nonce,
+                                      size_t noncelen)
+{
+  return _ksba_ocsp_response_builder_set_nonce (rb, nonce, noncelen);
+}
+
+
+gpg_error_t
+ksba_ocsp_response_builder_add_singles (ksba_ocsp_response_builder_t rb,
+                                     const struct ksba_ocsp_single_s *singles,
+                                     unsigned int nsingles)
+{
+  return _ksba_ocsp_response_builder_add_singles (rb, singles, nsingles);
+}
+
+
+gpg_error_t
+ksba_ocsp_response_builder_get_tbs (ksba_ocsp_response_builder_t rb,
+                                    const ksba_isotime_t produced_at,
+                                    const char *sigalgo, size_t maxsiglen,
+                                    unsigned char const **r_tbs,
+                                    size_t *r_tbslen)
+{
+  return _ksba_ocsp_response_builder_get_tbs (rb, produced_at,
+                                              sigalgo, maxsiglen,
+                                              r_tbs, r_tbslen);
+}
+
+
+gpg_error_t
+ksba_ocsp_response_builder_set_sig (ksba_ocsp_response_builder_t rb,
+                                    const unsigned char *sig, size_t siglen,
+                                    unsigned char const **r_der,
+                                    size_t *r_derlen)
+{
+  return _ksba_ocsp_response_builder_set_sig (rb, sig, siglen,
+                                              r_der, r_derlen);
+}
+
+
 
 
 /*-- certreq.c --*/
@@ -845,6 +1448,13 @@ ksba_certreq_release (ksba_certreq_t cr)
 }
 
 
+void
+ksba_certreq_reset (ksba_certreq_t cr)
+{
+  _ksba_certreq_reset (cr);
+}
+
+
 gpg_error_t
 ksba_certreq_set_writer (ksba_certreq_t cr, ksba_writer_t w)
 {
@@ -970,6 +1580,14 @@ ksba_reader_set_mem (ksba_reader_t r,
 }
 
 
+gpg_error_t
+ksba_reader_set_mmap (ksba_reader_t r, int fd,
+                      unsigned long long offset, size_t length)
+{
+  return _ksba_reader_set_mmap (r, fd, offset, length);
+}
+
+
 gpg_error_t
 ksba_reader_set_fd (ksba_reader_t r, int fd)
 {
@@ -993,6 +1611,20 @@ ksba_reader_set_cb (ksba_reader_t r,
 }
 
 
+gpg_error_t
+ksba_reader_set_buffer_size (ksba_reader_t r, size_t size)
+{
+  return _ksba_reader_set_buffer_size (r, size);
+}
+
+
+gpg_error_t
+ksba_reader_set_nonblocking (ksba_reader_t r, int yes)
+{
+  return _ksba_reader_set_nonblocking (r, yes);
+}
+
+
 
 gpg_error_t
 ksba_reader_read (ksba_reader_t r,
@@ -1016,6 +1648,21 @@ ksba_reader_tell (ksba_reader_t r)
 }
 
 
+gpg_error_t
+ksba_reader_peek (ksba_reader_t r,
+                  const unsigned char **r_buffer, size_t *r_length)
+{
+  return _ksba_reader_peek (r, r_buffer, r_length);
+}
+
+
+gpg_error_t
+ksba_reader_consume (ksba_reader_t r, size_t count)
+{
+  return _ksba_reader_consume (r, count);
+}
+
+
 
 /*-- writer.c --*/
 gpg_error_t
@@ -1109,6 +1756,52 @@ ksba_writer_write (ksba_writer_t w, const void *buffer, size_t length)
 }
 
 
+gpg_error_t
+ksba_writer_set_buffer_size (ksba_writer_t w, size_t size)
+{
+  return _ksba_writer_set_buffer_size (w, size);
+}
+
+
+gpg_error_t
+ksba_writer_flush (ksba_writer_t w)
+{
+  return _ksba_writer_flush (w);
+}
+
+
+gpg_error_t
+ksba_writer_set_mem_segments (ksba_writer_t w, size_t segment_size,
+                              void *(*alloc_fnc)(void *, size_t),
+                              void (*free_fnc)(void *, void *),
+                              void *fnc_value)
+{
+  return _ksba_writer_set_mem_segments (w, segment_size,
+                                        alloc_fnc, free_fnc, fnc_value);
+}
+
+
+gpg_error_t
+ksba_writer_get_mem_segments (ksba_writer_t w, unsigned int idx,
+                              const void **r_buffer, size_t *r_length)
+{
+  return _ksba_writer_get_mem_segments (w, idx, r_buffer, r_length);
+}
+
+
+gpg_error_t
+ksba_writer_set_queue (ksba_writer_t w, size_t buffer_size,
+                       gpg_error_t (*put_fnc)(void *, void *, size_t,
+                                              size_t *),
+                       gpg_error_t (*wait_fnc)(void *, size_t),
+                       void *fnc_value,
+                       size_t high_water, size_t low_water)
+{
+  return _ksba_writer_set_queue (w, buffer_size, put_fnc, wait_fnc,
+                                 fnc_value, high_water, low_water);
+}
+
+
 gpg_error_t
 ksba_writer_write_octet_string (ksba_writer_t w,
                                 const void *buffer, size_t length,
@@ -1177,6 +1870,22 @@ ksba_oid_from_str (const char *string,
 }
 
 
+gpg_error_t
+ksba_oid_to_str_buf (const char *der, size_t derlen,
+                     char *buffer, size_t bufsize)
+{
+  return _ksba_oid_to_str_buf (der, derlen, buffer, bufsize);
+}
+
+
+gpg_error_t
+ksba_oid_from_str_buf (const char *string, unsigned char *buffer,
+                       size_t bufsize, size_t *r_length)
+{
+  return _ksba_oid_from_str_buf (string, buffer, bufsize, r_length);
+}
+
+
 
 /*-- dn.c --*/
 gpg_error_t
@@ -1186,6 +1895,14 @@ ksba_dn_der2str (const void *der, size_t derlen, char **r_string)
 }
 
 
+gpg_error_t
+ksba_dn_der2str_buf (const void *der, size_t derlen,
+                     char *buffer, size_t bufsize, size_t *r_length)
+{
+  return _ksba_dn_der2str_buf (der, derlen, buffer, bufsize, r_length);
+}
+
+
 gpg_error_t
 ksba_dn_str2der (const char *string,
                  unsigned char **rder, size_t *rderlen)
@@ -1202,6 +1919,57 @@ ksba_dn_teststr (const char *string, int seq,
 }
 
 
+int
+ksba_dn_cmp_der (const void *a, size_t alen, const void *b, size_t blen)
+{
+  return _ksba_dn_cmp_der (a, alen, b, blen);
+}
+
+
+gpg_error_t
+ksba_dn_matcher_new (ksba_dn_matcher_t *r_matcher, const char *string)
+{
+  return _ksba_dn_matcher_new (r_matcher, string);
+}
+
+
+void
+ksba_dn_matcher_release (ksba_dn_matcher_t matcher)
+{
+  _ksba_dn_matcher_release (matcher);
+}
+
+
+int
+ksba_dn_matcher_match (ksba_dn_matcher_t matcher,
+                       const void *der, size_t derlen)
+{
+  return _ksba_dn_matcher_match (matcher, der, derlen);
+}
+
+
+gpg_error_t
+ksba_dn_cache_new (ksba_dn_cache_t *r_cache, unsigned int maxitems)
+{
+  return _ksba_dn_cache_new (r_cache, maxitems);
+}
+
+
+void
+ksba_dn_cache_release (ksba_dn_cache_t cache)
+{
+  _ksba_dn_cache_release (cache);
+}
+
+
+gpg_error_t
+ksba_dn_cache_der2str (ksba_dn_cache_t cache, const void *der, size_t derlen,
+                       char **r_string)
+{
+  return _ksba_dn_cache_der2str (cache, der, derlen, r_string);
+}
+
+
 
 
 /*-- name.c --*/
@@ -1317,3 +2085,75 @@ ksba_der_builder_get (ksba_der_t d, unsigned char **r_obj, size_t *r_objlen)
 {
   return _ksba_der_builder_get (d, r_obj, r_objlen);
 }
+
+gpg_error_t
+ksba_der_builder_get_buf (ksba_der_t d, unsigned char *buffer,
+                          size_t bufsize, size_t *r_objlen)
+{
+  return _ksba_der_builder_get_buf (d, buffer, bufsize, r_objlen);
+}
+
+gpg_error_t
+ksba_der_builder_write (ksba_der_t d, ksba_writer_t w)
+{
+  return _ksba_der_builder_write (d, w);
+}
+
+int
+ksba_der_mark_field (ksba_der_t d)
+{
+  return _ksba_der_mark_field (d);
+}
+
+gpg_error_t
+ksba_der_set_field (ksba_der_t d, int field,
+                    const void *value, size_t valuelen)
+{
+  return _ksba_der_set_field (d, field, value, valuelen);
+}
+
+gpg_error_t
+ksba_der_builder_update_buf (ksba_der_t d, unsigned char *buffer,
+                             size_t bufsize, size_t *r_objlen)
+{
+  return _ksba_der_builder_update_buf (d, buffer, bufsize, r_objlen);
+}
+
+void
+ksba_der_cursor_init (ksba_der_cursor_t c, const void *der, size_t derlen)
+{
+  _ksba_der_cursor_init (c, der, derlen);
+}
+
+gpg_error_t
+ksba_der_cursor_next (ksba_der_cursor_t c, int *r_class, int *r_tag,
+                      int *r_constructed, size_t *r_length)
+{
+  return _ksba_der_cursor_next (c, r_class, r_tag, r_constructed, r_length);
+}
+
+gpg_error_t
+ksba_der_cursor_enter (ksba_der_cursor_t c)
+{
+  return _ksba_der_cursor_enter (c);
+}
+
+gpg_error_t
+ksba_der_cursor_leave (ksba_der_cursor_t c)
+{
+  return _ksba_der_cursor_leave (c);
+}
+
+gpg_error_t
+ksba_der_cursor_value (ksba_der_cursor_t c,
+                       const unsigned char **r_ptr, size_t *r_length)
+{
+  return _ksba_der_cursor_value (c, r_ptr, r_length);
+}
+
+gpg_error_t
+ksba_der_cursor_tlv (ksba_der_cursor_t c,
+                     const unsigned char **r_ptr, size_t *r_length)
+{
+  return _ksba_der_cursor_tlv (c, r_ptr, r_length);
+}
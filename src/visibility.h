@@ -52,15 +52,47 @@
 #define ksba_cert_get_ext_key_usages       _ksba_cert_get_ext_key_usages
 #define ksba_cert_get_extension            _ksba_cert_get_extension
 #define ksba_cert_get_image                _ksba_cert_get_image
+#define ksba_cert_get_issuer_dn_ptr        _ksba_cert_get_issuer_dn_ptr
+#define ksba_cert_get_subject_dn_ptr       _ksba_cert_get_subject_dn_ptr
+#define ksba_cert_get_view                 _ksba_cert_get_view
+#define ksba_cert_prepare_verify           _ksba_cert_prepare_verify
+#define ksba_cert_release_verify           _ksba_cert_release_verify
+#define ksba_cert_get_validity_epoch       _ksba_cert_get_validity_epoch
+#define ksba_crl_get_update_epoch          _ksba_crl_get_update_epoch
+#define ksba_crl_get_item_epoch            _ksba_crl_get_item_epoch
+#define ksba_crl_build_index               _ksba_crl_build_index
+#define ksba_crl_index_new                 _ksba_crl_index_new
+#define ksba_crl_index_release             _ksba_crl_index_release
+#define ksba_crl_index_add                 _ksba_crl_index_add
+#define ksba_crl_index_remove              _ksba_crl_index_remove
+#define ksba_crl_index_merge               _ksba_crl_index_merge
+#define ksba_crl_index_apply_delta         _ksba_crl_index_apply_delta
+#define ksba_crl_index_count               _ksba_crl_index_count
+#define ksba_crl_index_lookup              _ksba_crl_index_lookup
+#define ksba_crl_index_set_info            _ksba_crl_index_set_info
+#define ksba_crl_index_set_digest          _ksba_crl_index_set_digest
+#define ksba_crl_index_get_info            _ksba_crl_index_get_info
+#define ksba_crl_index_get_digest          _ksba_crl_index_get_digest
+#define ksba_crl_index_write               _ksba_crl_index_write
+#define ksba_crl_index_read                _ksba_crl_index_read
+#define ksba_crl_index_map                 _ksba_crl_index_map
+#define ksba_crl_get_items                 _ksba_crl_get_items
+#define ksba_crl_split_items               _ksba_crl_split_items
+#define ksba_crl_build_index_chunk         _ksba_crl_build_index_chunk
 #define ksba_cert_get_issuer               _ksba_cert_get_issuer
 #define ksba_cert_get_key_usage            _ksba_cert_get_key_usage
 #define ksba_cert_get_public_key           _ksba_cert_get_public_key
 #define ksba_cert_get_serial               _ksba_cert_get_serial
 #define ksba_cert_get_sig_val              _ksba_cert_get_sig_val
+#define ksba_cert_get_public_key_desc      _ksba_cert_get_public_key_desc
+#define ksba_cert_get_sig_val_desc         _ksba_cert_get_sig_val_desc
 #define ksba_cert_get_subject              _ksba_cert_get_subject
 #define ksba_cert_get_validity             _ksba_cert_get_validity
 #define ksba_cert_hash                     _ksba_cert_hash
+#define ksba_cert_get_fingerprint          _ksba_cert_get_fingerprint
 #define ksba_cert_init_from_mem            _ksba_cert_init_from_mem
+#define ksba_cert_init_from_mem_ref        _ksba_cert_init_from_mem_ref
+#define ksba_cert_read_bundle              _ksba_cert_read_bundle
 #define ksba_cert_is_ca                    _ksba_cert_is_ca
 #define ksba_cert_new                      _ksba_cert_new
 #define ksba_cert_read_der                 _ksba_cert_read_der
@@ -70,8 +102,21 @@
                                            _ksba_cert_get_authority_info_access
 #define ksba_cert_get_subject_info_access  _ksba_cert_get_subject_info_access
 #define ksba_cert_get_subj_key_id          _ksba_cert_get_subj_key_id
+#define ksba_cert_get_key_ids              _ksba_cert_get_key_ids
+#define ksba_certstore_new                 _ksba_certstore_new
+#define ksba_certstore_release             _ksba_certstore_release
+#define ksba_certstore_add                 _ksba_certstore_add
+#define ksba_certstore_remove              _ksba_certstore_remove
+#define ksba_certstore_count               _ksba_certstore_count
+#define ksba_certstore_set_limit           _ksba_certstore_set_limit
+#define ksba_certstore_find_subject        _ksba_certstore_find_subject
+#define ksba_certstore_find_issuer         _ksba_certstore_find_issuer
+#define ksba_certstore_find_serial         _ksba_certstore_find_serial
+#define ksba_certstore_find_ski            _ksba_certstore_find_ski
+#define ksba_certstore_find_image          _ksba_certstore_find_image
 #define ksba_cert_set_user_data            _ksba_cert_set_user_data
 #define ksba_cert_get_user_data            _ksba_cert_get_user_data
+#define ksba_cert_set_lazy                 _ksba_cert_set_lazy
 
 #define ksba_certreq_set_serial            _ksba_certreq_set_serial
 #define ksba_certreq_set_issuer            _ksba_certreq_set_issuer
@@ -102,6 +147,8 @@
 #define ksba_cms_get_issuer_serial         _ksba_cms_get_issuer_serial
 #define ksba_cms_get_message_digest        _ksba_cms_get_message_digest
 #define ksba_cms_get_sig_val               _ksba_cms_get_sig_val
+#define ksba_cms_get_sig_val_desc          _ksba_cms_get_sig_val_desc
+#define ksba_cms_get_signers               _ksba_cms_get_signers
 #define ksba_cms_get_sigattr_oids          _ksba_cms_get_sigattr_oids
 #define ksba_cms_get_signing_time          _ksba_cms_get_signing_time
 #define ksba_cms_hash_signed_attrs         _ksba_cms_hash_signed_attrs
@@ -113,8 +160,13 @@
 #define ksba_cms_set_content_type          _ksba_cms_set_content_type
 #define ksba_cms_set_enc_val               _ksba_cms_set_enc_val
 #define ksba_cms_set_hash_function         _ksba_cms_set_hash_function
+#define ksba_cms_add_hash_function         _ksba_cms_add_hash_function
 #define ksba_cms_set_message_digest        _ksba_cms_set_message_digest
 #define ksba_cms_set_reader_writer         _ksba_cms_set_reader_writer
+#define ksba_cms_set_certstore             _ksba_cms_set_certstore
+#define ksba_cms_set_cert_cache_limit      _ksba_cms_set_cert_cache_limit
+#define ksba_cms_get_recipients            _ksba_cms_get_recipients
+#define ksba_cms_find_recipient            _ksba_cms_find_recipient
 #define ksba_cms_set_sig_val               _ksba_cms_set_sig_val
 #define ksba_cms_set_signing_time          _ksba_cms_set_signing_time
 #define ksba_cms_add_smime_capability      _ksba_cms_add_smime_capability
@@ -132,6 +184,7 @@
 #define ksba_crl_get_extension             _ksba_crl_get_extension
 #define ksba_crl_get_auth_key_id           _ksba_crl_get_auth_key_id
 #define ksba_crl_get_crl_number            _ksba_crl_get_crl_number
+#define ksba_crl_get_delta_base            _ksba_crl_get_delta_base
 
 #define ksba_name_enum                     _ksba_name_enum
 #define ksba_name_get_uri                  _ksba_name_get_uri
@@ -147,6 +200,21 @@
 #define ksba_ocsp_get_responder_id         _ksba_ocsp_get_responder_id
 #define ksba_ocsp_get_sig_val              _ksba_ocsp_get_sig_val
 #define ksba_ocsp_get_status               _ksba_ocsp_get_status
+#define ksba_ocsp_get_status_list          _ksba_ocsp_get_status_list
+#define ksba_ocsp_parse_response_ref       _ksba_ocsp_parse_response_ref
+#define ksba_ocsp_cache_new                _ksba_ocsp_cache_new
+#define ksba_ocsp_cache_release            _ksba_ocsp_cache_release
+#define ksba_ocsp_cache_put                _ksba_ocsp_cache_put
+#define ksba_ocsp_cache_get                _ksba_ocsp_cache_get
+#define ksba_ocsp_response_builder_new     _ksba_ocsp_response_builder_new
+#define ksba_ocsp_response_builder_release _ksba_ocsp_response_builder_release
+#define ksba_ocsp_response_builder_reset   _ksba_ocsp_response_builder_reset
+#define ksba_ocsp_response_builder_set_responder _ksba_ocsp_response_builder_set_responder
+#define ksba_ocsp_response_builder_add_cert _ksba_ocsp_response_builder_add_cert
+#define ksba_ocsp_response_builder_set_nonce _ksba_ocsp_response_builder_set_nonce
+#define ksba_ocsp_response_builder_add_singles _ksba_ocsp_response_builder_add_singles
+#define ksba_ocsp_response_builder_get_tbs _ksba_ocsp_response_builder_get_tbs
+#define ksba_ocsp_response_builder_set_sig _ksba_ocsp_response_builder_set_sig
 #define ksba_ocsp_hash_request             _ksba_ocsp_hash_request
 #define ksba_ocsp_hash_response            _ksba_ocsp_hash_response
 #define ksba_ocsp_new                      _ksba_ocsp_new
@@ -160,11 +228,21 @@
 #define ksba_ocsp_get_extension            _ksba_ocsp_get_extension
 
 #define ksba_oid_from_str                  _ksba_oid_from_str
+#define ksba_oid_from_str_buf              _ksba_oid_from_str_buf
 #define ksba_oid_to_str                    _ksba_oid_to_str
+#define ksba_oid_to_str_buf                _ksba_oid_to_str_buf
 
 #define ksba_dn_der2str                    _ksba_dn_der2str
+#define ksba_dn_der2str_buf                _ksba_dn_der2str_buf
 #define ksba_dn_str2der                    _ksba_dn_str2der
 #define ksba_dn_teststr                    _ksba_dn_teststr
+#define ksba_dn_cmp_der                    _ksba_dn_cmp_der
+#define ksba_dn_matcher_new                _ksba_dn_matcher_new
+#define ksba_dn_matcher_release            _ksba_dn_matcher_release
+#define ksba_dn_matcher_match              _ksba_dn_matcher_match
+#define ksba_dn_cache_new                  _ksba_dn_cache_new
+#define ksba_dn_cache_release              _ksba_dn_cache_release
+#define ksba_dn_cache_der2str              _ksba_dn_cache_der2str
 
 #define ksba_reader_clear                  _ksba_reader_clear
 #define ksba_reader_error                  _ksba_reader_error
@@ -175,8 +253,13 @@
 #define ksba_reader_set_fd                 _ksba_reader_set_fd
 #define ksba_reader_set_file               _ksba_reader_set_file
 #define ksba_reader_set_mem                _ksba_reader_set_mem
+#define ksba_reader_set_mmap               _ksba_reader_set_mmap
+#define ksba_reader_set_buffer_size        _ksba_reader_set_buffer_size
+#define ksba_reader_set_nonblocking        _ksba_reader_set_nonblocking
 #define ksba_reader_tell                   _ksba_reader_tell
 #define ksba_reader_unread                 _ksba_reader_unread
+#define ksba_reader_peek                   _ksba_reader_peek
+#define ksba_reader_consume                _ksba_reader_consume
 
 #define ksba_writer_error                  _ksba_writer_error
 #define ksba_writer_get_mem                _ksba_writer_get_mem
@@ -190,6 +273,11 @@
 #define ksba_writer_snatch_mem             _ksba_writer_snatch_mem
 #define ksba_writer_tell                   _ksba_writer_tell
 #define ksba_writer_write                  _ksba_writer_write
+#define ksba_writer_set_buffer_size        _ksba_writer_set_buffer_size
+#define ksba_writer_flush                  _ksba_writer_flush
+#define ksba_writer_set_mem_segments       _ksba_writer_set_mem_segments
+#define ksba_writer_get_mem_segments       _ksba_writer_get_mem_segments
+#define ksba_writer_set_queue              _ksba_writer_set_queue
 #define ksba_writer_write_octet_string     _ksba_writer_write_octet_string
 
 #define ksba_der_release                   _ksba_der_release
@@ -204,6 +292,24 @@
 #define ksba_der_add_tag                   _ksba_der_add_tag
 #define ksba_der_add_end                   _ksba_der_add_end
 #define ksba_der_builder_get               _ksba_der_builder_get
+#define ksba_der_builder_get_buf           _ksba_der_builder_get_buf
+#define ksba_der_builder_write             _ksba_der_builder_write
+#define ksba_der_mark_field                _ksba_der_mark_field
+#define ksba_der_set_field                 _ksba_der_set_field
+#define ksba_der_builder_update_buf        _ksba_der_builder_update_buf
+#define ksba_certreq_reset                 _ksba_certreq_reset
+#define ksba_alloc_ctx_new                 _ksba_alloc_ctx_new
+#define ksba_alloc_ctx_release             _ksba_alloc_ctx_release
+#define ksba_alloc_ctx_enter               _ksba_alloc_ctx_enter
+#define ksba_get_stats                     _ksba_get_stats
+#define ksba_reset_stats                   _ksba_reset_stats
+#define ksba_set_trace_cb                  _ksba_set_trace_cb
+#define ksba_der_cursor_init               _ksba_der_cursor_init
+#define ksba_der_cursor_next               _ksba_der_cursor_next
+#define ksba_der_cursor_enter              _ksba_der_cursor_enter
+#define ksba_der_cursor_leave              _ksba_der_cursor_leave
+#define ksba_der_cursor_value              _ksba_der_cursor_value
+#define ksba_der_cursor_tlv                _ksba_der_cursor_tlv
 
 
 /* Include the main header file to map the public symbols to the
@@ -260,15 +366,47 @@ int ksba_asn_delete_structure (void *dummy);
 #undef ksba_cert_get_ext_key_usages
 #undef ksba_cert_get_extension
 #undef ksba_cert_get_image
+#undef ksba_cert_get_issuer_dn_ptr
+#undef ksba_cert_get_subject_dn_ptr
+#undef ksba_cert_get_view
+#undef ksba_cert_prepare_verify
+#undef ksba_cert_release_verify
+#undef ksba_cert_get_validity_epoch
+#undef ksba_crl_get_update_epoch
+#undef ksba_crl_get_item_epoch
+#undef ksba_crl_build_index
+#undef ksba_crl_index_new
+#undef ksba_crl_index_release
+#undef ksba_crl_index_add
+#undef ksba_crl_index_remove
+#undef ksba_crl_index_merge
+#undef ksba_crl_index_apply_delta
+#undef ksba_crl_index_count
+#undef ksba_crl_index_lookup
+#undef ksba_crl_index_set_info
+#undef ksba_crl_index_set_digest
+#undef ksba_crl_index_get_info
+#undef ksba_crl_index_get_digest
+#undef ksba_crl_index_write
+#undef ksba_crl_index_read
+#undef ksba_crl_index_map
+#undef ksba_crl_get_items
+#undef ksba_crl_split_items
+#undef ksba_crl_build_index_chunk
 #undef ksba_cert_get_issuer
 #undef ksba_cert_get_key_usage
 #undef ksba_cert_get_public_key
 #undef ksba_cert_get_serial
 #undef ksba_cert_get_sig_val
+#undef ksba_cert_get_public_key_desc
+#undef ksba_cert_get_sig_val_desc
 #undef ksba_cert_get_subject
 #undef ksba_cert_get_validity
 #undef ksba_cert_hash
+#undef ksba_cert_get_fingerprint
 #undef ksba_cert_init_from_mem
+#undef ksba_cert_init_from_mem_ref
+#undef ksba_cert_read_bundle
 #undef ksba_cert_is_ca
 #undef ksba_cert_new
 #undef ksba_cert_read_der
@@ -277,8 +415,21 @@ int ksba_asn_delete_structure (void *dummy);
 #undef ksba_cert_get_authority_info_access
 #undef ksba_cert_get_subject_info_access
 #undef ksba_cert_get_subj_key_id
+#undef ksba_cert_get_key_ids
+#undef ksba_certstore_new
+#undef ksba_certstore_release
+#undef ksba_certstore_add
+#undef ksba_certstore_remove
+#undef ksba_certstore_count
+#undef ksba_certstore_set_limit
+#undef ksba_certstore_find_subject
+#undef ksba_certstore_find_issuer
+#undef ksba_certstore_find_serial
+#undef ksba_certstore_find_ski
+#undef ksba_certstore_find_image
 #undef ksba_cert_set_user_data
 #undef ksba_cert_get_user_data
+#undef ksba_cert_set_lazy
 
 #undef ksba_certreq_set_serial
 #undef ksba_certreq_set_issuer
@@ -309,6 +460,8 @@ int ksba_asn_delete_structure (void *dummy);
 #undef ksba_cms_get_issuer_serial
 #undef ksba_cms_get_message_digest
 #undef ksba_cms_get_sig_val
+#undef ksba_cms_get_sig_val_desc
+#undef ksba_cms_get_signers
 #undef ksba_cms_get_sigattr_oids
 #undef ksba_cms_get_signing_time
 #undef ksba_cms_hash_signed_attrs
@@ -320,8 +473,13 @@ int ksba_asn_delete_structure (void *dummy);
 #undef ksba_cms_set_content_type
 #undef ksba_cms_set_enc_val
 #undef ksba_cms_set_hash_function
+#undef ksba_cms_add_hash_function
 #undef ksba_cms_set_message_digest
 #undef ksba_cms_set_reader_writer
+#undef ksba_cms_set_certstore
+#undef ksba_cms_set_cert_cache_limit
+#undef ksba_cms_get_recipients
+#undef ksba_cms_find_recipient
 #undef ksba_cms_set_sig_val
 #undef ksba_cms_set_signing_time
 #undef ksba_cms_add_smime_capability
@@ -339,6 +497,7 @@ int ksba_asn_delete_structure (void *dummy);
 #undef ksba_crl_get_extension
 #undef ksba_crl_get_auth_key_id
 #undef ksba_crl_get_crl_number
+#undef ksba_crl_get_delta_base
 
 #undef ksba_name_enum
 #undef ksba_name_get_uri
@@ -354,6 +513,21 @@ int ksba_asn_delete_structure (void *dummy);
 #undef ksba_ocsp_get_responder_id
 #undef ksba_ocsp_get_sig_val
 #undef ksba_ocsp_get_status
+#undef ksba_ocsp_get_status_list
+#undef ksba_ocsp_parse_response_ref
+#undef ksba_ocsp_cache_new
+#undef ksba_ocsp_cache_release
+#undef ksba_ocsp_cache_put
+#undef ksba_ocsp_cache_get
+#undef ksba_ocsp_response_builder_new
+#undef ksba_ocsp_response_builder_release
+#undef ksba_ocsp_response_builder_reset
+#undef ksba_ocsp_response_builder_set_responder
+#undef ksba_ocsp_response_builder_add_cert
+#undef ksba_ocsp_response_builder_set_nonce
+#undef ksba_ocsp_response_builder_add_singles
+#undef ksba_ocsp_response_builder_get_tbs
+#undef ksba_ocsp_response_builder_set_sig
 #undef ksba_ocsp_hash_request
 #undef ksba_ocsp_hash_response
 #undef ksba_ocsp_new
@@ -367,11 +541,21 @@ int ksba_asn_delete_structure (void *dummy);
 #undef ksba_ocsp_get_extension
 
 #undef ksba_oid_from_str
+#undef ksba_oid_from_str_buf
 #undef ksba_oid_to_str
+#undef ksba_oid_to_str_buf
 
 #undef ksba_dn_der2str
+#undef ksba_dn_der2str_buf
 #undef ksba_dn_str2der
 #undef ksba_dn_teststr
+#undef ksba_dn_cmp_der
+#undef ksba_dn_matcher_new
+#undef ksba_dn_matcher_release
+#undef ksba_dn_matcher_match
+#undef ksba_dn_cache_new
+#undef ksba_dn_cache_release
+#undef ksba_dn_cache_der2str
 
 #undef ksba_reader_clear
 #undef ksba_reader_error
@@ -382,8 +566,13 @@ int ksba_asn_delete_structure (void *dummy);
 #undef ksba_reader_set_fd
 #undef ksba_reader_set_file
 #undef ksba_reader_set_mem
+#undef ksba_reader_set_mmap
+#undef ksba_reader_set_buffer_size
+#undef ksba_reader_set_nonblocking
 #undef ksba_reader_tell
 #undef ksba_reader_unread
+#undef ksba_reader_peek
+#undef ksba_reader_consume
 
 #undef ksba_writer_error
 #undef ksba_writer_get_mem
@@ -397,6 +586,11 @@ int ksba_asn_delete_structure (void *dummy);
 #undef ksba_writer_snatch_mem
 #undef ksba_writer_tell
 #undef ksba_writer_write
+#undef ksba_writer_set_buffer_size
+#undef ksba_writer_flush
+#undef ksba_writer_set_mem_segments
+#undef ksba_writer_get_mem_segments
+#undef ksba_writer_set_queue
 #undef ksba_writer_write_octet_string
 
 #undef ksba_der_release
@@ -411,6 +605,24 @@ int ksba_asn_delete_structure (void *dummy);
 #undef ksba_der_add_tag
 #undef ksba_der_add_end
 #undef ksba_der_builder_get
+#undef ksba_der_builder_get_buf
+#undef ksba_der_builder_write
+#undef ksba_der_mark_field
+#undef ksba_der_set_field
+#undef ksba_der_builder_update_buf
+#undef ksba_certreq_reset
+#undef ksba_alloc_ctx_new
+#undef ksba_alloc_ctx_release
+#undef ksba_alloc_ctx_enter
+#undef ksba_get_stats
+#undef ksba_reset_stats
+#undef ksba_set_trace_cb
+#undef ksba_der_cursor_init
+#undef ksba_der_cursor_next
+#undef ksba_der_cursor_enter
+#undef ksba_der_cursor_leave
+#undef ksba_der_cursor_value
+#undef ksba_der_cursor_tlv
 
 
 
@@ -436,15 +648,47 @@ MARK_VISIBLE (ksba_cert_get_digest_algo)
 MARK_VISIBLE (ksba_cert_get_ext_key_usages)
 MARK_VISIBLE (ksba_cert_get_extension)
 MARK_VISIBLE (ksba_cert_get_image)
+MARK_VISIBLE (ksba_cert_get_issuer_dn_ptr)
+MARK_VISIBLE (ksba_cert_get_subject_dn_ptr)
+MARK_VISIBLE (ksba_cert_get_view)
+MARK_VISIBLE (ksba_cert_prepare_verify)
+MARK_VISIBLE (ksba_cert_release_verify)
+MARK_VISIBLE (ksba_cert_get_validity_epoch)
+MARK_VISIBLE (ksba_crl_get_update_epoch)
+MARK_VISIBLE (ksba_crl_get_item_epoch)
+MARK_VISIBLE (ksba_crl_build_index)
+MARK_VISIBLE (ksba_crl_index_new)
+MARK_VISIBLE (ksba_crl_index_release)
+MARK_VISIBLE (ksba_crl_index_add)
+MARK_VISIBLE (ksba_crl_index_remove)
+MARK_VISIBLE (ksba_crl_index_merge)
+MARK_VISIBLE (ksba_crl_index_apply_delta)
+MARK_VISIBLE (ksba_crl_index_count)
+MARK_VISIBLE (ksba_crl_index_lookup)
+MARK_VISIBLE (ksba_crl_index_set_info)
+MARK_VISIBLE (ksba_crl_index_set_digest)
+MARK_VISIBLE (ksba_crl_index_get_info)
+MARK_VISIBLE (ksba_crl_index_get_digest)
+MARK_VISIBLE (ksba_crl_index_write)
+MARK_VISIBLE (ksba_crl_index_read)
+MARK_VISIBLE (ksba_crl_index_map)
+MARK_VISIBLE (ksba_crl_get_items)
+MARK_VISIBLE (ksba_crl_split_items)
+MARK_VISIBLE (ksba_crl_build_index_chunk)
 MARK_VISIBLE (ksba_cert_get_issuer)
 MARK_VISIBLE (ksba_cert_get_key_usage)
 MARK_VISIBLE (ksba_cert_get_public_key)
 MARK_VISIBLE (ksba_cert_get_serial)
 MARK_VISIBLE (ksba_cert_get_sig_val)
+MARK_VISIBLE (ksba_cert_get_public_key_desc)
+MARK_VISIBLE (ksba_cert_get_sig_val_desc)
 MARK_VISIBLE (ksba_cert_get_subject)
 MARK_VISIBLE (ksba_cert_get_validity)
 MARK_VISIBLE (ksba_cert_hash)
+MARK_VISIBLE (ksba_cert_get_fingerprint)
 MARK_VISIBLE (ksba_cert_init_from_mem)
+MARK_VISIBLE (ksba_cert_init_from_mem_ref)
+MARK_VISIBLE (ksba_cert_read_bundle)
 MARK_VISIBLE (ksba_cert_is_ca)
 MARK_VISIBLE (ksba_cert_new)
 MARK_VISIBLE (ksba_cert_read_der)
@@ -453,8 +697,21 @@ MARK_VISIBLE (ksba_cert_release)
 MARK_VISIBLE (ksba_cert_get_authority_info_access)
 MARK_VISIBLE (ksba_cert_get_subject_info_access)
 MARK_VISIBLE (ksba_cert_get_subj_key_id)
+MARK_VISIBLE (ksba_cert_get_key_ids)
+MARK_VISIBLE (ksba_certstore_new)
+MARK_VISIBLE (ksba_certstore_release)
+MARK_VISIBLE (ksba_certstore_add)
+MARK_VISIBLE (ksba_certstore_remove)
+MARK_VISIBLE (ksba_certstore_count)
+MARK_VISIBLE (ksba_certstore_set_limit)
+MARK_VISIBLE (ksba_certstore_find_subject)
+MARK_VISIBLE (ksba_certstore_find_issuer)
+MARK_VISIBLE (ksba_certstore_find_serial)
+MARK_VISIBLE (ksba_certstore_find_ski)
+MARK_VISIBLE (ksba_certstore_find_image)
 MARK_VISIBLE (ksba_cert_set_user_data)
 MARK_VISIBLE (ksba_cert_get_user_data)
+MARK_VISIBLE (ksba_cert_set_lazy)
 
 MARK_VISIBLE (ksba_certreq_set_serial)
 MARK_VISIBLE (ksba_certreq_set_issuer)
@@ -485,6 +742,8 @@ MARK_VISIBLE (ksba_cms_get_enc_val)
 MARK_VISIBLE (ksba_cms_get_issuer_serial)
 MARK_VISIBLE (ksba_cms_get_message_digest)
 MARK_VISIBLE (ksba_cms_get_sig_val)
+MARK_VISIBLE (ksba_cms_get_sig_val_desc)
+MARK_VISIBLE (ksba_cms_get_signers)
 MARK_VISIBLE (ksba_cms_get_sigattr_oids)
 MARK_VISIBLE (ksba_cms_get_signing_time)
 MARK_VISIBLE (ksba_cms_hash_signed_attrs)
@@ -496,8 +755,13 @@ MARK_VISIBLE (ksba_cms_set_content_enc_algo)
 MARK_VISIBLE (ksba_cms_set_content_type)
 MARK_VISIBLE (ksba_cms_set_enc_val)
 MARK_VISIBLE (ksba_cms_set_hash_function)
+MARK_VISIBLE (ksba_cms_add_hash_function)
 MARK_VISIBLE (ksba_cms_set_message_digest)
 MARK_VISIBLE (ksba_cms_set_reader_writer)
+MARK_VISIBLE (ksba_cms_set_certstore)
+MARK_VISIBLE (ksba_cms_set_cert_cache_limit)
+MARK_VISIBLE (ksba_cms_get_recipients)
+MARK_VISIBLE (ksba_cms_find_recipient)
 MARK_VISIBLE (ksba_cms_set_sig_val)
 MARK_VISIBLE (ksba_cms_set_signing_time)
 MARK_VISIBLE (ksba_cms_add_smime_capability)
@@ -515,6 +779,7 @@ MARK_VISIBLE (ksba_crl_set_reader)
 MARK_VISIBLE (ksba_crl_get_extension)
 MARK_VISIBLE (ksba_crl_get_auth_key_id)
 MARK_VISIBLE (ksba_crl_get_crl_number)
+MARK_VISIBLE (ksba_crl_get_delta_base)
 
 MARK_VISIBLE (ksba_name_enum)
 MARK_VISIBLE (ksba_name_get_uri)
@@ -530,6 +795,21 @@ MARK_VISIBLE (ksba_ocsp_get_digest_algo)
 MARK_VISIBLE (ksba_ocsp_get_responder_id)
 MARK_VISIBLE (ksba_ocsp_get_sig_val)
 MARK_VISIBLE (ksba_ocsp_get_status)
+MARK_VISIBLE (ksba_ocsp_get_status_list)
+MARK_VISIBLE (ksba_ocsp_parse_response_ref)
+MARK_VISIBLE (ksba_ocsp_cache_new)
+MARK_VISIBLE (ksba_ocsp_cache_release)
+MARK_VISIBLE (ksba_ocsp_cache_put)
+MARK_VISIBLE (ksba_ocsp_cache_get)
+MARK_VISIBLE (ksba_ocsp_response_builder_new)
+MARK_VISIBLE (ksba_ocsp_response_builder_release)
+MARK_VISIBLE (ksba_ocsp_response_builder_reset)
+MARK_VISIBLE (ksba_ocsp_response_builder_set_responder)
+MARK_VISIBLE (ksba_ocsp_response_builder_add_cert)
+MARK_VISIBLE (ksba_ocsp_response_builder_set_nonce)
+MARK_VISIBLE (ksba_ocsp_response_builder_add_singles)
+MARK_VISIBLE (ksba_ocsp_response_builder_get_tbs)
+MARK_VISIBLE (ksba_ocsp_response_builder_set_sig)
 MARK_VISIBLE (ksba_ocsp_hash_request)
 MARK_VISIBLE (ksba_ocsp_hash_response)
 MARK_VISIBLE (ksba_ocsp_new)
@@ -543,11 +823,21 @@ MARK_VISIBLE (ksba_ocsp_set_sig_val)
 MARK_VISIBLE (ksba_ocsp_get_extension)
 
 MARK_VISIBLE (ksba_oid_from_str)
+MARK_VISIBLE (ksba_oid_from_str_buf)
 MARK_VISIBLE (ksba_oid_to_str)
+MARK_VISIBLE (ksba_oid_to_str_buf)
 
 MARK_VISIBLE (ksba_dn_der2str)
+MARK_VISIBLE (ksba_dn_der2str_buf)
 MARK_VISIBLE (ksba_dn_str2der)
 MARK_VISIBLE (ksba_dn_teststr)
+MARK_VISIBLE (ksba_dn_cmp_der)
+MARK_VISIBLE (ksba_dn_matcher_new)
+MARK_VISIBLE (ksba_dn_matcher_release)
+MARK_VISIBLE (ksba_dn_matcher_match)
+MARK_VISIBLE (ksba_dn_cache_new)
+MARK_VISIBLE (ksba_dn_cache_release)
+MARK_VISIBLE (ksba_dn_cache_der2str)
 
 MARK_VISIBLE (ksba_reader_clear)
 MARK_VISIBLE (ksba_reader_error)
@@ -558,8 +848,13 @@ MARK_VISIBLE (ksba_reader_set_cb)
 MARK_VISIBLE (ksba_reader_set_fd)
 MARK_VISIBLE (ksba_reader_set_file)
 MARK_VISIBLE (ksba_reader_set_mem)
+MARK_VISIBLE (ksba_reader_set_mmap)
+MARK_VISIBLE (ksba_reader_set_buffer_size)
+MARK_VISIBLE (ksba_reader_set_nonblocking)
 MARK_VISIBLE (ksba_reader_tell)
 MARK_VISIBLE (ksba_reader_unread)
+MARK_VISIBLE (ksba_reader_peek)
+MARK_VISIBLE (ksba_reader_consume)
 
 MARK_VISIBLE (ksba_writer_error)
 MARK_VISIBLE (ksba_writer_get_mem)
@@ -573,6 +868,11 @@ MARK_VISIBLE (ksba_writer_set_mem)
 MARK_VISIBLE (ksba_writer_snatch_mem)
 MARK_VISIBLE (ksba_writer_tell)
 MARK_VISIBLE (ksba_writer_write)
+MARK_VISIBLE (ksba_writer_set_buffer_size)
+MARK_VISIBLE (ksba_writer_flush)
+MARK_VISIBLE (ksba_writer_set_mem_segments)
+MARK_VISIBLE (ksba_writer_get_mem_segments)
+MARK_VISIBLE (ksba_writer_set_queue)
 MARK_VISIBLE (ksba_writer_write_octet_string)
 
 MARK_VISIBLE (ksba_der_release)
@@ -587,6 +887,24 @@ MARK_VISIBLE (ksba_der_add_der)
 MARK_VISIBLE (ksba_der_add_tag)
 MARK_VISIBLE (ksba_der_add_end)
 MARK_VISIBLE (ksba_der_builder_get)
+MARK_VISIBLE (ksba_der_builder_get_buf)
+MARK_VISIBLE (ksba_der_builder_write)
+MARK_VISIBLE (ksba_der_mark_field)
+MARK_VISIBLE (ksba_der_set_field)
+MARK_VISIBLE (ksba_der_builder_update_buf)
+MARK_VISIBLE (ksba_certreq_reset)
+MARK_VISIBLE (ksba_alloc_ctx_new)
+MARK_VISIBLE (ksba_alloc_ctx_release)
+MARK_VISIBLE (ksba_alloc_ctx_enter)
+MARK_VISIBLE (ksba_get_stats)
+MARK_VISIBLE (ksba_reset_stats)
+MARK_VISIBLE (ksba_set_trace_cb)
+MARK_VISIBLE (ksba_der_cursor_init)
+MARK_VISIBLE (ksba_der_cursor_next)
+MARK_VISIBLE (ksba_der_cursor_enter)
+MARK_VISIBLE (ksba_der_cursor_leave)
+MARK_VISIBLE (ksba_der_cursor_value)
+MARK_VISIBLE (ksba_der_cursor_tlv)
 
 
 #  undef MARK_VISIBLE
@@ -34,6 +34,10 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_UIO_H
+# include <sys/uio.h>
+#endif
 #include "util.h"
 
 #include "ksba.h"
@@ -41,6 +45,32 @@
 #include "asn1-func.h"
 #include "ber-help.h"
 
+
+static gpg_error_t flush_batch (ksba_writer_t w,
+                                const void *buffer, size_t length);
+
+
+/* Release all segments of a WRITER_TYPE_MEMSEG writer.  */
+static void
+release_segments (ksba_writer_t w)
+{
+  size_t i;
+
+  for (i=0; i < w->u.seg.nsegs; i++)
+    {
+      if (!w->u.seg.alloc_fnc)
+        xfree (w->u.seg.segs[i]);
+      else if (w->u.seg.free_fnc)
+        w->u.seg.free_fnc (w->u.seg.fnc_value, w->u.seg.segs[i]);
+    }
+  xfree (w->u.seg.segs);
+  w->u.seg.segs = NULL;
+  w->u.seg.nsegs = 0;
+  w->u.seg.nalloced = 0;
+  w->u.seg.lastlen = 0;
+}
+
+
 /**
  * ksba_writer_new:
  *
@@ -64,13 +94,17 @@ ksba_writer_new (ksba_writer_t *r_w)
  * ksba_writer_release:
  * @w: Writer Object (or NULL)
  *
- * Release this object
+ * Release this object.  Data still held in the batch buffer is
+ * written out first unless a write has already failed; use
+ * ksba_writer_flush before to see errors.
  **/
 void
 ksba_writer_release (ksba_writer_t w)
 {
   if (!w)
     return;
+  if (w->batch.length && !w->error)
+    flush_batch (w, NULL, 0);
   if (w->notify_cb)
     {
       void (*notify_fnc)(void*,ksba_writer_t) = w->notify_cb;
@@ -80,6 +114,16 @@ ksba_writer_release (ksba_writer_t w)
     }
   if (w->type == WRITER_TYPE_MEM)
     xfree (w->u.mem.buffer);
+  else if (w->type == WRITER_TYPE_MEMSEG)
+    release_segments (w);
+  else if (w->type == WRITER_TYPE_QUEUE && w->u.queue.buf)
+    {
+      ksba_alloc_ctx_t prevctx = _ksba_alloc_ctx_switch (NULL);
+
+      xfree (w->u.queue.buf);
+      _ksba_alloc_ctx_restore (prevctx);
+    }
+  xfree (w->batch.buf);
   xfree (w);
 }
 
@@ -272,7 +316,202 @@ ksba_writer_snatch_mem (ksba_writer_t w, size_t *nbytes)
 }
 
 
+/**
+ * ksba_writer_set_mem_segments:
+ * @w: Writer object
+ * @segment_size: Size of each segment or 0 for a default
+ * @alloc_fnc: Function to allocate a segment or %NULL
+ * @free_fnc: Function to release a segment or %NULL
+ * @fnc_value: Value passed to the allocation functions
+ *
+ * Initialize the writer object to write into a list of memory
+ * segments of @segment_size bytes each.  Unlike ksba_writer_set_mem no
+ * data is ever moved once it has been written; the segments can be
+ * accessed using ksba_writer_get_mem_segments.  If @alloc_fnc is
+ * given it is used to allocate the segments; it is called with
+ * @fnc_value and the number of bytes to allocate and must return the
+ * memory or %NULL on error.  @free_fnc is then used to release them;
+ * it may be %NULL if the segments are owned by an arena which the
+ * caller releases itself.  It is possible to reuse this writer object
+ * if it has already been initialized using this function; the old
+ * segments are then released.
+ *
+ * Return value: 0 on success or an error code
+ **/
+gpg_error_t
+ksba_writer_set_mem_segments (ksba_writer_t w, size_t segment_size,
+                              void *(*alloc_fnc)(void *, size_t),
+                              void (*free_fnc)(void *, void *),
+                              void *fnc_value)
+{
+  if (!w)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (w->type == WRITER_TYPE_MEMSEG)
+    release_segments (w); /* Reuse this writer.  */
+  else if (w->type)
+    return gpg_error (GPG_ERR_CONFLICT);
+
+  if (!segment_size)
+    segment_size = 65536;
+
+  w->u.seg.segsize = segment_size;
+  w->u.seg.alloc_fnc = alloc_fnc;
+  w->u.seg.free_fnc = free_fnc;
+  w->u.seg.fnc_value = fnc_value;
+  w->type = WRITER_TYPE_MEMSEG;
+  w->error = 0;
+  w->nwritten = 0;
+
+  return 0;
+}
+
+
+/**
+ * ksba_writer_get_mem_segments:
+ * @w: Writer object
+ * @idx: Index of the segment
+ * @r_buffer: Returns the address of the segment
+ * @r_length: Returns the number of bytes in the segment
+ *
+ * Return the segment with index @idx of a writer initialized with
+ * ksba_writer_set_mem_segments.  All segments but the last one are
+ * completely filled.  The returned buffer is valid as long as the
+ * writer is not released or reinitialized; further writes do not
+ * change it.  Calling this with increasing values for @idx starting at
+ * 0 until %GPG_ERR_EOF is returned yields the entire output.
+ *
+ * Return value: 0 on success, %GPG_ERR_EOF or another error code
+ **/
+gpg_error_t
+ksba_writer_get_mem_segments (ksba_writer_t w, unsigned int idx,
+                              const void **r_buffer, size_t *r_length)
+{
+  if (!w || !r_buffer || !r_length)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (w->type != WRITER_TYPE_MEMSEG)
+    return gpg_error (GPG_ERR_CONFLICT);
+  if (w->error)
+    return gpg_error_from_errno (w->error);
+  if (idx >= w->u.seg.nsegs)
+    return gpg_error (GPG_ERR_EOF);
+
+  *r_buffer = w->u.seg.segs[idx];
+  *r_length = (idx + 1 == w->u.seg.nsegs)? w->u.seg.lastlen
+                                          : w->u.seg.segsize;
+  return 0;
+}
+
+
 
+/**
+ * ksba_writer_set_queue:
+ * @w: Writer object
+ * @buffer_size: Size of each buffer or 0 for a default
+ * @put_fnc: Function to append a buffer to the queue
+ * @wait_fnc: Function to wait for the queue to drain or %NULL
+ * @fnc_value: Value passed to the queue functions
+ * @high_water: Number of queued bytes to start waiting at or 0
+ * @low_water: Number of queued bytes to wait for
+ *
+ * Initialize the writer object to hand its output to a queue which
+ * is maintained by the caller, for example to send it from another
+ * thread.  The output is collected in buffers of @buffer_size bytes;
+ * each filled buffer is passed to @put_fnc along with @fnc_value and
+ * its length.  The ownership of the buffer goes to the queue and the
+ * consumer needs to release it using ksba_free.  The buffers are
+ * always allocated using the global allocation functions and not
+ * from an allocator context; thus ksba_free must be called while no
+ * allocator context is entered.  This is the case while @put_fnc and
+ * @wait_fnc are called.  @put_fnc shall store
+ * the number of bytes now in the queue at its last argument.  If that
+ * number is at least @high_water, @wait_fnc is called with
+ * @fnc_value and @low_water and shall return when not more than
+ * @low_water bytes are left in the queue.  Any error returned by one
+ * of the functions is passed back to the caller of the write
+ * function.  A partly filled buffer is only passed on by
+ * ksba_writer_flush; thus this function needs to be called after the
+ * last write.
+ *
+ * Return value: 0 on success or an error code
+ **/
+gpg_error_t
+ksba_writer_set_queue (ksba_writer_t w, size_t buffer_size,
+                       gpg_error_t (*put_fnc)(void *, void *, size_t,
+                                              size_t *),
+                       gpg_error_t (*wait_fnc)(void *, size_t),
+                       void *fnc_value,
+                       size_t high_water, size_t low_water)
+{
+  if (!w || !put_fnc || (high_water && low_water >= high_water))
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (w->type)
+    return gpg_error (GPG_ERR_CONFLICT);
+
+  if (!buffer_size)
+    buffer_size = 16384;
+
+  w->u.queue.size = buffer_size;
+  w->u.queue.high_water = wait_fnc? high_water : 0;
+  w->u.queue.low_water = low_water;
+  w->u.queue.put_fnc = put_fnc;
+  w->u.queue.wait_fnc = wait_fnc;
+  w->u.queue.fnc_value = fnc_value;
+  w->u.queue.buf = NULL;
+  w->u.queue.length = 0;
+  w->type = WRITER_TYPE_QUEUE;
+  w->error = 0;
+  w->nwritten = 0;
+
+  return 0;
+}
+
+
+/* Allocate a new buffer for a WRITER_TYPE_QUEUE writer.  The buffer
+   is released by the consumer, possibly in another thread, and thus
+   not taken from the allocator context of the producer.  */
+static gpg_error_t
+alloc_queue_buffer (ksba_writer_t w)
+{
+  ksba_alloc_ctx_t prevctx;
+  gpg_error_t err = 0;
+
+  prevctx = _ksba_alloc_ctx_switch (NULL);
+  w->u.queue.buf = xtrymalloc (w->u.queue.size);
+  if (!w->u.queue.buf)
+    err = gpg_error_from_errno (errno);
+  _ksba_alloc_ctx_restore (prevctx);
+  w->u.queue.length = 0;
+  return err;
+}
+
+
+/* Pass the current buffer of a WRITER_TYPE_QUEUE writer to the
+   queue and wait for the queue to drain if needed.  */
+static gpg_error_t
+put_queue_buffer (ksba_writer_t w)
+{
+  gpg_error_t err;
+  size_t queued = 0;
+  ksba_alloc_ctx_t prevctx;
+
+  /* The queue functions may release buffers using ksba_free.  */
+  prevctx = _ksba_alloc_ctx_switch (NULL);
+  err = w->u.queue.put_fnc (w->u.queue.fnc_value,
+                            w->u.queue.buf, w->u.queue.length, &queued);
+  if (err)
+    goto leave;
+  /* The buffer now belongs to the queue.  */
+  w->u.queue.buf = NULL;
+  w->u.queue.length = 0;
+
+  if (w->u.queue.high_water && queued >= w->u.queue.high_water)
+    err = w->u.queue.wait_fnc (w->u.queue.fnc_value, w->u.queue.low_water);
+ leave:
+  _ksba_alloc_ctx_restore (prevctx);
+  return err;
+}
+
+
 gpg_error_t
 ksba_writer_set_filter (ksba_writer_t w,
                         gpg_error_t (*filter)(void*,
@@ -291,6 +530,142 @@ ksba_writer_set_filter (ksba_writer_t w,
 
 
 
+/* Write LENGTH bytes from BUFFER and then BLENGTH bytes from BBUFFER
+   to the file descriptor of W.  Either buffer may be empty.  If
+   available writev is used to do this with only one system call.  If
+   R_NWRITTEN is not NULL the number of bytes actually written is
+   stored there, also on error.  */
+static gpg_error_t
+write_fd (ksba_writer_t w, const void *buffer, size_t length,
+          const void *bbuffer, size_t blength, size_t *r_nwritten)
+{
+  size_t dummy;
+#ifdef HAVE_WRITEV
+  struct iovec iov[2];
+  struct iovec *v = iov;
+  int nv = 0;
+  ssize_t n;
+
+  if (!r_nwritten)
+    r_nwritten = &dummy;
+  *r_nwritten = 0;
+
+  if (length)
+    {
+      iov[nv].iov_base = (void*)buffer;
+      iov[nv].iov_len = length;
+      nv++;
+    }
+  if (blength)
+    {
+      iov[nv].iov_base = (void*)bbuffer;
+      iov[nv].iov_len = blength;
+      nv++;
+    }
+  while (nv)
+    {
+      n = writev (w->u.fd, v, nv);
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          w->error = errno;
+          return gpg_error_from_errno (errno);
+        }
+      if (!n)  /* Would loop forever.  */
+        {
+          w->error = EIO;
+          return gpg_error (GPG_ERR_EIO);
+        }
+      *r_nwritten += n;
+      /* Skip what has been written.  */
+      while (nv && n >= v->iov_len)
+        {
+          n -= v->iov_len;
+          v++;
+          nv--;
+        }
+      if (nv)
+        {
+          v->iov_base = (char*)v->iov_base + n;
+          v->iov_len -= n;
+        }
+    }
+#else /*!HAVE_WRITEV*/
+  const char *p;
+  ssize_t n;
+  int i;
+
+  if (!r_nwritten)
+    r_nwritten = &dummy;
+  *r_nwritten = 0;
+  for (i=0; i < 2; i++)
+    {
+      p = i? bbuffer : buffer;
+      n = i? blength : length;
+      while (n > 0)
+        {
+          ssize_t nw = write (w->u.fd, p, n);
+          if (nw < 0)
+            {
+              if (errno == EINTR)
+                continue;
+              w->error = errno;
+              return gpg_error_from_errno (errno);
+            }
+          if (!nw)
+            {
+              w->error = EIO;
+              return gpg_error (GPG_ERR_EIO);
+            }
+          *r_nwritten += nw;
+          p += nw;
+          n -= nw;
+        }
+    }
+#endif /*!HAVE_WRITEV*/
+  return 0;
+}
+
+
+/* Write out the batched data of W followed by LENGTH bytes from
+   BUFFER which may be NULL.  On error only the batched data which
+   has not yet been written is kept.  */
+static gpg_error_t
+flush_batch (ksba_writer_t w, const void *buffer, size_t length)
+{
+  gpg_error_t err = 0;
+  size_t n;
+
+  if (w->type == WRITER_TYPE_FD)
+    {
+      err = write_fd (w, w->batch.buf, w->batch.length, buffer, length, &n);
+      if (n >= w->batch.length)
+        w->batch.length = 0;
+      else if (n)
+        {
+          memmove (w->batch.buf, w->batch.buf + n, w->batch.length - n);
+          w->batch.length -= n;
+        }
+    }
+  else if (w->type == WRITER_TYPE_CB)
+    {
+      if (w->batch.length)
+        {
+          err = w->u.cb.fnc (w->u.cb.value, w->batch.buf, w->batch.length);
+          if (!err)
+            w->batch.length = 0;
+        }
+      if (!err && length)
+        err = w->u.cb.fnc (w->u.cb.value, buffer, length);
+    }
+  else
+    err = gpg_error (GPG_ERR_BUG);
+
+  return err;
+}
+
+
 static gpg_error_t
 do_writer_write (ksba_writer_t w, const void *buffer, size_t length)
 {
@@ -334,6 +709,87 @@ do_writer_write (ksba_writer_t w, const void *buffer, size_t length)
       memcpy (w->u.mem.buffer + w->nwritten, buffer, length);
       w->nwritten += length;
     }
+  else if (w->type == WRITER_TYPE_MEMSEG)
+    {
+      const unsigned char *p = buffer;
+      size_t n;
+
+      if (w->error == ENOMEM)
+        return gpg_error (GPG_ERR_ENOMEM);
+
+      while (length)
+        {
+          if (!w->u.seg.nsegs || w->u.seg.lastlen == w->u.seg.segsize)
+            {
+              unsigned char *seg;
+
+              if (w->u.seg.nsegs == w->u.seg.nalloced)
+                {
+                  size_t newsize = w->u.seg.nalloced + 32;
+                  unsigned char **tmp;
+
+                  tmp = xtryrealloc (w->u.seg.segs, newsize * sizeof *tmp);
+                  if (!tmp)
+                    {
+                      w->error = ENOMEM;
+                      return gpg_error (GPG_ERR_ENOMEM);
+                    }
+                  w->u.seg.segs = tmp;
+                  w->u.seg.nalloced = newsize;
+                }
+              if (w->u.seg.alloc_fnc)
+                seg = w->u.seg.alloc_fnc (w->u.seg.fnc_value,
+                                          w->u.seg.segsize);
+              else
+                seg = xtrymalloc (w->u.seg.segsize);
+              if (!seg)
+                {
+                  w->error = ENOMEM;
+                  return gpg_error (GPG_ERR_ENOMEM);
+                }
+              w->u.seg.segs[w->u.seg.nsegs++] = seg;
+              w->u.seg.lastlen = 0;
+            }
+          n = w->u.seg.segsize - w->u.seg.lastlen;
+          if (n > length)
+            n = length;
+          memcpy (w->u.seg.segs[w->u.seg.nsegs-1] + w->u.seg.lastlen, p, n);
+          w->u.seg.lastlen += n;
+          w->nwritten += n;
+          p += n;
+          length -= n;
+        }
+    }
+  else if (w->type == WRITER_TYPE_QUEUE)
+    {
+      const unsigned char *p = buffer;
+      gpg_error_t err;
+      size_t n;
+
+      while (length)
+        {
+          if (!w->u.queue.buf)
+            {
+              err = alloc_queue_buffer (w);
+              if (err)
+                return err;
+            }
+          n = w->u.queue.size - w->u.queue.length;
+          if (n > length)
+            n = length;
+          memcpy (w->u.queue.buf + w->u.queue.length, p, n);
+          w->u.queue.length += n;
+          w->nwritten += n;
+          p += n;
+          length -= n;
+          if (w->u.queue.length == w->u.queue.size)
+            {
+              err = put_queue_buffer (w);
+              if (err)
+                return err;
+            }
+        }
+    }
   else if (w->type == WRITER_TYPE_FILE)
     {
       if (!length)
@@ -349,6 +805,30 @@ do_writer_write (ksba_writer_t w, const void *buffer, size_t length)
           return gpg_error_from_errno (errno);
         }
     }
+  else if (w->batch.size
+           && (w->type == WRITER_TYPE_FD || w->type == WRITER_TYPE_CB))
+    {
+      if (w->batch.length + length <= w->batch.size)
+        {
+          memcpy (w->batch.buf + w->batch.length, buffer, length);
+          w->batch.length += length;
+        }
+      else
+        {
+          /* Send the pending data along with this chunk.  */
+          gpg_error_t err = flush_batch (w, buffer, length);
+          if (err)
+            return err;
+        }
+      w->nwritten += length;
+    }
+  else if (w->type == WRITER_TYPE_FD)
+    {
+      gpg_error_t err = write_fd (w, buffer, length, NULL, 0, NULL);
+      if (err)
+        return err;
+      w->nwritten += length;
+    }
   else if (w->type == WRITER_TYPE_CB)
     {
       int err = w->u.cb.fnc (w->u.cb.value, buffer, length);
@@ -362,6 +842,159 @@ do_writer_write (ksba_writer_t w, const void *buffer, size_t length)
   return 0;
 }
 
+/* Return in R_BUF and R_SIZE free space of at least MINSIZE bytes in
+   the own buffer of W so that a filter can write its output directly
+   into it.  R_BUF is set to NULL if W has no such buffer.  */
+static gpg_error_t
+get_filter_space (ksba_writer_t w, size_t minsize,
+                  unsigned char **r_buf, size_t *r_size)
+{
+  gpg_error_t err;
+
+  *r_buf = NULL;
+  *r_size = 0;
+  if (w->batch.size >= minsize
+      && (w->type == WRITER_TYPE_FD || w->type == WRITER_TYPE_CB))
+    {
+      if (w->batch.size - w->batch.length < minsize)
+        {
+          err = flush_batch (w, NULL, 0);
+          if (err)
+            return err;
+        }
+      *r_buf = w->batch.buf + w->batch.length;
+      *r_size = w->batch.size - w->batch.length;
+    }
+  else if (w->type == WRITER_TYPE_QUEUE && w->u.queue.size >= minsize)
+    {
+      if (w->u.queue.buf && w->u.queue.size - w->u.queue.length < minsize)
+        {
+          err = put_queue_buffer (w);
+          if (err)
+            return err;
+        }
+      if (!w->u.queue.buf)
+        {
+          err = alloc_queue_buffer (w);
+          if (err)
+            return err;
+        }
+      *r_buf = w->u.queue.buf + w->u.queue.length;
+      *r_size = w->u.queue.size - w->u.queue.length;
+    }
+  return 0;
+}
+
+
+/* Account for LENGTH bytes a filter wrote into the space returned by
+   get_filter_space.  */
+static gpg_error_t
+put_filter_space (ksba_writer_t w, size_t length)
+{
+  w->nwritten += length;
+  if (w->type == WRITER_TYPE_QUEUE)
+    {
+      w->u.queue.length += length;
+      if (w->u.queue.length == w->u.queue.size)
+        return put_queue_buffer (w);
+    }
+  else
+    w->batch.length += length;
+  return 0;
+}
+
+
+/**
+ * ksba_writer_set_buffer_size:
+ * @w: Writer object
+ * @size: Size of the batch buffer or 0 to disable batching
+ *
+ * Enable batching of writes for a writer initialized with
+ * ksba_writer_set_fd or ksba_writer_set_cb.  Small writes, like the
+ * tag and length headers written by the encoders, are collected in a
+ * buffer of @size bytes instead of being passed on one by one.  The
+ * buffer is written out along with the next write which does not fit
+ * into it; for a file descriptor writev is used for this.  Batching
+ * is disabled by default.  If enabled the caller should call
+ * ksba_writer_flush to make sure that all data has been written;
+ * otherwise the remaining data is written by ksba_writer_release
+ * without a way to report an error.
+ *
+ * Return value: 0 on success or an error code
+ **/
+gpg_error_t
+ksba_writer_set_buffer_size (ksba_writer_t w, size_t size)
+{
+  gpg_error_t err;
+  unsigned char *buf;
+
+  if (!w)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (w->type != WRITER_TYPE_FD && w->type != WRITER_TYPE_CB)
+    return gpg_error (GPG_ERR_NOT_IMPLEMENTED);
+
+  if (w->batch.length)
+    {
+      err = flush_batch (w, NULL, 0);
+      if (err)
+        return err;
+    }
+  if (!size)
+    buf = NULL;
+  else
+    {
+      buf = xtrymalloc (size);
+      if (!buf)
+        return gpg_error_from_errno (errno);
+    }
+  xfree (w->batch.buf);
+  w->batch.buf = buf;
+  w->batch.size = size;
+
+  return 0;
+}
+
+
+/**
+ * ksba_writer_flush:
+ * @w: Writer object
+ *
+ * Write out all data batched up in @w.  For a writer initialized
+ * with ksba_writer_set_file the stream is flushed as well; for a
+ * writer initialized with ksba_writer_set_queue a partly filled
+ * buffer is passed to the queue.
+ *
+ * Return value: 0 on success or an error code
+ **/
+gpg_error_t
+ksba_writer_flush (ksba_writer_t w)
+{
+  gpg_error_t err;
+
+  if (!w)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  if (w->batch.length)
+    {
+      err = flush_batch (w, NULL, 0);
+      if (err)
+        return err;
+    }
+  if (w->type == WRITER_TYPE_QUEUE && w->u.queue.length)
+    {
+      err = put_queue_buffer (w);
+      if (err)
+        return err;
+    }
+  if (w->type == WRITER_TYPE_FILE && fflush (w->u.file))
+    {
+      w->error = errno;
+      return gpg_error_from_errno (errno);
+    }
+  return 0;
+}
+
+
 /**
  * ksba_writer_write:
  * @w: Writer object
@@ -386,18 +1019,34 @@ ksba_writer_write (ksba_writer_t w, const void *buffer, size_t length)
   if (w->filter)
     {
       char outbuf[4096];
-      size_t nin, nout;
+      unsigned char *space;
+      size_t spacelen, nin, nout;
       const char *p = buffer;
 
       while (length)
         {
-          err = w->filter (w->filter_arg, p, length, &nin,
-                           outbuf, sizeof (outbuf), &nout);
+          /* If W has a buffer of its own the filter writes into it
+             directly and we avoid the copy from OUTBUF.  */
+          err = get_filter_space (w, sizeof (outbuf), &space, &spacelen);
+          if (err)
+            break;
+          if (space)
+            err = w->filter (w->filter_arg, p, length, &nin,
+                             space, spacelen, &nout);
+          else
+            {
+              spacelen = sizeof (outbuf);
+              err = w->filter (w->filter_arg, p, length, &nin,
+                               outbuf, spacelen, &nout);
+            }
           if (err)
             break;
-          if (nin > length || nout > sizeof (outbuf))
+          if (nin > length || nout > spacelen)
             return gpg_error (GPG_ERR_BUG); /* tsss, someone else made an error */
-          err = do_writer_write (w, outbuf, nout);
+          if (space)
+            err = put_filter_space (w, nout);
+          else
+            err = do_writer_write (w, outbuf, nout);
           if (err)
             break;
           length -= nin;
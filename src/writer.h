@@ -38,7 +38,9 @@ enum writer_type {
   WRITER_TYPE_FD,
   WRITER_TYPE_FILE,
   WRITER_TYPE_CB,
-  WRITER_TYPE_MEM
+  WRITER_TYPE_MEM,
+  WRITER_TYPE_MEMSEG,
+  WRITER_TYPE_QUEUE
 };
 
 
@@ -53,6 +55,12 @@ struct ksba_writer_s {
                       void *, size_t, size_t *);
   void *filter_arg;
 
+  struct {
+    unsigned char *buf;
+    size_t size;    /* allocated size; 0 if batching is disabled */
+    size_t length;  /* used size */
+  } batch;          /* for WRITER_TYPE_FD and WRITER_TYPE_CB */
+
   union {
     int fd;  /* for WRITER_TYPE_FD */
     FILE *file; /* for WRITER_TYPE_FILE */
@@ -64,6 +72,26 @@ struct ksba_writer_s {
       unsigned char *buffer;
       size_t size;
     } mem;   /* for WRITER_TYPE_MEM */
+    struct {
+      unsigned char **segs; /* Array with the segments.  */
+      size_t nsegs;         /* Number of used segments.  */
+      size_t nalloced;      /* Allocated size of SEGS.  */
+      size_t segsize;       /* Size of each segment.  */
+      size_t lastlen;       /* Used length of the last segment.  */
+      void *(*alloc_fnc)(void *, size_t);
+      void (*free_fnc)(void *, void *);
+      void *fnc_value;
+    } seg;   /* for WRITER_TYPE_MEMSEG */
+    struct {
+      unsigned char *buf;   /* The buffer being filled or NULL.  */
+      size_t size;          /* Size of each buffer.  */
+      size_t length;        /* Used length of BUF.  */
+      size_t high_water;    /* Wait if that many bytes are queued.  */
+      size_t low_water;     /* ... until not more than this are queued.  */
+      gpg_error_t (*put_fnc)(void *, void *, size_t, size_t *);
+      gpg_error_t (*wait_fnc)(void *, size_t);
+      void *fnc_value;
+    } queue; /* for WRITER_TYPE_QUEUE */
   } u;
   void (*notify_cb)(void*,ksba_writer_t);
   void *notify_cb_value;
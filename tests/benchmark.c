@@ -0,0 +1,619 @@
+/* benchmark.c - Performance benchmarks for KSBA
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * KSBA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This program is not run by "make check" but by "make bench".  All
+   input data is either taken from the samples directory or generated
+   from a fixed seed so that the results of different runs and
+   different versions of the library can be compared.  The results
+   are printed as one JSON object to stdout.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include "../src/ksba.h"
+
+#define PGM "benchmark"
+
+#include "t-common.h"
+
+
+static int verbose;
+
+/* Multiplier for the number of iterations.  */
+static unsigned int repeat = 1;
+
+/* The number of entries of the synthetic CRL.  */
+static unsigned int crl_entries = 100000;
+
+/* The size of the content of the synthetic CMS object.  */
+static size_t cms_content_size = 4 * 1024 * 1024;
+
+/* The seed for the generated data.  */
+static unsigned long seed = 42;
+
+/* Set after the first result has been printed.  */
+static int any_result;
+
+
+static double
+get_time (void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  if (!clock_gettime (CLOCK_MONOTONIC, &ts))
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+  return (double)clock () / CLOCKS_PER_SEC;
+}
+
+
+/* Print one result.  UNITS is the number of processed units (e.g.
+   bytes or certificates) per iteration.  */
+static void
+print_result (const char *name, const char *unit, double units,
+              unsigned long iterations, double seconds)
+{
+  if (seconds <= 0)
+    seconds = 1e-9;
+  printf ("%s\n    {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.2f,"
+          " \"iterations\": %lu, \"seconds\": %.6f}",
+          any_result? ",":"", name, unit, units * iterations / seconds,
+          iterations, seconds);
+  any_result = 1;
+  if (verbose)
+    fprintf (stderr, PGM ": %-20s %14.2f %s\n",
+             name, units * iterations / seconds, unit);
+}
+
+
+static void *
+read_file (const char *fname, size_t *r_length)
+{
+  FILE *fp;
+  char *buf;
+  size_t buflen;
+  long size;
+
+  fp = fopen (fname, "rb");
+  if (!fp)
+    {
+      fprintf (stderr, PGM": can't open `%s': %s\n", fname, strerror (errno));
+      exit (1);
+    }
+  if (fseek (fp, 0, SEEK_END) || (size = ftell (fp)) < 0
+      || fseek (fp, 0, SEEK_SET))
+    {
+      fprintf (stderr, PGM": can't seek `%s': %s\n", fname, strerror (errno));
+      exit (1);
+    }
+  buflen = size;
+  buf = xmalloc (buflen + 1);
+  if (fread (buf, buflen, 1, fp) != 1)
+    {
+      fprintf (stderr, PGM": error reading `%s': %s\n",
+               fname, strerror (errno));
+      exit (1);
+    }
+  fclose (fp);
+  *r_length = buflen;
+  return buf;
+}
+
+
+/* Return the object written by FNC to a memory writer.  */
+static unsigned char *
+make_object (gpg_error_t (*fnc)(ksba_writer_t, unsigned long long),
+             unsigned long long arg, size_t *r_length)
+{
+  gpg_error_t err;
+  ksba_writer_t w;
+  unsigned char *der;
+
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_mem (w, 65536);
+  fail_if_err (err);
+  err = fnc (w, arg);
+  fail_if_err (err);
+  der = ksba_writer_snatch_mem (w, r_length);
+  if (!der)
+    fail ("out of core");
+  ksba_writer_release (w);
+  return der;
+}
+
+
+static gpg_error_t
+make_crl (ksba_writer_t w, unsigned long long nentries)
+{
+  return synth_crl (w, nentries);
+}
+
+
+
+/*
+ * Micro benchmarks
+ */
+
+/* Walk over all tag-length headers of DER with a DER cursor.
+   Returns the number of elements.  */
+static unsigned long
+walk_der (const unsigned char *der, size_t derlen)
+{
+  gpg_error_t err;
+  struct ksba_der_cursor_s cursor;
+  int class, tag, constructed;
+  size_t length;
+  unsigned long count = 0;
+
+  ksba_der_cursor_init (&cursor, der, derlen);
+  for (;;)
+    {
+      err = ksba_der_cursor_next (&cursor, &class, &tag, &constructed,
+                                  &length);
+      if (gpg_err_code (err) == GPG_ERR_EOF)
+        {
+          /* End of this level.  */
+          if (ksba_der_cursor_leave (&cursor))
+            break;
+          continue;
+        }
+      fail_if_err (err);
+      count++;
+      if (constructed)
+        {
+          err = ksba_der_cursor_enter (&cursor);
+          fail_if_err (err);
+        }
+    }
+  return count;
+}
+
+
+/* Note that this measures the DER cursor and not the TL reader used by
+   the BER decoder, which is internal to the library.  */
+static void
+bench_der_cursor (const unsigned char *der, size_t derlen)
+{
+  unsigned long iterations = 10 * repeat;
+  unsigned long i, count = 0;
+  double start;
+
+  start = get_time ();
+  for (i=0; i < iterations; i++)
+    count = walk_der (der, derlen);
+  print_result ("der-cursor", "tl/s", count, iterations,
+                get_time () - start);
+}
+
+
+/* The trees are shared and thus, except for the first call, this
+   measures the lookup in the module cache.  */
+static void
+bench_create_tree (void)
+{
+  gpg_error_t err;
+  ksba_asn_tree_t tree;
+  unsigned long iterations = 50000 * repeat;
+  unsigned long i;
+  double start;
+
+  start = get_time ();
+  for (i=0; i < iterations; i++)
+    {
+      err = ksba_asn_create_tree ("tmttv2", &tree);
+      fail_if_err (err);
+      ksba_asn_tree_release (tree);
+    }
+  print_result ("asn-create-tree", "trees/s", 1, iterations,
+                get_time () - start);
+}
+
+
+static void
+bench_oid_to_str (void)
+{
+  static const char *oids[] =
+    {
+     "1.2.840.113549.1.1.11",
+     "2.5.4.3",
+     "2.5.29.21",
+     "1.3.6.1.5.5.7.48.1.1",
+     "2.16.840.1.101.3.4.2.1",
+     "1.3.101.112",
+     "1.2.840.10045.3.1.7",
+     "0.9.2342.19200300.100.1.25"
+    };
+  enum { NOIDS = sizeof oids / sizeof *oids };
+  gpg_error_t err;
+  unsigned char *der[NOIDS];
+  size_t derlen[NOIDS];
+  unsigned long iterations = 100000 * repeat;
+  unsigned long i;
+  unsigned int n;
+  char *str;
+  double start;
+
+  for (n=0; n < NOIDS; n++)
+    {
+      err = ksba_oid_from_str (oids[n], der + n, derlen + n);
+      fail_if_err (err);
+    }
+
+  start = get_time ();
+  for (i=0; i < iterations; i++)
+    for (n=0; n < NOIDS; n++)
+      {
+        str = ksba_oid_to_str ((char*)der[n], derlen[n]);
+        if (!str)
+          fail ("ksba_oid_to_str failed");
+        xfree (str);
+      }
+  print_result ("oid-to-str", "oids/s", NOIDS, iterations,
+                get_time () - start);
+
+  for (n=0; n < NOIDS; n++)
+    xfree (der[n]);
+}
+
+
+static void
+bench_dn_to_str (void)
+{
+  static const char *dns[] =
+    {
+     "CN=Benchmark CA,O=g10 Code GmbH,C=DE",
+     "CN=Werner Koch,OU=Test,O=g10 Code GmbH,L=Duesseldorf,C=DE",
+     "EMAIL=ca@example.org,CN=Example Root,O=Example\\, Inc.,C=US",
+     "CN=www.example.org,OU=Web,O=Example Org,ST=NRW,C=DE"
+    };
+  enum { NDNS = sizeof dns / sizeof *dns };
+  gpg_error_t err;
+  unsigned char *der[NDNS];
+  size_t derlen[NDNS];
+  unsigned long iterations = 50000 * repeat;
+  unsigned long i;
+  unsigned int n;
+  char *str;
+  double start;
+
+  for (n=0; n < NDNS; n++)
+    {
+      err = ksba_dn_str2der (dns[n], der + n, derlen + n);
+      fail_if_err (err);
+    }
+
+  start = get_time ();
+  for (i=0; i < iterations; i++)
+    for (n=0; n < NDNS; n++)
+      {
+        err = ksba_dn_der2str (der[n], derlen[n], &str);
+        fail_if_err (err);
+        xfree (str);
+      }
+  print_result ("dn-to-str", "dns/s", NDNS, iterations,
+                get_time () - start);
+
+  for (n=0; n < NDNS; n++)
+    xfree (der[n]);
+}
+
+
+
+/*
+ * Macro benchmarks
+ */
+
+static void
+bench_certs (void)
+{
+  static const char *files[] =
+    {
+     "samples/cert_dfn_pca01.der",
+     "samples/cert_dfn_pca15.der",
+     "samples/cert_g10code_test1.der",
+     "samples/ov-root-ca-cert.crt",
+     "samples/ov-server.crt",
+     "samples/secp256r1-sha384_cert.crt",
+     "samples/ed25519-rfc8410.crt"
+    };
+  enum { NFILES = sizeof files / sizeof *files };
+  gpg_error_t err;
+  char *image[NFILES];
+  size_t imagelen[NFILES];
+  ksba_cert_t cert;
+  unsigned long iterations = 2000 * repeat;
+  unsigned long i;
+  unsigned int n;
+  char *fname;
+  double start;
+
+  for (n=0; n < NFILES; n++)
+    {
+      fname = prepend_srcdir (files[n]);
+      image[n] = read_file (fname, imagelen + n);
+      xfree (fname);
+    }
+
+  start = get_time ();
+  for (i=0; i < iterations; i++)
+    for (n=0; n < NFILES; n++)
+      {
+        err = ksba_cert_new (&cert);
+        fail_if_err (err);
+        err = ksba_cert_init_from_mem (cert, image[n], imagelen[n]);
+        fail_if_err2 (files[n], err);
+        ksba_cert_release (cert);
+      }
+  print_result ("cert-parse", "certs/s", NFILES, iterations,
+                get_time () - start);
+
+  for (n=0; n < NFILES; n++)
+    xfree (image[n]);
+}
+
+
+static ksba_crl_t
+open_crl (const unsigned char *der, size_t derlen, ksba_reader_t *r_reader)
+{
+  gpg_error_t err;
+  ksba_crl_t crl;
+
+  err = ksba_reader_new (r_reader);
+  fail_if_err (err);
+  err = ksba_reader_set_mem (*r_reader, der, derlen);
+  fail_if_err (err);
+  err = ksba_crl_new (&crl);
+  fail_if_err (err);
+  err = ksba_crl_set_reader (crl, *r_reader);
+  fail_if_err (err);
+  return crl;
+}
+
+
+/* Parse the CRL entry by entry as done by most applications.  */
+static void
+bench_crl (const unsigned char *der, size_t derlen)
+{
+  gpg_error_t err;
+  ksba_reader_t r;
+  ksba_crl_t crl;
+  ksba_stop_reason_t stopreason;
+  ksba_sexp_t serial;
+  unsigned long iterations = 5 * repeat;
+  unsigned long i, count;
+  double start;
+
+  start = get_time ();
+  for (i=0; i < iterations; i++)
+    {
+      count = 0;
+      crl = open_crl (der, derlen, &r);
+      do
+        {
+          err = ksba_crl_parse (crl, &stopreason);
+          fail_if_err (err);
+          if (stopreason == KSBA_SR_GOT_ITEM)
+            {
+              err = ksba_crl_get_item (crl, &serial, NULL, NULL);
+              fail_if_err (err);
+              xfree (serial);
+              count++;
+            }
+        }
+      while (stopreason != KSBA_SR_READY);
+      if (count != crl_entries)
+        fail ("wrong number of CRL entries");
+      ksba_crl_release (crl);
+      ksba_reader_release (r);
+    }
+  print_result ("crl-entries", "entries/s", crl_entries, iterations,
+                get_time () - start);
+}
+
+
+/* Parse the CRL using ksba_crl_get_items.  */
+static void
+bench_crl_batch (const unsigned char *der, size_t derlen)
+{
+  gpg_error_t err;
+  ksba_reader_t r;
+  ksba_crl_t crl;
+  ksba_stop_reason_t stopreason;
+  struct ksba_crl_entry_s entries[256];
+  unsigned long iterations = 5 * repeat;
+  unsigned long i, count;
+  unsigned int n;
+  double start;
+
+  start = get_time ();
+  for (i=0; i < iterations; i++)
+    {
+      count = 0;
+      crl = open_crl (der, derlen, &r);
+      stopreason = 0;
+      do
+        {
+          err = ksba_crl_get_items (crl, entries,
+                                    sizeof entries / sizeof *entries, &n,
+                                    &stopreason);
+          fail_if_err (err);
+          count += n;
+        }
+      while (stopreason == KSBA_SR_GOT_ITEM);
+      err = ksba_crl_parse (crl, &stopreason);
+      fail_if_err (err);
+      if (stopreason != KSBA_SR_READY || count != crl_entries)
+        fail ("wrong number of CRL entries");
+      ksba_crl_release (crl);
+      ksba_reader_release (r);
+    }
+  print_result ("crl-entries-batch", "entries/s", crl_entries, iterations,
+                get_time () - start);
+}
+
+
+static void
+count_hash (void *arg, const void *buffer, size_t length)
+{
+  size_t *total = arg;
+
+  (void)buffer;
+  *total += length;
+}
+
+
+static int
+discard_writer_cb (void *cb_value, const void *buffer, size_t count)
+{
+  (void)cb_value;
+  (void)buffer;
+  (void)count;
+  return 0;
+}
+
+
+/* Measure the rate at which the content of a signed-data object is
+   passed to the hash function.  */
+static void
+bench_cms_hash (const unsigned char *der, size_t derlen)
+{
+  gpg_error_t err;
+  ksba_reader_t r;
+  ksba_writer_t w;
+  ksba_cms_t cms;
+  ksba_stop_reason_t stopreason;
+  unsigned long iterations = 32 * repeat;
+  unsigned long i;
+  size_t total;
+  double start;
+
+  start = get_time ();
+  for (i=0; i < iterations; i++)
+    {
+      total = 0;
+      err = ksba_reader_new (&r);
+      fail_if_err (err);
+      err = ksba_reader_set_mem (r, der, derlen);
+      fail_if_err (err);
+      err = ksba_writer_new (&w);
+      fail_if_err (err);
+      err = ksba_writer_set_cb (w, discard_writer_cb, NULL);
+      fail_if_err (err);
+      err = ksba_cms_new (&cms);
+      fail_if_err (err);
+      err = ksba_cms_set_reader_writer (cms, r, w);
+      fail_if_err (err);
+      ksba_cms_set_hash_function (cms, count_hash, &total);
+      do
+        {
+          err = ksba_cms_parse (cms, &stopreason);
+          fail_if_err (err);
+        }
+      while (stopreason != KSBA_SR_READY);
+      if (total != cms_content_size)
+        fail ("wrong number of bytes hashed");
+      ksba_cms_release (cms);
+      ksba_writer_release (w);
+      ksba_reader_release (r);
+    }
+  print_result ("cms-hash", "MiB/s", cms_content_size / (1024.0 * 1024.0),
+                iterations, get_time () - start);
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  unsigned char *crl, *cms;
+  size_t crllen, cmslen;
+
+  if (argc)
+    {
+      argc--;  argv++;
+    }
+
+  while (argc && **argv == '-')
+    {
+      if (!strcmp (*argv, "--verbose"))
+        {
+          verbose = 1;
+          argc--; argv++;
+        }
+      else if (!strcmp (*argv, "--repeat") && argc > 1)
+        {
+          repeat = strtoul (argv[1], NULL, 10);
+          argc -= 2; argv += 2;
+        }
+      else if (!strcmp (*argv, "--crl-entries") && argc > 1)
+        {
+          crl_entries = strtoul (argv[1], NULL, 10);
+          argc -= 2; argv += 2;
+        }
+      else if (!strcmp (*argv, "--cms-size") && argc > 1)
+        {
+          cms_content_size = strtoul (argv[1], NULL, 10);
+          argc -= 2; argv += 2;
+        }
+      else if (!strcmp (*argv, "--seed") && argc > 1)
+        {
+          seed = strtoul (argv[1], NULL, 10);
+          argc -= 2; argv += 2;
+        }
+      else
+        break;
+    }
+  if (argc || !repeat || !crl_entries)
+    {
+      fputs ("usage: "PGM" [--verbose] [--repeat N] [--crl-entries N]"
+             " [--cms-size N] [--seed N]\n", stderr);
+      return 1;
+    }
+
+  synth_set_seed (seed);
+  crl = make_object (make_crl, crl_entries, &crllen);
+  cms = make_object (synth_cms, cms_content_size, &cmslen);
+
+  printf ("{\n  \"version\": \"%s\",\n"
+          "  \"corpus\": {\"seed\": %lu, \"crl-entries\": %u,"
+          " \"crl-size\": %lu, \"cms-size\": %lu},\n"
+          "  \"benchmarks\": [",
+          ksba_check_version (NULL), seed, crl_entries,
+          (unsigned long)crllen, (unsigned long)cmslen);
+
+  bench_der_cursor (crl, crllen);
+  bench_create_tree ();
+  bench_oid_to_str ();
+  bench_dn_to_str ();
+  bench_certs ();
+  bench_crl (crl, crllen);
+  bench_crl_batch (crl, crllen);
+  bench_cms_hash (cms, cmslen);
+
+  printf ("\n  ]\n}\n");
+
+  xfree (crl);
+  xfree (cms);
+  return 0;
+}
@@ -429,6 +429,561 @@ list_extensions (ksba_cert_t cert)
 }
 
 
+struct hash_buffer_s
+{
+  unsigned char *buffer;
+  size_t length;
+};
+
+static void
+hash_to_buffer (void *arg, const void *data, size_t length)
+{
+  struct hash_buffer_s *hb = arg;
+
+  hb->buffer = realloc (hb->buffer, hb->length + length);
+  if (!hb->buffer)
+    {
+      fprintf (stderr, "%s:%d: out of core\n", __FILE__, __LINE__);
+      exit (1);
+    }
+  memcpy (hb->buffer + hb->length, data, length);
+  hb->length += length;
+}
+
+
+/* Check that a lazily read copy of CERT returns the same values.  */
+static void
+check_lazy (const char *fname, ksba_cert_t cert)
+{
+  gpg_error_t err;
+  ksba_cert_t lazy;
+  const unsigned char *image, *image2;
+  size_t imagelen, imagelen2;
+  struct hash_buffer_s hb, hb2;
+  ksba_sexp_t serial, serial2;
+  char *dn, *dn2;
+  const char *oid, *oid2;
+  int what, idx;
+
+  image = ksba_cert_get_image (cert, &imagelen);
+  if (!image)
+    fail_if_err2 (fname, gpg_error (GPG_ERR_NO_VALUE));
+  err = ksba_cert_new (&lazy);
+  fail_if_err (err);
+  err = ksba_cert_set_lazy (lazy, 1);
+  fail_if_err (err);
+  err = ksba_cert_init_from_mem (lazy, image, imagelen);
+  fail_if_err2 (fname, err);
+
+  /* First the values available without decoding.  */
+  image2 = ksba_cert_get_image (lazy, &imagelen2);
+  if (!image2 || imagelen2 != imagelen || memcmp (image, image2, imagelen))
+    {
+      fprintf (stderr, "%s:%d: lazy image mismatch in `%s'\n",
+               __FILE__, __LINE__, fname);
+      errorcount++;
+    }
+  for (what=0; what < 2; what++)
+    {
+      memset (&hb, 0, sizeof hb);
+      memset (&hb2, 0, sizeof hb2);
+      err = ksba_cert_hash (cert, what, hash_to_buffer, &hb);
+      fail_if_err (err);
+      err = ksba_cert_hash (lazy, what, hash_to_buffer, &hb2);
+      fail_if_err (err);
+      if (hb.length != hb2.length || memcmp (hb.buffer, hb2.buffer, hb.length))
+        {
+          fprintf (stderr, "%s:%d: lazy hash %d mismatch in `%s'\n",
+                   __FILE__, __LINE__, what, fname);
+          errorcount++;
+        }
+      free (hb.buffer);
+      free (hb2.buffer);
+    }
+  serial = ksba_cert_get_serial (cert);
+  serial2 = ksba_cert_get_serial (lazy);
+  if (!serial || !serial2 || strcmp ((char*)serial, (char*)serial2))
+    {
+      fprintf (stderr, "%s:%d: lazy serial mismatch in `%s'\n",
+               __FILE__, __LINE__, fname);
+      errorcount++;
+    }
+  ksba_free (serial);
+  ksba_free (serial2);
+
+  /* These need to decode the certificate.  */
+  for (idx=0; idx < 2; idx++)
+    {
+      if (idx)
+        {
+          dn = ksba_cert_get_subject (cert, 0);
+          dn2 = ksba_cert_get_subject (lazy, 0);
+        }
+      else
+        {
+          dn = ksba_cert_get_issuer (cert, 0);
+          dn2 = ksba_cert_get_issuer (lazy, 0);
+        }
+      if (!dn != !dn2 || (dn && strcmp (dn, dn2)))
+        {
+          fprintf (stderr, "%s:%d: lazy DN mismatch in `%s'\n",
+                   __FILE__, __LINE__, fname);
+          errorcount++;
+        }
+      ksba_free (dn);
+      ksba_free (dn2);
+    }
+  for (idx=0; ; idx++)
+    {
+      err = ksba_cert_get_extension (cert, idx, &oid, NULL, NULL, NULL);
+      if (gpg_err_code (err) == GPG_ERR_EOF)
+        break;
+      fail_if_err (err);
+      err = ksba_cert_get_extension (lazy, idx, &oid2, NULL, NULL, NULL);
+      fail_if_err2 (fname, err);
+      if (strcmp (oid, oid2))
+        {
+          fprintf (stderr, "%s:%d: lazy extension mismatch in `%s'\n",
+                   __FILE__, __LINE__, fname);
+          errorcount++;
+        }
+    }
+
+  ksba_cert_release (lazy);
+}
+
+
+/* Check the DER views of CERT and of a lazily read copy.  */
+static void
+check_views (const char *fname, ksba_cert_t cert)
+{
+  gpg_error_t err;
+  ksba_cert_t lazy, c;
+  const unsigned char *image, *der, *der2, *ext;
+  size_t imagelen, derlen, derlen2, extoff, extlen, n;
+  struct hash_buffer_s hb;
+  ksba_sexp_t serial;
+  char *endp;
+  int pass, tag;
+
+  image = ksba_cert_get_image (cert, &imagelen);
+  if (!image)
+    fail_if_err2 (fname, gpg_error (GPG_ERR_NO_VALUE));
+  err = ksba_cert_new (&lazy);
+  fail_if_err (err);
+  err = ksba_cert_set_lazy (lazy, 1);
+  fail_if_err (err);
+  err = ksba_cert_init_from_mem (lazy, image, imagelen);
+  fail_if_err2 (fname, err);
+
+  for (pass=0; pass < 2; pass++)
+    {
+      c = pass? lazy : cert;
+      image = ksba_cert_get_image (c, &imagelen);
+
+      err = ksba_cert_get_view (c, KSBA_CERT_VIEW_CERT, &der, &derlen, &tag);
+      fail_if_err2 (fname, err);
+      if (der != image || derlen != imagelen || tag != 16)
+        {
+          fprintf (stderr, "%s:%d: certificate view mismatch in `%s'\n",
+                   __FILE__, __LINE__, fname);
+          errorcount++;
+        }
+
+      memset (&hb, 0, sizeof hb);
+      err = ksba_cert_hash (c, 1, hash_to_buffer, &hb);
+      fail_if_err (err);
+      err = ksba_cert_get_view (c, KSBA_CERT_VIEW_TBS, &der, &derlen, NULL);
+      fail_if_err2 (fname, err);
+      if (derlen != hb.length || memcmp (der, hb.buffer, derlen))
+        {
+          fprintf (stderr, "%s:%d: TBS view mismatch in `%s'\n",
+                   __FILE__, __LINE__, fname);
+          errorcount++;
+        }
+      free (hb.buffer);
+
+      err = ksba_cert_get_view (c, KSBA_CERT_VIEW_ISSUER, &der, &derlen, &tag);
+      fail_if_err2 (fname, err);
+      err = ksba_cert_get_issuer_dn_ptr (c, &der2, &derlen2);
+      fail_if_err2 (fname, err);
+      if (der != der2 || derlen != derlen2 || tag != 16)
+        {
+          fprintf (stderr, "%s:%d: issuer view mismatch in `%s'\n",
+                   __FILE__, __LINE__, fname);
+          errorcount++;
+        }
+      err = ksba_cert_get_view (c, KSBA_CERT_VIEW_SUBJECT,
+                                &der, &derlen, &tag);
+      fail_if_err2 (fname, err);
+      err = ksba_cert_get_subject_dn_ptr (c, &der2, &derlen2);
+      fail_if_err2 (fname, err);
+      if (der != der2 || derlen != derlen2 || tag != 16)
+        {
+          fprintf (stderr, "%s:%d: subject view mismatch in `%s'\n",
+                   __FILE__, __LINE__, fname);
+          errorcount++;
+        }
+
+      /* The serial is returned as "(LEN:VALUE)".  */
+      err = ksba_cert_get_view (c, KSBA_CERT_VIEW_SERIAL,
+                                &der, &derlen, &tag);
+      fail_if_err2 (fname, err);
+      serial = ksba_cert_get_serial (c);
+      if (!serial)
+        fail_if_err2 (fname, gpg_error (GPG_ERR_NO_VALUE));
+      n = strtoul ((char*)serial+1, &endp, 10);
+      if (tag != 2 || derlen < n + 2
+          || memcmp (der + derlen - n, endp + 1, n))
+        {
+          fprintf (stderr, "%s:%d: serial view mismatch in `%s'\n",
+                   __FILE__, __LINE__, fname);
+          errorcount++;
+        }
+      ksba_free (serial);
+
+      err = ksba_cert_get_view (c, KSBA_CERT_VIEW_VALIDITY,
+                                &der, &derlen, &tag);
+      fail_if_err2 (fname, err);
+      err = ksba_cert_get_view (c, KSBA_CERT_VIEW_NOTBEFORE,
+                                &der2, &derlen2, &tag);
+      fail_if_err2 (fname, err);
+      if ((tag != 23 && tag != 24) || der2 != der + 2)
+        {
+          fprintf (stderr, "%s:%d: notBefore view mismatch in `%s'\n",
+                   __FILE__, __LINE__, fname);
+          errorcount++;
+        }
+      err = ksba_cert_get_view (c, KSBA_CERT_VIEW_NOTAFTER,
+                                &der2, &derlen2, &tag);
+      fail_if_err2 (fname, err);
+      if ((tag != 23 && tag != 24) || der2 + derlen2 != der + derlen)
+        {
+          fprintf (stderr, "%s:%d: notAfter view mismatch in `%s'\n",
+                   __FILE__, __LINE__, fname);
+          errorcount++;
+        }
+
+      err = ksba_cert_get_view (c, KSBA_CERT_VIEW_PUBKEY, &der, &derlen, &tag);
+      fail_if_err2 (fname, err);
+      if (tag != 16)
+        {
+          fprintf (stderr, "%s:%d: public key view mismatch in `%s'\n",
+                   __FILE__, __LINE__, fname);
+          errorcount++;
+        }
+      err = ksba_cert_get_view (c, KSBA_CERT_VIEW_SIGALGO,
+                                &der, &derlen, &tag);
+      fail_if_err2 (fname, err);
+      err = ksba_cert_get_view (c, KSBA_CERT_VIEW_SIGVAL,
+                                &der2, &derlen2, &tag);
+      fail_if_err2 (fname, err);
+      if (tag != 3 || der + derlen != der2 || der2 + derlen2 != image+imagelen)
+        {
+          fprintf (stderr, "%s:%d: signature view mismatch in `%s'\n",
+                   __FILE__, __LINE__, fname);
+          errorcount++;
+        }
+
+      /* The first extension must be the first element of the view.  */
+      err = ksba_cert_get_view (c, KSBA_CERT_VIEW_EXTENSIONS,
+                                &der, &derlen, &tag);
+      if (!ksba_cert_get_extension (c, 0, NULL, NULL, &extoff, &extlen))
+        {
+          fail_if_err2 (fname, err);
+          ext = image + extoff;
+          if (tag != 16 || ext <= der || ext + extlen > der + derlen)
+            {
+              fprintf (stderr, "%s:%d: extensions view mismatch in `%s'\n",
+                       __FILE__, __LINE__, fname);
+              errorcount++;
+            }
+        }
+      else if (gpg_err_code (err) != GPG_ERR_NO_VALUE)
+        {
+          fprintf (stderr, "%s:%d: expected NO_VALUE but got: %s\n",
+                   __FILE__, __LINE__, gpg_strerror (err));
+          errorcount++;
+        }
+    }
+
+  ksba_cert_release (lazy);
+}
+
+
+/* Compare the key identifier KEYID of length KEYIDLEN with the
+   canonical S-expression SEXP.  */
+static int
+keyid_matches (const unsigned char *keyid, size_t keyidlen,
+               ksba_const_sexp_t sexp)
+{
+  const char *s = (const char *)sexp;
+  char *endp;
+  unsigned long n;
+
+  if (!sexp)
+    return !keyidlen;
+  if (*s++ != '(')
+    return 0;
+  n = strtoul (s, &endp, 10);
+  return (*endp == ':' && n == keyidlen
+          && !memcmp (endp+1, keyid, keyidlen));
+}
+
+
+static gpg_error_t
+xor_digest (void *arg, const char *algo, const void *buffer, size_t length,
+            unsigned char *digest, size_t *r_digestlen)
+{
+  const unsigned char *p = buffer;
+  int *ncalls = arg;
+  size_t i;
+
+  if (strcmp (algo, "xor8") || *r_digestlen < 8)
+    return gpg_error (GPG_ERR_DIGEST_ALGO);
+  (*ncalls)++;
+  memset (digest, 0, 8);
+  for (i=0; i < length; i++)
+    digest[i % 8] ^= p[i];
+  *r_digestlen = 8;
+  return 0;
+}
+
+
+/* Check the cached key identifiers and fingerprints of CERT.  */
+static void
+check_key_ids (const char *fname, ksba_cert_t cert)
+{
+  gpg_error_t err;
+  const unsigned char *ski, *aki, *fpr, *fpr2, *image;
+  size_t skilen, akilen, fprlen, fprlen2, imagelen;
+  unsigned char expected[KSBA_MAX_DIGEST_LEN];
+  size_t expectedlen = sizeof expected;
+  ksba_sexp_t keyid, serial;
+  ksba_name_t name;
+  int ncalls = 0;
+
+  err = ksba_cert_get_key_ids (cert, &ski, &skilen, &aki, &akilen);
+  fail_if_err2 (fname, err);
+  keyid = NULL;
+  err = ksba_cert_get_subj_key_id (cert, NULL, &keyid);
+  if ((err && gpg_err_code (err) != GPG_ERR_NO_DATA)
+      || !keyid_matches (ski, skilen, keyid))
+    {
+      fprintf (stderr, "%s:%d: SKI mismatch in `%s'\n",
+               __FILE__, __LINE__, fname);
+      errorcount++;
+    }
+  ksba_free (keyid);
+  keyid = serial = NULL;
+  name = NULL;
+  err = ksba_cert_get_auth_key_id (cert, &keyid, &name, &serial);
+  if ((err && gpg_err_code (err) != GPG_ERR_NO_DATA)
+      || !keyid_matches (aki, akilen, keyid))
+    {
+      fprintf (stderr, "%s:%d: AKI mismatch in `%s'\n",
+               __FILE__, __LINE__, fname);
+      errorcount++;
+    }
+  ksba_free (keyid);
+  ksba_free (serial);
+  ksba_name_release (name);
+
+  err = ksba_cert_get_fingerprint (cert, KSBA_FPR_CERT, "xor8", NULL, NULL,
+                                   &fpr, &fprlen);
+  if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    fail ("fingerprint unexpectedly cached");
+  err = ksba_cert_get_fingerprint (cert, KSBA_FPR_CERT, "xor8",
+                                   xor_digest, &ncalls, &fpr, &fprlen);
+  fail_if_err2 (fname, err);
+  err = ksba_cert_get_fingerprint (cert, KSBA_FPR_CERT, "xor8",
+                                   xor_digest, &ncalls, &fpr2, &fprlen2);
+  fail_if_err2 (fname, err);
+  err = ksba_cert_get_fingerprint (cert, KSBA_FPR_SUBJECT, "xor8",
+                                   xor_digest, &ncalls, &fpr2, &fprlen2);
+  fail_if_err2 (fname, err);
+  image = ksba_cert_get_image (cert, &imagelen);
+  xor_digest (&ncalls, "xor8", image, imagelen, expected, &expectedlen);
+  if (fprlen != 8 || memcmp (fpr, expected, 8) || ncalls != 3)
+    {
+      fprintf (stderr, "%s:%d: fingerprint mismatch in `%s'\n",
+               __FILE__, __LINE__, fname);
+      errorcount++;
+    }
+}
+
+
+static void
+release_borrowed (void *opaque)
+{
+  int *count = opaque;
+
+  (*count)++;
+}
+
+
+/* Check that a certificate may reference the image of CERT.  */
+static void
+check_borrow (const char *fname, ksba_cert_t cert)
+{
+  gpg_error_t err;
+  ksba_cert_t ref;
+  unsigned char *buffer;
+  const unsigned char *image;
+  size_t imagelen, imagelen2;
+  char *dn, *dn2;
+  int lazy, count;
+
+  image = ksba_cert_get_image (cert, &imagelen);
+  if (!image)
+    fail_if_err2 (fname, gpg_error (GPG_ERR_NO_VALUE));
+  buffer = xmalloc (imagelen);
+  memcpy (buffer, image, imagelen);
+
+  for (lazy=0; lazy < 2; lazy++)
+    {
+      count = 0;
+      err = ksba_cert_new (&ref);
+      fail_if_err (err);
+      err = ksba_cert_set_lazy (ref, lazy);
+      fail_if_err (err);
+      err = ksba_cert_init_from_mem_ref (ref, buffer, imagelen,
+                                         release_borrowed, &count);
+      fail_if_err2 (fname, err);
+      if (ksba_cert_get_image (ref, &imagelen2) != buffer
+          || imagelen2 != imagelen)
+        {
+          fprintf (stderr, "%s:%d: image not borrowed in `%s'\n",
+                   __FILE__, __LINE__, fname);
+          errorcount++;
+        }
+      dn = ksba_cert_get_subject (cert, 0);
+      dn2 = ksba_cert_get_subject (ref, 0);
+      if (!dn != !dn2 || (dn && strcmp (dn, dn2)))
+        {
+          fprintf (stderr, "%s:%d: borrowed DN mismatch in `%s'\n",
+                   __FILE__, __LINE__, fname);
+          errorcount++;
+        }
+      ksba_free (dn);
+      ksba_free (dn2);
+      ksba_cert_release (ref);
+      if (count != 1)
+        {
+          fprintf (stderr, "%s:%d: release function not called for `%s'\n",
+                   __FILE__, __LINE__, fname);
+          errorcount++;
+        }
+    }
+  xfree (buffer);
+}
+
+
+/* Return the length of the canonical S-expression SEXP.  */
+static size_t
+sexp_length (const unsigned char *sexp)
+{
+  const unsigned char *p = sexp;
+  unsigned long n;
+  int depth = 0;
+
+  do
+    {
+      if (*p == '(')
+        depth++, p++;
+      else if (*p == ')')
+        depth--, p++;
+      else
+        {
+          for (n=0; *p >= '0' && *p <= '9'; p++)
+            n = n * 10 + *p - '0';
+          p += 1 + n;  /* Skip the colon and the value.  */
+        }
+    }
+  while (depth);
+  return p - sexp;
+}
+
+
+/* Return true if the element NAME with VALUE of LENGTH is included in
+   the S-expression SEXP.  */
+static int
+sexp_has_elem (ksba_const_sexp_t sexp, char name,
+               const unsigned char *value, size_t length)
+{
+  char prefix[30];
+  size_t n, plen, slen;
+  const unsigned char *s = sexp;
+
+  snprintf (prefix, sizeof prefix, "(1:%c%u:", name, (unsigned int)length);
+  plen = strlen (prefix);
+  slen = sexp_length (sexp);
+  for (n=0; n + plen + length + 1 <= slen; n++)
+    if (!memcmp (s + n, prefix, plen)
+        && !memcmp (s + n + plen, value, length)
+        && s[n + plen + length] == ')')
+      return 1;
+  return 0;
+}
+
+
+/* Check that the key descriptions match the S-expressions.  */
+static void
+check_keydesc (const char *fname, ksba_cert_t cert)
+{
+  gpg_error_t err;
+  struct ksba_keydesc_s desc;
+  ksba_sexp_t sexp;
+  int pass, i;
+
+  for (pass=0; pass < 2; pass++)
+    {
+      if (!pass)
+        {
+          sexp = ksba_cert_get_public_key (cert);
+          err = ksba_cert_get_public_key_desc (cert, &desc);
+        }
+      else
+        {
+          sexp = ksba_cert_get_sig_val (cert);
+          err = ksba_cert_get_sig_val_desc (cert, &desc);
+        }
+      if (!sexp)
+        {
+          if (!err)
+            {
+              fprintf (stderr, "%s:%d: key description without sexp "
+                       "in `%s'\n", __FILE__, __LINE__, fname);
+              errorcount++;
+            }
+          continue;
+        }
+      fail_if_err2 (fname, err);
+      if (!desc.nelem || !desc.algo)
+        {
+          fprintf (stderr, "%s:%d: empty key description in `%s'\n",
+                   __FILE__, __LINE__, fname);
+          errorcount++;
+        }
+      for (i=0; i < desc.nelem; i++)
+        if (!sexp_has_elem (sexp, desc.elem[i].name,
+                            desc.elem[i].value, desc.elem[i].length))
+          {
+            fprintf (stderr, "%s:%d: element '%c' mismatch in `%s'\n",
+                     __FILE__, __LINE__, desc.elem[i].name, fname);
+            errorcount++;
+          }
+      if (desc.curve && !strstr ((char*)sexp, desc.curve))
+        {
+          fprintf (stderr, "%s:%d: curve mismatch in `%s'\n",
+                   __FILE__, __LINE__, fname);
+          errorcount++;
+        }
+      ksba_free (sexp);
+    }
+}
+
+
 static void
 one_file (const char *fname)
 {
@@ -511,6 +1066,21 @@ one_file (const char *fname)
       print_time (t);
       putchar ('\n');
     }
+  for (idx=0; idx < 2; idx++)
+    {
+      ksba_epoch_t epoch;
+
+      err = ksba_cert_get_validity (cert, idx, t);
+      fail_if_err2 (fname, err);
+      err = ksba_cert_get_validity_epoch (cert, idx, &epoch);
+      fail_if_err2 (fname, err);
+      if (!epoch_matches (epoch, t))
+        {
+          fprintf (stderr, "%s:%d: validity epoch mismatch in `%s'\n",
+                   __FILE__, __LINE__, fname);
+          errorcount++;
+        }
+    }
   oid = ksba_cert_get_digest_algo (cert);
   s = get_oid_desc (oid);
   if (!quiet)
@@ -612,6 +1182,11 @@ one_file (const char *fname)
     }
 
   list_extensions (cert);
+  check_lazy (fname, cert);
+  check_views (fname, cert);
+  check_borrow (fname, cert);
+  check_key_ids (fname, cert);
+  check_keydesc (fname, cert);
 
   ksba_cert_release (cert);
   err = ksba_cert_new (&cert);
@@ -636,6 +1211,139 @@ one_file (const char *fname)
 
 
 
+/* State for check_bundle.  */
+struct bundle_parm_s
+{
+  const unsigned char *bundle;
+  size_t *offsets;
+  unsigned int count;
+  unsigned int stop_at;
+};
+
+static gpg_error_t
+bundle_cb (void *opaque, ksba_cert_t cert)
+{
+  struct bundle_parm_s *parm = opaque;
+  const unsigned char *image;
+  size_t imagelen, off;
+  char *dn;
+
+  if (parm->count == parm->stop_at)
+    return gpg_error (GPG_ERR_CANCELED);
+  off = parm->offsets[parm->count];
+  image = ksba_cert_get_image (cert, &imagelen);
+  if (!image || imagelen != parm->offsets[parm->count+1] - off
+      || memcmp (image, parm->bundle + off, imagelen))
+    {
+      fprintf (stderr, "%s:%d: image of certificate %u of the bundle"
+               " does not match\n", __FILE__, __LINE__, parm->count);
+      errorcount++;
+    }
+  dn = ksba_cert_get_subject (cert, 0);
+  if (!dn)
+    {
+      fprintf (stderr, "%s:%d: no subject in certificate %u of the bundle\n",
+               __FILE__, __LINE__, parm->count);
+      errorcount++;
+    }
+  ksba_free (dn);
+  parm->count++;
+  return 0;
+}
+
+
+/* Concatenate the certificates FILES and read them back in one go.  */
+static void
+check_bundle (const char *srcdir, const char **files)
+{
+  gpg_error_t err;
+  struct bundle_parm_s parm;
+  unsigned char *bundle = NULL;
+  size_t offsets[100];
+  size_t length = 0;
+  unsigned int nfiles, count, flags;
+  ksba_reader_t r;
+  char *fname;
+  FILE *fp;
+  long n;
+
+  for (nfiles=0; files[nfiles]; nfiles++)
+    {
+      fname = xmalloc (strlen (srcdir) + 10 + strlen (files[nfiles]) + 1);
+      strcpy (fname, srcdir);
+      strcat (fname, "/samples/");
+      strcat (fname, files[nfiles]);
+      fp = fopen (fname, "rb");
+      if (!fp || fseek (fp, 0, SEEK_END) || (n = ftell (fp)) < 0)
+        {
+          fprintf (stderr, "%s:%d: can't read `%s': %s\n",
+                   __FILE__, __LINE__, fname, strerror (errno));
+          exit (1);
+        }
+      rewind (fp);
+      bundle = ksba_realloc (bundle, length + n + 10);
+      if (!bundle || fread (bundle + length, n, 1, fp) != 1)
+        fail ("error reading a sample file");
+      fclose (fp);
+      ksba_free (fname);
+      offsets[nfiles] = length;
+      length += n;
+    }
+  offsets[nfiles] = length;
+
+  for (flags=0; flags < 4; flags++)
+    {
+      memset (&parm, 0, sizeof parm);
+      parm.bundle = bundle;
+      parm.offsets = offsets;
+      parm.stop_at = nfiles;
+      err = ksba_reader_new (&r);
+      fail_if_err (err);
+      err = ksba_reader_set_mem (r, bundle, length);
+      fail_if_err (err);
+      err = ksba_cert_read_bundle (r, flags, bundle_cb, &parm, &count);
+      fail_if_err (err);
+      ksba_reader_release (r);
+      if (count != nfiles || parm.count != nfiles)
+        fail ("wrong number of certificates read from the bundle");
+    }
+
+  /* The callback may stop the reading.  */
+  memset (&parm, 0, sizeof parm);
+  parm.bundle = bundle;
+  parm.offsets = offsets;
+  parm.stop_at = 3;
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_mem (r, bundle, length);
+  fail_if_err (err);
+  err = ksba_cert_read_bundle (r, 0, bundle_cb, &parm, &count);
+  if (gpg_err_code (err) != GPG_ERR_CANCELED || count != 4)
+    fail ("callback did not stop reading the bundle");
+  ksba_reader_release (r);
+
+  /* A truncated certificate at the end is an error.  */
+  memcpy (bundle + length, bundle, 10);
+  for (flags=0; flags < 4; flags++)
+    {
+      memset (&parm, 0, sizeof parm);
+      parm.bundle = bundle;
+      parm.offsets = offsets;
+      parm.stop_at = nfiles;
+      err = ksba_reader_new (&r);
+      fail_if_err (err);
+      err = ksba_reader_set_mem (r, bundle, length + 10);
+      fail_if_err (err);
+      err = ksba_cert_read_bundle (r, flags, bundle_cb, &parm, &count);
+      if (!err || count != nfiles)
+        fail ("truncated certificate at the end of the bundle not detected");
+      ksba_reader_release (r);
+    }
+
+  ksba_free (bundle);
+}
+
+
 int
 main (int argc, char **argv)
 {
@@ -705,6 +1413,7 @@ main (int argc, char **argv)
           one_file (fname);
           ksba_free (fname);
         }
+      check_bundle (srcdir, files);
     }
 
   return !!errorcount;
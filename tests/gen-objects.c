@@ -0,0 +1,89 @@
+/* gen-objects.c - Write large synthetic objects
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * KSBA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Usage examples:
+
+     gen-objects crl 10000000 >huge.crl
+     gen-objects --seed 7 cms 4294967296 >big.p7s
+     gen-objects cert 500 200 >many-extensions.crt
+
+   The objects are written as DER to stdout; see synth.c for their
+   structure.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/ksba.h"
+
+#define PGM "gen-objects"
+
+#include "t-common.h"
+
+
+static void
+usage (void)
+{
+  fputs ("usage: "PGM" [--seed N] crl NENTRIES\n"
+         "       "PGM" [--seed N] cms CONTENTLENGTH\n"
+         "       "PGM" [--seed N] cert NEXTENSIONS NRDNS\n", stderr);
+  exit (1);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  gpg_error_t err;
+  ksba_writer_t w;
+
+  if (argc)
+    {
+      argc--;  argv++;
+    }
+
+  if (argc > 1 && !strcmp (*argv, "--seed"))
+    {
+      synth_set_seed (strtoul (argv[1], NULL, 10));
+      argc -= 2; argv += 2;
+    }
+  if (!argc)
+    usage ();
+
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_file (w, stdout);
+  fail_if_err (err);
+
+  if (!strcmp (*argv, "crl") && argc == 2)
+    err = synth_crl (w, strtoul (argv[1], NULL, 10));
+  else if (!strcmp (*argv, "cms") && argc == 2)
+    err = synth_cms (w, strtoull (argv[1], NULL, 10));
+  else if (!strcmp (*argv, "cert") && argc == 3)
+    err = synth_cert (w, strtoul (argv[1], NULL, 10),
+                      strtoul (argv[2], NULL, 10));
+  else
+    usage ();
+  fail_if_err (err);
+
+  ksba_writer_release (w);
+  if (fflush (stdout) || ferror (stdout))
+    fail ("error writing to stdout");
+  return 0;
+}
@@ -0,0 +1,522 @@
+/* synth.c - Generate large synthetic objects
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * KSBA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The functions here create CRLs, signed-data objects and
+   certificates of arbitrary size.  The output depends only on the
+   parameters and the seed.  The small parts are built with the DER
+   builder; the headers of the large containers are written directly
+   so that the objects are streamed to the writer and the memory use
+   does not depend on their size.  The signatures are random data and
+   thus not valid.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/ksba.h"
+
+
+#define SYNTH_ISSUER "CN=Synthetic CA,O=g10 Code GmbH,C=DE"
+
+static unsigned long synth_seed = 42;
+
+
+void
+synth_set_seed (unsigned long seed)
+{
+  synth_seed = seed;
+}
+
+
+/* A simple linear congruential generator; we only need reproducible
+   data and not good random.  */
+unsigned int
+synth_random (void)
+{
+  synth_seed = (synth_seed * 1103515245 + 12345) & 0xffffffff;
+  return (unsigned int)(synth_seed >> 8);
+}
+
+
+static void
+random_bytes (unsigned char *buffer, size_t length)
+{
+  for (; length; length--)
+    *buffer++ = synth_random ();
+}
+
+
+/* Write the header of an element with a tag below 31 and LENGTH to
+   W.  */
+static gpg_error_t
+write_tl (ksba_writer_t w, int class, int tag, int constructed,
+          unsigned long long length)
+{
+  unsigned char buf[10];
+  int i, n;
+
+  buf[0] = (class << 6) | (constructed? 0x20:0) | tag;
+  if (length < 128)
+    {
+      buf[1] = length;
+      n = 2;
+    }
+  else
+    {
+      for (n=0; n < 8 && (length >> (8*n)); n++)
+        ;
+      buf[1] = 0x80 | n;
+      for (i=0; i < n; i++)
+        buf[2+i] = length >> (8*(n-1-i));
+      n += 2;
+    }
+  return ksba_writer_write (w, buf, n);
+}
+
+
+/* Return the length of the header as written by write_tl.  */
+static unsigned int
+tl_length (unsigned long long length)
+{
+  unsigned int n;
+
+  if (length < 128)
+    return 2;
+  for (n=0; n < 8 && (length >> (8*n)); n++)
+    ;
+  return 2 + n;
+}
+
+
+/* Write the object built with D to W and reset D.  */
+static gpg_error_t
+flush_builder (ksba_der_t d, ksba_writer_t w)
+{
+  gpg_error_t err;
+
+  err = ksba_der_builder_write (d, w);
+  ksba_der_builder_reset (d);
+  return err;
+}
+
+
+/* Return the length of the object built with D.  */
+static gpg_error_t
+builder_length (ksba_der_t d, size_t *r_length)
+{
+  gpg_error_t err;
+
+  err = ksba_der_builder_get_buf (d, NULL, 0, r_length);
+  if (gpg_err_code (err) == GPG_ERR_BUFFER_TOO_SHORT)
+    err = 0;
+  return err;
+}
+
+
+/* Return the object built with D at R_DER and the value of that
+   constructed object at (R_VALUE,R_VALUELEN).  This is used to
+   encode a sequence of elements which are not a complete object.  D
+   is reset.  */
+static gpg_error_t
+builder_value (ksba_der_t d, unsigned char **r_der,
+               const unsigned char **r_value, size_t *r_valuelen)
+{
+  gpg_error_t err;
+  struct ksba_der_cursor_s cursor;
+  size_t derlen;
+
+  *r_der = NULL;
+  err = ksba_der_builder_get (d, r_der, &derlen);
+  ksba_der_builder_reset (d);
+  if (err)
+    return err;
+  ksba_der_cursor_init (&cursor, *r_der, derlen);
+  err = ksba_der_cursor_next (&cursor, NULL, NULL, NULL, NULL);
+  if (!err)
+    err = ksba_der_cursor_value (&cursor, r_value, r_valuelen);
+  return err;
+}
+
+
+static void
+add_sig_algo (ksba_der_t d)
+{
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_oid (d, "1.2.840.113549.1.1.11");  /* sha256WithRSA */
+  ksba_der_add_ptr (d, 0, KSBA_TYPE_NULL, NULL, 0);
+  ksba_der_add_end (d);
+}
+
+
+/* Add a random signature value as BIT STRING.  */
+static void
+add_signature (ksba_der_t d)
+{
+  unsigned char sig[256];
+
+  random_bytes (sig, sizeof sig);
+  ksba_der_add_bts (d, sig, sizeof sig, 0);
+}
+
+
+/* Add the revoked certificate with index N to D.  The serial number
+   contains N and is thus unique for all entries of a CRL.  Every 4th
+   entry carries a reason code.  */
+static void
+add_crl_entry (ksba_der_t d, unsigned int n)
+{
+  unsigned char serial[12];
+
+  random_bytes (serial, sizeof serial);
+  serial[0] = (serial[0] & 0x3f) | 0x40;  /* Positive and minimal.  */
+  serial[1] = n >> 24;
+  serial[2] = n >> 16;
+  serial[3] = n >> 8;
+  serial[4] = n;
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_int (d, serial, sizeof serial, 0);
+  ksba_der_add_val (d, 0, KSBA_TYPE_UTC_TIME, "251231235959Z", 13);
+  if (!(n % 4))
+    {
+      ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+      ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+      ksba_der_add_oid (d, "2.5.29.21");
+      /* ENUMERATED keyCompromise  */
+      ksba_der_add_val (d, 0, KSBA_TYPE_OCTET_STRING, "\x0a\x01\x01", 3);
+      ksba_der_add_end (d);
+      ksba_der_add_end (d);
+    }
+  ksba_der_add_end (d);
+}
+
+
+/* Write a CRL with NENTRIES revoked certificates to W.  */
+gpg_error_t
+synth_crl (ksba_writer_t w, unsigned int nentries)
+{
+  gpg_error_t err;
+  ksba_der_t d;
+  unsigned char *issuer = NULL;
+  unsigned char *prefixder = NULL;
+  unsigned char *sigder = NULL;
+  const unsigned char *prefix, *sig;
+  size_t issuerlen, prefixlen, siglen;
+  size_t entrylen[2];
+  unsigned long long entrieslen, tbslen;
+  unsigned int n;
+
+  d = ksba_der_builder_new (0);
+  if (!d)
+    return gpg_error_from_syserror ();
+  err = ksba_dn_str2der (SYNTH_ISSUER, &issuer, &issuerlen);
+  if (err)
+    goto leave;
+
+  /* All entries with and all without a reason code have the same
+     size; thus we can compute the size of the list.  */
+  for (n=0; n < 2; n++)
+    {
+      add_crl_entry (d, n);
+      err = builder_length (d, entrylen + n);
+      if (err)
+        goto leave;
+      ksba_der_builder_reset (d);
+    }
+  entrieslen = (unsigned long long)((nentries + 3) / 4) * entrylen[0]
+    + (unsigned long long)(nentries - (nentries + 3) / 4) * entrylen[1];
+
+  /* The part of the tbsCertList before the entries.  */
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_int (d, "\x01", 1, 0);
+  add_sig_algo (d);
+  ksba_der_add_der (d, issuer, issuerlen);
+  ksba_der_add_val (d, 0, KSBA_TYPE_UTC_TIME, "260101000000Z", 13);
+  ksba_der_add_val (d, 0, KSBA_TYPE_UTC_TIME, "260201000000Z", 13);
+  ksba_der_add_end (d);
+  err = builder_value (d, &prefixder, &prefix, &prefixlen);
+  if (err)
+    goto leave;
+  tbslen = prefixlen;
+  if (nentries)
+    tbslen += tl_length (entrieslen) + entrieslen;
+
+  /* The signature follows the entries; build it now to know its
+     length.  */
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+  add_sig_algo (d);
+  add_signature (d);
+  ksba_der_add_end (d);
+  err = builder_value (d, &sigder, &sig, &siglen);
+  if (err)
+    goto leave;
+
+  err = write_tl (w, 0, KSBA_TYPE_SEQUENCE, 1,
+                  tl_length (tbslen) + tbslen + siglen);
+  if (!err)
+    err = write_tl (w, 0, KSBA_TYPE_SEQUENCE, 1, tbslen);
+  if (!err)
+    err = ksba_writer_write (w, prefix, prefixlen);
+  if (!err && nentries)
+    err = write_tl (w, 0, KSBA_TYPE_SEQUENCE, 1, entrieslen);
+  for (n=0; !err && n < nentries; n++)
+    {
+      add_crl_entry (d, n);
+      err = flush_builder (d, w);
+    }
+  if (!err)
+    err = ksba_writer_write (w, sig, siglen);
+
+ leave:
+  ksba_free (sigder);
+  ksba_free (prefixder);
+  ksba_free (issuer);
+  ksba_der_release (d);
+  return err;
+}
+
+
+/* Write a signed-data object with an encapsulated content of
+   CONTENTLEN random octets and one signer to W.  */
+gpg_error_t
+synth_cms (ksba_writer_t w, unsigned long long contentlen)
+{
+  static const char oid_signed_data[11] =
+    "\x06\x09\x2a\x86\x48\x86\xf7\x0d\x01\x07\x02";
+  static const char oid_data[11] =
+    "\x06\x09\x2a\x86\x48\x86\xf7\x0d\x01\x07\x01";
+  gpg_error_t err;
+  ksba_der_t d, dsig;
+  unsigned char *issuer = NULL;
+  unsigned char *prefixder = NULL;
+  const unsigned char *prefix;
+  unsigned char buffer[65536];
+  size_t issuerlen, prefixlen, signerlen, nbytes;
+  unsigned long long eclen, sdlen, n;
+
+  d = ksba_der_builder_new (0);
+  dsig = ksba_der_builder_new (0);
+  if (!d || !dsig)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  err = ksba_dn_str2der (SYNTH_ISSUER, &issuer, &issuerlen);
+  if (err)
+    goto leave;
+
+  /* The version and the digestAlgorithms.  */
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_int (d, "\x01", 1, 0);
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SET);
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_oid (d, "2.16.840.1.101.3.4.2.1");  /* sha256 */
+  ksba_der_add_end (d);
+  ksba_der_add_end (d);
+  ksba_der_add_end (d);
+  err = builder_value (d, &prefixder, &prefix, &prefixlen);
+  if (err)
+    goto leave;
+
+  /* The signerInfos follow the content; build them now to know
+     their length.  */
+  random_bytes (buffer, 256);
+  ksba_der_add_tag (dsig, 0, KSBA_TYPE_SET);
+  ksba_der_add_tag (dsig, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_int (dsig, "\x01", 1, 0);
+  ksba_der_add_tag (dsig, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_der (dsig, issuer, issuerlen);
+  ksba_der_add_int (dsig, "\x42", 1, 0);
+  ksba_der_add_end (dsig);
+  ksba_der_add_tag (dsig, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_oid (dsig, "2.16.840.1.101.3.4.2.1");
+  ksba_der_add_end (dsig);
+  ksba_der_add_tag (dsig, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_oid (dsig, "1.2.840.113549.1.1.1");  /* rsaEncryption */
+  ksba_der_add_ptr (dsig, 0, KSBA_TYPE_NULL, NULL, 0);
+  ksba_der_add_end (dsig);
+  ksba_der_add_val (dsig, 0, KSBA_TYPE_OCTET_STRING, buffer, 256);
+  ksba_der_add_end (dsig);
+  ksba_der_add_end (dsig);
+  err = builder_length (dsig, &signerlen);
+  if (err)
+    goto leave;
+
+  eclen = sizeof oid_data + tl_length (tl_length (contentlen) + contentlen)
+    + tl_length (contentlen) + contentlen;
+  sdlen = prefixlen + tl_length (eclen) + eclen + signerlen;
+
+  err = write_tl (w, 0, KSBA_TYPE_SEQUENCE, 1,
+                  sizeof oid_signed_data
+                  + tl_length (tl_length (sdlen) + sdlen)
+                  + tl_length (sdlen) + sdlen);
+  if (!err)
+    err = ksba_writer_write (w, oid_signed_data, sizeof oid_signed_data);
+  if (!err)
+    err = write_tl (w, KSBA_CLASS_CONTEXT, 0, 1, tl_length (sdlen) + sdlen);
+  if (!err)
+    err = write_tl (w, 0, KSBA_TYPE_SEQUENCE, 1, sdlen);
+  if (!err)
+    err = ksba_writer_write (w, prefix, prefixlen);
+  if (!err)
+    err = write_tl (w, 0, KSBA_TYPE_SEQUENCE, 1, eclen);
+  if (!err)
+    err = ksba_writer_write (w, oid_data, sizeof oid_data);
+  if (!err)
+    err = write_tl (w, KSBA_CLASS_CONTEXT, 0, 1,
+                    tl_length (contentlen) + contentlen);
+  if (!err)
+    err = write_tl (w, 0, KSBA_TYPE_OCTET_STRING, 0, contentlen);
+  for (n=contentlen; !err && n; n -= nbytes)
+    {
+      nbytes = n < sizeof buffer? (size_t)n : sizeof buffer;
+      random_bytes (buffer, nbytes);
+      err = ksba_writer_write (w, buffer, nbytes);
+    }
+  if (!err)
+    err = flush_builder (dsig, w);
+
+ leave:
+  ksba_free (prefixder);
+  ksba_free (issuer);
+  ksba_der_release (dsig);
+  ksba_der_release (d);
+  return err;
+}
+
+
+/* Add a name with NRDNS organizational units and a common name to
+   D.  */
+static void
+add_deep_name (ksba_der_t d, unsigned int nrdns)
+{
+  char value[32];
+  unsigned int n;
+
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SET);
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_oid (d, "2.5.4.6");
+  ksba_der_add_val (d, 0, KSBA_TYPE_PRINTABLE_STRING, "DE", 2);
+  ksba_der_add_end (d);
+  ksba_der_add_end (d);
+  for (n=0; n < nrdns; n++)
+    {
+      snprintf (value, sizeof value, "Unit %u", n);
+      ksba_der_add_tag (d, 0, KSBA_TYPE_SET);
+      ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+      ksba_der_add_oid (d, "2.5.4.11");
+      ksba_der_add_val (d, 0, KSBA_TYPE_UTF8_STRING, value, strlen (value));
+      ksba_der_add_end (d);
+      ksba_der_add_end (d);
+    }
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SET);
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_oid (d, "2.5.4.3");
+  ksba_der_add_val (d, 0, KSBA_TYPE_UTF8_STRING, "Synthetic Subject", 17);
+  ksba_der_add_end (d);
+  ksba_der_add_end (d);
+  ksba_der_add_end (d);
+}
+
+
+/* Write a certificate with NEXTNS private extensions and a subject
+   name with NRDNS organizational units to W.  */
+gpg_error_t
+synth_cert (ksba_writer_t w, unsigned int nextns, unsigned int nrdns)
+{
+  gpg_error_t err;
+  ksba_der_t d;
+  unsigned char *issuer = NULL;
+  size_t issuerlen;
+  unsigned char serial[16];
+  unsigned char modulus[257];
+  unsigned char value[32];
+  char oid[64];
+  unsigned int n;
+
+  d = ksba_der_builder_new (0);
+  if (!d)
+    return gpg_error_from_syserror ();
+  err = ksba_dn_str2der (SYNTH_ISSUER, &issuer, &issuerlen);
+  if (err)
+    goto leave;
+
+  random_bytes (serial, sizeof serial);
+  serial[0] = (serial[0] & 0x3f) | 0x40;
+  random_bytes (modulus, sizeof modulus);
+  modulus[0] = 0;
+  modulus[1] |= 0x80;
+
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_tag (d, KSBA_CLASS_CONTEXT, 0);
+  ksba_der_add_int (d, "\x02", 1, 0);  /* v3 */
+  ksba_der_add_end (d);
+  ksba_der_add_int (d, serial, sizeof serial, 0);
+  add_sig_algo (d);
+  ksba_der_add_der (d, issuer, issuerlen);
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_val (d, 0, KSBA_TYPE_UTC_TIME, "260101000000Z", 13);
+  ksba_der_add_val (d, 0, KSBA_TYPE_UTC_TIME, "360101000000Z", 13);
+  ksba_der_add_end (d);
+  add_deep_name (d, nrdns);
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_oid (d, "1.2.840.113549.1.1.1");
+  ksba_der_add_ptr (d, 0, KSBA_TYPE_NULL, NULL, 0);
+  ksba_der_add_end (d);
+  ksba_der_add_tag (d, KSBA_CLASS_ENCAPSULATE, KSBA_TYPE_BIT_STRING);
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_int (d, modulus, sizeof modulus, 0);
+  ksba_der_add_int (d, "\x01\x00\x01", 3, 0);
+  ksba_der_add_end (d);
+  ksba_der_add_end (d);
+  ksba_der_add_end (d);
+  if (nextns)
+    {
+      ksba_der_add_tag (d, KSBA_CLASS_CONTEXT, 3);
+      ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+      for (n=0; n < nextns; n++)
+        {
+          /* An OID below the g10 Code arc which is not used.  */
+          snprintf (oid, sizeof oid, "1.3.6.1.4.1.11591.99.%u", n);
+          random_bytes (value, sizeof value);
+          ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+          ksba_der_add_oid (d, oid);
+          ksba_der_add_tag (d, KSBA_CLASS_ENCAPSULATE,
+                            KSBA_TYPE_OCTET_STRING);
+          ksba_der_add_val (d, 0, KSBA_TYPE_OCTET_STRING,
+                            value, sizeof value);
+          ksba_der_add_end (d);
+          ksba_der_add_end (d);
+        }
+      ksba_der_add_end (d);
+      ksba_der_add_end (d);
+    }
+  ksba_der_add_end (d);
+  add_sig_algo (d);
+  add_signature (d);
+  ksba_der_add_end (d);
+  err = flush_builder (d, w);
+
+ leave:
+  ksba_free (issuer);
+  ksba_der_release (d);
+  return err;
+}
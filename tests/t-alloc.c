@@ -0,0 +1,328 @@
+/* t-alloc.c - Tests for the allocator contexts
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * KSBA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <errno.h>
+
+#include "../src/ksba.h"
+
+#define PGM "t-alloc"
+
+#include "t-common.h"
+
+
+static int verbose;
+
+/* Number of live allocations done by the global functions.  */
+static int global_count;
+
+
+/* A simple arena which is released at once.  Each block is prefixed
+ * with its size so that realloc can copy it.  */
+struct arena_s
+{
+  char *buffer;
+  size_t size;
+  size_t used;
+  int nalloc;
+  int nfree;
+};
+
+
+static void *
+global_malloc (size_t n)
+{
+  global_count++;
+  return malloc (n);
+}
+
+static void *
+global_realloc (void *p, size_t n)
+{
+  if (!p)
+    global_count++;
+  return realloc (p, n);
+}
+
+static void
+global_free (void *p)
+{
+  if (p)
+    global_count--;
+  free (p);
+}
+
+
+static void *
+arena_alloc (void *opaque, size_t n)
+{
+  struct arena_s *arena = opaque;
+  size_t *p;
+
+  n = (n + 2 * sizeof (size_t) - 1) / sizeof (size_t) * sizeof (size_t);
+  if (arena->used + n > arena->size)
+    {
+      errno = ENOMEM;
+      return NULL;
+    }
+  p = (size_t *)(arena->buffer + arena->used);
+  arena->used += n;
+  *p = n - sizeof (size_t);
+  arena->nalloc++;
+  return p + 1;
+}
+
+static void *
+arena_realloc (void *opaque, void *old, size_t n)
+{
+  void *p;
+
+  if (!old)
+    return arena_alloc (opaque, n);
+  p = arena_alloc (opaque, n);
+  if (p)
+    {
+      size_t oldlen = ((size_t *)old)[-1];
+      memcpy (p, old, oldlen < n? oldlen : n);
+    }
+  return p;
+}
+
+static void
+arena_free (void *opaque, void *p)
+{
+  struct arena_s *arena = opaque;
+  char *cp = p;
+
+  if (cp < arena->buffer || cp >= arena->buffer + arena->size)
+    fail ("block to free is not from the arena");
+  arena->nfree++;
+}
+
+
+static void *
+read_file (const char *fname, size_t *r_length)
+{
+  FILE *fp;
+  char *buffer;
+
+  fp = fopen (fname, "rb");
+  if (!fp)
+    {
+      fprintf (stderr, PGM": can't open `%s': %s\n", fname, strerror (errno));
+      exit (1);
+    }
+  buffer = malloc (65536);
+  if (!buffer)
+    fail ("out of core");
+  *r_length = fread (buffer, 1, 65536, fp);
+  fclose (fp);
+  return buffer;
+}
+
+
+static void
+test_arena (void)
+{
+  gpg_error_t err;
+  struct arena_s arena;
+  ksba_alloc_ctx_t ctx, prev;
+  ksba_cert_t cert, cert2;
+  void *image;
+  size_t imagelen;
+  char *dn;
+  ksba_sexp_t sexp;
+  char *fname;
+  int count;
+
+  fname = prepend_srcdir ("samples/cert_g10code_test1.der");
+  image = read_file (fname, &imagelen);
+  xfree (fname);
+
+  memset (&arena, 0, sizeof arena);
+  arena.size = 256 * 1024;
+  arena.buffer = malloc (arena.size);
+  if (!arena.buffer)
+    fail ("out of core");
+
+  ksba_set_malloc_hooks (global_malloc, global_realloc, global_free);
+  err = ksba_alloc_ctx_new (&ctx, arena_alloc, arena_realloc, arena_free,
+                            &arena);
+  if (gpg_err_code (err) == GPG_ERR_NOT_SUPPORTED)
+    {
+      if (verbose)
+        printf ("allocator contexts are not supported\n");
+      ksba_set_malloc_hooks (malloc, realloc, free);
+      free (arena.buffer);
+      free (image);
+      return;
+    }
+  fail_if_err (err);
+
+  /* A certificate created outside of the context.  */
+  err = ksba_cert_new (&cert2);
+  fail_if_err (err);
+
+  count = global_count;
+  prev = ksba_alloc_ctx_enter (ctx);
+  if (prev)
+    fail ("an allocator context is unexpectedly entered");
+
+  err = ksba_cert_new (&cert);
+  fail_if_err (err);
+  err = ksba_cert_init_from_mem (cert, image, imagelen);
+  fail_if_err (err);
+  dn = ksba_cert_get_subject (cert, 0);
+  if (!dn)
+    fail ("no subject");
+  ksba_free (dn);
+  sexp = ksba_cert_get_public_key (cert);
+  if (!sexp)
+    fail ("no public key");
+  ksba_free (sexp);
+
+  /* The object created outside uses the global functions.  */
+  count = global_count;
+  ksba_cert_release (cert2);
+  if (global_count != count - 1)
+    fail ("object not released using the global functions");
+
+  ksba_alloc_ctx_enter (prev);
+  count = global_count;
+  if (!arena.nalloc || !arena.nfree)
+    fail ("allocator context not used");
+
+  /* Released outside of the context but uses the context.  */
+  ksba_alloc_ctx_release (ctx);
+  ksba_cert_release (cert);
+  if (global_count > count)
+    fail ("global functions used while parsing in the context");
+  if (verbose)
+    printf ("%d allocations from the arena using %zu bytes\n",
+            arena.nalloc, arena.used);
+
+  ksba_set_malloc_hooks (malloc, realloc, free);
+  free (arena.buffer);
+
+  /* Data shared between objects, like the ASN.1 tree built by the
+     first parse above, must not have been taken from the arena.  */
+  err = ksba_cert_new (&cert);
+  fail_if_err (err);
+  err = ksba_cert_init_from_mem (cert, image, imagelen);
+  fail_if_err (err);
+  ksba_cert_release (cert);
+  free (image);
+}
+
+
+/* Parse a certificate in a context, wipe the arena and parse again
+   in a new context using the same arena.  */
+static void
+test_reuse (void)
+{
+  gpg_error_t err;
+  struct arena_s arena;
+  ksba_alloc_ctx_t ctx, prev;
+  ksba_cert_t cert;
+  void *image;
+  size_t imagelen;
+  char *fname;
+  char *dn;
+  int pass;
+
+  fname = prepend_srcdir ("samples/cert_dfn_pca15.der");
+  image = read_file (fname, &imagelen);
+  xfree (fname);
+
+  memset (&arena, 0, sizeof arena);
+  arena.size = 256 * 1024;
+  arena.buffer = malloc (arena.size);
+  if (!arena.buffer)
+    fail ("out of core");
+
+  for (pass = 0; pass < 3; pass++)
+    {
+      err = ksba_alloc_ctx_new (&ctx, arena_alloc, arena_realloc, arena_free,
+                                &arena);
+      if (gpg_err_code (err) == GPG_ERR_NOT_SUPPORTED)
+        break;
+      fail_if_err (err);
+      prev = ksba_alloc_ctx_enter (ctx);
+      /* Release our reference while the context is entered; the
+         thread keeps it alive until it is left.  */
+      ksba_alloc_ctx_release (ctx);
+
+      err = ksba_cert_new (&cert);
+      fail_if_err (err);
+      err = ksba_cert_init_from_mem (cert, image, imagelen);
+      fail_if_err (err);
+      dn = ksba_cert_get_issuer (cert, 0);
+      if (!dn)
+        fail ("no issuer");
+      ksba_free (dn);
+      if (!ksba_cert_get_digest_algo (cert))
+        fail ("no digest algorithm");
+      ksba_cert_release (cert);
+
+      ksba_alloc_ctx_enter (prev);
+      if (verbose)
+        printf ("pass %d: %d allocations from the arena\n",
+                pass, arena.nalloc);
+      memset (arena.buffer, 0xa5, arena.size);
+      arena.used = 0;
+      arena.nalloc = arena.nfree = 0;
+    }
+
+  free (arena.buffer);
+  free (image);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  if (argc)
+    {
+      argc--;  argv++;
+    }
+
+  if (argc && !strcmp (*argv, "--verbose"))
+    {
+      verbose = 1;
+      argc--; argv++;
+    }
+
+  if (!argc)
+    {
+      test_arena ();
+      test_reuse ();
+    }
+  else
+    {
+      fputs ("usage: "PGM"\n", stderr);
+      return 1;
+    }
+
+  return 0;
+}
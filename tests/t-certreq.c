@@ -0,0 +1,218 @@
+/* t-certreq.c - Tests for the certificate request functions
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * KSBA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <errno.h>
+
+#include "../src/ksba.h"
+
+#define PGM "t-certreq"
+
+#include "t-common.h"
+
+
+static int verbose;
+
+static const char sample_key[] =
+  "(10:public-key(3:rsa(1:n9:\x00\xc5\x12\x34\x56\x78\x9a\xbc\xdf)"
+  "(1:e3:\x01\x00\x01)))";
+static const char sample_siginfo[] =
+  "(7:sig-val(3:rsa(1:s1:\x00)))";
+static const char sample_sigval[] =
+  "(7:sig-val(3:rsa(1:s4:\x11\x22\x33\x44)))";
+
+
+static void
+hash_cb (void *arg, const void *buffer, size_t length)
+{
+  size_t *counter = arg;
+
+  (void)buffer;
+  *counter += length;
+}
+
+
+/* Set the values specific to request number IDX on CR and build it.
+ * The result is stored at R_DER, R_DERLEN.  */
+static void
+build_one (ksba_certreq_t cr, int idx, unsigned char **r_der, size_t *r_derlen)
+{
+  gpg_error_t err;
+  ksba_writer_t w;
+  ksba_stop_reason_t stopreason;
+  char serial[10];
+  char subject[50];
+
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_mem (w, 512);
+  fail_if_err (err);
+  err = ksba_certreq_set_writer (cr, w);
+  fail_if_err (err);
+
+  memcpy (serial, "(1:\x00)", 6);
+  serial[3] = idx + 1;
+  err = ksba_certreq_set_serial (cr, (ksba_const_sexp_t)serial);
+  fail_if_err (err);
+  snprintf (subject, sizeof subject, "CN=Device %d,O=Example", idx);
+  err = ksba_certreq_add_subject (cr, subject);
+  fail_if_err (err);
+  err = ksba_certreq_add_subject (cr, "<device@example.org>");
+  fail_if_err (err);
+  err = ksba_certreq_set_public_key (cr, (ksba_const_sexp_t)sample_key);
+  fail_if_err (err);
+
+  stopreason = 0;
+  do
+    {
+      err = ksba_certreq_build (cr, &stopreason);
+      fail_if_err (err);
+      if (stopreason == KSBA_SR_NEED_SIG)
+        {
+          err = ksba_certreq_set_sig_val (cr,
+                                          (ksba_const_sexp_t)sample_sigval);
+          fail_if_err (err);
+        }
+    }
+  while (stopreason != KSBA_SR_READY);
+
+  *r_der = ksba_writer_snatch_mem (w, r_derlen);
+  if (!*r_der)
+    fail ("no certificate written");
+  ksba_writer_release (w);
+}
+
+
+static ksba_certreq_t
+new_template (size_t *hashcounter)
+{
+  gpg_error_t err;
+  ksba_certreq_t cr;
+
+  err = ksba_certreq_new (&cr);
+  fail_if_err (err);
+  ksba_certreq_set_hash_function (cr, hash_cb, hashcounter);
+  err = ksba_certreq_set_issuer (cr, "CN=Test CA,O=Example");
+  fail_if_err (err);
+  err = ksba_certreq_set_validity (cr, 0, "20260101T000000");
+  fail_if_err (err);
+  err = ksba_certreq_set_validity (cr, 1, "20270101T000000");
+  fail_if_err (err);
+  err = ksba_certreq_set_siginfo (cr, (ksba_const_sexp_t)sample_siginfo);
+  fail_if_err (err);
+  err = ksba_certreq_add_extension (cr, "2.5.29.15", 1, "\x03\x02\x05\xa0", 4);
+  fail_if_err (err);
+  err = ksba_certreq_add_extension (cr, "2.5.29.19", 0, "\x30\x00", 2);
+  fail_if_err (err);
+  return cr;
+}
+
+
+/* Create several certificates from one template and check that they
+ * are identical to certificates created from scratch.  */
+static void
+test_batch (void)
+{
+  gpg_error_t err;
+  ksba_certreq_t cr, cr2;
+  ksba_cert_t cert;
+  unsigned char *der, *der2;
+  size_t derlen, derlen2;
+  size_t hashed = 0, hashed2 = 0;
+  ksba_sexp_t sn;
+  char *dn;
+  char expected[50];
+  const char *oid;
+  int idx, n;
+
+  cr = new_template (&hashed);
+  for (idx=0; idx < 3; idx++)
+    {
+      hashed = 0;
+      build_one (cr, idx, &der, &derlen);
+      if (!hashed || hashed >= derlen)
+        fail ("hash function not called for the TBSCertificate");
+
+      err = ksba_cert_new (&cert);
+      fail_if_err (err);
+      err = ksba_cert_init_from_mem (cert, der, derlen);
+      fail_if_err (err);
+      sn = ksba_cert_get_serial (cert);
+      if (!sn || memcmp (sn, "(1:", 3) || sn[3] != idx + 1)
+        fail ("bad serial number");
+      xfree (sn);
+      dn = ksba_cert_get_subject (cert, 0);
+      snprintf (expected, sizeof expected, "CN=Device %d,O=Example", idx);
+      if (!dn || strcmp (dn, expected))
+        fail ("bad subject");
+      xfree (dn);
+      for (n=0; !ksba_cert_get_extension (cert, n, &oid, NULL, NULL, NULL);
+           n++)
+        ;
+      if (n != 3)
+        fail ("bad number of extensions");
+      ksba_cert_release (cert);
+
+      /* The same certificate created without a template.  */
+      cr2 = new_template (&hashed2);
+      build_one (cr2, idx, &der2, &derlen2);
+      if (derlen != derlen2 || memcmp (der, der2, derlen))
+        fail ("certificate from template differs");
+      ksba_certreq_release (cr2);
+      xfree (der2);
+      xfree (der);
+
+      ksba_certreq_reset (cr);
+    }
+
+  ksba_certreq_release (cr);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  if (argc)
+    {
+      argc--;  argv++;
+    }
+
+  if (argc && !strcmp (*argv, "--verbose"))
+    {
+      verbose = 1;
+      argc--; argv++;
+    }
+
+  if (!argc)
+    {
+      test_batch ();
+    }
+  else
+    {
+      fputs ("usage: "PGM"\n", stderr);
+      return 1;
+    }
+
+  return 0;
+}
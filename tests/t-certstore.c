@@ -0,0 +1,490 @@
+/* t-certstore.c - basic tests for the certificate store
+ *      Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * KSBA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <gpg-error.h>
+
+#include "../src/ksba.h"
+#include "t-common.h"
+
+
+static const char *sample_files[] = {
+  "samples/ov-root-ca-cert.crt",
+  "samples/ov-ocsp-server.crt",
+  "samples/ov-server.crt",
+  "samples/ov-serverrev.crt",
+  "samples/ov-user.crt",
+  "samples/ov-userrev.crt",
+  "samples/ov2-root-ca-cert.crt",
+  "samples/ov2-ocsp-server.crt",
+  "samples/ov2-user.crt",
+  "samples/ov2-userrev.crt",
+  NULL
+};
+
+
+static ksba_cert_t
+read_cert (const char *fname)
+{
+  gpg_error_t err;
+  char *fullname;
+  FILE *fp;
+  ksba_reader_t r;
+  ksba_cert_t cert;
+
+  fullname = prepend_srcdir (fname);
+  fp = fopen (fullname, "rb");
+  if (!fp)
+    {
+      fprintf (stderr, "%s:%d: can't open `%s': %s\n",
+               __FILE__, __LINE__, fullname, strerror (errno));
+      exit (1);
+    }
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_file (r, fp);
+  fail_if_err (err);
+  err = ksba_cert_new (&cert);
+  fail_if_err (err);
+  err = ksba_cert_read_der (cert, r);
+  fail_if_err2 (fullname, err);
+  ksba_reader_release (r);
+  fclose (fp);
+  xfree (fullname);
+  return cert;
+}
+
+
+/* Locate the serial number, the issuer and the subject in the
+   certificate CERT.  */
+static void
+get_parts (ksba_cert_t cert,
+           const unsigned char **r_serial, size_t *r_seriallen,
+           const unsigned char **r_issuer, size_t *r_issuerlen,
+           const unsigned char **r_subject, size_t *r_subjectlen)
+{
+  struct ksba_der_cursor_s cursor;
+  const unsigned char *image;
+  size_t imagelen;
+  int class, tag;
+  gpg_error_t err;
+
+  image = ksba_cert_get_image (cert, &imagelen);
+  if (!image)
+    fail ("no image");
+  ksba_der_cursor_init (&cursor, image, imagelen);
+  err = ksba_der_cursor_next (&cursor, NULL, NULL, NULL, NULL);
+  if (!err)
+    err = ksba_der_cursor_enter (&cursor);
+  if (!err)
+    err = ksba_der_cursor_next (&cursor, NULL, NULL, NULL, NULL);
+  if (!err)
+    err = ksba_der_cursor_enter (&cursor);
+  if (!err)
+    err = ksba_der_cursor_next (&cursor, &class, &tag, NULL, NULL);
+  if (!err && class == KSBA_CLASS_CONTEXT && !tag)
+    err = ksba_der_cursor_next (&cursor, &class, &tag, NULL, NULL);
+  if (!err)
+    err = ksba_der_cursor_value (&cursor, r_serial, r_seriallen);
+  if (!err)
+    err = ksba_der_cursor_next (&cursor, NULL, NULL, NULL, NULL);
+  if (!err)
+    err = ksba_der_cursor_next (&cursor, NULL, NULL, NULL, NULL);
+  if (!err)
+    err = ksba_der_cursor_tlv (&cursor, r_issuer, r_issuerlen);
+  if (!err)
+    err = ksba_der_cursor_next (&cursor, NULL, NULL, NULL, NULL);
+  if (!err)
+    err = ksba_der_cursor_next (&cursor, NULL, NULL, NULL, NULL);
+  if (!err)
+    err = ksba_der_cursor_tlv (&cursor, r_subject, r_subjectlen);
+  fail_if_err (err);
+}
+
+
+static void
+test_lookups (void)
+{
+  ksba_cert_t certs[sizeof sample_files / sizeof *sample_files];
+  ksba_certstore_t store;
+  ksba_cert_t cert, cert2;
+  const unsigned char *serial, *issuer, *subject, *image, *ski;
+  size_t seriallen, issuerlen, subjectlen, imagelen, skilen;
+  gpg_error_t err;
+  int i, n, idx, found;
+
+  err = ksba_certstore_new (&store);
+  fail_if_err (err);
+  for (n=0; sample_files[n]; n++)
+    {
+      certs[n] = read_cert (sample_files[n]);
+      err = ksba_certstore_add (store, certs[n]);
+      fail_if_err (err);
+    }
+  if (ksba_certstore_count (store) != n)
+    fail ("wrong number of certificates in the store");
+
+  /* The same image must not be added twice.  */
+  cert = read_cert (sample_files[2]);
+  err = ksba_certstore_add (store, cert);
+  if (gpg_err_code (err) != GPG_ERR_DUP_VALUE)
+    fail ("duplicate certificate not detected");
+  ksba_cert_release (cert);
+
+  for (i=0; i < n; i++)
+    {
+      image = ksba_cert_get_image (certs[i], &imagelen);
+      err = ksba_certstore_find_image (store, image, imagelen, &cert);
+      fail_if_err (err);
+      if (cert != certs[i])
+        fail ("wrong certificate found by image");
+      ksba_cert_release (cert);
+
+      get_parts (certs[i], &serial, &seriallen, &issuer, &issuerlen,
+                 &subject, &subjectlen);
+      err = ksba_certstore_find_serial (store, issuer, issuerlen,
+                                        serial, seriallen, &cert);
+      fail_if_err (err);
+      if (cert != certs[i])
+        fail ("wrong certificate found by issuer and serial");
+      ksba_cert_release (cert);
+
+      /* Some of the subjects are used by both CAs.  */
+      found = 0;
+      for (idx=0; !(err = ksba_certstore_find_subject (store,
+                                                       subject, subjectlen,
+                                                       idx, &cert)); idx++)
+        {
+          if (cert == certs[i])
+            found++;
+          ksba_cert_release (cert);
+        }
+      if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+        fail_if_err (err);
+      if (found != 1 || idx != (i == 0 || i == 2 || i == 3 || i == 6? 1 : 2))
+        fail ("wrong certificates found by subject");
+
+      /* All samples are issued by one of the root certificates.  */
+      err = ksba_certstore_find_issuer (store, certs[i], 0, &cert);
+      fail_if_err (err);
+      if (cert != certs[i < 6? 0 : 6])
+        fail ("wrong issuer found");
+      ksba_cert_release (cert);
+
+      if (!ksba_cert_get_key_ids (certs[i], &ski, &skilen, NULL, NULL))
+        {
+          /* The CAs share some of the keys.  */
+          found = 0;
+          for (idx=0; !(err = ksba_certstore_find_ski (store, ski, skilen,
+                                                       idx, &cert)); idx++)
+            {
+              if (cert == certs[i])
+                found++;
+              ksba_cert_release (cert);
+            }
+          if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+            fail_if_err (err);
+          if (found != 1)
+            fail ("certificate not found by SKI");
+        }
+    }
+
+  /* The serial numbers are only unique per issuer.  */
+  get_parts (certs[6], &serial, &seriallen, &issuer, &issuerlen,
+             &subject, &subjectlen);
+  get_parts (certs[2], &serial, &seriallen, &image, &imagelen,
+             &subject, &subjectlen);
+  err = ksba_certstore_find_serial (store, issuer, issuerlen,
+                                    serial, seriallen, &cert);
+  fail_if_err (err);
+  if (cert != certs[8])
+    fail ("wrong certificate found by issuer and serial");
+  ksba_cert_release (cert);
+  get_parts (certs[1], &serial, &seriallen, &image, &imagelen,
+             &subject, &subjectlen);
+  err = ksba_certstore_find_serial (store, issuer, issuerlen,
+                                    serial, seriallen, &cert);
+  if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    fail ("certificate found for a foreign issuer");
+
+  /* Remove a certificate using another object with the same image.  */
+  cert = read_cert (sample_files[3]);
+  err = ksba_certstore_remove (store, cert);
+  fail_if_err (err);
+  err = ksba_certstore_remove (store, cert);
+  if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    fail ("certificate removed twice");
+  image = ksba_cert_get_image (cert, &imagelen);
+  err = ksba_certstore_find_image (store, image, imagelen, &cert2);
+  if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    fail ("removed certificate still found");
+  get_parts (cert, &serial, &seriallen, &issuer, &issuerlen,
+             &subject, &subjectlen);
+  err = ksba_certstore_find_subject (store, subject, subjectlen, 0, &cert2);
+  if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    fail ("removed certificate still found by subject");
+  ksba_cert_release (cert);
+  if (ksba_certstore_count (store) != n - 1)
+    fail ("wrong number of certificates after the removal");
+
+  /* The store holds its own references.  */
+  for (i=0; i < n; i++)
+    ksba_cert_release (certs[i]);
+  err = ksba_certstore_find_issuer (store, certs[1], 0, &cert);
+  fail_if_err (err);
+  ksba_cert_release (cert);
+  ksba_certstore_release (store);
+}
+
+
+/* Add many variants of one certificate so that the tables need to
+   grow and the subject chain gets long.  */
+static void
+test_growth (void)
+{
+  enum { NVARIANTS = 300 };
+  ksba_certstore_t store;
+  ksba_cert_t base, cert;
+  const unsigned char *image, *serial, *issuer, *subject;
+  size_t imagelen, seriallen, issuerlen, subjectlen;
+  unsigned char *buffer;
+  gpg_error_t err;
+  int i;
+
+  base = read_cert (sample_files[4]);
+  image = ksba_cert_get_image (base, &imagelen);
+  buffer = xmalloc (imagelen);
+  memcpy (buffer, image, imagelen);
+
+  err = ksba_certstore_new (&store);
+  fail_if_err (err);
+  for (i=0; i < NVARIANTS; i++)
+    {
+      /* Changing the signature still gives a valid certificate.  */
+      buffer[imagelen-1] = i;
+      buffer[imagelen-2] = i >> 8;
+      err = ksba_cert_new (&cert);
+      fail_if_err (err);
+      err = ksba_cert_init_from_mem (cert, buffer, imagelen);
+      fail_if_err (err);
+      err = ksba_certstore_add (store, cert);
+      fail_if_err (err);
+      ksba_cert_release (cert);
+    }
+  if (ksba_certstore_count (store) != NVARIANTS)
+    fail ("wrong number of certificates in the store");
+
+  for (i=0; i < NVARIANTS; i++)
+    {
+      buffer[imagelen-1] = i;
+      buffer[imagelen-2] = i >> 8;
+      err = ksba_certstore_find_image (store, buffer, imagelen, &cert);
+      fail_if_err (err);
+      ksba_cert_release (cert);
+    }
+
+  get_parts (base, &serial, &seriallen, &issuer, &issuerlen,
+             &subject, &subjectlen);
+  for (i=0; i < NVARIANTS; i++)
+    {
+      err = ksba_certstore_find_subject (store, subject, subjectlen, i, &cert);
+      fail_if_err (err);
+      ksba_cert_release (cert);
+    }
+  err = ksba_certstore_find_subject (store, subject, subjectlen, i, &cert);
+  if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    fail ("too many certificates found by subject");
+
+  ksba_certstore_release (store);
+  xfree (buffer);
+  ksba_cert_release (base);
+}
+
+
+/* Return true if STORE has the certificate CERT.  */
+static int
+has_cert (ksba_certstore_t store, ksba_cert_t cert)
+{
+  const unsigned char *image;
+  size_t imagelen;
+  ksba_cert_t found;
+
+  image = ksba_cert_get_image (cert, &imagelen);
+  if (ksba_certstore_find_image (store, image, imagelen, &found))
+    return 0;
+  ksba_cert_release (found);
+  return 1;
+}
+
+
+static void
+test_limit (void)
+{
+  ksba_certstore_t store;
+  ksba_cert_t certs[4];
+  gpg_error_t err;
+  int i;
+
+  err = ksba_certstore_new (&store);
+  fail_if_err (err);
+  err = ksba_certstore_set_limit (store, 3);
+  fail_if_err (err);
+  for (i=0; i < 4; i++)
+    certs[i] = read_cert (sample_files[i]);
+  for (i=0; i < 3; i++)
+    {
+      err = ksba_certstore_add (store, certs[i]);
+      fail_if_err (err);
+    }
+
+  /* Using the first one makes the second the least recently used.  */
+  if (!has_cert (store, certs[0]))
+    fail ("certificate not found in the store");
+  err = ksba_certstore_add (store, certs[3]);
+  fail_if_err (err);
+  if (ksba_certstore_count (store) != 3)
+    fail ("limit of the store not obeyed");
+  if (has_cert (store, certs[1]))
+    fail ("least recently used certificate not removed");
+  if (!has_cert (store, certs[2]) || !has_cert (store, certs[0])
+      || !has_cert (store, certs[3]))
+    fail ("wrong certificate removed from the store");
+
+  /* Now 3 has been used last.  */
+  err = ksba_certstore_set_limit (store, 1);
+  fail_if_err (err);
+  if (ksba_certstore_count (store) != 1 || !has_cert (store, certs[3]))
+    fail ("lowering the limit removed the wrong certificates");
+
+  ksba_certstore_release (store);
+  for (i=0; i < 4; i++)
+    ksba_cert_release (certs[i]);
+}
+
+
+/* Check that PUBKEY is the public key of a certificate with the
+   issuer of CERT as subject.  */
+static int
+pubkey_of_issuer (ksba_cert_t cert, ksba_const_sexp_t pubkey,
+                  ksba_certstore_t store)
+{
+  ksba_cert_t issuer;
+  ksba_sexp_t key;
+  int idx, found = 0;
+
+  for (idx=0; !found && !ksba_certstore_find_issuer (store, cert, idx,
+                                                     &issuer); idx++)
+    {
+      key = ksba_cert_get_public_key (issuer);
+      found = key && !strcmp ((char*)key, (const char*)pubkey);
+      ksba_free (key);
+      ksba_cert_release (issuer);
+    }
+  return found;
+}
+
+
+static void
+test_prepare_verify (void)
+{
+  ksba_cert_t certs[sizeof sample_files / sizeof *sample_files];
+  struct ksba_cert_verify_item_s items[sizeof certs / sizeof *certs];
+  ksba_certstore_t store;
+  const unsigned char *tbs;
+  size_t tbslen;
+  gpg_error_t err;
+  int i, n;
+
+  err = ksba_certstore_new (&store);
+  fail_if_err (err);
+  for (n=0; sample_files[n]; n++)
+    {
+      certs[n] = read_cert (sample_files[n]);
+      err = ksba_certstore_add (store, certs[n]);
+      fail_if_err (err);
+    }
+
+  memset (items, 0, sizeof items);
+  for (i=0; i < n; i++)
+    items[i].cert = certs[i];
+  err = ksba_cert_prepare_verify (items, n, store);
+  fail_if_err (err);
+  for (i=0; i < n; i++)
+    {
+      fail_if_err (items[i].err);
+      err = ksba_cert_get_view (certs[i], KSBA_CERT_VIEW_TBS,
+                                &tbs, &tbslen, NULL);
+      fail_if_err (err);
+      if (items[i].tbs != tbs || items[i].tbslen != tbslen)
+        fail ("wrong signed data");
+      if (!items[i].digest_algo
+          || strcmp (items[i].digest_algo,
+                     ksba_cert_get_digest_algo (certs[i])))
+        fail ("wrong signature algorithm");
+      if (!items[i].sigval || !items[i].issuer)
+        fail ("signature value or issuer missing");
+      if (!pubkey_of_issuer (certs[i], items[i].pubkey, store))
+        fail ("wrong public key");
+    }
+  ksba_cert_release_verify (items, n);
+  for (i=0; i < n; i++)
+    if (items[i].issuer || items[i].sigval || items[i].pubkey)
+      fail ("items not released");
+
+  /* Without a store only the roots can be prepared.  The given issuer
+     must not be released.  */
+  items[1].issuer = certs[0];
+  err = ksba_cert_prepare_verify (items, n, NULL);
+  if (gpg_err_code (err) != GPG_ERR_MISSING_ISSUER_CERT)
+    fail ("missing issuer not detected");
+  fail_if_err (items[0].err);
+  fail_if_err (items[1].err);
+  fail_if_err (items[6].err);
+  if (items[0].issuer != certs[0] || items[6].issuer != certs[6])
+    fail ("root not taken as its own issuer");
+  if (gpg_err_code (items[2].err) != GPG_ERR_MISSING_ISSUER_CERT)
+    fail ("missing issuer not detected");
+  ksba_cert_release_verify (items, n);
+  if (items[1].issuer != certs[0] || items[0].issuer)
+    fail ("wrong issuers released");
+
+  for (i=0; i < n; i++)
+    ksba_cert_release (certs[i]);
+  ksba_certstore_release (store);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+
+  test_lookups ();
+  test_growth ();
+  test_limit ();
+  test_prepare_verify ();
+
+  return 0;
+}
@@ -41,6 +41,25 @@ dummy_hash_fnc (void *arg, const void *buffer, size_t length)
   (void)length;
 }
 
+/* A trivial digest to compare the data passed to hash functions.  */
+struct sum_s
+{
+  size_t length;
+  unsigned long sum;
+};
+
+static void
+sum_hash_fnc (void *arg, const void *buffer, size_t length)
+{
+  struct sum_s *sum = arg;
+  const unsigned char *p = buffer;
+
+  sum->length += length;
+  for (; length; length--, p++)
+    sum->sum = sum->sum * 31 + *p;
+}
+
+
 static int
 dummy_writer_cb (void *cb_value, const void *buffer, size_t count)
 {
@@ -52,6 +71,156 @@ dummy_writer_cb (void *cb_value, const void *buffer, size_t count)
 
 
 
+/* Return the length of the canonical S-expression at P.  */
+static size_t
+sexp_len (ksba_const_sexp_t p)
+{
+  const unsigned char *s = p;
+  int level = 0;
+  size_t n;
+
+  do
+    {
+      if (*s == '(')
+        level++, s++;
+      else if (*s == ')')
+        level--, s++;
+      else
+        {
+          for (n=0; *s >= '0' && *s <= '9'; s++)
+            n = n * 10 + *s - '0';
+          if (*s != ':')
+            fail ("invalid S-expression");
+          s += 1 + n;
+        }
+    }
+  while (level > 0);
+  return s - p;
+}
+
+
+/* Check that ksba_cms_get_signers returns the same as the functions
+   to get the values of one signer.  */
+static void
+check_signers (const char *fname, ksba_cms_t cms)
+{
+  gpg_error_t err;
+  struct ksba_cms_signer_s signers[4];
+  unsigned int count, n;
+  ksba_sexp_t serial, sigval;
+  char *issuer, *dn, *digest;
+  size_t digestlen;
+  struct sum_s sum, attrsum;
+  int idx;
+
+  err = ksba_cms_get_signers (cms, NULL, 0, &count);
+  if (gpg_err_code (err) == GPG_ERR_NO_DATA)
+    return;  /* No signers.  */
+  fail_if_err2 (fname, err);
+  if (!count || count > sizeof signers / sizeof *signers)
+    fail ("unexpected number of signers");
+  err = ksba_cms_get_signers (cms, signers, sizeof signers / sizeof *signers,
+                              &n);
+  fail_if_err2 (fname, err);
+  if (n != count)
+    fail ("number of signers changed");
+
+  for (idx=0; idx < (int)count; idx++)
+    {
+      err = ksba_cms_get_issuer_serial (cms, idx, &issuer, &serial);
+      fail_if_err2 (fname, err);
+      err = ksba_dn_der2str (signers[idx].issuer, signers[idx].issuerlen, &dn);
+      fail_if_err2 (fname, err);
+      if (strcmp (dn, issuer))
+        fail ("issuer does not match");
+      n = strtoul ((char*)serial+1, NULL, 10);
+      if (n != signers[idx].seriallen
+          || memcmp (strchr ((char*)serial, ':') + 1,
+                     signers[idx].serial, n))
+        fail ("serial number does not match");
+      ksba_free (dn);
+      ksba_free (issuer);
+      ksba_free (serial);
+
+      if (strcmp (signers[idx].digest_algo,
+                  ksba_cms_get_digest_algo (cms, idx)))
+        fail ("digest algorithm does not match");
+
+      err = ksba_cms_get_message_digest (cms, idx, &digest, &digestlen);
+      fail_if_err2 (fname, err);
+      if (digestlen != signers[idx].digestlen
+          || (digestlen && memcmp (digest, signers[idx].digest, digestlen)))
+        fail ("message digest does not match");
+      ksba_free (digest);
+
+      memset (&sum, 0, sizeof sum);
+      memset (&attrsum, 0, sizeof attrsum);
+      ksba_cms_set_hash_function (cms, sum_hash_fnc, &sum);
+      err = ksba_cms_hash_signed_attrs (cms, idx);
+      fail_if_err2 (fname, err);
+      sum_hash_fnc (&attrsum, signers[idx].attrs, signers[idx].attrslen);
+      if (!sum.length || sum.length != attrsum.length
+          || sum.sum != attrsum.sum)
+        fail ("signed attributes do not match");
+
+      sigval = ksba_cms_get_sig_val (cms, idx);
+      if (!sigval || sexp_len (sigval) != sexp_len (signers[idx].sigval)
+          || memcmp (sigval, signers[idx].sigval, sexp_len (sigval)))
+        fail ("signature does not match");
+      ksba_free (sigval);
+    }
+}
+
+
+/* Check that ksba_cms_get_recipients returns the same as
+   ksba_cms_get_issuer_serial.  */
+static void
+check_recipients (const char *fname, ksba_cms_t cms)
+{
+  gpg_error_t err;
+  struct ksba_cms_recipient_s recps[4];
+  unsigned int count, n;
+  ksba_sexp_t serial;
+  char *issuer, *dn;
+  int idx;
+
+  err = ksba_cms_get_recipients (cms, NULL, 0, &count);
+  fail_if_err2 (fname, err);
+  if (!count || count > sizeof recps / sizeof *recps)
+    fail ("unexpected number of recipients");
+  err = ksba_cms_get_recipients (cms, recps, sizeof recps / sizeof *recps,
+                                 &n);
+  fail_if_err2 (fname, err);
+  if (n != count)
+    fail ("number of recipients changed");
+
+  for (idx=0; idx < (int)count; idx++)
+    {
+      err = ksba_cms_get_issuer_serial (cms, idx, &issuer, &serial);
+      if (gpg_err_code (err) == GPG_ERR_UNSUPPORTED_CMS_OBJ)
+        {
+          if (recps[idx].issuer)
+            fail ("issuer returned for kekri or pwri");
+          continue;
+        }
+      fail_if_err2 (fname, err);
+      if (!recps[idx].issuer)
+        fail ("no issuer returned");
+      err = ksba_dn_der2str (recps[idx].issuer, recps[idx].issuerlen, &dn);
+      fail_if_err2 (fname, err);
+      if (strcmp (dn, issuer))
+        fail ("issuer does not match");
+      n = strtoul ((char*)serial+1, NULL, 10);
+      if (n != recps[idx].seriallen
+          || memcmp (strchr ((char*)serial, ':') + 1, recps[idx].serial, n))
+        fail ("serial number does not match");
+      ksba_free (dn);
+      ksba_free (issuer);
+      ksba_free (serial);
+    }
+}
+
+
 static void
 one_file (const char *fname)
 {
@@ -159,8 +328,11 @@ one_file (const char *fname)
 
 
   ct = ksba_cms_get_content_type (cms, 0);
+  if (ct == KSBA_CT_SIGNED_DATA)
+    check_signers (fname, cms);
   if (ct == KSBA_CT_ENVELOPED_DATA || ct == KSBA_CT_AUTHENVELOPED_DATA)
     {
+      check_recipients (fname, cms);
       for (idx=0; ; idx++)
         {
           err = ksba_cms_get_issuer_serial (cms, idx, &dn, &p);
@@ -287,6 +459,467 @@ one_file (const char *fname)
 }
 
 
+/* Check that the content of the signed data in FNAME is passed to
+   all hash functions.  With USE_SET also a function is set with
+   ksba_cms_set_hash_function.  */
+static void
+check_hash_functions (const char *fname, int use_set)
+{
+  gpg_error_t err;
+  FILE *fp;
+  ksba_reader_t r;
+  ksba_cms_t cms;
+  ksba_stop_reason_t stopreason;
+  struct sum_s sums[3];
+  int i;
+
+  memset (sums, 0, sizeof sums);
+  fp = fopen (fname, "rb");
+  if (!fp)
+    {
+      fprintf (stderr, "%s:%d: can't open `%s': %s\n",
+               __FILE__, __LINE__, fname, strerror (errno));
+      exit (1);
+    }
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_file (r, fp);
+  fail_if_err (err);
+  err = ksba_cms_new (&cms);
+  fail_if_err (err);
+  err = ksba_cms_set_reader_writer (cms, r, NULL);
+  fail_if_err (err);
+
+  err = ksba_cms_add_hash_function (cms, NULL, NULL);
+  if (gpg_err_code (err) != GPG_ERR_INV_VALUE)
+    fail ("adding a NULL hash function did not fail");
+  if (use_set)
+    ksba_cms_set_hash_function (cms, sum_hash_fnc, sums);
+  for (i = use_set; i < 3; i++)
+    {
+      err = ksba_cms_add_hash_function (cms, sum_hash_fnc, sums + i);
+      fail_if_err (err);
+    }
+
+  do
+    {
+      err = ksba_cms_parse (cms, &stopreason);
+      fail_if_err2 (fname, err);
+    }
+  while (stopreason != KSBA_SR_READY);
+
+  if (!sums[2].length)
+    fail ("no content has been hashed");
+  for (i = use_set? 0 : 1; i < 2; i++)
+    if (sums[i].length != sums[2].length || sums[i].sum != sums[2].sum)
+      fail ("hash functions got different data");
+
+  ksba_cms_release (cms);
+  ksba_reader_release (r);
+  fclose (fp);
+}
+
+
+static ksba_cert_t
+read_cert (const char *name)
+{
+  gpg_error_t err;
+  char *fname;
+  FILE *fp;
+  ksba_reader_t r;
+  ksba_cert_t cert;
+
+  fname = prepend_srcdir (name);
+  fp = fopen (fname, "rb");
+  if (!fp)
+    {
+      fprintf (stderr, "%s:%d: can't open `%s': %s\n",
+               __FILE__, __LINE__, fname, strerror (errno));
+      exit (1);
+    }
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_file (r, fp);
+  fail_if_err (err);
+  err = ksba_cert_new (&cert);
+  fail_if_err (err);
+  err = ksba_cert_read_der (cert, r);
+  fail_if_err2 (fname, err);
+  ksba_reader_release (r);
+  fclose (fp);
+  free (fname);
+  return cert;
+}
+
+
+/* Parse the signed data in FNAME with the certificate store STORE
+   and return its first certificate.  */
+static ksba_cert_t
+parse_with_store (const char *fname, ksba_certstore_t store)
+{
+  gpg_error_t err;
+  FILE *fp;
+  ksba_reader_t r;
+  ksba_cms_t cms;
+  ksba_stop_reason_t stopreason;
+  ksba_cert_t cert;
+
+  fp = fopen (fname, "rb");
+  if (!fp)
+    {
+      fprintf (stderr, "%s:%d: can't open `%s': %s\n",
+               __FILE__, __LINE__, fname, strerror (errno));
+      exit (1);
+    }
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_file (r, fp);
+  fail_if_err (err);
+  err = ksba_cms_new (&cms);
+  fail_if_err (err);
+  err = ksba_cms_set_reader_writer (cms, r, NULL);
+  fail_if_err (err);
+  err = ksba_cms_set_certstore (cms, store);
+  fail_if_err (err);
+  ksba_cms_set_hash_function (cms, dummy_hash_fnc, NULL);
+  do
+    {
+      err = ksba_cms_parse (cms, &stopreason);
+      fail_if_err2 (fname, err);
+    }
+  while (stopreason != KSBA_SR_READY);
+
+  cert = ksba_cms_get_cert (cms, 0);
+  if (!cert)
+    fail ("no certificate in signed data");
+  ksba_cms_release (cms);
+  ksba_reader_release (r);
+  fclose (fp);
+  return cert;
+}
+
+
+/* Check that the certificates of signed data are shared through a
+   certificate store.  */
+static void
+check_certstore (const char *fname)
+{
+  gpg_error_t err;
+  ksba_certstore_t store;
+  ksba_cert_t cert1, cert2, cert3;
+  unsigned int count;
+
+  err = ksba_certstore_new (&store);
+  fail_if_err (err);
+  cert1 = parse_with_store (fname, store);
+  count = ksba_certstore_count (store);
+  if (!count)
+    fail ("no certificates added to the store");
+  cert2 = parse_with_store (fname, store);
+  if (cert1 != cert2)
+    fail ("certificate not taken from the store");
+  if (ksba_certstore_count (store) != count)
+    fail ("certificates added twice to the store");
+  cert3 = parse_with_store (fname, NULL);
+  if (cert3 == cert1)
+    fail ("certificate taken from a store without one");
+  ksba_cert_release (cert1);
+  ksba_cert_release (cert2);
+  ksba_cert_release (cert3);
+  ksba_certstore_release (store);
+}
+
+
+/* Check that the certificates of signed data are shared through the
+   process-wide cache and that a store set for an object is used
+   instead.  */
+static void
+check_cert_cache (const char *fname)
+{
+  gpg_error_t err;
+  ksba_certstore_t store;
+  ksba_cert_t cert1, cert2, cert3;
+  size_t imagelen;
+
+  err = ksba_cms_set_cert_cache_limit (16);
+  fail_if_err (err);
+  cert1 = parse_with_store (fname, NULL);
+  cert2 = parse_with_store (fname, NULL);
+  if (cert1 != cert2)
+    fail ("certificate not taken from the cache");
+  err = ksba_certstore_new (&store);
+  fail_if_err (err);
+  cert3 = parse_with_store (fname, store);
+  if (cert3 == cert1)
+    fail ("certificate taken from the cache instead of the store");
+  ksba_cert_release (cert3);
+  ksba_certstore_release (store);
+
+  err = ksba_cms_set_cert_cache_limit (0);
+  fail_if_err (err);
+  if (!ksba_cert_get_image (cert1, &imagelen) || !imagelen)
+    fail ("certificate lost when the cache was disabled");
+  cert3 = parse_with_store (fname, NULL);
+  if (cert3 == cert1)
+    fail ("certificate taken from a disabled cache");
+  ksba_cert_release (cert1);
+  ksba_cert_release (cert2);
+  ksba_cert_release (cert3);
+}
+
+
+/* Build an enveloped data object with several recipients and check
+   that they are found in a store with some of their certificates.  */
+static void
+check_find_recipient (void)
+{
+  static const char *certnames[] =
+    { "samples/betsy.crt", "samples/cert_g10code_test1.der",
+      "samples/bull.crt" };
+  static const unsigned char iv[16] = { 1, 2, 3, 4 };
+  static const char encval[] = "(7:enc-val(3:rsa(1:a4:key0)))";
+  static const char content[] = "Some encrypted content";
+  enum { NRECPS = sizeof certnames / sizeof *certnames };
+  struct ksba_cms_recipient_s recps[NRECPS];
+  ksba_cert_t certs[NRECPS];
+  ksba_cert_t cert;
+  gpg_error_t err;
+  ksba_writer_t w;
+  ksba_reader_t r;
+  ksba_cms_t cms;
+  ksba_stop_reason_t stopreason;
+  ksba_certstore_t store;
+  const unsigned char *image;
+  size_t imagelen;
+  unsigned int count;
+  int i, idx;
+
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_mem (r, content, strlen (content));
+  fail_if_err (err);
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_mem (w, 0);
+  fail_if_err (err);
+  err = ksba_cms_new (&cms);
+  fail_if_err (err);
+  err = ksba_cms_set_reader_writer (cms, r, w);
+  fail_if_err (err);
+  err = ksba_cms_set_content_type (cms, 0, KSBA_CT_ENVELOPED_DATA);
+  fail_if_err (err);
+  err = ksba_cms_set_content_type (cms, 1, KSBA_CT_DATA);
+  fail_if_err (err);
+  err = ksba_cms_set_content_enc_algo (cms, "2.16.840.1.101.3.4.1.2",
+                                       iv, sizeof iv);
+  fail_if_err (err);
+  for (i=0; i < NRECPS; i++)
+    {
+      certs[i] = read_cert (certnames[i]);
+      err = ksba_cms_add_recipient (cms, certs[i]);
+      fail_if_err (err);
+      err = ksba_cms_set_enc_val (cms, i, (const unsigned char *)encval);
+      fail_if_err (err);
+    }
+  do
+    {
+      err = ksba_cms_build (cms, &stopreason);
+      fail_if_err (err);
+    }
+  while (stopreason != KSBA_SR_READY);
+  ksba_cms_release (cms);
+  ksba_reader_release (r);
+
+  image = ksba_writer_get_mem (w, &imagelen);
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_mem (r, image, imagelen);
+  fail_if_err (err);
+  err = ksba_cms_new (&cms);
+  fail_if_err (err);
+  err = ksba_cms_set_reader_writer (cms, r, NULL);
+  fail_if_err (err);
+  do
+    {
+      err = ksba_cms_parse (cms, &stopreason);
+      fail_if_err (err);
+    }
+  while (stopreason != KSBA_SR_READY);
+
+  err = ksba_cms_get_recipients (cms, recps, NRECPS, &count);
+  fail_if_err (err);
+  if (count != NRECPS)
+    fail ("wrong number of recipients in the built object");
+  for (i=0; i < NRECPS; i++)
+    if (strcmp (recps[i].type, "ktri") || !recps[i].issuer
+        || recps[i].keyid)
+      fail ("wrong recipient in the built object");
+  check_recipients ("built object", cms);
+
+  err = ksba_certstore_new (&store);
+  fail_if_err (err);
+  err = ksba_cms_find_recipient (cms, store, 0, &idx, &cert);
+  if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    fail ("recipient found in an empty store");
+  for (i=1; i < NRECPS; i++)
+    {
+      err = ksba_certstore_add (store, certs[i]);
+      fail_if_err (err);
+    }
+  for (i=1; i < NRECPS; i++)
+    {
+      err = ksba_cms_find_recipient (cms, store, i == 1? 0 : idx + 1,
+                                     &idx, &cert);
+      fail_if_err (err);
+      if (idx != i || cert != certs[i])
+        fail ("wrong recipient found");
+      ksba_cert_release (cert);
+    }
+  err = ksba_cms_find_recipient (cms, store, idx + 1, &idx, NULL);
+  if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    fail ("recipient found twice");
+
+  ksba_certstore_release (store);
+  ksba_cms_release (cms);
+  ksba_reader_release (r);
+  ksba_writer_release (w);
+  for (i=0; i < NRECPS; i++)
+    ksba_cert_release (certs[i]);
+}
+
+
+/* Build a signed data object with several signers and check that it
+   can be parsed again.  */
+static void
+check_build (void)
+{
+  static const char *certnames[] =
+    { "samples/cert_g10code_test1.der", "samples/betsy.crt",
+      "samples/bull.crt" };
+  static const char content[] = "Some content to be signed";
+  static const unsigned char digest[32] = { 1, 2, 3, 4 };
+  static const unsigned char sigval[] = "(7:sig-val(3:rsa(1:s4:sig0)))";
+  enum { NSIGNERS = sizeof certnames / sizeof *certnames };
+  struct ksba_cms_signer_s signers[NSIGNERS];
+  unsigned char sigvals[NSIGNERS][sizeof sigval];
+  ksba_cert_t certs[NSIGNERS];
+  ksba_cert_t cert;
+  gpg_error_t err;
+  ksba_writer_t w;
+  ksba_reader_t r;
+  ksba_cms_t cms;
+  ksba_stop_reason_t stopreason;
+  struct sum_s sum, expected;
+  const unsigned char *image;
+  size_t imagelen;
+  unsigned int count;
+  int i;
+
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_mem (w, 0);
+  fail_if_err (err);
+  err = ksba_cms_new (&cms);
+  fail_if_err (err);
+  err = ksba_cms_set_reader_writer (cms, NULL, w);
+  fail_if_err (err);
+  err = ksba_cms_set_content_type (cms, 0, KSBA_CT_SIGNED_DATA);
+  fail_if_err (err);
+  err = ksba_cms_set_content_type (cms, 1, KSBA_CT_DATA);
+  fail_if_err (err);
+  for (i=0; i < NSIGNERS; i++)
+    {
+      certs[i] = read_cert (certnames[i]);
+      err = ksba_cms_add_signer (cms, certs[i]);
+      fail_if_err (err);
+      err = ksba_cms_add_digest_algo (cms, "2.16.840.1.101.3.4.2.1");
+      fail_if_err (err);
+      err = ksba_cms_add_cert (cms, certs[i]);
+      fail_if_err (err);
+      memcpy (sigvals[i], sigval, sizeof sigval);
+      sigvals[i][sizeof sigval - 5] = '0' + i;
+    }
+
+  do
+    {
+      err = ksba_cms_build (cms, &stopreason);
+      fail_if_err (err);
+      if (stopreason == KSBA_SR_BEGIN_DATA)
+        {
+          err = ksba_writer_write_octet_string (w, content,
+                                                strlen (content), 1);
+          fail_if_err (err);
+          for (i=0; i < NSIGNERS; i++)
+            {
+              err = ksba_cms_set_message_digest (cms, i,
+                                                 digest, sizeof digest);
+              fail_if_err (err);
+            }
+        }
+      else if (stopreason == KSBA_SR_NEED_SIG)
+        {
+          err = ksba_cms_add_cert (cms, certs[0]);
+          if (gpg_err_code (err) != GPG_ERR_CONFLICT)
+            fail ("adding a certificate after they were written worked");
+          for (i=0; i < NSIGNERS; i++)
+            {
+              err = ksba_cms_set_sig_val (cms, i, sigvals[i]);
+              fail_if_err (err);
+            }
+        }
+    }
+  while (stopreason != KSBA_SR_READY);
+  ksba_cms_release (cms);
+
+  image = ksba_writer_get_mem (w, &imagelen);
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_mem (r, image, imagelen);
+  fail_if_err (err);
+  err = ksba_cms_new (&cms);
+  fail_if_err (err);
+  err = ksba_cms_set_reader_writer (cms, r, NULL);
+  fail_if_err (err);
+  memset (&sum, 0, sizeof sum);
+  ksba_cms_set_hash_function (cms, sum_hash_fnc, &sum);
+  do
+    {
+      err = ksba_cms_parse (cms, &stopreason);
+      fail_if_err (err);
+    }
+  while (stopreason != KSBA_SR_READY);
+
+  memset (&expected, 0, sizeof expected);
+  sum_hash_fnc (&expected, content, strlen (content));
+  if (sum.length != expected.length || sum.sum != expected.sum)
+    fail ("content of the built object does not match");
+  for (i=0; (cert = ksba_cms_get_cert (cms, i)); i++)
+    ksba_cert_release (cert);
+  if (i != NSIGNERS)
+    fail ("wrong number of certificates in the built object");
+  err = ksba_cms_get_signers (cms, signers, NSIGNERS, &count);
+  fail_if_err (err);
+  if (count != NSIGNERS)
+    fail ("wrong number of signers in the built object");
+  for (i=0; i < NSIGNERS; i++)
+    {
+      if (signers[i].digestlen != sizeof digest
+          || memcmp (signers[i].digest, digest, sizeof digest))
+        fail ("wrong message digest in the built object");
+      if (sexp_len (signers[i].sigval) != sexp_len (sigvals[i])
+          || memcmp (signers[i].sigval, sigvals[i], sexp_len (sigvals[i])))
+        fail ("wrong signature in the built object");
+    }
+  check_signers ("built object", cms);
+
+  ksba_cms_release (cms);
+  ksba_reader_release (r);
+  ksba_writer_release (w);
+  for (i=0; i < NSIGNERS; i++)
+    ksba_cert_release (certs[i]);
+}
+
+
 
 
 int
@@ -330,6 +963,17 @@ main (int argc, char **argv)
           one_file (fname);
           free(fname);
         }
+
+      fname = prepend_srcdir ("samples/rsa-sample1.p7s");
+      check_hash_functions (fname, 1);
+      check_hash_functions (fname, 0);
+      free (fname);
+      check_build ();
+      fname = prepend_srcdir ("samples/rsa-sample1.p7s");
+      check_certstore (fname);
+      check_cert_cache (fname);
+      free (fname);
+      check_find_recipient ();
     }
 
   if (!quiet)
@@ -17,9 +17,19 @@
  * along with this program; if not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <time.h>
+
 /*-- sha1.c --*/
 void sha1_hash_buffer (char *outbuf, const char *buffer, size_t length);
 
+/*-- synth.c --*/
+void synth_set_seed (unsigned long seed);
+unsigned int synth_random (void);
+gpg_error_t synth_crl (ksba_writer_t w, unsigned int nentries);
+gpg_error_t synth_cms (ksba_writer_t w, unsigned long long contentlen);
+gpg_error_t synth_cert (ksba_writer_t w, unsigned int nextns,
+                        unsigned int nrdns);
+
 
 
 #define digitp(p)   (*(p) >= '0' && *(p) <= '9')
@@ -227,3 +237,20 @@ print_time (ksba_isotime_t t)
   else
     printf ("%.4s-%.2s-%.2s %.2s:%.2s:%s", t, t+4, t+6, t+9, t+11, t+13);
 }
+
+
+/* Return true if EPOCH is the same time as the ISO time T.  */
+int
+epoch_matches (ksba_epoch_t epoch, const ksba_isotime_t t)
+{
+  time_t tt = epoch;
+  struct tm *tp;
+  char buf[32];
+
+  if (tt != epoch || !(tp = gmtime (&tt)))
+    return 0;
+  snprintf (buf, sizeof buf, "%04d%02d%02dT%02d%02d%02d",
+            1900 + tp->tm_year, tp->tm_mon+1, tp->tm_mday,
+            tp->tm_hour, tp->tm_min, tp->tm_sec);
+  return !strcmp (buf, t);
+}
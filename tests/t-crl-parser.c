@@ -189,6 +189,20 @@ one_file (const char *fname)
             err = ksba_crl_get_update_times (crl, this, next);
             if (gpg_err_code (err) != GPG_ERR_INV_TIME)
               fail_if_err2 (fname, err);
+            if (!err)
+              {
+                ksba_epoch_t epoch;
+
+                err = ksba_crl_get_update_epoch (crl, 0, &epoch);
+                fail_if_err2 (fname, err);
+                if (!epoch_matches (epoch, this))
+                  fail ("thisUpdate epoch mismatch");
+                err = ksba_crl_get_update_epoch (crl, 1, &epoch);
+                if (*next && (err || !epoch_matches (epoch, next)))
+                  fail ("nextUpdate epoch mismatch");
+                if (!*next && gpg_err_code (err) != GPG_ERR_NO_VALUE)
+                  fail ("missing nextUpdate not detected");
+              }
             if (!quiet)
               {
                 printf ("thisUpdate: ");
@@ -209,6 +223,14 @@ one_file (const char *fname)
 
             err = ksba_crl_get_item (crl, &serial, rdate, &reason);
             fail_if_err2 (fname, err);
+            {
+              ksba_epoch_t epoch;
+
+              err = ksba_crl_get_item_epoch (crl, &epoch);
+              fail_if_err2 (fname, err);
+              if (!epoch_matches (epoch, rdate))
+                fail ("revocation date epoch mismatch");
+            }
             if (!quiet)
               {
                 printf ("CRL entry %d: s=", ++count);
@@ -357,6 +379,672 @@ one_file (const char *fname)
 
 
 
+/* Open the CRL FNAME and return the CRL object with the reader R and
+   the file pointer FP.  */
+static ksba_crl_t
+open_crl (const char *fname, ksba_reader_t *r, FILE **fp)
+{
+  gpg_error_t err;
+  ksba_crl_t crl;
+
+  *fp = fopen (fname, "rb");
+  if (!*fp)
+    {
+      fprintf (stderr, "%s:%d: can't open `%s': %s\n",
+               __FILE__, __LINE__, fname, strerror (errno));
+      exit (1);
+    }
+  err = ksba_reader_new (r);
+  fail_if_err (err);
+  err = ksba_reader_set_file (*r, *fp);
+  fail_if_err (err);
+  err = ksba_crl_new (&crl);
+  fail_if_err (err);
+  err = ksba_crl_set_reader (crl, *r);
+  fail_if_err (err);
+  return crl;
+}
+
+
+/* Read the CRL FNAME into memory and return the CRL object with a
+   memory reader R.  */
+static ksba_crl_t
+open_crl_mem (const char *fname, ksba_reader_t *r)
+{
+  unsigned char buffer[4096];
+  size_t buflen;
+  gpg_error_t err;
+  ksba_crl_t crl;
+  FILE *fp;
+
+  fp = fopen (fname, "rb");
+  if (!fp)
+    {
+      fprintf (stderr, "%s:%d: can't open `%s': %s\n",
+               __FILE__, __LINE__, fname, strerror (errno));
+      exit (1);
+    }
+  buflen = fread (buffer, 1, sizeof buffer, fp);
+  fclose (fp);
+  if (!buflen || buflen == sizeof buffer)
+    fail ("error reading CRL into memory");
+
+  err = ksba_reader_new (r);
+  fail_if_err (err);
+  err = ksba_reader_set_mem (*r, buffer, buflen);
+  fail_if_err (err);
+  err = ksba_crl_new (&crl);
+  fail_if_err (err);
+  err = ksba_crl_set_reader (crl, *r);
+  fail_if_err (err);
+  return crl;
+}
+
+/* Check that all entries of the CRL in FNAME are found in IDX.  */
+static void
+check_entries (const char *fname, ksba_crl_index_t idx)
+{
+  gpg_error_t err;
+  FILE *fp;
+  ksba_reader_t r;
+  ksba_crl_t crl;
+  ksba_stop_reason_t stopreason;
+  ksba_sexp_t serial;
+  ksba_crl_reason_t reason, reason2;
+  ksba_epoch_t date, date2;
+  unsigned long n;
+  char *endp;
+  int count = 0;
+
+  crl = open_crl (fname, &r, &fp);
+  do
+    {
+      err = ksba_crl_parse (crl, &stopreason);
+      fail_if_err2 (fname, err);
+      if (stopreason != KSBA_SR_GOT_ITEM)
+        continue;
+      err = ksba_crl_get_item_epoch (crl, &date);
+      fail_if_err2 (fname, err);
+      err = ksba_crl_get_item (crl, &serial, NULL, &reason);
+      fail_if_err2 (fname, err);
+      n = strtoul ((char*)serial+1, &endp, 10);
+      err = ksba_crl_index_lookup (idx, (unsigned char*)endp+1, n,
+                                   &reason2, &date2);
+      fail_if_err2 (fname, err);
+      if (reason != reason2 || date != date2)
+        fail ("wrong index entry");
+      /* Modify the serial; this one must not be found.  */
+      endp[1] ^= 0x55;
+      err = ksba_crl_index_lookup (idx, (unsigned char*)endp+1, n,
+                                   NULL, NULL);
+      if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+        fail ("modified serial found in index");
+      xfree (serial);
+      count++;
+    }
+  while (stopreason != KSBA_SR_READY);
+  if (!count || ksba_crl_index_count (idx) > count)
+    fail ("wrong number of entries in the index");
+
+  ksba_crl_release (crl);
+  ksba_reader_release (r);
+  fclose (fp);
+}
+
+
+/* Check that the entries returned in batches by ksba_crl_get_items
+   are those in IDX.  */
+static void
+check_batches (const char *fname, ksba_crl_index_t idx)
+{
+  gpg_error_t err;
+  FILE *fp;
+  ksba_reader_t r;
+  ksba_crl_t crl;
+  ksba_stop_reason_t stopreason = 0;
+  struct ksba_crl_entry_s entries[7];
+  unsigned int nentries = sizeof entries / sizeof *entries;
+  ksba_crl_reason_t reason;
+  ksba_epoch_t date;
+  unsigned int i, n, count = 0;
+
+  crl = open_crl (fname, &r, &fp);
+  do
+    {
+      err = ksba_crl_get_items (crl, entries, nentries, &n, &stopreason);
+      fail_if_err2 (fname, err);
+      if (n > nentries || (stopreason == KSBA_SR_GOT_ITEM && n != nentries))
+        fail ("wrong number of entries returned");
+      for (i=0; i < n; i++)
+        {
+          err = ksba_crl_index_lookup (idx, entries[i].serial,
+                                       entries[i].seriallen, &reason, &date);
+          fail_if_err2 (fname, err);
+          if (reason != entries[i].reason || date != entries[i].date)
+            fail ("wrong entry returned");
+        }
+      count += n;
+    }
+  while (stopreason == KSBA_SR_GOT_ITEM);
+  if (stopreason != KSBA_SR_END_ITEMS)
+    fail ("expected KSBA_SR_END_ITEMS");
+  if (count < ksba_crl_index_count (idx))
+    fail ("entries missing");
+  err = ksba_crl_parse (crl, &stopreason);
+  fail_if_err2 (fname, err);
+  if (stopreason != KSBA_SR_READY)
+    fail ("expected KSBA_SR_READY");
+
+  ksba_crl_release (crl);
+  ksba_reader_release (r);
+  fclose (fp);
+}
+
+
+struct hashed_s
+{
+  unsigned char buffer[4096];
+  size_t length;
+  int ncalls;
+  const void *first;  /* The buffer passed to the first call.  */
+};
+
+static void
+collect_hash (void *arg, const void *buffer, size_t length)
+{
+  struct hashed_s *h = arg;
+
+  if (length > sizeof h->buffer - h->length)
+    fail ("too much data hashed");
+  if (!h->ncalls++)
+    h->first = buffer;
+  memcpy (h->buffer + h->length, buffer, length);
+  h->length += length;
+}
+
+
+/* Parse CRL until it is ready and return the hashed data in H.  */
+static void
+hash_crl (const char *fname, ksba_crl_t crl, struct hashed_s *h)
+{
+  gpg_error_t err;
+  ksba_stop_reason_t stopreason = 0;
+
+  h->length = 0;
+  h->ncalls = 0;
+  ksba_crl_set_hash_function (crl, collect_hash, h);
+  do
+    {
+      err = ksba_crl_parse (crl, &stopreason);
+      fail_if_err2 (fname, err);
+    }
+  while (stopreason != KSBA_SR_READY);
+}
+
+
+/* Check that a CRL read from memory is hashed in one call directly
+   from the memory of the reader and that the same data is hashed as with a file
+   reader.  */
+static void
+check_hash_spans (const char *fname)
+{
+  static struct hashed_s fromfile, frommem;
+  gpg_error_t err;
+  FILE *fp;
+  ksba_reader_t r;
+  ksba_crl_t crl;
+  const unsigned char *mem;
+  size_t memlen, off;
+
+  crl = open_crl (fname, &r, &fp);
+  hash_crl (fname, crl, &fromfile);
+  ksba_crl_release (crl);
+  ksba_reader_release (r);
+  fclose (fp);
+
+  crl = open_crl_mem (fname, &r);
+  err = ksba_reader_peek (r, &mem, &memlen);
+  fail_if_err (err);
+  hash_crl (fname, crl, &frommem);
+  for (off=0; off < memlen; off++)
+    if (frommem.first == mem + off)
+      break;
+  ksba_crl_release (crl);
+  ksba_reader_release (r);
+
+  if (!fromfile.length || frommem.length != fromfile.length
+      || memcmp (frommem.buffer, fromfile.buffer, fromfile.length))
+    fail ("hashed data of memory reader does not match");
+  if (frommem.ncalls != 1)
+    fail ("CRL from memory not hashed in one call");
+  if (off == memlen || frommem.length > memlen - off)
+    fail ("CRL from memory not hashed in place");
+}
+
+
+/* Build an index of the CRL in FNAME from NCHUNKS chunks and compare
+   it to IDX.  */
+static void
+check_chunks (const char *fname, ksba_crl_index_t idx, unsigned int nchunks)
+{
+  static struct hashed_s fromfile, fromchunks;
+  gpg_error_t err;
+  FILE *fp;
+  ksba_reader_t r;
+  ksba_crl_t crl;
+  ksba_stop_reason_t stopreason;
+  struct ksba_crl_chunk_s chunks[16];
+  ksba_crl_index_t parts[16], merged;
+  unsigned int i, count;
+
+  assert (nchunks <= sizeof chunks / sizeof *chunks);
+
+  crl = open_crl (fname, &r, &fp);
+  hash_crl (fname, crl, &fromfile);
+  ksba_crl_release (crl);
+  ksba_reader_release (r);
+  fclose (fp);
+
+  crl = open_crl_mem (fname, &r);
+  fromchunks.length = 0;
+  ksba_crl_set_hash_function (crl, collect_hash, &fromchunks);
+  err = ksba_crl_parse (crl, &stopreason);
+  fail_if_err2 (fname, err);
+  if (stopreason != KSBA_SR_BEGIN_ITEMS)
+    fail ("expected KSBA_SR_BEGIN_ITEMS");
+  err = ksba_crl_split_items (crl, chunks, nchunks, &count, &stopreason);
+  fail_if_err2 (fname, err);
+  if (stopreason != KSBA_SR_END_ITEMS)
+    fail ("expected KSBA_SR_END_ITEMS");
+  if (!count || count > nchunks)
+    fail ("wrong number of chunks returned");
+
+  /* This is what each thread would do.  */
+  for (i=0; i < count; i++)
+    {
+      err = ksba_crl_index_new (&parts[i]);
+      fail_if_err (err);
+      err = ksba_crl_build_index_chunk (&chunks[i], parts[i]);
+      fail_if_err2 (fname, err);
+    }
+
+  err = ksba_crl_index_new (&merged);
+  fail_if_err (err);
+  for (i=0; i < count; i++)
+    {
+      err = ksba_crl_index_merge (merged, parts[i]);
+      fail_if_err (err);
+      ksba_crl_index_release (parts[i]);
+    }
+
+  err = ksba_crl_parse (crl, &stopreason);
+  fail_if_err2 (fname, err);
+  if (stopreason != KSBA_SR_READY)
+    fail ("expected KSBA_SR_READY");
+  ksba_crl_release (crl);
+  ksba_reader_release (r);
+
+  if (fromchunks.length != fromfile.length
+      || memcmp (fromchunks.buffer, fromfile.buffer, fromfile.length))
+    fail ("hashed data of split CRL does not match");
+  if (ksba_crl_index_count (merged) != ksba_crl_index_count (idx))
+    fail ("wrong number of entries in merged index");
+  check_entries (fname, merged);
+  ksba_crl_index_release (merged);
+}
+
+
+/* Write IDX and read it back into a new index.  */
+static ksba_crl_index_t
+copy_index (ksba_crl_index_t idx)
+{
+  gpg_error_t err;
+  ksba_writer_t w;
+  ksba_reader_t r;
+  ksba_crl_index_t copy;
+  unsigned char *buf;
+  size_t buflen;
+
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_mem (w, 1024);
+  fail_if_err (err);
+  err = ksba_crl_index_write (idx, w);
+  fail_if_err (err);
+  buf = ksba_writer_snatch_mem (w, &buflen);
+  if (!buf)
+    fail ("no index written");
+  ksba_writer_release (w);
+
+  err = ksba_crl_index_new (&copy);
+  fail_if_err (err);
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_mem (r, buf, buflen);
+  fail_if_err (err);
+  err = ksba_crl_index_read (copy, r);
+  fail_if_err (err);
+  ksba_reader_release (r);
+  xfree (buf);
+  return copy;
+}
+
+
+/* Apply a delta to a copy of the index IDX of the CRL in FNAME and
+   then remove all entries.  */
+static void
+check_delta (const char *fname, ksba_crl_index_t idx)
+{
+  static const unsigned char newserial[] = { 0x7f, 0x01, 0x02 };
+  gpg_error_t err;
+  FILE *fp;
+  ksba_reader_t r;
+  ksba_crl_t crl;
+  ksba_stop_reason_t stopreason = 0;
+  ksba_sexp_t number;
+  struct ksba_crl_entry_s entries[16];
+  unsigned int nentries = sizeof entries / sizeof *entries;
+  unsigned char serials[16][64];
+  ksba_crl_index_t base, delta, copy;
+  ksba_crl_reason_t reason;
+  ksba_epoch_t date;
+  unsigned int i, j, n;
+
+  /* Get the serials of the base CRL which is not a delta CRL.  */
+  crl = open_crl (fname, &r, &fp);
+  err = ksba_crl_get_items (crl, entries, nentries, &n, &stopreason);
+  fail_if_err2 (fname, err);
+  if (stopreason != KSBA_SR_END_ITEMS || n < 3)
+    fail ("not enough entries for the delta test");
+  for (i=0; i < n; i++)
+    {
+      if (entries[i].seriallen > sizeof serials[i])
+        fail ("serial number too long");
+      memcpy (serials[i], entries[i].serial, entries[i].seriallen);
+      entries[i].serial = serials[i];
+    }
+  err = ksba_crl_parse (crl, &stopreason);
+  fail_if_err2 (fname, err);
+  err = ksba_crl_get_delta_base (crl, &number);
+  if (gpg_err_code (err) != GPG_ERR_NO_DATA)
+    fail ("base CRL claimed to be a delta CRL");
+  ksba_crl_release (crl);
+  ksba_reader_release (r);
+  fclose (fp);
+
+  err = ksba_crl_index_new (&base);
+  fail_if_err (err);
+  err = ksba_crl_index_merge (base, idx);
+  fail_if_err (err);
+
+  err = ksba_crl_index_new (&delta);
+  fail_if_err (err);
+  err = ksba_crl_index_add (delta, entries[0].serial, entries[0].seriallen,
+                            KSBA_CRLREASON_REMOVE_FROM_CRL, 0);
+  fail_if_err (err);
+  err = ksba_crl_index_add (delta, entries[1].serial, entries[1].seriallen,
+                            KSBA_CRLREASON_KEY_COMPROMISE, 42);
+  fail_if_err (err);
+  err = ksba_crl_index_add (delta, newserial, sizeof newserial,
+                            KSBA_CRLREASON_SUPERSEDED, 43);
+  fail_if_err (err);
+  err = ksba_crl_index_apply_delta (base, delta);
+  fail_if_err (err);
+  ksba_crl_index_release (delta);
+
+  /* Check the result also after writing it.  */
+  copy = copy_index (base);
+  for (j=0; j < 2; j++, base = copy)
+    {
+      if (ksba_crl_index_count (base) != ksba_crl_index_count (idx))
+        fail ("wrong number of entries after applying a delta");
+      err = ksba_crl_index_lookup (base, entries[0].serial,
+                                   entries[0].seriallen, NULL, NULL);
+      if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+        fail ("entry not removed by delta");
+      err = ksba_crl_index_lookup (base, entries[1].serial,
+                                   entries[1].seriallen, &reason, &date);
+      fail_if_err (err);
+      if (reason != KSBA_CRLREASON_KEY_COMPROMISE || date != 42)
+        fail ("entry not replaced by delta");
+      err = ksba_crl_index_lookup (base, newserial, sizeof newserial,
+                                   &reason, &date);
+      fail_if_err (err);
+      if (reason != KSBA_CRLREASON_SUPERSEDED || date != 43)
+        fail ("entry not added by delta");
+      for (i=2; i < n; i++)
+        {
+          err = ksba_crl_index_lookup (base, entries[i].serial,
+                                       entries[i].seriallen, &reason, &date);
+          fail_if_err (err);
+          if (reason != entries[i].reason || date != entries[i].date)
+            fail ("entry changed by delta");
+        }
+      if (!j)
+        ksba_crl_index_release (base);
+    }
+
+  /* Remove all entries of the copy.  */
+  for (i=1; i < n; i++)
+    {
+      err = ksba_crl_index_remove (base, entries[i].serial,
+                                   entries[i].seriallen);
+      fail_if_err (err);
+      for (j=i+1; j < n; j++)
+        {
+          err = ksba_crl_index_lookup (base, entries[j].serial,
+                                       entries[j].seriallen, NULL, NULL);
+          fail_if_err (err);
+        }
+    }
+  err = ksba_crl_index_remove (base, entries[1].serial, entries[1].seriallen);
+  if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    fail ("removed entry still found");
+  err = ksba_crl_index_remove (base, newserial, sizeof newserial);
+  fail_if_err (err);
+  if (ksba_crl_index_count (base))
+    fail ("index not empty after removing all entries");
+  ksba_crl_index_release (base);
+}
+
+
+/* Add and remove many serial numbers so that the probe sequences of
+   the index overlap.  */
+static void
+test_remove (void)
+{
+  gpg_error_t err;
+  ksba_crl_index_t idx;
+  unsigned char serial[2];
+  unsigned int i, n = 3000;
+
+  err = ksba_crl_index_new (&idx);
+  fail_if_err (err);
+  for (i=0; i < n; i++)
+    {
+      serial[0] = i >> 8;
+      serial[1] = i;
+      err = ksba_crl_index_add (idx, serial, 2, 0, i);
+      fail_if_err (err);
+    }
+  for (i=0; i < n; i += 2)
+    {
+      serial[0] = i >> 8;
+      serial[1] = i;
+      err = ksba_crl_index_remove (idx, serial, 2);
+      fail_if_err (err);
+    }
+  if (ksba_crl_index_count (idx) != n / 2)
+    fail ("wrong number of entries after removal");
+  for (i=0; i < n; i++)
+    {
+      ksba_epoch_t date;
+
+      serial[0] = i >> 8;
+      serial[1] = i;
+      err = ksba_crl_index_lookup (idx, serial, 2, NULL, &date);
+      if ((i & 1) && (err || date != i))
+        fail ("entry lost by removal of another entry");
+      if (!(i & 1) && gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+        fail ("removed entry still found");
+    }
+  ksba_crl_index_release (idx);
+}
+
+
+static const char test_digest_algo[] = "2.16.840.1.101.3.4.2.1";
+static const unsigned char test_digest[32] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+/* Check the information about the CRL stored in IDX.  */
+static void
+check_info (ksba_crl_index_t idx, const char *issuer,
+            ksba_epoch_t this_update)
+{
+  gpg_error_t err;
+  const char *s;
+  const unsigned char *p;
+  size_t n;
+  ksba_epoch_t t;
+
+  err = ksba_crl_index_get_info (idx, &s, NULL, NULL, &t, NULL);
+  fail_if_err (err);
+  if (strcmp (s, issuer) || t != this_update)
+    fail ("wrong CRL information in index");
+  err = ksba_crl_index_get_digest (idx, &s, &p, &n);
+  fail_if_err (err);
+  if (strcmp (s, test_digest_algo) || n != sizeof test_digest
+      || memcmp (p, test_digest, n))
+    fail ("wrong digest in index");
+}
+
+
+static void
+test_index (const char *fname)
+{
+  gpg_error_t err;
+  FILE *fp;
+  ksba_reader_t r;
+  ksba_writer_t w;
+  ksba_crl_t crl;
+  ksba_crl_index_t idx;
+  ksba_stop_reason_t stopreason;
+  ksba_sexp_t sigval;
+  unsigned char *buf;
+  size_t buflen;
+  char *issuer;
+  ksba_epoch_t this_update;
+
+  err = ksba_crl_index_new (&idx);
+  fail_if_err (err);
+  crl = open_crl (fname, &r, &fp);
+  err = ksba_crl_parse (crl, &stopreason);
+  fail_if_err2 (fname, err);
+  if (stopreason != KSBA_SR_BEGIN_ITEMS)
+    fail ("expected KSBA_SR_BEGIN_ITEMS");
+  err = ksba_crl_build_index (crl, idx, &stopreason);
+  fail_if_err2 (fname, err);
+  if (stopreason != KSBA_SR_END_ITEMS)
+    fail ("expected KSBA_SR_END_ITEMS");
+  err = ksba_crl_parse (crl, &stopreason);
+  fail_if_err2 (fname, err);
+  if (stopreason != KSBA_SR_READY)
+    fail ("expected KSBA_SR_READY");
+  sigval = ksba_crl_get_sig_val (crl);
+  if (!sigval)
+    fail ("signature value missing");
+  xfree (sigval);
+  err = ksba_crl_index_set_info (idx, crl);
+  fail_if_err2 (fname, err);
+  err = ksba_crl_index_set_digest (idx, test_digest_algo, test_digest,
+                                   sizeof test_digest);
+  fail_if_err (err);
+  err = ksba_crl_get_issuer (crl, &issuer);
+  fail_if_err2 (fname, err);
+  err = ksba_crl_get_update_epoch (crl, 0, &this_update);
+  fail_if_err2 (fname, err);
+  ksba_crl_release (crl);
+  ksba_reader_release (r);
+  fclose (fp);
+
+  check_entries (fname, idx);
+  check_batches (fname, idx);
+  check_hash_spans (fname);
+  check_chunks (fname, idx, 1);
+  check_chunks (fname, idx, 3);
+  check_chunks (fname, idx, 16);
+  check_delta (fname, idx);
+
+  /* Write the index and read it back.  */
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_mem (w, 1024);
+  fail_if_err (err);
+  err = ksba_crl_index_write (idx, w);
+  fail_if_err (err);
+  buf = ksba_writer_snatch_mem (w, &buflen);
+  if (!buf)
+    fail ("no index written");
+  ksba_writer_release (w);
+  ksba_crl_index_release (idx);
+
+  err = ksba_crl_index_new (&idx);
+  fail_if_err (err);
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_mem (r, buf, buflen);
+  fail_if_err (err);
+  err = ksba_crl_index_read (idx, r);
+  fail_if_err (err);
+  ksba_reader_release (r);
+  check_entries (fname, idx);
+  check_info (idx, issuer, this_update);
+  ksba_crl_index_release (idx);
+
+  /* Use the written index in place.  */
+  err = ksba_crl_index_new (&idx);
+  fail_if_err (err);
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_mem (r, buf, buflen);
+  fail_if_err (err);
+  err = ksba_crl_index_map (idx, r);
+  fail_if_err (err);
+  check_entries (fname, idx);
+  check_info (idx, issuer, this_update);
+  err = ksba_crl_index_add (idx, (const unsigned char *)"\x01", 1, 0, 0);
+  if (gpg_err_code (err) != GPG_ERR_NOT_SUPPORTED)
+    fail ("mapped index has been modified");
+  check_delta (fname, idx);
+  ksba_crl_index_release (idx);
+  ksba_reader_release (r);
+  xfree (issuer);
+
+  /* A truncated index must be rejected.  */
+  err = ksba_crl_index_new (&idx);
+  fail_if_err (err);
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_mem (r, buf, buflen - 1);
+  fail_if_err (err);
+  err = ksba_crl_index_read (idx, r);
+  if (gpg_err_code (err) != GPG_ERR_INV_OBJ)
+    fail ("truncated index not detected");
+  if (ksba_crl_index_count (idx))
+    fail ("truncated index not cleared");
+  ksba_reader_release (r);
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_mem (r, buf, buflen - 1);
+  fail_if_err (err);
+  err = ksba_crl_index_map (idx, r);
+  if (gpg_err_code (err) != GPG_ERR_INV_OBJ)
+    fail ("truncated index not detected by map");
+  ksba_reader_release (r);
+  ksba_crl_index_release (idx);
+  xfree (buf);
+}
+
+
 int
 main (int argc, char **argv)
 {
@@ -400,8 +1088,10 @@ main (int argc, char **argv)
           strcat (fname, "/samples/");
           strcat (fname, files[idx]);
           one_file (fname);
+          test_index (fname);
           xfree (fname);
         }
+      test_remove ();
     }
 
   return 0;
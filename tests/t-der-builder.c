@@ -172,6 +172,264 @@ test_der_builder (void)
 }
 
 
+static void
+test_der_builder_output (void)
+{
+  static const unsigned char expected[] =
+    "\x30\x13\x06\x03\x2a\x03\x04\x03\x0c\x00\x30"
+    "\x09\x02\x02\x01\xc3\xa0\x03\x02\x01\x2a";
+  gpg_error_t err;
+  ksba_der_t d;
+  ksba_writer_t w;
+  unsigned char buffer[200];
+  unsigned char *der;
+  size_t derlen;
+
+  d = ksba_der_builder_new (0);
+  if (!d)
+    fail ("error creating new DER builder");
+
+  ksba_der_add_tag (d, KSBA_CLASS_UNIVERSAL, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_oid (d, "1.2.3.4");
+  ksba_der_add_tag (d, KSBA_CLASS_ENCAPSULATE, KSBA_TYPE_BIT_STRING);
+  ksba_der_add_tag (d, KSBA_CLASS_UNIVERSAL, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_int (d, "\x01\xc3", 2, 0);
+  ksba_der_add_tag (d, KSBA_CLASS_CONTEXT, 0);
+  ksba_der_add_int (d, "\x2a", 1, 0);
+  ksba_der_add_end (d);
+  ksba_der_add_end (d);
+  ksba_der_add_end (d);
+  ksba_der_add_end (d);
+
+  /* Query the length and then write into a caller provided buffer.  */
+  err = ksba_der_builder_get_buf (d, NULL, 0, &derlen);
+  if (gpg_err_code (err) != GPG_ERR_BUFFER_TOO_SHORT || derlen != 21)
+    fail ("querying the length failed");
+  err = ksba_der_builder_get_buf (d, buffer, 20, &derlen);
+  if (gpg_err_code (err) != GPG_ERR_BUFFER_TOO_SHORT || derlen != 21)
+    fail ("short buffer not detected");
+  err = ksba_der_builder_get_buf (d, buffer, sizeof buffer, &derlen);
+  fail_if_err (err);
+  if (derlen != 21 || memcmp (buffer, expected, 21))
+    fail ("bad encoding");
+
+  /* The same object written to a writer.  */
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_mem (w, 16);
+  fail_if_err (err);
+  err = ksba_der_builder_write (d, w);
+  fail_if_err (err);
+  der = ksba_writer_snatch_mem (w, &derlen);
+  if (!der || derlen != 21 || memcmp (der, expected, 21))
+    fail ("bad encoding written");
+  xfree (der);
+  ksba_writer_release (w);
+
+  /* An encapsulating bit string whose length crosses the short form
+   * only due to the unused bits octet.  */
+  ksba_der_builder_reset (d);
+  memset (buffer, 'a', 125);
+  ksba_der_add_tag (d, KSBA_CLASS_ENCAPSULATE, KSBA_TYPE_BIT_STRING);
+  ksba_der_add_val (d, KSBA_CLASS_UNIVERSAL, KSBA_TYPE_OCTET_STRING,
+                    buffer, 125);
+  ksba_der_add_end (d);
+  err = ksba_der_builder_get (d, &der, &derlen);
+  fail_if_err (err);
+  if (derlen != 131 || memcmp (der, "\x03\x81\x80\x00\x04\x7d", 6))
+    fail ("bad encoding of the bit string");
+  xfree (der);
+
+  /* Unbalanced end tags are detected.  */
+  ksba_der_builder_reset (d);
+  ksba_der_add_tag (d, KSBA_CLASS_UNIVERSAL, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_end (d);
+  ksba_der_add_end (d);
+  err = ksba_der_builder_get (d, &der, &derlen);
+  if (gpg_err_code (err) != GPG_ERR_ENCODING_PROBLEM)
+    fail ("extra end tag not detected");
+
+  ksba_der_release (d);
+}
+
+
+static void
+test_der_builder_template (void)
+{
+  gpg_error_t err;
+  ksba_der_t d;
+  unsigned char buffer[64];
+  unsigned char *der;
+  size_t derlen;
+  int serial, atime;
+
+  d = ksba_der_builder_new (0);
+  if (!d)
+    fail ("error creating new DER builder");
+
+  ksba_der_add_tag (d, KSBA_CLASS_UNIVERSAL, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_int (d, "\x01\x02", 2, 1);
+  serial = ksba_der_mark_field (d);
+  ksba_der_add_val (d, KSBA_CLASS_UNIVERSAL, KSBA_TYPE_UTC_TIME,
+                    "200101000000Z", 13);
+  atime = ksba_der_mark_field (d);
+  ksba_der_add_oid (d, "1.2.3.4");
+  ksba_der_add_end (d);
+  if (serial < 0 || atime < 0)
+    fail ("marking a field failed");
+
+  err = ksba_der_builder_get_buf (d, buffer, sizeof buffer, &derlen);
+  fail_if_err (err);
+  if (derlen != 26
+      || memcmp (buffer, ("\x30\x18\x02\x02\x01\x02\x17\x0d""200101000000Z"
+                          "\x06\x03\x2a\x03\x04"), 26))
+    fail ("bad encoding");
+
+  /* Same length values are patched in place.  */
+  err = ksba_der_set_field (d, serial, "\x03\x04", 2);
+  fail_if_err (err);
+  err = ksba_der_set_field (d, atime, "211231235959Z", 13);
+  fail_if_err (err);
+  err = ksba_der_builder_update_buf (d, buffer, sizeof buffer, &derlen);
+  fail_if_err (err);
+  if (derlen != 26
+      || memcmp (buffer, ("\x30\x18\x02\x02\x03\x04\x17\x0d""211231235959Z"
+                          "\x06\x03\x2a\x03\x04"), 26))
+    fail ("bad encoding after patching");
+
+  /* A longer value changes the lengths.  */
+  err = ksba_der_set_field (d, serial, "\x00\x80\x01", 3);
+  fail_if_err (err);
+  err = ksba_der_builder_update_buf (d, buffer, 26, &derlen);
+  if (gpg_err_code (err) != GPG_ERR_BUFFER_TOO_SHORT || derlen != 27)
+    fail ("short buffer not detected");
+  err = ksba_der_builder_update_buf (d, buffer, sizeof buffer, &derlen);
+  fail_if_err (err);
+  err = ksba_der_builder_get (d, &der, &derlen);
+  fail_if_err (err);
+  if (derlen != 27
+      || memcmp (der, ("\x30\x19\x02\x03\x00\x80\x01\x17\x0d""211231235959Z"
+                       "\x06\x03\x2a\x03\x04"), 27)
+      || memcmp (buffer, der, 27))
+    fail ("bad encoding after resizing");
+  xfree (der);
+
+  err = ksba_der_set_field (d, serial - 1, "\x01", 1);
+  if (gpg_err_code (err) != GPG_ERR_INV_VALUE)
+    fail ("setting a constructed item not detected");
+
+  ksba_der_release (d);
+}
+
+
+static void
+test_der_cursor (void)
+{
+  static const unsigned char der[] =
+    "\x30\x1c\x06\x03\x2a\x03\x04\x31\x15\xa0\x03\x02"
+    "\x01\x01\xbf\x2a\x0d\x02\x01\x7f\x02\x01\x7f\x02"
+    "\x01\x82\x02\x02\x00\x83";
+  static struct {
+    const char *der;
+    size_t derlen;
+  } bad[] = {
+    { "\x30\x80\x05\x00\x00\x00", 6 },  /* Indefinite length.  */
+    { "\x04\x81\x01\x00", 4 },          /* Long form of a short length.  */
+    { "\x04\x82\x00\x01\x00", 5 },      /* Leading zero in the length.  */
+    { "\x1f\x05\x00", 3 },              /* Long form of a short tag.  */
+    { "\x9f\x80\x2a\x00", 4 },          /* Leading zero in the tag.  */
+    { "\x00\x00", 2 },                  /* End tag.  */
+    { "\x04\x05\x00", 3 },              /* Length too large.  */
+    { "\x01\x01\x01", 3 },              /* Non-canonical BOOLEAN.  */
+    { "\x02\x00", 2 },                  /* Empty INTEGER.  */
+    { "\x02\x02\x00\x7f", 4 },          /* Non-minimal INTEGER.  */
+    { "\x02\x02\xff\x80", 4 },          /* Non-minimal INTEGER.  */
+    { "\x05\x01\x00", 3 },              /* NULL with a value.  */
+    { "\x03\x01\x01", 3 },              /* Bad unused bits.  */
+    { "\x06\x02\x2a\x83", 4 },          /* Truncated OID.  */
+    { "\x06\x03\x2a\x80\x01", 5 },      /* Leading zero in an OID arc.  */
+    { "\x10\x00", 2 },                  /* Primitive SEQUENCE.  */
+    { "\x24\x03\x04\x01\x00", 5 }       /* Constructed OCTET STRING.  */
+  };
+  struct ksba_der_cursor_s cursor;
+  gpg_error_t err;
+  int class, tag, cons, i;
+  size_t len;
+  const unsigned char *p;
+
+  ksba_der_cursor_init (&cursor, der, sizeof der - 1);
+  err = ksba_der_cursor_next (&cursor, &class, &tag, &cons, &len);
+  fail_if_err (err);
+  if (class != KSBA_CLASS_UNIVERSAL || tag != KSBA_TYPE_SEQUENCE
+      || !cons || len != 28)
+    fail ("bad outer sequence");
+  err = ksba_der_cursor_enter (&cursor);
+  fail_if_err (err);
+  err = ksba_der_cursor_next (&cursor, &class, &tag, &cons, &len);
+  fail_if_err (err);
+  if (tag != KSBA_TYPE_OBJECT_ID || cons || len != 3)
+    fail ("bad OID");
+  err = ksba_der_cursor_value (&cursor, &p, &len);
+  fail_if_err (err);
+  if (len != 3 || memcmp (p, "\x2a\x03\x04", 3))
+    fail ("bad value of the OID");
+  err = ksba_der_cursor_next (&cursor, NULL, &tag, NULL, NULL);
+  fail_if_err (err);
+  if (tag != KSBA_TYPE_SET)
+    fail ("bad set");
+  err = ksba_der_cursor_enter (&cursor);
+  fail_if_err (err);
+  /* Skip the [0] and descend into the [42].  */
+  err = ksba_der_cursor_next (&cursor, NULL, NULL, NULL, NULL);
+  fail_if_err (err);
+  err = ksba_der_cursor_next (&cursor, &class, &tag, NULL, NULL);
+  fail_if_err (err);
+  if (class != KSBA_CLASS_CONTEXT || tag != 42)
+    fail ("bad tag [42]");
+  err = ksba_der_cursor_enter (&cursor);
+  fail_if_err (err);
+  for (i=0; !(err = ksba_der_cursor_next (&cursor, NULL, &tag, NULL, NULL));
+       i++)
+    if (tag != KSBA_TYPE_INTEGER)
+      fail ("integer expected");
+  if (gpg_err_code (err) != GPG_ERR_EOF || i != 4)
+    fail ("wrong number of integers");
+  err = ksba_der_cursor_tlv (&cursor, &p, &len);
+  if (gpg_err_code (err) != GPG_ERR_INV_STATE)
+    fail ("no current element expected");
+  /* Leave the [42] and the set.  */
+  err = ksba_der_cursor_leave (&cursor);
+  fail_if_err (err);
+  err = ksba_der_cursor_next (&cursor, NULL, NULL, NULL, NULL);
+  if (gpg_err_code (err) != GPG_ERR_EOF)
+    fail ("end of the set expected");
+  err = ksba_der_cursor_leave (&cursor);
+  fail_if_err (err);
+  err = ksba_der_cursor_next (&cursor, NULL, NULL, NULL, NULL);
+  if (gpg_err_code (err) != GPG_ERR_EOF)
+    fail ("end of the sequence expected");
+  err = ksba_der_cursor_leave (&cursor);
+  fail_if_err (err);
+  err = ksba_der_cursor_next (&cursor, NULL, NULL, NULL, NULL);
+  if (gpg_err_code (err) != GPG_ERR_EOF)
+    fail ("end of data expected");
+  err = ksba_der_cursor_leave (&cursor);
+  if (gpg_err_code (err) != GPG_ERR_INV_STATE)
+    fail ("leaving the top level should not be possible");
+
+  for (i=0; i < sizeof bad / sizeof *bad; i++)
+    {
+      ksba_der_cursor_init (&cursor, bad[i].der, bad[i].derlen);
+      err = ksba_der_cursor_next (&cursor, NULL, NULL, NULL, NULL);
+      if (gpg_err_code (err) != GPG_ERR_BAD_BER)
+        {
+          fprintf (stderr, PGM": bad DER #%d not detected\n", i);
+          fail ("invalid DER accepted");
+        }
+    }
+}
+
+
 int
 main (int argc, char **argv)
 {
@@ -191,6 +449,9 @@ main (int argc, char **argv)
     {
       test_der_encoding ();
       test_der_builder ();
+      test_der_builder_output ();
+      test_der_builder_template ();
+      test_der_cursor ();
     }
   else
     {
@@ -133,6 +133,225 @@ test_2 (void)
 }
 
 
+/* Build a DER encoded Name from SPEC.  The RDNs are separated by '|'
+   and attributes of the same RDN by '+'.  Each attribute starts with
+   a letter for the type ('c' = CN, 'o' = O, 'C' = C) and a letter for
+   the string type ('p' = PrintableString, 'u' = UTF8String, 't' =
+   TeletexString, 'b' = BMPString, 'x' = OCTET STRING), followed by
+   the value.  */
+static unsigned char *
+build_name (const char *spec, size_t *r_length)
+{
+  ksba_der_t d;
+  unsigned char *der, ucs2[100];
+  const char *oid;
+  size_t n, i;
+  int tag;
+  gpg_error_t err;
+
+  d = ksba_der_builder_new (0);
+  if (!d)
+    fail ("out of core");
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+  ksba_der_add_tag (d, 0, KSBA_TYPE_SET);
+  while (*spec)
+    {
+      oid = *spec == 'c'? "2.5.4.3" : *spec == 'o'? "2.5.4.10" : "2.5.4.6";
+      spec++;
+      tag = (*spec == 'p'? KSBA_TYPE_PRINTABLE_STRING
+             : *spec == 'u'? KSBA_TYPE_UTF8_STRING
+             : *spec == 't'? KSBA_TYPE_TELETEX_STRING
+             : *spec == 'b'? KSBA_TYPE_BMP_STRING
+             : KSBA_TYPE_OCTET_STRING);
+      spec++;
+      n = strcspn (spec, "|+");
+      ksba_der_add_tag (d, 0, KSBA_TYPE_SEQUENCE);
+      ksba_der_add_oid (d, oid);
+      if (tag == KSBA_TYPE_BMP_STRING)
+        {
+          for (i=0; i < n; i++)
+            {
+              ucs2[2*i] = 0;
+              ucs2[2*i+1] = spec[i];
+            }
+          ksba_der_add_val (d, 0, tag, ucs2, 2*n);
+        }
+      else
+        ksba_der_add_val (d, 0, tag, spec, n);
+      ksba_der_add_end (d);
+      spec += n;
+      if (*spec == '|')
+        {
+          ksba_der_add_end (d);
+          ksba_der_add_tag (d, 0, KSBA_TYPE_SET);
+        }
+      if (*spec)
+        spec++;
+    }
+  ksba_der_add_end (d);
+  ksba_der_add_end (d);
+  err = ksba_der_builder_get (d, &der, r_length);
+  fail_if_err (err);
+  ksba_der_release (d);
+  return der;
+}
+
+
+static void
+test_3 (void)
+{
+  static struct {
+    const char *a;
+    const char *b;
+    int result;
+  } tests[] = {
+    { "Cpde|opAcme|cpFoo Bar", "Cpde|opAcme|cpFoo Bar", 0 },
+    { "cpFoo Bar", "cu  foo   BAR ", 0 },
+    { "cpFoo Bar", "cuFooBar", 1 },
+    { "cbFoo", "cufoo", 0 },
+    { "cuM\xc3\xbcller", "ctM\xdcLLER", 0 },
+    { "cuM\xc3\xbcller", "ctMuller", 1 },
+    { "cuyes", "ouyes", 1 },
+    { "Cpde|opAcme+cpFoo", "Cpde|cpfoo+opACME", 0 },
+    { "Cpde|opAcme+cpFoo", "Cpde|opAcme|cpFoo", 1 },
+    { "Cpde|opAcme", "opAcme|Cpde", 1 },
+    { "Cpde|opAcme", "Cpde|opAcme|cpFoo", 1 },
+    { "cxFoo", "cxfoo", 1 },
+    { "cxFoo", "cpFoo", 1 },
+    { "cxFoo", "cxFoo", 0 }
+  };
+  unsigned char *a, *b;
+  size_t alen, blen;
+  int i, rc;
+
+  for (i=0; i < sizeof tests / sizeof *tests; i++)
+    {
+      a = build_name (tests[i].a, &alen);
+      b = build_name (tests[i].b, &blen);
+      rc = ksba_dn_cmp_der (a, alen, b, blen);
+      if (rc != tests[i].result || ksba_dn_cmp_der (b, blen, a, alen) != rc)
+        {
+          fprintf (stderr, "%s:%d: comparing `%s' and `%s' failed: %d\n",
+                   __FILE__, __LINE__, tests[i].a, tests[i].b, rc);
+          exit (1);
+        }
+      /* Truncated names are not valid.  */
+      if (ksba_dn_cmp_der (a, alen - 1, b, blen) != -1)
+        fail ("truncated name not detected");
+      xfree (a);
+      xfree (b);
+    }
+}
+
+
+static void
+test_4 (void)
+{
+  static struct {
+    const char *dn;
+    const char *name;
+    int result;
+  } tests[] = {
+    { "CN=Foo Bar,O=Acme,C=de", "Cpde|opAcme|cpFoo Bar", 0 },
+    { "CN=Foo Bar,O=Acme,C=de", "Cpde|opacme|cu  foo   BAR ", 0 },
+    { "CN=Foo Bar,O=Acme,C=de", "Cpde|opAcme|cbFoo Bar", 0 },
+    { "CN=Foo Bar,O=Acme,C=de", "Cpde|opAcme|cpFooBar", 1 },
+    { "CN=Foo Bar,O=Acme,C=de", "Cpde|opAcme", 1 },
+    { "CN=Foo Bar,O=Acme,C=de", "Cpde|opAcme|cpFoo Bar|cpX", 1 },
+    { "CN=Foo Bar,O=Acme,C=de", "opAcme|Cpde|cpFoo Bar", 1 },
+    { "CN=Foo,O=Acme,C=de", "Cpde|opAcme+cpFoo", 1 },
+    { "CN=M\\C3\\BCller", "ctM\xdcLLER", 0 },
+    { "CN=Muller", "ctM\xdcLLER", 1 }
+  };
+  ksba_dn_matcher_t matcher;
+  ksba_dn_cache_t cache;
+  unsigned char *der;
+  size_t derlen;
+  char *string, *string2;
+  int i, j, rc;
+  gpg_error_t err;
+
+  for (i=0; i < sizeof tests / sizeof *tests; i++)
+    {
+      err = ksba_dn_matcher_new (&matcher, tests[i].dn);
+      fail_if_err (err);
+      der = build_name (tests[i].name, &derlen);
+      rc = ksba_dn_matcher_match (matcher, der, derlen);
+      if (rc != tests[i].result)
+        {
+          fprintf (stderr, "%s:%d: matching `%s' and `%s' failed: %d\n",
+                   __FILE__, __LINE__, tests[i].dn, tests[i].name, rc);
+          exit (1);
+        }
+      if (ksba_dn_matcher_match (matcher, der, derlen - 1) != -1)
+        fail ("truncated name not detected");
+      xfree (der);
+      ksba_dn_matcher_release (matcher);
+    }
+
+  /* Use a small cache so that items get dropped.  */
+  err = ksba_dn_cache_new (&cache, 2);
+  fail_if_err (err);
+  for (j=0; j < 3; j++)
+    for (i=0; i < 4; i++)
+      {
+        der = build_name (tests[i].name, &derlen);
+        err = ksba_dn_der2str (der, derlen, &string);
+        fail_if_err (err);
+        err = ksba_dn_cache_der2str (cache, der, derlen, &string2);
+        fail_if_err (err);
+        if (strcmp (string, string2))
+          fail ("ksba_dn_cache_der2str returned a different string");
+        ksba_free (string2);
+        err = ksba_dn_cache_der2str (cache, der, derlen, &string2);
+        fail_if_err (err);
+        if (strcmp (string, string2))
+          fail ("ksba_dn_cache_der2str returned a different string");
+        ksba_free (string2);
+        ksba_free (string);
+        xfree (der);
+      }
+  ksba_dn_cache_release (cache);
+}
+
+
+static void
+test_5 (void)
+{
+  static const char *names[] = {
+    "Cpde|opAcme|cpFoo Bar",
+    "cu#Foo, Bar ",
+    "cbFoo+opA\\B|Cpde",
+    "ctM\xfcller",
+    "cxFoo"
+  };
+  unsigned char *der;
+  size_t derlen, len;
+  char *string, buffer[100];
+  int i;
+  gpg_error_t err;
+
+  for (i=0; i < sizeof names / sizeof *names; i++)
+    {
+      der = build_name (names[i], &derlen);
+      err = ksba_dn_der2str (der, derlen, &string);
+      fail_if_err (err);
+      err = ksba_dn_der2str_buf (der, derlen, buffer, sizeof buffer, &len);
+      fail_if_err (err);
+      if (strcmp (string, buffer) || len != strlen (string))
+        fail ("ksba_dn_der2str_buf returned a different string");
+      err = ksba_dn_der2str_buf (der, derlen, buffer, len, &len);
+      if (gpg_err_code (err) != GPG_ERR_BUFFER_TOO_SHORT
+          || len != strlen (string))
+        fail ("ksba_dn_der2str_buf did not detect a short buffer");
+      if (!ksba_dn_der2str_buf (der, derlen - 1, buffer, sizeof buffer, NULL))
+        fail ("truncated name not detected");
+      ksba_free (string);
+      xfree (der);
+    }
+}
+
+
 
 int
 main (int argc, char **argv)
@@ -181,6 +400,9 @@ main (int argc, char **argv)
       test_0 ();
       test_1 ();
       test_2 ();
+      test_3 ();
+      test_4 ();
+      test_5 ();
     }
   else
     {
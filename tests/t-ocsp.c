@@ -119,6 +119,8 @@ get_one_cert (const char *fname)
 
   err = ksba_cert_read_der (cert, r);
   fail_if_err2 (fname, err);
+  ksba_reader_release (r);
+  fclose (fp);
   return cert;
 }
 
@@ -149,6 +151,18 @@ one_request (const char *cert_fname, const char *issuer_cert_fname)
 
   err = ksba_ocsp_build_request (ocsp, &request, &requestlen);
   fail_if_err (err);
+
+  /* A second request is made from the template of the first.  */
+  {
+    unsigned char *request2;
+    size_t request2len;
+
+    err = ksba_ocsp_build_request (ocsp, &request2, &request2len);
+    fail_if_err (err);
+    if (request2len != requestlen || memcmp (request2, request, requestlen))
+      fail ("request from template does not match");
+    xfree (request2);
+  }
   ksba_ocsp_release (ocsp);
 
   printf ("OCSP request of length %u created\n", (unsigned int)requestlen);
@@ -166,6 +180,229 @@ one_request (const char *cert_fname, const char *issuer_cert_fname)
 }
 
 
+/* Check the response of length RESPONSELEN at RESPONSE which has
+   been parsed into OCSP for the REQUEST created for CERT and
+   ISSUER_CERT.  The status list, the zero-copy parser, and the
+   response cache need to agree with ksba_ocsp_get_status.  Returns
+   true if the response has been taken by the cache.  */
+static int
+check_response (ksba_ocsp_t ocsp, ksba_cert_t cert, ksba_cert_t issuer_cert,
+                const unsigned char *request, size_t requestlen,
+                const unsigned char *response, size_t responselen)
+{
+  gpg_error_t err;
+  ksba_status_t status;
+  ksba_crl_reason_t reason;
+  ksba_isotime_t this_update, next_update, revocation_time;
+  int cached_okay = 0;
+
+  err = ksba_ocsp_get_status (ocsp, cert,
+                              &status, this_update, next_update,
+                              revocation_time, &reason);
+  fail_if_err (err);
+
+  {
+    struct ksba_ocsp_status_s stati[1];
+    unsigned int count;
+
+    err = ksba_ocsp_get_status_list (ocsp, stati, 1, &count);
+    fail_if_err (err);
+    if (count != 1 || stati[0].cert != cert
+        || stati[0].status != status
+        || strcmp (stati[0].this_update, this_update)
+        || strcmp (stati[0].next_update, next_update)
+        || (status == KSBA_STATUS_REVOKED
+            && (strcmp (stati[0].revocation_time, revocation_time)
+                || stati[0].reason != reason)))
+      fail ("status list does not match");
+  }
+
+  /* Parse the response again without copying and check that the
+     status is the same. */
+  {
+    ksba_ocsp_t ocsp2;
+    unsigned char *request2;
+    size_t request2len;
+    ksba_status_t status2;
+    ksba_crl_reason_t reason2;
+    ksba_isotime_t this_update2, next_update2, revocation_time2;
+    ksba_ocsp_response_status_t response_status2;
+
+    err = ksba_ocsp_new (&ocsp2);
+    fail_if_err (err);
+    err = ksba_ocsp_add_target (ocsp2, cert, issuer_cert);
+    fail_if_err (err);
+    if (!no_nonce)
+      ksba_ocsp_set_nonce (ocsp2, "ABCDEFGHIJKLMNOP", 16);
+    err = ksba_ocsp_build_request (ocsp2, &request2, &request2len);
+    fail_if_err (err);
+    xfree (request2);
+    err = ksba_ocsp_parse_response_ref (ocsp2, response, responselen,
+                                        &response_status2);
+    fail_if_err (err);
+    err = ksba_ocsp_get_status (ocsp2, cert,
+                                &status2, this_update2, next_update2,
+                                revocation_time2, &reason2);
+    fail_if_err (err);
+    if (response_status2 != KSBA_OCSP_RSPSTATUS_SUCCESS
+        && response_status2 != KSBA_OCSP_RSPSTATUS_REPLAYED)
+      fail ("zero-copy parsing returned a different response status");
+    if (status2 != status
+        || strcmp (this_update2, this_update)
+        || strcmp (next_update2, next_update))
+      fail ("zero-copy parsing does not match");
+    ksba_ocsp_release (ocsp2);
+  }
+
+  /* Put the response into a cache and look it up again. */
+  {
+    ksba_ocsp_cache_t cache;
+    const unsigned char *cached;
+    size_t cachedlen;
+
+    err = ksba_ocsp_cache_new (&cache);
+    fail_if_err (err);
+    err = ksba_ocsp_cache_put (cache, response, responselen);
+    if (gpg_err_code (err) != GPG_ERR_NO_DATA)
+      {
+        fail_if_err (err);
+        err = ksba_ocsp_cache_get (cache, request, requestlen,
+                                   this_update, &cached, &cachedlen);
+        fail_if_err (err);
+        if (cachedlen != responselen
+            || memcmp (cached, response, responselen))
+          fail ("cached response does not match");
+        cached_okay = 1;
+      }
+    ksba_ocsp_cache_release (cache);
+  }
+
+  return cached_okay;
+}
+
+
+/* Build responses for CERT_FNAME with the response builder and check
+   that they are parsed as expected.  */
+void
+one_built_response (const char *cert_fname, const char *issuer_cert_fname)
+{
+  static const unsigned char sha1_algid[] =
+    { 0x30, 0x09, 0x06, 0x05, 0x2b, 0x0e, 0x03, 0x02, 0x1a, 0x05, 0x00 };
+  gpg_error_t err;
+  ksba_ocsp_t ocsp;
+  ksba_ocsp_response_builder_t rb;
+  struct ksba_ocsp_single_s single;
+  unsigned char *request;
+  size_t requestlen, n;
+  const unsigned char *certid, *tbs, *der;
+  size_t tbslen, derlen;
+  unsigned char keyhash[20], sig[64];
+  ksba_cert_t cert = get_one_cert (cert_fname);
+  ksba_cert_t issuer_cert = get_one_cert (issuer_cert_fname);
+  ksba_cert_t acert;
+  ksba_ocsp_response_status_t response_status;
+  ksba_status_t status;
+  ksba_crl_reason_t reason;
+  ksba_isotime_t this_update, next_update, revocation_time;
+  int pass;
+
+  err = ksba_ocsp_new (&ocsp);
+  fail_if_err (err);
+  err = ksba_ocsp_add_target (ocsp, cert, issuer_cert);
+  fail_if_err (err);
+  if (!no_nonce)
+    ksba_ocsp_set_nonce (ocsp, "ABCDEFGHIJKLMNOP", 16);
+  err = ksba_ocsp_build_request (ocsp, &request, &requestlen);
+  fail_if_err (err);
+
+  /* Take the hashes and the serial number from the CertID of the
+     request.  */
+  for (certid = NULL, n = 0; n + sizeof sha1_algid < requestlen; n++)
+    if (!memcmp (request + n, sha1_algid, sizeof sha1_algid))
+      {
+        certid = request + n + sizeof sha1_algid;
+        break;
+      }
+  if (!certid || certid[0] != 0x04 || certid[22] != 0x04
+      || certid[44] != 0x02 || certid[45] > 0x7f)
+    fail ("CertID not found in request");
+  memset (&single, 0, sizeof single);
+  single.issuer_name_hash = certid + 2;
+  single.issuer_key_hash = certid + 24;
+  single.serialno = certid + 46;
+  single.serialnolen = certid[45];
+  memset (keyhash, 0x11, sizeof keyhash);
+  memset (sig, 0x55, sizeof sig);
+
+  err = ksba_ocsp_response_builder_new (&rb);
+  fail_if_err (err);
+  err = ksba_ocsp_response_builder_set_responder (rb, NULL, 0, keyhash);
+  fail_if_err (err);
+  err = ksba_ocsp_response_builder_add_cert (rb, issuer_cert);
+  fail_if_err (err);
+
+  for (pass=0; pass < 2; pass++)
+    {
+      ksba_ocsp_response_builder_reset (rb);
+      if (!no_nonce)
+        {
+          err = ksba_ocsp_response_builder_set_nonce
+            (rb, (const unsigned char *)"ABCDEFGHIJKLMNOP", 16);
+          fail_if_err (err);
+        }
+      single.status = pass? KSBA_STATUS_REVOKED : KSBA_STATUS_GOOD;
+      strcpy (single.this_update, "20240101T120000");
+      strcpy (single.next_update, pass? "" : "20240102T120000");
+      strcpy (single.revocation_time, "20231224T180000");
+      single.reason = KSBA_CRLREASON_KEY_COMPROMISE;
+      err = ksba_ocsp_response_builder_add_singles (rb, &single, 1);
+      fail_if_err (err);
+
+      /* Reserve more space than needed for the signature.  */
+      err = ksba_ocsp_response_builder_get_tbs (rb, "20240101T120000",
+                                                "1.2.840.113549.1.1.11",
+                                                pass? 512 : sizeof sig,
+                                                &tbs, &tbslen);
+      fail_if_err (err);
+      err = ksba_ocsp_response_builder_set_sig (rb, sig, sizeof sig,
+                                                &der, &derlen);
+      fail_if_err (err);
+      if (!(tbs > der && tbs + tbslen < der + derlen))
+        fail ("tbsResponseData not within the response");
+
+      err = ksba_ocsp_parse_response (ocsp, der, derlen, &response_status);
+      fail_if_err (err);
+      if (response_status != KSBA_OCSP_RSPSTATUS_SUCCESS)
+        fail ("bad response status of built response");
+      err = ksba_ocsp_get_status (ocsp, cert,
+                                  &status, this_update, next_update,
+                                  revocation_time, &reason);
+      fail_if_err (err);
+      if (status != single.status
+          || strcmp (this_update, single.this_update)
+          || strcmp (next_update, single.next_update))
+        fail ("status of built response does not match");
+      if (pass && (strcmp (revocation_time, single.revocation_time)
+                   || reason != single.reason))
+        fail ("revocation of built response does not match");
+      acert = ksba_ocsp_get_cert (ocsp, 0);
+      if (!acert)
+        fail ("certificate missing in built response");
+      ksba_cert_release (acert);
+      /* Only a response with a nextUpdate may be cached.  */
+      if (check_response (ocsp, cert, issuer_cert, request, requestlen,
+                          der, derlen) != !pass)
+        fail ("built response not handled by the cache as expected");
+    }
+
+  ksba_ocsp_response_builder_release (rb);
+  ksba_cert_release (issuer_cert);
+  ksba_cert_release (cert);
+  ksba_ocsp_release (ocsp);
+  xfree (request);
+}
+
+
 void
 one_response (const char *cert_fname, const char *issuer_cert_fname,
               char *response_fname)
@@ -186,14 +423,12 @@ one_response (const char *cert_fname, const char *issuer_cert_fname,
      prepared for the response. */
   err = ksba_ocsp_add_target (ocsp, cert, issuer_cert);
   fail_if_err (err);
-  ksba_cert_release (issuer_cert);
 
   if (!no_nonce)
     ksba_ocsp_set_nonce (ocsp, "ABCDEFGHIJKLMNOP", 16);
 
   err = ksba_ocsp_build_request (ocsp, &request, &requestlen);
   fail_if_err (err);
-  xfree (request);
 
   /* Now for the response. */
   response = read_file (response_fname, &responselen);
@@ -280,6 +515,9 @@ one_response (const char *cert_fname, const char *issuer_cert_fname,
       printf ("\nnext update ......: ");
       print_time (next_update);
       putchar ('\n');
+      printf ("cached response ..: %s\n",
+              check_response (ocsp, cert, issuer_cert, request, requestlen,
+                              response, responselen)? "yes":"no");
       {
         int cert_idx;
         ksba_cert_t acert;
@@ -328,11 +566,14 @@ one_response (const char *cert_fname, const char *issuer_cert_fname,
         if (err && gpg_err_code (err) != GPG_ERR_EOF)
           fail_if_err (err);
       }
+
     }
 
 
+  ksba_cert_release (issuer_cert);
   ksba_cert_release (cert);
   ksba_ocsp_release (ocsp);
+  xfree (request);
   xfree (response);
 }
 
@@ -464,6 +705,7 @@ main (int argc, char **argv)
           f1 = prepend_srcdir (files[idx].cert_fname);
           f2 = prepend_srcdir (files[idx].issuer_cert_fname);
           one_request (f1, f2);
+          one_built_response (f1, f2);
           xfree (f2);
           xfree (f1);
         }
@@ -148,6 +148,80 @@ test_oid_to_str (void)
 }
 
 
+static void
+test_oid_buf (void)
+{
+  static const char *tests[] = {
+    "1.2.840.113549.1.7.2",     /* In the registry.  */
+    "2.5.29.14",                /* In the registry.  */
+    "1.2.840.10040.4.3",
+    "1.3.6.1.4.1.11591.2.1.1",
+    "2.48.4294967295",
+    NULL
+  };
+  int tidx;
+  gpg_error_t err;
+  unsigned char *der;
+  size_t derlen;
+  unsigned char buf[64];
+  size_t buflen;
+  char str[64];
+
+  for (tidx=0; tests[tidx]; tidx++)
+    {
+      err = ksba_oid_from_str (tests[tidx], &der, &derlen);
+      if (err)
+        {
+          fprintf (stderr, "test %d: %s\n", tidx, gpg_strerror (err));
+          exit (1);
+        }
+
+      err = ksba_oid_from_str_buf (tests[tidx], buf, sizeof buf, &buflen);
+      if (err)
+        {
+          fprintf (stderr, "test %d: %s\n", tidx, gpg_strerror (err));
+          exit (1);
+        }
+      if (buflen != derlen || memcmp (buf, der, derlen))
+        {
+          fprintf (stderr, "ksba_oid_from_str_buf test %d failed\n", tidx);
+          exit (1);
+        }
+      err = ksba_oid_from_str_buf (tests[tidx], buf, derlen - 1, &buflen);
+      if (gpg_err_code (err) != GPG_ERR_BUFFER_TOO_SHORT)
+        {
+          fprintf (stderr, "ksba_oid_from_str_buf short test %d failed\n",
+                   tidx);
+          exit (1);
+        }
+
+      err = ksba_oid_to_str_buf ((const char *)der, derlen,
+                                 str, sizeof str);
+      if (err)
+        {
+          fprintf (stderr, "test %d: %s\n", tidx, gpg_strerror (err));
+          exit (1);
+        }
+      if (strcmp (str, tests[tidx]))
+        {
+          fprintf (stderr, "ksba_oid_to_str_buf test %d failed\n", tidx);
+          fprintf (stderr, "  got=%s\n", str);
+          fprintf (stderr, " want=%s\n", tests[tidx]);
+          exit (1);
+        }
+      err = ksba_oid_to_str_buf ((const char *)der, derlen,
+                                 str, strlen (tests[tidx]));
+      if (gpg_err_code (err) != GPG_ERR_BUFFER_TOO_SHORT)
+        {
+          fprintf (stderr, "ksba_oid_to_str_buf short test %d failed\n",
+                   tidx);
+          exit (1);
+        }
+      ksba_free (der);
+    }
+}
+
+
 int
 main (int argc, char **argv)
 {
@@ -163,6 +237,7 @@ main (int argc, char **argv)
   if (!argc)
     {
       test_oid_to_str ();
+      test_oid_buf ();
     }
   else if (!strcmp (*argv, "--from-str"))
     {
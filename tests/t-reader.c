@@ -184,6 +184,540 @@ test_mem(const char* path)
   close (fd);
 }
 
+void
+test_mmap (const char* path)
+{
+  int fd = open (path, O_RDONLY);
+  gpg_error_t err = 0;
+  ksba_reader_t reader;
+  ksba_cert_t cert;
+
+  if (fd < 0)
+    {
+      perror ("open() failed");
+      exit (1);
+    }
+
+  if ((err = ksba_reader_new (&reader)))
+    {
+      fprintf (stderr, "ksba_reader_new() failed: %s\n", gpg_strerror (err));
+      exit (1);
+    }
+
+  err = ksba_reader_set_mmap (reader, fd, 0, 0);
+  if (gpg_err_code (err) == GPG_ERR_NOT_IMPLEMENTED)
+    {
+      ksba_reader_release (reader);
+      close (fd);
+      return;
+    }
+  if (err)
+    {
+      fprintf (stderr, "ksba_reader_set_mmap() failed: %s\n",
+               gpg_strerror (err));
+      exit (1);
+    }
+  /* The mapping must stay valid after closing the file.  */
+  close (fd);
+
+  if ((err = ksba_cert_new (&cert)))
+    {
+      fprintf (stderr, "ksba_cert_new() failed: %s\n", gpg_strerror (err));
+      exit (1);
+    }
+
+  if ((err = ksba_cert_read_der (cert, reader)))
+    {
+      fprintf(stderr, "ksba_cert_read_der() failed: %s\n", gpg_strerror (err));
+      exit (1);
+    }
+
+  ksba_cert_release (cert);
+  ksba_reader_release (reader);
+}
+
+void
+test_fd_buffered (const char* path)
+{
+  int fd = open (path, O_RDONLY);
+  gpg_error_t err = 0;
+  ksba_reader_t reader;
+  ksba_cert_t cert;
+  char buf[10];
+  size_t nread;
+
+  if (fd < 0)
+    {
+      perror ("open() failed");
+      exit (1);
+    }
+
+  if ((err = ksba_reader_new (&reader)))
+    {
+      fprintf (stderr, "ksba_reader_new() failed: %s\n", gpg_strerror (err));
+      exit (1);
+    }
+
+  if ((err = ksba_reader_set_fd (reader, fd)))
+    {
+      fprintf (stderr, "ksba_reader_set_fd() failed: %s\n", gpg_strerror (err));
+      exit (1);
+    }
+
+  /* Use a small buffer so that it needs to be refilled a few times.  */
+  if ((err = ksba_reader_set_buffer_size (reader, 64)))
+    {
+      fprintf (stderr, "ksba_reader_set_buffer_size() failed: %s\n",
+               gpg_strerror (err));
+      exit (1);
+    }
+
+  fail_if_err (ksba_reader_read (reader, buf, sizeof buf, &nread));
+  if (ksba_reader_tell (reader) != nread)
+    fail ("wrong position after buffered read");
+  fail_if_err (ksba_reader_unread (reader, buf, nread));
+  if (ksba_reader_tell (reader))
+    fail ("wrong position after unread");
+
+  if ((err = ksba_cert_new (&cert)))
+    {
+      fprintf (stderr, "ksba_cert_new() failed: %s\n", gpg_strerror (err));
+      exit (1);
+    }
+
+  if ((err = ksba_cert_read_der (cert, reader)))
+    {
+      fprintf(stderr, "ksba_cert_read_der() failed: %s\n", gpg_strerror (err));
+      exit (1);
+    }
+
+  ksba_cert_release (cert);
+  ksba_reader_release (reader);
+  close (fd);
+}
+
+void
+test_unread (const char* path)
+{
+  FILE *fp = fopen (path, "rb");
+  ksba_reader_t reader;
+  char buf[1000], buf2[1000];
+  size_t n, nread;
+
+  if (!fp)
+    {
+      perror ("fopen() failed");
+      exit (1);
+    }
+
+  fail_if_err (ksba_reader_new (&reader));
+  fail_if_err (ksba_reader_set_file (reader, fp));
+
+  /* Push back more than the old limit of the unread buffer.  */
+  fail_if_err (ksba_reader_read (reader, buf, 10, &nread));
+  if (nread != 10)
+    fail ("short read");
+  fail_if_err (ksba_reader_unread (reader, buf, 10));
+  fail_if_err (ksba_reader_read (reader, buf, 5, &nread));
+  for (n = nread; n < 700; n += nread)
+    fail_if_err (ksba_reader_read (reader, buf + n, 700 - n, &nread));
+  fail_if_err (ksba_reader_unread (reader, buf + 300, 400));
+  fail_if_err (ksba_reader_unread (reader, buf, 300));
+  if (ksba_reader_tell (reader))
+    fail ("wrong position after unread");
+  for (n=0; n < 700; n += nread)
+    fail_if_err (ksba_reader_read (reader, buf2 + n, 700 - n, &nread));
+  if (memcmp (buf, buf2, 700))
+    fail ("unread data does not match");
+
+  ksba_reader_release (reader);
+  fclose (fp);
+}
+
+void
+test_peek (void)
+{
+  static const char data[] = "0123456789";
+  gpg_error_t err;
+  ksba_reader_t reader;
+  const unsigned char *p;
+  size_t n, nread;
+  char buf[4];
+
+  if ((err = ksba_reader_new (&reader)))
+    fail_if_err (err);
+  if ((err = ksba_reader_set_mem (reader, data, 10)))
+    fail_if_err (err);
+
+  err = ksba_reader_peek (reader, &p, &n);
+  fail_if_err (err);
+  if (n != 10 || memcmp (p, data, 10))
+    fail ("peek returned wrong data");
+  fail_if_err (ksba_reader_consume (reader, 3));
+  if (ksba_reader_tell (reader) != 3)
+    fail ("consume did not advance the position");
+
+  /* Unread data must be returned by peek first.  */
+  fail_if_err (ksba_reader_read (reader, buf, 2, &nread));
+  fail_if_err (ksba_reader_unread (reader, buf, nread));
+  err = ksba_reader_peek (reader, &p, &n);
+  fail_if_err (err);
+  if (n < 2 || memcmp (p, "34", 2))
+    fail ("peek did not return unread data");
+  fail_if_err (ksba_reader_consume (reader, 2));
+
+  if (ksba_reader_consume (reader, 100) == 0)
+    fail ("consume beyond the end did not fail");
+  fail_if_err (ksba_reader_consume (reader, 10 - ksba_reader_tell (reader)));
+  err = ksba_reader_peek (reader, &p, &n);
+  if (gpg_err_code (err) != GPG_ERR_EOF)
+    fail ("peek at the end did not return EOF");
+
+  ksba_reader_release (reader);
+}
+
+/* Read the file PATH into a malloced buffer.  */
+static char *
+read_sample (const char *path, size_t *r_length)
+{
+  FILE *fp = fopen (path, "rb");
+  char *buf;
+  size_t n;
+
+  if (!fp)
+    {
+      perror ("fopen() failed");
+      exit (1);
+    }
+  buf = xmalloc (100000);
+  n = fread (buf, 1, 100000, fp);
+  fclose (fp);
+  *r_length = n;
+  return buf;
+}
+
+
+/* A growing buffer to collect the output of a parser run.  */
+struct collect_s
+{
+  char buf[100000];
+  size_t len;
+};
+
+static void
+collect (struct collect_s *c, const void *buffer, size_t length)
+{
+  if (length > sizeof c->buf - c->len)
+    fail ("collect buffer too short");
+  memcpy (c->buf + c->len, buffer, length);
+  c->len += length;
+}
+
+static void
+collect_hash (void *arg, const void *buffer, size_t length)
+{
+  collect (arg, buffer, length);
+}
+
+static int
+collect_write (void *arg, const void *buffer, size_t length)
+{
+  collect (arg, buffer, length);
+  return 0;
+}
+
+
+/* A callback reader which delivers its data in tiny pieces and
+   claims to have no data every other call.  */
+struct trickle_s
+{
+  const char *data;
+  size_t length;
+  size_t pos;
+  int ncalls;
+  int nblocked;
+};
+
+static int
+trickle_cb (void *cb_value, char *buffer, size_t count, size_t *r_nread)
+{
+  struct trickle_s *t = cb_value;
+  size_t n;
+
+  *r_nread = 0;
+  if (!count)
+    return 0;
+  if (t->pos == t->length)
+    return -1;  /* EOF */
+  if (!(t->ncalls++ % 2))
+    {
+      t->nblocked++;
+      return gpg_error (GPG_ERR_EAGAIN);
+    }
+  n = 1 + (t->ncalls % 7);
+  if (n > count)
+    n = count;
+  if (n > t->length - t->pos)
+    n = t->length - t->pos;
+  memcpy (buffer, t->data + t->pos, n);
+  t->pos += n;
+  *r_nread = n;
+  return 0;
+}
+
+
+/* Parse the CRL or CMS object using reader R and write the stop
+   reasons and the parsed items followed by the hashed data and the
+   output to OUT.  */
+static void
+run_parser (ksba_reader_t r, int is_crl, struct collect_s *out)
+{
+  static struct collect_s hashed, written;
+  gpg_error_t err;
+  ksba_stop_reason_t stopreason = 0;
+  ksba_crl_t crl = NULL;
+  ksba_cms_t cms = NULL;
+  ksba_writer_t w = NULL;
+  int nblocked = 0;
+  char tag;
+
+  hashed.len = written.len = 0;
+
+  if (is_crl)
+    {
+      fail_if_err (ksba_crl_new (&crl));
+      fail_if_err (ksba_crl_set_reader (crl, r));
+      ksba_crl_set_hash_function (crl, collect_hash, &hashed);
+    }
+  else
+    {
+      fail_if_err (ksba_writer_new (&w));
+      fail_if_err (ksba_writer_set_cb (w, collect_write, &written));
+      fail_if_err (ksba_cms_new (&cms));
+      fail_if_err (ksba_cms_set_reader_writer (cms, r, w));
+    }
+
+  do
+    {
+      if (crl)
+        err = ksba_crl_parse (crl, &stopreason);
+      else
+        err = ksba_cms_parse (cms, &stopreason);
+      fail_if_err (err);
+      if (stopreason == KSBA_SR_WOULD_BLOCK)
+        {
+          if (++nblocked > 100000)
+            fail ("parser does not make progress");
+          continue;
+        }
+      tag = 'A' + stopreason;
+      collect (out, &tag, 1);
+      if (crl && stopreason == KSBA_SR_GOT_ITEM)
+        {
+          ksba_sexp_t serial;
+          ksba_isotime_t rdate;
+
+          fail_if_err (ksba_crl_get_item (crl, &serial, rdate, NULL));
+          collect (out, serial, strlen ((char*)serial));
+          collect (out, rdate, strlen (rdate));
+          xfree (serial);
+        }
+      if (cms && stopreason == KSBA_SR_BEGIN_DATA)
+        ksba_cms_set_hash_function (cms, collect_hash, &hashed);
+      if (cms && (stopreason == KSBA_SR_NEED_HASH
+                  || stopreason == KSBA_SR_END_DATA))
+        {
+          const char *s;
+          int i;
+
+          for (i=0; (s = ksba_cms_get_digest_algo_list (cms, i)); i++)
+            collect (out, s, strlen (s));
+          for (i=0; (s = ksba_cms_get_digest_algo (cms, i)); i++)
+            collect (out, s, strlen (s));
+        }
+    }
+  while (stopreason != KSBA_SR_READY);
+
+  collect (out, hashed.buf, hashed.len);
+  collect (out, written.buf, written.len);
+  ksba_crl_release (crl);
+  ksba_cms_release (cms);
+  ksba_writer_release (w);
+}
+
+
+void
+test_nonblocking (const char *path, int is_crl)
+{
+  static struct collect_s expected, result;
+  struct trickle_s trickle;
+  ksba_reader_t reader;
+  size_t length;
+  char *data;
+
+  data = read_sample (path, &length);
+  expected.len = result.len = 0;
+
+  fail_if_err (ksba_reader_new (&reader));
+  fail_if_err (ksba_reader_set_mem (reader, data, length));
+  run_parser (reader, is_crl, &expected);
+  ksba_reader_release (reader);
+
+  memset (&trickle, 0, sizeof trickle);
+  trickle.data = data;
+  trickle.length = length;
+  fail_if_err (ksba_reader_new (&reader));
+  fail_if_err (ksba_reader_set_cb (reader, trickle_cb, &trickle));
+  fail_if_err (ksba_reader_set_nonblocking (reader, 1));
+  run_parser (reader, is_crl, &result);
+  ksba_reader_release (reader);
+
+  if (!trickle.nblocked)
+    fail ("callback never reported EAGAIN");
+  if (result.len != expected.len
+      || memcmp (result.buf, expected.buf, result.len))
+    fail ("non-blocking parse does not match blocking parse");
+
+  xfree (data);
+}
+
+/* Append an octet string chunk with the LENGTH bytes at BUFFER to
+   the data at P and return the new end.  */
+static char *
+put_chunk (char *p, const char *buffer, size_t length)
+{
+  *p++ = 0x04;
+  if (length > 127)
+    *p++ = (char)0x81;
+  *p++ = length;
+  memcpy (p, buffer, length);
+  return p + length;
+}
+
+
+/* Split the content of the signed data sample at PATH into many small
+   chunks, some of them within constructed chunks, and check that all
+   readers pass the same content as with the original sample.  */
+void
+test_ndef_chunks (const char *path)
+{
+  static const unsigned char ndef[] = { 0x24, 0x80, 0x04, 0x82, 0x02, 0xab };
+  static struct collect_s expected, result;
+  struct trickle_s trickle;
+  ksba_reader_t reader;
+  const char *content;
+  size_t length, newlength, off;
+  char *data, *newdata, *p;
+  FILE *fp;
+
+  data = read_sample (path, &length);
+  if (length < 52 + 6 + 683 || memcmp (data + 52, ndef, sizeof ndef))
+    fail ("unexpected encoding of the sample's content");
+  content = data + 52 + 6;
+
+  newdata = xmalloc (2 * length);
+  memcpy (newdata, data, 54);
+  p = newdata + 54;
+  for (off = 0; off < 300; off += 10)
+    p = put_chunk (p, content + off, 10);
+  *p++ = 0;
+  *p++ = 0;
+  for (; off < 500; off += 20)
+    p = put_chunk (p, content + off, 20);
+  *p++ = 0x24;
+  *p++ = (char)0x80;
+  p = put_chunk (p, content + off, 683 - off);
+  memcpy (p, content + 683, length - 58 - 683);
+  newlength = p - newdata + length - 58 - 683;
+
+  expected.len = 0;
+  fail_if_err (ksba_reader_new (&reader));
+  fail_if_err (ksba_reader_set_mem (reader, data, length));
+  run_parser (reader, 0, &expected);
+  ksba_reader_release (reader);
+
+  result.len = 0;
+  fail_if_err (ksba_reader_new (&reader));
+  fail_if_err (ksba_reader_set_mem (reader, newdata, newlength));
+  run_parser (reader, 0, &result);
+  ksba_reader_release (reader);
+  if (result.len != expected.len
+      || memcmp (result.buf, expected.buf, result.len))
+    fail ("parsing small chunks from memory does not match");
+
+  /* A small read-ahead buffer so that chunks cross its end.  */
+  fp = tmpfile ();
+  if (!fp || fwrite (newdata, newlength, 1, fp) != 1 || fflush (fp))
+    {
+      perror ("writing temporary file failed");
+      exit (1);
+    }
+  rewind (fp);
+  result.len = 0;
+  fail_if_err (ksba_reader_new (&reader));
+  fail_if_err (ksba_reader_set_fd (reader, fileno (fp)));
+  fail_if_err (ksba_reader_set_buffer_size (reader, 64));
+  run_parser (reader, 0, &result);
+  ksba_reader_release (reader);
+  fclose (fp);
+  if (result.len != expected.len
+      || memcmp (result.buf, expected.buf, result.len))
+    fail ("parsing small chunks from a buffered fd does not match");
+
+  memset (&trickle, 0, sizeof trickle);
+  trickle.data = newdata;
+  trickle.length = newlength;
+  result.len = 0;
+  fail_if_err (ksba_reader_new (&reader));
+  fail_if_err (ksba_reader_set_cb (reader, trickle_cb, &trickle));
+  fail_if_err (ksba_reader_set_nonblocking (reader, 1));
+  run_parser (reader, 0, &result);
+  ksba_reader_release (reader);
+  if (result.len != expected.len
+      || memcmp (result.buf, expected.buf, result.len))
+    fail ("non-blocking parsing of small chunks does not match");
+
+  xfree (newdata);
+  xfree (data);
+}
+
+
+/* Read several certificates from one reader so that the decoder is
+   reused.  */
+void
+test_cert_stream (const char *path)
+{
+  ksba_reader_t reader;
+  ksba_cert_t cert;
+  const unsigned char *image;
+  size_t length, n;
+  char *data, *stream;
+  int i;
+
+  data = read_sample (path, &length);
+  stream = xmalloc (3 * length);
+  for (i=0; i < 3; i++)
+    memcpy (stream + i * length, data, length);
+
+  fail_if_err (ksba_reader_new (&reader));
+  fail_if_err (ksba_reader_set_mem (reader, stream, 3 * length));
+  for (i=0; i < 3; i++)
+    {
+      fail_if_err (ksba_cert_new (&cert));
+      fail_if_err (ksba_cert_read_der (cert, reader));
+      image = ksba_cert_get_image (cert, &n);
+      if (!image || n != length || memcmp (image, data, n))
+        fail ("certificate read from stream does not match");
+      ksba_cert_release (cert);
+    }
+  if (ksba_reader_tell (reader) != 3 * length)
+    fail ("stream not completely read");
+  ksba_reader_release (reader);
+  xfree (stream);
+  xfree (data);
+}
+
+
 int
 main (int argc, char **argv)
 {
@@ -194,7 +728,26 @@ main (int argc, char **argv)
       test_fd (fname);
       test_file (fname);
       test_mem (fname);
+      test_mmap (fname);
+      test_fd_buffered (fname);
+      test_unread (fname);
+      test_cert_stream (fname);
       free(fname);
+      test_peek ();
+
+      fname = prepend_srcdir ("samples/ov-test-crl.crl");
+      test_nonblocking (fname, 1);
+      free (fname);
+      fname = prepend_srcdir ("samples/rsa-sample1.p7s");
+      test_nonblocking (fname, 0);
+      test_ndef_chunks (fname);
+      free (fname);
+      fname = prepend_srcdir ("samples/rsa-sample1.p7m");
+      test_nonblocking (fname, 0);
+      free (fname);
+      fname = prepend_srcdir ("samples/detached-sig.cms");
+      test_nonblocking (fname, 0);
+      free (fname);
     }
   else
     {
@@ -204,6 +757,9 @@ main (int argc, char **argv)
           test_fd (argv[i]);
           test_file (argv[i]);
           test_mem (argv[i]);
+          test_mmap (argv[i]);
+          test_fd_buffered (argv[i]);
+          test_unread (argv[i]);
         }
     }
 
@@ -0,0 +1,229 @@
+/* t-stats.c - Tests for the statistics counters
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * KSBA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <errno.h>
+
+#include "../src/ksba.h"
+
+#define PGM "t-stats"
+
+#include "t-common.h"
+
+
+static int verbose;
+
+
+struct trace_s
+{
+  int ncalls;
+  int nready;
+  unsigned long long last;
+};
+
+
+static void
+trace_cb (void *opaque, const char *phase, int reason, unsigned long long usec)
+{
+  struct trace_s *trace = opaque;
+
+  if (verbose)
+    printf ("%llu: %s %d\n", usec, phase, reason);
+  if (strcmp (phase, "crl"))
+    fail ("unexpected phase");
+  if (reason == KSBA_SR_GOT_ITEM)
+    fail ("entry traced");
+  if (usec < trace->last)
+    fail ("time goes backwards");
+  trace->last = usec;
+  trace->ncalls++;
+  if (reason == KSBA_SR_READY)
+    trace->nready++;
+}
+
+
+static void
+dummy_hash (void *arg, const void *buffer, size_t length)
+{
+  (void)arg;
+  (void)buffer;
+  (void)length;
+}
+
+
+/* Parse a CRL from a file and check that the counters advance.  */
+static void
+test_crl (void)
+{
+  gpg_error_t err;
+  char *fname;
+  FILE *fp;
+  ksba_reader_t r;
+  ksba_crl_t crl;
+  ksba_stop_reason_t stopreason;
+  struct ksba_stats_s stats;
+  struct trace_s trace;
+
+  ksba_reset_stats ();
+  memset (&trace, 0, sizeof trace);
+  ksba_set_trace_cb (trace_cb, &trace);
+
+  fname = prepend_srcdir ("samples/crl_testpki_testpca.der");
+  fp = fopen (fname, "rb");
+  if (!fp)
+    {
+      fprintf (stderr, "%s:%d: can't open `%s': %s\n",
+               __FILE__, __LINE__, fname, strerror (errno));
+      exit (1);
+    }
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_file (r, fp);
+  fail_if_err (err);
+  err = ksba_crl_new (&crl);
+  fail_if_err (err);
+  err = ksba_crl_set_reader (crl, r);
+  fail_if_err (err);
+  ksba_crl_set_hash_function (crl, dummy_hash, NULL);
+  do
+    {
+      err = ksba_crl_parse (crl, &stopreason);
+      fail_if_err (err);
+    }
+  while (stopreason != KSBA_SR_READY);
+  ksba_crl_release (crl);
+  ksba_reader_release (r);
+  fclose (fp);
+  xfree (fname);
+  ksba_set_trace_cb (NULL, NULL);
+
+  err = ksba_get_stats (&stats);
+  if (gpg_err_code (err) == GPG_ERR_NOT_SUPPORTED)
+    {
+      if (verbose)
+        printf ("statistics not enabled\n");
+      if (stats.tl_decoded || trace.ncalls)
+        fail ("counters used while not enabled");
+      return;
+    }
+  fail_if_err (err);
+  if (verbose)
+    printf ("read_file=%llu tl=%llu nodes=%llu/%llu trees=%llu/%lluus"
+            " decoder=%llu hash=%llu\n",
+            stats.read_file, stats.tl_decoded,
+            stats.nodes_allocated, stats.nodes_freed,
+            stats.create_tree_calls, stats.create_tree_usec,
+            stats.decoder_calls, stats.hash_bytes);
+  if (!stats.read_file || stats.read_mem || stats.read_fd || stats.read_cb)
+    fail ("wrong reader counters");
+  if (!stats.tl_decoded)
+    fail ("no TL headers counted");
+  if (!stats.create_tree_calls)
+    fail ("no ksba_asn_create_tree calls counted");
+  if (!stats.hash_bytes || stats.hash_bytes > stats.read_file)
+    fail ("wrong number of hashed bytes");
+  if (trace.nready != 1 || trace.ncalls < 3)
+    fail ("wrong number of trace calls");
+
+  ksba_reset_stats ();
+  err = ksba_get_stats (&stats);
+  fail_if_err (err);
+  if (stats.tl_decoded || stats.read_file)
+    fail ("counters not reset");
+}
+
+
+/* Check that the nodes of a parsed certificate are all released.  */
+static void
+test_nodes (void)
+{
+  gpg_error_t err;
+  char *fname;
+  FILE *fp;
+  ksba_reader_t r;
+  ksba_cert_t cert;
+  struct ksba_stats_s stats;
+
+  fname = prepend_srcdir ("samples/cert_g10code_test1.der");
+  fp = fopen (fname, "rb");
+  if (!fp)
+    {
+      fprintf (stderr, "%s:%d: can't open `%s': %s\n",
+               __FILE__, __LINE__, fname, strerror (errno));
+      exit (1);
+    }
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_file (r, fp);
+  fail_if_err (err);
+  err = ksba_cert_new (&cert);
+  fail_if_err (err);
+
+  ksba_reset_stats ();
+  err = ksba_cert_read_der (cert, r);
+  fail_if_err (err);
+  ksba_cert_release (cert);
+  ksba_reader_release (r);
+  fclose (fp);
+  xfree (fname);
+
+  err = ksba_get_stats (&stats);
+  if (gpg_err_code (err) == GPG_ERR_NOT_SUPPORTED)
+    return;
+  fail_if_err (err);
+  if (!stats.decoder_calls)
+    fail ("no decoder calls counted");
+  if (!stats.nodes_allocated || stats.nodes_allocated != stats.nodes_freed)
+    fail ("nodes not balanced");
+}
+
+
+int
+main (int argc, char **argv)
+{
+  if (argc)
+    {
+      argc--;  argv++;
+    }
+
+  if (argc && !strcmp (*argv, "--verbose"))
+    {
+      verbose = 1;
+      argc--; argv++;
+    }
+
+
+  if (!argc)
+    {
+      test_crl ();
+      test_nodes ();
+    }
+  else
+    {
+      fputs ("usage: "PGM"\n", stderr);
+      return 1;
+    }
+
+  return 0;
+}
@@ -0,0 +1,295 @@
+/* t-synth.c - Tests for the synthetic object generators
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * KSBA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <errno.h>
+
+#include "../src/ksba.h"
+
+#define PGM "t-synth"
+
+#include "t-common.h"
+
+
+static int verbose;
+
+
+/* Return a new memory writer.  */
+static ksba_writer_t
+new_writer (void)
+{
+  gpg_error_t err;
+  ksba_writer_t w;
+
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_mem (w, 4096);
+  fail_if_err (err);
+  return w;
+}
+
+
+/* Return a reader for the data written to W.  */
+static ksba_reader_t
+new_reader (ksba_writer_t w)
+{
+  gpg_error_t err;
+  ksba_reader_t r;
+  const void *buf;
+  size_t buflen;
+
+  buf = ksba_writer_get_mem (w, &buflen);
+  if (!buf)
+    fail ("nothing written");
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_mem (r, buf, buflen);
+  fail_if_err (err);
+  return r;
+}
+
+
+/* Check that the same seed yields the same object.  */
+static void
+test_reproducible (void)
+{
+  gpg_error_t err;
+  ksba_writer_t w1, w2;
+  const void *buf1, *buf2;
+  size_t len1, len2;
+
+  w1 = new_writer ();
+  w2 = new_writer ();
+  synth_set_seed (1);
+  err = synth_crl (w1, 100);
+  fail_if_err (err);
+  synth_set_seed (1);
+  err = synth_crl (w2, 100);
+  fail_if_err (err);
+  buf1 = ksba_writer_get_mem (w1, &len1);
+  buf2 = ksba_writer_get_mem (w2, &len2);
+  if (len1 != len2 || memcmp (buf1, buf2, len1))
+    fail ("objects differ");
+  ksba_writer_release (w2);
+
+  w2 = new_writer ();
+  synth_set_seed (2);
+  err = synth_crl (w2, 100);
+  fail_if_err (err);
+  buf2 = ksba_writer_get_mem (w2, &len2);
+  if (len1 == len2 && !memcmp (buf1, buf2, len1))
+    fail ("seed is ignored");
+  ksba_writer_release (w2);
+  ksba_writer_release (w1);
+}
+
+
+static void
+test_crl (unsigned int nentries)
+{
+  gpg_error_t err;
+  ksba_writer_t w;
+  ksba_reader_t r;
+  ksba_crl_t crl;
+  ksba_crl_index_t idx;
+  ksba_stop_reason_t stopreason;
+
+  w = new_writer ();
+  err = synth_crl (w, nentries);
+  fail_if_err (err);
+  r = new_reader (w);
+  err = ksba_crl_new (&crl);
+  fail_if_err (err);
+  err = ksba_crl_set_reader (crl, r);
+  fail_if_err (err);
+  err = ksba_crl_index_new (&idx);
+  fail_if_err (err);
+
+  err = ksba_crl_build_index (crl, idx, &stopreason);
+  fail_if_err (err);
+  if (stopreason != KSBA_SR_END_ITEMS)
+    fail ("expected KSBA_SR_END_ITEMS");
+  err = ksba_crl_parse (crl, &stopreason);
+  fail_if_err (err);
+  if (stopreason != KSBA_SR_READY)
+    fail ("expected KSBA_SR_READY");
+  /* All serial numbers are distinct.  */
+  if (ksba_crl_index_count (idx) != nentries)
+    fail ("wrong number of entries");
+  if (verbose)
+    printf ("CRL with %u entries is okay\n", nentries);
+
+  ksba_crl_index_release (idx);
+  ksba_crl_release (crl);
+  ksba_reader_release (r);
+  ksba_writer_release (w);
+}
+
+
+static int
+discard_writer_cb (void *cb_value, const void *buffer, size_t count)
+{
+  (void)cb_value;
+  (void)buffer;
+  (void)count;
+  return 0;
+}
+
+static void
+count_hash (void *arg, const void *buffer, size_t length)
+{
+  unsigned long long *total = arg;
+
+  (void)buffer;
+  *total += length;
+}
+
+
+static void
+test_cms (unsigned long long contentlen)
+{
+  gpg_error_t err;
+  ksba_writer_t w, wout;
+  ksba_reader_t r;
+  ksba_cms_t cms;
+  ksba_stop_reason_t stopreason;
+  unsigned long long total = 0;
+
+  w = new_writer ();
+  err = synth_cms (w, contentlen);
+  fail_if_err (err);
+  r = new_reader (w);
+  err = ksba_writer_new (&wout);
+  fail_if_err (err);
+  err = ksba_writer_set_cb (wout, discard_writer_cb, NULL);
+  fail_if_err (err);
+  err = ksba_cms_new (&cms);
+  fail_if_err (err);
+  err = ksba_cms_set_reader_writer (cms, r, wout);
+  fail_if_err (err);
+  ksba_cms_set_hash_function (cms, count_hash, &total);
+  do
+    {
+      err = ksba_cms_parse (cms, &stopreason);
+      fail_if_err (err);
+    }
+  while (stopreason != KSBA_SR_READY);
+  if (total != contentlen)
+    fail ("wrong number of bytes hashed");
+  if (strcmp (ksba_cms_get_digest_algo (cms, 0), "2.16.840.1.101.3.4.2.1"))
+    fail ("wrong digest algorithm");
+  if (verbose)
+    printf ("CMS with %llu bytes is okay\n", contentlen);
+
+  ksba_cms_release (cms);
+  ksba_writer_release (wout);
+  ksba_reader_release (r);
+  ksba_writer_release (w);
+}
+
+
+static void
+test_cert (unsigned int nextns, unsigned int nrdns)
+{
+  gpg_error_t err;
+  ksba_writer_t w;
+  ksba_cert_t cert;
+  const void *der;
+  size_t derlen;
+  const char *oid;
+  char *subject;
+  char expected[64];
+  int n;
+
+  w = new_writer ();
+  err = synth_cert (w, nextns, nrdns);
+  fail_if_err (err);
+  der = ksba_writer_get_mem (w, &derlen);
+  err = ksba_cert_new (&cert);
+  fail_if_err (err);
+  err = ksba_cert_init_from_mem (cert, der, derlen);
+  fail_if_err (err);
+
+  for (n=0; !(err = ksba_cert_get_extension (cert, n, &oid, NULL,
+                                              NULL, NULL)); n++)
+    {
+      snprintf (expected, sizeof expected, "1.3.6.1.4.1.11591.99.%d", n);
+      if (strcmp (oid, expected))
+        fail ("wrong extension");
+    }
+  if (gpg_err_code (err) != GPG_ERR_EOF || n != (int)nextns)
+    fail ("wrong number of extensions");
+
+  subject = ksba_cert_get_subject (cert, 0);
+  if (!subject)
+    fail ("no subject");
+  if (strncmp (subject, "CN=Synthetic Subject,", 21)
+      || (nrdns && !strstr (subject, ",OU=Unit 0,C=DE"))
+      || (!nrdns && strcmp (subject + 21, "C=DE")))
+    fail ("wrong subject");
+  if (verbose)
+    printf ("certificate with %u extensions and %u RDNs is okay\n",
+            nextns, nrdns + 2);
+
+  xfree (subject);
+  ksba_cert_release (cert);
+  ksba_writer_release (w);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  if (argc)
+    {
+      argc--;  argv++;
+    }
+
+  if (argc && !strcmp (*argv, "--verbose"))
+    {
+      verbose = 1;
+      argc--; argv++;
+    }
+
+
+  if (!argc)
+    {
+      test_reproducible ();
+      test_crl (0);
+      test_crl (1);
+      test_crl (5000);
+      test_cms (0);
+      test_cms (200);
+      test_cms (300000);
+      test_cert (1, 0);
+      test_cert (300, 100);
+    }
+  else
+    {
+      fputs ("usage: "PGM"\n", stderr);
+      return 1;
+    }
+
+  return 0;
+}
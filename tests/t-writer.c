@@ -0,0 +1,557 @@
+/* t-writer.c - basic tests for the writer object
+ *      Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * KSBA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <gpg-error.h>
+
+#include "../src/ksba.h"
+#include "t-common.h"
+
+
+/* Fill BUFFER with LENGTH bytes of a test pattern.  */
+static void
+make_pattern (unsigned char *buffer, size_t length)
+{
+  size_t i;
+
+  for (i=0; i < length; i++)
+    buffer[i] = (i * 7 + (i >> 8)) & 0xff;
+}
+
+
+/* Write the test pattern in chunks of varying sizes to W.  */
+static void
+write_pattern (ksba_writer_t w, const unsigned char *pattern, size_t length)
+{
+  static const size_t chunks[] = { 1, 2, 1, 3, 700, 5, 1, 4000, 2, 9 };
+  size_t off = 0;
+  int i = 0;
+
+  while (off < length)
+    {
+      size_t n = chunks[i++ % (sizeof chunks / sizeof *chunks)];
+      if (n > length - off)
+        n = length - off;
+      fail_if_err (ksba_writer_write (w, pattern + off, n));
+      off += n;
+    }
+  if (ksba_writer_tell (w) != length)
+    fail ("ksba_writer_tell returned a wrong value");
+}
+
+
+struct cb_parm_s
+{
+  unsigned char *buffer;
+  size_t length;
+  int ncalls;
+};
+
+static int
+write_cb (void *cb_value, const void *buffer, size_t count)
+{
+  struct cb_parm_s *parm = cb_value;
+
+  memcpy (parm->buffer + parm->length, buffer, count);
+  parm->length += count;
+  parm->ncalls++;
+  return 0;
+}
+
+
+/* Like write_cb but the second call fails.  */
+static int
+write_cb_fail_once (void *cb_value, const void *buffer, size_t count)
+{
+  struct cb_parm_s *parm = cb_value;
+
+  if (parm->ncalls == 1)
+    {
+      parm->ncalls++;
+      return gpg_error (GPG_ERR_EIO);
+    }
+  return write_cb (cb_value, buffer, count);
+}
+
+
+static void
+test_fd_batched (void)
+{
+  unsigned char pattern[20000];
+  unsigned char readback[sizeof pattern];
+  ksba_writer_t w;
+  FILE *fp;
+  size_t n;
+
+  make_pattern (pattern, sizeof pattern);
+
+  fp = tmpfile ();
+  if (!fp)
+    {
+      perror ("tmpfile() failed");
+      exit (1);
+    }
+
+  fail_if_err (ksba_writer_new (&w));
+  fail_if_err (ksba_writer_set_fd (w, fileno (fp)));
+  fail_if_err (ksba_writer_set_buffer_size (w, 512));
+  write_pattern (w, pattern, sizeof pattern);
+  fail_if_err (ksba_writer_flush (w));
+  ksba_writer_release (w);
+
+  rewind (fp);
+  n = fread (readback, 1, sizeof readback, fp);
+  if (n != sizeof pattern || memcmp (readback, pattern, n))
+    fail ("data written via batched fd writer does not match");
+  fclose (fp);
+}
+
+
+/* Read all data available from the non-blocking FD into BUFFER at
+   offset *R_OFF.  */
+static void
+drain_fd (int fd, unsigned char *buffer, size_t size, size_t *r_off)
+{
+  ssize_t n;
+
+  while (*r_off < size
+         && (n = read (fd, buffer + *r_off, size - *r_off)) > 0)
+    *r_off += n;
+  if (*r_off == size && read (fd, buffer, 1) > 0)
+    fail ("too much data written via batched fd writer");
+}
+
+
+/* Check that a partial write of the batch is not repeated.  */
+static void
+test_fd_partial (void)
+{
+  static unsigned char pattern[300000];
+  static unsigned char readback[sizeof pattern];
+  ksba_writer_t w;
+  int fds[2];
+  size_t off = 0;
+  int i;
+
+  make_pattern (pattern, sizeof pattern);
+  if (pipe (fds)
+      || fcntl (fds[0], F_SETFL, O_NONBLOCK)
+      || fcntl (fds[1], F_SETFL, O_NONBLOCK))
+    {
+      perror ("creating a pipe failed");
+      exit (1);
+    }
+
+  fail_if_err (ksba_writer_new (&w));
+  fail_if_err (ksba_writer_set_fd (w, fds[1]));
+  fail_if_err (ksba_writer_set_buffer_size (w, sizeof pattern));
+  fail_if_err (ksba_writer_write (w, pattern, sizeof pattern));
+  /* The pipe takes only a part of the batch at a time.  */
+  for (i=0; i < 100 && ksba_writer_flush (w); i++)
+    drain_fd (fds[0], readback, sizeof readback, &off);
+  drain_fd (fds[0], readback, sizeof readback, &off);
+  if (!i)
+    fail ("pipe took all data at once");
+  ksba_writer_release (w);
+  drain_fd (fds[0], readback, sizeof readback, &off);
+  if (off != sizeof pattern || memcmp (readback, pattern, off))
+    fail ("data written via partly flushed fd writer does not match");
+  close (fds[0]);
+  close (fds[1]);
+}
+
+
+static void
+test_cb_batched (void)
+{
+  unsigned char pattern[20000];
+  struct cb_parm_s parm;
+  int unbatched_calls;
+  ksba_writer_t w;
+
+  make_pattern (pattern, sizeof pattern);
+  parm.buffer = xmalloc (sizeof pattern);
+
+  /* First without batching to get the number of calls.  */
+  parm.length = 0;
+  parm.ncalls = 0;
+  fail_if_err (ksba_writer_new (&w));
+  fail_if_err (ksba_writer_set_cb (w, write_cb, &parm));
+  write_pattern (w, pattern, sizeof pattern);
+  fail_if_err (ksba_writer_flush (w));
+  ksba_writer_release (w);
+  if (parm.length != sizeof pattern || memcmp (parm.buffer, pattern,
+                                               parm.length))
+    fail ("data written via callback writer does not match");
+  unbatched_calls = parm.ncalls;
+
+  parm.length = 0;
+  parm.ncalls = 0;
+  fail_if_err (ksba_writer_new (&w));
+  fail_if_err (ksba_writer_set_cb (w, write_cb, &parm));
+  fail_if_err (ksba_writer_set_buffer_size (w, 1024));
+  write_pattern (w, pattern, sizeof pattern);
+  fail_if_err (ksba_writer_flush (w));
+  ksba_writer_release (w);
+  if (parm.length != sizeof pattern || memcmp (parm.buffer, pattern,
+                                               parm.length))
+    fail ("data written via batched callback writer does not match");
+  if (parm.ncalls >= unbatched_calls)
+    fail ("batching did not reduce the number of callback calls");
+
+  /* Releasing without a flush does not drop the batched data.  */
+  parm.length = 0;
+  parm.ncalls = 0;
+  fail_if_err (ksba_writer_new (&w));
+  fail_if_err (ksba_writer_set_cb (w, write_cb, &parm));
+  fail_if_err (ksba_writer_set_buffer_size (w, 1024));
+  fail_if_err (ksba_writer_write (w, pattern, 10));
+  if (parm.length)
+    fail ("small write not batched");
+  ksba_writer_release (w);
+  if (parm.length != 10 || memcmp (parm.buffer, pattern, 10))
+    fail ("batched data lost by ksba_writer_release");
+
+  /* A failed large write does not send the batched data again.  */
+  parm.length = 0;
+  parm.ncalls = 0;
+  fail_if_err (ksba_writer_new (&w));
+  fail_if_err (ksba_writer_set_cb (w, write_cb_fail_once, &parm));
+  fail_if_err (ksba_writer_set_buffer_size (w, 1024));
+  fail_if_err (ksba_writer_write (w, pattern, 10));
+  if (!ksba_writer_write (w, pattern + 10, 2000))
+    fail ("failing callback not reported");
+  fail_if_err (ksba_writer_flush (w));
+  ksba_writer_release (w);
+  if (parm.length != 10 || memcmp (parm.buffer, pattern, 10))
+    fail ("batched data sent twice after a failed write");
+
+  xfree (parm.buffer);
+}
+
+
+/* A filter which flips the bits of the data.  */
+static gpg_error_t
+flip_filter (void *arg, const void *inbuf, size_t inlen, size_t *r_nin,
+             void *outbuf, size_t outlen, size_t *r_nout)
+{
+  const unsigned char *src = inbuf;
+  unsigned char *dst = outbuf;
+  size_t n;
+
+  (void)arg;
+  n = inlen < outlen? inlen : outlen;
+  *r_nin = *r_nout = n;
+  while (n--)
+    *dst++ = *src++ ^ 0xff;
+  return 0;
+}
+
+
+static void
+test_cb_filtered (void)
+{
+  unsigned char pattern[20000];
+  unsigned char expected[sizeof pattern];
+  struct cb_parm_s parm;
+  size_t bufsize;
+  size_t i;
+  ksba_writer_t w;
+
+  make_pattern (pattern, sizeof pattern);
+  for (i=0; i < sizeof pattern; i++)
+    expected[i] = pattern[i] ^ 0xff;
+  parm.buffer = xmalloc (sizeof pattern);
+
+  /* Without batching, with a batch buffer too small to be filtered
+     into and with one large enough for that.  */
+  for (bufsize = 0; bufsize <= 8192; bufsize += 4096)
+    {
+      parm.length = 0;
+      parm.ncalls = 0;
+      fail_if_err (ksba_writer_new (&w));
+      fail_if_err (ksba_writer_set_cb (w, write_cb, &parm));
+      if (bufsize)
+        fail_if_err (ksba_writer_set_buffer_size (w, bufsize - 1));
+      fail_if_err (ksba_writer_set_filter (w, flip_filter, NULL));
+      write_pattern (w, pattern, sizeof pattern);
+      fail_if_err (ksba_writer_flush (w));
+      ksba_writer_release (w);
+      if (parm.length != sizeof pattern || memcmp (parm.buffer, expected,
+                                                   parm.length))
+        fail ("data written via filtered writer does not match");
+    }
+
+  xfree (parm.buffer);
+}
+
+
+/* A trivial arena handing out consecutive parts of a static buffer.  */
+struct arena_s
+{
+  unsigned char buffer[30000];
+  size_t used;
+  int nallocs;
+  int nfrees;
+};
+
+static void *
+arena_alloc (void *opaque, size_t n)
+{
+  struct arena_s *arena = opaque;
+  void *p;
+
+  if (n > sizeof arena->buffer - arena->used)
+    return NULL;
+  p = arena->buffer + arena->used;
+  arena->used += n;
+  arena->nallocs++;
+  return p;
+}
+
+static void
+arena_free (void *opaque, void *p)
+{
+  struct arena_s *arena = opaque;
+
+  (void)p;
+  arena->nfrees++;
+}
+
+
+static void
+check_segments (ksba_writer_t w, const unsigned char *pattern, size_t length,
+                size_t segsize)
+{
+  gpg_error_t err;
+  const void *buf;
+  size_t n, off;
+  unsigned int idx;
+
+  off = 0;
+  for (idx=0; !(err = ksba_writer_get_mem_segments (w, idx, &buf, &n)); idx++)
+    {
+      if (n > length - off || memcmp (buf, pattern + off, n))
+        fail ("segment does not match");
+      if (off + n < length && n != segsize)
+        fail ("segment not completely filled");
+      off += n;
+    }
+  if (gpg_err_code (err) != GPG_ERR_EOF)
+    fail_if_err (err);
+  if (off != length)
+    fail ("segments are too short");
+}
+
+
+static void
+test_mem_segments (void)
+{
+  unsigned char pattern[20000];
+  static struct arena_s arena;
+  ksba_writer_t w;
+
+  make_pattern (pattern, sizeof pattern);
+
+  fail_if_err (ksba_writer_new (&w));
+  fail_if_err (ksba_writer_set_mem_segments (w, 1000, NULL, NULL, NULL));
+  write_pattern (w, pattern, sizeof pattern);
+  check_segments (w, pattern, sizeof pattern, 1000);
+  /* Reuse the writer with the arena.  */
+  fail_if_err (ksba_writer_set_mem_segments (w, 4096, arena_alloc,
+                                             arena_free, &arena));
+  write_pattern (w, pattern, sizeof pattern);
+  check_segments (w, pattern, sizeof pattern, 4096);
+  ksba_writer_release (w);
+
+  if (arena.nallocs != 5 || arena.nfrees != 5)
+    fail ("arena has not been used as expected");
+}
+
+
+/* A queue as it may be used to pass the output to another thread.
+   Here the wait function simply acts as the consumer.  */
+struct queue_s
+{
+  struct {
+    void *buffer;
+    size_t length;
+  } items[100];
+  int nitems;
+  size_t queued;
+  size_t max_queued;
+  int nwaits;
+  unsigned char output[30000];
+  size_t outlen;
+};
+
+static gpg_error_t
+queue_put (void *opaque, void *buffer, size_t length, size_t *r_queued)
+{
+  struct queue_s *q = opaque;
+
+  if (q->nitems == sizeof q->items / sizeof *q->items)
+    fail ("queue overflow");
+  q->items[q->nitems].buffer = buffer;
+  q->items[q->nitems].length = length;
+  q->nitems++;
+  q->queued += length;
+  if (q->queued > q->max_queued)
+    q->max_queued = q->queued;
+  *r_queued = q->queued;
+  return 0;
+}
+
+/* Take the first item from queue Q.  */
+static void
+queue_consume (struct queue_s *q)
+{
+  memcpy (q->output + q->outlen, q->items[0].buffer, q->items[0].length);
+  q->outlen += q->items[0].length;
+  q->queued -= q->items[0].length;
+  ksba_free (q->items[0].buffer);
+  q->nitems--;
+  memmove (q->items, q->items + 1, q->nitems * sizeof *q->items);
+}
+
+static gpg_error_t
+queue_wait (void *opaque, size_t low_water)
+{
+  struct queue_s *q = opaque;
+
+  q->nwaits++;
+  while (q->queued > low_water)
+    queue_consume (q);
+  return 0;
+}
+
+
+static void
+test_queue (void)
+{
+  unsigned char pattern[20000];
+  static struct queue_s q;
+  ksba_writer_t w;
+
+  make_pattern (pattern, sizeof pattern);
+
+  fail_if_err (ksba_writer_new (&w));
+  fail_if_err (ksba_writer_set_queue (w, 1000, queue_put, queue_wait, &q,
+                                      4000, 1000));
+  write_pattern (w, pattern, sizeof pattern);
+  fail_if_err (ksba_writer_flush (w));
+  ksba_writer_release (w);
+  while (q.nitems)
+    queue_consume (&q);
+
+  if (q.outlen != sizeof pattern || memcmp (q.output, pattern, q.outlen))
+    fail ("data written via queue does not match");
+  if (q.max_queued > 4000)
+    fail ("queue grew beyond its high water mark");
+  if (!q.nwaits)
+    fail ("queue wait function not called");
+}
+
+
+static int ctx_nalloc;
+
+static void *
+ctx_alloc (void *opaque, size_t n)
+{
+  (void)opaque;
+  ctx_nalloc++;
+  return malloc (n);
+}
+
+static void *
+ctx_realloc (void *opaque, void *p, size_t n)
+{
+  (void)opaque;
+  ctx_nalloc++;
+  return realloc (p, n);
+}
+
+static void
+ctx_free (void *opaque, void *p)
+{
+  (void)opaque;
+  (void)p;
+  fail ("queue buffer released using the allocator context");
+}
+
+
+/* Queue buffers are not taken from the producer's allocator
+   context.  */
+static void
+test_queue_ctx (void)
+{
+  gpg_error_t err;
+  unsigned char pattern[20000];
+  static struct queue_s q;
+  ksba_alloc_ctx_t ctx, prev;
+  ksba_writer_t w;
+
+  err = ksba_alloc_ctx_new (&ctx, ctx_alloc, ctx_realloc, ctx_free, NULL);
+  if (gpg_err_code (err) == GPG_ERR_NOT_SUPPORTED)
+    return;
+  fail_if_err (err);
+  make_pattern (pattern, sizeof pattern);
+
+  fail_if_err (ksba_writer_new (&w));
+  fail_if_err (ksba_writer_set_queue (w, 1000, queue_put, queue_wait, &q,
+                                      4000, 1000));
+  prev = ksba_alloc_ctx_enter (ctx);
+  write_pattern (w, pattern, sizeof pattern);
+  fail_if_err (ksba_writer_flush (w));
+  ksba_alloc_ctx_enter (prev);
+  ksba_writer_release (w);
+  while (q.nitems)
+    queue_consume (&q);
+  ksba_alloc_ctx_release (ctx);
+
+  if (ctx_nalloc)
+    fail ("queue buffer allocated using the allocator context");
+  if (q.outlen != sizeof pattern || memcmp (q.output, pattern, q.outlen))
+    fail ("data written via queue does not match");
+}
+
+
+int
+main (int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+
+  test_fd_batched ();
+  test_fd_partial ();
+  test_cb_batched ();
+  test_cb_filtered ();
+  test_mem_segments ();
+  test_queue ();
+  test_queue_ctx ();
+
+  return 0;
+}